@@ -0,0 +1,173 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "bench.h"
+
+static struct
+{
+	char *name;
+	swBench_Func func;
+} swBench_list[SW_BENCH_MAX];
+
+static int swBench_num;
+
+void _swBench_setup(swBench_Func func, char *name)
+{
+	if (swBench_num == SW_BENCH_MAX)
+	{
+		swWarn("too many benchmarks.");
+		return;
+	}
+	swBench_list[swBench_num].name = name;
+	swBench_list[swBench_num].func = func;
+	swBench_num++;
+}
+
+/**
+ * bench [-d ms] [-n fd_num] [-a active_num] [name_prefix ...] [key=value ...]
+ * 没有指定名字时全部运行, loadgen需要单独指定
+ */
+int swBench_run(swBench *object)
+{
+	int i, j, ran, ret = SW_OK;
+	char **names;
+	int name_num;
+	int opt;
+
+	while ((opt = getopt(object->argc, object->argv, "d:n:a:l")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			object->duration = atoi(optarg);
+			break;
+		case 'n':
+			object->fd_num = atoi(optarg);
+			break;
+		case 'a':
+			object->active_num = atoi(optarg);
+			break;
+		case 'l':
+			for (i = 0; i < swBench_num; i++)
+			{
+				printf("%s\n", swBench_list[i].name);
+			}
+			return SW_OK;
+		default:
+			printf("Usage: %s [-d ms] [-n fd_num] [-a active_num] [-l] [name ...] [key=value ...]\n", object->argv[0]);
+			return SW_ERR;
+		}
+	}
+	names = object->argv + optind;
+	name_num = 0;
+	object->params = sw_calloc(object->argc, sizeof(char *));
+	if (object->params == NULL)
+	{
+		return SW_ERR;
+	}
+	for (i = optind; i < object->argc; i++)
+	{
+		if (strchr(object->argv[i], '=') != NULL)
+		{
+			object->params[object->param_num++] = object->argv[i];
+		}
+		else
+		{
+			names[name_num++] = object->argv[i];
+		}
+	}
+
+	printf("%-40s %14s %10s %10s %10s %10s %10s\n", "name", "ops/s", "p50", "p90", "p99", "p99.9", "max");
+	//fork之前必须清空缓存, 否则子进程退出时会再输出一次
+	fflush(stdout);
+	for (i = 0; i < swBench_num; i++)
+	{
+		ran = (name_num == 0 && strcmp(swBench_list[i].name, "loadgen") != 0);
+		for (j = 0; j < name_num && !ran; j++)
+		{
+			ran = strncmp(names[j], swBench_list[i].name, strlen(names[j])) == 0;
+		}
+		if (!ran)
+		{
+			continue;
+		}
+		if (swBench_list[i].func(object) < 0)
+		{
+			printf("%-40s failed\n", swBench_list[i].name);
+			ret = SW_ERR;
+		}
+		fflush(stdout);
+	}
+	return ret;
+}
+
+char* swBench_param(swBench *object, char *key, char *default_value)
+{
+	int i, len = strlen(key);
+
+	for (i = 0; i < object->param_num; i++)
+	{
+		if (strncmp(object->params[i], key, len) == 0 && object->params[i][len] == '=')
+		{
+			return object->params[i] + len + 1;
+		}
+	}
+	return default_value;
+}
+
+/**
+ * 一批操作可能不到1微秒, 批次用纳秒计时
+ */
+static inline uint64_t swBench_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void swBench_start(swBench *object, swBench_result *timer)
+{
+	bzero(timer, sizeof(swBench_result));
+	timer->start = swClock_usec();
+	timer->end = timer->start + object->duration * 1000;
+	timer->last = swBench_nsec();
+}
+
+int swBench_batch(swBench_result *timer, uint32_t n)
+{
+	uint64_t now = swBench_nsec();
+	uint64_t nsec = (now - timer->last) / n;
+
+	swHistogram_record(&timer->latency, nsec > UINT32_MAX ? UINT32_MAX : (uint32_t) nsec);
+	timer->ops += n;
+	timer->last = now;
+	return now / 1000 < timer->end;
+}
+
+void swBench_report(swBench_result *timer, char *name, char *unit)
+{
+	uint64_t usec = swClock_usec() - timer->start;
+	swHistogram *h = &timer->latency;
+
+	if (usec == 0)
+	{
+		usec = 1;
+	}
+	printf("%-40s %14.0f %10lu %10lu %10lu %10lu %10lu %s\n", name, (double) timer->ops * 1000000 / usec,
+			(unsigned long) swHistogram_percentile(h, 50), (unsigned long) swHistogram_percentile(h, 90),
+			(unsigned long) swHistogram_percentile(h, 99), (unsigned long) swHistogram_percentile(h, 99.9),
+			(unsigned long) h->max, unit);
+}
@@ -0,0 +1,104 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef SW_BENCH_H_
+#define SW_BENCH_H_
+
+#include "swoole.h"
+
+#define swBench(x)           int swBench_##x(swBench *object)
+#define swBench_setup(x)     _swBench_setup(swBench_##x, #x)
+
+#define SW_BENCH_MAX         64
+#define SW_BENCH_DURATION    1000     //每一项默认运行的时间, 毫秒
+#define SW_BENCH_RING_SIZE   (1024 * 64)
+
+typedef struct _swBench
+{
+	int argc;
+	char **argv;
+	uint32_t duration;   //-d, 毫秒
+	uint32_t fd_num;     //-n, reactor测试注册的fd数量
+	uint32_t active_num; //-a, 其中活跃的fd数量
+	char **params;       //命令行中的key=value
+	int param_num;
+} swBench;
+
+typedef int (*swBench_Func)(swBench *object);
+
+/**
+ * 计时和结果, 微基准按批次计时, latency为批次内每次操作的平均纳秒数
+ * IPC和压测客户端逐次计时, latency为往返的微秒数
+ */
+typedef struct _swBench_result
+{
+	uint64_t start;
+	uint64_t last;    //上一批结束的时间, 纳秒
+	uint64_t end;
+	uint64_t ops;
+	swHistogram latency;
+} swBench_result;
+
+void _swBench_setup(swBench_Func func, char *name);
+int swBench_run(swBench *object);
+char* swBench_param(swBench *object, char *key, char *default_value);
+void swBench_start(swBench *object, swBench_result *timer);
+/**
+ * 完成一批n次操作, 运行时间未到时返回1
+ */
+int swBench_batch(swBench_result *timer, uint32_t n);
+/**
+ * 逐次计时, latency为微秒
+ */
+static inline void swBench_record(swBench_result *timer, uint64_t usec)
+{
+	timer->ops++;
+	swHistogram_record(&timer->latency, usec > UINT32_MAX ? UINT32_MAX : (uint32_t) usec);
+}
+static inline int swBench_running(swBench_result *timer)
+{
+	return swClock_usec() < timer->end;
+}
+void swBench_report(swBench_result *timer, char *name, char *unit);
+
+//-----------------------------------------------
+//load generator
+#define SW_BENCH_PIPELINE_MAX   64
+
+enum swBench_protocol
+{
+	SW_BENCH_ECHO = 0,     //原样返回
+	SW_BENCH_LENGTH,       //4字节网络字节序的包体长度 + 包体, 服务器返回整个包
+};
+
+typedef struct _swBench_load
+{
+	char *host;
+	int port;
+	int conn_num;
+	int thread_num;
+	int protocol;
+	int size;       //每个请求的字节数, 包括长度头
+	int pipeline;   //每个连接同时发出的请求数
+} swBench_load;
+
+/**
+ * 多线程epoll客户端, 每个线程有自己的epoll和连接, latency为请求到收齐响应的微秒数
+ */
+int swBench_load_run(swBench *object, swBench_load *load, char *name);
+void swBench_load_init(swBench *object, swBench_load *load);
+
+#endif /* SW_BENCH_H_ */
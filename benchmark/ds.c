@@ -0,0 +1,179 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "bench.h"
+#include "RingQueue.h"
+
+/**
+ * 单线程的微基准, 每批先写入SW_BENCH_BATCH个再全部取出, latency为每次操作的平均纳秒数
+ */
+#define SW_BENCH_BATCH        64
+#define SW_BENCH_SLAB_SIZE    64
+
+swBench(channel)
+{
+	swChannel *chan;
+	swBench_result timer;
+	char item[SW_BENCH_SLAB_SIZE];
+	int i;
+
+	//worker之间共享时的配置
+	chan = swChannel_create(1024 * 128, 1024, SW_CHAN_LOCK | SW_CHAN_SHM);
+	if (chan == NULL)
+	{
+		return SW_ERR;
+	}
+	memset(item, 'x', sizeof(item));
+	swBench_start(object, &timer);
+	do
+	{
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			swChannel_push(chan, item, sizeof(item));
+		}
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			swChannel_pop(chan, item, sizeof(item));
+		}
+	}
+	while (swBench_batch(&timer, SW_BENCH_BATCH * 2));
+	swBench_report(&timer, "channel push/pop size=64", "ns/op");
+	swChannel_free(chan);
+	return SW_OK;
+}
+
+swBench(ringqueue)
+{
+	swRingQueue queue;
+	swBench_result timer;
+	void *data;
+	long i;
+
+	if (swRingQueue_init(&queue, SW_BENCH_BATCH) < 0)
+	{
+		return SW_ERR;
+	}
+	swBench_start(object, &timer);
+	do
+	{
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			swRingQueue_push(&queue, (void *) i);
+		}
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			swRingQueue_pop(&queue, &data);
+		}
+	}
+	while (swBench_batch(&timer, SW_BENCH_BATCH * 2));
+	swBench_report(&timer, "ringqueue push/pop", "ns/op");
+	swRingQueue_free(&queue);
+	return SW_OK;
+}
+
+swBench(mempool)
+{
+	swMemoryPool pool;
+	swBench_result timer;
+	void *items[SW_BENCH_BATCH];
+	int i;
+
+	if (swMemoryPool_create(&pool, 1024 * 1024 * 64, SW_BENCH_SLAB_SIZE) < 0)
+	{
+		return SW_ERR;
+	}
+	swBench_start(object, &timer);
+	do
+	{
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			items[i] = swMemoryPool_alloc(&pool);
+		}
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			swMemoryPool_free(&pool, items[i]);
+		}
+	}
+	while (swBench_batch(&timer, SW_BENCH_BATCH * 2));
+	swBench_report(&timer, "mempool alloc/free size=64", "ns/op");
+	return SW_OK;
+}
+
+swBench(malloc)
+{
+	swBench_result timer;
+	void *items[SW_BENCH_BATCH];
+	int i;
+
+	swBench_start(object, &timer);
+	do
+	{
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			items[i] = sw_malloc(SW_BENCH_SLAB_SIZE);
+		}
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			sw_free(items[i]);
+		}
+	}
+	while (swBench_batch(&timer, SW_BENCH_BATCH * 2));
+	swBench_report(&timer, "malloc alloc/free size=64", "ns/op");
+	return SW_OK;
+}
+
+static void timer_bench_callback(swTimer *timer, swTimer_node *node)
+{
+
+}
+
+swBench(timer)
+{
+	swTimer timer;
+	swBench_result bench_result;
+	int ids[SW_BENCH_BATCH];
+	int i;
+	uint32_t seed = 1;
+
+	bzero(&timer, sizeof(timer));
+	if (swTimer_create(&timer, 1000) < 0)
+	{
+		return SW_ERR;
+	}
+	//堆中常驻1万个定时器
+	for (i = 0; i < 10000; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		swTimer_set(&timer, 60000 + seed % 60000, 0, NULL, timer_bench_callback);
+	}
+	swBench_start(object, &bench_result);
+	do
+	{
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			ids[i] = swTimer_set(&timer, 60000 + seed % 60000, 0, NULL, timer_bench_callback);
+		}
+		for (i = 0; i < SW_BENCH_BATCH; i++)
+		{
+			swTimer_clear(&timer, ids[i]);
+		}
+	}
+	while (swBench_batch(&bench_result, SW_BENCH_BATCH * 2));
+	swBench_report(&bench_result, "timer set/clear heap=10000", "ns/op");
+	swTimer_free(&timer);
+	return SW_OK;
+}
@@ -0,0 +1,224 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "bench.h"
+
+/**
+ * reactor线程和worker之间的三种IPC方式, 父子进程之间ping-pong
+ * latency为一次往返的微秒数, 第一个字节为'q'时子进程退出
+ */
+static int ipc_bench_size[] = { 64, 4096 };
+
+#define SW_BENCH_IPC_SIZE_NUM   (sizeof(ipc_bench_size) / sizeof(ipc_bench_size[0]))
+
+static void ipc_bench_report(swBench_result *timer, char *type, int size)
+{
+	char name[128];
+	snprintf(name, sizeof(name), "ipc_%s size=%d", type, size);
+	swBench_report(timer, name, "us/rtt");
+}
+
+swBench(ipc_unsock)
+{
+	swPipe pipe;
+	swBench_result timer;
+	char buf[SW_BUFFER_SIZE];
+	int i, n, size, parent, child;
+	uint64_t start;
+	pid_t pid;
+
+	for (i = 0; i < SW_BENCH_IPC_SIZE_NUM; i++)
+	{
+		size = ipc_bench_size[i];
+		//和worker的管道一样使用SOCK_DGRAM
+		if (swPipeUnsock_create(&pipe, 1, SOCK_DGRAM) < 0)
+		{
+			return SW_ERR;
+		}
+		parent = pipe.getFd(&pipe, 0);
+		child = pipe.getFd(&pipe, 1);
+		pid = fork();
+		if (pid < 0)
+		{
+			return SW_ERR;
+		}
+		else if (pid == 0)
+		{
+			while ((n = read(child, buf, sizeof(buf))) > 0 && buf[0] != 'q')
+			{
+				write(child, buf, n);
+			}
+			_exit(0);
+		}
+		memset(buf, 'x', size);
+		swBench_start(object, &timer);
+		while (swBench_running(&timer))
+		{
+			start = swClock_usec();
+			write(parent, buf, size);
+			if (read(parent, buf, sizeof(buf)) != size)
+			{
+				break;
+			}
+			swBench_record(&timer, swClock_usec() - start);
+		}
+		buf[0] = 'q';
+		write(parent, buf, 1);
+		waitpid(pid, NULL, 0);
+		pipe.close(&pipe);
+		ipc_bench_report(&timer, "unsock", size);
+	}
+	return SW_OK;
+}
+
+swBench(ipc_msgqueue)
+{
+	swQueue queue;
+	swBench_result timer;
+	swQueue_data data;
+	int i, n, size;
+	uint64_t start;
+	pid_t pid;
+
+	for (i = 0; i < SW_BENCH_IPC_SIZE_NUM; i++)
+	{
+		size = ipc_bench_size[i];
+		if (swQueueMsg_create(&queue, 1, IPC_PRIVATE, 1) < 0)
+		{
+			swWarn("swQueueMsg_create() failed. Error: %s[%d]", strerror(errno), errno);
+			return SW_ERR;
+		}
+		pid = fork();
+		if (pid < 0)
+		{
+			return SW_ERR;
+		}
+		//mtype=1为请求, mtype=2为响应
+		else if (pid == 0)
+		{
+			while (1)
+			{
+				data.mtype = 1;
+				n = queue.out(&queue, &data, sizeof(data.mdata));
+				if (n < 0 || data.mdata[0] == 'q')
+				{
+					break;
+				}
+				data.mtype = 2;
+				queue.in(&queue, &data, n);
+			}
+			_exit(0);
+		}
+		memset(data.mdata, 'x', size);
+		swBench_start(object, &timer);
+		while (swBench_running(&timer))
+		{
+			start = swClock_usec();
+			data.mtype = 1;
+			data.mdata[0] = 'x';
+			queue.in(&queue, &data, size);
+			data.mtype = 2;
+			if (queue.out(&queue, &data, sizeof(data.mdata)) != size)
+			{
+				break;
+			}
+			swBench_record(&timer, swClock_usec() - start);
+		}
+		data.mtype = 1;
+		data.mdata[0] = 'q';
+		queue.in(&queue, &data, 1);
+		waitpid(pid, NULL, 0);
+		queue.free(&queue);
+		ipc_bench_report(&timer, "msgqueue", size);
+	}
+	return SW_OK;
+}
+
+swBench(ipc_ring)
+{
+	swRingBuffer *request, *response;
+	swPipe request_notify, response_notify;
+	swBench_result timer;
+	char buf[SW_BUFFER_SIZE], *ptr;
+	int i, size, length, quit;
+	uint64_t flag = 1, start;
+	pid_t pid;
+
+	for (i = 0; i < SW_BENCH_IPC_SIZE_NUM; i++)
+	{
+		size = ipc_bench_size[i];
+		//和SW_WORKER_IPC_MODE=3一样, 共享内存的ring加上eventfd通知
+		request = swRingBuffer_create(SW_BENCH_RING_SIZE, 1);
+		response = swRingBuffer_create(SW_BENCH_RING_SIZE, 1);
+		if (request == NULL || response == NULL)
+		{
+			return SW_ERR;
+		}
+		if (swPipeNotify_auto(&request_notify, 1, 0) < 0 || swPipeNotify_auto(&response_notify, 1, 0) < 0)
+		{
+			return SW_ERR;
+		}
+		pid = fork();
+		if (pid < 0)
+		{
+			return SW_ERR;
+		}
+		else if (pid == 0)
+		{
+			for (quit = 0; !quit;)
+			{
+				request_notify.read(&request_notify, &flag, sizeof(flag));
+				while ((ptr = swRingBuffer_front(request, &length)) != NULL)
+				{
+					quit = ptr[0] == 'q';
+					while (!quit && swRingBuffer_push(response, ptr, length) < 0)
+					{
+						swYield();
+					}
+					swRingBuffer_pop(request);
+				}
+				response_notify.write(&response_notify, &flag, sizeof(flag));
+			}
+			_exit(0);
+		}
+		memset(buf, 'x', size);
+		swBench_start(object, &timer);
+		while (swBench_running(&timer))
+		{
+			start = swClock_usec();
+			swRingBuffer_push(request, buf, size);
+			request_notify.write(&request_notify, &flag, sizeof(flag));
+			response_notify.read(&response_notify, &flag, sizeof(flag));
+			ptr = swRingBuffer_front(response, &length);
+			if (ptr == NULL || length != size)
+			{
+				break;
+			}
+			swRingBuffer_pop(response);
+			swBench_record(&timer, swClock_usec() - start);
+		}
+		buf[0] = 'q';
+		swRingBuffer_push(request, buf, 1);
+		request_notify.write(&request_notify, &flag, sizeof(flag));
+		waitpid(pid, NULL, 0);
+		request_notify.close(&request_notify);
+		response_notify.close(&response_notify);
+		swRingBuffer_free(request);
+		swRingBuffer_free(response);
+		ipc_bench_report(&timer, "ring", size);
+	}
+	return SW_OK;
+}
@@ -0,0 +1,310 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "bench.h"
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+
+typedef struct _swBench_conn
+{
+	int fd;
+	uint8_t connected;
+	uint32_t send_offset;   //当前请求已发送的字节数
+	uint32_t send_queue;    //还没有开始发送的请求数
+	uint32_t recv_length;   //当前响应已收到的字节数
+	uint32_t inflight;
+	uint32_t head;
+	uint64_t start[SW_BENCH_PIPELINE_MAX]; //每个请求的发送时间, 响应按顺序返回
+} swBench_conn;
+
+typedef struct _swBench_thread
+{
+	pthread_t tid;
+	swBench_load *load;
+	swBench_result timer;
+	struct sockaddr_in addr;
+	uint64_t end;
+	char *request;
+	int conn_num;
+	int errors;
+} swBench_thread;
+
+static void swBench_conn_close(swBench_thread *thread, int epfd, swBench_conn *conn)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+	conn->fd = -1;
+	thread->errors++;
+}
+
+/**
+ * 发送积压的请求, 发送缓存区满时等待EPOLLOUT
+ */
+static int swBench_conn_flush(swBench_thread *thread, int epfd, swBench_conn *conn)
+{
+	struct epoll_event ev;
+	int n, size = thread->load->size;
+
+	while (conn->send_queue > 0)
+	{
+		if (conn->send_offset == 0)
+		{
+			conn->start[(conn->head + conn->inflight) % SW_BENCH_PIPELINE_MAX] = swClock_usec();
+		}
+		n = send(conn->fd, thread->request + conn->send_offset, size - conn->send_offset, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EAGAIN)
+			{
+				ev.events = EPOLLIN | EPOLLOUT;
+				ev.data.ptr = conn;
+				return epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+			}
+			return SW_ERR;
+		}
+		//开始发送后才算发出的请求
+		if (conn->send_offset == 0)
+		{
+			conn->inflight++;
+		}
+		conn->send_offset += n;
+		if (conn->send_offset == size)
+		{
+			conn->send_offset = 0;
+			conn->send_queue--;
+		}
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = conn;
+	return epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+static int swBench_conn_read(swBench_thread *thread, swBench_conn *conn, char *buf, int buf_size)
+{
+	int n, size = thread->load->size;
+	uint64_t now;
+
+	n = recv(conn->fd, buf, buf_size, 0);
+	if (n < 0)
+	{
+		return errno == EAGAIN ? SW_OK : SW_ERR;
+	}
+	else if (n == 0)
+	{
+		return SW_ERR;
+	}
+	//响应和请求一样长, 按字节数划分
+	conn->recv_length += n;
+	now = swClock_usec();
+	while (conn->recv_length >= size && conn->inflight > 0)
+	{
+		conn->recv_length -= size;
+		swBench_record(&thread->timer, now - conn->start[conn->head]);
+		conn->head = (conn->head + 1) % SW_BENCH_PIPELINE_MAX;
+		conn->inflight--;
+		//保持pipeline深度
+		if (now < thread->end)
+		{
+			conn->send_queue++;
+		}
+	}
+	return SW_OK;
+}
+
+static void* swBench_load_thread(void *arg)
+{
+	swBench_thread *thread = arg;
+	swBench_load *load = thread->load;
+	swBench_conn *conns, *conn;
+	struct epoll_event ev, events[SW_REACTOR_MAXEVENTS];
+	char buf[SW_BUFFER_SIZE];
+	int epfd, i, n, opt = 1, alive;
+
+	epfd = epoll_create(512);
+	conns = sw_calloc(thread->conn_num, sizeof(swBench_conn));
+	if (epfd < 0 || conns == NULL)
+	{
+		thread->errors = thread->conn_num;
+		return NULL;
+	}
+	for (i = 0; i < thread->conn_num; i++)
+	{
+		conn = &conns[i];
+		conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (conn->fd < 0)
+		{
+			thread->errors++;
+			continue;
+		}
+		swSetNonBlock(conn->fd);
+		setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+		if (connect(conn->fd, (struct sockaddr *) &thread->addr, sizeof(thread->addr)) < 0 && errno != EINPROGRESS)
+		{
+			close(conn->fd);
+			conn->fd = -1;
+			thread->errors++;
+			continue;
+		}
+		ev.events = EPOLLOUT;
+		ev.data.ptr = conn;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, conn->fd, &ev);
+	}
+
+	while (1)
+	{
+		n = epoll_wait(epfd, events, SW_REACTOR_MAXEVENTS, 100);
+		for (i = 0; i < n; i++)
+		{
+			conn = events[i].data.ptr;
+			if (conn->fd < 0)
+			{
+				continue;
+			}
+			if (events[i].events & (EPOLLERR | EPOLLHUP))
+			{
+				swBench_conn_close(thread, epfd, conn);
+				continue;
+			}
+			if (!conn->connected && (events[i].events & EPOLLOUT))
+			{
+				conn->connected = 1;
+				conn->send_queue = load->pipeline;
+			}
+			if ((events[i].events & EPOLLIN) && swBench_conn_read(thread, conn, buf, sizeof(buf)) < 0)
+			{
+				swBench_conn_close(thread, epfd, conn);
+				continue;
+			}
+			if (conn->send_queue > 0 && swBench_conn_flush(thread, epfd, conn) < 0)
+			{
+				swBench_conn_close(thread, epfd, conn);
+			}
+		}
+		if (swClock_usec() < thread->end)
+		{
+			continue;
+		}
+		//结束后等待已发出的请求返回
+		for (i = 0, alive = 0; i < thread->conn_num; i++)
+		{
+			alive += conns[i].fd >= 0 && conns[i].inflight > 0;
+		}
+		if (alive == 0 || swClock_usec() > thread->end + 1000000)
+		{
+			break;
+		}
+	}
+	for (i = 0; i < thread->conn_num; i++)
+	{
+		if (conns[i].fd >= 0)
+		{
+			close(conns[i].fd);
+		}
+	}
+	close(epfd);
+	sw_free(conns);
+	return NULL;
+}
+
+void swBench_load_init(swBench *object, swBench_load *load)
+{
+	load->host = swBench_param(object, "host", "127.0.0.1");
+	load->port = atoi(swBench_param(object, "port", "9501"));
+	load->conn_num = atoi(swBench_param(object, "conn", "64"));
+	load->thread_num = atoi(swBench_param(object, "thread", "2"));
+	load->protocol = strcmp(swBench_param(object, "proto", "echo"), "length") == 0 ? SW_BENCH_LENGTH : SW_BENCH_ECHO;
+	load->size = atoi(swBench_param(object, "size", "64"));
+	load->pipeline = atoi(swBench_param(object, "pipeline", "1"));
+}
+
+int swBench_load_run(swBench *object, swBench_load *load, char *name)
+{
+	swBench_thread *threads;
+	swBench_result timer;
+	uint32_t body;
+	char *request;
+	int i, errors = 0;
+
+	if (load->thread_num < 1 || load->conn_num < load->thread_num || load->size < 5 || load->size > SW_BUFFER_SIZE
+			|| load->pipeline < 1 || load->pipeline > SW_BENCH_PIPELINE_MAX)
+	{
+		swWarn("invalid options. conn >= thread >= 1, 5 <= size <= %lu, 1 <= pipeline <= %d", (unsigned long) SW_BUFFER_SIZE,
+				SW_BENCH_PIPELINE_MAX);
+		return SW_ERR;
+	}
+	request = sw_malloc(load->size);
+	threads = sw_calloc(load->thread_num, sizeof(swBench_thread));
+	if (request == NULL || threads == NULL)
+	{
+		return SW_ERR;
+	}
+	memset(request, 'x', load->size);
+	if (load->protocol == SW_BENCH_LENGTH)
+	{
+		body = htonl(load->size - 4);
+		memcpy(request, &body, sizeof(body));
+	}
+
+	swBench_start(object, &timer);
+	for (i = 0; i < load->thread_num; i++)
+	{
+		threads[i].load = load;
+		threads[i].request = request;
+		threads[i].end = timer.end;
+		threads[i].conn_num = load->conn_num / load->thread_num + (i < load->conn_num % load->thread_num);
+		threads[i].addr.sin_family = AF_INET;
+		threads[i].addr.sin_port = htons(load->port);
+		inet_pton(AF_INET, load->host, &threads[i].addr.sin_addr);
+		pthread_create(&threads[i].tid, NULL, swBench_load_thread, &threads[i]);
+	}
+	for (i = 0; i < load->thread_num; i++)
+	{
+		pthread_join(threads[i].tid, NULL);
+		swHistogram_merge(&timer.latency, &threads[i].timer.latency);
+		timer.ops += threads[i].timer.ops;
+		errors += threads[i].errors;
+	}
+	swBench_report(&timer, name, "us/req");
+	if (errors > 0)
+	{
+		printf("%-40s errors=%d\n", "", errors);
+	}
+	sw_free(threads);
+	sw_free(request);
+	return timer.ops > 0 ? SW_OK : SW_ERR;
+}
+
+#endif
+
+/**
+ * bench -d 10000 loadgen host=127.0.0.1 port=9501 conn=64 thread=2 proto=echo|length size=64 pipeline=1
+ */
+swBench(loadgen)
+{
+#ifdef HAVE_EPOLL
+	swBench_load load;
+	char name[128];
+
+	swBench_load_init(object, &load);
+	snprintf(name, sizeof(name), "loadgen %s:%d conn=%d size=%d", load.host, load.port, load.conn_num, load.size);
+	return swBench_load_run(object, &load, name);
+#else
+	printf("%-40s skipped\n", "loadgen");
+	return SW_OK;
+#endif
+}
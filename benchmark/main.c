@@ -0,0 +1,73 @@
+#include "swoole.h"
+#include "bench.h"
+#include <sys/resource.h>
+
+swBench(reactor_epoll);
+swBench(reactor_poll);
+swBench(reactor_select);
+swBench(reactor_kqueue);
+swBench(reactor_uring);
+
+swBench(ipc_unsock);
+swBench(ipc_msgqueue);
+swBench(ipc_ring);
+
+swBench(channel);
+swBench(ringqueue);
+swBench(mempool);
+swBench(malloc);
+swBench(timer);
+
+swBench(parser_length);
+swBench(parser_eof);
+
+swBench(server_echo);
+swBench(server_length);
+swBench(loadgen);
+
+int main(int argc, char **argv)
+{
+	swBench bench;
+	struct rlimit rlmt;
+
+	swoole_init();
+	SwooleG.running = 1;
+	//reactor测试每个fd需要一对socket
+	if (getrlimit(RLIMIT_NOFILE, &rlmt) == 0 && rlmt.rlim_cur < rlmt.rlim_max)
+	{
+		rlmt.rlim_cur = rlmt.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlmt);
+	}
+
+	bzero(&bench, sizeof(bench));
+	bench.argc = argc;
+	bench.argv = argv;
+	bench.duration = SW_BENCH_DURATION;
+	bench.fd_num = 1000;
+	bench.active_num = 10;
+
+	swBench_setup(reactor_epoll);
+	swBench_setup(reactor_poll);
+	swBench_setup(reactor_select);
+	swBench_setup(reactor_kqueue);
+	swBench_setup(reactor_uring);
+
+	swBench_setup(ipc_unsock);
+	swBench_setup(ipc_msgqueue);
+	swBench_setup(ipc_ring);
+
+	swBench_setup(channel);
+	swBench_setup(ringqueue);
+	swBench_setup(mempool);
+	swBench_setup(malloc);
+	swBench_setup(timer);
+
+	swBench_setup(parser_length);
+	swBench_setup(parser_eof);
+
+	swBench_setup(server_echo);
+	swBench_setup(server_length);
+	swBench_setup(loadgen);
+
+	return swBench_run(&bench) < 0 ? 1 : 0;
+}
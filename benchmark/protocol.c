@@ -0,0 +1,131 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "bench.h"
+#include "Server.h"
+
+/**
+ * reactor线程收到64K数据后的分包, 和ReactorThread.c中的扫描方式相同
+ * latency为每个包的平均纳秒数
+ */
+#define SW_BENCH_PARSER_BUFSIZE   (1024 * 64)
+
+static int parser_bench_size[] = { 64, 1024 };
+
+#define SW_BENCH_PARSER_SIZE_NUM   (sizeof(parser_bench_size) / sizeof(parser_bench_size[0]))
+
+swBench(parser_length)
+{
+	swServer serv;
+	swPackage_length_parser parser;
+	swPackage_range packages[SW_PACKAGE_PARSE_MAX];
+	swBench_result timer;
+	char *buf, *ptr, name[128];
+	uint32_t length, need, total, body;
+	int i, n, num, size;
+
+	buf = sw_malloc(SW_BENCH_PARSER_BUFSIZE);
+	if (buf == NULL)
+	{
+		return SW_ERR;
+	}
+	swServer_init(&serv);
+	serv.package_length_type = SW_NUM_NET;
+	serv.package_length_offset = 0;
+	serv.package_body_start = 4;
+	parser = swPackage_get_length_parser(serv.package_length_type);
+
+	for (i = 0; i < SW_BENCH_PARSER_SIZE_NUM; i++)
+	{
+		size = parser_bench_size[i];
+		body = htonl(size - 4);
+		for (total = 0, num = 0; total + size <= SW_BENCH_PARSER_BUFSIZE; total += size, num++)
+		{
+			memcpy(buf + total, &body, sizeof(body));
+			memset(buf + total + 4, 'x', size - 4);
+		}
+		swBench_start(object, &timer);
+		do
+		{
+			ptr = buf;
+			length = total;
+			do
+			{
+				n = parser(&serv, ptr, length, packages, SW_PACKAGE_PARSE_MAX, &need);
+				if (n <= 0)
+				{
+					break;
+				}
+				ptr += packages[n - 1].offset + packages[n - 1].length;
+				length -= packages[n - 1].offset + packages[n - 1].length;
+			}
+			while (n == SW_PACKAGE_PARSE_MAX);
+			if (length != 0)
+			{
+				sw_free(buf);
+				return SW_ERR;
+			}
+		}
+		while (swBench_batch(&timer, num));
+		snprintf(name, sizeof(name), "parser_length size=%d", size);
+		swBench_report(&timer, name, "ns/pkg");
+	}
+	sw_free(buf);
+	return SW_OK;
+}
+
+swBench(parser_eof)
+{
+	swBench_result timer;
+	char *buf, name[128];
+	char eof[] = "\r\n";
+	uint32_t total, scan_offset;
+	int i, pos, num, size;
+
+	buf = sw_malloc(SW_BENCH_PARSER_BUFSIZE);
+	if (buf == NULL)
+	{
+		return SW_ERR;
+	}
+	for (i = 0; i < SW_BENCH_PARSER_SIZE_NUM; i++)
+	{
+		size = parser_bench_size[i];
+		for (total = 0, num = 0; total + size <= SW_BENCH_PARSER_BUFSIZE; total += size, num++)
+		{
+			memset(buf + total, 'x', size - 2);
+			memcpy(buf + total + size - 2, eof, 2);
+		}
+		swBench_start(object, &timer);
+		do
+		{
+			scan_offset = 0;
+			while ((pos = swoole_strnpos(buf + scan_offset, total - scan_offset, eof, 2)) >= 0)
+			{
+				scan_offset += pos + 2;
+			}
+			if (scan_offset != total)
+			{
+				sw_free(buf);
+				return SW_ERR;
+			}
+		}
+		while (swBench_batch(&timer, num));
+		snprintf(name, sizeof(name), "parser_eof size=%d", size);
+		swBench_report(&timer, name, "ns/pkg");
+	}
+	sw_free(buf);
+	return SW_OK;
+}
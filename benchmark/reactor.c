@@ -0,0 +1,182 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "bench.h"
+
+/**
+ * 注册fd_num个socketpair的一端, 其中active_num个一直可读: 回调读出1字节后写回对端
+ * 每轮wait处理active_num个事件, 空闲的fd体现select/poll按fd数量扫描的开销
+ * latency为每个事件的平均纳秒数
+ */
+typedef int (*swBench_reactor_create)(swReactor *reactor, int max_event_num);
+
+static swBench_result reactor_bench_result;
+static int *reactor_bench_peer;
+static uint32_t reactor_bench_active;
+
+static int reactor_bench_onRead(swReactor *reactor, swEvent *event)
+{
+	char c;
+
+	if (read(event->fd, &c, 1) == 1)
+	{
+		write(reactor_bench_peer[event->fd], &c, 1);
+	}
+	return SW_OK;
+}
+
+static void reactor_bench_onFinish(swReactor *reactor)
+{
+	if (!swBench_batch(&reactor_bench_result, reactor_bench_active))
+	{
+		SwooleG.running = 0;
+	}
+}
+
+static int reactor_bench_select_create(swReactor *reactor, int max_event_num)
+{
+	return swReactorSelect_create(reactor);
+}
+
+static int reactor_bench(swBench *object, char *backend, swBench_reactor_create create, uint32_t fd_num)
+{
+	swReactor reactor;
+	struct timeval timeo;
+	int (*pairs)[2];
+	char name[128];
+	uint32_t i, active = object->active_num;
+	int max_fd = 0, ret = SW_ERR;
+
+	bzero(&reactor, sizeof(reactor));
+	if (active > fd_num)
+	{
+		active = fd_num;
+	}
+	pairs = sw_calloc(fd_num, sizeof(int[2]));
+	if (pairs == NULL)
+	{
+		return SW_ERR;
+	}
+	for (i = 0; i < fd_num; i++)
+	{
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) < 0)
+		{
+			swWarn("socketpair() failed. Error: %s[%d]", strerror(errno), errno);
+			fd_num = i;
+			goto free_pairs;
+		}
+		swSetNonBlock(pairs[i][0]);
+		if (pairs[i][0] > max_fd)
+		{
+			max_fd = pairs[i][0];
+		}
+		if (pairs[i][1] > max_fd)
+		{
+			max_fd = pairs[i][1];
+		}
+	}
+	reactor_bench_peer = sw_calloc(max_fd + 1, sizeof(int));
+	if (reactor_bench_peer == NULL)
+	{
+		goto free_pairs;
+	}
+	if (create(&reactor, fd_num + 1) < 0)
+	{
+		goto free_peer;
+	}
+	reactor.setHandle(&reactor, SW_FD_PIPE, reactor_bench_onRead);
+	reactor.onFinish = reactor_bench_onFinish;
+	for (i = 0; i < fd_num; i++)
+	{
+		reactor_bench_peer[pairs[i][0]] = pairs[i][1];
+		reactor.add(&reactor, pairs[i][0], SW_FD_PIPE);
+	}
+	//活跃的fd均匀分布
+	for (i = 0; i < active; i++)
+	{
+		write(pairs[i * (fd_num / active)][1], "x", 1);
+	}
+
+	reactor_bench_active = active;
+	timeo.tv_sec = 1;
+	timeo.tv_usec = 0;
+	swBench_start(object, &reactor_bench_result);
+	reactor.wait(&reactor, &timeo);
+	SwooleG.running = 1;
+
+	snprintf(name, sizeof(name), "reactor_%s fds=%u active=%u", backend, fd_num, active);
+	swBench_report(&reactor_bench_result, name, "ns/event");
+	reactor.flag |= SW_REACTOR_KEEP_FD;
+	reactor.free(&reactor);
+	ret = SW_OK;
+
+	free_peer:
+	sw_free(reactor_bench_peer);
+	free_pairs:
+	for (i = 0; i < fd_num; i++)
+	{
+		close(pairs[i][0]);
+		close(pairs[i][1]);
+	}
+	sw_free(pairs);
+	return ret;
+}
+
+swBench(reactor_epoll)
+{
+#ifdef HAVE_EPOLL
+	return reactor_bench(object, "epoll", swReactorEpoll_create, object->fd_num);
+#else
+	printf("%-40s skipped\n", "reactor_epoll");
+	return SW_OK;
+#endif
+}
+
+swBench(reactor_poll)
+{
+	return reactor_bench(object, "poll", swReactorPoll_create, object->fd_num);
+}
+
+swBench(reactor_select)
+{
+	//select最多FD_SETSIZE个fd, 每个socketpair占两个
+	uint32_t fd_num = object->fd_num;
+	if (fd_num > (FD_SETSIZE - 32) / 2)
+	{
+		fd_num = (FD_SETSIZE - 32) / 2;
+	}
+	return reactor_bench(object, "select", reactor_bench_select_create, fd_num);
+}
+
+swBench(reactor_kqueue)
+{
+#ifdef HAVE_KQUEUE
+	return reactor_bench(object, "kqueue", swReactorKqueue_create, object->fd_num);
+#else
+	printf("%-40s skipped\n", "reactor_kqueue");
+	return SW_OK;
+#endif
+}
+
+swBench(reactor_uring)
+{
+#ifdef HAVE_IO_URING
+	return reactor_bench(object, "uring", swReactorUring_create, object->fd_num);
+#else
+	printf("%-40s skipped\n", "reactor_uring");
+	return SW_OK;
+#endif
+}
@@ -0,0 +1,130 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "bench.h"
+#include "Server.h"
+
+/**
+ * 在子进程中启动一个echo服务器(SW_MODE_PROCESS), 用loadgen测试整个请求路径:
+ * reactor线程收包和分包 -> IPC -> worker -> 回到reactor线程发送
+ * 可以用reactor=, worker=, port=修改服务器配置
+ */
+static int server_bench_onReceive(swFactory *factory, swEventData *req)
+{
+	swServer *serv = factory->ptr;
+	return swServer_tcp_send(serv, req->info.fd, req->data, req->info.len);
+}
+
+static void server_bench_start(swBench *object, swBench_load *load)
+{
+	swServer serv;
+
+	swServer_init(&serv);
+	serv.reactor_num = atoi(swBench_param(object, "reactor", "2"));
+	serv.worker_num = atoi(swBench_param(object, "worker", "2"));
+	serv.factory_mode = SW_MODE_PROCESS;
+	serv.max_conn = 10000;
+	serv.dispatch_mode = SW_DISPATCH_FDMOD;
+	serv.onReceive = server_bench_onReceive;
+	if (load->protocol == SW_BENCH_LENGTH)
+	{
+		serv.open_length_check = 1;
+		serv.package_length_type = SW_NUM_NET;
+		serv.package_length_offset = 0;
+		serv.package_body_start = 4;
+	}
+	if (swServer_create(&serv) < 0 || swServer_addListen(&serv, SW_SOCK_TCP, load->host, load->port) < 0)
+	{
+		_exit(1);
+	}
+	swServer_start(&serv);
+	_exit(0);
+}
+
+/**
+ * 等待服务器开始监听
+ */
+static int server_bench_wait(swBench_load *load)
+{
+	struct sockaddr_in addr;
+	int i, fd, ret;
+
+	bzero(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(load->port);
+	inet_pton(AF_INET, load->host, &addr.sin_addr);
+	for (i = 0; i < 300; i++)
+	{
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		ret = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+		close(fd);
+		if (ret == 0)
+		{
+			return SW_OK;
+		}
+		usleep(10000);
+	}
+	return SW_ERR;
+}
+
+static int server_bench(swBench *object, int protocol)
+{
+	swBench_load load;
+	char name[128];
+	pid_t pid;
+	int ret;
+
+	swBench_load_init(object, &load);
+	load.protocol = protocol;
+	load.port = atoi(swBench_param(object, "port", "9513"));
+	pid = fork();
+	if (pid < 0)
+	{
+		return SW_ERR;
+	}
+	else if (pid == 0)
+	{
+		server_bench_start(object, &load);
+	}
+	if (server_bench_wait(&load) < 0)
+	{
+		swWarn("server is not ready.");
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		return SW_ERR;
+	}
+	snprintf(name, sizeof(name), "server_%s conn=%d size=%d pipeline=%d", protocol == SW_BENCH_LENGTH ? "length" : "echo",
+			load.conn_num, load.size, load.pipeline);
+#ifdef HAVE_EPOLL
+	ret = swBench_load_run(object, &load, name);
+#else
+	printf("%-40s skipped\n", name);
+	ret = SW_OK;
+#endif
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return ret;
+}
+
+swBench(server_echo)
+{
+	return server_bench(object, SW_BENCH_ECHO);
+}
+
+swBench(server_length)
+{
+	return server_bench(object, SW_BENCH_LENGTH);
+}
@@ -21,6 +21,12 @@ PHP_ARG_ENABLE(sockets, enable sockets support,
 PHP_ARG_ENABLE(async_mysql, enable async_mysql support,
 [  --enable-async-mysql    Do you have mysqli and mysqlnd?], no, no)
 
+PHP_ARG_ENABLE(swoole-openssl, enable openssl support,
+[  --enable-swoole-openssl Use openssl and kernel TLS?], no, no)
+
+PHP_ARG_ENABLE(swoole-zlib, enable zlib support,
+[  --enable-swoole-zlib    Use zlib for WebSocket permessage-deflate?], no, no)
+
 PHP_ARG_WITH(swoole, swoole support,
 [  --with-swoole           Include swoole support])
 
@@ -74,6 +80,26 @@ AC_DEFUN([AC_SWOOLE_KQUEUE],
 	])
 ])
 
+AC_DEFUN([AC_SWOOLE_OPENSSL_KTLS],
+[
+	AC_MSG_CHECKING([for openssl with kernel TLS])
+	swoole_save_LIBS="$LIBS"
+	LIBS="$LIBS -lssl -lcrypto"
+	AC_TRY_LINK(
+	[
+		#include <openssl/ssl.h>
+	], [
+		SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+		return (int) SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+	], [
+		AC_MSG_RESULT([yes])
+	], [
+		AC_MSG_RESULT([no])
+		AC_MSG_ERROR([--enable-swoole-openssl requires OpenSSL built with kernel TLS (SSL_OP_ENABLE_KTLS)])
+	])
+	LIBS="$swoole_save_LIBS"
+])
+
 AC_DEFUN([AC_SWOOLE_CPU_AFFINITY],
 [
     AC_MSG_CHECKING([for cpu affinity])
@@ -144,6 +170,26 @@ AC_DEFUN([AC_SWOOLE_EPOLL],
 	])
 ])
 
+AC_DEFUN([AC_SWOOLE_IO_URING],
+[
+	AC_MSG_CHECKING([for io_uring])
+
+	AC_TRY_COMPILE(
+	[
+		#include <linux/io_uring.h>
+		#include <sys/syscall.h>
+	], [
+		struct io_uring_params params;
+		int features = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP | IORING_POLL_ADD_MULTI;
+		syscall(__NR_io_uring_setup, 1, &params);
+	], [
+		AC_DEFINE([HAVE_IO_URING], 1, [do we have io_uring?])
+		AC_MSG_RESULT([yes])
+	], [
+		AC_MSG_RESULT([no])
+	])
+])
+
 AC_DEFUN([AC_SWOOLE_EVENTFD],
 [
 	AC_MSG_CHECKING([for eventfd])
@@ -209,6 +255,18 @@ if test "$PHP_SWOOLE" != "no"; then
 		AC_DEFINE(SW_ASYNC_MYSQL, 1, [enable async_mysql support])
     fi
     
+    if test "$PHP_SWOOLE_OPENSSL" = "yes"; then
+		AC_SWOOLE_OPENSSL_KTLS
+		AC_DEFINE(SW_USE_OPENSSL, 1, [enable openssl support])
+		PHP_ADD_LIBRARY(ssl, 1, SWOOLE_SHARED_LIBADD)
+		PHP_ADD_LIBRARY(crypto, 1, SWOOLE_SHARED_LIBADD)
+    fi
+
+    if test "$PHP_SWOOLE_ZLIB" = "yes"; then
+		AC_DEFINE(SW_USE_ZLIB, 1, [enable zlib support])
+		PHP_ADD_LIBRARY(z, 1, SWOOLE_SHARED_LIBADD)
+    fi
+
     if test "$PHP_MSGQUEUE" != "no"; then
         AC_DEFINE(SW_WORKER_IPC_MODE, 2, [use message queue])
     else
@@ -217,6 +275,7 @@ if test "$PHP_SWOOLE" != "no"; then
         
     AC_SWOOLE_EVENTFD
     AC_SWOOLE_EPOLL
+    AC_SWOOLE_IO_URING
     AC_SWOOLE_KQUEUE
     AC_SWOOLE_TIMERFD
     AC_SWOOLE_CPU_AFFINITY
@@ -234,6 +293,9 @@ if test "$PHP_SWOOLE" != "no"; then
   
     AC_CHECK_LIB(c, accept4, AC_DEFINE(SW_USE_ACCEPT4, 1, [have accept4]))
     AC_CHECK_LIB(c, signalfd, AC_DEFINE(HAVE_SIGNALFD, 1, [have signalfd]))
+    AC_CHECK_LIB(c, recvmmsg, AC_DEFINE(HAVE_RECVMMSG, 1, [have recvmmsg]))
+    AC_CHECK_LIB(c, sendmmsg, AC_DEFINE(HAVE_SENDMMSG, 1, [have sendmmsg]))
+    AC_CHECK_LIB(c, splice, AC_DEFINE(HAVE_SPLICE, 1, [have splice]))
     AC_CHECK_LIB(pthread, pthread_spin_lock, AC_DEFINE(HAVE_SPINLOCK, 1, [have pthread_spin_lock]))
     AC_CHECK_LIB(rt, clock_gettime, AC_DEFINE(HAVE_CLOCK_GETTIME, 1, [have clock_gettime]))
     
@@ -241,16 +303,26 @@ if test "$PHP_SWOOLE" != "no"; then
     dnl PHP_ADD_LIBRARY(rt, 1, SWOOLE_SHARED_LIBADD)
     dnl PHP_ADD_LIBRARY(pthread, 1, SWOOLE_SHARED_LIBADD)
 
-    PHP_NEW_EXTENSION(swoole, swoole.c swoole_lock.c swoole_client.c swoole_async.c\
+    PHP_NEW_EXTENSION(swoole, swoole.c swoole_lock.c swoole_client.c swoole_client_waitset.c swoole_mysql.c swoole_redis.c swoole_table.c swoole_async.c\
         src/core/Base.c \
         src/core/log.c \
         src/core/hashmap.c \
         src/core/RingQueue.c \
+        src/core/MPMCQueue.c \
         src/core/Channel.c \
+        src/core/MPSCChannel.c \
+        src/core/RingBuffer.c \
+        src/core/RecvRing.c \
+        src/core/Histogram.c \
+        src/core/Coroutine.c \
         src/core/string.c \
+        src/core/sha1.c \
+        src/core/base64.c \
         src/core/array.c \
         src/memory/ShareMemory.c \
         src/memory/MemoryPool.c \
+        src/memory/MemoryArena.c \
+        src/memory/Table.c \
         src/factory/Factory.c \
         src/factory/FactoryThread.c \
         src/factory/FactoryProcess.c \
@@ -258,6 +330,7 @@ if test "$PHP_SWOOLE" != "no"; then
         src/reactor/ReactorSelect.c \
         src/reactor/ReactorPoll.c \
         src/reactor/ReactorEpoll.c \
+        src/reactor/ReactorUring.c \
         src/reactor/ReactorKqueue.c \
         src/pipe/PipeBase.c \
         src/pipe/PipeEventfd.c \
@@ -267,10 +340,26 @@ if test "$PHP_SWOOLE" != "no"; then
         src/lock/Mutex.c \
         src/lock/RWLock.c \
         src/lock/SpinLock.c \
+        src/lock/FutexLock.c \
+        src/lock/SeqLock.c \
+        src/lock/BRLock.c \
+        src/lock/Ready.c \
         src/lock/FileLock.c \
         src/network/Server.c \
+        src/network/Stats.c \
         src/network/Client.c \
+        src/network/DNS.c \
+        src/network/ClientPool.c \
+        src/network/MySQL.c \
+        src/network/Redis.c \
         src/network/Buffer.c \
+        src/network/FileCache.c \
+        src/network/Package.c \
+        src/network/Http.c \
+        src/network/WebSocket.c \
+        src/network/Proxy.c \
+        src/network/SSL.c \
+        src/network/UdpPeer.c \
         src/network/Connection.c \
         src/network/ProcessPool.c \
         src/network/ThreadPool.c \
@@ -278,9 +367,13 @@ if test "$PHP_SWOOLE" != "no"; then
         src/os/base.c \
         src/os/linux_aio.c \
         src/os/gcc_aio.c \
+        src/os/uring_aio.c \
         src/os/sendfile.c \
         src/os/signal.c \
         src/os/timer.c \
+        src/os/numa.c \
+        src/os/clock.c \
+        src/os/slowlog.c \
       , $ext_shared)
       
     PHP_ADD_INCLUDE([$ext_srcdir/include])
@@ -0,0 +1,25 @@
+<?php
+$db = new swoole_mysql(array(
+	'host' => '127.0.0.1',
+	'port' => 3306,
+	'user' => 'root',
+	'password' => 'root',
+	'database' => 'test',
+	'charset' => 'utf8',
+	'pool_size' => 4,
+));
+
+$db->query("show tables", function(swoole_mysql $db, $result) {
+	if ($result === false)
+	{
+		echo "query failed: {$db->error}[{$db->errno}]\n";
+		return;
+	}
+	var_dump($result);
+});
+
+$db->execute("select * from userinfo where id = ?", array(1), function(swoole_mysql $db, $result) {
+	var_dump($result);
+	$db->close();
+	swoole_event_exit();
+});
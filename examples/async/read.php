@@ -8,4 +8,4 @@ swoole_async_read(__DIR__.'/data.txt', function($filename, $content){
 	} else {
 		return true;
 	}
-}, 8192);
+}, 262144, 4);
@@ -0,0 +1,25 @@
+<?php
+$redis = new swoole_redis(array(
+	'host' => '127.0.0.1',
+	'port' => 6379,
+	//'password' => 'secret',
+	//'database' => 1,
+	'pool_size' => 4,
+));
+
+//同一轮事件中的命令合并发送, 不等待前一个命令的回复
+for ($i = 0; $i < 40; $i++)
+{
+	$redis->command(array('SET', "key_$i", $i), function(swoole_redis $redis, $result) {
+		if ($result === false)
+		{
+			echo "command failed: {$redis->error}\n";
+		}
+	});
+}
+
+$redis->command(array('MGET', 'key_1', 'key_2', 'key_not_exists'), function(swoole_redis $redis, $result) {
+	var_dump($result);
+	$redis->close();
+	swoole_event_exit();
+});
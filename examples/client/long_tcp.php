@@ -1,4 +1,6 @@
 <?php
+//同步长连接使用进程内的连接池, close()后归还
+//swoole_client_pool_set(array('min_idle' => 1, 'max_idle' => 16, 'max_pipeline' => 1, 'idle_timeout' => 60));
 for($i=0; $i < 100; $i++)
 {
 	$client = new swoole_client(SWOOLE_TCP | SWOOLE_KEEP);
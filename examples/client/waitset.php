@@ -0,0 +1,29 @@
+<?php
+//注册一次, 多次wait, 每次只返回就绪的客户端
+$set = new swoole_client_waitset();
+$clients = array();
+for($i=0; $i < 2000; $i++)
+{
+	$client = new swoole_client(SWOOLE_SOCK_TCP, SWOOLE_SOCK_SYNC);
+	if(!$client->connect('127.0.0.1', 9501, 0.5))
+	{
+		exit("connect failed\n");
+	}
+	$client->send("hello world\n");
+	$set->add($client, SWOOLE_EVENT_READ);
+	$clients[$client->sock] = $client;
+}
+while($set->count() > 0)
+{
+	$ready = $set->wait(1.0);
+	if($ready === false)
+	{
+		break;
+	}
+	foreach($ready as $fd => $client)
+	{
+		echo "recv #{$fd}: ".$client->recv();
+		$set->del($client);
+		$client->close();
+	}
+}
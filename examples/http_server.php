@@ -0,0 +1,23 @@
+<?php
+$serv = new swoole_server("127.0.0.1", 9501);
+$serv->set(array(
+	'worker_num' => 4,
+	'open_http_protocol' => 1,
+	'buffer_input_size' => 2 * 1024 * 1024, //最大请求长度
+));
+
+$serv->on('Request', function ($serv, $fd, $from_id, $request) {
+	$body = "<h1>Hello Swoole.</h1>" . $request['method'] . ' ' . $request['uri'];
+	$response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " . strlen($body) . "\r\n";
+	if (!$request['keepalive'])
+	{
+		$response .= "Connection: close\r\n";
+	}
+	$serv->send($fd, $response . "\r\n" . $body);
+	if (!$request['keepalive'])
+	{
+		$serv->close($fd);
+	}
+});
+
+$serv->start();
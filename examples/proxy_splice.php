@@ -0,0 +1,24 @@
+<?php
+$serv = new swoole_server("127.0.0.1", 9503);
+$serv->set(array(
+	'worker_num' => 2,
+	'open_eof_check' => true,
+	'package_eof' => "\r\n",
+));
+
+//收到CONNECT请求后由reactor线程用splice在客户端和上游之间转发, 之后不再触发onReceive
+$serv->on('Receive', function ($serv, $fd, $from_id, $data) {
+	if (strncmp($data, "CONNECT ", 8) != 0)
+	{
+		$serv->close($fd);
+		return;
+	}
+	list($host, $port) = explode(':', trim(substr($data, 8)));
+	$serv->send($fd, "OK\r\n");
+	if (!$serv->proxy($fd, $host, $port))
+	{
+		$serv->close($fd);
+	}
+});
+
+$serv->start();
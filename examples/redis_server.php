@@ -0,0 +1,52 @@
+<?php
+$serv = new swoole_server("127.0.0.1", 9510);
+$serv->set(array(
+	'worker_num' => 2,
+	'dispatch_mode' => 2,
+	//每个完整的RESP命令回调一次onReceive, 数据是原始的命令, 可以直接转发给redis
+	'open_redis_protocol' => 1,
+));
+
+$serv->on('Receive', function (swoole_server $serv, $fd, $from_id, $data) {
+	static $redis = null;
+	if ($redis === null)
+	{
+		$redis = new swoole_redis(array('host' => '127.0.0.1', 'port' => 6379));
+	}
+	//简单的解析: *N\r\n$len\r\narg\r\n...
+	$lines = explode("\r\n", $data);
+	$argv = array();
+	for ($i = 2; $i < count($lines); $i += 2)
+	{
+		$argv[] = $lines[$i];
+	}
+	$redis->command($argv, function (swoole_redis $redis, $result) use ($serv, $fd) {
+		if ($result === false)
+		{
+			$serv->send($fd, "-{$redis->error}\r\n");
+		}
+		elseif (is_int($result))
+		{
+			$serv->send($fd, ":$result\r\n");
+		}
+		elseif ($result === null)
+		{
+			$serv->send($fd, "\$-1\r\n");
+		}
+		elseif (is_string($result))
+		{
+			$serv->send($fd, "\$" . strlen($result) . "\r\n$result\r\n");
+		}
+		else
+		{
+			$reply = "*" . count($result) . "\r\n";
+			foreach ($result as $v)
+			{
+				$reply .= $v === null ? "\$-1\r\n" : "\$" . strlen($v) . "\r\n$v\r\n";
+			}
+			$serv->send($fd, $reply);
+		}
+	});
+});
+
+$serv->start();
@@ -5,10 +5,47 @@ $serv->set(array(
     'worker_num' => 2,
     //'open_eof_check' => true,
     //'package_eof' => "\r\n",
+    //'open_http_protocol' => 1,
+    //'open_websocket_protocol' => 1,
+    //'websocket_compression' => 6, //permessage-deflate压缩级别, 在reactor线程中压缩, 也可以 array(9501 => 6)
+    //'websocket_compression_min_length' => 256, //小于此长度的消息不压缩
+    //'open_redis_protocol' => 1, //按RESP协议分包, 每个完整的命令回调一次onReceive, 需要dispatch_mode=2
     'task_worker_num' => 2,
+	//'task_dispatch_mode' => 3, //空闲的task进程抢占任务, 4: 投递给未完成任务最少的task进程
+	//'task_finish_batch' => 1, //task进程合并发往同一个worker的结果, 设置了onFinishBatch时一次回调array(task_id => data)
 	//'dispatch_mode' => 2,
+	//'dispatch_key_offset' => 4,
+	//'dispatch_key_length' => 8,
 	//'daemonize' => 1,
 	'log_file' => '/tmp/swoole.log',
+	//'stats_file' => '/tmp/swoole_stats.prom',  //manager进程每隔10秒写入统计数据
+	//'latency_sample' => 100,  //每100个请求采样一次延迟, 也可以按端口设置: array(9501 => 100, 9502 => 10)
+	//'tcp_defer_accept' => 5,  //收到数据后才accept, 最多等待5秒, 也可以按端口设置
+	//'tcp_fastopen' => 128,    //开启TCP Fast Open, 值为队列长度
+	//'tcp_busy_poll' => array(9502 => 50), //低延迟端口读取时忙轮询50微秒
+	//'slow_callback_threshold' => 200,  //回调超过200ms打印slowlog和PHP调用栈
+	//'overload_target' => 5,   //worker排队延迟持续100ms超过5ms时拒绝新连接和新请求, 只用于SWOOLE_PROCESS
+	//'overload_interval' => 100,
+	//'overload_response' => "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n",
+	//'direct_send' => 1,
+	//'dispatch_batch' => 1,
+	//'work_stealing' => 1,
+	//'worker_spin_usec' => 50,
+	//'reload_batch' => 1,
+	//'reload_drain_timeout' => 5,
+	//'enable_reuse_port' => 1, //SWOOLE_BASE模式下每个worker进程一个SO_REUSEPORT socket, 自己accept和收发
+	//'ssl_cert_file' => __DIR__.'/ssl.crt', //SWOOLE_SOCK_TCP | SWOOLE_SSL的端口, 握手后由内核kTLS加解密
+	//'ssl_key_file' => __DIR__.'/ssl.key',
+	//'open_cpu_affinity' => 1,
+	//'numa_affinity' => 1,
+	//'incoming_cpu_affinity' => 1, //连接分配给绑定在其软中断CPU上的reactor线程, 需要open_cpu_affinity
+	//'hugepage' => 1, //1: THP, 2: MAP_HUGETLB
+	//'enable_edge_trigger' => 1,
+	//'send_arena_size' => 16 * 1024 * 1024,
+	//'recv_ring_size' => 32 * 1024 * 1024, //PROCESS模式下open_length_check的大包直接接收到共享内存, worker中不再拼包
+	//'sendfile_window' => 1024 * 1024,
+	//'buffer_high_watermark' => 8 * 1024 * 1024,
+	//'buffer_low_watermark' => 1024 * 1024,
     //'heartbeat_idle_time' => 5,
     //'heartbeat_check_interval' => 5,
 ));
@@ -76,11 +113,20 @@ function my_onReceive(swoole_server $serv, $fd, $from_id, $data)
 		$result = $serv->taskwait("hello world");
 		echo "SyncTask: result=$result\n";
 	}
+	elseif($cmd == "taskwaitmulti") 
+    {
+		$results = $serv->taskWaitMulti(array("hello", "world", "swoole"), 1.0);
+		echo "MultiTask: results=".var_export($results, true)."\n";
+	}
 	elseif($cmd == "info") 
     {
 		$info = $serv->connection_info($fd);
 		$serv->send($fd, 'Info: '.var_export($info, true).PHP_EOL);
 	}
+	elseif($cmd == "sendv")
+    {
+		$serv->sendv($fd, array("HTTP/1.1 200 OK\r\n", "Content-Length: 5\r\n\r\n", "hello"));
+	}
     elseif($cmd == "broadcast")
     {
         $start_fd = 0;
@@ -0,0 +1,28 @@
+<?php
+//共享内存表必须在start之前创建, 所有worker进程共用
+$table = new swoole_table(1024);
+$table->column('fd', SWOOLE_TABLE_INT);
+$table->column('from_id', SWOOLE_TABLE_INT, 4);
+$table->column('name', SWOOLE_TABLE_STRING, 64);
+$table->column('score', SWOOLE_TABLE_FLOAT);
+$table->create();
+
+$serv = new swoole_server("127.0.0.1", 9501);
+$serv->set(array('worker_num' => 4));
+$serv->table = $table;
+
+$serv->on('Connect', function ($serv, $fd, $from_id) {
+	$serv->table->set("conn_$fd", array('fd' => $fd, 'from_id' => $from_id, 'name' => "client#$fd"));
+});
+
+$serv->on('Receive', function ($serv, $fd, $from_id, $data) {
+	$n = $serv->table->incr('counter', 'fd');
+	$info = $serv->table->get("conn_$fd");
+	$serv->send($fd, "request#$n from {$info['name']}, online: " . ($serv->table->count() - 1) . "\n");
+});
+
+$serv->on('Close', function ($serv, $fd, $from_id) {
+	$serv->table->del("conn_$fd");
+});
+
+$serv->start();
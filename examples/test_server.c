@@ -293,9 +293,9 @@ int my_onReceive(swFactory *factory, swEventData *req)
 	}
 	else
 	{
-		swConnection *conn = swServer_get_connection(serv, req->info.fd);
+		swConnectionInfo *info = swServer_get_connection_info(serv, req->info.fd);
 		printf("onReceive[%d]: ip=%s|port=%d Data=%s|Len=%d\n", g_receive_count,
-					inet_ntoa(conn->addr.sin_addr), conn->addr.sin_port,
+					inet_ntoa(info->addr.sin_addr), info->addr.sin_port,
 					rtrim(req->data, req->info.len), req->info.len);
 	}
 //	req->info.type = 99;
@@ -0,0 +1,18 @@
+<?php
+$serv = new swoole_server("127.0.0.1", 9502);
+$serv->set(array(
+	'worker_num' => 4,
+	'open_websocket_protocol' => 1,
+	'buffer_input_size' => 2 * 1024 * 1024, //最大消息长度
+));
+
+//握手, ping/pong和分片都在reactor线程处理, 这里只收到完整的消息
+$serv->on('Message', function ($serv, $fd, $from_id, $data, $opcode) {
+	$serv->push($fd, "server: " . $data, $opcode);
+});
+
+$serv->on('Close', function ($serv, $fd, $from_id) {
+	echo "client[$fd] closed\n";
+});
+
+$serv->start();
@@ -13,6 +13,9 @@
 #define SW_SOCK_ASYNC    1
 #define SW_SOCK_SYNC     0
 
+struct _swClientPool;
+struct _swClientPool_group;
+
 typedef struct _swClient
 {
 	int sock;
@@ -25,6 +28,7 @@ typedef struct _swClient
 	uint8_t async;
 	uint8_t connected;
 	uint8_t keep;
+	uint8_t open_tcp_fastopen; //connect时使用TCP_FASTOPEN_CONNECT, 第一次send的数据随SYN发出
 	char *server_str;
 	uint8_t server_strlen;
 	double timeout;
@@ -34,6 +38,14 @@ typedef struct _swClient
 
 	swBuffer *out_buffer;
 
+	/**
+	 * 从swClientPool中借出的连接
+	 */
+	struct _swClientPool *pool;
+	struct _swClientPool_group *group;
+	uint16_t borrowed;     //借出的次数, pipeline模式下大于1
+	time_t last_use;
+
 	void (*onConnect)(struct _swClient *cli);
 	int (*onReceive)(struct _swClient *cli, swSendData *data);
 	void (*onClose)(struct _swClient *cli, int fd, int from_id);
@@ -55,4 +67,38 @@ int swClient_udp_connect(swClient *cli, char *host, int port, double _timeout, i
 int swClient_udp_send(swClient *cli, char *data, int length);
 int swClient_udp_recv(swClient *cli, char *data, int len, int waitall);
 
+/**
+ * 按host:port分组的连接池, 每个进程一个
+ */
+typedef struct _swClientPool_group
+{
+	char key[SW_CLIENT_POOL_KEY_LEN];
+	uint16_t key_len;
+	swClient **idle;        //空闲连接, 后进先出, idle[0]最久未使用
+	uint32_t idle_num;
+	uint32_t idle_size;
+	swClient *pipeline;     //pipeline模式下正在共享的连接
+	uint32_t active_num;    //借出的连接数量
+	struct _swClientPool_group *next;
+} swClientPool_group;
+
+typedef struct _swClientPool
+{
+	swHashMap map;          //key -> swClientPool_group
+	swClientPool_group *groups;
+	uint32_t min_idle;
+	uint32_t max_idle;
+	uint16_t max_pipeline;
+	uint32_t idle_timeout;
+	int timer_id;
+	pid_t pid;              //fork后子进程不能复用父进程的连接
+	uint8_t init;
+} swClientPool;
+
+int swClientPool_create(swClientPool *pool);
+swClient* swClientPool_get(swClientPool *pool, int type, char *host, int port);
+void swClientPool_release(swClientPool *pool, swClient *cli);
+void swClientPool_check(swClientPool *pool);
+void swClientPool_free(swClientPool *pool);
+
 #endif /* SW_CLIENT_H_ */
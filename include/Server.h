@@ -20,6 +20,10 @@
 #include "swoole.h"
 #include "buffer.h"
 
+#ifdef SW_USE_OPENSSL
+#include <openssl/ssl.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -32,6 +36,8 @@ extern "C" {
 #define SW_DISPATCH_ROUND        1
 #define SW_DISPATCH_FDMOD        2
 #define SW_DISPATCH_QUEUE        3
+#define SW_DISPATCH_LEAST        4 //随机取两个worker,投递给未处理请求较少的一个
+#define SW_DISPATCH_KEY          5 //按数据包中的key做一致性hash,worker数量变化时只有少量key迁移
 
 #define SW_WORKER_BUSY           1
 #define SW_WORKER_IDLE           0
@@ -47,6 +53,8 @@ extern "C" {
 
 #define SW_TASK_BLOCKING           1
 #define SW_TASK_NONBLOCK           0
+#define SW_TASK_WAITMULTI          2  //taskWaitMulti,结果保存在task_result_multi中
+#define SW_TASK_SHM                1  //info.from_fd标志: 数据保存在task_arena中,data只存放swTaskPackage
 
 #define SW_EVENT_TCP               0
 #define SW_EVENT_UDP               1
@@ -58,9 +66,24 @@ extern "C" {
 #define SW_EVENT_PACKAGE_TRUNK     10
 #define SW_EVENT_PACKAGE_END       11
 #define SW_EVENT_SENDFILE          12
+#define SW_EVENT_BROADCAST         13 //info.from_id为目标reactor线程
+#define SW_EVENT_SHARED            14 //data为send_arena中swBuffer_shared的指针
+#define SW_EVENT_PACKAGE_BATCH     15 //多个数据包合并投递, data为多条swDataHead + 数据
+#define SW_EVENT_BUFFER_FULL       16 //out_buffer超过高水位, 已停止读取
+#define SW_EVENT_BUFFER_EMPTY      17 //out_buffer降到低水位, 已恢复读取
+#define SW_EVENT_PROXY             18 //data为swProxy_request, 连接交给reactor线程转发到上游
+#define SW_EVENT_FINISH_BATCH      19 //task进程合并发回的多个结果, 格式同SW_EVENT_PACKAGE_BATCH
+#define SW_EVENT_DIRECT            20 //data为worker_id, worker请求直接写连接的socket; 回复给worker时socket的副本在SCM_RIGHTS中
+#define SW_EVENT_DIRECT_END        21 //data为worker_id, worker写完后归还连接
+#define SW_EVENT_PACKAGE_VIEW      22 //data为swPackage_view, 完整的包在serv->recv_rings[info.from_id]中, 处理完后释放
+#define SW_EVENT_DIRECT_RESET      23 //data为worker_id, 由manager发出, worker退出后收回它直接写的连接
 
 #define SW_TRUNK_DATA              0 //send data
 #define SW_TRUNK_SENDFILE          1 //send file
+#define SW_TRUNK_SHARED            2 //多个连接共享的数据,data为swBuffer_shared
+
+#define SW_SEND_SHARED             2 //info.from_fd标志: 数据保存在send_arena中
+#define SW_SEND_WEBSOCKET          0x10 //info.from_fd标志: 数据为WebSocket消息的负载, 低4位为opcode, 由reactor线程封装帧
 
 #define SW_STATUS_EMPTY            0
 #define SW_STATUS_ACTIVE           1
@@ -77,18 +100,114 @@ extern "C" {
 #define SW_NUM_UNSIGN              (1u << 5)
 #define SW_NUM_SIGN                (1u << 6)
 
-typedef struct _swUdpFd{
-	struct sockaddr addr;
-	int sock;
-} swUdpFd;
+/**
+ * 一次扫描出的完整数据包在buffer中的位置
+ */
+typedef struct
+{
+	uint32_t offset;
+	uint32_t length;
+} swPackage_range;
+
+/**
+ * 解析data中所有完整的包, 最多max个, 返回包的数量, 返回-1表示长度不合法
+ * need为第一个不完整的包的总长度, 包头不足时为0
+ */
+typedef int (*swPackage_length_parser)(swServer *serv, char *data, uint32_t length, swPackage_range *packages, int max, uint32_t *need);
+
+typedef struct
+{
+	uint16_t num;
+	long queue_type; //For Message Queue, 必须紧挨着event
+	swEventData event;
+} swPackage_batch;
+
+#define swPackage_batch_init(batch, _fd, _from_id)  do { (batch)->num = 0; (batch)->event.info.len = 0; \
+	(batch)->event.info.fd = _fd; (batch)->event.info.from_id = _from_id; (batch)->event.info.from_fd = 0; } while (0)
+
+/**
+ * 缓存打开的文件, 同一个文件的多次sendfile共用一个fd
+ */
+typedef struct _swFileCache
+{
+	swHashMap map;  //filename -> swFileCache_node
+	swLock lock;    //writer线程也会发送文件
+	uint32_t num;
+} swFileCache;
+
+typedef struct _swFileCache_node
+{
+	swFileCache *cache;
+	int fd;
+	uint32_t refcount;  //缓存本身持有一个引用, 每个sendfile任务持有一个
+	off_t filesize;
+	time_t mtime;
+	ino_t inode;
+	time_t check_time;  //上一次stat检查的时间
+} swFileCache_node;
+
+/**
+ * UDP对端地址, 存放在共享内存中, 由reactor线程写入, worker进程读取
+ */
+typedef struct _swUdpPeer
+{
+	volatile uint32_t version; //奇数表示正在写入
+	socklen_t addrlen;
+	union
+	{
+		struct sockaddr_in inet_v4;
+		struct sockaddr_in6 inet_v6;
+	} addr;
+} swUdpPeer;
+
+typedef struct _swUdpPeerTable
+{
+	uint32_t size;     //2的N次方
+	uint32_t mask;
+	swLock lock;       //跨进程锁, base模式下多个worker进程共用
+	swUdpPeer peers[0];
+} swUdpPeerTable;
+
+/**
+ * UDP的fd为对端地址在表中的序号, 高位保存版本号, 槽位被复用后旧的fd失效
+ */
+#define SW_UDP_PEER_FLAG          0x40000000
+#define SW_UDP_PEER_SLOT_BITS     20
+#define SW_UDP_PEER_VERSION_MASK  0x3ff
+#define swUdpPeer_is_peer(fd)     (((fd) & SW_UDP_PEER_FLAG) != 0)
 
 typedef struct _swThreadPoll
 {
 	pthread_t ptid; //线程ID
 	swReactor reactor;
-	swUdpFd *udp_addrs;
 	swCloseQueue close_queue;
-	int c_udp_fd;
+	swRingBuffer *close_ring;  //投递给主线程的关闭fd, 单生产者单消费者
+	atomic_t close_notified;   //已唤醒主线程, 主线程读取close_ring前清除
+	swBufferPool buffer_pool; //trunk内存池,只在本线程内使用
+	swFileCache file_cache;
+	/**
+	 * 空闲连接链表,按last_time从旧到新排列,链表节点为fd,0表示空
+	 */
+	int idle_head;
+	int idle_tail;
+	swLock lock;               //保护空闲链表和活动连接索引,主线程accept时会插入,进程模式下worker遍历索引时也要加锁
+	time_t idle_check_time;    //上一次检测空闲连接的时间
+	/**
+	 * 活动连接索引,紧凑排列,只需遍历active_num个
+	 */
+	int *active_fds;
+	int active_num;
+	/**
+	 * 开启dispatch_batch时合并投递的数据包, dispatch_mode=2时每个worker一个, 否则只有一个
+	 */
+	swPackage_batch *batches;
+	uint16_t batch_num;
+	/**
+	 * 空闲的接收buffer, 包处理完后归还, 空闲连接不占用buffer
+	 */
+	swString *input_buffers[SW_BUFFER_INPUT_POOL_NUM];
+	int input_buffer_num;
+	swHashMap_int proxies;     //客户端和上游的fd -> swProxy
 } swReactorThread;
 
 typedef struct _swThreadWriter
@@ -102,38 +221,245 @@ typedef struct _swThreadWriter
 	swPipe evfd;       //eventfd
 } swWriterThread;
 
+/**
+ * 可以按端口设置的监听socket选项
+ */
+enum swListen_option
+{
+	SW_LISTEN_DEFER_ACCEPT,  //TCP_DEFER_ACCEPT, 收到数据后才唤醒accept, 单位秒
+	SW_LISTEN_FASTOPEN,      //TCP_FASTOPEN, 允许SYN中携带数据, 值为队列长度
+	SW_LISTEN_BUSY_POLL,     //SO_BUSY_POLL, 读取时忙轮询网卡队列的微秒数
+	SW_LISTEN_WEBSOCKET_COMPRESSION, //permessage-deflate的压缩级别1-9, 不是socket选项, 连接创建时继承
+	SW_LISTEN_OPTION_NUM,
+};
+
 typedef struct _swListenList_node
 {
 	struct _swListenList_node *next, *prev;
 	int type;
 	int port;
 	int sock;
+	int *reuse_socks;  //SO_REUSEPORT模式下每个reactor线程一个监听socket
+	uint8_t worker_group; //此端口的请求投递到哪个worker分组
+	int latency_sample;   //-1表示使用serv->latency_sample
+	int options[SW_LISTEN_OPTION_NUM]; //-1表示使用serv->listen_options
+	uint8_t ssl;          //SW_SOCK_SSL, 此端口的连接先完成TLS握手
 	char host[SW_HOST_MAXSIZE];
 } swListenList_node;
 
+/**
+ * worker分组, 每个分组占用workers中连续的一段, 有自己的分配模式和max_request
+ * 0为默认分组, 使用serv->worker_num/dispatch_mode/max_request
+ */
+typedef struct _swWorkerGroup
+{
+	char name[SW_WORKER_GROUP_NAMELEN];
+	uint16_t offset;     //分组中第一个worker的id
+	uint16_t worker_num;
+	uint8_t dispatch_mode;
+	int max_request;
+	uint32_t worker_pti; //轮询分配的位置
+} swWorkerGroup;
+
 typedef struct {
-	char *filename;
-	uint16_t name_len;
+	swFileCache_node *file;
 	int fd;
-	off_t filesize;
 	off_t offset;
+	off_t end;      //发送到此位置结束
 } swTask_sendfile;
 
+/**
+ * SW_EVENT_SENDFILE的数据
+ */
+typedef struct {
+	off_t offset;
+	off_t length;   //0表示发送到文件末尾
+	char filename[0];
+} swSendFile_request;
+
+#define SW_SSL_STATE_HANDSHAKE     1
+#define SW_SSL_STATE_READY         2
+
+#define SW_PROXY_WAIT              1
+#define SW_PROXY_ACTIVE            2
+
+#define SW_DIRECT_WAIT             1
+#define SW_DIRECT_ACTIVE           2
+
+/**
+ * SW_EVENT_PROXY的数据
+ */
+typedef struct {
+	struct sockaddr_in addr;
+} swProxy_request;
+
+/**
+ * 客户端连接与上游socket之间用splice经过管道转发, 数据不进入用户态
+ * 方向0为客户端到上游, 方向1为上游到客户端, 管道满时停止读取来源一端
+ */
+typedef struct _swProxy {
+	int fds[2];          //[0]: 客户端, [1]: 上游
+	int pipes[2][2];     //每个方向一个管道
+	uint32_t pending[2]; //管道中还未写出的字节数
+	uint8_t eof[2];      //来源一端已关闭, 管道写完后关闭
+	uint8_t paused[2];   //管道已满, 停止读取来源一端
+	uint8_t events[2];   //当前监听的事件, 避免重复epoll_ctl
+	uint8_t connected;
+} swProxy;
+
+/**
+ * 每次事件都会访问的热数据,控制在32字节以内
+ * 状态标志使用位域, 与from_id共用8字节, 新增的状态优先放到这里或者swConnectionInfo
+ */
 typedef struct _swConnection {
-	uint8_t active;     //0表示非活动,1表示活动
 	int fd;             //文件描述符
 	uint16_t from_id;   //Reactor Id
+	uint16_t active :1;     //0表示非活动,1表示活动
+	uint16_t out_event :1;  //是否已监听可写事件,边缘触发模式下一直为1
+	uint16_t recv_paused :1; //out_buffer超过高水位, 已取消监听可读事件
+	uint16_t websocket_status :2; //open_websocket_protocol: 0为HTTP, 握手后按帧解析
+	uint16_t proxy :2;      //SW_PROXY_WAIT: 等待out_buffer发送完, SW_PROXY_ACTIVE: 已由reactor线程转发
+	uint16_t ssl_state :2;  //SW_SSL_STATE_HANDSHAKE: 握手中, 不接收也不发送数据
+	uint16_t direct :2;     //SW_DIRECT_WAIT: 等待out_buffer发送完, SW_DIRECT_ACTIVE: worker正在直接写socket, 新的响应只追加到out_buffer
+	time_t last_time;   //最近一次收到数据的时间
+	swString *string_buffer;    //缓存区
+	swBuffer *out_buffer;
+} swConnection;
+
+SW_STATIC_ASSERT(sizeof(swConnection) <= 32, swConnection_size);
+
+/**
+ * 连接的冷数据,与connection_list按fd一一对应
+ */
+typedef struct _swConnectionInfo {
 	uint16_t from_fd;   //从哪个ServerFD引发的
 	struct sockaddr_in addr; //socket的地址
+	time_t connect_time; //连接时间戳
+	swBuffer *in_buffer;
 
-	swString *string_buffer;    //缓存区
+	int idle_prev;       //空闲链表的前一个fd
+	int idle_next;       //空闲链表的后一个fd
+	uint8_t idle_linked;
+	int active_index;    //在reactor线程活动连接索引中的位置
+	int direct_worker;   //直接写socket的worker, connection.direct不为0时有效
+	uint8_t worker_group; //监听socket所属的worker分组, 连接创建时继承
+	uint16_t latency_sample; //每latency_sample个请求采样一次延迟, 0为不采样, 连接创建时继承
+	uint32_t latency_start;  //还在out_buffer中的采样响应: 请求投递时间
+	uint32_t latency_resp;   //还在out_buffer中的采样响应: reactor收到响应的时间
+	uint32_t ring_offset;    //正在直接接收到recv_ring中的大包, ring_length为0时没有
+	uint32_t ring_length;
+	uint32_t ring_recv;      //已接收的字节数
+	uint8_t websocket_opcode;   //分片消息第一帧的opcode
+	uint8_t websocket_compressed; //分片消息第一帧设置了RSV1
+	uint8_t websocket_compression; //监听socket的压缩级别, 握手时客户端不支持permessage-deflate则清零
+	swString *websocket_message; //合并中的分片消息
+	uint8_t open_ssl;    //监听socket: 此端口启用TLS, 连接创建时继承
+#ifdef SW_USE_OPENSSL
+	SSL *ssl;            //握手完成后只用于关闭, 记录的加解密在内核中
+	uint8_t ssl_want_write;
+#endif
+} swConnectionInfo;
+
+/**
+ * 连接表的一块, count为此块中的连接数, 为SW_CONNECTION_CHUNK_RELEASING时正在归还物理内存
+ */
+typedef struct _swConnectionChunk {
+	atomic_t count;
+	uint8_t committed;  //块中有页面被访问过
+} swConnectionChunk;
+
+#define SW_CONNECTION_CHUNK_RELEASING  ((atomic_uint_t) -1)
+
+/**
+ * 广播到reactor线程的描述符, 数据本身在send_arena中
+ */
+typedef struct _swBroadcastPackage
+{
+	swBuffer_shared *shared;
+	int fd_num;  //0表示发送到reactor线程的所有连接
+	int fds[0];
+} swBroadcastPackage;
+
+#define SW_BROADCAST_FD_MAX        ((SW_BUFFER_SIZE - sizeof(swBroadcastPackage)) / sizeof(int))
+
+/**
+ * 每页在reactor线程的锁内复制, 两页之间关闭的连接会把末尾的fd移入空位, 可能有少量连接被跳过
+ * 遍历期间关闭的连接会把末尾的fd移入空位, 可能有少量连接被跳过
+ */
+typedef struct _swConnectionIterator {
+	uint16_t reactor_id;
+	int index;
+} swConnectionIterator;
+
+/**
+ * 统计数据, 在共享内存中, 每个reactor线程和worker占用单独的cache line, 计数时没有伪共享
+ */
+typedef struct _swServerStats
+{
+	time_t start_time;
+	atomic_t connection_num;   //当前连接数, worker进程也可以读取
+	char padding[SW_CACHELINE_SIZE - sizeof(time_t) - sizeof(atomic_t)];
+} swServerStats;
 
-	swBuffer *in_buffer;
-	swBuffer *out_buffer;
+typedef struct _swReactorStats
+{
+	atomic_t accept_count;
+	atomic_t close_count;
+	atomic_t recv_bytes;
+	atomic_t send_bytes;
+	atomic_t dispatch_count;   //投递给worker的数据包
+	atomic_t eagain_count;     //发送时socket缓存区已满
+	atomic_t out_buffer_bytes; //out_buffer中待发送的字节数
+	atomic_t slow_count;       //超过slow_callback_usec的回调和事件循环
+	atomic_t overload_count;   //过载时拒绝的连接和请求
+	atomic_t incoming_cpu_count; //按SO_INCOMING_CPU分配的连接
+	char padding[2 * SW_CACHELINE_SIZE - 10 * sizeof(atomic_t)]; //超过了一个cache line
+} swReactorStats;
+
+/**
+ * 前worker_num个是worker进程, 后面是task进程, 未处理完的请求数为dispatch_count - request_count
+ */
+typedef struct _swWorkerStats
+{
+	atomic_t dispatch_count;
+	atomic_t request_count;
+	atomic_t busy_usec;
+	atomic_t slow_count;
+	atomic_t overload;  //排队延迟持续一个overload_interval超过overload_target, 只由worker自己写入
+	char padding[SW_CACHELINE_SIZE - 5 * sizeof(atomic_t)];
+} swWorkerStats;
+
+/**
+ * 采样请求的延迟, 单位微秒
+ * queue: reactor投递到worker收到, handler: worker处理, send: reactor收到响应到最后一个字节写入socket
+ * total: reactor投递到最后一个字节写入socket
+ */
+enum swLatency_type
+{
+	SW_LATENCY_QUEUE,
+	SW_LATENCY_HANDLER,
+	SW_LATENCY_SEND,
+	SW_LATENCY_TOTAL,
+};
 
-	time_t connect_time; //连接时间戳
-	time_t last_time;	 //最近一次收到数据的时间
-} swConnection;
+typedef struct _swWorkerLatency
+{
+	swHistogram queue;
+	swHistogram handler;
+	char padding[SW_CACHELINE_SIZE - (2 * sizeof(swHistogram)) % SW_CACHELINE_SIZE];
+} swWorkerLatency;
+
+typedef struct _swReactorLatency
+{
+	swHistogram send;
+	swHistogram total;
+	char padding[SW_CACHELINE_SIZE - (2 * sizeof(swHistogram)) % SW_CACHELINE_SIZE];
+} swReactorLatency;
+
+#define swServer_reactor_stats_add(serv, reactor_id, field, n) \
+	if ((serv)->reactor_stats != NULL) sw_atomic_fetch_add(&(serv)->reactor_stats[reactor_id].field, n)
+#define swServer_worker_stats_add(serv, worker_id, field, n) \
+	if ((serv)->worker_stats != NULL) sw_atomic_fetch_add(&(serv)->worker_stats[worker_id].field, n)
 
 struct swServer_s
 {
@@ -143,10 +469,17 @@ struct swServer_s
 	uint16_t worker_num;
 	uint16_t task_worker_num;
 	uint16_t reactor_pipe_num; //每个reactor维持的pipe数量
+	uint32_t task_arena_size;  //大task数据共享内存的尺寸
+	uint32_t send_arena_size;  //广播和大数据包共享内存的尺寸
+	uint32_t recv_ring_size;   //每个reactor线程的共享内存接收环的尺寸, 0为关闭
+	uint32_t sendfile_window;  //每次可写事件最多sendfile的字节数
 
 	uint8_t factory_mode;
 	uint8_t daemonize;
 	uint8_t dispatch_mode; //分配模式，1平均分配，2按FD取摸固定分配，3,使用抢占式队列(IPC消息队列)分配
+	uint8_t task_dispatch_mode; //task进程的分配模式, 1轮询, 3空闲的task进程从共用管道抢占, 4投递给未完成任务最少的
+	uint8_t task_finish_batch;  //task进程把发往同一个worker的结果合并, 管道中没有任务时发送
+	uint8_t enable_coroutine;   //worker的onReceive在协程中执行, 见coroutine.h. 只用于C编写的服务器, PHP扩展不支持
 
 	int worker_uid;
 	int worker_groupid;
@@ -161,6 +494,7 @@ struct swServer_s
 	int sock_server_buffer_size;    //server的socket缓存区设置
 
 	char log_file[SW_LOG_FILENAME];      //日志文件
+	char stats_file[SW_LOG_FILENAME];    //manager进程定时写入Prometheus格式的统计数据
 
 	int signal_fd;
 	int event_fd;
@@ -171,14 +505,35 @@ struct swServer_s
 	uint16_t reactor_round_i;   //轮询调度
 	uint16_t reactor_next_i;    //平均算法调度
 	uint16_t reactor_schedule_count;
+	int16_t *incoming_cpu_map;  //incoming_cpu_affinity: CPU -> reactor线程(BASE模式为worker进程), -1为没有绑定
 
 	int udp_sock_buffer_size; //UDP临时包数量，超过数量未处理将会被丢弃
 
+#ifdef SW_USE_OPENSSL
+	char *ssl_cert_file;
+	char *ssl_key_file;
+	char *ssl_ciphers;         //NULL使用SW_SSL_CIPHERS
+	SSL_CTX *ssl_context;
+#endif
+	swUdpPeerTable *udp_peers; //UDP对端地址表
+
 	uint8_t have_udp_sock;      //是否有UDP监听端口
 	uint8_t have_tcp_sock;      //是否有TCP监听端口
 
 	uint8_t open_cpu_affinity; //是否设置CPU亲和性
+	uint8_t numa_affinity;     //按NUMA拓扑绑定CPU, reactor线程和它的worker在同一个节点
+	uint8_t incoming_cpu_affinity; //新连接交给绑定在其软中断CPU(SO_INCOMING_CPU)上的reactor线程, 需要open_cpu_affinity
+	uint8_t hugepage;          //共享内存使用大页, SW_HUGEPAGE_THP/SW_HUGEPAGE_HUGETLB
 	uint8_t open_tcp_nodelay;  //是否关闭Nagle算法
+	uint8_t enable_reuse_port; //每个reactor线程使用SO_REUSEPORT监听并自己accept
+	uint8_t enable_edge_trigger; //连接使用边缘触发,读到EAGAIN为止,可写事件只注册一次
+	uint8_t direct_send;       //out_buffer为空时直接发送,EAGAIN后再监听EPOLLOUT
+	uint8_t dispatch_batch;    //进程模式下一轮事件循环内的小包合并投递到worker
+	uint8_t disable_package_batch; //有按key分配的分组时, 同一次读取的多个包不能合并投递
+	uint8_t work_stealing;     //线程模式下空闲的写线程窃取其他线程的请求,同一连接仍按顺序执行
+	uint32_t worker_spin_usec; //worker没有请求时自旋等待的微秒数,减少epoll_wait唤醒次数
+	uint16_t reload_batch;     //reload时每次最多替换的worker数量, 0表示不排空逐个替换
+	uint32_t reload_drain_timeout; //reload时等待worker处理完已投递请求的最长时间(毫秒)
 
 
 	/* tcp keepalive */
@@ -215,10 +570,25 @@ struct swServer_s
 	uint16_t package_length_type;  //length field type
 	int package_length_offset;    //第几个字节开始表示长度
 	int package_body_start ;      //第几个字节开始计算长度
+	swPackage_length_parser package_length_parser; //根据package_length_type选择
+
+	/* one package: http request */
+	uint8_t open_http_protocol;    //reactor线程解析HTTP/1.1请求, 投递swHttpRequest给worker
+	uint8_t open_websocket_protocol; //在open_http_protocol基础上处理WebSocket握手和帧, 只投递完整的数据消息
+	uint32_t websocket_compression_min_length; //小于此长度的消息不压缩
+
+	/* one package: redis command */
+	uint8_t open_redis_protocol;   //按RESP协议分包, 每个完整的命令投递一次
+
+	/* dispatch_mode=5: key在数据包中的位置 */
+	uint32_t dispatch_key_offset;
+	uint16_t dispatch_key_length;
 
 	/* buffer output/input setting*/
 	uint32_t buffer_output_size;
 	uint32_t buffer_input_size;
+	uint32_t buffer_high_watermark; //out_buffer的高水位, 超过后停止读取
+	uint32_t buffer_low_watermark;  //out_buffer的低水位, 低于后恢复读取
 
 	void *ptr2;
 
@@ -228,12 +598,34 @@ struct swServer_s
 
 	swListenList_node *listen_list;
 
+	swWorkerGroup worker_groups[SW_MAX_WORKER_GROUP];
+	uint8_t worker_group_num;
+
+	swReady *ready;  //reactor线程, writer线程和worker的启动握手, 在共享内存中
 	swReactorThread *reactor_threads;
 	swWriterThread *writer_threads;
+
+	swServerStats *stats;
+	swReactorStats *reactor_stats;
+	swRecvRing **recv_rings;   //PROCESS模式下超过SW_BUFFER_SIZE的length_check包直接接收到这里, worker处理完后释放
+	swWorkerStats *worker_stats;
+	int latency_sample;  //默认每多少个请求采样一次延迟, 0为关闭
+	int listen_options[SW_LISTEN_OPTION_NUM]; //所有端口的默认监听选项, 0为关闭
+	uint32_t slow_callback_usec; //回调或一轮事件循环超过此时间记录slowlog, 0为关闭
+	uint32_t overload_target_usec;   //worker排队延迟的目标, 0为不做过载保护, 只用于进程模式
+	uint32_t overload_interval_usec; //排队延迟持续超过目标多久算过载
+	char *overload_response;         //过载时回复给新请求的数据, NULL时直接关闭
+	uint32_t overload_response_length;
+	swWorkerLatency *worker_latency;   //没有端口开启采样时为NULL
+	swReactorLatency *reactor_latency;
 	swWorker *workers;
 
 	swConnection *connection_list; //连接列表
+	swConnectionInfo *connection_info; //连接的冷数据
 	int connection_list_capacity;  //超过此容量，会自动扩容
+	swConnectionChunk *connection_chunks; //按SW_CONNECTION_CHUNK_SIZE分块的连接计数
+	uint32_t connection_chunk_num;
+	time_t connection_release_time;  //上一次归还空闲块的时间
 
 	swReactor *reactor_ptr; //Main Reactor
 	swFactory *factory_ptr; //Factory
@@ -244,15 +636,28 @@ struct swServer_s
 	int (*onReceive)(swFactory *factory, swEventData *data);
 	void (*onClose)(swServer *serv, int fd, int from_id);
 	void (*onConnect)(swServer *serv, int fd, int from_id);
+	void (*onBufferFull)(swServer *serv, int fd, int from_id);  //worker中调用, 此时应暂停向该连接发送
+	void (*onBufferEmpty)(swServer *serv, int fd, int from_id);
 	void (*onMasterClose)(swServer *serv, int fd, int from_id);
 	void (*onMasterConnect)(swServer *serv, int fd, int from_id);
 	void (*onShutdown)(swServer *serv);
 	void (*onTimer)(swServer *serv, int interval);
 	void (*onWorkerStart)(swServer *serv, int worker_id); //Only process mode
 	void (*onWorkerStop)(swServer *serv, int worker_id);  //Only process mode
+	void (*onWorkerWarmup)(swServer *serv, int worker_id); //reload_batch>0时, 新worker加入分配之前调用
+	swSlowlog_dump onSlowlog; //worker中慢回调时在信号处理函数里调用, 打印调用栈
 	void (*onWorkerError)(swServer *serv, int worker_id, pid_t worker_pid, int exit_code);   //Only process mode
 	int (*onTask)(swServer *serv, swEventData *data);
 	int (*onFinish)(swServer *serv, swEventData *data);
+	/**
+	 * 可选, 合并发回的多个task结果一次回调, 为NULL时每个结果调用onFinish
+	 */
+	int (*onFinishBatch)(swServer *serv, swEventData *batch);
+	/**
+	 * dispatch_mode=5时从数据包中取出key, 返回key的长度, 返回0时按fd分配
+	 * 在reactor线程中调用, 代替dispatch_key_offset/dispatch_key_length
+	 */
+	uint32_t (*dispatch_key)(swServer *serv, char *data, uint32_t length, char **key);
 };
 
 int swServer_onFinish(swFactory *factory, swSendData *resp);
@@ -261,8 +666,44 @@ int swServer_onFinish2(swFactory *factory, swSendData *resp);
 void swServer_init(swServer *serv);
 int swServer_start(swServer *serv);
 int swServer_addListen(swServer *serv, int type, char *host,int port);
+int swServer_add_worker_group(swServer *serv, char *name, int worker_num, int dispatch_mode, int max_request);
+int swServer_bind_worker_group(swServer *serv, int port, char *name);
+swWorkerGroup* swServer_get_worker_group(swServer *serv, int worker_id);
+int swServer_set_cpu_affinity(swServer *serv, int reactor_thread, int id);
+int swServer_stats_create(swServer *serv);
+/**
+ * Prometheus文本格式, 追加到buf
+ */
+int swServer_stats_dump(swServer *serv, swString *buf);
+int swServer_stats_write(swServer *serv, char *file);
+/**
+ * port为0时设置所有端口的默认值
+ */
+int swServer_set_latency_sample(swServer *serv, int port, int sample);
+int swServer_set_listen_option(swServer *serv, int port, int option, int value);
+/**
+ * 是否采样, 返回写入info->time的时间戳, 不采样时为0
+ */
+uint32_t swServer_latency_stamp(swServer *serv, swDataHead *info);
+/**
+ * worker收到请求时记录排队延迟, 按CoDel的方式判断过载
+ */
+void swServer_overload_record(swServer *serv, uint32_t now, uint32_t sojourn);
+/**
+ * 所有worker都过载时返回1, 由accept和reactor线程调用
+ */
+int swServer_overloaded(swServer *serv);
+/**
+ * 拒绝过载时的连接或请求, 由调用方关闭连接
+ */
+void swServer_overload_reject(swServer *serv, int reactor_id, int fd, int reply);
+/**
+ * 合并所有worker或reactor线程的histogram
+ */
+int swServer_latency_merge(swServer *serv, int type, swHistogram *out);
 int swServer_create(swServer *serv);
 int swServer_listen(swServer *serv, swReactor *reactor);
+int swServer_master_onAccept(swReactor *reactor, swEvent *event);
 int swServer_free(swServer *serv);
 int swServer_close(swServer *factory, swDataHead *event);
 int swServer_process_close(swServer *serv, swDataHead *event);
@@ -270,18 +711,79 @@ int swServer_shutdown(swServer *serv);
 int swServer_addTimer(swServer *serv, int interval);
 int swServer_reload(swServer *serv);
 int swServer_send_udp_packet(swServer *serv, swSendData *resp);
+void swServer_udp_queue_start(swServer *serv);
+void swServer_udp_queue_end(swServer *serv);
+int swServer_udp_queue_flush(swServer *serv);
+int swServer_tcp_send(swServer *serv, int fd, char *data, int length);
+int swServer_tcp_sendv(swServer *serv, int fd, struct iovec *iov, int iovcnt);
+int swServer_websocket_push(swServer *serv, int fd, char *data, int length, int opcode);
+int swServer_proxy(swServer *serv, int fd, char *host, int port);
+/**
+ * 进程模式: worker直接写连接的socket, 大的响应不再经过reactor线程中转
+ * 之前的响应发送完后, reactor线程通过worker管道(SCM_RIGHTS)发来socket的副本, 返回副本的fd, 失败返回SW_ERR
+ * 阻塞等待期间管道中到达的其他请求在当前回调返回后按顺序处理
+ */
+int swServer_direct_begin(swServer *serv, int fd, int timeout_ms);
+/**
+ * 副本和连接共享O_NONBLOCK, 在这里等待可写, timeout_ms为每次等待的超时时间
+ */
+int swServer_direct_send(int sock, char *data, size_t length, int timeout_ms);
+int swServer_direct_sendfile(int sock, char *filename, off_t offset, size_t length, int timeout_ms);
+/**
+ * 关闭副本并归还连接, reactor线程继续发送期间追加到out_buffer的响应
+ */
+int swServer_direct_end(swServer *serv, int fd, int sock);
+int swServer_sendfile(swServer *serv, int fd, char *filename, off_t offset, off_t length);
+int swServer_broadcast(swServer *serv, char *data, int length);
+int swServer_multicast(swServer *serv, int *fds, int fd_num, char *data, int length);
+int swServer_connection_next(swServer *serv, swConnectionIterator *iter, int *fds, int size);
+int swServer_connection_snapshot(swServer *serv, int reactor_id, int **fds);
 int swServer_reactor_add(swServer *serv, int fd, int sock_type); //no use
 int swServer_reactor_del(swServer *serv, int fd, int reacot_id); //no use
 int swServer_get_manager_pid(swServer *serv);
 
 int swTaskWorker_onTask(swProcessPool *pool, swEventData *task);
 void swTaskWorker_onWorkerStart(swProcessPool *pool, int worker_id);
+int swTaskWorker_dispatch(swServer *serv, swEventData *task, int worker_id);
+int swTaskWorker_finish(swServer *serv, swEventData *result, int worker_id);
+int swTaskWorker_onFinish_batch(swServer *serv, swEventData *batch);
+/**
+ * worker收到一个task结果, 先交给等待的协程, 否则回调onFinish
+ */
+int swTaskWorker_onResult(swServer *serv, swEventData *result);
+
+typedef struct _swTaskPackage
+{
+	void *data;
+	uint32_t length;
+} swTaskPackage;
+
+#define swTaskWorker_result_multi(worker_id, task_id) (&SwooleG.task_result_multi[(worker_id) * SW_TASKWAIT_MULTI_MAX + (task_id) % SW_TASKWAIT_MULTI_MAX])
+
+int swTaskWorker_pack(swEventData *task, void *data, int data_len);
+void* swTaskWorker_unpack(swEventData *task, int *data_len);
+void swTaskWorker_release(swEventData *task);
+
+/**
+ * SW_EVENT_PACKAGE_VIEW: 包在reactor线程的recv_ring中的位置
+ */
+typedef struct _swPackage_view
+{
+	uint32_t offset;
+	uint32_t length;
+} swPackage_view;
 
-#define swPackage_data(task) ((task->info.type==SW_EVENT_PACKAGE_END)?SwooleWG.buffer_input[task->info.from_id]->str:task->data)
-#define swPackage_length(task) ((task->info.type==SW_EVENT_PACKAGE_END)?SwooleWG.buffer_input[task->info.from_id]->length:task->info.len)
+#define swPackage_view_data(task) swRecvRing_data(SwooleG.serv->recv_rings[(task)->info.from_id], ((swPackage_view *) (task)->data)->offset)
+#define swPackage_data(task) ((task->info.type==SW_EVENT_PACKAGE_END)?SwooleWG.buffer_input[task->info.from_id]->str:\
+		((task->info.type==SW_EVENT_PACKAGE_VIEW)?swPackage_view_data(task):task->data))
+#define swPackage_length(task) ((task->info.type==SW_EVENT_PACKAGE_END)?SwooleWG.buffer_input[task->info.from_id]->length:\
+		((task->info.type==SW_EVENT_PACKAGE_VIEW)?((swPackage_view *) task->data)->length:task->info.len))
 
 SWINLINE int swServer_new_connection(swServer *serv, swEvent *ev);
 SWINLINE void swConnection_close(swServer *serv, int fd, int notify);
+SWINLINE void swConnection_idle_link(swServer *serv, swConnection *conn);
+SWINLINE void swConnection_idle_unlink(swServer *serv, swConnection *conn);
+SWINLINE void swConnection_idle_touch(swServer *serv, swConnection *conn);
 SWINLINE int swConnection_error(int fd, int err);
 
 #define SW_SERVER_MAX_FD_INDEX        0
@@ -291,22 +793,66 @@ SWINLINE int swConnection_error(int fd, int err);
 #define swServer_set_maxfd(serv,maxfd) (serv->connection_list[SW_SERVER_MAX_FD_INDEX].fd=maxfd)
 #define swServer_get_maxfd(serv) (serv->connection_list[SW_SERVER_MAX_FD_INDEX].fd)
 #define swServer_get_connection(serv,fd) ((fd>serv->max_conn|| fd<= 2)?NULL:&serv->connection_list[fd])
+#define swServer_get_connection_info(serv,fd) (&serv->connection_info[fd])
 //使用connection_list[1]表示最小的FD
 #define swServer_set_minfd(serv,maxfd) (serv->connection_list[SW_SERVER_MIN_FD_INDEX].fd=maxfd)
 #define swServer_get_minfd(serv) (serv->connection_list[SW_SERVER_MIN_FD_INDEX].fd)
+//连接所属reactor线程的trunk内存池
+#define swServer_heartbeat_enable(serv) ((serv)->heartbeat_check_interval >= 1 && (serv)->heartbeat_check_interval <= (serv)->heartbeat_idle_time)
+#define swServer_get_buffer_pool(serv,reactor_id) (&(serv->reactor_threads[reactor_id].buffer_pool))
 SWINLINE swString* swConnection_get_string_buffer(swConnection *conn);
+SWINLINE void swConnection_chunk_ref(swServer *serv, int fd);
+SWINLINE void swConnection_chunk_unref(swServer *serv, int fd);
+void swConnection_chunk_release(swServer *serv);
 SWINLINE void swConnection_clear_string_buffer(swConnection *conn);
 SWINLINE swBuffer_trunk* swConnection_get_out_buffer(swConnection *conn, uint32_t type);
 SWINLINE swBuffer_trunk* swConnection_get_in_buffer(swConnection *conn);
 int swConnection_send_in_buffer(swConnection *conn);
 
+swPackage_length_parser swPackage_get_length_parser(uint16_t type);
+int swPackage_batch_add(swFactory *factory, swPackage_batch *batch, swDataHead *info, char *data);
+int swPackage_batch_flush(swFactory *factory, swPackage_batch *batch);
+int swPackage_batch_append(swPackage_batch *batch, swDataHead *info, char *data);
+void swPackage_batch_pack(swPackage_batch *batch);
+
+int swFileCache_create(swFileCache *cache);
+swFileCache_node* swFileCache_get(swFileCache *cache, char *filename, uint16_t name_len);
+void swFileCache_release(swFileCache_node *node);
+void swTask_sendfile_free(swTask_sendfile *task);
+
+swUdpPeerTable* swUdpPeerTable_new(uint32_t size);
+int swUdpPeerTable_intern(swUdpPeerTable *table, struct sockaddr *addr, socklen_t addrlen);
+int swUdpPeerTable_get(swUdpPeerTable *table, int fd, swUdpPeer *peer);
+
 int swReactorThread_onPackage(swReactor *reactor, swEvent *event);
 int swReactorThread_send(swEventData *resp);
+int swReactorThread_send_batch(swEventData *resps, int n);
+
+#ifdef SW_USE_OPENSSL
+SSL_CTX* swSSL_get_context(char *cert_file, char *key_file, char *ciphers);
+int swSSL_create(swServer *serv, int fd);
+int swSSL_accept(swServer *serv, int fd);
+void swSSL_free(swServer *serv, int fd);
+int swReactorThread_onHandshake(swReactor *reactor, swEvent *event);
+#endif
+
+int swProxy_start(swReactor *reactor, swEventData *resp);
+int swProxy_activate(swReactor *reactor, swConnection *conn);
+void swProxy_free(swReactor *reactor, int fd);
+int swProxy_onRead(swReactor *reactor, swEvent *event);
+int swProxy_onWrite(swReactor *reactor, swEvent *event);
+void swReactorThread_direct_free(swServer *serv, swConnection *conn);
 int swReactorThread_start(swServer *serv, swReactor *main_reactor_ptr);
 int swReactorThread_close_queue(swReactor *reactor, swCloseQueue *close_queue);
+int swReactorThread_close_queue_add(swServer *serv, int reactor_id, int fd);
+int swReactorThread_batch_notify(swServer *serv, int reactor_id, swDataHead *ev);
+void swReactorThread_idle_check(swReactor *reactor);
+void swReactorThread_batch_flush(swServer *serv, int reactor_id, int fd);
 int swReactorThread_onReceive_no_buffer(swReactor *reactor, swEvent *event);
 int swReactorThread_onReceive_buffer_check_length(swReactor *reactor, swEvent *event);
 int swReactorThread_onReceive_buffer_check_eof(swReactor *reactor, swEvent *event);
+int swReactorThread_onReceive_http(swReactor *reactor, swEvent *event);
+int swReactorThread_onReceive_redis(swReactor *reactor, swEvent *event);
 
 #ifdef __cplusplus
 }
@@ -44,4 +44,11 @@ int swoole_aio_write(int fd, void *inbuf, size_t size, off_t offset);
 int swoole_aio_dns_lookup(void *hostname, void *ip_addr, size_t size);
 #define swoole_aio_set_callback(callback) swoole_aio_complete_callback = callback
 
+#if defined(SW_AIO_THREAD_POOL) && defined(SW_AIO_USE_IO_URING) && defined(HAVE_IO_URING)
+int swoole_aio_uring_init(swReactor *reactor, int max_aio_events);
+int swoole_aio_uring_read(int fd, void *outbuf, size_t size, off_t offset);
+int swoole_aio_uring_write(int fd, void *inbuf, size_t size, off_t offset);
+void swoole_aio_uring_destroy();
+#endif
+
 #endif /* _SW_ASYNC_H_ */
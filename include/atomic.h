@@ -19,4 +19,13 @@ typedef volatile atomic_uint_t  atomic_t;
 #define sw_atomic_memory_barrier()        __sync_synchronize()
 #define sw_atomic_cpu_pause()             __asm__ ("pause")
 
+//x86的load/store不会和同类操作重排, 只需要阻止编译器重排
+#if defined(__x86_64__) || defined(__i386__)
+#define sw_atomic_read_barrier()          __asm__ __volatile__("" ::: "memory")
+#define sw_atomic_write_barrier()         __asm__ __volatile__("" ::: "memory")
+#else
+#define sw_atomic_read_barrier()          __sync_synchronize()
+#define sw_atomic_write_barrier()         __sync_synchronize()
+#endif
+
 #endif
@@ -18,16 +18,40 @@ typedef struct _swBuffer_trunk
 	void *data;
 	uint32_t type;
 	uint32_t length;
-	uint16_t offset;
+	uint32_t offset;
+	swMemoryPool *pool; //从哪个pool分配的,为NULL表示使用sw_malloc
 	struct _swBuffer_trunk *next;
 } swBuffer_trunk;
 
+/**
+ * 多个连接共享的发送数据, 在send_arena中分配,跨进程可见
+ * 每个引用它的trunk持有一个引用计数, 为0时释放
+ */
+typedef struct _swBuffer_shared
+{
+	atomic_t refcount;
+	uint32_t length;
+	char data[0];
+} swBuffer_shared;
+
+#define swBuffer_trunk_data(trunk)   (((trunk)->type == SW_TRUNK_SHARED) ? ((swBuffer_shared *) (trunk)->data)->data : (char *) (trunk)->data)
+#define swBuffer_trunk_is_data(trunk) ((trunk)->type == SW_TRUNK_DATA || (trunk)->type == SW_TRUNK_SHARED)
+
+/**
+ * trunk内存池, 按尺寸分级, 每个reactor线程一个, 无锁
+ */
+typedef struct _swBufferPool
+{
+	swMemoryPool size_class[SW_BUFFER_POOL_CLASS_NUM];
+} swBufferPool;
+
 typedef struct _swBuffer
 {
 	int fd;
-	uint8_t trunk_num; //trunk数量
+	uint32_t trunk_num; //trunk数量
 	uint16_t trunk_size;
 	uint32_t length;
+	swBufferPool *pool;
 	swBuffer_trunk *head;
 	swBuffer_trunk *tail;
 } swBuffer;
@@ -36,9 +60,16 @@ typedef struct _swBuffer
 #define swBuffer_empty(buffer)       (buffer == NULL || buffer->head == NULL)
 
 SWINLINE swBuffer* swBuffer_new(int trunk_size);
-swBuffer_trunk *swBuffer_new_trunk(swBuffer *buffer, uint32_t type, uint16_t size);
+swBuffer_trunk *swBuffer_new_trunk(swBuffer *buffer, uint32_t type, uint32_t size);
 SWINLINE void swBuffer_pop_trunk(swBuffer *buffer, swBuffer_trunk *trunk);
 int swBuffer_in(swBuffer *buffer, swSendData *send_data);
+int swBuffer_append_shared(swBuffer *buffer, swBuffer_shared *shared, uint32_t offset);
+swBuffer_shared* swBuffer_shared_alloc(uint32_t length);
+swBuffer_shared* swBuffer_shared_new(char *data, uint32_t length);
+SWINLINE void swBuffer_shared_release(swBuffer_shared *shared);
+int swBuffer_writev(swBuffer *buffer, int fd);
+
+int swBufferPool_create(swBufferPool *pool, int memory_limit);
 
 void swBuffer_debug(swBuffer *buffer);
 int swBuffer_free(swBuffer *buffer);
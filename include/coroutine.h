@@ -0,0 +1,97 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef SW_COROUTINE_H_
+#define SW_COROUTINE_H_
+
+#include "swoole.h"
+#include "Client.h"
+
+#include <ucontext.h>
+
+enum swCoroutine_state
+{
+	SW_CORO_RUNNING = 1,
+	SW_CORO_WAITING,
+	SW_CORO_DEAD,
+};
+
+typedef void (*swCoroutine_func)(void *arg);
+
+typedef struct _swCoroutine
+{
+	ucontext_t ctx;
+	ucontext_t *caller;  //resume时保存的上下文, yield时切换回去
+	void *stack;         //mmap分配, 最低的一页是保护页
+	uint32_t id;
+	uint8_t state;
+	int result;          //resume传给yield的返回值
+	int timer_id;        //等待超时的定时器, 0为没有
+	int wait_fd;         //正在等待的fd, -1为没有
+	swCoroutine_func func;
+	void *arg;
+	struct _swCoroutine *next; //空闲链表
+} swCoroutine;
+
+/**
+ * 协程运行在当前进程的SwooleG.main_reactor上, 只能在一个线程中使用
+ * 等待fd, 定时器和task结果时yield, 事件到达后由reactor回调resume
+ * 不在协程中调用等待函数时退化为阻塞调用
+ * 只提供C接口, PHP5的执行器状态不是每个协程一份, swoole_server_set会忽略enable_coroutine
+ */
+
+/**
+ * 设置栈的尺寸和最多同时存在的协程数, 0为使用默认值, 必须在创建第一个协程之前调用
+ */
+int swCoroutine_init(uint32_t stack_size, uint32_t max_num);
+/**
+ * 创建协程并立即执行到第一次yield或结束, 返回协程id, 超过max_num或内存不足时返回SW_ERR
+ */
+int swCoroutine_create(swCoroutine_func func, void *arg);
+swCoroutine* swCoroutine_current(void);
+/**
+ * 切换回resume的位置, 返回下一次resume传入的result
+ */
+int swCoroutine_yield(void);
+void swCoroutine_resume(swCoroutine *co, int result);
+uint32_t swCoroutine_num(void);
+void swCoroutine_free(void);
+
+/**
+ * 等待fd可读或可写, events为SW_EVENT_READ或SW_EVENT_WRITE
+ * 返回SW_OK, 超时返回SW_ERR并设置errno为ETIMEDOUT, timeout_ms小于0为不超时
+ */
+int swCoroutine_wait_fd(int fd, int events, int timeout_ms);
+int swCoroutine_sleep(int ms);
+
+/**
+ * 使用swClient的非阻塞socket, cli->timeout为每次等待的超时时间
+ */
+int swCoroutine_connect(swClient *cli, char *host, int port, double timeout);
+int swCoroutine_send(swClient *cli, char *data, int length);
+int swCoroutine_recv(swClient *cli, char *data, int length, int waitall);
+
+/**
+ * 投递task并等待结果, task->info.fd必须是task_id, 结果复制到result
+ * 超时返回SW_ERR, 之后到达的结果仍然交给onFinish
+ */
+int swCoroutine_task(swServer *serv, swEventData *task, int worker_id, int timeout_ms, swEventData *result);
+/**
+ * worker收到task结果时调用, 有协程在等待时返回1
+ */
+int swCoroutine_task_finish(swEventData *result);
+
+#endif /* SW_COROUTINE_H_ */
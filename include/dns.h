@@ -0,0 +1,43 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef SW_DNS_H_
+#define SW_DNS_H_
+
+#include "swoole.h"
+
+typedef struct _swDNSResolver_result
+{
+	uint8_t ipv4_num;
+	uint8_t ipv6_num;
+	struct in_addr ipv4[SW_DNS_HOST_ADDR_MAX];
+	struct in6_addr ipv6[SW_DNS_HOST_ADDR_MAX];
+} swDNSResolver_result;
+
+/**
+ * result为NULL表示查询失败
+ */
+typedef void (*swDNSResolver_callback)(char *domain, swDNSResolver_result *result, void *data);
+
+/**
+ * 在reactor上异步查询A/AAAA记录, 相同的域名只发送一次查询
+ * 命中缓存或/etc/hosts时直接回调
+ */
+int swDNSResolver_lookup(swReactor *reactor, char *domain, swDNSResolver_callback callback, void *data);
+swDNSResolver_result* swDNSResolver_find(char *domain);
+void swDNSResolver_free();
+
+#endif /* SW_DNS_H_ */
@@ -3,17 +3,39 @@
 
 typedef struct swHashMap_node* swHashMap;
 
+/**
+ * 整数key的哈希表, 开放寻址+线性探测, 删除时后移回填, 不需要墓碑
+ * 数据直接存在槽位中, 容量是2的幂, 第一次add时创建, NULL就是空表
+ * data为NULL的槽位是空的, 所以不能存NULL
+ */
+typedef struct _swHashMap_int_slot
+{
+	uint64_t key;
+	void *data;
+} swHashMap_int_slot;
+
+typedef struct _swHashMap_int_table
+{
+	uint32_t size;
+	uint32_t num;
+	uint8_t bits;
+	swHashMap_int_slot slots[0];
+} swHashMap_int_table;
+
+typedef swHashMap_int_table* swHashMap_int;
+
 void swHashMap_free(swHashMap *hm);
 int swHashMap_add(swHashMap *hm, char *key, uint16_t key_len, void *data);
-void swHashMap_add_int(swHashMap *hm, uint64_t key, void *data);
+void swHashMap_add_int(swHashMap_int *hm, uint64_t key, void *data);
 void* swHashMap_find(swHashMap *hm, char *key, uint16_t key_len);
-void* swHashMap_find_int(swHashMap *hm, uint64_t key);
-void swHashMap_update_int(swHashMap *hm, uint64_t key, void *data);
+void* swHashMap_find_int(swHashMap_int *hm, uint64_t key);
+void swHashMap_update_int(swHashMap_int *hm, uint64_t key, void *data);
 int swHashMap_update(swHashMap *hm, char *key, uint16_t key_len, void *data);
 int swHashMap_del(swHashMap *hm, char *key, uint16_t key_len);
-void swHashMap_del_int(swHashMap *hm, uint64_t key);
+void swHashMap_del_int(swHashMap_int *hm, uint64_t key);
 SWINLINE void* swHashMap_foreach(swHashMap* root, char **key, void **data, swHashMap head);
-void* swHashMap_foreach_int(swHashMap* root, uint64_t *key, void **data, swHashMap head);
+void* swHashMap_foreach_int(swHashMap_int* root, uint64_t *key, void **data, void *head);
 void swHashMap_destory(swHashMap* root);
+void swHashMap_free_int(swHashMap_int *hm);
 
 #endif
@@ -0,0 +1,93 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef SW_HTTP_H_
+#define SW_HTTP_H_
+
+#include "swoole.h"
+
+#define SW_HTTP_AGAIN        1   //数据不完整, 等待后续数据
+
+enum swHttp_method
+{
+	SW_HTTP_OTHER = 0,
+	SW_HTTP_GET,
+	SW_HTTP_POST,
+	SW_HTTP_HEAD,
+	SW_HTTP_PUT,
+	SW_HTTP_DELETE,
+	SW_HTTP_OPTIONS,
+	SW_HTTP_PATCH,
+};
+
+/**
+ * 位置都相对于swHttpRequest_data(), 头部最大SW_HTTP_HEADER_MAX_SIZE字节
+ */
+typedef struct _swHttp_slice
+{
+	uint16_t offset;
+	uint16_t length;
+} swHttp_slice;
+
+typedef struct _swHttp_header
+{
+	swHttp_slice name;
+	swHttp_slice value;
+} swHttp_header;
+
+/**
+ * reactor线程解析后投递给worker的请求, 后面紧跟header_num个swHttp_header,
+ * 然后是原始的请求行和头部(header_length字节), 最后是解码后的body(content_length字节)
+ */
+typedef struct _swHttpRequest
+{
+	uint8_t method;
+	uint8_t version;            //10: HTTP/1.0, 11: HTTP/1.1
+	uint8_t keepalive;
+	uint8_t chunked;
+	uint8_t expect_continue;
+	uint16_t status;            //解析失败时返回给客户端的状态码
+	uint16_t header_length;
+	uint16_t header_num;
+	uint32_t content_length;
+	swHttp_slice method_name;
+	swHttp_slice uri;
+	swHttp_slice path;
+	swHttp_slice query_string;
+	swHttp_header headers[0];
+} swHttpRequest;
+
+#define swHttpRequest_size(req)     (sizeof(swHttpRequest) + (req)->header_num * sizeof(swHttp_header))
+#define swHttpRequest_data(req)     ((char *) ((req)->headers + (req)->header_num))
+#define swHttpRequest_body(req)     (swHttpRequest_data(req) + (req)->header_length)
+
+/**
+ * 解析请求行和头部, req至少要有SW_HTTP_HEADER_NUM个headers的空间
+ * 返回SW_OK, SW_HTTP_AGAIN, 或者SW_ERR(req->status为错误状态码)
+ */
+int swHttpRequest_parse(swHttpRequest *req, char *buf, uint32_t length);
+/**
+ * 检查chunked body是否完整, decode为1时就地解码
+ * body_length为解码后的长度, consumed为包括trailer在内的原始长度
+ */
+int swHttpRequest_parse_chunked(char *buf, uint32_t length, int decode, uint32_t *body_length, uint32_t *consumed);
+swHttp_header* swHttpRequest_find_header(swHttpRequest *req, char *name, int name_len);
+/**
+ * 逗号分隔的列表中是否有token, 如Connection: keep-alive, Upgrade
+ */
+int swHttp_has_token(char *value, int length, char *token, int token_len);
+
+#endif /* SW_HTTP_H_ */
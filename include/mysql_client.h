@@ -0,0 +1,150 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef SW_MYSQL_CLIENT_H_
+#define SW_MYSQL_CLIENT_H_
+
+#include "swoole.h"
+#include <sys/un.h>
+
+//客户端错误码, 与libmysqlclient一致
+#define SW_MYSQL_CR_CONN_HOST_ERROR     2003
+#define SW_MYSQL_CR_SERVER_LOST         2013
+#define SW_MYSQL_CR_MALFORMED_PACKET    2027
+#define SW_MYSQL_CR_PARAMS_NOT_BOUND    2031
+#define SW_MYSQL_CR_AUTH_PLUGIN         2059
+
+typedef struct _swMySQL_field
+{
+	char *name;
+	uint16_t name_len;
+	uint8_t type;
+	uint8_t decimals;
+	uint16_t flags;
+	uint16_t charset;
+} swMySQL_field;
+
+typedef struct _swMySQL_result
+{
+	uint16_t field_num;
+	swMySQL_field *fields;
+	uint32_t row_num;
+	uint64_t affected_rows;
+	uint64_t insert_id;
+	uint16_t status;
+	uint16_t warnings;
+	uint16_t error_code;        //不为0时表示查询失败
+	char sqlstate[6];
+	char error_msg[SW_MYSQL_ERROR_MAX];
+} swMySQL_result;
+
+typedef struct _swMySQL_query swMySQL_query;
+
+/**
+ * values[i]为NULL表示SQL NULL, 值不以\0结尾, 只在回调期间有效
+ */
+typedef void (*swMySQL_onRow)(swMySQL_query *query, swMySQL_result *result, char **values, uint32_t *lengths);
+/**
+ * 查询结束时回调一次, 回调后query不再被使用, 由调用者释放
+ */
+typedef void (*swMySQL_onResult)(swMySQL_query *query, swMySQL_result *result);
+
+struct _swMySQL_query
+{
+	char *sql;
+	uint32_t sql_len;
+	/**
+	 * param_num > 0 或 binary = 1 时使用预处理语句, 结果为二进制协议, 参数以字符串绑定
+	 */
+	uint8_t binary;
+	uint16_t param_num;
+	char **params;              //NULL表示SQL NULL
+	uint32_t *param_lens;
+	swMySQL_onRow onRow;
+	swMySQL_onResult onResult;
+	void *object;
+	struct _swMySQL_query *next;
+};
+
+typedef struct _swMySQL_pool swMySQL_pool;
+
+typedef struct _swMySQL_client
+{
+	int fd;
+	uint8_t state;
+	uint8_t result_state;
+	uint8_t sequence;
+	uint8_t releasing;          //正在执行结果回调
+	int timer_id;
+	uint32_t capability;
+	char scramble[20];
+	uint16_t field_index;
+	uint32_t skip_packets;      //预处理时忽略的参数/字段定义包
+	uint32_t stmt_id;
+	uint16_t stmt_param_num;
+	swString *buffer;           //读缓存
+	uint32_t offset;            //buffer中已解析的位置
+	swString *out;              //写缓存, 发送不完时等待可写事件
+	swString *row;              //二进制协议转换为字符串的缓存
+	char **values;
+	uint32_t *lengths;
+	swMySQL_query *query;
+	swMySQL_result result;
+	swMySQL_pool *pool;
+	struct _swMySQL_client *next;      //pool中所有的连接
+	struct _swMySQL_client *next_idle;
+} swMySQL_client;
+
+/**
+ * 每个worker一个或多个pool, 一个pool最多size个连接, 查询按FIFO分配到空闲的连接
+ */
+struct _swMySQL_pool
+{
+	swReactor *reactor;
+	int sock_domain;
+	struct sockaddr_in addr;
+	struct sockaddr_un unix_addr;
+	char user[SW_MYSQL_USER_MAX];
+	char password[SW_MYSQL_PASSWORD_MAX];
+	char database[SW_MYSQL_DATABASE_MAX];
+	uint8_t charset;
+	uint16_t size;
+	uint16_t num;               //已创建的连接数量
+	uint16_t connecting;        //正在连接和认证的数量
+	uint16_t releasing;
+	uint8_t destroy;            //回调中释放时延迟到回调之后
+	uint32_t callback_depth;
+	swMySQL_client *clients;
+	swMySQL_client *idle;
+	swMySQL_query *queue_head;
+	swMySQL_query *queue_tail;
+	uint32_t queue_num;
+	void *object;
+};
+
+/**
+ * host以/开头时使用unix socket
+ */
+swMySQL_pool* swMySQL_pool_new(swReactor *reactor, char *host, int port, char *user, char *password, char *database,
+		int size);
+int swMySQL_pool_query(swMySQL_pool *pool, swMySQL_query *query);
+int swMySQL_charset(char *name);
+/**
+ * 未完成的查询以SW_MYSQL_CR_SERVER_LOST回调, 在回调中调用时延迟到回调返回后释放
+ */
+void swMySQL_pool_free(swMySQL_pool *pool);
+
+#endif /* SW_MYSQL_CLIENT_H_ */
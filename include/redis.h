@@ -0,0 +1,131 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef SW_REDIS_H_
+#define SW_REDIS_H_
+
+#include "swoole.h"
+#include <sys/un.h>
+
+enum swRedis_reply_type
+{
+	SW_REDIS_REPLY_STATUS = 1,  //+OK
+	SW_REDIS_REPLY_ERROR,       //-ERR
+	SW_REDIS_REPLY_INTEGER,     //:1
+	SW_REDIS_REPLY_STRING,      //$3 foo
+	SW_REDIS_REPLY_NIL,         //$-1 或 *-1
+	SW_REDIS_REPLY_ARRAY,       //*2
+};
+
+/**
+ * str指向连接的读缓存, 不以\0结尾, 只在回调期间有效
+ */
+typedef struct _swRedis_reply
+{
+	uint8_t type;
+	int64_t integer;
+	char *str;
+	uint32_t len;
+	uint32_t element_num;
+	struct _swRedis_reply *elements;    //数组的元素是连续的
+} swRedis_reply;
+
+/**
+ * 扫描一个完整的RESP值, 返回长度, 数据不完整返回0, 协议错误返回SW_ERR
+ * need为已知的最少需要的字节数, node_num为值的数量(包括所有数组元素)
+ */
+int swRedis_reply_length(char *data, uint32_t length, uint32_t *need, uint32_t *node_num);
+/**
+ * 服务器端分包: 客户端的命令是bulk string数组, 或者以\n结尾的inline命令
+ */
+int swRedis_request_length(char *data, uint32_t length, uint32_t *need);
+/**
+ * data必须是swRedis_reply_length返回的完整的值, nodes至少有node_num个
+ */
+void swRedis_reply_parse(char *data, swRedis_reply *nodes);
+
+typedef struct _swRedis_command swRedis_command;
+
+/**
+ * 连接出错或连接池关闭时reply为NULL, 错误信息在pool->error中, 回调后command不再被使用, 由调用者释放
+ */
+typedef void (*swRedis_onReply)(swRedis_command *command, swRedis_reply *reply);
+
+struct _swRedis_command
+{
+	int argc;
+	char **argv;
+	uint32_t *argv_len;
+	swRedis_onReply onReply;    //为NULL时是连接池内部的AUTH/SELECT
+	void *object;
+	struct _swRedis_command *next;
+};
+
+typedef struct _swRedis_pool swRedis_pool;
+
+typedef struct _swRedis_client
+{
+	int fd;
+	uint8_t connected;
+	int timer_id;
+	swString *buffer;           //读缓存
+	uint32_t offset;            //buffer中已解析的位置
+	swString *out;              //写缓存, 同一轮事件中的命令合并为一次send
+	swRedis_reply *nodes;
+	uint32_t node_size;
+	swRedis_command *head;      //已发送或等待发送, 按顺序对应回复
+	swRedis_command *tail;
+	uint32_t pending;
+	swRedis_command init[2];    //AUTH和SELECT
+	swRedis_pool *pool;
+	struct _swRedis_client *next;
+} swRedis_client;
+
+/**
+ * 每个worker一个或多个pool, 一个pool最多size个连接, 命令在连接上流水线发送不等待回复
+ * 有空闲连接时使用空闲连接, 否则在连接数未满时创建新连接, 连接数已满时分配到等待回复最少的连接
+ */
+struct _swRedis_pool
+{
+	swReactor *reactor;
+	int sock_domain;
+	struct sockaddr_in addr;
+	struct sockaddr_un unix_addr;
+	char password[SW_REDIS_PASSWORD_MAX];
+	int database;
+	uint16_t size;
+	uint16_t num;
+	uint8_t destroy;            //回调中释放时延迟到回调之后
+	uint32_t callback_depth;
+	swRedis_client *clients;
+	char error[SW_REDIS_ERROR_MAX];
+	void *object;
+};
+
+/**
+ * host以/开头时使用unix socket, password为空不认证, database为0不执行SELECT
+ */
+swRedis_pool* swRedis_pool_new(swReactor *reactor, char *host, int port, char *password, int database, int size);
+/**
+ * 返回SW_ERR时不会回调
+ */
+int swRedis_pool_command(swRedis_pool *pool, swRedis_command *command);
+/**
+ * 未完成的命令以NULL回调, 在回调中调用时延迟到回调返回后释放
+ */
+void swRedis_pool_free(swRedis_pool *pool);
+
+#endif /* SW_REDIS_H_ */
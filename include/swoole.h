@@ -48,6 +48,7 @@ extern "C" {
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <sys/mman.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -100,6 +101,9 @@ int clock_gettime(clock_id_t which_clock, struct timespec *t);
 #define CLOCK_REALTIME 0
 #endif
 
+//编译期检查, 条件不成立时数组长度为负
+#define SW_STATIC_ASSERT(cond, name) typedef char sw_static_assert_##name[(cond) ? 1 : -1]
+
 #define SW_START_LINE  "-------------------------START----------------------------"
 #define SW_END_LINE    "-------------------------END------------------------------"
 /*----------------------------------------------------------------------------*/
@@ -125,7 +129,6 @@ int clock_gettime(clock_id_t which_clock, struct timespec *t);
 #define SW_CPU_NUM             sysconf(_SC_NPROCESSORS_ONLN)
 
 #define SW_STRL(s)             s, sizeof(s)
-#define SW_START_SLEEP         usleep(100000)  //sleep 1s,wait fork and pthread_create
 
 #define sw_malloc              malloc
 #define sw_free(ptr)           if(ptr){free(ptr);ptr=NULL;}
@@ -152,8 +155,16 @@ int clock_gettime(clock_id_t which_clock, struct timespec *t);
 #define SW_FD_AIO              9 //linux native aio
 #define SW_FD_SEND_TO_CLIENT   10 //sendtoclient
 #define SW_FD_SIGNAL           11
+#define SW_FD_RING             12 //shared memory ring notify
+#define SW_FD_AIO_URING        13 //io_uring aio eventfd
+#define SW_FD_DNS              14 //dns resolver udp socket
+#define SW_FD_MYSQL            15 //async mysql client
+#define SW_FD_PROXY            16 //splice proxy, client and upstream socket
+#define SW_FD_SSL              17 //tls握手中的连接, 握手完成后改为SW_FD_TCP
+#define SW_FD_CORO             18 //协程等待的fd
+#define SW_FD_REDIS            19 //async redis client
 
-#define SW_FD_USER             15 //SW_FD_USER or SW_FD_USER+n: for custom event
+#define SW_FD_USER             20 //SW_FD_USER or SW_FD_USER+n: for custom event
 
 #define SW_MODE_BASE           1
 #define SW_MODE_THREAD         2
@@ -164,6 +175,7 @@ int clock_gettime(clock_id_t which_clock, struct timespec *t);
 #define SW_SOCK_UDP            2
 #define SW_SOCK_TCP6           3
 #define SW_SOCK_UDP6           4
+#define SW_SOCK_SSL            (1u << 13) //与SW_SOCK_TCP/SW_SOCK_TCP6组合, 此端口启用TLS
 
 #define SW_LOG_DEBUG           0
 #define SW_LOG_INFO            1
@@ -171,15 +183,12 @@ int clock_gettime(clock_id_t which_clock, struct timespec *t);
 #define SW_LOG_ERROR           3
 #define SW_LOG_TRACE           4
 
-#define swWarn(str,...)        SwooleG.lock.lock(&SwooleG.lock);\
-snprintf(sw_error,SW_ERROR_MSG_SIZE,"%s: "str,__func__,##__VA_ARGS__);\
-swLog_put(SW_LOG_WARN, sw_error);\
-SwooleG.lock.unlock(&SwooleG.lock)
+//sw_error是线程局部变量, 不需要加锁
+#define swWarn(str,...)        snprintf(sw_error,SW_ERROR_MSG_SIZE,"%s: "str,__func__,##__VA_ARGS__);\
+swLog_put(SW_LOG_WARN, sw_error)
 
-#define swError(str,...)       SwooleG.lock.lock(&SwooleG.lock);\
-snprintf(sw_error, SW_ERROR_MSG_SIZE, str, ##__VA_ARGS__);\
+#define swError(str,...)       snprintf(sw_error, SW_ERROR_MSG_SIZE, str, ##__VA_ARGS__);\
 swLog_put(SW_LOG_ERROR, sw_error);\
-SwooleG.lock.unlock(&SwooleG.lock);\
 exit(1)
 
 #ifdef SW_DEBUG
@@ -200,17 +209,14 @@ enum SW_TRACE_LOG
 };
 
 #if SW_LOG_TRACE_OPEN == 1
-#define swTraceLog(id,str,...)      SwooleG.lock.lock(&SwooleG.lock);\
-snprintf(sw_error,SW_ERROR_MSG_SIZE,"%s: "str,__func__,##__VA_ARGS__);\
-swLog_put(SW_LOG_TRACE, sw_error);\
-SwooleG.lock.unlock(&SwooleG.lock)
+#define swTraceLog(id,str,...)      snprintf(sw_error,SW_ERROR_MSG_SIZE,"%s: "str,__func__,##__VA_ARGS__);\
+swLog_put(SW_LOG_TRACE, sw_error)
 #elif SW_LOG_TRACE_OPEN == 0
 #define swTraceLog(id,str,...)
 #else
-#define swTraceLog(id,str,...)      if (id==SW_LOG_TRACE_OPEN) {SwooleG.lock.lock(&SwooleG.lock);\
+#define swTraceLog(id,str,...)      if (id==SW_LOG_TRACE_OPEN) {\
 snprintf(sw_error,SW_ERROR_MSG_SIZE,"%s: "str,__func__,##__VA_ARGS__);\
-swLog_put(SW_LOG_TRACE, sw_error);\
-SwooleG.lock.unlock(&SwooleG.lock);}
+swLog_put(SW_LOG_TRACE, sw_error);}
 #endif
 
 #define swYield()              sched_yield() //or usleep(1)
@@ -226,6 +232,7 @@ typedef struct _swDataHead
 	int16_t from_id; //Reactor Id
 	uint8_t type; //类型
 	uint8_t from_fd; //从哪个ServerFD引发的
+	uint32_t time;   //采样时reactor投递的时间戳(swClock_usec的低32位), 0为不采样
 } swDataHead;
 
 typedef struct _swEventData
@@ -249,9 +256,13 @@ typedef swDataHead swEvent;
 //	int fd;
 //} swEvent;
 
+/**
+ * reactor线程中本轮关闭的fd, 满了时扩容, 在onFinish中投递
+ */
 typedef struct _swEventClose_queue {
-	int events[SW_CLOSE_QLEN];
+	int *events;
 	int num;
+	int size;
 } swCloseQueue;
 
 typedef struct _swEventConnect
@@ -323,6 +334,12 @@ enum SW_LOCKS
 #define SW_SPINLOCK SW_SPINLOCK
 	SW_ATOMLOCK = 6,
 #define SW_ATOMLOCK SW_ATOMLOCK
+	SW_FUTEXLOCK = 7,
+#define SW_FUTEXLOCK SW_FUTEXLOCK
+	SW_SEQLOCK = 8,
+#define SW_SEQLOCK SW_SEQLOCK
+	SW_BRLOCK = 9,
+#define SW_BRLOCK SW_BRLOCK
 };
 
 typedef struct _swLock swLock;
@@ -364,6 +381,35 @@ typedef struct _swAtomicLock
 	uint32_t spin;
 } swAtomicLock;
 
+//自旋+futex, 竞争激烈时睡眠而不是空转
+typedef struct _swFutexLock
+{
+	atomic_t value;
+	uint32_t spin;
+	int op_wait;
+	int op_wake;
+} swFutexLock;
+
+//顺序锁, 读者不修改共享数据
+typedef struct _swSeqLock
+{
+	atomic_t seq;
+} swSeqLock;
+
+//读者计数按CPU分散的读写锁
+typedef struct _swBRLock_slot
+{
+	atomic_t readers;
+	char padding[SW_CACHELINE_SIZE - sizeof(atomic_t)];
+} swBRLock_slot_t;
+
+typedef struct _swBRLock
+{
+	atomic_t writer;
+	uint8_t shared;
+	swBRLock_slot_t *slots;
+} swBRLock;
+
 //信号量
 typedef struct _swSem
 {
@@ -382,6 +428,9 @@ struct _swLock
 		swFileLock filelock;
 		swSem sem;
 		swAtomicLock atomlock;
+		swFutexLock futexlock;
+		swSeqLock seqlock;
+		swBRLock brlock;
 #ifdef HAVE_SPINLOCK
 		swSpinLock spinlock;
 #endif
@@ -406,6 +455,14 @@ typedef struct _swCond
 	int (*broadcast)(struct _swCond *object);
 } swCond;
 
+//启动握手, 代替固定时间的usleep
+typedef struct _swReady
+{
+	volatile int32_t count;  //futex只支持32位
+	int op_wait;
+	int op_wake;
+} swReady;
+
 
 #define SW_SHM_MMAP_FILE_LEN  64
 typedef struct _swShareMemory_mmap
@@ -424,6 +481,8 @@ int swShareMemory_sysv_free(swShareMemory *object, int rm);
 int swShareMemory_mmap_free(swShareMemory *object);
 
 //-------------------share memory-------------------------
+#define SW_MEM_ALIGNED_SIZE(size)  (((size) + 7) & ~7)  //按8字节对齐
+
 typedef struct _swMemoryPoolSlab
 {
 	char tag; //1表示被占用 0未使用
@@ -459,6 +518,7 @@ swString *swString_new(size_t size);
 void swString_free(swString *str);
 int swString_append(swString *str, swString *append_str);
 int swString_extend(swString *str, size_t new_size);
+int swoole_strnpos(char *haystack, uint32_t haystack_length, char *needle, uint32_t needle_length);
 
 #define swString_length(s) (s->length)
 #define swString_ptr(s) (s->str)
@@ -470,16 +530,28 @@ typedef struct _swAllocator {
 	void (*destroy)(struct _swAllocator *alloc);
 } swAllocator;
 
+enum swHugepage_mode
+{
+	SW_HUGEPAGE_NONE = 0,
+	SW_HUGEPAGE_THP,        //madvise(MADV_HUGEPAGE), 透明大页
+	SW_HUGEPAGE_HUGETLB,    //MAP_HUGETLB, 需要预留大页, 失败时回退到THP
+};
+
+#define SW_MEMORY_CLASS_NUM   23      //16 ~ SW_MEMORY_CLASS_MAX
+#define SW_MEMORY_CLASS_MAX   32768
+
+/**
+ * 按尺寸分级的全局内存, 小块按级别放入空闲链表, 大块按地址合并
+ */
 typedef struct _swMemoryGlobal
 {
-	int size;  //总容量
-	void *mem; //剩余内存的指针
-	int offset; //内存分配游标
+	swLock lock;
 	char shared;
-	int pagesize;
-	swLock lock; //锁
-	void *root_page;
-	void *cur_page;
+	size_t size;    //预留的地址空间
+	size_t offset;  //未分配区的起点
+	void *mem;
+	struct _swMemoryFree *free_list[SW_MEMORY_CLASS_NUM];
+	struct _swMemoryFree *large_list;
 } swMemoryGlobal;
 
 /**
@@ -490,9 +562,17 @@ void swMemoryPool_free(swMemoryPool *pool, void *data);
 void* swMemoryPool_alloc(swMemoryPool *pool);
 
 /**
- * 全局内存,程序生命周期内只分配/释放一次
+ * 全局内存, 支持释放, 返回的内存已清零
  */
-swAllocator* swMemoryGlobal_create(int pagesize, char shared);
+swAllocator* swMemoryGlobal_create(size_t size, char shared);
+int swMemoryGlobal_contains(swAllocator *allocator, void *ptr);
+size_t swMemoryGlobal_size(void *ptr);
+void swMemoryGlobal_thread_flush(void);
+
+/**
+ * 共享内存分配器,可分配任意长度并支持释放,需要在fork之前创建
+ */
+swAllocator* swMemoryArena_create(uint32_t size);
 
 /**
  * 共享内存分配
@@ -501,6 +581,9 @@ void* sw_shm_malloc(size_t size);
 void sw_shm_free(void *ptr);
 void* sw_shm_calloc(size_t num, size_t _size);
 void* sw_shm_realloc(void *ptr, size_t new_size);
+void* sw_shm_reserve(size_t size);
+void sw_shm_hugepage(void *mem, size_t size);
+int sw_shm_decommit(void *addr, size_t length);
 
 int swRWLock_create(swLock *lock, int use_in_process);
 int swSem_create(swLock *lock, key_t key, int n);
@@ -513,6 +596,42 @@ int swAtomicLock_create(swLock *object, int spin);
 SWINLINE int swAtomicLock_lock(swLock *lock);
 SWINLINE int swAtomicLock_unlock(swLock *lock);
 SWINLINE int swAtomicLock_trylock(swLock *lock);
+int swFutexLock_create(swLock *lock, int use_in_process);
+int swSeqLock_create(swLock *lock, int use_in_process);
+int swBRLock_create(swLock *lock, int use_in_process);
+
+void swSeqLock_write_lock(swSeqLock *object);
+/**
+ * 读写一个定长记录, 读者在写者修改期间会重试
+ */
+void swSeqLock_read(swSeqLock *object, void *dst, void *src, size_t length);
+void swSeqLock_write(swSeqLock *object, void *dst, void *src, size_t length);
+
+static inline atomic_uint_t swSeqLock_read_begin(swSeqLock *object)
+{
+	atomic_uint_t seq;
+	while ((seq = object->seq) & 1)
+	{
+		sw_atomic_cpu_pause();
+	}
+	sw_atomic_read_barrier();
+	return seq;
+}
+
+/**
+ * 读取期间有写者时返回1, 需要重新读取
+ */
+static inline int swSeqLock_read_retry(swSeqLock *object, atomic_uint_t seq)
+{
+	sw_atomic_read_barrier();
+	return object->seq != seq;
+}
+
+static inline void swSeqLock_write_unlock(swSeqLock *object)
+{
+	sw_atomic_write_barrier();
+	object->seq++;
+}
 
 int swCond_create(swCond *cond);
 int swCond_notify(swCond *cond);
@@ -521,6 +640,14 @@ int swCond_timewait(swCond *cond, long sec, long nsec);
 int swCond_wait(swCond *cond);
 void swCond_free(swCond *cond);
 
+void swReady_init(swReady *ready, int use_in_process);
+void swReady_add(swReady *ready, int n);
+void swReady_done(swReady *ready);
+/**
+ * 等待所有add的线程/进程done, 超时返回SW_ERR
+ */
+int swReady_wait(swReady *ready, int timeout_msec);
+
 typedef struct _swThreadParam
 {
 	void *object;
@@ -528,7 +655,7 @@ typedef struct _swThreadParam
 } swThreadParam;
 
 extern int16_t sw_errno;
-extern char sw_error[SW_ERROR_MSG_SIZE];
+extern __thread char sw_error[SW_ERROR_MSG_SIZE];
 
 #define SW_PROCESS_MASTER      1
 #define SW_PROCESS_WORKER      2
@@ -538,15 +665,27 @@ extern char sw_error[SW_ERROR_MSG_SIZE];
 #define swIsWorker()          (SwooleG.process_type==SW_PROCESS_WORKER)
 #define swIsManager()         (SwooleG.process_type==SW_PROCESS_MANAGER)
 
+#define SW_THREAD_MASTER       1
+#define SW_THREAD_REACTOR      2
+
 //----------------------tool function---------------------
 int swLog_init(char *logfile);
 void swLog_put(int level, char *cnt);
 void swLog_free(void);
+void swLog_flush(void);
+/**
+ * 直接写入日志文件, 不经过日志线程和频率限制, 用于信号处理函数
+ */
+void swLog_write_direct(char *buf, int n);
 #define sw_log(str,...)       {snprintf(sw_error,SW_ERROR_MSG_SIZE,str,##__VA_ARGS__);swLog_put(SW_LOG_INFO, sw_error);}
 
 uint64_t swoole_hash_key(char *str, int str_len);
+uint64_t swoole_hash_fnv1a(char *str, int str_len);
+uint32_t swoole_jump_hash(uint64_t key, uint32_t num);
 uint32_t swoole_common_multiple(uint32_t u, uint32_t v);
 uint32_t swoole_common_divisor(uint32_t u, uint32_t v);
+void swoole_sha1(const char *str, int len, unsigned char *digest);
+int swoole_base64_encode(unsigned char *src, int src_len, char *dst);
 
 //----------------------core function---------------------
 SWINLINE int swSetTimeout(int sock, double timeout);
@@ -558,7 +697,7 @@ SWINLINE void swSetBlock(int);
 
 void swoole_init(void);
 void swoole_clean(void);
-int swSocket_listen(int type, char *host, int port, int backlog);
+int swSocket_listen(int type, char *host, int port, int backlog, int reuse_port);
 int swSocket_create(int type);
 swSignalFunc swSignal_set(int sig, swSignalFunc func, int restart, int mask);
 void swSignal_none(void);
@@ -583,6 +722,10 @@ typedef struct _swFactory
 	int (*onFinish)(struct _swFactory *, swSendData *result); //factory worker finish.callback
 } swFactory;
 
+//swReactor->flag
+#define SW_REACTOR_ONCE       1   //wait只轮询一次就返回, 返回就绪的fd数量
+#define SW_REACTOR_KEEP_FD    2   //del时不关闭fd
+
 struct swReactor_s
 {
 	void *object;
@@ -590,7 +733,7 @@ struct swReactor_s
 	uint32_t event_num;
 	uint32_t max_event_num;
 	uint16_t id; //Reactor ID
-	uint16_t flag; //flag
+	uint16_t flag; //SW_REACTOR_ONCE | SW_REACTOR_KEEP_FD
 	char running;
 
 	swReactor_handle handle[SW_MAX_FDTYPE];       //默认事件
@@ -608,12 +751,21 @@ struct swReactor_s
 
 	void (*onTimeout)(swReactor *); //发生超时时
 	void (*onFinish)(swReactor *);  //完成一次轮询
+
+	uint32_t slow_usec;   //单个回调或一轮事件处理超过此时间(微秒)时记录到日志, 0为关闭
+	uint8_t slow_flag;    //本轮已经记录过慢回调
+	uint64_t loop_start;
+	atomic_t *slow_count; //不为NULL时累加慢回调次数, 可以指向共享内存中的统计
 };
 
 typedef struct _swWorker swWorker;
 typedef struct _swThread swThread;
 typedef struct _swProcessPool swProcessPool;
 
+#define SW_POOL_DISPATCH_ROUND   1 //轮询
+#define SW_POOL_DISPATCH_QUEUE   3 //所有worker从同一个管道读取, 空闲的worker先取到
+#define SW_POOL_DISPATCH_LEAST   4 //投递给未完成任务最少的worker
+
 struct _swWorker
 {
 	pid_t pid;
@@ -637,13 +789,17 @@ struct _swProcessPool
 
 	int (*onTask)(struct _swProcessPool *pool, swEventData *task);
 	void (*onWorkerStart)(struct _swProcessPool *pool, int worker_id);
+	void (*onIdle)(struct _swProcessPool *pool); //管道中没有待处理的任务, 阻塞等待之前调用
 
 	int (*main_loop)(struct _swProcessPool *pool, swWorker *worker);
 
 	int round_id;
+	uint8_t dispatch_mode;  //worker_id小于0时的分配方式, SW_POOL_DISPATCH_*
+	atomic_t *inflight;     //SW_POOL_DISPATCH_LEAST: 每个worker未完成的任务数, 在共享内存中
+	swPipe queue;           //SW_POOL_DISPATCH_QUEUE: 所有worker共用的管道
 	swWorker *workers;
 	swPipe *pipes;
-	swHashMap map;
+	swHashMap_int map;
 
 	void *ptr;
 	void *ptr2;
@@ -660,6 +816,16 @@ typedef struct _swFactoryProcess
 	//worker的忙闲状态
 	//这里直接使用char来保存了，位运算速度会快，但需要前置计算
 	char *workers_status;
+	//dispatch_mode=4或reload_batch>0时每个worker未处理完的请求数
+	atomic_t *workers_inflight;
+	//平滑reload中不再分配新请求的worker
+	volatile uint8_t *workers_excluded;
+
+#if SW_WORKER_IPC_MODE == 3
+	struct _swRingBuffer **rings;   //每个(reactor线程,worker)一个环形队列
+	swPipe *rings_notify;           //每个worker一个eventfd,用于唤醒
+	volatile uint8_t *rings_sleep;  //worker是否在等待唤醒
+#endif
 
 	int writer_num; //writer thread num
 	int worker_num; //worker child process num
@@ -682,6 +848,10 @@ int swFactoryProcess_shutdown(swFactory *factory);
 int swFactoryProcess_end(swFactory *factory, swDataHead *event);
 int swFactoryProcess_worker_excute(swFactory *factory, swEventData *task);
 int swFactoryProcess_send2worker(swFactory *factory, swEventData *data, int worker_id);
+/**
+ * 等待reactor线程回复SW_EVENT_DIRECT, 返回收到的fd, 期间的其他消息暂存后按顺序处理
+ */
+int swFactoryProcess_direct_wait(swFactory *factory, int fd, int timeout_ms);
 int swFactoryProcess_send2client(swReactor *reactor, swDataHead *ev);
 
 int swFactoryThread_create(swFactory *factory, int writer_num);
@@ -701,6 +871,8 @@ enum SW_EVENTS
 #define SW_EVENT_WRITE SW_EVENT_WRITE
 	SW_EVENT_ERROR = 1u << 11,
 #define SW_EVENT_ERROR SW_EVENT_ERROR
+	SW_EVENT_ET = 1u << 12, //边缘触发
+#define SW_EVENT_ET SW_EVENT_ET
 };
 
 SWINLINE int swReactor_error(swReactor *reactor);
@@ -712,7 +884,10 @@ int swReactor_receive(swReactor *reactor, swEvent *event);
 int swReactor_setHandle(swReactor *, int, swReactor_handle);
 int swReactor_auto(swReactor *reactor, int max_event);
 swReactor_handle swReactor_getHandle(swReactor *reactor, int event_type, int fdtype);
+int swReactor_call_timed(swReactor *reactor, int event_type, swReactor_handle handle, swEvent *ev);
+void swReactor_loop_check(swReactor *reactor);
 int swReactorEpoll_create(swReactor *reactor, int max_event_num);
+int swReactorUring_create(swReactor *reactor, int max_event_num);
 int swReactorPoll_create(swReactor *reactor, int max_event_num);
 int swReactorKqueue_create(swReactor *reactor, int max_event_num);
 int swReactorSelect_create(swReactor *reactor);
@@ -723,6 +898,8 @@ int swProcessPool_wait(swProcessPool *pool);
 int swProcessPool_start(swProcessPool *pool);
 void swProcessPool_shutdown(swProcessPool *pool);
 pid_t swProcessPool_spawn(swWorker *worker);
+int swProcessPool_set_dispatch_mode(swProcessPool *pool, int dispatch_mode);
+int swProcessPool_schedule(swProcessPool *pool);
 int swProcessPool_dispatch(swProcessPool *pool, swEventData *data, int worker_id);
 int swProcessPool_add_worker(swProcessPool *pool, swWorker *worker);
 
@@ -762,6 +939,134 @@ int swChannel_wait(swChannel *object);
 int swChannel_notify(swChannel *object);
 void swChannel_free(swChannel *object);
 
+/*----------------------------MPSC Channel-------------------------------*/
+enum swMPSCChannel_flag
+{
+	SW_MPSC_COMMIT = 1,
+	SW_MPSC_PADDING = 2,
+};
+
+typedef struct _swMPSCChannel_item
+{
+	uint32_t length;
+	uint32_t flag;
+	char data[0];
+} swMPSCChannel_item;
+
+typedef struct _swMPSCChannel
+{
+	atomic_t tail;                //生产者方向
+	char padding1[SW_CACHELINE_SIZE - sizeof(atomic_t)];
+	atomic_t head;                //消费者方向
+	atomic_t waiting;             //消费者是否在等待通知
+	char padding2[SW_CACHELINE_SIZE - 2 * sizeof(atomic_t)];
+	uint32_t size;                //2的幂
+	int flag;                     //SW_CHAN_SHM, SW_CHAN_NOTIFY
+	void *mem;
+	swPipe notify_fd;
+} swMPSCChannel;
+
+typedef struct _swMPSCChannel_buffer
+{
+	void *data;
+	int size;
+	int length;
+} swMPSCChannel_buffer;
+
+typedef void (*swMPSCChannel_handler)(swMPSCChannel *object, void *data, uint32_t length, void *arg);
+
+swMPSCChannel* swMPSCChannel_create(uint32_t size, int flag);
+int swMPSCChannel_push(swMPSCChannel *object, void *data, uint32_t length);
+int swMPSCChannel_pop(swMPSCChannel *object, void *out, int buffer_length);
+int swMPSCChannel_pop_batch(swMPSCChannel *object, swMPSCChannel_handler handler, void *arg, int max);
+int swMPSCChannel_empty(swMPSCChannel *object);
+int swMPSCChannel_arm(swMPSCChannel *object);
+int swMPSCChannel_wait(swMPSCChannel *object);
+int swMPSCChannel_notify(swMPSCChannel *object);
+void swMPSCChannel_free(swMPSCChannel *object);
+
+/*----------------------------RingBuffer-------------------------------*/
+/**
+ * 单生产者单消费者的无锁环形队列, 变长记录, 可放在共享内存中跨进程使用
+ */
+typedef struct _swRingBuffer
+{
+	volatile uint32_t head;  //消费者读到的位置,只由消费者修改
+	char _pad1[60];          //head和tail分别在不同的cache line上
+	volatile uint32_t tail;  //生产者写到的位置,只由生产者修改
+	char _pad2[60];
+	uint32_t size;           //必须是2的N次方
+	uint32_t shared;
+	char mem[0];
+} swRingBuffer;
+
+#define swRingBuffer_empty(rb)  ((rb)->head == (rb)->tail)
+
+swRingBuffer* swRingBuffer_create(uint32_t size, int shared);
+int swRingBuffer_push(swRingBuffer *rb, void *data, int length);
+void* swRingBuffer_front(swRingBuffer *rb, int *length);
+void swRingBuffer_pop(swRingBuffer *rb);
+void* swRingBuffer_peek(swRingBuffer *rb, uint32_t *cursor, int *length);
+void swRingBuffer_release(swRingBuffer *rb, uint32_t cursor);
+void swRingBuffer_free(swRingBuffer *rb);
+
+/*----------------------------RecvRing-------------------------------*/
+/**
+ * 共享内存中的接收环: 只有一个线程分配和回收, 其他进程使用完后释放, 释放的顺序可以和分配不同
+ * 按分配顺序回收, 最早的块没有释放时, 之后已释放的块也不能复用
+ */
+typedef struct _swRecvRing
+{
+	uint32_t size;
+	uint32_t head;  //最早分配的块
+	uint32_t tail;  //下一次分配的位置
+	uint32_t used;  //已分配的字节数, 包括尾部的填充
+	char mem[0];
+} swRecvRing;
+
+swRecvRing* swRecvRing_create(uint32_t size);
+/**
+ * 分配连续的length字节, 返回数据在mem中的偏移, 空间不足返回SW_ERR
+ */
+int swRecvRing_alloc(swRecvRing *ring, uint32_t length);
+/**
+ * 可以在任意进程中调用
+ */
+void swRecvRing_release(swRecvRing *ring, uint32_t offset);
+void swRecvRing_free(swRecvRing *ring);
+
+#define swRecvRing_data(ring, offset)  ((ring)->mem + (offset))
+
+/*----------------------------MPMC Queue-------------------------------*/
+typedef struct _swMPMCQueue_cell
+{
+	volatile uint64_t sequence;
+	void *data;
+} swMPMCQueue_cell;
+
+typedef struct _swMPMCQueue
+{
+	swMPMCQueue_cell *cells;
+	uint32_t size;
+	uint32_t mask;
+	//生产者和消费者的位置放在不同的cache line
+	char pad0[SW_CACHE_LINE_SIZE];
+	volatile uint64_t enqueue_pos;
+	char pad1[SW_CACHE_LINE_SIZE];
+	volatile uint64_t dequeue_pos;
+	char pad2[SW_CACHE_LINE_SIZE];
+	volatile uint32_t futex;   //有新数据时加1, 消费者在此睡眠
+	volatile uint32_t waiters; //睡眠中的消费者数量
+} swMPMCQueue;
+
+int swMPMCQueue_create(swMPMCQueue *queue, uint32_t size);
+int swMPMCQueue_push(swMPMCQueue *queue, void *data);
+int swMPMCQueue_pop(swMPMCQueue *queue, void **data);
+int swMPMCQueue_wait(swMPMCQueue *queue, void **data, int timeout);
+void swMPMCQueue_wake(swMPMCQueue *queue, int num);
+void swMPMCQueue_wake_all(swMPMCQueue *queue);
+void swMPMCQueue_free(swMPMCQueue *queue);
+
 /*----------------------------Thread Pool-------------------------------*/
 typedef struct _swThreadPool
 {
@@ -772,9 +1077,10 @@ typedef struct _swThreadPool
 	swThreadParam *params;
 
 #ifdef SW_THREADPOOL_USE_CHANNEL
-	swChannel *chan;
+	swMPSCChannel *chan;
+	atomic_t idle_num;    //在cond上等待的线程数量
 #else
-	swRingQueue queue;
+	swMPMCQueue queue;
 #endif
 
 	int thread_num;
@@ -798,16 +1104,30 @@ int swThreadPool_run(swThreadPool *pool);
 int swThreadPool_free(swThreadPool *pool);
 
 //-----------------------------------------------
+struct _swTimer;
+struct _swTimer_node;
+typedef void (*swTimerCallback)(struct _swTimer *timer, struct _swTimer_node *node);
+
 typedef struct _swTimer_node
 {
-	struct _swTimerList_node *next, *prev;
-	uint64_t lasttime;
+	uint64_t exec_msec;  //下一次执行的时间
+	uint32_t id;
+	uint32_t heap_index; //在最小堆中的位置,0表示不在堆中
 	int interval;
+	uint8_t repeat;
+	uint8_t remove;      //在回调函数中被删除
+	void *data;
+	swTimerCallback callback; //为NULL时调用timer->onTimer
 } swTimer_node;
 
 typedef struct _swTimer
 {
-	swHashMap list;
+	swHashMap_int list;   //interval -> node, for swTimer_add/swTimer_del
+	swHashMap_int map;    //id -> node
+	swTimer_node **heap;  //按到期时间排序的最小堆
+	uint32_t heap_num;
+	uint32_t heap_size;
+	uint32_t id_seq;
 	int num;
 	int interval;
 	int use_pipe;
@@ -818,6 +1138,9 @@ typedef struct _swTimer
 } swTimer;
 
 int swTimer_create(swTimer *timer, int interval_ms);
+int swTimer_set(swTimer *timer, int ms, int repeat, void *data, swTimerCallback callback);
+int swTimer_init_reactor(swReactor *reactor, int interval);
+int swTimer_clear(swTimer *timer, int id);
 void swTimer_del(swTimer *timer, int ms);
 int swTimer_free(swTimer *timer);
 int swTimer_add(swTimer *timer, int ms);
@@ -847,7 +1170,10 @@ typedef struct _swServerG{
 	swReactor *main_reactor;
 	swPipe *task_notify; //for taskwait
 	swEventData *task_result; //for taskwait
-	pthread_t heartbeat_pidt;
+	swEventData *task_result_multi; //for taskWaitMulti, 每个worker有SW_TASKWAIT_MULTI_MAX个
+	swAllocator *task_arena; //for large task data
+	swAllocator *send_arena; //for shared send data, see swBuffer_shared
+	uint8_t hugepage; //SW_HUGEPAGE_THP/SW_HUGEPAGE_HUGETLB, 共享内存使用大页
 } swServerG;
 
 //Share Memory
@@ -862,14 +1188,129 @@ typedef struct _swWorkerG{
 	int id; //Current Proccess Worker's id
 	swString **buffer_input;
 	atomic_uint_t worker_pti;
+	uint32_t latency_time; //正在处理的请求的采样时间戳, 随响应带回reactor线程
+	uint32_t overload_deadline; //排队延迟开始超过overload_target后, 到这个时间还没有降下来就是过载, 0为没有超过
 } swWorkerG;
 
+typedef struct _swThreadG{
+	int id;        //Current Thread's id, reactor_id for reactor thread
+	uint8_t type;  //SW_THREAD_MASTER/SW_THREAD_REACTOR
+	uint64_t clock_msec;  //缓存的单调时间(毫秒), 见swClock_update
+	time_t clock_now;     //缓存的墙上时间(秒)
+} swThreadG;
+
 extern swServerG SwooleG;    //Local Global Variable
 extern swServerGS *SwooleGS; //Share Memory Global Variable
 extern swWorkerG SwooleWG;   //Worker Global Variable
+extern __thread swThreadG SwooleTG;   //Thread Global Variable
+
+//-----------------------------------------------
+//Clock
+void swClock_update(void);
+
+/**
+ * 当前线程最后一次swClock_update时的时间, 不是reactor线程时需要自己调用swClock_update
+ */
+static inline uint64_t swClock_msec(void)
+{
+	if (SwooleTG.clock_msec == 0)
+	{
+		swClock_update();
+	}
+	return SwooleTG.clock_msec;
+}
+
+static inline time_t swClock_now(void)
+{
+	if (SwooleTG.clock_now == 0)
+	{
+		swClock_update();
+	}
+	return SwooleTG.clock_now;
+}
+
+/**
+ * 单调时间(微秒), 每次调用都会读取时钟, 只用于计时
+ */
+uint64_t swClock_usec(void);
+
+/**
+ * 调用事件回调, 开启了slow_usec时计时
+ */
+static inline int swReactor_call(swReactor *reactor, int event_type, swReactor_handle handle, swEvent *ev)
+{
+	if (reactor->slow_usec == 0)
+	{
+		return handle(reactor, ev);
+	}
+	return swReactor_call_timed(reactor, event_type, handle, ev);
+}
+
+static inline void swReactor_loop_begin(swReactor *reactor)
+{
+	if (reactor->slow_usec > 0)
+	{
+		reactor->loop_start = swClock_usec();
+		reactor->slow_flag = 0;
+	}
+}
+
+/**
+ * 一轮事件处理的总时间, 没有单个慢回调时也可能因为事件太多而阻塞
+ */
+static inline void swReactor_loop_end(swReactor *reactor)
+{
+	if (reactor->slow_usec > 0)
+	{
+		swReactor_loop_check(reactor);
+	}
+}
+
+//-----------------------------------------------
+//Slowlog
+/**
+ * 回调执行超过阈值时, 监视线程向主线程发信号, 在信号处理函数中记录正在执行的调用栈
+ * name为回调的名字, usec为已经执行的时间
+ */
+typedef void (*swSlowlog_dump)(const char *name, uint64_t usec);
+
+int swSlowlog_init(uint32_t threshold_usec, swSlowlog_dump dump, atomic_t *count);
+void swSlowlog_enter(const char *name);
+void swSlowlog_leave(void);
+
+//-----------------------------------------------
+//Histogram
+/**
+ * 按2的幂分段, 每段再分SW_HISTOGRAM_SUB_BUCKETS个桶, 相对误差不超过1/SW_HISTOGRAM_SUB_BUCKETS
+ * 记录是无锁的, 多个histogram在读取时合并
+ */
+#define SW_HISTOGRAM_SUB_BITS      2
+#define SW_HISTOGRAM_SUB_BUCKETS   (1 << SW_HISTOGRAM_SUB_BITS)
+#define SW_HISTOGRAM_BUCKETS       ((32 - SW_HISTOGRAM_SUB_BITS + 1) * SW_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct _swHistogram
+{
+	atomic_t count;
+	atomic_t sum;
+	atomic_t max;
+	atomic_t buckets[SW_HISTOGRAM_BUCKETS];
+} swHistogram;
+
+void swHistogram_record(swHistogram *h, uint32_t value);
+void swHistogram_merge(swHistogram *dst, swHistogram *src);
+/**
+ * percent为0-100, 返回所在桶的上界
+ */
+uint64_t swHistogram_percentile(swHistogram *h, double percent);
 
 //-----------------------------------------------
 //OS Feature
+int swoole_numa_node_num(void);
+int swoole_numa_cpu_node(int cpu);
+int swoole_numa_node_cpu(int node, int index);
+int swoole_numa_prefer(int node);
+int swoole_numa_bind(void *addr, size_t length, int node);
+
 #ifdef HAVE_SIGNALFD
 void swSignalfd_init();
 void swSignalfd_add(int signo, __sighandler_t callback);
@@ -0,0 +1,125 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#ifndef SW_TABLE_H_
+#define SW_TABLE_H_
+
+#include "swoole.h"
+
+enum swTableColumn_type
+{
+	SW_TABLE_INT = 1,
+	SW_TABLE_FLOAT,
+	SW_TABLE_STRING,
+};
+
+/**
+ * 列的定义, index为数据在行内的偏移
+ * SW_TABLE_STRING前面有2字节的长度
+ */
+typedef struct _swTableColumn
+{
+	uint8_t type;
+	uint8_t name_len;
+	uint16_t size;
+	uint32_t index;
+	char name[SW_TABLE_COLUMN_NAME_SIZE];
+} swTableColumn;
+
+/**
+ * 行的头部, 桶中的行和冲突链表中的行使用同一种结构
+ * next为冲突行的下标, 0表示没有下一行(下标0总是桶)
+ */
+typedef struct _swTableRow
+{
+	atomic_t lock;
+	uint32_t next;
+	uint8_t active;
+	uint8_t key_len;
+	char key[SW_TABLE_KEY_SIZE];
+	char data[0];
+} swTableRow;
+
+/**
+ * 固定容量的共享内存哈希表, 在fork之前创建
+ * 每个桶一个自旋锁, 只有分配/释放冲突行时才使用全局锁
+ */
+typedef struct _swTable
+{
+	swLock lock;                //保护冲突行的空闲链表
+	uint32_t size;              //桶的数量, 2的幂
+	uint32_t mask;
+	uint32_t conflict_num;
+	uint32_t free_list;         //空闲的冲突行
+	uint32_t conflict_used;     //从未使用过的冲突行的起点
+	atomic_t row_num;
+	uint32_t item_size;
+	uint16_t column_num;
+	swTableColumn columns[SW_TABLE_COLUMN_NUM];
+	swShareMemory memory;
+	void *rows;
+} swTable;
+
+#define swTable_row(table, i)         ((swTableRow *) ((char *) (table)->rows + (size_t) (i) * (table)->item_size))
+#define swTableColumn_data(row, col)  ((row)->data + (col)->index)
+
+swTable* swTable_new(uint32_t rows_size);
+int swTable_column_add(swTable *table, char *name, int len, int type, int size);
+swTableColumn* swTable_column_find(swTable *table, char *name, int len);
+int swTable_create(swTable *table);
+void swTable_free(swTable *table);
+/**
+ * get/set返回的行已加锁, 读写完之后需要调用swTableRow_unlock(lock_row)
+ */
+swTableRow* swTableRow_get(swTable *table, char *key, int keylen, swTableRow **lock_row);
+swTableRow* swTableRow_set(swTable *table, char *key, int keylen, swTableRow **lock_row);
+int swTableRow_del(swTable *table, char *key, int keylen);
+void swTableRow_set_value(swTableRow *row, swTableColumn *col, void *value, int vlen);
+int64_t swTableRow_get_int(swTableRow *row, swTableColumn *col);
+void swTableRow_set_int(swTableRow *row, swTableColumn *col, int64_t value);
+
+static inline void swTableRow_lock(swTableRow *row)
+{
+	uint32_t i, n;
+	while (1)
+	{
+		if (row->lock == 0 && sw_atomic_cmp_set(&row->lock, 0, 1))
+		{
+			return;
+		}
+		for (n = 1; n < SW_TABLE_LOCK_SPIN; n <<= 1)
+		{
+			for (i = 0; i < n; i++)
+			{
+				sw_atomic_cpu_pause();
+			}
+			if (row->lock == 0 && sw_atomic_cmp_set(&row->lock, 0, 1))
+			{
+				return;
+			}
+		}
+		swYield();
+	}
+}
+
+static inline void swTableRow_unlock(swTableRow *row)
+{
+	sw_atomic_memory_barrier();
+	row->lock = 0;
+}
+
+#endif /* SW_TABLE_H_ */
@@ -24,18 +24,41 @@ int swUnitTest_run(swUnitTest *object);
 swUnitTest(mem_test1);
 swUnitTest(mem_test2);
 swUnitTest(mem_test3);
+swUnitTest(mem_test4);
+swUnitTest(mem_test5);
+swUnitTest(mem_test6);
 
 swUnitTest(client_test);
 swUnitTest(server_test);
+swUnitTest(direct_send_test);
+swUnitTest(udp_peer_test);
 
 swUnitTest(hashmap_test1);
+swUnitTest(hashmap_test2);
 swUnitTest(ds_test2);
 swUnitTest(ds_test1);
 
 swUnitTest(chan_test);
+swUnitTest(ringbuffer_test);
+swUnitTest(recv_ring_test);
+swUnitTest(timer_test);
+swUnitTest(mpmc_test);
+swUnitTest(mpsc_test);
+swUnitTest(table_test);
+swUnitTest(futexlock_test);
+swUnitTest(brlock_test);
+swUnitTest(ready_test);
+swUnitTest(histogram_test);
+swUnitTest(slowlog_test);
+swUnitTest(stats_test);
+swUnitTest(coroutine_test);
+swUnitTest(uring_test);
+swUnitTest(redis_test);
+swUnitTest(websocket_deflate_test);
 
 swUnitTest(u1_test2);
 swUnitTest(u1_test1);
+swUnitTest(log_test);
 
 swUnitTest(http_test2);
 
@@ -0,0 +1,121 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifndef SW_WEBSOCKET_H_
+#define SW_WEBSOCKET_H_
+
+#include "swoole.h"
+#include "http.h"
+
+#define SW_WEBSOCKET_GUID             "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define SW_WEBSOCKET_VERSION          13
+#define SW_WEBSOCKET_ACCEPT_LEN       28    //base64(sha1)的长度
+#define SW_WEBSOCKET_KEY_MAX          64    //Sec-WebSocket-Key的最大长度, 标准为24字节
+#define SW_WEBSOCKET_HEADER_MAX       14    //2字节 + 8字节扩展长度 + 4字节掩码
+#define SW_WEBSOCKET_CONTROL_MAX      125   //控制帧的最大负载
+#define SW_WEBSOCKET_AGAIN            1
+#define SW_WEBSOCKET_FLAG_RSV1        0x40  //permessage-deflate: 压缩的消息在第一帧设置RSV1
+
+enum swWebSocket_opcode
+{
+	SW_WEBSOCKET_OPCODE_CONTINUATION = 0x0,
+	SW_WEBSOCKET_OPCODE_TEXT = 0x1,
+	SW_WEBSOCKET_OPCODE_BINARY = 0x2,
+	SW_WEBSOCKET_OPCODE_CLOSE = 0x8,
+	SW_WEBSOCKET_OPCODE_PING = 0x9,
+	SW_WEBSOCKET_OPCODE_PONG = 0xa,
+};
+
+enum swWebSocket_close_code
+{
+	SW_WEBSOCKET_CLOSE_NORMAL = 1000,
+	SW_WEBSOCKET_CLOSE_PROTOCOL_ERROR = 1002,
+	SW_WEBSOCKET_CLOSE_UNSUPPORTED = 1003,
+	SW_WEBSOCKET_CLOSE_INVALID_DATA = 1007,
+	SW_WEBSOCKET_CLOSE_TOO_BIG = 1009,
+	SW_WEBSOCKET_CLOSE_SERVER_ERROR = 1011,
+};
+
+/**
+ * swConnection->websocket_status
+ */
+enum swWebSocket_status
+{
+	SW_WEBSOCKET_STATUS_NONE = 0,
+	SW_WEBSOCKET_STATUS_ACTIVE,    //已完成握手, 按帧解析
+};
+
+typedef struct _swWebSocket_frame
+{
+	uint8_t fin;
+	uint8_t opcode;
+	uint8_t mask;
+	uint8_t header_length;
+	uint8_t compressed;   //RSV1
+	uint64_t payload_length;
+	char mask_key[4];
+} swWebSocket_frame;
+
+/**
+ * 投递给worker的数据消息: data为解掩码并合并分片后的完整负载, info.from_fd为opcode(TEXT/BINARY)
+ * 普通HTTP请求的from_fd为0
+ */
+#define swWebSocket_is_message(info)   ((info)->from_fd == SW_WEBSOCKET_OPCODE_TEXT || (info)->from_fd == SW_WEBSOCKET_OPCODE_BINARY)
+
+/**
+ * 解析帧头, 返回SW_OK, SW_WEBSOCKET_AGAIN, 或者SW_ERR(帧头不合法)
+ * RSV1保存在compressed中, 由调用者按是否协商了permessage-deflate检查
+ */
+int swWebSocket_decode_frame(swWebSocket_frame *frame, char *buf, uint32_t length);
+/**
+ * 写入服务端帧头(不带掩码), buf至少SW_WEBSOCKET_HEADER_MAX字节, 返回帧头长度
+ */
+int swWebSocket_encode_header(char *buf, uint8_t opcode, uint8_t fin, uint64_t length);
+/**
+ * 就地解掩码, 按16字节SIMD异或
+ */
+void swWebSocket_unmask(char *data, uint64_t length, char *mask_key);
+/**
+ * 是否带有Upgrade: websocket, data为原始请求(请求行开始)
+ */
+int swWebSocket_is_upgrade(swHttpRequest *req, char *data);
+/**
+ * 检查升级请求, 写入Sec-WebSocket-Accept(包括\0, accept至少SW_WEBSOCKET_ACCEPT_LEN + 1字节)
+ */
+int swWebSocket_handshake(swHttpRequest *req, char *data, char *accept);
+
+/**
+ * permessage-deflate(RFC 7692), 固定回复server_no_context_takeover和client_no_context_takeover
+ * 每个消息独立压缩, 不需要为连接保存上下文, 当前线程的所有连接共用一组z_stream
+ */
+#define SW_WEBSOCKET_DEFLATE_RESPONSE "Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; client_no_context_takeover\r\n"
+
+/**
+ * 客户端的Sec-WebSocket-Extensions中有可以接受的permessage-deflate时返回SW_TRUE
+ */
+int swWebSocket_accept_deflate(swHttpRequest *req, char *data);
+#ifdef SW_USE_ZLIB
+/**
+ * 返回去掉结尾00 00 ff ff的压缩数据, 只在当前线程下一次调用之前有效, 失败返回NULL
+ */
+swString* swWebSocket_deflate(char *data, uint32_t length, int level);
+/**
+ * 解压一个完整的消息, 结果超过max_length时返回NULL并设置errno为E2BIG
+ */
+swString* swWebSocket_inflate(char *data, uint32_t length, uint32_t max_length);
+#endif
+
+#endif /* SW_WEBSOCKET_H_ */
@@ -87,6 +87,10 @@ extern void ***sw_thread_ctx;
 #define SW_RES_SERVER_NAME          "SwooleServer"
 #define SW_RES_CLIENT_NAME          "SwooleClient"
 #define SW_RES_LOCK_NAME            "SwooleLock"
+#define SW_RES_CLIENT_WAITSET_NAME  "SwooleClientWaitSet"
+#define SW_RES_MYSQL_NAME           "SwooleMySQL"
+#define SW_RES_REDIS_NAME           "SwooleRedis"
+#define SW_RES_TABLE_NAME           "SwooleTable"
 
 #define PHP_CLIENT_CALLBACK_NUM             4
 //---------------------------------------------------
@@ -98,7 +102,7 @@ extern void ***sw_thread_ctx;
 #define SW_MAX_FIND_COUNT                   100 //for swoole_server::connection_list
 #define SW_PHP_CLIENT_BUFFER_SIZE           65535
 
-#define PHP_SERVER_CALLBACK_NUM             15
+#define PHP_SERVER_CALLBACK_NUM             21
 //--------------------------------------------------------
 #define SW_SERVER_CB_onStart                0 //Server start(master)
 #define SW_SERVER_CB_onConnect              1 //accept new connection(worker)
@@ -115,26 +119,42 @@ extern void ***sw_thread_ctx;
 #define SW_SERVER_CB_onWorkerError          12 //worker exception(manager)
 #define SW_SERVER_CB_onManagerStart         13
 #define SW_SERVER_CB_onManagerStop          14
+#define SW_SERVER_CB_onBufferFull           15 //out_buffer reached high watermark(worker)
+#define SW_SERVER_CB_onBufferEmpty          16 //out_buffer drained to low watermark(worker)
+#define SW_SERVER_CB_onRequest              17 //http request, open_http_protocol(worker)
+#define SW_SERVER_CB_onMessage              18 //websocket message, open_websocket_protocol(worker)
+#define SW_SERVER_CB_onWorkerWarmup         19 //reload_batch>0, before joining dispatch(worker)
+#define SW_SERVER_CB_onFinishBatch          20 //coalesced task results, task_finish_batch(worker)
 //---------------------------------------------------------
 #define SW_FLAG_KEEP                        (1u << 9)
 #define SW_FLAG_ASYNC                       (1u << 10)
 #define SW_FLAG_SYNC                        (1u << 11)
-#define php_swoole_socktype(type)           (type & (~SW_FLAG_SYNC) & (~SW_FLAG_ASYNC) & (~SW_FLAG_KEEP))
+#define SW_FLAG_FASTOPEN                    (1u << 12)
+#define php_swoole_socktype(type)           (type & (~SW_FLAG_SYNC) & (~SW_FLAG_ASYNC) & (~SW_FLAG_KEEP) & (~SW_FLAG_FASTOPEN))
 
 #define SW_LONG_CONNECTION_KEY_LEN          64
 
 extern int le_swoole_server;
 extern int le_swoole_client;
 extern int le_swoole_lock;
+extern int le_swoole_client_waitset;
+extern int le_swoole_mysql;
+extern int le_swoole_redis;
+extern int le_swoole_table;
 
 extern zend_class_entry *swoole_lock_class_entry_ptr;
 extern zend_class_entry *swoole_client_class_entry_ptr;
+extern zend_class_entry *swoole_client_waitset_class_entry_ptr;
+extern zend_class_entry *swoole_mysql_class_entry_ptr;
+extern zend_class_entry *swoole_redis_class_entry_ptr;
+extern zend_class_entry *swoole_table_class_entry_ptr;
 extern zend_class_entry *swoole_server_class_entry_ptr;
 
 extern HashTable php_sw_reactor_callback;
 extern HashTable php_sw_client_callback;
 extern HashTable php_sw_timer_callback;
 extern HashTable php_sw_long_connections;
+extern swClientPool php_sw_client_pool;
 extern HashTable php_sw_aio_callback;
 
 PHP_MINIT_FUNCTION(swoole);
@@ -151,7 +171,10 @@ PHP_FUNCTION(swoole_server_set);
 PHP_FUNCTION(swoole_server_start);
 PHP_FUNCTION(swoole_server_stop);
 PHP_FUNCTION(swoole_server_send);
+PHP_FUNCTION(swoole_server_sendv);
 PHP_FUNCTION(swoole_server_sendfile);
+PHP_FUNCTION(swoole_server_push);
+PHP_FUNCTION(swoole_server_proxy);
 PHP_FUNCTION(swoole_server_close);
 PHP_FUNCTION(swoole_server_on);
 PHP_FUNCTION(swoole_server_handler);
@@ -160,11 +183,14 @@ PHP_FUNCTION(swoole_server_addtimer);
 PHP_FUNCTION(swoole_server_deltimer);
 PHP_FUNCTION(swoole_server_task);
 PHP_FUNCTION(swoole_server_taskwait);
+PHP_FUNCTION(swoole_server_taskWaitMulti);
 PHP_FUNCTION(swoole_server_finish);
 PHP_FUNCTION(swoole_server_reload);
 PHP_FUNCTION(swoole_server_shutdown);
 PHP_FUNCTION(swoole_server_heartbeat);
 PHP_FUNCTION(swoole_connection_list);
+PHP_FUNCTION(swoole_server_broadcast);
+PHP_FUNCTION(swoole_server_stats);
 PHP_FUNCTION(swoole_connection_info);
 
 PHP_FUNCTION(swoole_event_add);
@@ -190,6 +216,7 @@ PHP_FUNCTION(swoole_get_mysqli_sock);
 #endif
 
 PHP_FUNCTION(swoole_client_select);
+PHP_FUNCTION(swoole_client_pool_set);
 
 PHP_METHOD(swoole_client, __construct);
 PHP_METHOD(swoole_client, connect);
@@ -206,8 +233,44 @@ PHP_METHOD(swoole_lock, trylock_read);
 PHP_METHOD(swoole_lock, unlock);
 
 void swoole_destory_lock(zend_rsrc_list_entry *rsrc TSRMLS_DC);
+
+#ifdef HAVE_EPOLL
+PHP_METHOD(swoole_client_waitset, __construct);
+PHP_METHOD(swoole_client_waitset, add);
+PHP_METHOD(swoole_client_waitset, del);
+PHP_METHOD(swoole_client_waitset, wait);
+PHP_METHOD(swoole_client_waitset, count);
+void swoole_destory_client_waitset(zend_rsrc_list_entry *rsrc TSRMLS_DC);
+#endif
+
+PHP_METHOD(swoole_mysql, __construct);
+PHP_METHOD(swoole_mysql, query);
+PHP_METHOD(swoole_mysql, execute);
+PHP_METHOD(swoole_mysql, close);
+void swoole_destory_mysql(zend_rsrc_list_entry *rsrc TSRMLS_DC);
+
+PHP_METHOD(swoole_redis, __construct);
+PHP_METHOD(swoole_redis, command);
+PHP_METHOD(swoole_redis, close);
+void swoole_destory_redis(zend_rsrc_list_entry *rsrc TSRMLS_DC);
+
+PHP_METHOD(swoole_table, __construct);
+PHP_METHOD(swoole_table, column);
+PHP_METHOD(swoole_table, create);
+PHP_METHOD(swoole_table, set);
+PHP_METHOD(swoole_table, get);
+PHP_METHOD(swoole_table, exist);
+PHP_METHOD(swoole_table, del);
+PHP_METHOD(swoole_table, incr);
+PHP_METHOD(swoole_table, decr);
+PHP_METHOD(swoole_table, count);
+void swoole_destory_table(zend_rsrc_list_entry *rsrc TSRMLS_DC);
 void php_swoole_check_reactor();
 void php_swoole_try_run_reactor();
+/**
+ * 调用PHP回调, 开启了slow_callback_threshold时超时会记录调用栈
+ */
+int php_swoole_call_user_function(const char *name, zval *callback, zval **retval, zend_uint argc, zval ***args TSRMLS_DC);
 
 #ifdef ZTS
 #define SWOOLE_G(v) TSRMG(swoole_globals_id, zend_swoole_globals *, v)
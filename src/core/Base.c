@@ -29,6 +29,33 @@ uint64_t swoole_hash_key(char *str, int str_len)
 	return hash;
 }
 
+uint64_t swoole_hash_fnv1a(char *str, int str_len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	int i;
+	for (i = 0; i < str_len; i++)
+	{
+		hash ^= (uint8_t) str[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+ * Jump Consistent Hash, 桶数量从n变为n+1时只有1/(n+1)的key改变位置
+ */
+uint32_t swoole_jump_hash(uint64_t key, uint32_t num)
+{
+	int64_t b = -1, j = 0;
+	while (j < num)
+	{
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = (b + 1) * ((double) (1LL << 31) / (double) ((key >> 33) + 1));
+	}
+	return (uint32_t) b;
+}
+
 uint32_t swoole_common_divisor(uint32_t u, uint32_t v)
 {
 	assert(u > 0);
@@ -100,7 +127,7 @@ SWINLINE void swFloat2timeval(float timeout, long int *sec, long int *usec)
 	*usec = (int) ((timeout * 1000 * 1000) - ((*sec) * 1000 * 1000));
 }
 
-int swSocket_listen(int type, char *host, int port, int backlog)
+int swSocket_listen(int type, char *host, int port, int backlog, int reuse_port)
 {
 	int sock;
 	int option;
@@ -118,6 +145,15 @@ int swSocket_listen(int type, char *host, int port, int backlog)
 	//reuse
 	option = 1;
 	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(int));
+#ifdef SO_REUSEPORT
+	//多个socket监听同一端口,由内核分配连接
+	if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(int)) < 0)
+	{
+		swWarn("setsockopt(SO_REUSEPORT) fail. Error: %s[%d]", strerror(errno), errno);
+		close(sock);
+		return SW_ERR;
+	}
+#endif
 
 	//IPv6
 	if (type > SW_SOCK_UDP)
@@ -76,9 +76,9 @@ swChannel* swChannel_create(int size, int maxlen, int flag)
 	if (flag & SW_CHAN_LOCK)
 	{
 		//初始化锁
-		if (swMutex_create(&object->lock, 1) < 0)
+		if (swFutexLock_create(&object->lock, 1) < 0)
 		{
-			swWarn("swChannel_create: mutex init fail");
+			swWarn("swChannel_create: lock init fail");
 			return NULL;
 		}
 	}
@@ -0,0 +1,541 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "Server.h"
+#include "coroutine.h"
+
+#include <sys/mman.h>
+#include <poll.h>
+
+#define SW_CORO_TIMEOUT   -2  //resume的result: 等待超时
+
+typedef struct
+{
+	swCoroutine *current;
+	swCoroutine *free_list; //结束的协程保留栈, 下一次创建时复用
+	uint32_t free_num;
+	uint32_t num;
+	uint32_t max_num;
+	uint32_t stack_size;
+	uint32_t id_seq;
+	swReactor *reactor;     //已经注册了SW_FD_CORO回调的reactor
+	swCoroutine **fds;      //fd -> 等待的协程
+	uint32_t fds_size;
+	swHashMap_int tasks;    //task_id -> swCoroutine_task_waiter
+} swCoroutine_global;
+
+typedef struct
+{
+	swCoroutine *co;
+	swEventData *result;
+} swCoroutine_task_waiter;
+
+static swCoroutine_global swoole_coroutine = { NULL, NULL, 0, 0, SW_CORO_MAX_NUM, SW_CORO_STACK_SIZE };
+
+static swCoroutine* swCoroutine_alloc(void);
+static void swCoroutine_release(swCoroutine *co);
+static void swCoroutine_main(void);
+static int swCoroutine_reactor_init(swReactor *reactor);
+static int swCoroutine_onEvent(swReactor *reactor, swEvent *event);
+static void swCoroutine_onTimeout(swTimer *timer, swTimer_node *node);
+
+int swCoroutine_init(uint32_t stack_size, uint32_t max_num)
+{
+	if (swoole_coroutine.id_seq > 0)
+	{
+		swWarn("coroutine is already in use.");
+		return SW_ERR;
+	}
+	if (stack_size > 0)
+	{
+		//按页对齐
+		swoole_coroutine.stack_size = (stack_size + getpagesize() - 1) & ~(getpagesize() - 1);
+	}
+	if (max_num > 0)
+	{
+		swoole_coroutine.max_num = max_num;
+	}
+	return SW_OK;
+}
+
+static swCoroutine* swCoroutine_alloc(void)
+{
+	swCoroutine *co = swoole_coroutine.free_list;
+	size_t page = getpagesize();
+	void *mem;
+
+	if (co != NULL)
+	{
+		swoole_coroutine.free_list = co->next;
+		swoole_coroutine.free_num--;
+		return co;
+	}
+	co = sw_malloc(sizeof(swCoroutine));
+	if (co == NULL)
+	{
+		swWarn("malloc for coroutine failed.");
+		return NULL;
+	}
+	//只占用虚拟地址, 用到的页才分配物理内存
+	mem = mmap(NULL, swoole_coroutine.stack_size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		swWarn("mmap for coroutine stack failed. Error: %s[%d]", strerror(errno), errno);
+		sw_free(co);
+		return NULL;
+	}
+	//栈向下增长, 溢出时访问保护页触发SIGSEGV, 不会覆盖其他内存
+	mprotect(mem, page, PROT_NONE);
+	co->stack = mem;
+	return co;
+}
+
+static void swCoroutine_release(swCoroutine *co)
+{
+	swoole_coroutine.num--;
+	if (swoole_coroutine.free_num < SW_CORO_POOL_SIZE)
+	{
+		co->next = swoole_coroutine.free_list;
+		swoole_coroutine.free_list = co;
+		swoole_coroutine.free_num++;
+		return;
+	}
+	munmap(co->stack, swoole_coroutine.stack_size + getpagesize());
+	sw_free(co);
+}
+
+static void swCoroutine_main(void)
+{
+	swCoroutine *co = swoole_coroutine.current;
+	co->func(co->arg);
+	co->state = SW_CORO_DEAD;
+	//不再返回, 栈由resume的一方回收
+	setcontext(co->caller);
+}
+
+int swCoroutine_create(swCoroutine_func func, void *arg)
+{
+	swCoroutine *co;
+	uint32_t id;
+
+	if (swoole_coroutine.num >= swoole_coroutine.max_num)
+	{
+		swWarn("too many coroutines, max_num=%d.", swoole_coroutine.max_num);
+		return SW_ERR;
+	}
+	co = swCoroutine_alloc();
+	if (co == NULL)
+	{
+		return SW_ERR;
+	}
+	swoole_coroutine.num++;
+	if (getcontext(&co->ctx) < 0)
+	{
+		swWarn("getcontext() failed. Error: %s[%d]", strerror(errno), errno);
+		swCoroutine_release(co);
+		return SW_ERR;
+	}
+	co->ctx.uc_stack.ss_sp = (char *) co->stack + getpagesize();
+	co->ctx.uc_stack.ss_size = swoole_coroutine.stack_size;
+	co->ctx.uc_link = NULL;
+	makecontext(&co->ctx, swCoroutine_main, 0);
+
+	//id不能为0
+	co->id = ++swoole_coroutine.id_seq;
+	if (co->id == 0)
+	{
+		co->id = ++swoole_coroutine.id_seq;
+	}
+	co->state = 0;
+	co->func = func;
+	co->arg = arg;
+	co->timer_id = 0;
+	co->wait_fd = -1;
+
+	id = co->id;
+	swCoroutine_resume(co, 0);
+	return id;
+}
+
+swCoroutine* swCoroutine_current(void)
+{
+	return swoole_coroutine.current;
+}
+
+uint32_t swCoroutine_num(void)
+{
+	return swoole_coroutine.num;
+}
+
+int swCoroutine_yield(void)
+{
+	swCoroutine *co = swoole_coroutine.current;
+
+	if (co == NULL)
+	{
+		swWarn("not in coroutine.");
+		return SW_ERR;
+	}
+	co->state = SW_CORO_WAITING;
+	swapcontext(&co->ctx, co->caller);
+	return co->result;
+}
+
+void swCoroutine_resume(swCoroutine *co, int result)
+{
+	swCoroutine *prev = swoole_coroutine.current;
+	ucontext_t caller;
+
+	//只能恢复刚创建或等待中的协程
+	if (co->state != 0 && co->state != SW_CORO_WAITING)
+	{
+		swWarn("coroutine#%d is not waiting.", co->id);
+		return;
+	}
+	co->result = result;
+	co->caller = &caller;
+	co->state = SW_CORO_RUNNING;
+	swoole_coroutine.current = co;
+	swapcontext(&caller, &co->ctx);
+	swoole_coroutine.current = prev;
+
+	if (co->state == SW_CORO_DEAD)
+	{
+		swCoroutine_release(co);
+	}
+}
+
+void swCoroutine_free(void)
+{
+	swCoroutine *co;
+
+	while ((co = swoole_coroutine.free_list) != NULL)
+	{
+		swoole_coroutine.free_list = co->next;
+		munmap(co->stack, swoole_coroutine.stack_size + getpagesize());
+		sw_free(co);
+	}
+	swoole_coroutine.free_num = 0;
+	if (swoole_coroutine.fds != NULL)
+	{
+		sw_free(swoole_coroutine.fds);
+		swoole_coroutine.fds = NULL;
+		swoole_coroutine.fds_size = 0;
+	}
+	if (swoole_coroutine.tasks != NULL)
+	{
+		swHashMap_free_int(&swoole_coroutine.tasks);
+	}
+}
+
+static int swCoroutine_reactor_init(swReactor *reactor)
+{
+	if (swoole_coroutine.reactor == reactor)
+	{
+		return SW_OK;
+	}
+	if (swTimer_init_reactor(reactor, 1) < 0)
+	{
+		return SW_ERR;
+	}
+	reactor->setHandle(reactor, SW_FD_CORO | SW_EVENT_READ, swCoroutine_onEvent);
+	reactor->setHandle(reactor, SW_FD_CORO | SW_EVENT_WRITE, swCoroutine_onEvent);
+	reactor->setHandle(reactor, SW_FD_CORO | SW_EVENT_ERROR, swCoroutine_onEvent);
+	swoole_coroutine.reactor = reactor;
+	return SW_OK;
+}
+
+static int swCoroutine_onEvent(swReactor *reactor, swEvent *event)
+{
+	swCoroutine *co;
+
+	//同一次epoll_wait中可读和RDHUP会各回调一次
+	if (event->fd >= swoole_coroutine.fds_size || (co = swoole_coroutine.fds[event->fd]) == NULL)
+	{
+		return SW_OK;
+	}
+	swoole_coroutine.fds[event->fd] = NULL;
+	swCoroutine_resume(co, SW_OK);
+	return SW_OK;
+}
+
+static void swCoroutine_onTimeout(swTimer *timer, swTimer_node *node)
+{
+	swCoroutine *co = node->data;
+	//定时器正在执行, 不需要再删除
+	co->timer_id = 0;
+	swCoroutine_resume(co, SW_CORO_TIMEOUT);
+}
+
+int swCoroutine_wait_fd(int fd, int events, int timeout_ms)
+{
+	swCoroutine *co = swoole_coroutine.current;
+	swReactor *reactor = SwooleG.main_reactor;
+	struct pollfd pfd;
+	uint32_t size;
+	int ret;
+
+	//不在协程中, 阻塞等待
+	if (co == NULL || reactor == NULL)
+	{
+		pfd.fd = fd;
+		pfd.events = (events & SW_EVENT_WRITE) ? POLLOUT : POLLIN;
+		do
+		{
+			ret = poll(&pfd, 1, timeout_ms);
+		}
+		while (ret < 0 && errno == EINTR);
+		if (ret == 0)
+		{
+			errno = ETIMEDOUT;
+			return SW_ERR;
+		}
+		return ret < 0 ? SW_ERR : SW_OK;
+	}
+	if (swCoroutine_reactor_init(reactor) < 0)
+	{
+		return SW_ERR;
+	}
+	if (fd >= swoole_coroutine.fds_size)
+	{
+		size = swoole_coroutine.fds_size > 0 ? swoole_coroutine.fds_size : SW_CORO_FD_INIT_SIZE;
+		while (size <= fd)
+		{
+			size *= 2;
+		}
+		swCoroutine **fds = sw_realloc(swoole_coroutine.fds, sizeof(swCoroutine *) * size);
+		if (fds == NULL)
+		{
+			swWarn("realloc for coroutine fds failed.");
+			return SW_ERR;
+		}
+		bzero(fds + swoole_coroutine.fds_size, sizeof(swCoroutine *) * (size - swoole_coroutine.fds_size));
+		swoole_coroutine.fds = fds;
+		swoole_coroutine.fds_size = size;
+	}
+	if (reactor->add(reactor, fd, SW_FD_CORO | events | SW_EVENT_ERROR) < 0)
+	{
+		return SW_ERR;
+	}
+	swoole_coroutine.fds[fd] = co;
+	co->wait_fd = fd;
+	if (timeout_ms >= 0)
+	{
+		co->timer_id = swTimer_set(&SwooleG.timer, timeout_ms > 0 ? timeout_ms : 1, 0, co, swCoroutine_onTimeout);
+	}
+
+	ret = swCoroutine_yield();
+
+	if (co->timer_id > 0)
+	{
+		swTimer_clear(&SwooleG.timer, co->timer_id);
+		co->timer_id = 0;
+	}
+	swoole_coroutine.fds[fd] = NULL;
+	co->wait_fd = -1;
+	//只移除事件, fd由调用方关闭
+	reactor->flag |= SW_REACTOR_KEEP_FD;
+	reactor->del(reactor, fd);
+	reactor->flag &= ~SW_REACTOR_KEEP_FD;
+	if (ret == SW_CORO_TIMEOUT)
+	{
+		errno = ETIMEDOUT;
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+int swCoroutine_sleep(int ms)
+{
+	swCoroutine *co = swoole_coroutine.current;
+
+	if (co == NULL || SwooleG.main_reactor == NULL)
+	{
+		return usleep(ms * 1000);
+	}
+	if (swCoroutine_reactor_init(SwooleG.main_reactor) < 0)
+	{
+		return SW_ERR;
+	}
+	co->timer_id = swTimer_set(&SwooleG.timer, ms > 0 ? ms : 1, 0, co, swCoroutine_onTimeout);
+	if (co->timer_id < 0)
+	{
+		co->timer_id = 0;
+		return SW_ERR;
+	}
+	swCoroutine_yield();
+	return SW_OK;
+}
+
+#define swCoroutine_client_timeout(cli)   ((cli)->timeout > 0 ? (int) ((cli)->timeout * 1000) : -1)
+#define swCoroutine_client_udp(cli)       ((cli)->type == SW_SOCK_UDP || (cli)->type == SW_SOCK_UDP6)
+
+int swCoroutine_connect(swClient *cli, char *host, int port, double timeout)
+{
+	socklen_t len = sizeof(int);
+	int err = 0;
+
+	//UDP的connect不会阻塞
+	if (cli->connect(cli, host, port, timeout, 1) == 0)
+	{
+		return SW_OK;
+	}
+	if (errno != EINPROGRESS)
+	{
+		return SW_ERR;
+	}
+	if (swCoroutine_wait_fd(cli->sock, SW_EVENT_WRITE, swCoroutine_client_timeout(cli)) < 0)
+	{
+		return SW_ERR;
+	}
+	if (getsockopt(cli->sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+	{
+		errno = err;
+		return SW_ERR;
+	}
+	cli->connected = 1;
+	return SW_OK;
+}
+
+int swCoroutine_send(swClient *cli, char *data, int length)
+{
+	int written = 0, n;
+
+	if (swCoroutine_client_udp(cli))
+	{
+		return cli->send(cli, data, length);
+	}
+	while (written < length)
+	{
+		n = send(cli->sock, data + written, length - written, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n >= 0)
+		{
+			written += n;
+			continue;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if (errno != EAGAIN || swCoroutine_wait_fd(cli->sock, SW_EVENT_WRITE, swCoroutine_client_timeout(cli)) < 0)
+		{
+			return SW_ERR;
+		}
+	}
+	return written;
+}
+
+int swCoroutine_recv(swClient *cli, char *data, int length, int waitall)
+{
+	socklen_t len;
+	int total = 0, n;
+
+	while (1)
+	{
+		if (swCoroutine_client_udp(cli))
+		{
+			len = sizeof(cli->remote_addr);
+			n = recvfrom(cli->sock, data, length, MSG_DONTWAIT, (struct sockaddr *) &cli->remote_addr, &len);
+		}
+		else
+		{
+			n = recv(cli->sock, data + total, length - total, MSG_DONTWAIT);
+		}
+		if (n > 0)
+		{
+			total += n;
+			if (!waitall || total == length || swCoroutine_client_udp(cli))
+			{
+				return total;
+			}
+			continue;
+		}
+		//对端关闭
+		if (n == 0)
+		{
+			return total;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if (errno != EAGAIN || swCoroutine_wait_fd(cli->sock, SW_EVENT_READ, swCoroutine_client_timeout(cli)) < 0)
+		{
+			return total > 0 ? total : SW_ERR;
+		}
+	}
+	return total;
+}
+
+int swCoroutine_task(swServer *serv, swEventData *task, int worker_id, int timeout_ms, swEventData *result)
+{
+	swCoroutine *co = swoole_coroutine.current;
+	swCoroutine_task_waiter waiter;
+	int ret;
+
+	if (co == NULL || SwooleG.main_reactor == NULL)
+	{
+		swWarn("swCoroutine_task must be called in a coroutine.");
+		return SW_ERR;
+	}
+	if (swCoroutine_reactor_init(SwooleG.main_reactor) < 0)
+	{
+		return SW_ERR;
+	}
+	//task进程处理完后发送SW_EVENT_FINISH
+	task->info.type = SW_TASK_NONBLOCK;
+	if (swTaskWorker_dispatch(serv, task, worker_id) < 0)
+	{
+		return SW_ERR;
+	}
+	waiter.co = co;
+	waiter.result = result;
+	swHashMap_add_int(&swoole_coroutine.tasks, task->info.fd, &waiter);
+	if (timeout_ms >= 0)
+	{
+		co->timer_id = swTimer_set(&SwooleG.timer, timeout_ms > 0 ? timeout_ms : 1, 0, co, swCoroutine_onTimeout);
+	}
+
+	ret = swCoroutine_yield();
+
+	if (co->timer_id > 0)
+	{
+		swTimer_clear(&SwooleG.timer, co->timer_id);
+		co->timer_id = 0;
+	}
+	if (ret == SW_CORO_TIMEOUT)
+	{
+		swHashMap_del_int(&swoole_coroutine.tasks, task->info.fd);
+		errno = ETIMEDOUT;
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+int swCoroutine_task_finish(swEventData *result)
+{
+	swCoroutine_task_waiter *waiter;
+
+	if (swoole_coroutine.tasks == NULL || (waiter = swHashMap_find_int(&swoole_coroutine.tasks, result->info.fd)) == NULL)
+	{
+		return 0;
+	}
+	swHashMap_del_int(&swoole_coroutine.tasks, result->info.fd);
+	memcpy(waiter->result, result, sizeof(swDataHead) + result->info.len);
+	swCoroutine_resume(waiter->co, SW_OK);
+	return 1;
+}
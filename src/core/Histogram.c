@@ -0,0 +1,110 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+
+static inline int swHistogram_index(uint32_t value)
+{
+	int msb;
+
+	if (value < SW_HISTOGRAM_SUB_BUCKETS)
+	{
+		return value;
+	}
+	msb = 31 - __builtin_clz(value);
+	return (msb - SW_HISTOGRAM_SUB_BITS + 1) * SW_HISTOGRAM_SUB_BUCKETS
+			+ ((value >> (msb - SW_HISTOGRAM_SUB_BITS)) & (SW_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * 桶中的最大值
+ */
+static inline uint64_t swHistogram_upper(int index)
+{
+	int shift = index / SW_HISTOGRAM_SUB_BUCKETS - 1;
+
+	if (index < SW_HISTOGRAM_SUB_BUCKETS)
+	{
+		return index;
+	}
+	return ((uint64_t) (SW_HISTOGRAM_SUB_BUCKETS + index % SW_HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void swHistogram_record(swHistogram *h, uint32_t value)
+{
+	atomic_t max;
+
+	sw_atomic_fetch_add(&h->buckets[swHistogram_index(value)], 1);
+	sw_atomic_fetch_add(&h->sum, value);
+	sw_atomic_fetch_add(&h->count, 1);
+	for (max = h->max; value > max; max = h->max)
+	{
+		if (sw_atomic_cmp_set(&h->max, max, value))
+		{
+			break;
+		}
+	}
+}
+
+void swHistogram_merge(swHistogram *dst, swHistogram *src)
+{
+	int i;
+
+	for (i = 0; i < SW_HISTOGRAM_BUCKETS; i++)
+	{
+		dst->buckets[i] += src->buckets[i];
+	}
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+	{
+		dst->max = src->max;
+	}
+}
+
+uint64_t swHistogram_percentile(swHistogram *h, double percent)
+{
+	uint64_t total = 0, rank;
+	uint64_t upper;
+	int i;
+
+	//count和buckets不是同时读取的, 按buckets重新计算总数
+	for (i = 0; i < SW_HISTOGRAM_BUCKETS; i++)
+	{
+		total += h->buckets[i];
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+	rank = (uint64_t) (total * percent / 100 + 0.5);
+	if (rank == 0)
+	{
+		rank = 1;
+	}
+	for (i = 0; i < SW_HISTOGRAM_BUCKETS; i++)
+	{
+		if (h->buckets[i] >= rank)
+		{
+			break;
+		}
+		rank -= h->buckets[i];
+	}
+	upper = swHistogram_upper(i);
+	//不超过记录到的最大值
+	return upper > h->max && h->max > 0 ? h->max : upper;
+}
@@ -0,0 +1,184 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+
+#include <limits.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * 有界无锁多生产者多消费者队列, 每个槽位有一个序号
+ * sequence == pos 表示可以写入, sequence == pos + 1 表示可以读取
+ */
+int swMPMCQueue_create(swMPMCQueue *queue, uint32_t size)
+{
+	uint32_t i;
+
+	if (size < 2 || (size & (size - 1)) != 0)
+	{
+		swWarn("swMPMCQueue size[%d] must be a power of 2.", size);
+		return SW_ERR;
+	}
+	bzero(queue, sizeof(swMPMCQueue));
+	queue->cells = sw_malloc(sizeof(swMPMCQueue_cell) * size);
+	if (queue->cells == NULL)
+	{
+		swWarn("malloc for swMPMCQueue failed.");
+		return SW_ERR;
+	}
+	for (i = 0; i < size; i++)
+	{
+		queue->cells[i].sequence = i;
+		queue->cells[i].data = NULL;
+	}
+	queue->size = size;
+	queue->mask = size - 1;
+	return SW_OK;
+}
+
+void swMPMCQueue_free(swMPMCQueue *queue)
+{
+	sw_free(queue->cells);
+	queue->cells = NULL;
+}
+
+int swMPMCQueue_push(swMPMCQueue *queue, void *data)
+{
+	swMPMCQueue_cell *cell;
+	uint64_t pos = queue->enqueue_pos;
+	int64_t diff;
+
+	while (1)
+	{
+		cell = &queue->cells[pos & queue->mask];
+		diff = (int64_t) cell->sequence - (int64_t) pos;
+		if (diff == 0)
+		{
+			if (sw_atomic_cmp_set(&queue->enqueue_pos, pos, pos + 1))
+			{
+				break;
+			}
+			pos = queue->enqueue_pos;
+		}
+		//队列已满
+		else if (diff < 0)
+		{
+			return SW_ERR;
+		}
+		else
+		{
+			pos = queue->enqueue_pos;
+		}
+	}
+	cell->data = data;
+	sw_atomic_memory_barrier();
+	cell->sequence = pos + 1;
+	//写入sequence之后再读取waiters, 与swMPMCQueue_wait配对
+	sw_atomic_memory_barrier();
+
+	//有消费者睡眠时才需要系统调用
+	if (queue->waiters > 0)
+	{
+		sw_atomic_fetch_add(&queue->futex, 1);
+		swMPMCQueue_wake(queue, 1);
+	}
+	return SW_OK;
+}
+
+int swMPMCQueue_pop(swMPMCQueue *queue, void **data)
+{
+	swMPMCQueue_cell *cell;
+	uint64_t pos = queue->dequeue_pos;
+	int64_t diff;
+
+	while (1)
+	{
+		cell = &queue->cells[pos & queue->mask];
+		diff = (int64_t) cell->sequence - (int64_t) (pos + 1);
+		if (diff == 0)
+		{
+			if (sw_atomic_cmp_set(&queue->dequeue_pos, pos, pos + 1))
+			{
+				break;
+			}
+			pos = queue->dequeue_pos;
+		}
+		//队列为空
+		else if (diff < 0)
+		{
+			return SW_ERR;
+		}
+		else
+		{
+			pos = queue->dequeue_pos;
+		}
+	}
+	*data = cell->data;
+	sw_atomic_memory_barrier();
+	cell->sequence = pos + queue->mask + 1;
+	return SW_OK;
+}
+
+/**
+ * 队列为空时睡眠, 最多等待timeout毫秒, 超时或被唤醒后返回SW_ERR
+ */
+int swMPMCQueue_wait(swMPMCQueue *queue, void **data, int timeout)
+{
+	uint32_t futex;
+
+	if (swMPMCQueue_pop(queue, data) == SW_OK)
+	{
+		return SW_OK;
+	}
+	futex = queue->futex;
+	sw_atomic_fetch_add(&queue->waiters, 1);
+	//增加waiters后重新检查, 避免错过唤醒
+	if (swMPMCQueue_pop(queue, data) == SW_OK)
+	{
+		sw_atomic_fetch_sub(&queue->waiters, 1);
+		return SW_OK;
+	}
+#ifdef __linux__
+	struct timespec ts;
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000 * 1000;
+	syscall(SYS_futex, &queue->futex, FUTEX_WAIT_PRIVATE, futex, &ts, NULL, 0);
+#else
+	usleep(1000);
+#endif
+	sw_atomic_fetch_sub(&queue->waiters, 1);
+	return swMPMCQueue_pop(queue, data);
+}
+
+void swMPMCQueue_wake(swMPMCQueue *queue, int num)
+{
+#ifdef __linux__
+	syscall(SYS_futex, &queue->futex, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+#endif
+}
+
+/**
+ * 唤醒所有睡眠的消费者, 用于退出
+ */
+void swMPMCQueue_wake_all(swMPMCQueue *queue)
+{
+	sw_atomic_fetch_add(&queue->futex, 1);
+	swMPMCQueue_wake(queue, INT_MAX);
+}
@@ -0,0 +1,245 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+
+#define swMPSCChannel_item_size(len)   SW_MEM_ALIGNED_SIZE(sizeof(swMPSCChannel_item) + (len))
+#define swMPSCChannel_item_at(ch, pos) ((swMPSCChannel_item *) ((char *) (ch)->mem + ((pos) & ((ch)->size - 1))))
+
+/**
+ * 多生产者单消费者的无锁channel, 变长记录
+ * 生产者CAS移动tail预留空间, 写完数据后设置记录的flag提交, 消费者按顺序读取已提交的记录
+ * head之外的内存始终是0, 所以没提交的记录flag一定是0
+ */
+swMPSCChannel* swMPSCChannel_create(uint32_t size, int flag)
+{
+	swMPSCChannel *object;
+	uint32_t mem_size = SW_MPSC_CHANNEL_MIN_SIZE;
+
+	while (mem_size < size)
+	{
+		mem_size <<= 1;
+	}
+	if (flag & SW_CHAN_SHM)
+	{
+		object = sw_shm_calloc(1, sizeof(swMPSCChannel) + mem_size);
+	}
+	else
+	{
+		object = sw_calloc(1, sizeof(swMPSCChannel) + mem_size);
+	}
+	if (object == NULL)
+	{
+		swWarn("swMPSCChannel_create: malloc fail");
+		return NULL;
+	}
+	object->size = mem_size;
+	object->flag = flag;
+	object->mem = object + 1;
+	object->waiting = 1;
+
+	if (flag & SW_CHAN_NOTIFY)
+	{
+#ifdef HAVE_EVENTFD
+		if (swPipeEventfd_create(&object->notify_fd, 1, 0) < 0)
+#else
+		if (swPipeBase_create(&object->notify_fd, 1) < 0)
+#endif
+		{
+			swWarn("swMPSCChannel_create: notify_fd init fail");
+			swMPSCChannel_free(object);
+			return NULL;
+		}
+	}
+	return object;
+}
+
+/**
+ * 空间不足时返回SW_ERR, 不会阻塞
+ */
+int swMPSCChannel_push(swMPSCChannel *object, void *data, uint32_t length)
+{
+	swMPSCChannel_item *item;
+	atomic_uint_t tail;
+	uint32_t msize = swMPSCChannel_item_size(length), offset, padding;
+
+	if (msize > object->size / 2)
+	{
+		swWarn("swMPSCChannel_push: data is too big[%d].", length);
+		return SW_ERR;
+	}
+	while (1)
+	{
+		tail = object->tail;
+		offset = tail & (object->size - 1);
+		//不够放到结尾, 剩下的部分填充后从头开始
+		padding = (offset + msize > object->size) ? object->size - offset : 0;
+		if (tail + padding + msize - object->head > object->size)
+		{
+			return SW_ERR;
+		}
+		if (sw_atomic_cmp_set(&object->tail, tail, tail + padding + msize))
+		{
+			break;
+		}
+		sw_atomic_cpu_pause();
+	}
+	if (padding > 0)
+	{
+		item = swMPSCChannel_item_at(object, tail);
+		item->length = padding - sizeof(swMPSCChannel_item);
+		sw_atomic_write_barrier();
+		item->flag = SW_MPSC_PADDING;
+	}
+	item = swMPSCChannel_item_at(object, tail + padding);
+	item->length = length;
+	memcpy(item->data, data, length);
+	sw_atomic_write_barrier();
+	item->flag = SW_MPSC_COMMIT;
+
+	//只有消费者准备睡眠时才需要通知
+	if (object->flag & SW_CHAN_NOTIFY)
+	{
+		sw_atomic_memory_barrier();
+		if (object->waiting && sw_atomic_cmp_set(&object->waiting, 1, 0))
+		{
+			swMPSCChannel_notify(object);
+		}
+	}
+	return SW_OK;
+}
+
+/**
+ * 批量取出最多max条记录, 直接在channel的内存中回调handler, 最后只更新一次head
+ * 返回取出的记录数量
+ */
+int swMPSCChannel_pop_batch(swMPSCChannel *object, swMPSCChannel_handler handler, void *arg, int max)
+{
+	swMPSCChannel_item *item;
+	atomic_uint_t head = object->head;
+	uint32_t msize;
+	int n = 0;
+
+	while (n < max)
+	{
+		item = swMPSCChannel_item_at(object, head);
+		if (item->flag == 0)
+		{
+			break;
+		}
+		sw_atomic_read_barrier();
+		msize = swMPSCChannel_item_size(item->length);
+		if (item->flag == SW_MPSC_COMMIT)
+		{
+			handler(object, item->data, item->length, arg);
+			n++;
+		}
+		bzero(item, msize);
+		head += msize;
+	}
+	if (head != object->head)
+	{
+		sw_atomic_memory_barrier();
+		object->head = head;
+	}
+	return n;
+}
+
+static void swMPSCChannel_copy(swMPSCChannel *object, void *data, uint32_t length, void *arg)
+{
+	swMPSCChannel_buffer *buffer = arg;
+	if (length > buffer->size)
+	{
+		swWarn("swMPSCChannel_pop: buffer is too small, length=%d.", length);
+		buffer->length = SW_ERR;
+		return;
+	}
+	memcpy(buffer->data, data, length);
+	buffer->length = length;
+}
+
+/**
+ * 取出一条记录, channel为空时返回SW_ERR
+ */
+int swMPSCChannel_pop(swMPSCChannel *object, void *out, int buffer_length)
+{
+	swMPSCChannel_buffer buffer;
+	buffer.data = out;
+	buffer.size = buffer_length;
+	buffer.length = SW_ERR;
+	swMPSCChannel_pop_batch(object, swMPSCChannel_copy, &buffer, 1);
+	return buffer.length;
+}
+
+int swMPSCChannel_empty(swMPSCChannel *object)
+{
+	swMPSCChannel_item *item = swMPSCChannel_item_at(object, object->head);
+	return item->flag == 0;
+}
+
+/**
+ * 消费者处理完所有数据后调用, 之后第一个push会发出通知
+ * 返回SW_FALSE表示在设置期间有新数据, 需要继续处理
+ */
+int swMPSCChannel_arm(swMPSCChannel *object)
+{
+	object->waiting = 1;
+	sw_atomic_memory_barrier();
+	if (!swMPSCChannel_empty(object))
+	{
+		object->waiting = 0;
+		return SW_FALSE;
+	}
+	return SW_TRUE;
+}
+
+/**
+ * 阻塞等待新数据
+ */
+int swMPSCChannel_wait(swMPSCChannel *object)
+{
+	uint64_t flag;
+	assert(object->flag & SW_CHAN_NOTIFY);
+	if (!swMPSCChannel_arm(object))
+	{
+		return SW_OK;
+	}
+	return object->notify_fd.read(&object->notify_fd, &flag, sizeof(flag));
+}
+
+int swMPSCChannel_notify(swMPSCChannel *object)
+{
+	uint64_t flag = 1;
+	assert(object->flag & SW_CHAN_NOTIFY);
+	return object->notify_fd.write(&object->notify_fd, &flag, sizeof(flag));
+}
+
+void swMPSCChannel_free(swMPSCChannel *object)
+{
+	if ((object->flag & SW_CHAN_NOTIFY) && object->notify_fd.close)
+	{
+		object->notify_fd.close(&object->notify_fd);
+	}
+	if (object->flag & SW_CHAN_SHM)
+	{
+		sw_shm_free(object);
+	}
+	else
+	{
+		sw_free(object);
+	}
+}
@@ -0,0 +1,130 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+
+typedef struct _swRecvRing_block
+{
+	uint32_t length;             //整个块的长度, 包括头部和尾部的填充
+	volatile uint32_t released;  //使用者处理完后设置, 由分配的线程回收
+} swRecvRing_block;
+
+//多保留1字节, 使用者可以直接在数据尾部写入\0
+#define SW_RECVRING_BLOCK_SIZE(n)  SW_MEM_ALIGNED_SIZE(sizeof(swRecvRing_block) + (n) + 1)
+
+swRecvRing* swRecvRing_create(uint32_t size)
+{
+	swRecvRing *ring;
+
+	size = SW_MEM_ALIGNED_SIZE(size);
+	ring = sw_shm_malloc(sizeof(swRecvRing) + size);
+	if (ring == NULL)
+	{
+		swWarn("malloc for recv ring failed. Error: %s[%d]", strerror(errno), errno);
+		return NULL;
+	}
+	bzero(ring, sizeof(swRecvRing));
+	ring->size = size;
+	return ring;
+}
+
+/**
+ * 从head开始回收连续的已释放的块
+ */
+static void swRecvRing_reclaim(swRecvRing *ring)
+{
+	swRecvRing_block *block;
+
+	while (ring->used > 0)
+	{
+		block = (swRecvRing_block *) (ring->mem + ring->head);
+		if (!block->released)
+		{
+			break;
+		}
+		sw_atomic_memory_barrier();
+		ring->head += block->length;
+		ring->used -= block->length;
+		if (ring->head == ring->size)
+		{
+			ring->head = 0;
+		}
+	}
+	//全部释放后从头开始, 可分配的连续空间最大
+	if (ring->used == 0)
+	{
+		ring->head = ring->tail = 0;
+	}
+}
+
+int swRecvRing_alloc(swRecvRing *ring, uint32_t length)
+{
+	uint32_t block_size = SW_RECVRING_BLOCK_SIZE(length);
+	uint32_t offset;
+	swRecvRing_block *block;
+
+	swRecvRing_reclaim(ring);
+	if (block_size > ring->size - ring->used)
+	{
+		return SW_ERR;
+	}
+	//空闲空间在tail之后和head之前两段
+	if (ring->tail >= ring->head)
+	{
+		//块不跨越尾部, 剩余空间填充为已释放的块, 从头开始
+		if (ring->size - ring->tail < block_size)
+		{
+			if (ring->head < block_size)
+			{
+				return SW_ERR;
+			}
+			block = (swRecvRing_block *) (ring->mem + ring->tail);
+			block->length = ring->size - ring->tail;
+			block->released = 1;
+			ring->used += block->length;
+			ring->tail = 0;
+		}
+	}
+	else if (ring->head - ring->tail < block_size)
+	{
+		return SW_ERR;
+	}
+	offset = ring->tail;
+	block = (swRecvRing_block *) (ring->mem + offset);
+	block->length = block_size;
+	block->released = 0;
+	ring->used += block_size;
+	ring->tail += block_size;
+	if (ring->tail == ring->size)
+	{
+		ring->tail = 0;
+	}
+	return offset + sizeof(swRecvRing_block);
+}
+
+void swRecvRing_release(swRecvRing *ring, uint32_t offset)
+{
+	swRecvRing_block *block = (swRecvRing_block *) (ring->mem + offset - sizeof(swRecvRing_block));
+
+	//数据读完之后才能被复用
+	sw_atomic_memory_barrier();
+	block->released = 1;
+}
+
+void swRecvRing_free(swRecvRing *ring)
+{
+	sw_shm_free(ring);
+}
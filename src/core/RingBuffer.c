@@ -0,0 +1,165 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+
+#define SW_RINGBUFFER_WRAP        0xffffffff  //剩余空间不足一个记录,跳到开头
+//多保留1字节, 消费者可以直接在数据尾部写入\0
+#define SW_RINGBUFFER_ITEM_SIZE(n) SW_MEM_ALIGNED_SIZE(sizeof(uint32_t) + (n) + 1)
+
+/**
+ * head和tail是一直递增的计数, 取模得到实际位置, 溢出后依然正确
+ */
+swRingBuffer* swRingBuffer_create(uint32_t size, int shared)
+{
+	//size must be 2^n
+	assert(size >= 1024 && (size & (size - 1)) == 0);
+
+	int alloc_size = sizeof(swRingBuffer) + size;
+	swRingBuffer *rb = shared ? sw_shm_malloc(alloc_size) : sw_malloc(alloc_size);
+	if (rb == NULL)
+	{
+		swWarn("malloc for ringbuffer failed. Error: %s[%d]", strerror(errno), errno);
+		return NULL;
+	}
+	bzero(rb, sizeof(swRingBuffer));
+	rb->size = size;
+	rb->shared = shared;
+	return rb;
+}
+
+/**
+ * 生产者写入一条记录, 空间不足返回SW_ERR
+ */
+int swRingBuffer_push(swRingBuffer *rb, void *data, int length)
+{
+	uint32_t tail = rb->tail;
+	uint32_t offset = tail & (rb->size - 1);
+	uint32_t item_size = SW_RINGBUFFER_ITEM_SIZE(length);
+	uint32_t pad = 0;
+
+	if (item_size > rb->size / 2)
+	{
+		swWarn("data is too big. length=%d|ringbuffer_size=%d", length, rb->size);
+		return SW_ERR;
+	}
+	//记录不可跨越尾部,剩余空间填充后从头开始
+	if (offset + item_size > rb->size)
+	{
+		pad = rb->size - offset;
+	}
+	//队列满了
+	if (rb->size - (tail - rb->head) < pad + item_size)
+	{
+		return SW_ERR;
+	}
+	if (pad > 0)
+	{
+		*(uint32_t *) (rb->mem + offset) = SW_RINGBUFFER_WRAP;
+		offset = 0;
+	}
+	*(uint32_t *) (rb->mem + offset) = length;
+	memcpy(rb->mem + offset + sizeof(uint32_t), data, length);
+
+	//数据必须在tail之前写入完成
+	sw_atomic_memory_barrier();
+	rb->tail = tail + pad + item_size;
+	return SW_OK;
+}
+
+/**
+ * 消费者取得队头记录, 不复制数据, 处理完后需调用swRingBuffer_pop
+ */
+void* swRingBuffer_front(swRingBuffer *rb, int *length)
+{
+	uint32_t head = rb->head;
+	uint32_t offset;
+	uint32_t n;
+
+	if (head == rb->tail)
+	{
+		return NULL;
+	}
+	//读取tail后再读数据
+	sw_atomic_memory_barrier();
+
+	offset = head & (rb->size - 1);
+	n = *(uint32_t *) (rb->mem + offset);
+	if (n == SW_RINGBUFFER_WRAP)
+	{
+		rb->head = head + (rb->size - offset);
+		offset = 0;
+		n = *(uint32_t *) rb->mem;
+	}
+	*length = n;
+	return rb->mem + offset + sizeof(uint32_t);
+}
+
+void swRingBuffer_pop(swRingBuffer *rb)
+{
+	uint32_t head = rb->head;
+	uint32_t n = *(uint32_t *) (rb->mem + (head & (rb->size - 1)));
+
+	//数据使用完成后才能释放空间
+	sw_atomic_memory_barrier();
+	rb->head = head + SW_RINGBUFFER_ITEM_SIZE(n);
+}
+
+/**
+ * 从cursor开始依次读取记录而不释放空间, cursor初始为rb->head
+ * 处理完后调用swRingBuffer_release一次释放cursor之前的所有记录
+ */
+void* swRingBuffer_peek(swRingBuffer *rb, uint32_t *cursor, int *length)
+{
+	uint32_t offset;
+	uint32_t n;
+
+	if (*cursor == rb->tail)
+	{
+		return NULL;
+	}
+	sw_atomic_memory_barrier();
+
+	offset = *cursor & (rb->size - 1);
+	n = *(uint32_t *) (rb->mem + offset);
+	if (n == SW_RINGBUFFER_WRAP)
+	{
+		*cursor += rb->size - offset;
+		offset = 0;
+		n = *(uint32_t *) rb->mem;
+	}
+	*length = n;
+	*cursor += SW_RINGBUFFER_ITEM_SIZE(n);
+	return rb->mem + offset + sizeof(uint32_t);
+}
+
+void swRingBuffer_release(swRingBuffer *rb, uint32_t cursor)
+{
+	sw_atomic_memory_barrier();
+	rb->head = cursor;
+}
+
+void swRingBuffer_free(swRingBuffer *rb)
+{
+	if (rb->shared)
+	{
+		sw_shm_free(rb);
+	}
+	else
+	{
+		sw_free(rb);
+	}
+}
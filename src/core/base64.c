@@ -0,0 +1,53 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+
+static const char swoole_base64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * dst至少要有(src_len + 2) / 3 * 4 + 1字节, 返回编码后的长度
+ */
+int swoole_base64_encode(unsigned char *src, int src_len, char *dst)
+{
+	char *p = dst;
+	int i;
+
+	for (i = 0; i + 2 < src_len; i += 3)
+	{
+		*p++ = swoole_base64_table[src[i] >> 2];
+		*p++ = swoole_base64_table[((src[i] & 0x03) << 4) | (src[i + 1] >> 4)];
+		*p++ = swoole_base64_table[((src[i + 1] & 0x0f) << 2) | (src[i + 2] >> 6)];
+		*p++ = swoole_base64_table[src[i + 2] & 0x3f];
+	}
+	if (i < src_len)
+	{
+		*p++ = swoole_base64_table[src[i] >> 2];
+		if (i + 1 < src_len)
+		{
+			*p++ = swoole_base64_table[((src[i] & 0x03) << 4) | (src[i + 1] >> 4)];
+			*p++ = swoole_base64_table[(src[i + 1] & 0x0f) << 2];
+		}
+		else
+		{
+			*p++ = swoole_base64_table[(src[i] & 0x03) << 4];
+			*p++ = '=';
+		}
+		*p++ = '=';
+	}
+	*p = '\0';
+	return p - dst;
+}
@@ -28,7 +28,7 @@ typedef struct swHashMap_node
 SWINLINE static int swHashMap_add_keyptr(swHashMap_node **root, swHashMap_node *add);
 SWINLINE static uint64_t swHashMap_jenkins_hash(char *key, uint64_t keylen, uint32_t num_bkts);
 SWINLINE static swHashMap_node *swHashMap_find_node(swHashMap_node *head, char *key_str, uint16_t key_len);
-SWINLINE static int swHashMap_delete_node(swHashMap_node *head, swHashMap_node *del_node);
+SWINLINE static int swHashMap_delete_node(swHashMap_node **root, swHashMap_node *del_node);
 
 static int swHashMap_create(swHashMap_node *head);
 
@@ -173,19 +173,6 @@ int swHashMap_add(swHashMap_node** root, char *key, uint16_t key_len, void *data
 	return swHashMap_add_keyptr(root, node);
 }
 
-void swHashMap_add_int(swHashMap_node** root, uint64_t key, void *data)
-{
-	swHashMap_node *node = (swHashMap_node*) sw_malloc(sizeof(swHashMap_node));
-	if (node == NULL)
-	{
-		swWarn("malloc fail");
-		return;
-	}
-	node->key_int = key;
-	node->data = data;
-	HASH_ADD_INT(*root, key_int, node);
-}
-
 SWINLINE static swHashMap_node *swHashMap_find_node(swHashMap_node *head, char *key_str, uint16_t key_len)
 {
 	swHashMap_node *out;
@@ -200,15 +187,20 @@ SWINLINE static swHashMap_node *swHashMap_find_node(swHashMap_node *head, char *
 	return out;
 }
 
-static int swHashMap_delete_node(swHashMap_node *head, swHashMap_node *del_node)
+/**
+ * 删除的是第一个节点时需要修改root
+ */
+static int swHashMap_delete_node(swHashMap_node **root, swHashMap_node *del_node)
 {
 	unsigned bucket;
 	struct UT_hash_handle *_hd_hh_del;
+	swHashMap_node *head = *root;
 	if ((del_node->hh.prev == NULL) && (del_node->hh.next == NULL))
 	{
 		sw_free(head->hh.tbl->buckets);
 		sw_free(head->hh.tbl);
-		head = NULL;
+		*root = NULL;
+		return SW_OK;
 	}
 	else
 	{
@@ -234,6 +226,7 @@ static int swHashMap_delete_node(swHashMap_node *head, swHashMap_node *del_node)
 		head->hh.tbl->num_items--;
 	}
 	HASH_FSCK(hh, head);
+	*root = head;
 	return SW_OK;
 }
 
@@ -247,17 +240,6 @@ void* swHashMap_find(swHashMap_node** root, char *key, uint16_t key_len)
 	return ret->data;
 }
 
-void* swHashMap_find_int(swHashMap_node** root, uint64_t key)
-{
-	swHashMap_node *ret = NULL;
-	HASH_FIND_INT(*root, &key, ret);
-	if (ret == NULL)
-	{
-		return NULL;
-	}
-	return ret->data;
-}
-
 int swHashMap_update(swHashMap_node** root, char *key, uint16_t key_len, void *data)
 {
 	swHashMap_node *node = swHashMap_find_node(*root, key, key_len);
@@ -269,17 +251,6 @@ int swHashMap_update(swHashMap_node** root, char *key, uint16_t key_len, void *d
 	return SW_OK;
 }
 
-void swHashMap_update_int(swHashMap_node** root, uint64_t key, void *data)
-{
-	swHashMap_node *ret = NULL;
-	HASH_FIND_INT(*root, &key, ret);
-	if (ret == NULL)
-	{
-		return;
-	}
-	ret->data = data;
-}
-
 int swHashMap_del(swHashMap_node** root, char *key, uint16_t key_len)
 {
 	swHashMap_node *node = swHashMap_find_node(*root, key, key_len);;
@@ -287,24 +258,12 @@ int swHashMap_del(swHashMap_node** root, char *key, uint16_t key_len)
 	{
 		return SW_ERR;
 	}
-	swHashMap_delete_node(*root, node);
+	swHashMap_delete_node(root, node);
 	sw_free(node->key_str);
 	sw_free(node);
 	return SW_OK;
 }
 
-void swHashMap_del_int(swHashMap_node** root, uint64_t key)
-{
-	swHashMap_node *ret = NULL;
-	HASH_FIND_INT(*root, &key, ret);
-	if (ret == NULL)
-	{
-		return;
-	}
-	HASH_DEL(*root, ret);
-	sw_free(ret);
-}
-
 SWINLINE void* swHashMap_foreach(swHashMap_node** root, char **key, void **data, swHashMap_node *head)
 {
 	swHashMap_node *find = NULL, *tmp = NULL;
@@ -321,29 +280,182 @@ SWINLINE void* swHashMap_foreach(swHashMap_node** root, char **key, void **data,
 	return tmp;
 }
 
-void* swHashMap_foreach_int(swHashMap_node** root, uint64_t *key, void **data, swHashMap_node *head)
+void swHashMap_destory(swHashMap_node** root)
 {
-	swHashMap_node *find = NULL, *tmp = NULL;
-	if (head == NULL)
+	swHashMap_node *find, *tmp = NULL;
+	HASH_ITER(hh, *root, find, tmp)
 	{
-		head = *root;
+		swHashMap_delete_node(root, find);
+		sw_free(find);
+	}
+}
+
+//Fibonacci hashing, 取乘积的高位, 连续的fd/id也能分散开
+#define swHashMap_int_home(t, key)    ((uint32_t) (((key) * 0x9E3779B97F4A7C15ULL) >> (64 - (t)->bits)))
+
+static int swHashMap_int_resize(swHashMap_int *root, uint8_t bits)
+{
+	swHashMap_int_table *old = *root, *t;
+	uint32_t i, j;
+
+	t = sw_calloc(1, sizeof(swHashMap_int_table) + sizeof(swHashMap_int_slot) * (1u << bits));
+	if (t == NULL)
+	{
+		swWarn("malloc for hashmap failed.");
+		return SW_ERR;
+	}
+	t->bits = bits;
+	t->size = 1u << bits;
+	if (old)
+	{
+		for (i = 0; i < old->size; i++)
+		{
+			if (old->slots[i].data == NULL)
+			{
+				continue;
+			}
+			j = swHashMap_int_home(t, old->slots[i].key);
+			while (t->slots[j].data != NULL)
+			{
+				j = (j + 1) & (t->size - 1);
+			}
+			t->slots[j] = old->slots[i];
+		}
+		t->num = old->num;
+		sw_free(old);
+	}
+	*root = t;
+	return SW_OK;
+}
+
+SWINLINE static swHashMap_int_slot* swHashMap_int_find_slot(swHashMap_int_table *t, uint64_t key)
+{
+	uint32_t i;
+	if (t == NULL)
+	{
+		return NULL;
 	}
+	for (i = swHashMap_int_home(t, key); t->slots[i].data != NULL; i = (i + 1) & (t->size - 1))
+	{
+		if (t->slots[i].key == key)
+		{
+			return &t->slots[i];
+		}
+	}
+	return NULL;
+}
+
+void swHashMap_add_int(swHashMap_int *root, uint64_t key, void *data)
+{
+	swHashMap_int_table *t = *root;
+	swHashMap_int_slot *slot;
+	uint32_t i;
+
+	if (data == NULL)
+	{
+		swHashMap_del_int(root, key);
+		return;
+	}
+	if ((slot = swHashMap_int_find_slot(t, key)) != NULL)
+	{
+		slot->data = data;
+		return;
+	}
+	//负载因子超过3/4时扩容
+	if (t == NULL || (t->num + 1) * 4 > t->size * 3)
+	{
+		if (swHashMap_int_resize(root, t ? t->bits + 1 : SW_HASHMAP_INT_INIT_BITS) < 0)
+		{
+			return;
+		}
+		t = *root;
+	}
+	for (i = swHashMap_int_home(t, key); t->slots[i].data != NULL; i = (i + 1) & (t->size - 1));
+	t->slots[i].key = key;
+	t->slots[i].data = data;
+	t->num++;
+}
+
+void* swHashMap_find_int(swHashMap_int *root, uint64_t key)
+{
+	swHashMap_int_slot *slot = swHashMap_int_find_slot(*root, key);
+	return slot ? slot->data : NULL;
+}
+
+void swHashMap_update_int(swHashMap_int *root, uint64_t key, void *data)
+{
+	swHashMap_int_slot *slot = swHashMap_int_find_slot(*root, key);
+	if (slot == NULL)
+	{
+		return;
+	}
+	if (data == NULL)
+	{
+		swHashMap_del_int(root, key);
+		return;
+	}
+	slot->data = data;
+}
+
+/**
+ * 后面同一个探测序列上的元素往前移, 填补删除留下的空位
+ */
+void swHashMap_del_int(swHashMap_int *root, uint64_t key)
+{
+	swHashMap_int_table *t = *root;
+	swHashMap_int_slot *slot = swHashMap_int_find_slot(t, key);
+	uint32_t i, j, home, mask;
+
+	if (slot == NULL)
+	{
+		return;
+	}
+	mask = t->size - 1;
+	i = slot - t->slots;
+	for (j = (i + 1) & mask; t->slots[j].data != NULL; j = (j + 1) & mask)
+	{
+		home = swHashMap_int_home(t, t->slots[j].key);
+		//home不在(i, j]之间才能移到i
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			t->slots[i] = t->slots[j];
+			i = j;
+		}
+	}
+	t->slots[i].data = NULL;
+	t->num--;
+}
+
+/**
+ * head为NULL时从头开始, 返回下一个元素的位置, 没有更多元素时返回NULL
+ */
+void* swHashMap_foreach_int(swHashMap_int *root, uint64_t *key, void **data, void *head)
+{
+	swHashMap_int_table *t = *root;
+	swHashMap_int_slot *slot = head, *end;
+
 	*data = NULL;
-	HASH_ITER(hh, head, find, tmp)
+	if (t == NULL)
 	{
-		*key = find->key_int;
-		*data = find->data;
-		break;
+		return NULL;
 	}
-	return tmp;
+	end = t->slots + t->size;
+	for (slot = slot ? slot : t->slots; slot < end && slot->data == NULL; slot++);
+	if (slot == end)
+	{
+		return NULL;
+	}
+	*key = slot->key;
+	*data = slot->data;
+	for (slot++; slot < end && slot->data == NULL; slot++);
+	return slot == end ? NULL : slot;
 }
 
-void swHashMap_destory(swHashMap_node** root)
+void swHashMap_free_int(swHashMap_int *root)
 {
-	swHashMap_node *find, *tmp = NULL;
-	HASH_ITER(hh, *root, find, tmp)
+	if (*root)
 	{
-		swHashMap_delete_node(*root, find);
-		sw_free(find);
+		sw_free(*root);
+		*root = NULL;
 	}
 }
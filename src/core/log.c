@@ -14,63 +14,303 @@
   +----------------------------------------------------------------------+
 */
 
+
 #include "swoole.h"
+#include <sys/uio.h>
 
-#define SW_LOG_BUFFER_SIZE 1024
 #define SW_LOG_DATE_STRLEN  64
-#define SW_LOG_FORMAT "[%s]\t%s\t%s\n"
+#define SW_LOG_LEVEL_NUM    5
+#define SW_LOG_IOV_MAX      256
+
+/**
+ * 每个线程写入自己的环形队列(单生产者), 日志线程把所有队列中的记录一次writev到文件
+ * 时间字符串每秒只格式化一次, 不在热路径上调用localtime
+ * 队列满了或者超过每秒的条数限制时直接丢弃, 下一秒记录丢弃的数量, 不会阻塞调用者
+ */
+typedef struct _swLog_rate
+{
+	atomic_t second;
+	atomic_t count;
+	atomic_t dropped;
+} swLog_rate;
+
+static int swoole_log_fd = STDOUT_FILENO;
+static int swoole_log_async = 0;
+
+static swRingBuffer *swLog_rings[SW_LOG_RING_NUM];
+static atomic_t swLog_ring_num = 0;
+static __thread swRingBuffer *swLog_ring = NULL;
+static __thread uint8_t swLog_ring_failed = 0;
+
+static pthread_t swLog_thread;
+static atomic_t swLog_thread_running = 0;
+static pthread_mutex_t swLog_drain_lock = PTHREAD_MUTEX_INITIALIZER;
 
-FILE *swoole_log_fn = NULL;
-static char bufr[SW_LOG_BUFFER_SIZE];
+static swSeqLock swLog_date_lock;
+static time_t swLog_date_time = 0;
+static char swLog_date[SW_LOG_DATE_STRLEN];
+
+static swLog_rate swLog_rates[SW_LOG_LEVEL_NUM];
+
+static const char *swLog_level_str[SW_LOG_LEVEL_NUM] = {
+	"DEBUG", "INFO", "WARN", "ERR", "TRACE"
+};
+
+static void swLog_write(int level, char *cnt);
+static void* swLog_loop(void *arg);
+static int swLog_drain(void);
+
+static void swLog_atfork_child(void)
+{
+	//其他线程和它们的队列在子进程中不存在了, 父进程的日志线程会写出这些记录
+	swLog_ring = NULL;
+	swLog_ring_failed = 0;
+	swLog_ring_num = 0;
+	swLog_thread_running = 0;
+	pthread_mutex_init(&swLog_drain_lock, NULL);
+}
 
 int swLog_init(char *logfile)
 {
-	swoole_log_fn = fopen(logfile, "a+");
-	if(swoole_log_fn == NULL)
+	static int atfork_registered = 0;
+
+	swoole_log_fd = open(logfile, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (swoole_log_fd < 0)
 	{
+		swoole_log_fd = STDOUT_FILENO;
 		return SW_ERR;
 	}
-	if (setvbuf(swoole_log_fn, bufr, _IOLBF, SW_LOG_BUFFER_SIZE) < 0)
+#ifdef SW_LOG_ASYNC
+	if (!atfork_registered)
 	{
-		return SW_ERR;
+		pthread_atfork(NULL, NULL, swLog_atfork_child);
+		atexit(swLog_flush);
+		atfork_registered = 1;
 	}
+	swoole_log_async = 1;
+#endif
 	return SW_OK;
 }
 
 void swLog_free(void)
 {
-	fclose(swoole_log_fn);
+	if (swoole_log_async)
+	{
+		if (swLog_thread_running)
+		{
+			swLog_thread_running = 0;
+			pthread_join(swLog_thread, NULL);
+		}
+		swLog_flush();
+		swoole_log_async = 0;
+	}
+	if (swoole_log_fd != STDOUT_FILENO)
+	{
+		close(swoole_log_fd);
+		swoole_log_fd = STDOUT_FILENO;
+	}
+}
+
+/**
+ * 同步写出所有队列中的日志, 进程退出前调用
+ */
+void swLog_flush(void)
+{
+	if (!swoole_log_async)
+	{
+		return;
+	}
+	pthread_mutex_lock(&swLog_drain_lock);
+	while (swLog_drain() > 0);
+	pthread_mutex_unlock(&swLog_drain_lock);
+}
+
+/**
+ * 时间精确到秒, 每秒由一个线程重新格式化, 其他线程通过顺序锁读取
+ */
+static void swLog_get_date(time_t now, char *date)
+{
+	struct tm tm;
+	char buf[SW_LOG_DATE_STRLEN];
+
+	if (now != swLog_date_time)
+	{
+		localtime_r(&now, &tm);
+		snprintf(buf, sizeof(buf), "%d-%02d-%02d %02d:%02d:%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+				tm.tm_hour, tm.tm_min, tm.tm_sec);
+		swSeqLock_write(&swLog_date_lock, swLog_date, buf, sizeof(buf));
+		swLog_date_time = now;
+	}
+	swSeqLock_read(&swLog_date_lock, date, swLog_date, SW_LOG_DATE_STRLEN);
+}
+
+/**
+ * 超过每秒的限制返回SW_TRUE, 新的一秒开始时报告上一秒丢弃的数量
+ */
+static int swLog_limited(int level, time_t now)
+{
+	swLog_rate *rate = &swLog_rates[level];
+	atomic_uint_t second = rate->second, dropped;
+	char buf[64];
+
+	if (second != now && sw_atomic_cmp_set(&rate->second, second, now))
+	{
+		rate->count = 0;
+		dropped = __sync_lock_test_and_set(&rate->dropped, 0);
+		if (dropped > 0)
+		{
+			snprintf(buf, sizeof(buf), "%lu log messages suppressed.", (unsigned long) dropped);
+			swLog_write(level, buf);
+		}
+	}
+	if (sw_atomic_fetch_add(&rate->count, 1) >= SW_LOG_RATE_LIMIT)
+	{
+		sw_atomic_fetch_add(&rate->dropped, 1);
+		return SW_TRUE;
+	}
+	return SW_FALSE;
+}
+
+static swRingBuffer* swLog_get_ring(void)
+{
+	atomic_uint_t index;
+
+	if (swLog_ring != NULL || swLog_ring_failed)
+	{
+		return swLog_ring;
+	}
+	index = sw_atomic_fetch_add(&swLog_ring_num, 1);
+	if (index >= SW_LOG_RING_NUM || (swLog_ring = swRingBuffer_create(SW_LOG_RING_SIZE, 0)) == NULL)
+	{
+		swLog_ring_failed = 1;
+		return NULL;
+	}
+	sw_atomic_memory_barrier();
+	swLog_rings[index] = swLog_ring;
+	return swLog_ring;
+}
+
+static void swLog_write_fd(char *buf, int n)
+{
+	while (write(swoole_log_fd, buf, n) < 0 && errno == EINTR);
+}
+
+void swLog_write_direct(char *buf, int n)
+{
+	swLog_write_fd(buf, n);
+}
+
+static void swLog_write(int level, char *cnt)
+{
+	char date[SW_LOG_DATE_STRLEN];
+	char buf[SW_ERROR_MSG_SIZE + SW_LOG_DATE_STRLEN + 16];
+	swRingBuffer *ring;
+	int n;
+
+	swLog_get_date(time(NULL), date);
+	n = snprintf(buf, sizeof(buf), "[%s]\t%s\t%s\n", date, swLog_level_str[level], cnt);
+	if (n >= sizeof(buf))
+	{
+		n = sizeof(buf) - 1;
+		buf[n - 1] = '\n';
+	}
+	if (!swoole_log_async)
+	{
+		swLog_write_fd(buf, n);
+		return;
+	}
+	//日志线程在fork后的子进程中不存在, 需要重新创建
+	if (swLog_thread_running == 0 && sw_atomic_cmp_set(&swLog_thread_running, 0, 1))
+	{
+		if (pthread_create(&swLog_thread, NULL, swLog_loop, NULL) < 0)
+		{
+			swoole_log_async = 0;
+		}
+	}
+	ring = swLog_get_ring();
+	if (ring == NULL)
+	{
+		swLog_write_fd(buf, n);
+	}
+	else if (swRingBuffer_push(ring, buf, n) < 0)
+	{
+		sw_atomic_fetch_add(&swLog_rates[level].dropped, 1);
+	}
 }
 
 void swLog_put(int level, char *cnt)
 {
-	const char *level_str;
-	char date_str[SW_LOG_DATE_STRLEN];
-
-	switch (level)
-	{
-	case SW_LOG_DEBUG:
-		level_str = "DEBUG";
-		break;
-	case SW_LOG_ERROR:
-		level_str = "ERR";
-		break;
-	case SW_LOG_WARN:
-		level_str = "WARN";
-		break;
-	case SW_LOG_TRACE:
-		level_str = "TRACE";
-		break;
-	default:
-		level_str = "INFO";
-		break;
-	}
-
-	time_t t;
-	struct tm *p;
-	t = time(NULL);
-	p = localtime(&t);
-	snprintf(date_str, SW_LOG_DATE_STRLEN, "%d-%02d-%02d %02d:%02d:%02d", p->tm_year + 1900, p->tm_mon+1, p->tm_mday , p->tm_hour, p->tm_min, p->tm_sec);
-	fprintf(swoole_log_fn, SW_LOG_FORMAT, date_str, level_str, cnt);
+	if (level < 0 || level >= SW_LOG_LEVEL_NUM)
+	{
+		level = SW_LOG_INFO;
+	}
+	//swError之后进程会退出, 不限制
+	if (SW_LOG_RATE_LIMIT > 0 && level != SW_LOG_ERROR && swLog_limited(level, time(NULL)))
+	{
+		return;
+	}
+	swLog_write(level, cnt);
+	if (level == SW_LOG_ERROR)
+	{
+		swLog_flush();
+	}
 }
 
+/**
+ * 返回写出的记录数量, 需要持有swLog_drain_lock
+ */
+static int swLog_drain(void)
+{
+	struct iovec iov[SW_LOG_IOV_MAX];
+	swRingBuffer *rings[SW_LOG_RING_NUM];
+	uint32_t cursors[SW_LOG_RING_NUM];
+	int i, num = 0, iovcnt = 0, length;
+	int ring_num = swLog_ring_num < SW_LOG_RING_NUM ? swLog_ring_num : SW_LOG_RING_NUM;
+	void *data;
+
+	for (i = 0; i < ring_num && iovcnt < SW_LOG_IOV_MAX; i++)
+	{
+		if (swLog_rings[i] == NULL)
+		{
+			continue;
+		}
+		rings[num] = swLog_rings[i];
+		cursors[num] = rings[num]->head;
+		while (iovcnt < SW_LOG_IOV_MAX && (data = swRingBuffer_peek(rings[num], &cursors[num], &length)) != NULL)
+		{
+			iov[iovcnt].iov_base = data;
+			iov[iovcnt].iov_len = length;
+			iovcnt++;
+		}
+		num++;
+	}
+	if (iovcnt == 0)
+	{
+		return 0;
+	}
+	while (writev(swoole_log_fd, iov, iovcnt) < 0 && errno == EINTR);
+	//写完之后才能释放队列空间
+	for (i = 0; i < num; i++)
+	{
+		swRingBuffer_release(rings[i], cursors[i]);
+	}
+	return iovcnt;
+}
+
+static void* swLog_loop(void *arg)
+{
+	int n;
+
+	swSignal_none();
+	while (swLog_thread_running)
+	{
+		pthread_mutex_lock(&swLog_drain_lock);
+		n = swLog_drain();
+		pthread_mutex_unlock(&swLog_drain_lock);
+		if (n < SW_LOG_IOV_MAX)
+		{
+			usleep(SW_LOG_FLUSH_INTERVAL * 1000);
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,120 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+
+#define SW_SHA1_ROL(v, n)  (((v) << (n)) | ((v) >> (32 - (n))))
+
+static void swoole_sha1_block(uint32_t *h, const unsigned char *block)
+{
+	uint32_t w[80];
+	uint32_t a, b, c, d, e, f, k, tmp;
+	int i;
+
+	for (i = 0; i < 16; i++)
+	{
+		w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16)
+				| ((uint32_t) block[i * 4 + 2] << 8) | (uint32_t) block[i * 4 + 3];
+	}
+	for (i = 16; i < 80; i++)
+	{
+		w[i] = SW_SHA1_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+
+	a = h[0];
+	b = h[1];
+	c = h[2];
+	d = h[3];
+	e = h[4];
+
+	for (i = 0; i < 80; i++)
+	{
+		if (i < 20)
+		{
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		}
+		else if (i < 40)
+		{
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		}
+		else if (i < 60)
+		{
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		}
+		else
+		{
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		tmp = SW_SHA1_ROL(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = SW_SHA1_ROL(b, 30);
+		b = a;
+		a = tmp;
+	}
+
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+}
+
+/**
+ * digest为20字节
+ */
+void swoole_sha1(const char *str, int len, unsigned char *digest)
+{
+	uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	unsigned char block[64];
+	uint64_t bits = (uint64_t) len * 8;
+	int i, n = len;
+
+	while (n >= 64)
+	{
+		swoole_sha1_block(h, (const unsigned char *) str);
+		str += 64;
+		n -= 64;
+	}
+
+	//补齐: 0x80, 0..., 64位长度
+	memcpy(block, str, n);
+	block[n++] = 0x80;
+	if (n > 56)
+	{
+		memset(block + n, 0, 64 - n);
+		swoole_sha1_block(h, block);
+		n = 0;
+	}
+	memset(block + n, 0, 56 - n);
+	for (i = 0; i < 8; i++)
+	{
+		block[56 + i] = (unsigned char) (bits >> (56 - i * 8));
+	}
+	swoole_sha1_block(h, block);
+
+	for (i = 0; i < 5; i++)
+	{
+		digest[i * 4] = (unsigned char) (h[i] >> 24);
+		digest[i * 4 + 1] = (unsigned char) (h[i] >> 16);
+		digest[i * 4 + 2] = (unsigned char) (h[i] >> 8);
+		digest[i * 4 + 3] = (unsigned char) h[i];
+	}
+}
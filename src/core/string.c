@@ -16,6 +16,10 @@
 
 #include "swoole.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 swString *swString_new(size_t size)
 {
 	swString *str = sw_malloc(sizeof(swString));
@@ -63,12 +67,14 @@ int swString_extend(swString *str, size_t new_size)
 		swWarn("new_size <= size. extend failed.");
 		return SW_ERR;
 	}
-	str->str = sw_realloc(str->str, new_size);
-	if (str->str == NULL)
+	char *new_str = sw_realloc(str->str, new_size);
+	if (new_str == NULL)
 	{
 		swWarn("realloc failed.");
 		return SW_ERR;
 	}
+	str->str = new_str;
+	str->size = new_size;
 	return SW_OK;
 }
 
@@ -153,3 +159,60 @@ size_t swoole_utf8_length(u_char *p, size_t n)
 	return len;
 }
 
+
+/**
+ * 在haystack中查找needle, 返回偏移量, 未找到返回-1
+ * SSE2下同时比较needle的首字节和尾字节, 一次筛选16个位置, 命中后再memcmp校验
+ */
+int swoole_strnpos(char *haystack, uint32_t haystack_length, char *needle, uint32_t needle_length)
+{
+	uint32_t i = 0;
+	char *p;
+
+	if (needle_length == 0 || needle_length > haystack_length)
+	{
+		return -1;
+	}
+#ifdef __SSE2__
+	if (needle_length > 1)
+	{
+		__m128i first = _mm_set1_epi8(needle[0]);
+		__m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+		__m128i block_first, block_last;
+		uint32_t mask;
+		int bit;
+
+		for (; i + needle_length - 1 + 16 <= haystack_length; i += 16)
+		{
+			block_first = _mm_loadu_si128((__m128i *) (haystack + i));
+			block_last = _mm_loadu_si128((__m128i *) (haystack + i + needle_length - 1));
+			mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+			while (mask != 0)
+			{
+				bit = __builtin_ctz(mask);
+				if (memcmp(haystack + i + bit + 1, needle + 1, needle_length - 2) == 0)
+				{
+					return i + bit;
+				}
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+	//剩余部分, memchr查找首字节
+	while (i + needle_length <= haystack_length)
+	{
+		p = memchr(haystack + i, needle[0], haystack_length - needle_length + 1 - i);
+		if (p == NULL)
+		{
+			return -1;
+		}
+		i = p - haystack;
+		if (memcmp(p + 1, needle + 1, needle_length - 1) == 0)
+		{
+			return i;
+		}
+		i++;
+	}
+	return -1;
+}
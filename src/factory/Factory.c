@@ -60,6 +60,12 @@ int swFactory_notify(swFactory *factory, swEvent *req)
 	case SW_EVENT_CONNECT:
 		serv->onConnect(serv, req->fd, req->from_id);
 		break;
+	case SW_EVENT_BUFFER_FULL:
+		serv->onBufferFull(serv, req->fd, req->from_id);
+		break;
+	case SW_EVENT_BUFFER_EMPTY:
+		serv->onBufferEmpty(serv, req->fd, req->from_id);
+		break;
 	default:
 		swWarn("Error event[type=%d]", (int)req->type);
 		break;
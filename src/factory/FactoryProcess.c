@@ -16,10 +16,12 @@
 
 #include "swoole.h"
 #include "Server.h"
+#include "coroutine.h"
 #include <signal.h>
 #include <sys/wait.h>
 
 static int swFactoryProcess_manager_loop(swFactory *factory);
+static void swFactoryProcess_manager_rolling_reload(swFactory *factory);
 static int swFactoryProcess_manager_start(swFactory *factory);
 
 static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti);
@@ -35,16 +37,58 @@ static int swFactoryProcess_writer_loop_queue(swThreadParam *param);
 static int swFactoryProcess_writer_loop_unsock(swThreadParam *param);
 #endif
 static int swFactoryProcess_worker_receive(swReactor *reactor, swEvent *event);
+#if SW_WORKER_IPC_MODE == 3
+static int swFactoryProcess_rings_create(swFactory *factory);
+static int swFactoryProcess_worker_receive_ring(swReactor *reactor, swEvent *event);
+#endif
 #endif
 
 static int swFactoryProcess_notify(swFactory *factory, swEvent *event);
 static int swFactoryProcess_dispatch(swFactory *factory, swEventData *buf);
 static int swFactoryProcess_finish(swFactory *factory, swSendData *data);
+static int swFactoryProcess_worker_task(swFactory *factory, swEventData *task);
+static int swFactoryProcess_worker_onTask(swFactory *factory, swEventData *task);
+static void swFactoryProcess_coroutine_main(void *arg);
+static int swFactoryProcess_least_loaded(swFactoryProcess *object, int offset, int worker_num);
+static int swFactoryProcess_key_worker(swServer *serv, swEventData *data, int worker_num);
+static int swFactoryProcess_skip_excluded(swFactoryProcess *object, swWorkerGroup *group, int pti);
+static swWorkerGroup* swFactoryProcess_get_group(swServer *serv, swEventData *data);
+
+/**
+ * 在协程中执行的onReceive, 复制了请求数据, 协程挂起后worker继续处理下一个请求
+ */
+typedef struct
+{
+	swFactory *factory;
+	swString *package;  //挂起时从SwooleWG.buffer_input取走的大包
+	uint8_t done;
+	uint8_t detached;   //第一次yield后由协程自己释放
+	swEventData task;
+} swFactoryProcess_coroutine;
+
+#if SW_WORKER_IPC_MODE != 2
+/**
+ * 等待SW_EVENT_DIRECT回复期间从管道读到的其他消息
+ */
+typedef struct _swFactoryProcess_stash
+{
+	struct _swFactoryProcess_stash *next;
+	swEventData task;
+} swFactoryProcess_stash;
+
+static swFactoryProcess_stash *worker_stash_head = NULL;
+static swFactoryProcess_stash *worker_stash_tail = NULL;
+
+static void swFactoryProcess_direct_replay(swFactory *factory);
+static void swFactoryProcess_worker_onFinish(swReactor *reactor);
+static void swFactoryProcess_direct_reset(swFactory *factory, int worker_id);
+#endif
 
 static int worker_task_num = 0;
 static int worker_task_always = 0;
 static int manager_worker_reloading = 0;
 static int manager_reload_flag = 0;
+static int manager_stats_dump = 0;
 
 int swFactoryProcess_create(swFactory *factory, int writer_num, int worker_num)
 {
@@ -116,6 +160,7 @@ int swFactoryProcess_start(swFactory *factory)
 
 	swServer *serv = factory->ptr;
 	swFactoryProcess *object = factory->object;
+	int i, use_inflight;
 	object->workers_status = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(char)*serv->worker_num);
 
 	//worler idle or busy
@@ -124,6 +169,38 @@ int swFactoryProcess_start(swFactory *factory)
 		swWarn("alloc for worker_status fail");
 		return SW_ERR;
 	}
+	for (i = 0; i < serv->worker_group_num; i++)
+	{
+		if (serv->worker_groups[i].dispatch_mode == SW_DISPATCH_LEAST)
+		{
+			break;
+		}
+	}
+	use_inflight = (i < serv->worker_group_num);
+#if SW_WORKER_IPC_MODE != 2
+	//reload时根据未处理完的请求数排空, 消息队列模式下请求留在队列中由新worker处理
+	use_inflight = use_inflight || serv->reload_batch > 0;
+#endif
+	if (use_inflight)
+	{
+		object->workers_inflight = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(atomic_t) * serv->worker_num);
+		if (object->workers_inflight == NULL)
+		{
+			swWarn("alloc for workers_inflight fail");
+			return SW_ERR;
+		}
+		bzero((void *) object->workers_inflight, sizeof(atomic_t) * serv->worker_num);
+	}
+	if (serv->reload_batch > 0)
+	{
+		object->workers_excluded = SwooleG.memory_pool->alloc(SwooleG.memory_pool, serv->worker_num);
+		if (object->workers_excluded == NULL)
+		{
+			swWarn("alloc for workers_excluded fail");
+			return SW_ERR;
+		}
+		bzero((void *) object->workers_excluded, serv->worker_num);
+	}
 
 	//必须先启动manager进程组，否则会带线程fork
 	if (swFactoryProcess_manager_start(factory) < 0)
@@ -153,30 +230,203 @@ int swFactoryProcess_start(swFactory *factory)
 	return SW_OK;
 }
 
+/**
+ * 拆开合并投递的数据包, 逐个处理
+ */
+static int swFactoryProcess_worker_batch(swFactory *factory, swEventData *batch)
+{
+	swEventData task;
+	uint32_t offset = 0;
+
+	//UDP回复在处理完所有记录后用sendmmsg一次发出
+	swServer_udp_queue_start(factory->ptr);
+
+	while (offset + sizeof(swDataHead) <= batch->info.len)
+	{
+		memcpy(&task.info, batch->data + offset, sizeof(swDataHead));
+		offset += sizeof(swDataHead);
+		if (offset + task.info.len > batch->info.len)
+		{
+			swWarn("[Worker] package batch is broken.");
+			swServer_udp_queue_end(factory->ptr);
+			return SW_ERR;
+		}
+		memcpy(task.data, batch->data + offset, task.info.len);
+		offset += task.info.len;
+		swFactoryProcess_worker_task(factory, &task);
+	}
+	swServer_udp_queue_end(factory->ptr);
+	return SW_OK;
+}
+
 int swFactoryProcess_worker_excute(swFactory *factory, swEventData *task)
 {
-	swServer *serv = factory->ptr;
 	swFactoryProcess *object = factory->object;
-	swString *package;
+	swServer *serv = factory->ptr;
+	uint64_t start = swClock_usec(), usec;
 
-	factory->last_from_id = task->info.from_id;
+	//等待超时后才到达的写权限回复, 不是reactor线程投递的请求
+	if (task->info.type == SW_EVENT_DIRECT)
+	{
+		return SW_OK;
+	}
 
 	//worker busy
 	object->workers_status[SwooleWG.id] = SW_WORKER_BUSY;
 
+	if (task->info.time != 0)
+	{
+		if (serv->overload_target_usec > 0)
+		{
+			swServer_overload_record(serv, (uint32_t) start, (uint32_t) start - task->info.time);
+		}
+		//采样的请求, 处理过程中发出的响应带上投递时间
+		if ((task->info.time & 1) && serv->worker_latency != NULL)
+		{
+			swHistogram_record(&serv->worker_latency[SwooleWG.id].queue, (uint32_t) start - task->info.time);
+			SwooleWG.latency_time = task->info.time;
+		}
+	}
+
+	swFactoryProcess_worker_task(factory, task);
+
+	//worker idle
+	object->workers_status[SwooleWG.id] = SW_WORKER_IDLE;
+
+	usec = swClock_usec() - start;
+	if (SwooleWG.latency_time != 0)
+	{
+		swHistogram_record(&serv->worker_latency[SwooleWG.id].handler, (uint32_t) usec);
+		SwooleWG.latency_time = 0;
+	}
+
+	//只有本进程写入, 不需要原子操作
+	serv->worker_stats[SwooleWG.id].request_count++;
+	serv->worker_stats[SwooleWG.id].busy_usec += usec;
+
+	//合并投递的消息只计数一次
+	if (object->workers_inflight != NULL)
+	{
+		sw_atomic_fetch_sub(&object->workers_inflight[SwooleWG.id], 1);
+	}
+
+	//stop
+	if(worker_task_num < 0)
+	{
+		SwooleG.running = 0;
+	}
+	return SW_OK;
+}
+
+/**
+ * recv_ring中的包处理完成, reactor线程可以复用这块内存
+ */
+static void swFactoryProcess_view_release(swServer *serv, swEventData *task)
+{
+	if (task->info.type == SW_EVENT_PACKAGE_VIEW)
+	{
+		swRecvRing_release(serv->recv_rings[task->info.from_id], ((swPackage_view *) task->data)->offset);
+	}
+}
+
+static void swFactoryProcess_coroutine_main(void *arg)
+{
+	swFactoryProcess_coroutine *coro = arg;
+
+	coro->factory->onTask(coro->factory, &coro->task);
+	coro->done = 1;
+	if (coro->detached)
+	{
+		if (coro->package != NULL)
+		{
+			swString_free(coro->package);
+		}
+		swFactoryProcess_view_release(coro->factory->ptr, &coro->task);
+		sw_free(coro);
+	}
+}
+
+static int swFactoryProcess_worker_onTask(swFactory *factory, swEventData *task)
+{
+	swServer *serv = factory->ptr;
+	swFactoryProcess_coroutine *coro;
+	swString *package;
+	int ret;
+
+	if (!serv->enable_coroutine)
+	{
+		goto direct;
+	}
+	coro = sw_malloc(offsetof(swFactoryProcess_coroutine, task.data) + task->info.len);
+	if (coro == NULL)
+	{
+		goto direct;
+	}
+	coro->factory = factory;
+	coro->package = NULL;
+	coro->done = 0;
+	coro->detached = 0;
+	memcpy(&coro->task, task, sizeof(swDataHead) + task->info.len);
+
+	//超过max_coroutine时在当前上下文中执行
+	if (swCoroutine_create(swFactoryProcess_coroutine_main, coro) < 0)
+	{
+		sw_free(coro);
+		goto direct;
+	}
+	if (coro->done)
+	{
+		sw_free(coro);
+		swFactoryProcess_view_release(serv, task);
+		return SW_OK;
+	}
+	coro->detached = 1;
+	//协程还在使用合并的大包, 下一个大包换一个buffer
+	if (task->info.type == SW_EVENT_PACKAGE_END && (package = swString_new(SW_BUFFER_INPUT_INIT_SIZE)) != NULL)
+	{
+		coro->package = SwooleWG.buffer_input[task->info.from_id];
+		SwooleWG.buffer_input[task->info.from_id] = package;
+	}
+	return SW_OK;
+
+	direct:
+	ret = factory->onTask(factory, task);
+	swFactoryProcess_view_release(serv, task);
+	return ret;
+}
+
+static int swFactoryProcess_worker_task(swFactory *factory, swEventData *task)
+{
+	swServer *serv = factory->ptr;
+	swString *package;
+	uint32_t new_size;
+
+	factory->last_from_id = task->info.from_id;
+
 	switch(task->info.type)
 	{
 	//no buffer
 	case SW_EVENT_TCP:
 	case SW_EVENT_UDP:
+	case SW_EVENT_PACKAGE_VIEW:
 		//处理任务
 		onTask:
-		factory->onTask(factory, task);
+		swFactoryProcess_worker_onTask(factory, task);
 		//只有数据请求任务才计算task_num
 		if(!worker_task_always)
 		{
 			worker_task_num--;
 		}
+		//大包处理完成, 释放扩容的buffer
+		if (task->info.type == SW_EVENT_PACKAGE_END && SwooleWG.buffer_input[task->info.from_id]->size > SW_BUFFER_INPUT_SHRINK_SIZE)
+		{
+			package = swString_new(SW_BUFFER_INPUT_INIT_SIZE);
+			if (package != NULL)
+			{
+				swString_free(SwooleWG.buffer_input[task->info.from_id]);
+				SwooleWG.buffer_input[task->info.from_id] = package;
+			}
+		}
 		break;
 
 	//buffer
@@ -189,6 +439,20 @@ int swFactoryProcess_worker_excute(swFactory *factory, swEventData *task)
 		{
 			package->length = 0;
 		}
+		//buffer不够时按2倍扩容, 最大为buffer_input_size
+		if (package->length + task->info.len > package->size)
+		{
+			new_size = package->size * 2 > serv->buffer_input_size ? serv->buffer_input_size : package->size * 2;
+			if (new_size < package->length + task->info.len)
+			{
+				new_size = package->length + task->info.len;
+			}
+			if (swString_extend(package, new_size) < 0)
+			{
+				swWarn("extend package buffer to %d failed.", new_size);
+				break;
+			}
+		}
 		//合并数据到package buffer中
 		memcpy(package->str + package->length, task->data, task->info.len);
 		package->length += task->info.len;
@@ -200,28 +464,31 @@ int swFactoryProcess_worker_excute(swFactory *factory, swEventData *task)
 		}
 		break;
 
+	case SW_EVENT_PACKAGE_BATCH:
+		return swFactoryProcess_worker_batch(factory, task);
+
 	case SW_EVENT_CLOSE:
 		serv->onClose(serv, task->info.fd, task->info.from_id);
 		break;
 	case SW_EVENT_CONNECT:
 		serv->onConnect(serv, task->info.fd, task->info.from_id);
 		break;
+	case SW_EVENT_BUFFER_FULL:
+		serv->onBufferFull(serv, task->info.fd, task->info.from_id);
+		break;
+	case SW_EVENT_BUFFER_EMPTY:
+		serv->onBufferEmpty(serv, task->info.fd, task->info.from_id);
+		break;
 	case SW_EVENT_FINISH:
-		serv->onFinish(serv, task);
+		swTaskWorker_onResult(serv, task);
+		break;
+	case SW_EVENT_FINISH_BATCH:
+		swTaskWorker_onFinish_batch(serv, task);
 		break;
 	default:
 		swWarn("[Worker] error event[type=%d]", (int)task->info.type);
 		break;
 	}
-
-	//worker idle
-	object->workers_status[SwooleWG.id] = SW_WORKER_IDLE;
-
-	//stop
-	if(worker_task_num < 0)
-	{
-		SwooleG.running = 0;
-	}
 	return SW_OK;
 }
 
@@ -272,6 +539,12 @@ static int swFactoryProcess_manager_start(swFactory *factory)
 		object->workers[i].pipe_master = object->pipes[i].getFd(&object->pipes[i], 1);
 		object->workers[i].pipe_worker = object->pipes[i].getFd(&object->pipes[i], 0);
 	}
+#if SW_WORKER_IPC_MODE == 3
+	if (swFactoryProcess_rings_create(factory) < 0)
+	{
+		return SW_ERR;
+	}
+#endif
 #endif
 	if (serv->task_worker_num > 0)
 	{
@@ -283,9 +556,10 @@ static int swFactoryProcess_manager_start(swFactory *factory)
 		//设置指针和回调函数
 		SwooleG.task_workers.ptr = serv;
 		SwooleG.task_workers.onTask = swTaskWorker_onTask;
-		if (serv->onWorkerStart != NULL)
+		SwooleG.task_workers.onWorkerStart = swTaskWorker_onWorkerStart;
+		if (swProcessPool_set_dispatch_mode(&SwooleG.task_workers, serv->task_dispatch_mode) < 0)
 		{
-			SwooleG.task_workers.onWorkerStart = swTaskWorker_onWorkerStart;
+			return SW_ERR;
 		}
 	}
 	pid = fork();
@@ -342,11 +616,103 @@ static void swManagerSignalHanlde(int sig)
 			manager_reload_flag = 0;
 		}
 		break;
+	case SIGALRM:
+		manager_stats_dump = 1;
+		break;
 	default:
 		break;
 	}
 }
 
+/**
+ * 平滑reload, 每次替换reload_batch个worker
+ * 先停止向它们分配新请求, 处理完已投递的请求后再kill, 新worker预热完成后才重新加入分配
+ */
+static void swFactoryProcess_manager_rolling_reload(swFactory *factory)
+{
+	swFactoryProcess *object = factory->object;
+	swServer *serv = factory->ptr;
+	int i, j, end, status;
+	uint64_t deadline;
+	pid_t new_pid;
+
+	for (i = 0; i < object->worker_num && SwooleG.running > 0; i = end)
+	{
+		end = i + serv->reload_batch;
+		if (end > object->worker_num)
+		{
+			end = object->worker_num;
+		}
+		for (j = i; j < end; j++)
+		{
+			object->workers_excluded[j] = 1;
+		}
+		sw_atomic_memory_barrier();
+
+		//排空: 已投递的请求处理完或者超时
+		swClock_update();
+		deadline = swClock_msec() + serv->reload_drain_timeout;
+		for (j = i; object->workers_inflight != NULL && j < end;)
+		{
+			if (object->workers_inflight[j] == 0)
+			{
+				j++;
+				continue;
+			}
+			if (swClock_msec() >= deadline)
+			{
+				swWarn("[Manager]worker#%d still has %d requests after drain timeout.", j, (int ) object->workers_inflight[j]);
+				break;
+			}
+			usleep(1000);
+			swClock_update();
+		}
+
+		for (j = i; j < end; j++)
+		{
+			if (kill(object->workers[j].pid, SIGTERM) < 0)
+			{
+				swWarn("[Manager]kill failed, pid=%d. Error: %s [%d]", object->workers[j].pid, strerror(errno), errno);
+			}
+		}
+		for (j = i; j < end; j++)
+		{
+			while (waitpid(object->workers[j].pid, &status, 0) < 0 && errno == EINTR);
+#if SW_WORKER_IPC_MODE != 2
+			swFactoryProcess_direct_reset(factory, j);
+#endif
+			new_pid = swFactoryProcess_worker_spawn(factory, j);
+			if (new_pid < 0)
+			{
+				swWarn("Fork worker process failed. Error: %s [%d]", strerror(errno), errno);
+				object->workers_excluded[j] = 0;
+				continue;
+			}
+			object->workers[j].pid = new_pid;
+		}
+
+		//错开替换: 新worker预热完成后才替换下一批
+		swClock_update();
+		deadline = swClock_msec() + SW_RELOAD_WARMUP_TIMEOUT;
+		for (j = i; j < end;)
+		{
+			if (object->workers_excluded[j] == 0)
+			{
+				j++;
+				continue;
+			}
+			if (swClock_msec() >= deadline)
+			{
+				swWarn("[Manager]worker#%d warmup timeout.", j);
+				object->workers_excluded[j] = 0;
+				continue;
+			}
+			usleep(1000);
+			swClock_update();
+		}
+	}
+}
+
 static int swFactoryProcess_manager_loop(swFactory *factory)
 {
 	int pid, new_pid;
@@ -373,11 +739,23 @@ static int swFactoryProcess_manager_loop(swFactory *factory)
 
 	//for reload
 	swSignal_set(SIGUSR1, swManagerSignalHanlde, 1, 0);
+	//定时写入统计数据
+	if (serv->stats_file[0] != 0)
+	{
+		swSignal_set(SIGALRM, swManagerSignalHanlde, 1, 0);
+		alarm(SW_STATS_DUMP_INTERVAL);
+	}
 
 	while (SwooleG.running > 0)
 	{
 		pid = wait(&worker_exit_code);
 		swTrace("[manager] worker stop.pid=%d\n", pid);
+		if (pid < 0 && manager_stats_dump)
+		{
+			manager_stats_dump = 0;
+			swServer_stats_write(serv, serv->stats_file);
+			alarm(SW_STATS_DUMP_INTERVAL);
+		}
 		if (pid < 0)
 		{
 			if (manager_worker_reloading == 0)
@@ -386,6 +764,12 @@ static int swFactoryProcess_manager_loop(swFactory *factory)
 			}
 			else if (manager_reload_flag == 0)
 			{
+				if (serv->reload_batch > 0)
+				{
+					swFactoryProcess_manager_rolling_reload(factory);
+					manager_worker_reloading = 0;
+					continue;
+				}
 				memcpy(reload_workers, object->workers, sizeof(swWorker) * object->worker_num);
 				manager_reload_flag = 1;
 				goto kill_worker;
@@ -407,6 +791,9 @@ static int swFactoryProcess_manager_loop(swFactory *factory)
 						serv->onWorkerError(serv, i, pid, WEXITSTATUS(worker_exit_code));
 					}
 					pid = 0;
+#if SW_WORKER_IPC_MODE != 2
+					swFactoryProcess_direct_reset(factory, i);
+#endif
 					new_pid = swFactoryProcess_worker_spawn(factory, i);
 					if (new_pid < 0)
 					{
@@ -530,17 +917,30 @@ int swFactoryProcess_finish(swFactory *factory, swSendData *resp)
 	//copy
 	memcpy(sdata._send.data, resp->data, resp->info.len);
 
-	swConnection *conn = swServer_get_connection(serv, fd);
-	if(conn == NULL)
+	int reactor_id;
+	//广播直接投递到指定的reactor线程
+	if (resp->info.type == SW_EVENT_BROADCAST)
 	{
-		swWarn("connection[%d] not found.", fd);
-		return SW_ERR;
+		reactor_id = resp->info.from_id;
+	}
+	else
+	{
+		swConnection *conn = swServer_get_connection(serv, fd);
+		if(conn == NULL)
+		{
+			swWarn("connection[%d] not found.", fd);
+			return SW_ERR;
+		}
+		reactor_id = conn->from_id;
 	}
 
 	sdata._send.info.fd = fd;
 	sdata._send.info.type = resp->info.type;
 	sdata._send.info.len = resp->info.len;
-	sdata._send.info.from_id = conn->from_id;
+	sdata._send.info.from_id = reactor_id;
+	sdata._send.info.from_fd = (resp->info.type == SW_EVENT_BROADCAST || (resp->info.from_fd & SW_SEND_WEBSOCKET)) ?
+			resp->info.from_fd : 0;
+	sdata._send.info.time = (resp->info.type == SW_EVENT_BROADCAST) ? 0 : SwooleWG.latency_time;
 	sendn = resp->info.len + sizeof(resp->info);
 
 	//swWarn("send: type=%d|content=%s", resp->info.type, resp->data);
@@ -552,10 +952,10 @@ int swFactoryProcess_finish(swFactory *factory, swSendData *resp)
 		ret = object->wt_queue.in(&object->wt_queue, (swQueue_data *)&sdata, sendn);
 #else
 		int pipe_i;
-		swReactor *reactor = &(serv->reactor_threads[conn->from_id].reactor);
+		swReactor *reactor = &(serv->reactor_threads[reactor_id].reactor);
 		if (serv->reactor_pipe_num > 1)
 		{
-			pipe_i = fd % serv->reactor_pipe_num + reactor->id;
+			pipe_i = reactor->id * serv->reactor_pipe_num + fd % serv->reactor_pipe_num;
 		}
 		else
 		{
@@ -654,6 +1054,7 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 {
 	swFactoryProcess *object = factory->object;
 	swServer *serv = factory->ptr;
+	swWorkerGroup *group = swServer_get_worker_group(serv, worker_pti);
 	int i;
 #if SW_WORKER_IPC_MODE == 2
 	struct
@@ -666,18 +1067,7 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 	int pipe_rd = object->workers[worker_pti].pipe_worker;
 #endif
 
-#ifdef HAVE_CPU_AFFINITY
-	if (serv->open_cpu_affinity == 1)
-	{
-		cpu_set_t cpu_set;
-		CPU_ZERO(&cpu_set);
-		CPU_SET(worker_pti % SW_CPU_NUM, &cpu_set);
-		if (0 != sched_setaffinity(getpid(), sizeof(cpu_set), &cpu_set))
-		{
-			swWarn("pthread_setaffinity_np set failed");
-		}
-	}
-#endif
+	swServer_set_cpu_affinity(serv, 0, worker_pti);
 
 	//signal init
 	swFactoryProcess_worker_signal_init();
@@ -685,8 +1075,8 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 	//worker_id
 	SwooleWG.id = worker_pti;
 
-	//for open_check_eof and  open_check_length
-	if (serv->open_eof_check || serv->open_length_check)
+	//for open_check_eof, open_check_length, open_http_protocol and open_redis_protocol
+	if (serv->open_eof_check || serv->open_length_check || serv->open_http_protocol || serv->open_redis_protocol)
 	{
 		SwooleWG.buffer_input = sw_malloc(sizeof(swString*) * serv->reactor_num);
 		if (SwooleWG.buffer_input == NULL)
@@ -696,7 +1086,7 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 		}
 		for (i = 0; i < serv->reactor_num; i++)
 		{
-			SwooleWG.buffer_input[i] = swString_new(serv->buffer_input_size);
+			SwooleWG.buffer_input[i] = swString_new(SW_BUFFER_INPUT_INIT_SIZE);
 			if (SwooleWG.buffer_input[i] == NULL)
 			{
 				swError("buffer_input init failed.");
@@ -707,10 +1097,10 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 
 #if SW_WORKER_IPC_MODE == 2
 	//抢占式,使用相同的队列type
-	if (serv->dispatch_mode == SW_DISPATCH_QUEUE)
+	if (group->dispatch_mode == SW_DISPATCH_QUEUE)
 	{
-		//这里必须加1
-		rdata.pti = serv->worker_num + 1;
+		//这里必须加1, 每个分组使用不同的type
+		rdata.pti = serv->worker_num + 1 + (group - serv->worker_groups);
 	}
 	else
 	{
@@ -730,17 +1120,42 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 		return SW_ERR;
 	}
 	SwooleG.main_reactor->ptr = serv;
+	SwooleG.main_reactor->id = worker_pti;
+	SwooleG.main_reactor->slow_usec = serv->slow_callback_usec;
+	SwooleG.main_reactor->slow_count = serv->worker_stats ? &serv->worker_stats[SwooleWG.id].slow_count : NULL;
 	SwooleG.main_reactor->add(SwooleG.main_reactor, pipe_rd, SW_FD_PIPE);
 	SwooleG.main_reactor->setHandle(SwooleG.main_reactor, SW_FD_PIPE, swFactoryProcess_worker_receive);
+	SwooleG.main_reactor->onFinish = swFactoryProcess_worker_onFinish;
+#if SW_WORKER_IPC_MODE == 3
+	{
+		swPipe *notify = &object->rings_notify[worker_pti];
+		SwooleG.main_reactor->add(SwooleG.main_reactor, notify->getFd(notify, 0), SW_FD_RING);
+		SwooleG.main_reactor->setHandle(SwooleG.main_reactor, SW_FD_RING, swFactoryProcess_worker_receive_ring);
+	}
+#endif
+#endif
+	//同一个id的上一个进程可能在过载时退出
+	if (serv->worker_stats != NULL)
+	{
+		serv->worker_stats[SwooleWG.id].overload = 0;
+	}
+#if SW_WORKER_IPC_MODE == 2
+	swSlowlog_init(serv->slow_callback_usec, serv->onSlowlog, serv->worker_stats ? &serv->worker_stats[SwooleWG.id].slow_count : NULL);
+#else
+	//reactor已经计数, 这里只打印调用栈
+	swSlowlog_init(serv->slow_callback_usec, serv->onSlowlog, NULL);
 #endif
 
-	if(factory->max_request < 1)
+	//onWorkerStart是用户代码, 可能很慢, 不计入启动握手
+	swReady_done(serv->ready);
+
+	if(group->max_request < 1)
 	{
 		worker_task_always = 1;
 	}
 	else
 	{
-		worker_task_num = factory->max_request;
+		worker_task_num = group->max_request;
 		worker_task_num += swRandom(worker_pti);
 	}
 
@@ -749,6 +1164,15 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 		//worker进程启动时调用
 		serv->onWorkerStart(serv, worker_pti);
 	}
+	//预热完成后才重新加入分配
+	if (object->workers_excluded != NULL)
+	{
+		if (serv->onWorkerWarmup != NULL)
+		{
+			serv->onWorkerWarmup(serv, worker_pti);
+		}
+		object->workers_excluded[worker_pti] = 0;
+	}
 
 #if SW_WORKER_IPC_MODE == 2
 	//主线程
@@ -787,6 +1211,8 @@ static int swFactoryProcess_worker_loop(swFactory *factory, int worker_pti)
 		//worker进程结束时调用
 		serv->onWorkerStop(serv, worker_pti);
 	}
+	//进程退出后缓存的共享内存块不会再被使用
+	swMemoryGlobal_thread_flush();
 	swTrace("[Worker]max request");
 	return SW_OK;
 }
@@ -810,66 +1236,228 @@ int swFactoryProcess_notify(swFactory *factory, swDataHead *ev)
 	return swFactoryProcess_send2worker(factory, (swEventData *) &sw_notify_data._send, -1);
 }
 
+/**
+ * 随机取两个worker, 选择未处理请求较少的一个(power of two choices)
+ * 不需要扫描所有worker, worker数量很多时也是O(1). worker较少时直接扫描全部
+ */
+static int swFactoryProcess_least_loaded(swFactoryProcess *object, int offset, int worker_num)
+{
+	static __thread uint32_t seed = 0;
+	atomic_t *inflight = object->workers_inflight + offset;
+	uint32_t a, b, i;
+
+	if (seed == 0)
+	{
+		seed = (uint32_t) pthread_self() ^ (uint32_t) getpid() ^ (uint32_t) time(NULL);
+		seed = seed ? seed : 1;
+	}
+	//xorshift32
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	a = seed % worker_num;
+	if (worker_num <= SW_DISPATCH_LEAST_SCAN)
+	{
+		for (i = 1; i < worker_num && inflight[a] > 0; i++)
+		{
+			b = (a + i) % worker_num;
+			if (inflight[b] < inflight[a])
+			{
+				a = b;
+			}
+		}
+		return a;
+	}
+	b = (a + 1 + (seed >> 16) % (worker_num - 1)) % worker_num;
+	return inflight[a] <= inflight[b] ? a : b;
+}
+
+/**
+ * 按key的hash值选择worker, 没有key时按fd分配
+ */
+static int swFactoryProcess_key_worker(swServer *serv, swEventData *data, int worker_num)
+{
+	uint32_t key_length = 0, length = data->info.len;
+	char *key = NULL, *payload = data->data;
+	int pti;
+
+	switch (data->info.type)
+	{
+	//包在recv_ring中, reactor线程可以直接读取
+	case SW_EVENT_PACKAGE_VIEW:
+		payload = swPackage_view_data(data);
+		length = ((swPackage_view *) data->data)->length;
+		//no break
+	case SW_EVENT_TCP:
+	case SW_EVENT_UDP:
+	case SW_EVENT_PACKAGE_START:
+		if (serv->dispatch_key != NULL)
+		{
+			key_length = serv->dispatch_key(serv, payload, length, &key);
+		}
+		else if (serv->dispatch_key_length > 0 && length >= serv->dispatch_key_offset + serv->dispatch_key_length)
+		{
+			key = payload + serv->dispatch_key_offset;
+			key_length = serv->dispatch_key_length;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (key_length > 0)
+	{
+		pti = swoole_jump_hash(swoole_hash_fnv1a(key, key_length), worker_num);
+	}
+	else if (data->info.type == SW_EVENT_UDP)
+	{
+		pti = ((uint16_t) data->info.from_id) % worker_num;
+	}
+	else
+	{
+		pti = data->info.fd % worker_num;
+	}
+	return pti;
+}
+
+/**
+ * 跳过reload中的worker, 分组内所有worker都在reload中时仍然投递给原来的worker
+ */
+static int swFactoryProcess_skip_excluded(swFactoryProcess *object, swWorkerGroup *group, int pti)
+{
+	int i, n;
+
+	//消息队列抢占模式下pti不是worker的编号
+	if (pti - group->offset >= group->worker_num || object->workers_excluded[pti] == 0)
+	{
+		return pti;
+	}
+	for (i = 1; i < group->worker_num; i++)
+	{
+		n = group->offset + (pti - group->offset + i) % group->worker_num;
+		if (object->workers_excluded[n] == 0)
+		{
+			return n;
+		}
+	}
+	return pti;
+}
+
+/**
+ * TCP连接在accept时继承监听端口的分组, UDP按接收数据的socket查找
+ */
+static swWorkerGroup* swFactoryProcess_get_group(swServer *serv, swEventData *data)
+{
+	int fd;
+	if (serv->worker_group_num == 1)
+	{
+		return &serv->worker_groups[0];
+	}
+	fd = (data->info.type == SW_EVENT_UDP) ? data->info.from_fd : data->info.fd;
+	return &serv->worker_groups[serv->connection_info[fd].worker_group];
+}
+
 /**
  * 主进程向worker进程发送数据
  * @param worker_id 发到指定的worker进程
  */
 int swFactoryProcess_send2worker(swFactory *factory, swEventData *data, int worker_id)
 {
+	static __thread int package_worker = 0;
 	swFactoryProcess *object = factory->object;
 	swServer *serv = factory->ptr;
 	int pti = 0;
 	int ret;
 	int send_len = sizeof(data->info) + data->info.len;
 
+	//大数据包的后续分片与第一个分片投递到同一个worker, 同一个线程内分片是连续投递的
+	if (worker_id < 0 && (data->info.type == SW_EVENT_PACKAGE_TRUNK || data->info.type == SW_EVENT_PACKAGE_END))
+	{
+		worker_id = package_worker;
+	}
 	if (worker_id < 0)
 	{
+		//按监听端口选择worker分组, 在分组内分配
+		swWorkerGroup *group = swFactoryProcess_get_group(serv, data);
+		int worker_num = group->worker_num;
+
 		//轮询
-		if (serv->dispatch_mode == SW_DISPATCH_ROUND)
+		if (group->dispatch_mode == SW_DISPATCH_ROUND)
 		{
-			pti = (object->worker_pti++) % object->worker_num;
+			pti = (group->worker_pti++) % worker_num;
 		}
 		//使用fd取摸来散列
-		else if (serv->dispatch_mode == SW_DISPATCH_FDMOD)
+		else if (group->dispatch_mode == SW_DISPATCH_FDMOD)
 		{
 			//Fixed #48. 替换一下顺序
 			//udp use remote port
 			if (data->info.type == SW_EVENT_UDP)
 			{
-				pti = ((uint16_t) data->info.from_id) % object->worker_num;
+				pti = ((uint16_t) data->info.from_id) % worker_num;
 			}
 			else
 			{
-				pti = data->info.fd % object->worker_num;
+				pti = data->info.fd % worker_num;
 			}
 		}
+		else if (group->dispatch_mode == SW_DISPATCH_LEAST)
+		{
+			pti = swFactoryProcess_least_loaded(object, group->offset, worker_num);
+		}
+		else if (group->dispatch_mode == SW_DISPATCH_KEY)
+		{
+			pti = swFactoryProcess_key_worker(serv, data, worker_num);
+		}
 		//使用抢占式队列(IPC消息队列)分配
 		else
 		{
 #if SW_WORKER_IPC_MODE == 2
 			//msgsnd参数必须>0
-			//worker进程中正确的mtype应该是pti + 1
-			pti = object->worker_num;
+			//worker进程中正确的mtype应该是pti + 1, 每个分组一个type
+			pti = object->worker_num + (group - serv->worker_groups) - group->offset;
 #else
 			int i;
 			atomic_t *round = &SwooleWG.worker_pti;
-			for(i=0; i< serv->worker_num; i++)
+			for(i=0; i< worker_num; i++)
 			{
-				sw_atomic_fetch_add(round, 1);
-				pti = (*round) % serv->worker_num;
-				if (object->workers_status[pti] == SW_WORKER_IDLE)
+				pti = sw_atomic_fetch_add(round, 1) % worker_num;
+				if (object->workers_status[group->offset + pti] == SW_WORKER_IDLE)
 				{
 					break;
 				}
 			}
 #endif
 		}
+		pti += group->offset;
+		if (object->workers_excluded != NULL)
+		{
+			pti = swFactoryProcess_skip_excluded(object, group, pti);
+		}
+		if (data->info.type == SW_EVENT_PACKAGE_START)
+		{
+			package_worker = pti;
+		}
 	}
 	//指定了worker_id
 	else
 	{
 		pti = worker_id;
 	}
+	data->info.time = swServer_latency_stamp(serv, &data->info);
+	//在发送前计数, 避免worker先处理完导致计数为负
+	if (object->workers_inflight != NULL)
+	{
+		sw_atomic_fetch_add(&object->workers_inflight[pti], 1);
+	}
+	if (SwooleTG.type == SW_THREAD_REACTOR)
+	{
+		swServer_reactor_stats_add(serv, SwooleTG.id, dispatch_count, 1);
+	}
+	//消息队列抢占模式下pti不是worker的编号
+	if (pti < object->worker_num)
+	{
+		swServer_worker_stats_add(serv, pti, dispatch_count, 1);
+	}
 
 #if SW_WORKER_IPC_MODE == 2
 	//insert to msg queue
@@ -882,10 +1470,37 @@ int swFactoryProcess_send2worker(swFactory *factory, swEventData *data, int work
 	ret = object->rd_queue.in(&object->rd_queue, in_data, send_len);
 	swTrace("[Master]rd_queue[%ld]->in: fd=%d|type=%d|len=%d", in_data->mtype, info->fd, info->type, info->len);
 #else
+#if SW_WORKER_IPC_MODE == 3
+	//只有reactor线程独占一个ring(单生产者),其他线程/进程仍然走unix socket
+	if (SwooleTG.type == SW_THREAD_REACTOR)
+	{
+		swRingBuffer *ring = object->rings[pti * serv->reactor_num + SwooleTG.id];
+		swPipe *notify = &object->rings_notify[pti];
+		uint64_t flag = 1;
+
+		while (swRingBuffer_push(ring, (void *) data, send_len) < 0)
+		{
+			//ring已满,唤醒worker后让出CPU
+			notify->write(notify, &flag, sizeof(flag));
+			swYield();
+		}
+		sw_atomic_memory_barrier();
+		if (object->rings_sleep[pti])
+		{
+			object->rings_sleep[pti] = 0;
+			notify->write(notify, &flag, sizeof(flag));
+		}
+		return send_len;
+	}
+#endif
 	//send to unix sock
 	//swWarn("pti=%d|from_id=%d|data_len=%d|swDataHead_size=%ld", pti, data->info.from_id, send_len, sizeof(swDataHead));
 	ret = swWrite(object->workers[pti].pipe_master, (void *) data, send_len);
 #endif
+	if (ret < 0 && object->workers_inflight != NULL)
+	{
+		sw_atomic_fetch_sub(&object->workers_inflight[pti], 1);
+	}
 	return ret;
 }
 
@@ -921,6 +1536,7 @@ static int swFactoryProcess_writer_start(swFactory *factory)
 		}
 		param->object = factory;
 		param->pti = i;
+		swReady_add(serv->ready, 1);
 		if (pthread_create(&pidt, NULL, thread_main, (void *) param) < 0)
 		{
 			swTrace("pthread_create fail\n");
@@ -928,7 +1544,6 @@ static int swFactoryProcess_writer_start(swFactory *factory)
 		}
 		pthread_detach(pidt);
 		serv->writer_threads[i].ptid = pidt;
-		SW_START_SLEEP;
 	}
 	return SW_OK;
 }
@@ -949,6 +1564,7 @@ int swFactoryProcess_writer_loop_queue(swThreadParam *param)
 	sdata.mtype = pti + 1;
 
 	swSignal_none();
+	swReady_done(SwooleG.serv->ready);
 	while (SwooleG.running > 0)
 	{
 		swTrace("[Writer]wt_queue[%ld]->out wait", sdata.mtype);
@@ -976,28 +1592,409 @@ static int swFactoryProcess_worker_receive(swReactor *reactor, swEvent *event)
 	swEventData task;
 	swServer *serv = reactor->ptr;
 	swFactory *factory = &serv->factory;
+	uint64_t spin_end = 0;
+
 	do
 	{
 		n = read(event->fd, &task, sizeof(task));
 	}
 	while(n < 0 && errno == EINTR);
-	return swFactoryProcess_worker_excute(factory, &task);
+	if (n <= 0)
+	{
+		return SW_OK;
+	}
+	swFactoryProcess_worker_excute(factory, &task);
+	//暂存的请求比管道中的先到达
+	swFactoryProcess_direct_replay(factory);
+
+	//一次唤醒取完所有已到达的请求,没有请求时自旋一段时间后再回到epoll_wait
+	while (SwooleG.running > 0)
+	{
+		n = recv(event->fd, &task, sizeof(task), MSG_DONTWAIT);
+		if (n > 0)
+		{
+			swFactoryProcess_worker_excute(factory, &task);
+			swFactoryProcess_direct_replay(factory);
+			spin_end = 0;
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n == 0 || errno != EAGAIN || serv->worker_spin_usec == 0)
+		{
+			break;
+		}
+		if (spin_end == 0)
+		{
+			spin_end = swClock_usec() + serv->worker_spin_usec;
+		}
+		else if (swClock_usec() >= spin_end)
+		{
+			break;
+		}
+	}
+	return SW_OK;
+}
+
+static void swFactoryProcess_direct_replay(swFactory *factory)
+{
+	swFactoryProcess_stash *stash;
+
+	//处理过程中可能再次等待并暂存新的消息
+	while ((stash = worker_stash_head) != NULL)
+	{
+		worker_stash_head = stash->next;
+		if (worker_stash_head == NULL)
+		{
+			worker_stash_tail = NULL;
+		}
+		swFactoryProcess_worker_excute(factory, &stash->task);
+		sw_free(stash);
+	}
+}
+
+/**
+ * 定时器等其他事件的回调中等待时, 暂存的消息在这一轮事件结束后处理
+ */
+static void swFactoryProcess_worker_onFinish(swReactor *reactor)
+{
+	swServer *serv = reactor->ptr;
+
+	if (worker_stash_head != NULL)
+	{
+		swFactoryProcess_direct_replay(&serv->factory);
+	}
+}
+
+/**
+ * manager进程: worker退出后通知每个reactor线程收回它直接写的连接, 在重新创建worker之前
+ */
+static void swFactoryProcess_direct_reset(swFactory *factory, int worker_id)
+{
+	swFactoryProcess *object = factory->object;
+	swServer *serv = factory->ptr;
+	swEventData ev;
+	int i, pipe_i;
+
+	bzero(&ev.info, sizeof(ev.info));
+	ev.info.type = SW_EVENT_DIRECT_RESET;
+	ev.info.len = sizeof(worker_id);
+	memcpy(ev.data, &worker_id, sizeof(worker_id));
+	for (i = 0; i < serv->reactor_num; i++)
+	{
+		ev.info.from_id = i;
+		pipe_i = serv->reactor_pipe_num > 1 ? i * serv->reactor_pipe_num : i;
+		if (write(object->workers[pipe_i].pipe_worker, &ev, sizeof(ev.info) + ev.info.len) < 0)
+		{
+			swWarn("[Manager]notify reactor#%d failed. Error: %s [%d]", i, strerror(errno), errno);
+		}
+	}
+}
+
+static int swFactoryProcess_direct_stash(swEventData *task, int n)
+{
+	swFactoryProcess_stash *stash = sw_malloc(offsetof(swFactoryProcess_stash, task) + n);
+
+	if (stash == NULL)
+	{
+		swWarn("malloc for stash failed, task[type=%d] lost.", task->info.type);
+		return SW_ERR;
+	}
+	memcpy(&stash->task, task, n);
+	stash->next = NULL;
+	if (worker_stash_tail == NULL)
+	{
+		worker_stash_head = stash;
+	}
+	else
+	{
+		worker_stash_tail->next = stash;
+	}
+	worker_stash_tail = stash;
+	return SW_OK;
+}
+
+int swFactoryProcess_direct_wait(swFactory *factory, int fd, int timeout_ms)
+{
+	swFactoryProcess *object = factory->object;
+	int pipe_rd = object->workers[SwooleWG.id].pipe_worker;
+	uint64_t now, deadline = swClock_usec() + (uint64_t) timeout_ms * 1000;
+	union
+	{
+		struct cmsghdr cm;
+		char control[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct pollfd pfd;
+	swEventData task;
+	int n, sock;
+
+	while (SwooleG.running > 0)
+	{
+		now = swClock_usec();
+		if (now >= deadline)
+		{
+			errno = ETIMEDOUT;
+			return SW_ERR;
+		}
+		pfd.fd = pipe_rd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, (deadline - now) / 1000 + 1) <= 0)
+		{
+			continue;
+		}
+
+		iov.iov_base = &task;
+		iov.iov_len = sizeof(task);
+		bzero(&msg, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.control;
+		msg.msg_controllen = sizeof(control.control);
+		n = recvmsg(pipe_rd, &msg, MSG_DONTWAIT);
+		if (n < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+			{
+				continue;
+			}
+			swWarn("recvmsg from pipe failed. Error: %s[%d]", strerror(errno), errno);
+			return SW_ERR;
+		}
+		if (n < sizeof(task.info))
+		{
+			continue;
+		}
+		cmsg = CMSG_FIRSTHDR(&msg);
+		sock = -1;
+		if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		{
+			memcpy(&sock, CMSG_DATA(cmsg), sizeof(sock));
+		}
+		if (task.info.type != SW_EVENT_DIRECT)
+		{
+			swFactoryProcess_direct_stash(&task, n);
+			continue;
+		}
+		//超时后才到达的回复
+		if (task.info.fd != fd)
+		{
+			if (sock >= 0)
+			{
+				close(sock);
+			}
+			continue;
+		}
+		//连接已关闭或者正在转发
+		if (sock < 0)
+		{
+			errno = ECONNRESET;
+		}
+		return sock;
+	}
+	return SW_ERR;
+}
+
+#if SW_WORKER_IPC_MODE == 3
+/**
+ * 为每对(worker, reactor线程)创建共享内存环形队列
+ */
+static int swFactoryProcess_rings_create(swFactory *factory)
+{
+	swFactoryProcess *object = factory->object;
+	swServer *serv = factory->ptr;
+	int i, ring_num = object->worker_num * serv->reactor_num;
+
+	object->rings = sw_calloc(ring_num, sizeof(swRingBuffer *));
+	object->rings_notify = sw_calloc(object->worker_num, sizeof(swPipe));
+	object->rings_sleep = sw_shm_calloc(object->worker_num, sizeof(uint8_t));
+	if (object->rings == NULL || object->rings_notify == NULL || object->rings_sleep == NULL)
+	{
+		swError("malloc[rings] fail. Error: %s [%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	for (i = 0; i < ring_num; i++)
+	{
+		object->rings[i] = swRingBuffer_create(SW_WORKER_RING_SIZE, 1);
+		if (object->rings[i] == NULL)
+		{
+			swError("create ring[%d] fail", i);
+			return SW_ERR;
+		}
+	}
+	for (i = 0; i < object->worker_num; i++)
+	{
+		if (swPipeNotify_auto(&object->rings_notify[i], 0, 0) < 0)
+		{
+			swError("create ring notify[%d] fail", i);
+			return SW_ERR;
+		}
+		//worker启动前处于等待状态,第一次投递需要唤醒
+		object->rings_sleep[i] = 1;
+	}
+	return SW_OK;
+}
+
+/**
+ * worker进程消费所有reactor线程的环形队列
+ */
+static int swFactoryProcess_worker_receive_ring(swReactor *reactor, swEvent *event)
+{
+	swServer *serv = reactor->ptr;
+	swFactory *factory = &serv->factory;
+	swFactoryProcess *object = factory->object;
+	swRingBuffer **rings = &object->rings[SwooleWG.id * serv->reactor_num];
+	swPipe *notify = &object->rings_notify[SwooleWG.id];
+	swEventData *task;
+	uint64_t flag;
+	uint64_t spin_end = 0;
+	int i, n, length;
+
+	notify->read(notify, &flag, sizeof(flag));
+
+	while (1)
+	{
+		do
+		{
+			n = 0;
+			for (i = 0; i < serv->reactor_num; i++)
+			{
+				task = swRingBuffer_front(rings[i], &length);
+				if (task == NULL)
+				{
+					continue;
+				}
+				swFactoryProcess_worker_excute(factory, task);
+				swRingBuffer_pop(rings[i]);
+				n++;
+			}
+			if (n > 0)
+			{
+				spin_end = 0;
+			}
+			//所有ring都为空,自旋等待一段时间,期间生产者不需要唤醒
+			else if (serv->worker_spin_usec > 0 && SwooleG.running > 0)
+			{
+				if (spin_end == 0)
+				{
+					spin_end = swClock_usec() + serv->worker_spin_usec;
+					n = 1;
+				}
+				else if (swClock_usec() < spin_end)
+				{
+					n = 1;
+				}
+			}
+		}
+		while (n > 0 && SwooleG.running > 0);
+
+		//标记为等待状态后再检查一次,防止丢失唤醒
+		object->rings_sleep[SwooleWG.id] = 1;
+		sw_atomic_memory_barrier();
+		for (i = 0; i < serv->reactor_num; i++)
+		{
+			if (!swRingBuffer_empty(rings[i]))
+			{
+				break;
+			}
+		}
+		if (i == serv->reactor_num)
+		{
+			return SW_OK;
+		}
+		object->rings_sleep[SwooleWG.id] = 0;
+	}
+	return SW_OK;
 }
+#endif
 
 #endif
 
+/**
+ * 一次唤醒最多读出SW_REACTOR_RESP_BATCH个响应, 每个线程一个
+ */
+typedef struct
+{
+	swEventData resps[SW_REACTOR_RESP_BATCH];
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[SW_REACTOR_RESP_BATCH];
+	struct iovec iovs[SW_REACTOR_RESP_BATCH];
+#endif
+} swFactoryProcess_resp_buffer;
+
+static __thread swFactoryProcess_resp_buffer *swFactoryProcess_resp_buf = NULL;
+
+static swFactoryProcess_resp_buffer* swFactoryProcess_resp_buffer_get(void)
+{
+	swFactoryProcess_resp_buffer *buffer = swFactoryProcess_resp_buf;
+	if (buffer != NULL)
+	{
+		return buffer;
+	}
+	buffer = sw_malloc(sizeof(swFactoryProcess_resp_buffer));
+	if (buffer == NULL)
+	{
+		swWarn("malloc for response buffer failed.");
+		return NULL;
+	}
+#ifdef HAVE_RECVMMSG
+	int i;
+	bzero(buffer->msgs, sizeof(buffer->msgs));
+	for (i = 0; i < SW_REACTOR_RESP_BATCH; i++)
+	{
+		buffer->iovs[i].iov_base = &buffer->resps[i];
+		buffer->iovs[i].iov_len = sizeof(swEventData);
+		buffer->msgs[i].msg_hdr.msg_iov = &buffer->iovs[i];
+		buffer->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+	swFactoryProcess_resp_buf = buffer;
+	return buffer;
+}
+
+/**
+ * worker管道可读时读完管道中的响应(最多SW_REACTOR_RESP_BATCH个)再一起发送
+ * worker连续发送多个响应时减少唤醒、read和send的次数
+ */
 int swFactoryProcess_send2client(swReactor *reactor, swDataHead *ev)
 {
 	int n;
-	swEventData resp;
+	swFactoryProcess_resp_buffer *buffer = swFactoryProcess_resp_buffer_get();
 
+	if (buffer == NULL)
+	{
+		return SW_ERR;
+	}
 	//Unix Sock UDP
-	n = read(ev->fd, &resp, sizeof(resp));
-	swTrace("[WriteThread]recv: writer=%d|pipe=%d", ev->from_id, ev->fd);
-	//swWarn("send: type=%d|content=%s", resp.info.type, resp.data);
+#ifdef HAVE_RECVMMSG
+	n = recvmmsg(ev->fd, buffer->msgs, SW_REACTOR_RESP_BATCH, MSG_DONTWAIT, NULL);
+#else
+	int ret;
+	for (n = 0; n < SW_REACTOR_RESP_BATCH; n++)
+	{
+		ret = recv(ev->fd, &buffer->resps[n], sizeof(swEventData), MSG_DONTWAIT);
+		if (ret <= 0)
+		{
+			break;
+		}
+	}
+	if (n == 0)
+	{
+		n = -1;
+	}
+#endif
+	swTrace("[WriteThread]recv: writer=%d|pipe=%d|n=%d", ev->from_id, ev->fd, n);
 	if (n > 0)
 	{
-		return swReactorThread_send(&resp);
+		return swReactorThread_send_batch(buffer->resps, n);
+	}
+	else if (errno == EAGAIN)
+	{
+		return SW_OK;
 	}
 	else
 	{
@@ -1030,6 +2027,7 @@ int swFactoryProcess_writer_loop_unsock(swThreadParam *param)
 	}
 	swSingalNone();
 	reactor->setHandle(reactor, SW_FD_PIPE, swFactoryProcess_send2client);
+	swReady_done(SwooleG.serv->ready);
 	reactor->wait(reactor, &tmo);
 	reactor->free(reactor);
 	pthread_exit((void *) param);
@@ -17,15 +17,50 @@
 #include "swoole.h"
 #include "Server.h"
 
+#include <stddef.h>
+
+typedef struct _swFactoryThread_task
+{
+	uint32_t seq;
+	struct _swFactoryThread_task *next;
+	swEventData data;
+} swFactoryThread_task;
+
+/**
+ * 每个连接的执行顺序, 前面的请求未执行完时后面的请求挂在deferred上
+ * 由执行完前一个请求的线程继续执行, 窃取的线程不会阻塞
+ */
+typedef struct _swFactoryThread_conn
+{
+	uint32_t dispatch_seq; //已投递的请求数
+	uint32_t exec_seq;     //已执行的请求数
+	atomic_t lock;
+	swFactoryThread_task *deferred; //按序号排列
+} swFactoryThread_conn;
+
 typedef struct _swFactoryThread
 {
 	int writer_num;
 	int writer_pti;
-	swRingQueue *queues; //消息队列
+	swMPMCQueue *queues; //消息队列
 	swWriterThread *writers;
+	/**
+	 * work_stealing: 空闲的写线程从其他线程的队列中取请求
+	 * 同一连接的请求按投递序号执行, 被窃取后也不会乱序
+	 */
+	uint8_t work_stealing;
+	uint8_t *idle; //写线程是否在等待
+	swFactoryThread_conn *conns;
+	uint32_t conn_num;
 } swFactoryThread;
 
+#define swFactoryThread_ordered(this, info) (this->work_stealing && info.type != SW_EVENT_UDP && info.fd >= 0 && info.fd < this->conn_num)
+#define swFactoryThread_lock(conn)          while (!sw_atomic_cmp_set(&conn->lock, 0, 1)) sw_atomic_cpu_pause()
+#define swFactoryThread_unlock(conn)        sw_atomic_memory_barrier(); conn->lock = 0
+
 static int swFactoryThread_writer_loop(swThreadParam *param);
+static swFactoryThread_task* swFactoryThread_steal(swFactoryThread *this, int pti);
+static void swFactoryThread_execute(swFactory *factory, swFactoryThread_task *task);
 
 int swFactoryThread_create(swFactory *factory, int writer_num)
 {
@@ -42,7 +77,7 @@ int swFactoryThread_create(swFactory *factory, int writer_num)
 		swTrace("malloc[1] fail\n");
 		return SW_ERR;
 	}
-	this->queues = sw_calloc(writer_num, sizeof(swRingQueue));
+	this->queues = sw_calloc(writer_num, sizeof(swMPMCQueue));
 	if (this->queues == NULL)
 	{
 		swTrace("malloc[2] fail\n");
@@ -67,6 +102,7 @@ int swFactoryThread_create(swFactory *factory, int writer_num)
 int swFactoryThread_start(swFactory *factory)
 {
 	swFactoryThread *this = factory->object;
+	swServer *serv = factory->ptr;
 	swThreadParam *param;
 	int i;
 	int ret;
@@ -77,13 +113,28 @@ int swFactoryThread_start(swFactory *factory)
 	{
 		return SW_ERR;
 	}
+	this->work_stealing = serv->work_stealing && this->writer_num > 1;
+	this->conn_num = serv->max_conn;
+	if (this->work_stealing)
+	{
+		this->idle = sw_calloc(this->writer_num, sizeof(uint8_t));
+		this->conns = sw_calloc(this->conn_num, sizeof(swFactoryThread_conn));
+		if (this->idle == NULL || this->conns == NULL)
+		{
+			swWarn("malloc for work stealing failed.");
+			return SW_ERR;
+		}
+	}
+	//必须在线程启动前创建, 窃取时会访问其他线程的队列
 	for (i = 0; i < this->writer_num; i++)
 	{
-		if (swPipeNotify_auto(&this->writers[i].evfd, 1, 1) < 0)
+		if (swMPMCQueue_create(&this->queues[i], SW_THREAD_QUEUE_SIZE) < 0)
 		{
-			swWarn("create eventfd fail");
 			return SW_ERR;
 		}
+	}
+	for (i = 0; i < this->writer_num; i++)
+	{
 		param = sw_malloc(sizeof(swThreadParam));
 		if (param == NULL)
 		{
@@ -96,13 +147,7 @@ int swFactoryThread_start(swFactory *factory)
 			swTrace("pthread_create fail\n");
 			return SW_ERR;
 		}
-		if (swRingQueue_init(&this->queues[i], SW_RINGQUEUE_LEN) < 0)
-		{
-			swTrace("create ring queue fail\n");
-			return SW_ERR;
-		}
 		this->writers[i].ptid = pidt;
-		//SW_START_SLEEP;
 	}
 	return SW_OK;
 }
@@ -110,6 +155,26 @@ int swFactoryThread_shutdown(swFactory *factory)
 {
 	SwooleG.running = 0;
 	swFactoryThread *this = factory->object;
+	int i;
+
+	for (i = 0; i < this->writer_num; i++)
+	{
+		swMPMCQueue_wake_all(&this->queues[i]);
+	}
+	//所有线程退出后才能释放队列, 其他线程可能正在窃取
+	for (i = 0; i < this->writer_num; i++)
+	{
+		pthread_join(this->writers[i].ptid, NULL);
+	}
+	for (i = 0; i < this->writer_num; i++)
+	{
+		swMPMCQueue_free(&this->queues[i]);
+	}
+	if (this->work_stealing)
+	{
+		sw_free(this->idle);
+		sw_free(this->conns);
+	}
 	sw_free(this->writers);
 	sw_free(this->queues);
 	sw_free(this);
@@ -121,14 +186,13 @@ int swFactoryThread_shutdown(swFactory *factory)
 int swFactoryThread_dispatch(swFactory *factory, swEventData *buf)
 {
 	swFactoryThread *this = factory->object;
-	int pti;
-	int ret;
-	uint64_t flag = 1;
-	int datasize = sizeof(int)*3 + buf->info.len + 1;
-	char *data;
+	int i, pti;
+	int datasize = offsetof(swFactoryThread_task, data) + sizeof(swDataHead) + buf->info.len + 1;
+	swFactoryThread_task *task;
 	swServer *serv = factory->ptr;
 
-	if(serv->dispatch_mode == SW_DISPATCH_ROUND)
+	//窃取模式下按fd选择队列, 同一连接的请求通常由同一个线程处理
+	if (serv->dispatch_mode == SW_DISPATCH_ROUND && !this->work_stealing)
 	{
 		//使用平均分配
 		pti = this->writer_pti;
@@ -143,27 +207,115 @@ int swFactoryThread_dispatch(swFactory *factory, swEventData *buf)
 		pti = buf->info.fd % this->writer_num;
 	}
 
-	data = sw_malloc(datasize);
-	if(data == NULL)
+	task = sw_malloc(datasize);
+	if (task == NULL)
 	{
 		swTrace("malloc fail\n");
 		return SW_ERR;
 	}
-	memcpy(data, buf, datasize);
-	//send data ptr. use event_fd
-	if (swRingQueue_push(&(this->queues[pti]), (void *) data) < 0)
+	memcpy(&task->data, buf, datasize - offsetof(swFactoryThread_task, data));
+	if (swFactoryThread_ordered(this, buf->info))
 	{
-		swWarn("swRingQueue_push fail.Buffer is full.Writer=%d\n", pti);
-		return SW_ERR;
+		task->seq = sw_atomic_fetch_add(&this->conns[buf->info.fd].dispatch_seq, 1);
 	}
-	else
+	//队列已满时让出CPU等待写线程消费, 不丢弃数据
+	while (swMPMCQueue_push(&(this->queues[pti]), (void *) task) < 0)
 	{
-		ret = this->writers[pti].evfd.write(&this->writers[pti].evfd, &flag, sizeof(flag));
-		if(ret < 0)
+		if (SwooleG.running == 0)
 		{
-			swWarn("Send queue notice fail.errno=%d\n", errno);
+			sw_free(task);
+			return SW_ERR;
 		}
-		return ret;
+		swYield();
+	}
+	if (SwooleTG.type == SW_THREAD_REACTOR)
+	{
+		swServer_reactor_stats_add(serv, SwooleTG.id, dispatch_count, 1);
+	}
+	if (this->work_stealing && !this->idle[pti])
+	{
+		//目标线程正忙, 唤醒一个空闲的线程来窃取
+		for (i = 0; i < this->writer_num; i++)
+		{
+			if (this->idle[i])
+			{
+				swMPMCQueue_wake_all(&this->queues[i]);
+				break;
+			}
+		}
+	}
+	return SW_OK;
+}
+
+/**
+ * 依次尝试其他写线程的队列
+ */
+static swFactoryThread_task* swFactoryThread_steal(swFactoryThread *this, int pti)
+{
+	swFactoryThread_task *task;
+	int i;
+
+	for (i = 1; i < this->writer_num; i++)
+	{
+		if (swMPMCQueue_pop(&this->queues[(pti + i) % this->writer_num], (void **) &task) == SW_OK)
+		{
+			return task;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * 同一连接的请求按dispatch_seq的顺序执行
+ */
+static void swFactoryThread_execute(swFactory *factory, swFactoryThread_task *task)
+{
+	swFactoryThread *this = factory->object;
+	swFactoryThread_conn *conn;
+	swFactoryThread_task **prev;
+
+	if (!swFactoryThread_ordered(this, task->data.info))
+	{
+		factory->last_from_id = task->data.info.from_id;
+		factory->onTask(factory, &task->data);
+		sw_free(task);
+		return;
+	}
+
+	conn = &this->conns[task->data.info.fd];
+	swFactoryThread_lock(conn);
+	if (task->seq != conn->exec_seq)
+	{
+		prev = &conn->deferred;
+		while (*prev != NULL && (int32_t) ((*prev)->seq - task->seq) < 0)
+		{
+			prev = &(*prev)->next;
+		}
+		task->next = *prev;
+		*prev = task;
+		swFactoryThread_unlock(conn);
+		return;
+	}
+	swFactoryThread_unlock(conn);
+
+	while (task != NULL)
+	{
+		factory->last_from_id = task->data.info.from_id;
+		factory->onTask(factory, &task->data);
+		sw_free(task);
+
+		swFactoryThread_lock(conn);
+		conn->exec_seq++;
+		task = conn->deferred;
+		if (task != NULL && task->seq == conn->exec_seq)
+		{
+			conn->deferred = task->next;
+		}
+		else
+		{
+			task = NULL;
+		}
+		swFactoryThread_unlock(conn);
 	}
 }
 
@@ -173,23 +325,11 @@ static int swFactoryThread_writer_loop(swThreadParam *param)
 	swServer *serv = factory->ptr;
 	swFactoryThread *this = factory->object;
 	int pti = param->pti;
-	int ret;
-	swEventData *req;
-	uint64_t flag;
+	int i, timeout;
+	swFactoryThread_task *task;
 
 	//cpu affinity setting
-#if HAVE_CPU_AFFINITY
-	if (serv->open_cpu_affinity)
-	{
-		cpu_set_t cpu_set;
-		CPU_ZERO(&cpu_set);
-		CPU_SET(pti % SW_CPU_NUM, &cpu_set);
-		if (0 != pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set))
-		{
-			swTrace("pthread_setaffinity_np set fail\n");
-		}
-	}
-#endif
+	swServer_set_cpu_affinity(serv, 0, pti);
 
 	if (serv->onWorkerStart != NULL)
 	{
@@ -199,23 +339,43 @@ static int swFactoryThread_writer_loop(swThreadParam *param)
 	//main loop
 	while (SwooleG.running > 0)
 	{
-		if (swRingQueue_pop(&(this->queues[pti]), (void **) &req) == 0)
+		if (swMPMCQueue_pop(&(this->queues[pti]), (void **) &task) < 0)
 		{
-			factory->last_from_id = req->info.from_id;
-			factory->onTask(factory, req);
-			sw_free(req);
-		}
-		else
-		{
-			ret = this->writers[pti].evfd.read(&this->writers[pti].evfd, &flag, sizeof(flag));
-			if (ret < 0)
+			if (!this->work_stealing)
+			{
+				if (swMPMCQueue_wait(&(this->queues[pti]), (void **) &task, SW_THREAD_QUEUE_WAIT) < 0)
+				{
+					continue;
+				}
+			}
+			else
 			{
-				swTrace("read fail.errno=%d", errno);
+				this->idle[pti] = 1;
+				sw_atomic_memory_barrier();
+				task = swFactoryThread_steal(this, pti);
+				//有其他线程繁忙时只短暂睡眠, 投递线程发现目标线程繁忙时也会唤醒
+				timeout = SW_THREAD_QUEUE_WAIT;
+				for (i = 0; i < this->writer_num; i++)
+				{
+					if (i != pti && !this->idle[i])
+					{
+						timeout = SW_FACTORY_STEAL_WAIT;
+						break;
+					}
+				}
+				if (task == NULL && swMPMCQueue_wait(&(this->queues[pti]), (void **) &task, timeout) < 0)
+				{
+					task = swFactoryThread_steal(this, pti);
+				}
+				this->idle[pti] = 0;
+				if (task == NULL)
+				{
+					continue;
+				}
 			}
 		}
+		swFactoryThread_execute(factory, task);
 	}
-	//shutdown
-	this->writers[pti].evfd.close(&this->writers[pti].evfd);
 
 	if (serv->onWorkerStop != NULL)
 	{
@@ -0,0 +1,225 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+
+/**
+ * 读多写少的读写锁(big-reader lock), 读者计数分散在按CPU划分的slot中, 每个slot独占一个cache line
+ * 读锁只修改本线程slot的计数, 写锁先设置writer, 再等所有slot的读者退出
+ * writer: 0 无写者, 1 等待读者退出, 2 持有写锁
+ */
+static int swBRLock_lock_rd(swLock *lock);
+static int swBRLock_lock(swLock *lock);
+static int swBRLock_unlock(swLock *lock);
+static int swBRLock_trylock_rd(swLock *lock);
+static int swBRLock_trylock(swLock *lock);
+static int swBRLock_free(swLock *lock);
+
+static __thread int swBRLock_slot = -1;
+static pthread_once_t swBRLock_once = PTHREAD_ONCE_INIT;
+
+//fork后子进程重新选择slot
+static void swBRLock_atfork_child(void)
+{
+	swBRLock_slot = -1;
+}
+
+static void swBRLock_init(void)
+{
+	pthread_atfork(NULL, NULL, swBRLock_atfork_child);
+}
+
+static inline atomic_t* swBRLock_get_slot(swBRLock *object)
+{
+	int cpu;
+	if (swBRLock_slot < 0)
+	{
+		cpu = sched_getcpu();
+		swBRLock_slot = (cpu < 0 ? getpid() : cpu) % SW_BRLOCK_SLOT_NUM;
+	}
+	return &object->slots[swBRLock_slot].readers;
+}
+
+int swBRLock_create(swLock *lock, int use_in_process)
+{
+	swBRLock *object = &lock->object.brlock;
+
+	bzero(lock, sizeof(swLock));
+	lock->type = SW_BRLOCK;
+	if (use_in_process)
+	{
+		object->slots = sw_shm_calloc(SW_BRLOCK_SLOT_NUM, sizeof(swBRLock_slot_t));
+	}
+	else
+	{
+		object->slots = sw_calloc(SW_BRLOCK_SLOT_NUM, sizeof(swBRLock_slot_t));
+	}
+	if (object->slots == NULL)
+	{
+		swWarn("alloc brlock slots failed.");
+		return SW_ERR;
+	}
+	object->shared = use_in_process;
+	pthread_once(&swBRLock_once, swBRLock_init);
+
+	lock->lock_rd = swBRLock_lock_rd;
+	lock->lock = swBRLock_lock;
+	lock->unlock = swBRLock_unlock;
+	lock->trylock_rd = swBRLock_trylock_rd;
+	lock->trylock = swBRLock_trylock;
+	lock->free = swBRLock_free;
+	return SW_OK;
+}
+
+static void swBRLock_wait(atomic_t *value, int n)
+{
+	uint32_t i;
+	if (SW_CPU_NUM > 1 && n < SW_BRLOCK_SPIN)
+	{
+		for (i = 0; i < n; i++)
+		{
+			sw_atomic_cpu_pause();
+		}
+	}
+	else
+	{
+		swYield();
+	}
+}
+
+static int swBRLock_lock_rd(swLock *lock)
+{
+	swBRLock *object = &lock->object.brlock;
+	atomic_t *readers = swBRLock_get_slot(object);
+	int n = 1;
+
+	while (1)
+	{
+		sw_atomic_fetch_add(readers, 1);
+		if (object->writer == 0)
+		{
+			return SW_OK;
+		}
+		//有写者, 退出后等待
+		sw_atomic_fetch_sub(readers, 1);
+		while (object->writer != 0)
+		{
+			swBRLock_wait(&object->writer, n);
+			n <<= 1;
+		}
+	}
+	return SW_ERR;
+}
+
+static int swBRLock_trylock_rd(swLock *lock)
+{
+	swBRLock *object = &lock->object.brlock;
+	atomic_t *readers = swBRLock_get_slot(object);
+
+	sw_atomic_fetch_add(readers, 1);
+	if (object->writer == 0)
+	{
+		return 0;
+	}
+	sw_atomic_fetch_sub(readers, 1);
+	return EBUSY;
+}
+
+static inline int swBRLock_readers_exit(swBRLock *object, int wait)
+{
+	int i, n;
+	for (i = 0; i < SW_BRLOCK_SLOT_NUM; i++)
+	{
+		n = 1;
+		while (object->slots[i].readers != 0)
+		{
+			if (!wait)
+			{
+				return SW_FALSE;
+			}
+			swBRLock_wait(&object->slots[i].readers, n);
+			n <<= 1;
+		}
+	}
+	return SW_TRUE;
+}
+
+static int swBRLock_lock(swLock *lock)
+{
+	swBRLock *object = &lock->object.brlock;
+	int n = 1;
+
+	while (object->writer != 0 || !sw_atomic_cmp_set(&object->writer, 0, 1))
+	{
+		swBRLock_wait(&object->writer, n);
+		n <<= 1;
+	}
+	swBRLock_readers_exit(object, 1);
+	object->writer = 2;
+	return SW_OK;
+}
+
+static int swBRLock_trylock(swLock *lock)
+{
+	swBRLock *object = &lock->object.brlock;
+
+	if (object->writer != 0 || !sw_atomic_cmp_set(&object->writer, 0, 1))
+	{
+		return EBUSY;
+	}
+	if (!swBRLock_readers_exit(object, 0))
+	{
+		object->writer = 0;
+		return EBUSY;
+	}
+	object->writer = 2;
+	return 0;
+}
+
+/**
+ * 持有写锁时不可能有读者, 所以writer == 2表示释放写锁
+ */
+static int swBRLock_unlock(swLock *lock)
+{
+	swBRLock *object = &lock->object.brlock;
+
+	if (object->writer == 2)
+	{
+		sw_atomic_memory_barrier();
+		object->writer = 0;
+	}
+	else
+	{
+		sw_atomic_fetch_sub(swBRLock_get_slot(object), 1);
+	}
+	return SW_OK;
+}
+
+static int swBRLock_free(swLock *lock)
+{
+	swBRLock *object = &lock->object.brlock;
+	if (object->shared)
+	{
+		sw_shm_free(object->slots);
+	}
+	else
+	{
+		free(object->slots);
+	}
+	object->slots = NULL;
+	return SW_OK;
+}
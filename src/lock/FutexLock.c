@@ -0,0 +1,115 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * 先自旋(指数退避+pause), 仍然拿不到锁再在futex上睡眠
+ * value: 0 未加锁, 1 已加锁, 2 已加锁并且可能有等待者
+ * 锁放在共享内存中时可以跨进程使用, 不需要pthread的process-shared属性
+ */
+static int swFutexLock_lock(swLock *lock);
+static int swFutexLock_unlock(swLock *lock);
+static int swFutexLock_trylock(swLock *lock);
+static int swFutexLock_free(swLock *lock);
+
+int swFutexLock_create(swLock *lock, int use_in_process)
+{
+	bzero(lock, sizeof(swLock));
+	lock->type = SW_FUTEXLOCK;
+	lock->object.futexlock.spin = SW_FUTEXLOCK_SPIN;
+#ifdef __linux__
+	lock->object.futexlock.op_wait = use_in_process ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+	lock->object.futexlock.op_wake = use_in_process ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+#endif
+	lock->lock = swFutexLock_lock;
+	lock->unlock = swFutexLock_unlock;
+	lock->trylock = swFutexLock_trylock;
+	lock->free = swFutexLock_free;
+	return SW_OK;
+}
+
+static int swFutexLock_lock(swLock *lock)
+{
+	swFutexLock *object = &lock->object.futexlock;
+	uint32_t i, n;
+
+	if (sw_atomic_cmp_set(&object->value, 0, 1))
+	{
+		return SW_OK;
+	}
+	if (SW_CPU_NUM > 1)
+	{
+		for (n = 1; n < object->spin; n <<= 1)
+		{
+			for (i = 0; i < n; i++)
+			{
+				sw_atomic_cpu_pause();
+			}
+			//已经有等待者时不再自旋, 直接排队
+			if (object->value == 2)
+			{
+				break;
+			}
+			if (object->value == 0 && sw_atomic_cmp_set(&object->value, 0, 1))
+			{
+				return SW_OK;
+			}
+		}
+	}
+	//标记为有等待者, 持有者解锁时需要唤醒
+	while (__sync_lock_test_and_set(&object->value, 2) != 0)
+	{
+#ifdef __linux__
+		syscall(SYS_futex, &object->value, object->op_wait, 2, NULL, NULL, 0);
+#else
+		swYield();
+#endif
+	}
+	return SW_OK;
+}
+
+static int swFutexLock_unlock(swLock *lock)
+{
+	swFutexLock *object = &lock->object.futexlock;
+
+	//没有等待者时不需要系统调用
+	if (sw_atomic_fetch_sub(&object->value, 1) != 1)
+	{
+		object->value = 0;
+		sw_atomic_memory_barrier();
+#ifdef __linux__
+		syscall(SYS_futex, &object->value, object->op_wake, 1, NULL, NULL, 0);
+#endif
+	}
+	return SW_OK;
+}
+
+static int swFutexLock_trylock(swLock *lock)
+{
+	return sw_atomic_cmp_set(&lock->object.futexlock.value, 0, 1) ? 0 : EBUSY;
+}
+
+static int swFutexLock_free(swLock *lock)
+{
+	return SW_OK;
+}
@@ -0,0 +1,83 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include <limits.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * 启动握手: 创建线程/进程前add, 子线程/进程注册好reactor后done, 主进程wait到计数为0
+ * 放在共享内存中时可以跨进程使用
+ */
+void swReady_init(swReady *ready, int use_in_process)
+{
+	ready->count = 0;
+#ifdef __linux__
+	ready->op_wait = use_in_process ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+	ready->op_wake = use_in_process ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+#endif
+}
+
+void swReady_add(swReady *ready, int n)
+{
+	sw_atomic_fetch_add(&ready->count, n);
+}
+
+void swReady_done(swReady *ready)
+{
+	//重启的worker也会调用, 计数可能小于0, 只在正好减到0时唤醒
+	if (sw_atomic_fetch_sub(&ready->count, 1) == 1)
+	{
+#ifdef __linux__
+		syscall(SYS_futex, &ready->count, ready->op_wake, INT_MAX, NULL, NULL, 0);
+#endif
+	}
+}
+
+int swReady_wait(swReady *ready, int timeout_msec)
+{
+	int32_t n;
+	int64_t remain;
+	uint64_t deadline;
+	struct timespec ts;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	deadline = now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeout_msec;
+
+	while ((n = ready->count) > 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remain = (int64_t) deadline - (int64_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+		if (remain <= 0)
+		{
+			return SW_ERR;
+		}
+#ifdef __linux__
+		ts.tv_sec = remain / 1000;
+		ts.tv_nsec = (remain % 1000) * 1000000;
+		syscall(SYS_futex, &ready->count, ready->op_wait, n, &ts, NULL, 0);
+#else
+		(void) ts;
+		usleep(1000);
+#endif
+	}
+	return SW_OK;
+}
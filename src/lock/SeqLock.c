@@ -0,0 +1,106 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+
+/**
+ * 顺序锁, 适合很小的定长记录: 写者把seq变成奇数后修改, 改完再加1
+ * 读者不写任何共享数据, 用swSeqLock_read_begin/swSeqLock_read_retry检查读到的是不是一致的快照
+ * 作为swLock使用时lock/unlock是写锁, 写者之间互斥
+ */
+static int swSeqLock_lock(swLock *lock);
+static int swSeqLock_unlock(swLock *lock);
+static int swSeqLock_trylock(swLock *lock);
+static int swSeqLock_free(swLock *lock);
+
+int swSeqLock_create(swLock *lock, int use_in_process)
+{
+	bzero(lock, sizeof(swLock));
+	lock->type = SW_SEQLOCK;
+	lock->lock = swSeqLock_lock;
+	lock->unlock = swSeqLock_unlock;
+	lock->trylock = swSeqLock_trylock;
+	lock->free = swSeqLock_free;
+	return SW_OK;
+}
+
+void swSeqLock_write_lock(swSeqLock *object)
+{
+	uint32_t i, n = 1;
+	atomic_uint_t seq;
+
+	while (1)
+	{
+		seq = object->seq;
+		if (!(seq & 1) && sw_atomic_cmp_set(&object->seq, seq, seq + 1))
+		{
+			return;
+		}
+		if (SW_CPU_NUM > 1 && n < SW_SEQLOCK_SPIN)
+		{
+			for (i = 0; i < n; i++)
+			{
+				sw_atomic_cpu_pause();
+			}
+			n <<= 1;
+		}
+		else
+		{
+			swYield();
+		}
+	}
+}
+
+void swSeqLock_read(swSeqLock *object, void *dst, void *src, size_t length)
+{
+	atomic_uint_t seq;
+	do
+	{
+		seq = swSeqLock_read_begin(object);
+		memcpy(dst, src, length);
+	} while (swSeqLock_read_retry(object, seq));
+}
+
+void swSeqLock_write(swSeqLock *object, void *dst, void *src, size_t length)
+{
+	swSeqLock_write_lock(object);
+	memcpy(dst, src, length);
+	swSeqLock_write_unlock(object);
+}
+
+static int swSeqLock_lock(swLock *lock)
+{
+	swSeqLock_write_lock(&lock->object.seqlock);
+	return SW_OK;
+}
+
+static int swSeqLock_unlock(swLock *lock)
+{
+	swSeqLock_write_unlock(&lock->object.seqlock);
+	return SW_OK;
+}
+
+static int swSeqLock_trylock(swLock *lock)
+{
+	atomic_uint_t seq = lock->object.seqlock.seq;
+	return (!(seq & 1) && sw_atomic_cmp_set(&lock->object.seqlock.seq, seq, seq + 1)) ? 0 : EBUSY;
+}
+
+static int swSeqLock_free(swLock *lock)
+{
+	return SW_OK;
+}
@@ -0,0 +1,185 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+
+#define SW_ARENA_NIL         0xffffffff  //空闲链表结束
+#define SW_ARENA_USED        0xfffffffe  //已被占用的块
+#define SW_ARENA_MIN_SPLIT   64          //剩余空间小于此值时不再拆分
+
+typedef struct _swMemoryArenaBlock
+{
+	uint32_t size;  //块的总长度,包含头部
+	uint32_t next;  //下一个空闲块的偏移量,已占用时为SW_ARENA_USED
+} swMemoryArenaBlock;
+
+typedef struct _swMemoryArena
+{
+	swAllocator allocator;
+	swLock lock;
+	uint32_t size;
+	uint32_t usage;
+	uint32_t free_list; //按地址排序的空闲链表
+	uint32_t alloc_num; //已分配的块数
+	char mem[0];
+} swMemoryArena;
+
+#define swMemoryArena_block(arena, offset)  ((swMemoryArenaBlock *) ((arena)->mem + (offset)))
+
+static void *swMemoryArena_alloc(swAllocator *allocator, int size);
+static void swMemoryArena_free(swAllocator *allocator, void *ptr);
+static void swMemoryArena_destroy(swAllocator *allocator);
+
+/**
+ * 共享内存分配器,必须在fork之前创建
+ */
+swAllocator* swMemoryArena_create(uint32_t size)
+{
+	swMemoryArena *arena;
+	swMemoryArenaBlock *block;
+
+	size = SW_MEM_ALIGNED_SIZE(size);
+	arena = sw_shm_malloc(sizeof(swMemoryArena) + size);
+	if (arena == NULL)
+	{
+		swWarn("malloc for arena failed. Error: %s[%d]", strerror(errno), errno);
+		return NULL;
+	}
+	bzero(arena, sizeof(swMemoryArena));
+	if (swFutexLock_create(&arena->lock, 1) < 0)
+	{
+		swWarn("create arena lock failed.");
+		sw_shm_free(arena);
+		return NULL;
+	}
+	arena->size = size;
+	arena->free_list = 0;
+
+	block = swMemoryArena_block(arena, 0);
+	block->size = size;
+	block->next = SW_ARENA_NIL;
+
+	arena->allocator.object = arena;
+	arena->allocator.alloc = swMemoryArena_alloc;
+	arena->allocator.free = swMemoryArena_free;
+	arena->allocator.destroy = swMemoryArena_destroy;
+	return &arena->allocator;
+}
+
+/**
+ * first-fit, 从空闲块的尾部切出需要的内存
+ */
+static void *swMemoryArena_alloc(swAllocator *allocator, int size)
+{
+	swMemoryArena *arena = allocator->object;
+	swMemoryArenaBlock *block, *prev = NULL;
+	uint32_t need = SW_MEM_ALIGNED_SIZE(size) + sizeof(swMemoryArenaBlock);
+	uint32_t offset;
+	void *ptr = NULL;
+
+	if (size <= 0 || need > arena->size)
+	{
+		return NULL;
+	}
+	arena->lock.lock(&arena->lock);
+	for (offset = arena->free_list; offset != SW_ARENA_NIL; offset = block->next)
+	{
+		block = swMemoryArena_block(arena, offset);
+		if (block->size < need)
+		{
+			prev = block;
+			continue;
+		}
+		if (block->size - need >= SW_ARENA_MIN_SPLIT)
+		{
+			block->size -= need;
+			block = swMemoryArena_block(arena, offset + block->size);
+			block->size = need;
+		}
+		//整块分配,从空闲链表中移除
+		else if (prev == NULL)
+		{
+			arena->free_list = block->next;
+		}
+		else
+		{
+			prev->next = block->next;
+		}
+		block->next = SW_ARENA_USED;
+		arena->usage += block->size;
+		arena->alloc_num++;
+		ptr = (void *) (block + 1);
+		break;
+	}
+	arena->lock.unlock(&arena->lock);
+	return ptr;
+}
+
+/**
+ * 按地址顺序插回空闲链表,并与前后相邻的空闲块合并
+ */
+static void swMemoryArena_free(swAllocator *allocator, void *ptr)
+{
+	swMemoryArena *arena = allocator->object;
+	swMemoryArenaBlock *block = ((swMemoryArenaBlock *) ptr) - 1;
+	swMemoryArenaBlock *prev = NULL, *next;
+	uint32_t offset = (char *) block - arena->mem;
+	uint32_t prev_offset = SW_ARENA_NIL, next_offset;
+
+	if ((char *) ptr < arena->mem || offset >= arena->size || block->next != SW_ARENA_USED)
+	{
+		swWarn("invalid pointer or double free. ptr=%p", ptr);
+		return;
+	}
+	arena->lock.lock(&arena->lock);
+	arena->usage -= block->size;
+	arena->alloc_num--;
+	for (next_offset = arena->free_list; next_offset != SW_ARENA_NIL && next_offset < offset; next_offset = prev->next)
+	{
+		prev_offset = next_offset;
+		prev = swMemoryArena_block(arena, prev_offset);
+	}
+	//合并后面的空闲块
+	block->next = next_offset;
+	if (next_offset != SW_ARENA_NIL && offset + block->size == next_offset)
+	{
+		next = swMemoryArena_block(arena, next_offset);
+		block->size += next->size;
+		block->next = next->next;
+	}
+	//合并到前面的空闲块
+	if (prev == NULL)
+	{
+		arena->free_list = offset;
+	}
+	else if (prev_offset + prev->size == offset)
+	{
+		prev->size += block->size;
+		prev->next = block->next;
+	}
+	else
+	{
+		prev->next = offset;
+	}
+	arena->lock.unlock(&arena->lock);
+}
+
+static void swMemoryArena_destroy(swAllocator *allocator)
+{
+	swMemoryArena *arena = allocator->object;
+	arena->lock.free(&arena->lock);
+	sw_shm_free(arena);
+}
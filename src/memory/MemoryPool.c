@@ -16,130 +16,483 @@
 
 #include "swoole.h"
 
-#define SW_PAGE_SIZE  256
-
 static int swMemoryPool_expand(swMemoryPool *pool);
 static void swMemoryPool_print_slab(swMemoryPoolSlab *slab);
 static void swMemoryPool_print_slab(swMemoryPoolSlab *slab);
 
+#define SW_MEMORY_MAGIC_USED   0x5355
+#define SW_MEMORY_MAGIC_FREE   0x4652
+#define SW_MEMORY_CLASS_LARGE  0xffff
+
+/**
+ * 每个块前面的头部, size包含头部
+ */
+typedef struct _swMemoryBlock
+{
+	uint32_t size;
+	uint16_t size_class;
+	uint16_t magic;
+} swMemoryBlock;
+
+/**
+ * 空闲块的body中保存链表指针
+ */
+typedef struct _swMemoryFree
+{
+	struct _swMemoryFree *next;
+} swMemoryFree;
+
+/**
+ * 每个线程(进程)的空闲块缓存, 大部分alloc/free不需要全局锁
+ */
+static __thread struct
+{
+	swMemoryGlobal *gm;
+	swMemoryFree *list[SW_MEMORY_CLASS_NUM];
+	uint16_t num[SW_MEMORY_CLASS_NUM];
+} swMemoryGlobal_cache;
+
 static void *swMemoryGlobal_alloc(swAllocator *allocator, int size);
 static void swMemoryGlobal_free(swAllocator *allocator, void *ptr);
 static void swMemoryGlobal_destroy(swAllocator *allocator);
-static void* swMemoryGlobal_new_page(swMemoryGlobal *gm);
+static swMemoryBlock* swMemoryGlobal_take_large(swMemoryGlobal *gm, uint32_t size);
+static void* swMemoryGlobal_alloc_large(swMemoryGlobal *gm, uint32_t size);
+static void swMemoryGlobal_free_large(swMemoryGlobal *gm, swMemoryBlock *block);
+static void swMemoryGlobal_flush(swMemoryGlobal *gm, int size_class, int n);
+static void swMemoryGlobal_atfork_child(void);
+static void swMemoryGlobal_thread_exit(void *arg);
+
+static pthread_key_t swMemoryGlobal_cache_key;
+static pthread_once_t swMemoryGlobal_cache_once = PTHREAD_ONCE_INIT;
 
-swAllocator* swMemoryGlobal_create(int pagesize, char shared)
+#define swMemoryGlobal_body(block)        ((void *) ((swMemoryBlock *) (block) + 1))
+#define swMemoryGlobal_class_size(i)      (((i) & 1) ? (24 << ((i) >> 1)) : (16 << ((i) >> 1)))
+
+/**
+ * 16, 24, 32, 48, 64 ... 32768, 相邻两级相差不超过50%
+ */
+SWINLINE static int swMemoryGlobal_class(uint32_t size)
 {
-	swMemoryGlobal gm, *gm_ptr;
-	assert(pagesize >= SW_PAGE_SIZE);
-	bzero(&gm, sizeof(swMemoryGlobal));
-	gm.shared = shared;
-	gm.pagesize = pagesize;
-	void *first_page = swMemoryGlobal_new_page(&gm);
-	if (first_page == NULL)
+	uint32_t base;
+	int bit;
+
+	if (size <= 16)
 	{
+		return 0;
+	}
+	bit = 31 - __builtin_clz(size - 1);
+	base = 1u << bit;
+	return (size <= base + (base >> 1)) ? 2 * (bit - 4) + 1 : 2 * (bit - 3);
+}
+
+/**
+ * 预留size字节的地址空间, 只有访问到的页面才占用物理内存
+ * shared为1时在fork之前创建, 所有子进程共用同一块内存
+ */
+swAllocator* swMemoryGlobal_create(size_t size, char shared)
+{
+	swMemoryGlobal *gm;
+	swAllocator *allocator;
+	static int atfork_registered = 0;
+	void *mem;
+	int flag = MAP_ANONYMOUS | MAP_NORESERVE;
+
+	flag |= shared ? MAP_SHARED : MAP_PRIVATE;
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, flag, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		swWarn("mmap(%ld) fail. Error: %s[%d]", (long) size, strerror(errno), errno);
 		return NULL;
 	}
+	gm = (swMemoryGlobal *) mem;
+	allocator = (swAllocator *) (gm + 1);
 	//分配内存需要加锁
-	if(swMutex_create(&gm.lock, 1) < 0)
+	if (swFutexLock_create(&gm->lock, shared) < 0)
 	{
+		munmap(mem, size);
 		return NULL;
 	}
-	//root
-	gm.root_page = first_page;
-	gm.cur_page = first_page;
-
-	gm_ptr = (swMemoryGlobal *) gm.mem;
-	gm.offset += sizeof(swMemoryGlobal);
+	gm->shared = shared;
+	gm->size = size;
+	gm->mem = mem;
+	gm->offset = SW_MEM_ALIGNED_SIZE(sizeof(swMemoryGlobal) + sizeof(swAllocator));
 
-	swAllocator *allocator = (swAllocator *) (gm.mem + gm.offset);
-	gm.offset += sizeof(swAllocator);
-
-	allocator->object = gm_ptr;
+	allocator->object = gm;
 	allocator->alloc = swMemoryGlobal_alloc;
 	allocator->destroy = swMemoryGlobal_destroy;
 	allocator->free = swMemoryGlobal_free;
 
-	memcpy(gm_ptr, &gm, sizeof(gm));
+	//子进程不能继续使用父进程缓存的块
+	if (!atfork_registered)
+	{
+		pthread_atfork(NULL, NULL, swMemoryGlobal_atfork_child);
+		atfork_registered = 1;
+	}
 	return allocator;
 }
 
+static void swMemoryGlobal_atfork_child(void)
+{
+	bzero(&swMemoryGlobal_cache, sizeof(swMemoryGlobal_cache));
+}
+
+static void swMemoryGlobal_cache_key_create(void)
+{
+	pthread_key_create(&swMemoryGlobal_cache_key, swMemoryGlobal_thread_exit);
+}
+
 /**
- * 使用前8个字节保存next指针
+ * 线程退出时归还缓存的块
  */
-static void* swMemoryGlobal_new_page(swMemoryGlobal *gm)
+static void swMemoryGlobal_thread_exit(void *arg)
 {
-	void *page = (gm->shared == 1) ? sw_shm_malloc(gm->pagesize) : sw_malloc(gm->pagesize);
-	if (page == NULL)
+	swMemoryGlobal_thread_flush();
+}
+
+/**
+ * 把当前线程(进程)缓存的块全部归还到全局空闲链表, worker进程和线程退出前调用
+ */
+void swMemoryGlobal_thread_flush(void)
+{
+	int n;
+
+	if (swMemoryGlobal_cache.gm == NULL)
 	{
-		return NULL;
+		return;
 	}
-	bzero(page, gm->pagesize);
-	//将next设置为NULL
-	((void **)page)[0] = NULL;
+	for (n = 0; n < SW_MEMORY_CLASS_NUM; n++)
+	{
+		swMemoryGlobal_flush(swMemoryGlobal_cache.gm, n, swMemoryGlobal_cache.num[n]);
+	}
+	swMemoryGlobal_cache.gm = NULL;
+}
+
+/**
+ * 从未分配过的区域切出一块, 需要持有锁, 内容为0
+ */
+static swMemoryBlock* swMemoryGlobal_bump(swMemoryGlobal *gm, uint32_t size)
+{
+	swMemoryBlock *block;
 
-	gm->offset = 0;
-	gm->size = gm->pagesize - sizeof(void*);
-	gm->mem = page + sizeof(void*);
-	return page;
+	if (gm->offset + size > gm->size)
+	{
+		return NULL;
+	}
+	block = (swMemoryBlock *) ((char *) gm->mem + gm->offset);
+	gm->offset += size;
+	block->size = size;
+	return block;
 }
 
 static void *swMemoryGlobal_alloc(swAllocator *allocator, int size)
 {
 	swMemoryGlobal *gm = allocator->object;
-	gm->lock.lock(&gm->lock);
-	if (size > gm->pagesize)
+	swMemoryBlock *block = NULL;
+	swMemoryFree *node;
+	int size_class, n, reused = 0;
+	uint32_t need;
+
+	if (size <= 0)
 	{
-		swWarn("swMemoryGlobal_alloc: alloc %d bytes not allow. Max size=%d", size, gm->pagesize);
 		return NULL;
 	}
+	need = SW_MEM_ALIGNED_SIZE(size) + sizeof(swMemoryBlock);
+	if (need > SW_MEMORY_CLASS_MAX)
+	{
+		return swMemoryGlobal_alloc_large(gm, need);
+	}
+	size_class = swMemoryGlobal_class(need);
+	if (swMemoryGlobal_cache.gm != gm)
+	{
+		//线程缓存只服务一个分配器, 切换时先归还
+		swMemoryGlobal_thread_flush();
+		swMemoryGlobal_cache.gm = gm;
+		//线程退出时由key的析构函数归还
+		pthread_once(&swMemoryGlobal_cache_once, swMemoryGlobal_cache_key_create);
+		pthread_setspecific(swMemoryGlobal_cache_key, gm);
+	}
 
-	if (gm->offset + size > gm->size)
+	node = swMemoryGlobal_cache.list[size_class];
+	if (node == NULL)
 	{
-		//没有足够的内存,再次申请
-		swTrace("swMemoryGlobal_alloc new page: size=%d|offset=%d|alloc=%d", gm->size, gm->offset, size);
-		void *page = swMemoryGlobal_new_page(gm);
-		if (page == NULL)
+		//批量从全局空闲链表取回
+		gm->lock.lock(&gm->lock);
+		for (n = 0; n < SW_MEMORY_CACHE_BATCH && gm->free_list[size_class] != NULL; n++)
 		{
-			swWarn("swMemoryGlobal_alloc alloc memory error.");
-			return NULL;
+			node = gm->free_list[size_class];
+			gm->free_list[size_class] = node->next;
+			node->next = swMemoryGlobal_cache.list[size_class];
+			swMemoryGlobal_cache.list[size_class] = node;
+			swMemoryGlobal_cache.num[size_class]++;
+		}
+		//级别链表为空时先从大块的空闲链表切出, 不要继续推高未分配区
+		if (n == 0 && (block = swMemoryGlobal_take_large(gm, swMemoryGlobal_class_size(size_class))) != NULL)
+		{
+			reused = 1;
 		}
-		//将next指向新申请的内存块
-		((void **) gm->cur_page)[0] = page;
-		gm->cur_page = page;
+		else if (n == 0)
+		{
+			block = swMemoryGlobal_bump(gm, swMemoryGlobal_class_size(size_class));
+		}
+		gm->lock.unlock(&gm->lock);
+
+		if (n == 0)
+		{
+			if (block == NULL)
+			{
+				swWarn("global memory is exhausted. size=%ld", (long) gm->size);
+				return NULL;
+			}
+			block->size_class = size_class;
+			block->magic = SW_MEMORY_MAGIC_USED;
+			if (reused)
+			{
+				bzero(swMemoryGlobal_body(block), block->size - sizeof(swMemoryBlock));
+			}
+			return swMemoryGlobal_body(block);
+		}
+		node = swMemoryGlobal_cache.list[size_class];
+	}
+	swMemoryGlobal_cache.list[size_class] = node->next;
+	swMemoryGlobal_cache.num[size_class]--;
+
+	block = ((swMemoryBlock *) node) - 1;
+	block->magic = SW_MEMORY_MAGIC_USED;
+	bzero(node, block->size - sizeof(swMemoryBlock));
+	return node;
+}
+
+/**
+ * 把线程缓存中的n个块归还到全局空闲链表
+ */
+static void swMemoryGlobal_flush(swMemoryGlobal *gm, int size_class, int n)
+{
+	swMemoryFree *node;
+
+	if (n <= 0)
+	{
+		return;
+	}
+	gm->lock.lock(&gm->lock);
+	while (n-- > 0 && (node = swMemoryGlobal_cache.list[size_class]) != NULL)
+	{
+		swMemoryGlobal_cache.list[size_class] = node->next;
+		swMemoryGlobal_cache.num[size_class]--;
+		node->next = gm->free_list[size_class];
+		gm->free_list[size_class] = node;
 	}
-	void *mem = gm->mem + gm->offset;
-	gm->offset += size;
 	gm->lock.unlock(&gm->lock);
-	return mem;
 }
 
 static void swMemoryGlobal_free(swAllocator *allocator, void *ptr)
 {
-	swWarn("swMemoryGlobal Allocator no free.");
+	swMemoryGlobal *gm = allocator->object;
+	swMemoryBlock *block = ((swMemoryBlock *) ptr) - 1;
+	swMemoryFree *node = ptr;
+
+	if ((char *) block < (char *) gm->mem || (char *) ptr >= (char *) gm->mem + gm->offset || block->magic != SW_MEMORY_MAGIC_USED)
+	{
+		swWarn("invalid pointer or double free. ptr=%p", ptr);
+		return;
+	}
+	block->magic = SW_MEMORY_MAGIC_FREE;
+	if (block->size_class == SW_MEMORY_CLASS_LARGE)
+	{
+		swMemoryGlobal_free_large(gm, block);
+		return;
+	}
+	//其他分配器的块直接还到全局链表
+	if (swMemoryGlobal_cache.gm != gm)
+	{
+		gm->lock.lock(&gm->lock);
+		node->next = gm->free_list[block->size_class];
+		gm->free_list[block->size_class] = node;
+		gm->lock.unlock(&gm->lock);
+		return;
+	}
+	node->next = swMemoryGlobal_cache.list[block->size_class];
+	swMemoryGlobal_cache.list[block->size_class] = node;
+	if (++swMemoryGlobal_cache.num[block->size_class] >= SW_MEMORY_CACHE_NUM)
+	{
+		swMemoryGlobal_flush(gm, block->size_class, SW_MEMORY_CACHE_NUM / 2);
+	}
+}
+
+/**
+ * 大块按地址排序first-fit, 需要持有锁, 返回的块内容不是0
+ */
+static swMemoryBlock* swMemoryGlobal_take_large(swMemoryGlobal *gm, uint32_t size)
+{
+	swMemoryBlock *block, *rest;
+	swMemoryFree *node, **prev;
+
+	for (prev = &gm->large_list; (node = *prev) != NULL; prev = &node->next)
+	{
+		block = ((swMemoryBlock *) node) - 1;
+		if (block->size < size)
+		{
+			continue;
+		}
+		//剩余部分足够大时拆分, 剩余部分留在链表中的原位置
+		if (block->size - size >= SW_MEMORY_LARGE_SPLIT)
+		{
+			rest = (swMemoryBlock *) ((char *) block + size);
+			rest->size = block->size - size;
+			rest->size_class = SW_MEMORY_CLASS_LARGE;
+			rest->magic = SW_MEMORY_MAGIC_FREE;
+			((swMemoryFree *) swMemoryGlobal_body(rest))->next = node->next;
+			*prev = swMemoryGlobal_body(rest);
+			block->size = size;
+		}
+		else
+		{
+			*prev = node->next;
+		}
+		return block;
+	}
+	return NULL;
+}
+
+/**
+ * 释放时与相邻的空闲块合并
+ */
+static void* swMemoryGlobal_alloc_large(swMemoryGlobal *gm, uint32_t size)
+{
+	swMemoryBlock *block;
+	int reused = 1;
+
+	size = SW_MEM_ALIGNED_SIZE(size);
+	gm->lock.lock(&gm->lock);
+	block = swMemoryGlobal_take_large(gm, size);
+	if (block == NULL)
+	{
+		block = swMemoryGlobal_bump(gm, size);
+		reused = 0;
+	}
+	gm->lock.unlock(&gm->lock);
+
+	if (block == NULL)
+	{
+		swWarn("global memory is exhausted. size=%ld|alloc=%u", (long) gm->size, size);
+		return NULL;
+	}
+	block->size_class = SW_MEMORY_CLASS_LARGE;
+	block->magic = SW_MEMORY_MAGIC_USED;
+	if (reused)
+	{
+		bzero(swMemoryGlobal_body(block), block->size - sizeof(swMemoryBlock));
+	}
+	return swMemoryGlobal_body(block);
+}
+
+/**
+ * 退回给未分配区的内存必须是0, 首尾不完整的页面不能decommit, 直接清零
+ */
+static void swMemoryGlobal_decommit(void *addr, size_t length)
+{
+	uintptr_t pagesize = (uintptr_t) getpagesize();
+	uintptr_t start = (uintptr_t) addr, end = start + length;
+	uintptr_t head = (start + pagesize - 1) & ~(pagesize - 1);
+	uintptr_t tail = end & ~(pagesize - 1);
+
+	if (tail <= head)
+	{
+		bzero(addr, length);
+		return;
+	}
+	bzero(addr, head - start);
+	bzero((void *) tail, end - tail);
+	sw_shm_decommit((void *) head, tail - head);
+}
+
+static void swMemoryGlobal_free_large(swMemoryGlobal *gm, swMemoryBlock *block)
+{
+	swMemoryFree *node = swMemoryGlobal_body(block), **prev;
+	swMemoryBlock *prev_block = NULL, *next_block;
+
+	gm->lock.lock(&gm->lock);
+	for (prev = &gm->large_list; *prev != NULL && (void *) *prev < (void *) node; prev = &(*prev)->next)
+	{
+		prev_block = ((swMemoryBlock *) *prev) - 1;
+	}
+	node->next = *prev;
+	*prev = node;
+	//合并后面的空闲块
+	if (node->next != NULL)
+	{
+		next_block = ((swMemoryBlock *) node->next) - 1;
+		if ((char *) block + block->size == (char *) next_block)
+		{
+			block->size += next_block->size;
+			node->next = ((swMemoryFree *) node->next)->next;
+		}
+	}
+	//合并到前面的空闲块
+	if (prev_block != NULL && (char *) prev_block + prev_block->size == (char *) block)
+	{
+		prev_block->size += block->size;
+		((swMemoryFree *) swMemoryGlobal_body(prev_block))->next = node->next;
+		block = prev_block;
+		node = swMemoryGlobal_body(block);
+		prev = NULL;
+	}
+	//位于分配区末尾时直接退回给未分配区
+	if (node->next == NULL && (char *) block + block->size == (char *) gm->mem + gm->offset)
+	{
+		if (prev == NULL)
+		{
+			for (prev = &gm->large_list; *prev != node; prev = &(*prev)->next);
+		}
+		*prev = NULL;
+		gm->offset -= block->size;
+		swMemoryGlobal_decommit(block, block->size);
+	}
+	else
+	{
+		sw_shm_decommit(node + 1, block->size - sizeof(swMemoryBlock) - sizeof(swMemoryFree));
+	}
+	gm->lock.unlock(&gm->lock);
+}
+
+/**
+ * 指针是否由此分配器分配
+ */
+int swMemoryGlobal_contains(swAllocator *allocator, void *ptr)
+{
+	swMemoryGlobal *gm = allocator->object;
+	return (char *) ptr > (char *) gm->mem && (char *) ptr < (char *) gm->mem + gm->offset;
+}
+
+/**
+ * 块的可用长度
+ */
+size_t swMemoryGlobal_size(void *ptr)
+{
+	return (((swMemoryBlock *) ptr) - 1)->size - sizeof(swMemoryBlock);
 }
 
 static void swMemoryGlobal_destroy(swAllocator *allocator)
 {
 	swMemoryGlobal *gm = allocator->object;
-	void *page = gm->root_page;
-	void *next =((void **)page)[0];
-	while(next != NULL)
+	if (swMemoryGlobal_cache.gm == gm)
 	{
-		next = ((void **)next)[0];
-		sw_shm_free(page);
-		swTrace("swMemoryGlobal free=%p", next);
+		bzero(&swMemoryGlobal_cache, sizeof(swMemoryGlobal_cache));
 	}
+	gm->lock.free(&gm->lock);
+	munmap(gm->mem, gm->size);
 }
 
 /**
  * 固定尺寸随机释放的内存池
+ * 空闲的slab通过next串成单链表, alloc/free都是O(1)
  */
 int swMemoryPool_create(swMemoryPool *pool, int memory_limit, int slab_size)
 {
 	pool->head = NULL;
 	pool->tail = NULL;
 	pool->memory_limit = memory_limit;
-	pool->slab_size = slab_size; //固定大小
+	//保证data按8字节对齐
+	pool->slab_size = SW_MEM_ALIGNED_SIZE(slab_size); //固定大小
 	pool->memory_usage = 0;
 	pool->block_size = (sizeof(swMemoryPoolSlab) + pool->slab_size) * SW_MEMORY_POOL_SLAB_PAGE;
 	//扩展内存
@@ -158,81 +511,50 @@ int swMemoryPool_expand(swMemoryPool *pool)
 		return -1;
 	}
 	pool->memory_usage += pool->block_size;
-//	int i = 0;
+
 	swMemoryPoolSlab *slab;
 	void *cur = mem;
 	void *max = mem + pool->block_size;
 
-//	printf("Memory Expand.\n");
-	do
+	while (cur < max)
 	{
 		slab = (swMemoryPoolSlab *) cur;
 		slab->data = (slab + 1);
 		slab->tag = 0;
-		if (pool->head != NULL)
-		{
-			pool->head->pre = slab;
-			slab->next = pool->head;
-		}
-		//第一次运行
-		else
-		{
-			pool->tail = slab;
-		}
-		pool->head = slab; //放到头部
+		slab->pre = NULL;
+		//放到空闲链表头部
+		slab->next = pool->head;
+		pool->head = slab;
 		cur += (sizeof(swMemoryPoolSlab) + pool->slab_size);
-		slab->pre = (swMemoryPoolSlab *) cur;
-	} while (cur < max);
-
+	}
 	return 0;
 }
 
 void* swMemoryPool_alloc(swMemoryPool *pool)
 {
 	swMemoryPoolSlab *slab;
-	alloc_start: slab = pool->head;
-	//有可分配块
-	if (slab->tag == 0)
-	{
-		slab->tag = 1; //标记为已使用
-		pool->head = slab->next; //将下一个内存块作为待分配区
-		slab->next->pre = NULL;
-		pool->tail->next = slab; //将自己加入到队尾
-
-		slab->next = NULL;
-		slab->pre = pool->tail; //将slab的pre指定为队尾
-
-		pool->tail = slab; //将自己加入到队尾
-		return slab->data;
-	}
 	//需要扩容
-	else if (pool->memory_limit > pool->memory_usage)
+	if (pool->head == NULL)
 	{
-		if (swMemoryPool_expand(pool) < 0)
+		if (pool->memory_limit <= pool->memory_usage || swMemoryPool_expand(pool) < 0)
 		{
 			return NULL;
 		}
-		goto alloc_start;
-	}
-	else
-	{
-		return NULL;
 	}
+	slab = pool->head;
+	pool->head = slab->next;
+	slab->next = NULL;
+	slab->tag = 1; //标记为已使用
+	return slab->data;
 }
 
 void swMemoryPool_print(swMemoryPool *pool)
 {
 	int line = 0;
 	swMemoryPoolSlab *slab = pool->head;
-//	printf("swMemoryPool_print: head=%p\n", slab);
 	printf("===============================%s=================================\n", __FUNCTION__);
 	while (slab != NULL)
 	{
-		if (slab->next == slab)
-		{
-			printf("-------------------@@@@@@@@@@@@@@@@@@@@@@----------------\n");
-
-		}
 		printf("#%d\t", line);
 		swMemoryPool_print_slab(slab);
 
@@ -246,7 +568,6 @@ void swMemoryPool_print(swMemoryPool *pool)
 void swMemoryPool_print_slab(swMemoryPoolSlab *slab)
 {
 	printf("Slab[%p]\t", slab);
-	printf("pre=%p\t", slab->pre);
 	printf("next=%p\t", slab->next);
 	printf("tag=%d\t", slab->tag);
 	printf("data=%p\n", slab->data);
@@ -254,34 +575,14 @@ void swMemoryPool_print_slab(swMemoryPoolSlab *slab)
 
 void swMemoryPool_free(swMemoryPool *pool, void *data)
 {
-//	printf("Memory free.\n");
-	swMemoryPoolSlab *slab;
-
-	slab = data - sizeof(swMemoryPoolSlab);
-	slab->tag = 0;
-
-	//队头 AB
-	if (slab->pre == NULL)
+	swMemoryPoolSlab *slab = data - sizeof(swMemoryPoolSlab);
+	if (slab->tag == 0)
 	{
-		//直接返回
+		swWarn("swMemoryPool: double free. slab=%p", slab);
 		return;
 	}
-	//队尾 DE
-	if (slab->next == NULL)
-	{
-		slab->pre->next = NULL; //将上一个设为队尾
-	}
-	//中间区域 BCD
-	else
-	{
-		//BCD 连接BD
-		slab->pre->next = slab->next;
-		slab->next->pre = slab->pre;
-//		printf("slab=%p\tslab->pre->next=%p|slab->next->pre=%p\n", slab, slab->pre->next, slab->next->pre);
-	}
-	slab->pre = NULL;
-	slab->next = pool->head; //加入待分配区
-	pool->head->pre = slab; //队头的上级指为当前
-	pool->head = slab; //将自己设为队头
+	slab->tag = 0;
+	//加入待分配区
+	slab->next = pool->head;
+	pool->head = slab;
 }
-
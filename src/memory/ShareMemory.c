@@ -16,11 +16,22 @@
 
 #include "swoole.h"
 #include "memory.h"
+#include <limits.h>
 
+/**
+ * 优先从全局内存分配, fork之后分配的内存也是所有进程共享的
+ * 全局内存耗尽或者还未初始化时单独mmap
+ */
 void* sw_shm_malloc(size_t size)
 {
 	swShareMemory object;
 	void *mem;
+
+	if (SwooleG.memory_pool != NULL && size <= INT_MAX
+			&& (mem = SwooleG.memory_pool->alloc(SwooleG.memory_pool, size)) != NULL)
+	{
+		return mem;
+	}
 	//object对象需要保存在头部
 	size += sizeof(swShareMemory);
 	mem = swShareMemory_mmap_create(&object, size, NULL);
@@ -40,6 +51,13 @@ void* sw_shm_calloc(size_t num, size_t _size)
 	swShareMemory object;
 	void *mem;
 	void *ret_mem;
+
+	//全局内存返回的内存已清零
+	if (SwooleG.memory_pool != NULL && num * _size <= INT_MAX
+			&& (mem = SwooleG.memory_pool->alloc(SwooleG.memory_pool, num * _size)) != NULL)
+	{
+		return mem;
+	}
 	//object对象需要保存在头部
 	int size = sizeof(swShareMemory) + (num * _size);
 	mem = swShareMemory_mmap_create(&object, size, NULL);
@@ -57,8 +75,84 @@ void* sw_shm_calloc(size_t num, size_t _size)
 	}
 }
 
+/**
+ * 只预留地址空间(MAP_NORESERVE), 首次访问时才分配物理内存, 内容为0
+ * 用于按fd索引的大数组, 可以用sw_shm_free释放
+ */
+void* sw_shm_reserve(size_t size)
+{
+#if defined(MAP_ANONYMOUS) && defined(MAP_NORESERVE)
+	swShareMemory object;
+	void *mem;
+
+	size += sizeof(swShareMemory);
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		swWarn("mmap(MAP_NORESERVE) fail. Error: %s[%d]", strerror(errno), errno);
+		return NULL;
+	}
+	sw_shm_hugepage(mem, size);
+	bzero(&object, sizeof(swShareMemory));
+	object.size = size;
+	object.mem = mem;
+	object.tmpfd = -1;
+	memcpy(mem, &object, sizeof(swShareMemory));
+	return mem + sizeof(swShareMemory);
+#else
+	return sw_shm_calloc(1, size);
+#endif
+}
+
+/**
+ * 开启hugepage时建议内核对较大的共享内存使用透明大页, 比如全局内存和连接列表
+ * 共享内存需要/sys/kernel/mm/transparent_hugepage/shmem_enabled为advise或always
+ */
+void sw_shm_hugepage(void *mem, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	if (SwooleG.hugepage != SW_HUGEPAGE_NONE && size >= SW_HUGEPAGE_SIZE)
+	{
+		madvise(mem, size, MADV_HUGEPAGE);
+	}
+#endif
+}
+
+/**
+ * 归还[addr, addr+length)中完整页面的物理内存, 再次访问时重新分配并清零
+ */
+int sw_shm_decommit(void *addr, size_t length)
+{
+	uintptr_t pagesize = (uintptr_t) getpagesize();
+	uintptr_t start = ((uintptr_t) addr + pagesize - 1) & ~(pagesize - 1);
+	uintptr_t end = ((uintptr_t) addr + length) & ~(pagesize - 1);
+
+	if (end <= start)
+	{
+		return SW_OK;
+	}
+#ifdef MADV_REMOVE
+	//共享内存必须使用MADV_REMOVE才能释放
+	if (madvise((void *) start, end - start, MADV_REMOVE) == 0)
+	{
+		return SW_OK;
+	}
+#endif
+	if (madvise((void *) start, end - start, MADV_DONTNEED) < 0)
+	{
+		swWarn("madvise fail. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
 void sw_shm_free(void *ptr)
 {
+	if (SwooleG.memory_pool != NULL && swMemoryGlobal_contains(SwooleG.memory_pool, ptr))
+	{
+		SwooleG.memory_pool->free(SwooleG.memory_pool, ptr);
+		return;
+	}
 	//object对象在头部，如果释放了错误的对象可能会发生段错误
 	swShareMemory *object = ptr - sizeof(swShareMemory);
 #ifdef SW_DEBUG
@@ -70,10 +164,17 @@ void sw_shm_free(void *ptr)
 void* sw_shm_realloc(void *ptr, size_t new_size)
 {
 	swShareMemory *object = ptr - sizeof(swShareMemory);
-#ifdef SW_DEBUG
-	char check = *(char *)(ptr + object->size); //尝试访问
-#endif
+	size_t old_size;
 	void *new_ptr;
+
+	if (SwooleG.memory_pool != NULL && swMemoryGlobal_contains(SwooleG.memory_pool, ptr))
+	{
+		old_size = swMemoryGlobal_size(ptr);
+	}
+	else
+	{
+		old_size = object->size - sizeof(swShareMemory);
+	}
 	new_ptr = sw_shm_malloc(new_size);
 	if(new_ptr==NULL)
 	{
@@ -81,7 +182,7 @@ void* sw_shm_realloc(void *ptr, size_t new_size)
 	}
 	else
 	{
-		memcpy(new_ptr, ptr, object->size);
+		memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
 		sw_shm_free(ptr);
 		return new_ptr;
 	}
@@ -109,6 +210,21 @@ void *swShareMemory_mmap_create(swShareMemory *object, int size, char *mapfile)
 	object->tmpfd = tmpfd;
 #endif
 
+#ifdef MAP_HUGETLB
+	//大页不足时回退到普通页面
+	if (SwooleG.hugepage == SW_HUGEPAGE_HUGETLB && size >= SW_HUGEPAGE_SIZE && tmpfd < 0)
+	{
+		int huge_size = (size + SW_HUGEPAGE_SIZE - 1) & ~(SW_HUGEPAGE_SIZE - 1);
+		mem = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, flag | MAP_HUGETLB, tmpfd, 0);
+		if (mem != MAP_FAILED)
+		{
+			object->size = huge_size;
+			object->mem = mem;
+			return mem;
+		}
+		swTrace("mmap(MAP_HUGETLB) fail. Error: %s[%d]", strerror(errno), errno);
+	}
+#endif
 	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, flag, tmpfd, 0);
 #ifdef MAP_FAILED
 	if (mem == MAP_FAILED)
@@ -123,6 +239,7 @@ void *swShareMemory_mmap_create(swShareMemory *object, int size, char *mapfile)
 	{
 		object->size = size;
 		object->mem = mem;
+		sw_shm_hugepage(mem, size);
 		return mem;
 	}
 }
@@ -0,0 +1,385 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+#include "table.h"
+
+static swTableRow* swTable_alloc_row(swTable *table);
+static void swTable_free_row(swTable *table, uint32_t index);
+
+swTable* swTable_new(uint32_t rows_size)
+{
+	uint32_t size = 1;
+	swTable *table;
+
+	while (size < rows_size)
+	{
+		size <<= 1;
+	}
+	table = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(swTable));
+	if (table == NULL)
+	{
+		swWarn("alloc swTable fail.");
+		return NULL;
+	}
+	bzero(table, sizeof(swTable));
+	if (swFutexLock_create(&table->lock, 1) < 0)
+	{
+		return NULL;
+	}
+	table->size = size;
+	table->mask = size - 1;
+	table->conflict_num = size * SW_TABLE_CONFLICT_PROPORTION;
+	table->item_size = sizeof(swTableRow);
+	return table;
+}
+
+int swTable_column_add(swTable *table, char *name, int len, int type, int size)
+{
+	swTableColumn *col;
+
+	if (table->rows != NULL)
+	{
+		swWarn("table has been created, can not add column.");
+		return SW_ERR;
+	}
+	if (table->column_num == SW_TABLE_COLUMN_NUM)
+	{
+		swWarn("too many columns. [MAX=%d]", SW_TABLE_COLUMN_NUM);
+		return SW_ERR;
+	}
+	if (len <= 0 || len >= SW_TABLE_COLUMN_NAME_SIZE || swTable_column_find(table, name, len) != NULL)
+	{
+		swWarn("column name is invalid or exists.");
+		return SW_ERR;
+	}
+	switch (type)
+	{
+	case SW_TABLE_INT:
+		if (size != 1 && size != 2 && size != 4 && size != 8)
+		{
+			size = 8;
+		}
+		break;
+	case SW_TABLE_FLOAT:
+		size = sizeof(double);
+		break;
+	case SW_TABLE_STRING:
+		if (size <= 0 || size > UINT16_MAX)
+		{
+			swWarn("string column size[%d] is invalid.", size);
+			return SW_ERR;
+		}
+		size += sizeof(uint16_t);
+		break;
+	default:
+		swWarn("unknown column type[%d].", type);
+		return SW_ERR;
+	}
+	col = &table->columns[table->column_num++];
+	col->type = type;
+	col->size = size;
+	col->index = table->item_size - sizeof(swTableRow);
+	col->name_len = len;
+	memcpy(col->name, name, len);
+	table->item_size += size;
+	return SW_OK;
+}
+
+swTableColumn* swTable_column_find(swTable *table, char *name, int len)
+{
+	int i;
+	for (i = 0; i < table->column_num; i++)
+	{
+		if (table->columns[i].name_len == len && memcmp(table->columns[i].name, name, len) == 0)
+		{
+			return &table->columns[i];
+		}
+	}
+	return NULL;
+}
+
+int swTable_create(swTable *table)
+{
+	size_t memory_size;
+
+	if (table->rows != NULL)
+	{
+		return SW_OK;
+	}
+	//行之间按8字节对齐, 保证整数和锁的原子访问
+	table->item_size = SW_MEM_ALIGNED_SIZE(table->item_size);
+	memory_size = (size_t) (table->size + table->conflict_num) * table->item_size;
+	//匿名映射的内存已经是0
+	table->rows = swShareMemory_mmap_create(&table->memory, memory_size, NULL);
+	if (table->rows == NULL)
+	{
+		swWarn("create table memory fail. size=%ld", (long) memory_size);
+		return SW_ERR;
+	}
+	table->conflict_used = table->size;
+	return SW_OK;
+}
+
+void swTable_free(swTable *table)
+{
+	if (table->rows != NULL)
+	{
+		swShareMemory_mmap_free(&table->memory);
+		table->rows = NULL;
+	}
+}
+
+static swTableRow* swTable_alloc_row(swTable *table)
+{
+	swTableRow *row = NULL;
+	uint32_t index = 0;
+
+	table->lock.lock(&table->lock);
+	if (table->free_list != 0)
+	{
+		index = table->free_list;
+		table->free_list = swTable_row(table, index)->next;
+	}
+	else if (table->conflict_used < table->size + table->conflict_num)
+	{
+		index = table->conflict_used++;
+	}
+	table->lock.unlock(&table->lock);
+
+	if (index != 0)
+	{
+		row = swTable_row(table, index);
+		bzero(row, table->item_size);
+		//借用lock字段保存下标, 链接到桶之前清零
+		row->lock = index;
+	}
+	return row;
+}
+
+static void swTable_free_row(swTable *table, uint32_t index)
+{
+	swTableRow *row = swTable_row(table, index);
+
+	table->lock.lock(&table->lock);
+	row->active = 0;
+	row->next = table->free_list;
+	table->free_list = index;
+	table->lock.unlock(&table->lock);
+}
+
+SWINLINE static swTableRow* swTable_hash(swTable *table, char *key, int keylen)
+{
+	return swTable_row(table, swoole_hash_fnv1a(key, keylen) & table->mask);
+}
+
+#define swTableRow_match(row, key, keylen)  ((row)->active && (row)->key_len == keylen && memcmp((row)->key, key, keylen) == 0)
+
+swTableRow* swTableRow_get(swTable *table, char *key, int keylen, swTableRow **lock_row)
+{
+	swTableRow *row;
+
+	if (keylen <= 0 || keylen > SW_TABLE_KEY_SIZE)
+	{
+		return NULL;
+	}
+	row = swTable_hash(table, key, keylen);
+	*lock_row = row;
+	swTableRow_lock(row);
+	while (1)
+	{
+		if (swTableRow_match(row, key, keylen))
+		{
+			return row;
+		}
+		if (row->next == 0)
+		{
+			break;
+		}
+		row = swTable_row(table, row->next);
+	}
+	swTableRow_unlock(*lock_row);
+	return NULL;
+}
+
+swTableRow* swTableRow_set(swTable *table, char *key, int keylen, swTableRow **lock_row)
+{
+	swTableRow *head, *row;
+	uint32_t index;
+
+	if (keylen <= 0 || keylen > SW_TABLE_KEY_SIZE)
+	{
+		swWarn("key length[%d] is invalid. [MAX=%d]", keylen, SW_TABLE_KEY_SIZE);
+		return NULL;
+	}
+	head = swTable_hash(table, key, keylen);
+	*lock_row = head;
+	swTableRow_lock(head);
+	if (!head->active)
+	{
+		row = head;
+		bzero(row->data, table->item_size - sizeof(swTableRow));
+	}
+	else
+	{
+		for (row = head; ; row = swTable_row(table, row->next))
+		{
+			if (swTableRow_match(row, key, keylen))
+			{
+				return row;
+			}
+			if (row->next == 0)
+			{
+				break;
+			}
+		}
+		row = swTable_alloc_row(table);
+		if (row == NULL)
+		{
+			swTableRow_unlock(head);
+			swWarn("no available conflict row. [MAX=%d]", table->conflict_num);
+			return NULL;
+		}
+		index = row->lock;
+		row->lock = 0;
+		//插入到桶之后, 不需要遍历到链表尾
+		row->next = head->next;
+		head->next = index;
+	}
+	row->active = 1;
+	row->key_len = keylen;
+	memcpy(row->key, key, keylen);
+	sw_atomic_fetch_add(&table->row_num, 1);
+	return row;
+}
+
+int swTableRow_del(swTable *table, char *key, int keylen)
+{
+	swTableRow *head, *row, *prev;
+	uint32_t index;
+
+	if (keylen <= 0 || keylen > SW_TABLE_KEY_SIZE)
+	{
+		return SW_ERR;
+	}
+	head = swTable_hash(table, key, keylen);
+	swTableRow_lock(head);
+	if (swTableRow_match(head, key, keylen))
+	{
+		//把第一个冲突行移到桶中
+		if (head->next != 0)
+		{
+			index = head->next;
+			row = swTable_row(table, index);
+			memcpy((char *) head + sizeof(atomic_t), (char *) row + sizeof(atomic_t), table->item_size - sizeof(atomic_t));
+			swTable_free_row(table, index);
+		}
+		else
+		{
+			head->active = 0;
+		}
+		goto deleted;
+	}
+	for (prev = head; prev->next != 0; prev = row)
+	{
+		index = prev->next;
+		row = swTable_row(table, index);
+		if (swTableRow_match(row, key, keylen))
+		{
+			prev->next = row->next;
+			swTable_free_row(table, index);
+			goto deleted;
+		}
+	}
+	swTableRow_unlock(head);
+	return SW_ERR;
+
+	deleted:
+	sw_atomic_fetch_sub(&table->row_num, 1);
+	swTableRow_unlock(head);
+	return SW_OK;
+}
+
+void swTableRow_set_value(swTableRow *row, swTableColumn *col, void *value, int vlen)
+{
+	char *data = swTableColumn_data(row, col);
+	uint16_t len;
+
+	switch (col->type)
+	{
+	case SW_TABLE_INT:
+		swTableRow_set_int(row, col, *(int64_t *) value);
+		break;
+	case SW_TABLE_FLOAT:
+		memcpy(data, value, sizeof(double));
+		break;
+	default:
+		len = vlen > col->size - sizeof(uint16_t) ? col->size - sizeof(uint16_t) : vlen;
+		memcpy(data, &len, sizeof(len));
+		memcpy(data + sizeof(len), value, len);
+		break;
+	}
+}
+
+int64_t swTableRow_get_int(swTableRow *row, swTableColumn *col)
+{
+	char *data = swTableColumn_data(row, col);
+	int8_t v8;
+	int16_t v16;
+	int32_t v32;
+	int64_t v64;
+
+	switch (col->size)
+	{
+	case 1:
+		memcpy(&v8, data, 1);
+		return v8;
+	case 2:
+		memcpy(&v16, data, 2);
+		return v16;
+	case 4:
+		memcpy(&v32, data, 4);
+		return v32;
+	default:
+		memcpy(&v64, data, 8);
+		return v64;
+	}
+}
+
+void swTableRow_set_int(swTableRow *row, swTableColumn *col, int64_t value)
+{
+	char *data = swTableColumn_data(row, col);
+	int8_t v8 = value;
+	int16_t v16 = value;
+	int32_t v32 = value;
+
+	switch (col->size)
+	{
+	case 1:
+		memcpy(data, &v8, 1);
+		break;
+	case 2:
+		memcpy(data, &v16, 2);
+		break;
+	case 4:
+		memcpy(data, &v32, 4);
+		break;
+	default:
+		memcpy(data, &value, 8);
+		break;
+	}
+}
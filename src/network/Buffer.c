@@ -17,6 +17,14 @@
 #include "swoole.h"
 #include "Server.h"
 
+#include <limits.h>
+#include <sys/uio.h>
+
+#if defined(IOV_MAX) && IOV_MAX < SW_BUFFER_IOV_MAX
+#undef SW_BUFFER_IOV_MAX
+#define SW_BUFFER_IOV_MAX          IOV_MAX
+#endif
+
 /**
  * create new buffer
  */
@@ -35,33 +43,97 @@ swBuffer* swBuffer_new(int trunk_size)
 	return buffer;
 }
 
+static const int swBufferPool_class_size[SW_BUFFER_POOL_CLASS_NUM] =
+{
+	SW_BUFFER_POOL_SMALL_SIZE,
+	SW_BUFFER_SIZE,
+};
+
 /**
- * create new trunk
+ * create trunk pool, one size class per swMemoryPool
  */
-swBuffer_trunk *swBuffer_new_trunk(swBuffer *buffer, uint32_t type, uint16_t size)
+int swBufferPool_create(swBufferPool *pool, int memory_limit)
 {
-	swBuffer_trunk *trunk = sw_malloc(sizeof(swBuffer_trunk));
-	if (trunk == NULL)
+	int i;
+	bzero(pool, sizeof(swBufferPool));
+	for (i = 0; i < SW_BUFFER_POOL_CLASS_NUM; i++)
 	{
-		swWarn("malloc for trunk failed. Error: %s[%d]", strerror(errno), errno);
-		return NULL;
+		if (swMemoryPool_create(&pool->size_class[i], memory_limit, sizeof(swBuffer_trunk) + swBufferPool_class_size[i]) < 0)
+		{
+			swWarn("create trunk pool[size=%d] failed.", swBufferPool_class_size[i]);
+			return SW_ERR;
+		}
 	}
+	return SW_OK;
+}
 
-	bzero(trunk, sizeof(swBuffer_trunk));
+static void swBuffer_free_trunk(swBuffer_trunk *trunk)
+{
+	if (trunk->type == SW_TRUNK_SHARED)
+	{
+		swBuffer_shared_release((swBuffer_shared *) trunk->data);
+	}
+	//关闭连接时未发送完的文件
+	else if (trunk->type == SW_TRUNK_SENDFILE && trunk->data != NULL)
+	{
+		swTask_sendfile_free((swTask_sendfile *) trunk->data);
+	}
+	if (trunk->pool != NULL)
+	{
+		swMemoryPool_free(trunk->pool, trunk);
+	}
+	else
+	{
+		sw_free(trunk);
+	}
+}
 
-	//require alloc memory
-	if (type == SW_TRUNK_DATA && size > 0)
+/**
+ * create new trunk, the header and the data are in one allocation
+ */
+swBuffer_trunk *swBuffer_new_trunk(swBuffer *buffer, uint32_t type, uint32_t size)
+{
+	swBuffer_trunk *trunk = NULL;
+	swMemoryPool *pool = NULL;
+	int i;
+
+	//only data trunk require alloc memory
+	if (type != SW_TRUNK_DATA)
+	{
+		size = 0;
+	}
+
+	if (buffer->pool != NULL)
+	{
+		for (i = 0; i < SW_BUFFER_POOL_CLASS_NUM; i++)
+		{
+			if (size <= swBufferPool_class_size[i])
+			{
+				pool = &buffer->pool->size_class[i];
+				trunk = swMemoryPool_alloc(pool);
+				break;
+			}
+		}
+	}
+
+	//size-class fallback: large payload or pool is full
+	if (trunk == NULL)
 	{
-		void *buf = sw_malloc(size);
-		if (buf == NULL)
+		pool = NULL;
+		trunk = sw_malloc(sizeof(swBuffer_trunk) + size);
+		if (trunk == NULL)
 		{
-			swWarn("malloc for data failed. Error: %s[%d]", strerror(errno), errno);
-			sw_free(trunk);
+			swWarn("malloc for trunk failed. Error: %s[%d]", strerror(errno), errno);
 			return NULL;
 		}
-		trunk->data = buf;
 	}
 
+	bzero(trunk, sizeof(swBuffer_trunk));
+	trunk->pool = pool;
+	if (size > 0)
+	{
+		trunk->data = (void *) (trunk + 1);
+	}
 	trunk->type = type;
 	buffer->trunk_num ++;
 
@@ -94,11 +166,11 @@ SWINLINE void swBuffer_pop_trunk(swBuffer *buffer, swBuffer_trunk *trunk)
 		buffer->head = trunk->next;
 		buffer->trunk_num --;
 	}
-	if (trunk->type == SW_TRUNK_DATA)
+	if (swBuffer_trunk_is_data(trunk))
 	{
-		sw_free(trunk->data);
+		buffer->length -= (trunk->length - trunk->offset);
 	}
-	sw_free(trunk);
+	swBuffer_free_trunk(trunk);
 }
 
 /**
@@ -110,13 +182,9 @@ int swBuffer_free(swBuffer *buffer)
 	swBuffer_trunk *will_free_trunk; //free the point
 	while (trunk != NULL)
 	{
-		if (trunk->type == SW_TRUNK_DATA)
-		{
-			sw_free(trunk->data);
-		}
 		will_free_trunk = trunk;
 		trunk = trunk->next;
-		sw_free(will_free_trunk);
+		swBuffer_free_trunk(will_free_trunk);
 	}
 	sw_free(buffer);
 	return SW_OK;
@@ -135,6 +203,7 @@ int swBuffer_in(swBuffer *buffer, swSendData *send_data)
 
 	trunk->length = send_data->info.len;
 	memcpy(trunk->data, send_data->data, trunk->length);
+	buffer->length += trunk->length;
 
 	swTraceLog(SW_TRACE_BUFFER, "trunk_n=%d|data_len=%d|trunk_len=%d|trunk=%p", buffer->trunk_num, send_data->info.len,
 			trunk->length, trunk);
@@ -142,6 +211,120 @@ int swBuffer_in(swBuffer *buffer, swSendData *send_data)
 	return SW_OK;
 }
 
+/**
+ * 在send_arena中分配共享数据, 初始引用计数为1, 归调用者所有, 数据由调用者填充
+ */
+swBuffer_shared* swBuffer_shared_alloc(uint32_t length)
+{
+	swBuffer_shared *shared;
+	if (SwooleG.send_arena == NULL)
+	{
+		return NULL;
+	}
+	shared = SwooleG.send_arena->alloc(SwooleG.send_arena, sizeof(swBuffer_shared) + length);
+	if (shared == NULL)
+	{
+		return NULL;
+	}
+	shared->refcount = 1;
+	shared->length = length;
+	return shared;
+}
+
+swBuffer_shared* swBuffer_shared_new(char *data, uint32_t length)
+{
+	swBuffer_shared *shared = swBuffer_shared_alloc(length);
+	if (shared != NULL)
+	{
+		memcpy(shared->data, data, length);
+	}
+	return shared;
+}
+
+SWINLINE void swBuffer_shared_release(swBuffer_shared *shared)
+{
+	if (sw_atomic_fetch_sub(&shared->refcount, 1) == 1)
+	{
+		SwooleG.send_arena->free(SwooleG.send_arena, shared);
+	}
+}
+
+/**
+ * 追加一个共享数据的引用, offset之前的数据已经发送
+ */
+int swBuffer_append_shared(swBuffer *buffer, swBuffer_shared *shared, uint32_t offset)
+{
+	swBuffer_trunk *trunk = swBuffer_new_trunk(buffer, SW_TRUNK_SHARED, 0);
+	if (trunk == NULL)
+	{
+		return SW_ERR;
+	}
+	sw_atomic_fetch_add(&shared->refcount, 1);
+	trunk->data = shared;
+	trunk->length = shared->length;
+	trunk->offset = offset;
+	buffer->length += trunk->length - offset;
+	return SW_OK;
+}
+
+/**
+ * gather-send the head data trunks with writev, return the bytes sent
+ * 发送完的trunk会被弹出，部分发送的trunk只移动offset
+ */
+int swBuffer_writev(swBuffer *buffer, int fd)
+{
+	struct iovec iov[SW_BUFFER_IOV_MAX];
+	swBuffer_trunk *trunk = buffer->head;
+	int iovcnt = 0;
+	ssize_t ret;
+	size_t n;
+
+	while (trunk != NULL && swBuffer_trunk_is_data(trunk) && iovcnt < SW_BUFFER_IOV_MAX)
+	{
+		if (trunk->length > trunk->offset)
+		{
+			iov[iovcnt].iov_base = swBuffer_trunk_data(trunk) + trunk->offset;
+			iov[iovcnt].iov_len = trunk->length - trunk->offset;
+			iovcnt++;
+		}
+		trunk = trunk->next;
+	}
+
+	while (1)
+	{
+		ret = (iovcnt == 0) ? 0 : writev(fd, iov, iovcnt);
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		break;
+	}
+	if (ret < 0)
+	{
+		return SW_ERR;
+	}
+
+	n = ret;
+	while ((trunk = buffer->head) != NULL && swBuffer_trunk_is_data(trunk))
+	{
+		//trunk full send
+		if (trunk->length - trunk->offset <= n)
+		{
+			n -= (trunk->length - trunk->offset);
+			swBuffer_pop_trunk(buffer, trunk);
+		}
+		//partial send, the rest will be sent on next EPOLLOUT
+		else
+		{
+			trunk->offset += n;
+			buffer->length -= n;
+			break;
+		}
+	}
+	swTraceLog(SW_TRACE_BUFFER, "writev iovcnt=%d|sent=%ld|buffer_len=%d", iovcnt, (long) ret, buffer->length);
+	return ret;
+}
+
 /**
  * print buffer
  */
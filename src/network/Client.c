@@ -16,6 +16,7 @@
 
 #include "swoole.h"
 #include "Client.h"
+#include "dns.h"
 
 static int swClient_inet_addr(swClient *cli, char *string);
 
@@ -75,11 +76,17 @@ static int swClient_inet_addr(swClient *cli, char *string)
 	struct in_addr tmp;
 	struct hostent *host_entry;
 	struct sockaddr_in *sin = &cli->serv_addr;
+	swDNSResolver_result *result;
 
 	if (inet_aton(string, &tmp))
 	{
 		sin->sin_addr.s_addr = tmp.s_addr;
 	}
+	//异步DNS查询的缓存
+	else if ((result = swDNSResolver_find(string)) != NULL && result->ipv4_num > 0)
+	{
+		sin->sin_addr = result->ipv4[0];
+	}
 	else
 	{
 		if (cli->async)
@@ -123,6 +130,17 @@ int swClient_tcp_connect(swClient *cli, char *host, int port, double timeout, in
 
 	cli->timeout = timeout;
 
+#ifdef TCP_FASTOPEN_CONNECT
+	if (cli->open_tcp_fastopen)
+	{
+		int flag = 1;
+		if (setsockopt(cli->sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &flag, sizeof(flag)) < 0)
+		{
+			swWarn("setsockopt(TCP_FASTOPEN_CONNECT) failed. Error: %s[%d]", strerror(errno), errno);
+		}
+	}
+#endif
+
 	if (nonblock == 1)
 	{
 		swSetNonBlock(cli->sock);
@@ -0,0 +1,259 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "Client.h"
+
+static swClientPool_group* swClientPool_get_group(swClientPool *pool, int type, char *host, int port);
+static int swClientPool_alive(swClient *cli);
+static void swClientPool_destroy(swClient *cli);
+static void swClientPool_onTimer(swTimer *timer, swTimer_node *node);
+
+int swClientPool_create(swClientPool *pool)
+{
+	bzero(pool, sizeof(swClientPool));
+	pool->min_idle = SW_CLIENT_POOL_MIN_IDLE;
+	pool->max_idle = SW_CLIENT_POOL_MAX_IDLE;
+	pool->max_pipeline = SW_CLIENT_POOL_MAX_PIPELINE;
+	pool->idle_timeout = SW_CLIENT_POOL_IDLE_TIMEOUT;
+	pool->pid = getpid();
+
+	//在worker的reactor中定时回收空闲连接, 没有reactor时在获取连接时检查
+	if (SwooleG.main_reactor != NULL && swTimer_init_reactor(SwooleG.main_reactor, SW_CLIENT_POOL_CHECK_INTERVAL) == SW_OK)
+	{
+		pool->timer_id = swTimer_set(&SwooleG.timer, SW_CLIENT_POOL_CHECK_INTERVAL, 1, pool, swClientPool_onTimer);
+		if (pool->timer_id < 0)
+		{
+			pool->timer_id = 0;
+		}
+	}
+	pool->init = 1;
+	return SW_OK;
+}
+
+static swClientPool_group* swClientPool_get_group(swClientPool *pool, int type, char *host, int port)
+{
+	char key[SW_CLIENT_POOL_KEY_LEN];
+	int key_len = snprintf(key, sizeof(key), "%d:%s:%d", type, host, port);
+	swClientPool_group *group;
+
+	if (key_len >= sizeof(key))
+	{
+		swWarn("host[%s] is too long.", host);
+		return NULL;
+	}
+	group = swHashMap_find(&pool->map, key, key_len);
+	if (group != NULL)
+	{
+		return group;
+	}
+	group = sw_malloc(sizeof(swClientPool_group));
+	if (group == NULL)
+	{
+		swWarn("malloc for swClientPool_group failed.");
+		return NULL;
+	}
+	bzero(group, sizeof(swClientPool_group));
+	group->idle = sw_calloc(pool->max_idle > 0 ? pool->max_idle : 1, sizeof(swClient *));
+	if (group->idle == NULL)
+	{
+		swWarn("calloc for idle connections failed.");
+		sw_free(group);
+		return NULL;
+	}
+	group->idle_size = pool->max_idle > 0 ? pool->max_idle : 1;
+	memcpy(group->key, key, key_len + 1);
+	group->key_len = key_len;
+	swHashMap_add(&pool->map, key, key_len, group);
+	group->next = pool->groups;
+	pool->groups = group;
+	return group;
+}
+
+/**
+ * 空闲连接上不应该有数据, 有数据或者已关闭都不能再使用
+ */
+static int swClientPool_alive(swClient *cli)
+{
+	char buf;
+	int ret = recv(cli->sock, &buf, sizeof(buf), MSG_DONTWAIT | MSG_PEEK);
+	return ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void swClientPool_destroy(swClient *cli)
+{
+	if (cli->sock > 0)
+	{
+		cli->close(cli);
+	}
+	sw_free(cli);
+}
+
+/**
+ * 获取一个连接, 优先使用最近释放的空闲连接
+ * 没有空闲连接时返回未连接的swClient, 由调用者connect
+ */
+swClient* swClientPool_get(swClientPool *pool, int type, char *host, int port)
+{
+	swClientPool_group *group = swClientPool_get_group(pool, type, host, port);
+	swClient *cli;
+
+	if (group == NULL)
+	{
+		return NULL;
+	}
+	//pipeline模式下多个客户端共享同一个连接, 按发送顺序读取响应
+	cli = group->pipeline;
+	if (pool->max_pipeline > 1 && cli != NULL && cli->connected && cli->borrowed < pool->max_pipeline)
+	{
+		cli->borrowed++;
+		return cli;
+	}
+	while (group->idle_num > 0)
+	{
+		cli = group->idle[--group->idle_num];
+		if (swClientPool_alive(cli))
+		{
+			goto borrow;
+		}
+		swClientPool_destroy(cli);
+	}
+
+	cli = sw_malloc(sizeof(swClient));
+	if (cli == NULL)
+	{
+		swWarn("malloc for swClient failed.");
+		return NULL;
+	}
+	if (swClient_create(cli, type, 0) < 0)
+	{
+		swWarn("create client failed. Error: %s[%d]", strerror(errno), errno);
+		sw_free(cli);
+		return NULL;
+	}
+	cli->pool = pool;
+	cli->group = group;
+
+	borrow:
+	cli->borrowed = 1;
+	group->active_num++;
+	if (pool->max_pipeline > 1)
+	{
+		group->pipeline = cli;
+	}
+	return cli;
+}
+
+/**
+ * 归还连接, 空闲连接已满或者连接不可用时关闭
+ */
+void swClientPool_release(swClientPool *pool, swClient *cli)
+{
+	swClientPool_group *group = cli->group;
+	swClient **idle;
+
+	if (cli->borrowed == 0 || --cli->borrowed > 0)
+	{
+		return;
+	}
+	group->active_num--;
+	if (group->pipeline == cli)
+	{
+		group->pipeline = NULL;
+	}
+	if (!cli->connected || group->idle_num >= pool->max_idle || !swClientPool_alive(cli))
+	{
+		swClientPool_destroy(cli);
+		return;
+	}
+	if (group->idle_num == group->idle_size)
+	{
+		idle = sw_realloc(group->idle, pool->max_idle * sizeof(swClient *));
+		if (idle == NULL)
+		{
+			swClientPool_destroy(cli);
+			return;
+		}
+		group->idle = idle;
+		group->idle_size = pool->max_idle;
+	}
+	cli->last_use = time(NULL);
+	group->idle[group->idle_num++] = cli;
+}
+
+/**
+ * 关闭超时的空闲连接, 至少保留min_idle个, 同时剔除已经断开的连接
+ */
+void swClientPool_check(swClientPool *pool)
+{
+	swClientPool_group *group;
+	swClient *cli;
+	time_t now = time(NULL);
+	uint32_t i, n, expired;
+
+	for (group = pool->groups; group != NULL; group = group->next)
+	{
+		expired = 0;
+		while (expired < group->idle_num && group->idle_num - expired > pool->min_idle
+				&& now - group->idle[expired]->last_use >= pool->idle_timeout)
+		{
+			expired++;
+		}
+		n = 0;
+		for (i = 0; i < group->idle_num; i++)
+		{
+			cli = group->idle[i];
+			if (i < expired || !swClientPool_alive(cli))
+			{
+				swClientPool_destroy(cli);
+				continue;
+			}
+			group->idle[n++] = cli;
+		}
+		group->idle_num = n;
+	}
+}
+
+static void swClientPool_onTimer(swTimer *timer, swTimer_node *node)
+{
+	swClientPool_check(node->data);
+}
+
+/**
+ * 只关闭空闲连接, 借出的连接由调用者关闭
+ */
+void swClientPool_free(swClientPool *pool)
+{
+	swClientPool_group *group, *next;
+	uint32_t i;
+
+	if (pool->timer_id > 0)
+	{
+		swTimer_clear(&SwooleG.timer, pool->timer_id);
+	}
+	for (group = pool->groups; group != NULL; group = next)
+	{
+		next = group->next;
+		for (i = 0; i < group->idle_num; i++)
+		{
+			swClientPool_destroy(group->idle[i]);
+		}
+		sw_free(group->idle);
+		sw_free(group);
+	}
+	swHashMap_destory(&pool->map);
+	bzero(pool, sizeof(swClientPool));
+}
@@ -20,6 +20,9 @@
 #define EOK      0
 #endif
 
+static void swConnection_index_add(swServer *serv, swConnection *conn);
+static void swConnection_index_remove(swServer *serv, swConnection *conn);
+
 SWINLINE int swConnection_error(int fd, int err)
 {
 	switch(err)
@@ -33,6 +36,9 @@ SWINLINE int swConnection_error(int fd, int err)
 	case ENETUNREACH:
 	case EHOSTDOWN:
 	case EHOSTUNREACH:
+	//kTLS: 收到alert等非数据记录或解密失败
+	case EIO:
+	case EBADMSG:
 		return SW_ERR;
 	case EAGAIN:
 	case EOK:
@@ -49,6 +55,7 @@ SWINLINE int swConnection_error(int fd, int err)
 SWINLINE void swConnection_close(swServer *serv, int fd, int notify)
 {
 	swConnection *conn = swServer_get_connection(serv, fd);
+	swConnectionInfo *info;
 	swReactor *reactor;
 	swEvent notify_ev;
 	if(conn == NULL)
@@ -56,66 +63,159 @@ SWINLINE void swConnection_close(swServer *serv, int fd, int notify)
 		swWarn("[Master]connection not found. fd=%d|max_fd=%d", fd, swServer_get_maxfd(serv));
 		return;
 	}
+	info = swServer_get_connection_info(serv, fd);
+	uint8_t active = conn->active;
 
 	conn->active = 0;
+	swConnection_idle_unlink(serv, conn);
+	swConnection_index_remove(serv, conn);
 
 	int reactor_id = conn->from_id;
 
-	swCloseQueue *queue = &serv->reactor_threads[reactor_id].close_queue;
+	//释放上游socket和管道
+	if (conn->proxy)
+	{
+		swProxy_free(&(serv->reactor_threads[reactor_id].reactor), fd);
+	}
+	//等待写权限的worker收到连接已关闭的回复
+	if (conn->direct)
+	{
+		swReactorThread_direct_free(serv, conn);
+	}
 
-	//将关闭的fd放入队列
-	queue->events[queue->num] = fd;
-	//增加计数
-	queue->num ++;
+	//连接计数在reactor线程中直接更新
+	if (active)
+	{
+		sw_atomic_fetch_sub(&serv->connect_count, 1);
+		sw_atomic_fetch_sub(&serv->stats->connection_num, 1);
+		swServer_reactor_stats_add(serv, reactor_id, close_count, 1);
+	}
+	//只有onMasterClose和重新计算max_fd需要主线程处理
+	if (serv->factory_mode != SW_MODE_SINGLE && (serv->onMasterClose != NULL || fd == swServer_get_maxfd(serv)))
+	{
+		swReactorThread_close_queue_add(serv, reactor_id, fd);
+	}
 
 	reactor = &(serv->reactor_threads[reactor_id].reactor);
 	swTrace("Close Event.fd=%d|from=%d", fd, reactor_id);
 
 	//释放缓存区占用的内存
-	if (serv->open_eof_check == 1)
+	if (conn->string_buffer != NULL)
 	{
-		if (conn->in_buffer != NULL)
-		{
-			swBuffer_free(conn->in_buffer);
-			conn->in_buffer = NULL;
-		}
-	}
-	else if (serv->open_length_check == 1)
-	{
-		if (conn->string_buffer != NULL)
-		{
-			swString_free(conn->string_buffer);
-		}
+		swString_free(conn->string_buffer);
+		conn->string_buffer = NULL;
 	}
 
 	if (conn->out_buffer != NULL)
 	{
+		swServer_reactor_stats_add(serv, reactor_id, out_buffer_bytes, -(atomic_int_t) conn->out_buffer->length);
 		swBuffer_free(conn->out_buffer);
 		conn->out_buffer = NULL;
 	}
 
-	if (conn->in_buffer != NULL)
+	if (info->in_buffer != NULL)
 	{
-		swBuffer_free(conn->in_buffer);
-		conn->in_buffer = NULL;
+		swBuffer_free(info->in_buffer);
+		info->in_buffer = NULL;
 	}
 
+	//还没有接收完的大包
+	if (info->ring_length > 0)
+	{
+		swRecvRing_release(serv->recv_rings[reactor_id], info->ring_offset);
+		info->ring_length = 0;
+	}
+
+	if (info->websocket_message != NULL)
+	{
+		swString_free(info->websocket_message);
+		info->websocket_message = NULL;
+	}
+
+#ifdef SW_USE_OPENSSL
+	//握手未完成时worker没有收到onConnect, 也不通知onClose
+	if (conn->ssl_state == SW_SSL_STATE_HANDSHAKE)
+	{
+		notify = 0;
+	}
+	swSSL_free(serv, fd);
+#endif
+
 	//通知到worker进程
 	if (serv->onClose != NULL && notify == 1)
 	{
 		//通知worker进程
+		bzero(&notify_ev, sizeof(notify_ev));
 		notify_ev.from_id = reactor_id;
 		notify_ev.fd = fd;
 		notify_ev.type = SW_EVENT_CLOSE;
-		SwooleG.factory->notify(SwooleG.factory, &notify_ev);
-	}
-	//通知主进程
-	if (queue->num == SW_CLOSE_QLEN)
-	{
-		swReactorThread_close_queue(reactor, queue);
+		swReactorThread_batch_notify(serv, reactor_id, &notify_ev);
 	}
 	//关闭此连接，必须放在最前面，以保证线程安全
 	reactor->del(reactor, fd);
+	//重复关闭时不能再减少计数
+	if (active)
+	{
+		swConnection_chunk_unref(serv, fd);
+	}
+}
+
+/**
+ * 增加fd所在块的连接数, 此块正在归还物理内存时等待完成
+ */
+SWINLINE void swConnection_chunk_ref(swServer *serv, int fd)
+{
+	swConnectionChunk *chunk = &serv->connection_chunks[fd / SW_CONNECTION_CHUNK_SIZE];
+	atomic_uint_t count;
+
+	while (1)
+	{
+		count = chunk->count;
+		if (count == SW_CONNECTION_CHUNK_RELEASING)
+		{
+			swYield();
+			continue;
+		}
+		if (sw_atomic_cmp_set(&chunk->count, count, count + 1))
+		{
+			break;
+		}
+	}
+	chunk->committed = 1;
+}
+
+SWINLINE void swConnection_chunk_unref(swServer *serv, int fd)
+{
+	sw_atomic_fetch_sub(&serv->connection_chunks[fd / SW_CONNECTION_CHUNK_SIZE].count, 1);
+}
+
+/**
+ * 归还没有连接的块占用的物理内存, 只需要一个线程定期调用
+ */
+void swConnection_chunk_release(swServer *serv)
+{
+	swConnectionChunk *chunk;
+	uint32_t i, start, num;
+
+	for (i = 1; i < serv->connection_chunk_num; i++)
+	{
+		chunk = &serv->connection_chunks[i];
+		if (!chunk->committed || chunk->count != 0)
+		{
+			continue;
+		}
+		//加锁, 与swConnection_chunk_ref互斥
+		if (!sw_atomic_cmp_set(&chunk->count, 0, SW_CONNECTION_CHUNK_RELEASING))
+		{
+			continue;
+		}
+		start = i * SW_CONNECTION_CHUNK_SIZE;
+		num = (start + SW_CONNECTION_CHUNK_SIZE > serv->max_conn) ? serv->max_conn - start : SW_CONNECTION_CHUNK_SIZE;
+		sw_shm_decommit(&serv->connection_list[start], num * sizeof(swConnection));
+		sw_shm_decommit(&serv->connection_info[start], num * sizeof(swConnectionInfo));
+		chunk->committed = 0;
+		sw_atomic_cmp_set(&chunk->count, SW_CONNECTION_CHUNK_RELEASING, 0);
+	}
 }
 
 /**
@@ -125,8 +225,9 @@ SWINLINE int swServer_new_connection(swServer *serv, swEvent *ev)
 {
 	int conn_fd = ev->fd;
 	swConnection* connection = NULL;
+	swConnectionInfo *info;
 
-	if(conn_fd > swServer_get_maxfd(serv))
+	if (conn_fd > swServer_get_maxfd(serv) && !serv->enable_reuse_port)
 	{
 		swServer_set_maxfd(serv, conn_fd);
 #ifdef SW_CONNECTION_LIST_EXPAND
@@ -143,46 +244,264 @@ SWINLINE int swServer_new_connection(swServer *serv, swEvent *ev)
 			}
 			else
 			{
-				serv->connection_list_capacity += SW_CONNECTION_LIST_EXPAND;
 				serv->connection_list = (swConnection *)new_ptr;
 			}
+			new_ptr = sw_shm_realloc(serv->connection_info, sizeof(swConnectionInfo)*(serv->connection_list_capacity + SW_CONNECTION_LIST_EXPAND));
+			if(new_ptr == NULL)
+			{
+				swWarn("connection_info realloc fail");
+				return SW_ERR;
+			}
+			serv->connection_info = (swConnectionInfo *)new_ptr;
+			serv->connection_list_capacity += SW_CONNECTION_LIST_EXPAND;
 		}
 #endif
 	}
 
+	//必须在写入之前, 所在的块可能正在归还物理内存
+	swConnection_chunk_ref(serv, conn_fd);
+
+	info = swServer_get_connection_info(serv, conn_fd);
+	bzero(info, sizeof(swConnectionInfo));
+	info->from_fd = ev->from_fd;
+	info->worker_group = serv->connection_info[ev->from_fd].worker_group;
+	info->latency_sample = serv->connection_info[ev->from_fd].latency_sample;
+	info->websocket_compression = serv->connection_info[ev->from_fd].websocket_compression;
+	info->connect_time = swClock_now();
+
 	connection = &(serv->connection_list[conn_fd]);
 	bzero(connection, sizeof(swConnection));
 
 	connection->fd = conn_fd;
 	connection->from_id = ev->from_id;
-	connection->from_fd = ev->from_fd;
-	connection->connect_time = SwooleGS->now;
-	connection->last_time = SwooleGS->now;
+	connection->last_time = swClock_now();
 	connection->active = 1; //使此连接激活,必须在最后，保证线程安全
+	swConnection_index_add(serv, connection);
 
+	//多个reactor线程同时accept, 必须在active之后加锁更新max_fd
+	if (serv->enable_reuse_port)
+	{
+		SwooleG.lock.lock(&SwooleG.lock);
+		if (conn_fd > swServer_get_maxfd(serv))
+		{
+			swServer_set_maxfd(serv, conn_fd);
+		}
+		SwooleG.lock.unlock(&SwooleG.lock);
+	}
 	return SW_OK;
 }
 
+/**
+ * 加入reactor线程的活动连接索引
+ */
+static void swConnection_index_add(swServer *serv, swConnection *conn)
+{
+	swReactorThread *thread = &serv->reactor_threads[conn->from_id];
+	swConnectionInfo *info = swServer_get_connection_info(serv, conn->fd);
+
+	thread->lock.lock(&thread->lock);
+	info->active_index = thread->active_num;
+	thread->active_fds[thread->active_num++] = conn->fd;
+	thread->lock.unlock(&thread->lock);
+}
+
+/**
+ * 用最后一个fd填补空位,保持索引紧凑
+ */
+static void swConnection_index_remove(swServer *serv, swConnection *conn)
+{
+	swReactorThread *thread = &serv->reactor_threads[conn->from_id];
+	swConnectionInfo *info = swServer_get_connection_info(serv, conn->fd);
+	int last_fd;
+
+	thread->lock.lock(&thread->lock);
+	//重复close时已经不在索引中
+	if (thread->active_num > 0 && thread->active_fds[info->active_index] == conn->fd)
+	{
+		last_fd = thread->active_fds[--thread->active_num];
+		thread->active_fds[info->active_index] = last_fd;
+		swServer_get_connection_info(serv, last_fd)->active_index = info->active_index;
+	}
+	thread->lock.unlock(&thread->lock);
+}
+
+/**
+ * 加入所在reactor线程的空闲链表尾部
+ */
+SWINLINE void swConnection_idle_link(swServer *serv, swConnection *conn)
+{
+	swReactorThread *thread = &serv->reactor_threads[conn->from_id];
+	swConnectionInfo *info = swServer_get_connection_info(serv, conn->fd);
+
+	thread->lock.lock(&thread->lock);
+	if (info->idle_linked == 0)
+	{
+		info->idle_next = 0;
+		info->idle_prev = thread->idle_tail;
+		if (thread->idle_tail == 0)
+		{
+			thread->idle_head = conn->fd;
+		}
+		else
+		{
+			serv->connection_info[thread->idle_tail].idle_next = conn->fd;
+		}
+		thread->idle_tail = conn->fd;
+		info->idle_linked = 1;
+	}
+	thread->lock.unlock(&thread->lock);
+}
+
+SWINLINE void swConnection_idle_unlink(swServer *serv, swConnection *conn)
+{
+	swReactorThread *thread = &serv->reactor_threads[conn->from_id];
+	swConnectionInfo *info = swServer_get_connection_info(serv, conn->fd);
+
+	//未开启心跳检测时不会加入链表
+	if (info->idle_linked == 0)
+	{
+		return;
+	}
+	thread->lock.lock(&thread->lock);
+	if (info->idle_linked == 1)
+	{
+		if (info->idle_prev == 0)
+		{
+			thread->idle_head = info->idle_next;
+		}
+		else
+		{
+			serv->connection_info[info->idle_prev].idle_next = info->idle_next;
+		}
+		if (info->idle_next == 0)
+		{
+			thread->idle_tail = info->idle_prev;
+		}
+		else
+		{
+			serv->connection_info[info->idle_next].idle_prev = info->idle_prev;
+		}
+		info->idle_prev = info->idle_next = 0;
+		info->idle_linked = 0;
+	}
+	thread->lock.unlock(&thread->lock);
+}
+
+/**
+ * 收到数据时更新时间,每秒最多移动一次链表节点
+ */
+SWINLINE void swConnection_idle_touch(swServer *serv, swConnection *conn)
+{
+	if (conn->last_time == swClock_now())
+	{
+		return;
+	}
+	conn->last_time = swClock_now();
+	if (swServer_get_connection_info(serv, conn->fd)->idle_linked == 1)
+	{
+		swConnection_idle_unlink(serv, conn);
+		swConnection_idle_link(serv, conn);
+	}
+}
+
+/**
+ * 从iter位置开始取出最多size个活动连接的fd, 返回0表示已遍历完
+ */
+int swServer_connection_next(swServer *serv, swConnectionIterator *iter, int *fds, int size)
+{
+	swReactorThread *thread;
+	int n = 0;
+
+	for (; iter->reactor_id < serv->reactor_num; iter->reactor_id++, iter->index = 0)
+	{
+		thread = &serv->reactor_threads[iter->reactor_id];
+		//reactor线程和主线程会同时修改索引
+		thread->lock.lock(&thread->lock);
+		for (; iter->index < thread->active_num; iter->index++)
+		{
+			if (n == size)
+			{
+				thread->lock.unlock(&thread->lock);
+				return n;
+			}
+			fds[n++] = thread->active_fds[iter->index];
+		}
+		thread->lock.unlock(&thread->lock);
+	}
+	return n;
+}
+
+/**
+ * 复制reactor线程当前的活动连接, 返回fd的数量, *fds由调用者sw_free
+ * 复制之后连接可能已经关闭, 使用前要检查active
+ */
+int swServer_connection_snapshot(swServer *serv, int reactor_id, int **fds)
+{
+	swReactorThread *thread = &serv->reactor_threads[reactor_id];
+	int n;
+
+	*fds = NULL;
+	thread->lock.lock(&thread->lock);
+	n = thread->active_num;
+	if (n > 0 && (*fds = sw_malloc(n * sizeof(int))) != NULL)
+	{
+		memcpy(*fds, thread->active_fds, n * sizeof(int));
+	}
+	thread->lock.unlock(&thread->lock);
+	if (n > 0 && *fds == NULL)
+	{
+		swWarn("malloc(%d) for active connections failed.", n);
+		return SW_ERR;
+	}
+	return n;
+}
+
+/**
+ * 接收buffer从reactor线程的空闲列表中取, 初始为SW_BUFFER_INPUT_INIT_SIZE, 收到大包时再扩容
+ */
 SWINLINE swString* swConnection_get_string_buffer(swConnection *conn)
 {
 	swString *buffer = conn->string_buffer;
+	swReactorThread *thread;
+
 	if (buffer == NULL)
 	{
-		return swString_new(SW_BUFFER_SIZE);
-	}
-	else
-	{
-		return buffer;
+		thread = &(SwooleG.serv->reactor_threads[conn->from_id]);
+		if (thread->input_buffer_num > 0)
+		{
+			buffer = thread->input_buffers[--thread->input_buffer_num];
+		}
+		else
+		{
+			buffer = swString_new(SW_BUFFER_INPUT_INIT_SIZE);
+		}
+		conn->string_buffer = buffer;
 	}
+	return buffer;
 }
 
+/**
+ * 没有未完成的包时归还接收buffer, 扩容过的直接释放, 只能在连接所属的reactor线程中调用
+ */
 SWINLINE void swConnection_clear_string_buffer(swConnection *conn)
 {
 	swString *buffer = conn->string_buffer;
-	if (buffer != NULL)
+	swReactorThread *thread;
+
+	if (buffer == NULL)
+	{
+		return;
+	}
+	conn->string_buffer = NULL;
+	thread = &(SwooleG.serv->reactor_threads[conn->from_id]);
+	if (buffer->size == SW_BUFFER_INPUT_INIT_SIZE && thread->input_buffer_num < SW_BUFFER_INPUT_POOL_NUM)
+	{
+		buffer->length = 0;
+		thread->input_buffers[thread->input_buffer_num++] = buffer;
+	}
+	else
 	{
 		swString_free(buffer);
-		conn->string_buffer = NULL;
 	}
 }
 
@@ -195,7 +514,7 @@ int swConnection_send_in_buffer(swConnection *conn)
 
 	swFactory *factory = SwooleG.factory;
 	swEventData _send;
-	swBuffer *buffer = conn->in_buffer;
+	swBuffer *buffer = swServer_get_connection_info(SwooleG.serv, conn->fd)->in_buffer;
 	swBuffer_trunk *trunk = swBuffer_get_trunk(buffer);
 
 	_send.info.fd = conn->fd;
@@ -236,8 +555,9 @@ SWINLINE swBuffer_trunk* swConnection_get_in_buffer(swConnection *conn)
 {
 	swBuffer_trunk *trunk = NULL;
 	swBuffer *buffer;
+	swConnectionInfo *info = swServer_get_connection_info(SwooleG.serv, conn->fd);
 
-	if (conn->in_buffer == NULL)
+	if (info->in_buffer == NULL)
 	{
 		buffer = swBuffer_new(SW_BUFFER_SIZE);
 		//buffer create failed
@@ -245,6 +565,7 @@ SWINLINE swBuffer_trunk* swConnection_get_in_buffer(swConnection *conn)
 		{
 			return NULL;
 		}
+		buffer->pool = swServer_get_buffer_pool(SwooleG.serv, conn->from_id);
 		//new trunk
 		trunk = swBuffer_new_trunk(buffer, SW_TRUNK_DATA, buffer->trunk_size);
 		if (trunk == NULL)
@@ -252,11 +573,11 @@ SWINLINE swBuffer_trunk* swConnection_get_in_buffer(swConnection *conn)
 			sw_free(buffer);
 			return NULL;
 		}
-		conn->in_buffer = buffer;
+		info->in_buffer = buffer;
 	}
 	else
 	{
-		buffer = conn->in_buffer;
+		buffer = info->in_buffer;
 		trunk = swBuffer_get_trunk(buffer);
 		if (trunk == NULL || trunk->length == buffer->trunk_size)
 		{
@@ -276,6 +597,7 @@ SWINLINE swBuffer_trunk* swConnection_get_out_buffer(swConnection *conn, uint32_
 		{
 			return NULL;
 		}
+		conn->out_buffer->pool = swServer_get_buffer_pool(SwooleG.serv, conn->from_id);
 	}
 	if (type == SW_TRUNK_SENDFILE)
 	{
@@ -0,0 +1,757 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "dns.h"
+
+#include <ctype.h>
+
+#define SW_DNS_QUERY_A        1
+#define SW_DNS_QUERY_AAAA     2
+
+#define SW_DNS_TYPE_A         1
+#define SW_DNS_TYPE_AAAA      28
+#define SW_DNS_CLASS_IN       1
+
+#define SW_DNS_HEADER_SIZE    12
+#define SW_DNS_FLAG_QR        0x8000
+#define SW_DNS_FLAG_RD        0x0100
+
+typedef struct _swDNSResolver_waiter
+{
+	swDNSResolver_callback callback;
+	void *data;
+	struct _swDNSResolver_waiter *next;
+} swDNSResolver_waiter;
+
+typedef struct _swDNSResolver_entry
+{
+	char domain[SW_DNS_DOMAIN_MAX];
+	uint16_t domain_len;
+	uint16_t id[2];        //A/AAAA查询的id
+	uint8_t pending;       //还未返回的查询, SW_DNS_QUERY_A | SW_DNS_QUERY_AAAA
+	uint8_t retry;
+	uint8_t permanent;     //来自/etc/hosts, 不会过期
+	uint8_t cached;        //缓存已满时不加入缓存, 查询完成后释放
+	int timer_id;
+	uint32_t ttl;
+	time_t expire;
+	swDNSResolver_result result;
+	swDNSResolver_waiter *waiter_head;
+	swDNSResolver_waiter *waiter_tail;
+	struct _swDNSResolver_entry *prev;
+	struct _swDNSResolver_entry *next;
+} swDNSResolver_entry;
+
+typedef struct
+{
+	int fd;
+	swReactor *reactor;
+	struct sockaddr_in server;
+	swHashMap cache;       //domain -> swDNSResolver_entry
+	swHashMap_int queries; //query id -> swDNSResolver_entry
+	uint32_t cache_num;
+	swDNSResolver_entry *entries;  //所有的entry, 用于释放
+} swDNSResolver;
+
+static swDNSResolver swoole_dns_resolver;
+
+static int swDNSResolver_init(swReactor *reactor);
+static void swDNSResolver_load_server(swDNSResolver *resolver);
+static void swDNSResolver_load_hosts(swDNSResolver *resolver);
+static int swDNSResolver_normalize(char *domain, char *key);
+static swDNSResolver_entry* swDNSResolver_entry_new(swDNSResolver *resolver, char *key, int len);
+static void swDNSResolver_entry_free(swDNSResolver *resolver, swDNSResolver_entry *entry);
+static int swDNSResolver_query(swDNSResolver *resolver, swDNSResolver_entry *entry);
+static int swDNSResolver_send(swDNSResolver *resolver, swDNSResolver_entry *entry, int type);
+static int swDNSResolver_parse(swDNSResolver_entry *entry, int type, char *packet, int length);
+static void swDNSResolver_finish(swDNSResolver *resolver, swDNSResolver_entry *entry);
+static int swDNSResolver_onReceive(swReactor *reactor, swEvent *event);
+static void swDNSResolver_onTimeout(swTimer *timer, swTimer_node *node);
+
+/**
+ * 第一次查询时初始化, 绑定到第一个调用的reactor上
+ */
+static int swDNSResolver_init(swReactor *reactor)
+{
+	swDNSResolver *resolver = &swoole_dns_resolver;
+
+	if (resolver->reactor != NULL)
+	{
+		return SW_OK;
+	}
+	if (swTimer_init_reactor(reactor, SW_DNS_TIMEOUT) < 0)
+	{
+		return SW_ERR;
+	}
+
+	resolver->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (resolver->fd < 0)
+	{
+		swWarn("socket() failed. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	swSetNonBlock(resolver->fd);
+	fcntl(resolver->fd, F_SETFD, FD_CLOEXEC);
+
+	reactor->setHandle(reactor, SW_FD_DNS, swDNSResolver_onReceive);
+	if (reactor->add(reactor, resolver->fd, SW_FD_DNS) < 0)
+	{
+		close(resolver->fd);
+		return SW_ERR;
+	}
+	resolver->reactor = reactor;
+	srand(getpid() ^ time(NULL));
+
+	swDNSResolver_load_server(resolver);
+	swDNSResolver_load_hosts(resolver);
+	return SW_OK;
+}
+
+/**
+ * 使用resolv.conf中第一个IPv4的nameserver
+ */
+static void swDNSResolver_load_server(swDNSResolver *resolver)
+{
+	char line[SW_DNS_LINE_MAX];
+	char server[SW_IP_MAX_LENGTH];
+	int found = 0;
+
+	resolver->server.sin_family = AF_INET;
+	resolver->server.sin_port = htons(SW_DNS_SERVER_PORT);
+
+	FILE *fp = fopen(SW_DNS_RESOLV_CONF, "r");
+	if (fp != NULL)
+	{
+		while (fgets(line, sizeof(line), fp) != NULL)
+		{
+			if (sscanf(line, "nameserver %31s", server) == 1
+					&& inet_pton(AF_INET, server, &resolver->server.sin_addr) == 1)
+			{
+				found = 1;
+				break;
+			}
+		}
+		fclose(fp);
+	}
+	if (!found)
+	{
+		inet_pton(AF_INET, SW_DNS_DEFAULT_SERVER, &resolver->server.sin_addr);
+	}
+}
+
+/**
+ * /etc/hosts中的记录预先加入缓存, 不会过期
+ */
+static void swDNSResolver_load_hosts(swDNSResolver *resolver)
+{
+	char line[SW_DNS_LINE_MAX];
+	char key[SW_DNS_DOMAIN_MAX];
+	char *ip, *name, *saveptr;
+	struct in_addr addr4;
+	struct in6_addr addr6;
+	swDNSResolver_entry *entry;
+	int family, len;
+
+	FILE *fp = fopen(SW_DNS_HOSTS_CONF, "r");
+	if (fp == NULL)
+	{
+		return;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		line[strcspn(line, "#\r\n")] = 0;
+		ip = strtok_r(line, " \t", &saveptr);
+		if (ip == NULL)
+		{
+			continue;
+		}
+		if (inet_pton(AF_INET, ip, &addr4) == 1)
+		{
+			family = AF_INET;
+		}
+		else if (inet_pton(AF_INET6, ip, &addr6) == 1)
+		{
+			family = AF_INET6;
+		}
+		else
+		{
+			continue;
+		}
+		while ((name = strtok_r(NULL, " \t", &saveptr)) != NULL)
+		{
+			len = swDNSResolver_normalize(name, key);
+			if (len < 0)
+			{
+				continue;
+			}
+			entry = swHashMap_find(&resolver->cache, key, len);
+			if (entry == NULL)
+			{
+				entry = swDNSResolver_entry_new(resolver, key, len);
+				if (entry == NULL)
+				{
+					break;
+				}
+				entry->permanent = 1;
+				entry->cached = 1;
+				swHashMap_add(&resolver->cache, key, len, entry);
+				resolver->cache_num++;
+			}
+			if (family == AF_INET && entry->result.ipv4_num < SW_DNS_HOST_ADDR_MAX)
+			{
+				entry->result.ipv4[entry->result.ipv4_num++] = addr4;
+			}
+			else if (family == AF_INET6 && entry->result.ipv6_num < SW_DNS_HOST_ADDR_MAX)
+			{
+				entry->result.ipv6[entry->result.ipv6_num++] = addr6;
+			}
+		}
+	}
+	fclose(fp);
+}
+
+/**
+ * 转为小写并去掉末尾的'.', 返回长度
+ */
+static int swDNSResolver_normalize(char *domain, char *key)
+{
+	int i, len = strlen(domain);
+
+	if (len > 0 && domain[len - 1] == '.')
+	{
+		len--;
+	}
+	if (len == 0 || len >= SW_DNS_DOMAIN_MAX)
+	{
+		return SW_ERR;
+	}
+	for (i = 0; i < len; i++)
+	{
+		key[i] = tolower((unsigned char) domain[i]);
+	}
+	key[len] = 0;
+	return len;
+}
+
+static swDNSResolver_entry* swDNSResolver_entry_new(swDNSResolver *resolver, char *key, int len)
+{
+	swDNSResolver_entry *entry = sw_malloc(sizeof(swDNSResolver_entry));
+	if (entry == NULL)
+	{
+		swWarn("malloc for swDNSResolver_entry failed.");
+		return NULL;
+	}
+	bzero(entry, sizeof(swDNSResolver_entry));
+	memcpy(entry->domain, key, len + 1);
+	entry->domain_len = len;
+
+	entry->next = resolver->entries;
+	if (resolver->entries != NULL)
+	{
+		resolver->entries->prev = entry;
+	}
+	resolver->entries = entry;
+	return entry;
+}
+
+static void swDNSResolver_entry_free(swDNSResolver *resolver, swDNSResolver_entry *entry)
+{
+	swDNSResolver_waiter *waiter, *next;
+
+	if (entry->cached)
+	{
+		swHashMap_del(&resolver->cache, entry->domain, entry->domain_len);
+		resolver->cache_num--;
+	}
+	if (entry->pending & SW_DNS_QUERY_A)
+	{
+		swHashMap_del_int(&resolver->queries, entry->id[0]);
+	}
+	if (entry->pending & SW_DNS_QUERY_AAAA)
+	{
+		swHashMap_del_int(&resolver->queries, entry->id[1]);
+	}
+	if (entry->timer_id > 0)
+	{
+		swTimer_clear(&SwooleG.timer, entry->timer_id);
+	}
+	for (waiter = entry->waiter_head; waiter != NULL; waiter = next)
+	{
+		next = waiter->next;
+		sw_free(waiter);
+	}
+	if (entry->prev != NULL)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		resolver->entries = entry->next;
+	}
+	if (entry->next != NULL)
+	{
+		entry->next->prev = entry->prev;
+	}
+	sw_free(entry);
+}
+
+int swDNSResolver_lookup(swReactor *reactor, char *domain, swDNSResolver_callback callback, void *data)
+{
+	swDNSResolver *resolver = &swoole_dns_resolver;
+	swDNSResolver_result result;
+	swDNSResolver_entry *entry;
+	swDNSResolver_waiter *waiter;
+	char key[SW_DNS_DOMAIN_MAX];
+	int len;
+
+	len = swDNSResolver_normalize(domain, key);
+	if (len < 0)
+	{
+		swWarn("invalid domain name[%s].", domain);
+		return SW_ERR;
+	}
+
+	//IP地址不需要查询
+	bzero(&result, sizeof(result));
+	if (inet_pton(AF_INET, key, &result.ipv4[0]) == 1)
+	{
+		result.ipv4_num = 1;
+		callback(key, &result, data);
+		return SW_OK;
+	}
+	if (inet_pton(AF_INET6, key, &result.ipv6[0]) == 1)
+	{
+		result.ipv6_num = 1;
+		callback(key, &result, data);
+		return SW_OK;
+	}
+
+	if (swDNSResolver_init(reactor) < 0)
+	{
+		return SW_ERR;
+	}
+	entry = swHashMap_find(&resolver->cache, key, len);
+	if (entry != NULL && entry->pending == 0 && (entry->permanent || entry->expire > swClock_now()))
+	{
+		callback(entry->domain, &entry->result, data);
+		return SW_OK;
+	}
+
+	waiter = sw_malloc(sizeof(swDNSResolver_waiter));
+	if (waiter == NULL)
+	{
+		swWarn("malloc for swDNSResolver_waiter failed.");
+		return SW_ERR;
+	}
+	waiter->callback = callback;
+	waiter->data = data;
+	waiter->next = NULL;
+
+	if (entry == NULL)
+	{
+		entry = swDNSResolver_entry_new(resolver, key, len);
+		if (entry == NULL)
+		{
+			sw_free(waiter);
+			return SW_ERR;
+		}
+		if (resolver->cache_num < SW_DNS_CACHE_MAX)
+		{
+			swHashMap_add(&resolver->cache, key, len, entry);
+			resolver->cache_num++;
+			entry->cached = 1;
+		}
+	}
+	if (entry->waiter_tail != NULL)
+	{
+		entry->waiter_tail->next = waiter;
+	}
+	else
+	{
+		entry->waiter_head = waiter;
+	}
+	entry->waiter_tail = waiter;
+
+	//已经在查询, 等待结果
+	if (entry->pending)
+	{
+		return SW_OK;
+	}
+	if (swDNSResolver_query(resolver, entry) < 0)
+	{
+		swDNSResolver_entry_free(resolver, entry);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+/**
+ * 同步查询缓存, 未命中返回NULL
+ */
+swDNSResolver_result* swDNSResolver_find(char *domain)
+{
+	swDNSResolver *resolver = &swoole_dns_resolver;
+	swDNSResolver_entry *entry;
+	char key[SW_DNS_DOMAIN_MAX];
+	int len = swDNSResolver_normalize(domain, key);
+
+	if (len < 0 || resolver->reactor == NULL)
+	{
+		return NULL;
+	}
+	entry = swHashMap_find(&resolver->cache, key, len);
+	if (entry != NULL && entry->pending == 0 && (entry->permanent || entry->expire > swClock_now()))
+	{
+		return &entry->result;
+	}
+	return NULL;
+}
+
+/**
+ * 同时发送A和AAAA查询, 两个都返回或者超时后回调
+ */
+static int swDNSResolver_query(swDNSResolver *resolver, swDNSResolver_entry *entry)
+{
+	int i, type;
+	uint16_t id;
+
+	bzero(&entry->result, sizeof(entry->result));
+	entry->retry = 0;
+	entry->ttl = SW_DNS_MAX_TTL;
+
+	for (i = 0; i < 2; i++)
+	{
+		type = (i == 0) ? SW_DNS_QUERY_A : SW_DNS_QUERY_AAAA;
+		do
+		{
+			id = rand() & 0xffff;
+		} while (id == 0 || swHashMap_find_int(&resolver->queries, id) != NULL);
+		entry->id[i] = id;
+		swHashMap_add_int(&resolver->queries, id, entry);
+		entry->pending |= type;
+		//发送失败时等待超时重发
+		swDNSResolver_send(resolver, entry, type);
+	}
+	entry->timer_id = swTimer_set(&SwooleG.timer, SW_DNS_TIMEOUT, 0, entry, swDNSResolver_onTimeout);
+	if (entry->timer_id < 0)
+	{
+		entry->timer_id = 0;
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+static int swDNSResolver_send(swDNSResolver *resolver, swDNSResolver_entry *entry, int type)
+{
+	char packet[SW_DNS_PACKET_SIZE];
+	uint16_t *header = (uint16_t *) packet;
+	char *label, *dot, *p = packet + SW_DNS_HEADER_SIZE;
+	int label_len;
+	uint16_t qtype, qclass;
+
+	bzero(packet, SW_DNS_HEADER_SIZE);
+	header[0] = htons(type == SW_DNS_QUERY_A ? entry->id[0] : entry->id[1]);
+	header[1] = htons(SW_DNS_FLAG_RD);
+	header[2] = htons(1);
+
+	//www.example.com -> 3www7example3com0
+	label = entry->domain;
+	while (*label)
+	{
+		dot = strchr(label, '.');
+		label_len = dot ? dot - label : strlen(label);
+		if (label_len == 0 || label_len > 63)
+		{
+			swWarn("invalid domain name[%s].", entry->domain);
+			return SW_ERR;
+		}
+		*p++ = label_len;
+		memcpy(p, label, label_len);
+		p += label_len;
+		label += label_len + (dot ? 1 : 0);
+	}
+	*p++ = 0;
+	qtype = htons(type == SW_DNS_QUERY_A ? SW_DNS_TYPE_A : SW_DNS_TYPE_AAAA);
+	qclass = htons(SW_DNS_CLASS_IN);
+	memcpy(p, &qtype, 2);
+	memcpy(p + 2, &qclass, 2);
+	p += 4;
+
+	if (sendto(resolver->fd, packet, p - packet, 0, (struct sockaddr *) &resolver->server, sizeof(resolver->server)) < 0)
+	{
+		swWarn("sendto dns server failed. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+/**
+ * 跳过一个域名, 支持压缩指针
+ */
+static int swDNSResolver_skip_name(char *packet, int length, int offset)
+{
+	uint8_t len;
+	while (offset < length)
+	{
+		len = packet[offset];
+		if (len == 0)
+		{
+			return offset + 1;
+		}
+		if ((len & 0xc0) == 0xc0)
+		{
+			return offset + 2;
+		}
+		offset += len + 1;
+	}
+	return SW_ERR;
+}
+
+static int swDNSResolver_parse(swDNSResolver_entry *entry, int type, char *packet, int length)
+{
+	uint16_t flags, qdcount, ancount, rtype, rdlength;
+	uint32_t ttl;
+	int i, offset = SW_DNS_HEADER_SIZE;
+	swDNSResolver_result *result = &entry->result;
+
+	memcpy(&flags, packet + 2, 2);
+	memcpy(&qdcount, packet + 4, 2);
+	memcpy(&ancount, packet + 6, 2);
+	flags = ntohs(flags);
+	qdcount = ntohs(qdcount);
+	ancount = ntohs(ancount);
+
+	//NXDOMAIN等错误
+	if (!(flags & SW_DNS_FLAG_QR) || (flags & 0x000f) != 0)
+	{
+		return SW_ERR;
+	}
+	for (i = 0; i < qdcount; i++)
+	{
+		offset = swDNSResolver_skip_name(packet, length, offset);
+		if (offset < 0)
+		{
+			return SW_ERR;
+		}
+		offset += 4;
+	}
+	//CNAME链上的A/AAAA记录都属于这个域名
+	for (i = 0; i < ancount; i++)
+	{
+		offset = swDNSResolver_skip_name(packet, length, offset);
+		if (offset < 0 || offset + 10 > length)
+		{
+			return SW_ERR;
+		}
+		memcpy(&rtype, packet + offset, 2);
+		memcpy(&ttl, packet + offset + 4, 4);
+		memcpy(&rdlength, packet + offset + 8, 2);
+		rtype = ntohs(rtype);
+		ttl = ntohl(ttl);
+		rdlength = ntohs(rdlength);
+		offset += 10;
+		if (offset + rdlength > length)
+		{
+			return SW_ERR;
+		}
+		if (type == SW_DNS_QUERY_A && rtype == SW_DNS_TYPE_A && rdlength == 4)
+		{
+			if (result->ipv4_num < SW_DNS_HOST_ADDR_MAX)
+			{
+				memcpy(&result->ipv4[result->ipv4_num++], packet + offset, 4);
+			}
+		}
+		else if (type == SW_DNS_QUERY_AAAA && rtype == SW_DNS_TYPE_AAAA && rdlength == 16)
+		{
+			if (result->ipv6_num < SW_DNS_HOST_ADDR_MAX)
+			{
+				memcpy(&result->ipv6[result->ipv6_num++], packet + offset, 16);
+			}
+		}
+		else
+		{
+			offset += rdlength;
+			continue;
+		}
+		if (ttl < entry->ttl)
+		{
+			entry->ttl = ttl;
+		}
+		offset += rdlength;
+	}
+	return SW_OK;
+}
+
+static int swDNSResolver_onReceive(swReactor *reactor, swEvent *event)
+{
+	swDNSResolver *resolver = &swoole_dns_resolver;
+	swDNSResolver_entry *entry;
+	struct sockaddr_in addr;
+	socklen_t addr_len;
+	char packet[SW_DNS_PACKET_SIZE];
+	uint16_t id;
+	int n, type;
+
+	while (1)
+	{
+		addr_len = sizeof(addr);
+		n = recvfrom(event->fd, packet, sizeof(packet), 0, (struct sockaddr *) &addr, &addr_len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno != EAGAIN)
+			{
+				swWarn("recvfrom dns server failed. Error: %s[%d]", strerror(errno), errno);
+			}
+			break;
+		}
+		//只接收nameserver的响应
+		if (n < SW_DNS_HEADER_SIZE || addr.sin_addr.s_addr != resolver->server.sin_addr.s_addr
+				|| addr.sin_port != resolver->server.sin_port)
+		{
+			continue;
+		}
+		memcpy(&id, packet, 2);
+		id = ntohs(id);
+		entry = swHashMap_find_int(&resolver->queries, id);
+		if (entry == NULL)
+		{
+			continue;
+		}
+		if ((entry->pending & SW_DNS_QUERY_A) && entry->id[0] == id)
+		{
+			type = SW_DNS_QUERY_A;
+		}
+		else if ((entry->pending & SW_DNS_QUERY_AAAA) && entry->id[1] == id)
+		{
+			type = SW_DNS_QUERY_AAAA;
+		}
+		else
+		{
+			continue;
+		}
+		swHashMap_del_int(&resolver->queries, id);
+		entry->pending &= ~type;
+		swDNSResolver_parse(entry, type, packet, n);
+		if (entry->pending == 0)
+		{
+			swDNSResolver_finish(resolver, entry);
+		}
+	}
+	return SW_OK;
+}
+
+/**
+ * 超时重发还没有返回的查询, 重试SW_DNS_RETRY次后放弃
+ */
+static void swDNSResolver_onTimeout(swTimer *timer, swTimer_node *node)
+{
+	swDNSResolver *resolver = &swoole_dns_resolver;
+	swDNSResolver_entry *entry = node->data;
+
+	entry->timer_id = 0;
+	if (entry->retry < SW_DNS_RETRY)
+	{
+		entry->retry++;
+		if (entry->pending & SW_DNS_QUERY_A)
+		{
+			swDNSResolver_send(resolver, entry, SW_DNS_QUERY_A);
+		}
+		if (entry->pending & SW_DNS_QUERY_AAAA)
+		{
+			swDNSResolver_send(resolver, entry, SW_DNS_QUERY_AAAA);
+		}
+		entry->timer_id = swTimer_set(timer, SW_DNS_TIMEOUT, 0, entry, swDNSResolver_onTimeout);
+		if (entry->timer_id > 0)
+		{
+			return;
+		}
+		entry->timer_id = 0;
+	}
+	if (entry->pending & SW_DNS_QUERY_A)
+	{
+		swHashMap_del_int(&resolver->queries, entry->id[0]);
+	}
+	if (entry->pending & SW_DNS_QUERY_AAAA)
+	{
+		swHashMap_del_int(&resolver->queries, entry->id[1]);
+	}
+	entry->pending = 0;
+	swDNSResolver_finish(resolver, entry);
+}
+
+/**
+ * 通知所有等待的回调, 查询失败的结果不缓存
+ */
+static void swDNSResolver_finish(swDNSResolver *resolver, swDNSResolver_entry *entry)
+{
+	swDNSResolver_waiter *waiter, *next;
+	swDNSResolver_result *result = NULL;
+
+	if (entry->timer_id > 0)
+	{
+		swTimer_clear(&SwooleG.timer, entry->timer_id);
+		entry->timer_id = 0;
+	}
+	if (entry->result.ipv4_num > 0 || entry->result.ipv6_num > 0)
+	{
+		result = &entry->result;
+	}
+	entry->expire = swClock_now() + (entry->ttl < SW_DNS_MIN_TTL ? SW_DNS_MIN_TTL : entry->ttl);
+
+	waiter = entry->waiter_head;
+	entry->waiter_head = entry->waiter_tail = NULL;
+	//回调中可能再次查询同一个域名, 先从缓存中移除
+	if (result == NULL && entry->cached)
+	{
+		swHashMap_del(&resolver->cache, entry->domain, entry->domain_len);
+		resolver->cache_num--;
+		entry->cached = 0;
+	}
+	for (; waiter != NULL; waiter = next)
+	{
+		next = waiter->next;
+		waiter->callback(entry->domain, result, waiter->data);
+		sw_free(waiter);
+	}
+	if (!entry->cached)
+	{
+		swDNSResolver_entry_free(resolver, entry);
+	}
+}
+
+void swDNSResolver_free()
+{
+	swDNSResolver *resolver = &swoole_dns_resolver;
+
+	if (resolver->reactor == NULL)
+	{
+		return;
+	}
+	while (resolver->entries != NULL)
+	{
+		swDNSResolver_entry_free(resolver, resolver->entries);
+	}
+	resolver->reactor->del(resolver->reactor, resolver->fd);
+	close(resolver->fd);
+	swHashMap_destory(&resolver->cache);
+	swHashMap_free_int(&resolver->queries);
+	bzero(resolver, sizeof(swDNSResolver));
+}
@@ -0,0 +1,158 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "Server.h"
+
+#include <sys/stat.h>
+
+static swFileCache_node* swFileCache_node_new(swFileCache *cache, char *filename);
+static int swFileCache_node_release(swFileCache_node *node);
+
+int swFileCache_create(swFileCache *cache)
+{
+	bzero(cache, sizeof(swFileCache));
+	if (swMutex_create(&cache->lock, 0) < 0)
+	{
+		swWarn("create file cache lock failed.");
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+static swFileCache_node* swFileCache_node_new(swFileCache *cache, char *filename)
+{
+	swFileCache_node *node;
+	struct stat file_stat;
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		swWarn("open file[%s] failed. Error: %s[%d]", filename, strerror(errno), errno);
+		return NULL;
+	}
+	if (fstat(fd, &file_stat) < 0)
+	{
+		swWarn("fstat file[%s] failed. Error: %s[%d]", filename, strerror(errno), errno);
+		close(fd);
+		return NULL;
+	}
+	node = sw_malloc(sizeof(swFileCache_node));
+	if (node == NULL)
+	{
+		swWarn("malloc for swFileCache_node failed.");
+		close(fd);
+		return NULL;
+	}
+	node->cache = cache;
+	node->fd = fd;
+	node->refcount = 1;
+	node->filesize = file_stat.st_size;
+	node->mtime = file_stat.st_mtime;
+	node->inode = file_stat.st_ino;
+	node->check_time = swClock_now();
+	return node;
+}
+
+/**
+ * 引用计数为0时关闭文件, 调用者必须持有锁
+ */
+static int swFileCache_node_release(swFileCache_node *node)
+{
+	if (--node->refcount > 0)
+	{
+		return SW_OK;
+	}
+	close(node->fd);
+	sw_free(node);
+	return SW_OK;
+}
+
+/**
+ * 获取文件的引用, 缓存的文件每隔SW_FILECACHE_CHECK_INTERVAL秒用stat检查一次是否被修改
+ * 文件被修改后打开新的fd, 旧的fd在最后一个引用释放后关闭
+ */
+swFileCache_node* swFileCache_get(swFileCache *cache, char *filename, uint16_t name_len)
+{
+	swFileCache_node *node, *old;
+	struct stat file_stat;
+
+	cache->lock.lock(&cache->lock);
+	node = swHashMap_find(&cache->map, filename, name_len);
+	if (node == NULL)
+	{
+		node = swFileCache_node_new(cache, filename);
+		if (node == NULL)
+		{
+			goto unlock;
+		}
+		//缓存已满, 不再缓存, 只由调用者持有
+		if (cache->num >= SW_FILECACHE_MAX || swHashMap_add(&cache->map, filename, name_len, node) < 0)
+		{
+			node->refcount = 0;
+		}
+		else
+		{
+			cache->num++;
+		}
+	}
+	else if (swClock_now() - node->check_time >= SW_FILECACHE_CHECK_INTERVAL)
+	{
+		if (stat(filename, &file_stat) == 0 && file_stat.st_mtime == node->mtime && file_stat.st_ino == node->inode
+				&& file_stat.st_size == node->filesize)
+		{
+			node->check_time = swClock_now();
+		}
+		else
+		{
+			old = node;
+			node = swFileCache_node_new(cache, filename);
+			//保留旧的节点, 下次请求重新检查
+			if (node == NULL)
+			{
+				old->check_time = 0;
+				goto unlock;
+			}
+			swHashMap_update(&cache->map, filename, name_len, node);
+			swFileCache_node_release(old);
+		}
+	}
+	node->refcount++;
+
+	unlock:
+	cache->lock.unlock(&cache->lock);
+	return node;
+}
+
+void swFileCache_release(swFileCache_node *node)
+{
+	swFileCache *cache = node->cache;
+	cache->lock.lock(&cache->lock);
+	swFileCache_node_release(node);
+	cache->lock.unlock(&cache->lock);
+}
+
+/**
+ * 释放sendfile任务持有的文件引用
+ */
+void swTask_sendfile_free(swTask_sendfile *task)
+{
+	if (task->file != NULL)
+	{
+		swFileCache_release(task->file);
+	}
+	sw_free(task);
+}
@@ -0,0 +1,363 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "http.h"
+
+#define swHttp_is_header(name, len, str)  (len == sizeof(str) - 1 && strncasecmp(name, str, len) == 0)
+
+static const struct
+{
+	char *name;
+	uint8_t length;
+	uint8_t method;
+} swHttp_methods[] = {
+	{ "GET", 3, SW_HTTP_GET },
+	{ "POST", 4, SW_HTTP_POST },
+	{ "HEAD", 4, SW_HTTP_HEAD },
+	{ "PUT", 3, SW_HTTP_PUT },
+	{ "DELETE", 6, SW_HTTP_DELETE },
+	{ "OPTIONS", 7, SW_HTTP_OPTIONS },
+	{ "PATCH", 5, SW_HTTP_PATCH },
+};
+
+static inline void swHttp_slice_set(swHttp_slice *slice, char *base, char *start, char *end)
+{
+	slice->offset = start - base;
+	slice->length = end - start;
+}
+
+int swHttp_has_token(char *value, int length, char *token, int token_len)
+{
+	char *p = value, *end = value + length, *item;
+
+	while (p < end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+		{
+			p++;
+		}
+		item = p;
+		while (p < end && *p != ',')
+		{
+			p++;
+		}
+		length = p - item;
+		while (length > 0 && (item[length - 1] == ' ' || item[length - 1] == '\t'))
+		{
+			length--;
+		}
+		if (length == token_len && strncasecmp(item, token, token_len) == 0)
+		{
+			return SW_TRUE;
+		}
+	}
+	return SW_FALSE;
+}
+
+int swHttpRequest_parse(swHttpRequest *req, char *buf, uint32_t length)
+{
+	char *p, *end, *line_end, *start, *name_end, *value, *value_end;
+	uint32_t scan_length = length < SW_HTTP_HEADER_MAX_SIZE ? length : SW_HTTP_HEADER_MAX_SIZE;
+	uint64_t content_length = 0;
+	uint8_t has_length = 0, conn_close = 0, conn_keepalive = 0;
+	swHttp_header *header;
+	int pos, i;
+
+	bzero(req, sizeof(swHttpRequest));
+	pos = swoole_strnpos(buf, scan_length, "\r\n\r\n", 4);
+	if (pos < 0)
+	{
+		if (length >= SW_HTTP_HEADER_MAX_SIZE)
+		{
+			req->status = 431;
+			return SW_ERR;
+		}
+		return SW_HTTP_AGAIN;
+	}
+	req->header_length = pos + 4;
+	req->status = 400;
+	//最后一行头部的\r\n之后
+	end = buf + pos + 2;
+
+	//请求行之前的空行
+	p = buf;
+	while (p < end && (*p == '\r' || *p == '\n'))
+	{
+		p++;
+	}
+	if (p >= end)
+	{
+		return SW_ERR;
+	}
+	line_end = p + swoole_strnpos(p, end - p, "\r\n", 2);
+
+	//method
+	start = p;
+	while (p < line_end && *p != ' ')
+	{
+		p++;
+	}
+	if (p == start || p == line_end)
+	{
+		return SW_ERR;
+	}
+	swHttp_slice_set(&req->method_name, buf, start, p);
+	for (i = 0; i < sizeof(swHttp_methods) / sizeof(swHttp_methods[0]); i++)
+	{
+		if (swHttp_methods[i].length == p - start && memcmp(start, swHttp_methods[i].name, p - start) == 0)
+		{
+			req->method = swHttp_methods[i].method;
+			break;
+		}
+	}
+
+	//uri
+	start = ++p;
+	while (p < line_end && *p != ' ')
+	{
+		p++;
+	}
+	if (p == start || p == line_end)
+	{
+		return SW_ERR;
+	}
+	swHttp_slice_set(&req->uri, buf, start, p);
+	value = memchr(start, '?', p - start);
+	if (value == NULL)
+	{
+		swHttp_slice_set(&req->path, buf, start, p);
+		swHttp_slice_set(&req->query_string, buf, p, p);
+	}
+	else
+	{
+		swHttp_slice_set(&req->path, buf, start, value);
+		swHttp_slice_set(&req->query_string, buf, value + 1, p);
+	}
+
+	//version
+	p++;
+	if (line_end - p != 8 || memcmp(p, "HTTP/", 5) != 0 || p[6] != '.')
+	{
+		return SW_ERR;
+	}
+	if (p[5] != '1')
+	{
+		req->status = 505;
+		return SW_ERR;
+	}
+	else if (p[7] == '1')
+	{
+		req->version = 11;
+	}
+	else if (p[7] == '0')
+	{
+		req->version = 10;
+	}
+	else
+	{
+		req->status = 505;
+		return SW_ERR;
+	}
+
+	//headers
+	p = line_end + 2;
+	while (p < end)
+	{
+		line_end = p + swoole_strnpos(p, end - p, "\r\n", 2);
+		//不支持obs-fold
+		if (*p == ' ' || *p == '\t')
+		{
+			return SW_ERR;
+		}
+		name_end = memchr(p, ':', line_end - p);
+		//字段名和冒号之间不允许有空白
+		if (name_end == NULL || name_end == p || name_end[-1] == ' ' || name_end[-1] == '\t')
+		{
+			return SW_ERR;
+		}
+		if (req->header_num == SW_HTTP_HEADER_NUM)
+		{
+			req->status = 431;
+			return SW_ERR;
+		}
+		value = name_end + 1;
+		while (value < line_end && (*value == ' ' || *value == '\t'))
+		{
+			value++;
+		}
+		value_end = line_end;
+		while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+		{
+			value_end--;
+		}
+		header = &req->headers[req->header_num++];
+		swHttp_slice_set(&header->name, buf, p, name_end);
+		swHttp_slice_set(&header->value, buf, value, value_end);
+
+		if (swHttp_is_header(p, name_end - p, "Content-Length"))
+		{
+			if (has_length || value == value_end)
+			{
+				return SW_ERR;
+			}
+			content_length = 0;
+			for (start = value; start < value_end; start++)
+			{
+				if (*start < '0' || *start > '9')
+				{
+					return SW_ERR;
+				}
+				content_length = content_length * 10 + (*start - '0');
+				if (content_length > UINT32_MAX)
+				{
+					req->status = 413;
+					return SW_ERR;
+				}
+			}
+			has_length = 1;
+		}
+		else if (swHttp_is_header(p, name_end - p, "Transfer-Encoding"))
+		{
+			if (!swHttp_has_token(value, value_end - value, "chunked", 7))
+			{
+				req->status = 501;
+				return SW_ERR;
+			}
+			req->chunked = 1;
+		}
+		else if (swHttp_is_header(p, name_end - p, "Connection"))
+		{
+			conn_close |= swHttp_has_token(value, value_end - value, "close", 5);
+			conn_keepalive |= swHttp_has_token(value, value_end - value, "keep-alive", 10);
+		}
+		else if (swHttp_is_header(p, name_end - p, "Expect"))
+		{
+			req->expect_continue = swHttp_has_token(value, value_end - value, "100-continue", 12);
+		}
+		p = line_end + 2;
+	}
+
+	//同时有Content-Length和chunked可能是请求走私, 直接拒绝
+	if (has_length && req->chunked)
+	{
+		return SW_ERR;
+	}
+	req->content_length = content_length;
+	if (req->version == 11)
+	{
+		req->keepalive = !conn_close;
+	}
+	else
+	{
+		req->keepalive = conn_keepalive && !conn_close;
+	}
+	req->status = 0;
+	return SW_OK;
+}
+
+int swHttpRequest_parse_chunked(char *buf, uint32_t length, int decode, uint32_t *body_length, uint32_t *consumed)
+{
+	char *p = buf, *end = buf + length, *out = buf, *s;
+	uint64_t size;
+	int pos;
+
+	while (1)
+	{
+		pos = swoole_strnpos(p, end - p, "\r\n", 2);
+		if (pos < 0)
+		{
+			return end - p > SW_HTTP_CHUNK_LINE_MAX ? SW_ERR : SW_HTTP_AGAIN;
+		}
+		size = 0;
+		for (s = p; s < p + pos; s++)
+		{
+			if (*s >= '0' && *s <= '9')
+			{
+				size = size * 16 + (*s - '0');
+			}
+			else if ((*s | 0x20) >= 'a' && (*s | 0x20) <= 'f')
+			{
+				size = size * 16 + ((*s | 0x20) - 'a' + 10);
+			}
+			else
+			{
+				break;
+			}
+			if (size > UINT32_MAX)
+			{
+				return SW_ERR;
+			}
+		}
+		//chunk-ext
+		if (s == p || (s < p + pos && *s != ';' && *s != ' ' && *s != '\t'))
+		{
+			return SW_ERR;
+		}
+		p += pos + 2;
+		if (size == 0)
+		{
+			break;
+		}
+		if (end - p < size + 2)
+		{
+			return SW_HTTP_AGAIN;
+		}
+		if (p[size] != '\r' || p[size + 1] != '\n')
+		{
+			return SW_ERR;
+		}
+		if (decode)
+		{
+			memmove(out, p, size);
+		}
+		out += size;
+		p += size + 2;
+	}
+	//trailer, 以空行结束
+	while (1)
+	{
+		pos = swoole_strnpos(p, end - p, "\r\n", 2);
+		if (pos < 0)
+		{
+			return end - p > SW_HTTP_HEADER_MAX_SIZE ? SW_ERR : SW_HTTP_AGAIN;
+		}
+		p += pos + 2;
+		if (pos == 0)
+		{
+			break;
+		}
+	}
+	*body_length = out - buf;
+	*consumed = p - buf;
+	return SW_OK;
+}
+
+swHttp_header* swHttpRequest_find_header(swHttpRequest *req, char *name, int name_len)
+{
+	char *data = swHttpRequest_data(req);
+	int i;
+
+	for (i = 0; i < req->header_num; i++)
+	{
+		if (req->headers[i].name.length == name_len
+				&& strncasecmp(data + req->headers[i].name.offset, name, name_len) == 0)
+		{
+			return &req->headers[i];
+		}
+	}
+	return NULL;
+}
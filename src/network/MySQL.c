@@ -0,0 +1,1611 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "mysql_client.h"
+
+#define SW_MYSQL_PACKET_HEADER        4
+#define SW_MYSQL_PACKET_MAX           0xffffff
+#define SW_MYSQL_NATIVE_PASSWORD      "mysql_native_password"
+
+#define SW_MYSQL_CLIENT_LONG_PASSWORD     0x00000001
+#define SW_MYSQL_CLIENT_LONG_FLAG         0x00000004
+#define SW_MYSQL_CLIENT_CONNECT_WITH_DB   0x00000008
+#define SW_MYSQL_CLIENT_PROTOCOL_41       0x00000200
+#define SW_MYSQL_CLIENT_TRANSACTIONS      0x00002000
+#define SW_MYSQL_CLIENT_SECURE_CONNECTION 0x00008000
+#define SW_MYSQL_CLIENT_PLUGIN_AUTH       0x00080000
+
+#define SW_MYSQL_COM_QUIT             0x01
+#define SW_MYSQL_COM_QUERY            0x03
+#define SW_MYSQL_COM_STMT_PREPARE     0x16
+#define SW_MYSQL_COM_STMT_EXECUTE     0x17
+#define SW_MYSQL_COM_STMT_CLOSE       0x19
+
+#define SW_MYSQL_PACKET_OK            0x00
+#define SW_MYSQL_PACKET_AUTH_MORE     0x01
+#define SW_MYSQL_PACKET_LOCAL_INFILE  0xfb
+#define SW_MYSQL_PACKET_EOF           0xfe
+#define SW_MYSQL_PACKET_ERR           0xff
+
+#define SW_MYSQL_UNSIGNED_FLAG        32
+
+enum swMySQL_state
+{
+	SW_MYSQL_STATE_CONNECT = 1,
+	SW_MYSQL_STATE_HANDSHAKE,
+	SW_MYSQL_STATE_AUTH,
+	SW_MYSQL_STATE_READY,
+	SW_MYSQL_STATE_QUERY,
+	SW_MYSQL_STATE_PREPARE,
+	SW_MYSQL_STATE_EXECUTE,
+};
+
+enum swMySQL_result_state
+{
+	SW_MYSQL_RESULT_HEAD = 0,
+	SW_MYSQL_RESULT_FIELD,
+	SW_MYSQL_RESULT_FIELD_EOF,
+	SW_MYSQL_RESULT_ROW,
+};
+
+enum swMySQL_type
+{
+	SW_MYSQL_TYPE_TINY = 1,
+	SW_MYSQL_TYPE_SHORT = 2,
+	SW_MYSQL_TYPE_LONG = 3,
+	SW_MYSQL_TYPE_FLOAT = 4,
+	SW_MYSQL_TYPE_DOUBLE = 5,
+	SW_MYSQL_TYPE_NULL = 6,
+	SW_MYSQL_TYPE_TIMESTAMP = 7,
+	SW_MYSQL_TYPE_LONGLONG = 8,
+	SW_MYSQL_TYPE_INT24 = 9,
+	SW_MYSQL_TYPE_DATE = 10,
+	SW_MYSQL_TYPE_TIME = 11,
+	SW_MYSQL_TYPE_DATETIME = 12,
+	SW_MYSQL_TYPE_YEAR = 13,
+	SW_MYSQL_TYPE_VAR_STRING = 253,
+};
+
+#define sw_mysql_uint2(p)  ((uint16_t) (uint8_t) (p)[0] | ((uint16_t) (uint8_t) (p)[1] << 8))
+#define sw_mysql_uint3(p)  ((uint32_t) (uint8_t) (p)[0] | ((uint32_t) (uint8_t) (p)[1] << 8) | ((uint32_t) (uint8_t) (p)[2] << 16))
+#define sw_mysql_uint4(p)  ((uint32_t) sw_mysql_uint3(p) | ((uint32_t) (uint8_t) (p)[3] << 24))
+#define sw_mysql_uint8(p)  ((uint64_t) sw_mysql_uint4(p) | ((uint64_t) sw_mysql_uint4((p) + 4) << 32))
+
+static swHashMap_int swoole_mysql_clients;   //fd -> swMySQL_client
+
+static int swMySQL_client_connect(swMySQL_pool *pool);
+static void swMySQL_client_close(swMySQL_client *cli, int error_code, char *error_msg);
+static void swMySQL_client_free(swMySQL_client *cli);
+static int swMySQL_client_flush(swMySQL_client *cli);
+static void swMySQL_client_start(swMySQL_client *cli, swMySQL_query *query);
+static void swMySQL_client_finish(swMySQL_client *cli);
+static int swMySQL_client_handle(swMySQL_client *cli, char *p, uint32_t len);
+static int swMySQL_client_handshake(swMySQL_client *cli, char *p, uint32_t len);
+static int swMySQL_client_auth(swMySQL_client *cli, char *p, uint32_t len);
+static int swMySQL_client_prepare(swMySQL_client *cli, char *p, uint32_t len);
+static int swMySQL_client_result(swMySQL_client *cli, char *p, uint32_t len, int binary);
+static int swMySQL_client_execute(swMySQL_client *cli);
+static int swMySQL_parse_field(swMySQL_client *cli, char *p, uint32_t len);
+static int swMySQL_parse_row(swMySQL_client *cli, char *p, uint32_t len);
+static int swMySQL_parse_binary_row(swMySQL_client *cli, char *p, uint32_t len);
+static void swMySQL_parse_ok(swMySQL_client *cli, char *p, uint32_t len);
+static void swMySQL_parse_error(swMySQL_client *cli, char *p, uint32_t len);
+static void swMySQL_set_error(swMySQL_result *result, int error_code, char *error_msg);
+static void swMySQL_pool_dispatch(swMySQL_pool *pool);
+static void swMySQL_pool_fail(swMySQL_pool *pool, int error_code, char *error_msg);
+static void swMySQL_pool_destroy(swMySQL_pool *pool);
+static int swMySQL_onRead(swReactor *reactor, swEvent *event);
+static int swMySQL_onWrite(swReactor *reactor, swEvent *event);
+static void swMySQL_onTimeout(swTimer *timer, swTimer_node *node);
+
+static int swMySQL_string_reserve(swString *str, uint32_t length)
+{
+	size_t size = str->size;
+	if (str->length + length <= size)
+	{
+		return SW_OK;
+	}
+	while (size < str->length + length)
+	{
+		size *= 2;
+	}
+	return swString_extend(str, size);
+}
+
+/**
+ * 返回消耗的字节数, 0xfb表示NULL
+ */
+static int swMySQL_lenenc(char *p, char *end, uint64_t *value, int *is_null)
+{
+	uint8_t c;
+
+	if (p >= end)
+	{
+		return SW_ERR;
+	}
+	c = (uint8_t) p[0];
+	if (is_null)
+	{
+		*is_null = (c == 0xfb);
+	}
+	if (c < 0xfb)
+	{
+		*value = c;
+		return 1;
+	}
+	else if (c == 0xfb)
+	{
+		*value = 0;
+		return 1;
+	}
+	else if (c == 0xfc && p + 3 <= end)
+	{
+		*value = sw_mysql_uint2(p + 1);
+		return 3;
+	}
+	else if (c == 0xfd && p + 4 <= end)
+	{
+		*value = sw_mysql_uint3(p + 1);
+		return 4;
+	}
+	else if (c == 0xfe && p + 9 <= end)
+	{
+		*value = sw_mysql_uint8(p + 1);
+		return 9;
+	}
+	return SW_ERR;
+}
+
+static char* swMySQL_write_lenenc(char *p, uint64_t value)
+{
+	int i, n;
+
+	if (value < 251)
+	{
+		*p++ = (char) value;
+		return p;
+	}
+	else if (value < 0x10000)
+	{
+		*p++ = (char) 0xfc;
+		n = 2;
+	}
+	else if (value < 0x1000000)
+	{
+		*p++ = (char) 0xfd;
+		n = 3;
+	}
+	else
+	{
+		*p++ = (char) 0xfe;
+		n = 8;
+	}
+	for (i = 0; i < n; i++)
+	{
+		*p++ = (char) (value >> (i * 8));
+	}
+	return p;
+}
+
+/**
+ * 在out中预留包头, 写完数据后由swMySQL_packet_end填写长度
+ */
+static int swMySQL_packet_begin(swMySQL_client *cli, uint32_t length)
+{
+	int begin;
+
+	if (swMySQL_string_reserve(cli->out, SW_MYSQL_PACKET_HEADER + length) < 0)
+	{
+		return SW_ERR;
+	}
+	begin = cli->out->length;
+	cli->out->length += SW_MYSQL_PACKET_HEADER;
+	return begin;
+}
+
+static void swMySQL_packet_end(swMySQL_client *cli, int begin)
+{
+	char *header = cli->out->str + begin;
+	uint32_t length = cli->out->length - begin - SW_MYSQL_PACKET_HEADER;
+
+	header[0] = (char) length;
+	header[1] = (char) (length >> 8);
+	header[2] = (char) (length >> 16);
+	header[3] = (char) cli->sequence++;
+}
+
+static int swMySQL_send_command(swMySQL_client *cli, uint8_t command, char *data, uint32_t length)
+{
+	int begin;
+
+	if (length + 1 >= SW_MYSQL_PACKET_MAX)
+	{
+		swWarn("mysql command is too large.");
+		return SW_ERR;
+	}
+	cli->sequence = 0;
+	begin = swMySQL_packet_begin(cli, length + 1);
+	if (begin < 0)
+	{
+		return SW_ERR;
+	}
+	cli->out->str[cli->out->length++] = (char) command;
+	memcpy(cli->out->str + cli->out->length, data, length);
+	cli->out->length += length;
+	swMySQL_packet_end(cli, begin);
+	return swMySQL_client_flush(cli);
+}
+
+/**
+ * 发送出错时不关闭连接, 由随后的可读事件处理
+ */
+static int swMySQL_client_flush(swMySQL_client *cli)
+{
+	swString *out = cli->out;
+	int n, sent = 0;
+
+	if (cli->state == SW_MYSQL_STATE_CONNECT)
+	{
+		return SW_OK;
+	}
+	while (sent < out->length)
+	{
+		n = send(cli->fd, out->str + sent, out->length - sent, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			else if (errno == EAGAIN)
+			{
+				break;
+			}
+			swWarn("send to mysql failed. Error: %s[%d]", strerror(errno), errno);
+			out->length = 0;
+			return SW_ERR;
+		}
+		sent += n;
+	}
+	if (sent == out->length)
+	{
+		out->length = 0;
+		return cli->pool->reactor->set(cli->pool->reactor, cli->fd, SW_FD_MYSQL | SW_EVENT_READ);
+	}
+	memmove(out->str, out->str + sent, out->length - sent);
+	out->length -= sent;
+	return cli->pool->reactor->set(cli->pool->reactor, cli->fd, SW_FD_MYSQL | SW_EVENT_READ | SW_EVENT_WRITE);
+}
+
+int swMySQL_charset(char *name)
+{
+	static const struct
+	{
+		char *name;
+		int id;
+	} charsets[] = {
+		{ "big5", 1 },
+		{ "latin1", 8 },
+		{ "gb2312", 24 },
+		{ "gbk", 28 },
+		{ "utf8", 33 },
+		{ "utf8mb4", 45 },
+		{ "binary", 63 },
+	};
+	int i;
+
+	for (i = 0; i < sizeof(charsets) / sizeof(charsets[0]); i++)
+	{
+		if (strcasecmp(name, charsets[i].name) == 0)
+		{
+			return charsets[i].id;
+		}
+	}
+	return SW_ERR;
+}
+
+swMySQL_pool* swMySQL_pool_new(swReactor *reactor, char *host, int port, char *user, char *password, char *database,
+		int size)
+{
+	swMySQL_pool *pool;
+	struct hostent *host_entry;
+
+	if (strlen(user) >= SW_MYSQL_USER_MAX || strlen(password) >= SW_MYSQL_PASSWORD_MAX
+			|| strlen(database) >= SW_MYSQL_DATABASE_MAX)
+	{
+		swWarn("mysql user, password or database is too long.");
+		return NULL;
+	}
+	pool = sw_malloc(sizeof(swMySQL_pool));
+	if (pool == NULL)
+	{
+		swWarn("malloc for swMySQL_pool failed.");
+		return NULL;
+	}
+	bzero(pool, sizeof(swMySQL_pool));
+
+	if (host[0] == '/')
+	{
+		if (strlen(host) >= sizeof(pool->unix_addr.sun_path))
+		{
+			swWarn("unix socket path[%s] is too long.", host);
+			sw_free(pool);
+			return NULL;
+		}
+		pool->sock_domain = AF_UNIX;
+		pool->unix_addr.sun_family = AF_UNIX;
+		strcpy(pool->unix_addr.sun_path, host);
+	}
+	else
+	{
+		pool->sock_domain = AF_INET;
+		pool->addr.sin_family = AF_INET;
+		pool->addr.sin_port = htons(port > 0 ? port : SW_MYSQL_DEFAULT_PORT);
+		//只在创建时解析一次
+		if (!inet_aton(host, &pool->addr.sin_addr))
+		{
+			host_entry = gethostbyname(host);
+			if (host_entry == NULL || host_entry->h_addrtype != AF_INET)
+			{
+				swWarn("gethostbyname(%s) failed.", host);
+				sw_free(pool);
+				return NULL;
+			}
+			memcpy(&pool->addr.sin_addr, host_entry->h_addr_list[0], host_entry->h_length);
+		}
+	}
+	strcpy(pool->user, user);
+	strcpy(pool->password, password);
+	strcpy(pool->database, database);
+	pool->charset = SW_MYSQL_DEFAULT_CHARSET;
+	pool->size = size > 0 ? size : SW_MYSQL_POOL_SIZE;
+	pool->reactor = reactor;
+
+	reactor->setHandle(reactor, SW_FD_MYSQL | SW_EVENT_READ, swMySQL_onRead);
+	reactor->setHandle(reactor, SW_FD_MYSQL | SW_EVENT_WRITE, swMySQL_onWrite);
+	return pool;
+}
+
+/**
+ * 加入队列, 有空闲连接时立即发送, 否则在连接数未满时创建新连接
+ */
+int swMySQL_pool_query(swMySQL_pool *pool, swMySQL_query *query)
+{
+	if (pool->destroy)
+	{
+		return SW_ERR;
+	}
+	query->next = NULL;
+	if (pool->queue_tail == NULL)
+	{
+		pool->queue_head = query;
+	}
+	else
+	{
+		pool->queue_tail->next = query;
+	}
+	pool->queue_tail = query;
+	pool->queue_num++;
+
+	swMySQL_pool_dispatch(pool);
+	if (pool->destroy && pool->callback_depth == 0)
+	{
+		swMySQL_pool_destroy(pool);
+	}
+	return SW_OK;
+}
+
+static void swMySQL_pool_dispatch(swMySQL_pool *pool)
+{
+	swMySQL_client *cli;
+	swMySQL_query *query;
+
+	while (pool->queue_head != NULL && pool->idle != NULL && !pool->destroy)
+	{
+		cli = pool->idle;
+		pool->idle = cli->next_idle;
+		cli->next_idle = NULL;
+
+		query = pool->queue_head;
+		pool->queue_head = query->next;
+		if (pool->queue_head == NULL)
+		{
+			pool->queue_tail = NULL;
+		}
+		pool->queue_num--;
+		query->next = NULL;
+		swMySQL_client_start(cli, query);
+	}
+	//正在回调的连接很快会空闲, 不需要为它们等待的查询创建连接
+	while (pool->queue_num > pool->connecting + pool->releasing && pool->num < pool->size && !pool->destroy)
+	{
+		if (swMySQL_client_connect(pool) < 0)
+		{
+			if (pool->num == 0)
+			{
+				swMySQL_pool_fail(pool, SW_MYSQL_CR_CONN_HOST_ERROR, strerror(errno));
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * 所有连接都失败时, 队列中的查询全部返回错误
+ */
+static void swMySQL_pool_fail(swMySQL_pool *pool, int error_code, char *error_msg)
+{
+	swMySQL_query *query;
+	swMySQL_result result;
+
+	bzero(&result, sizeof(result));
+	swMySQL_set_error(&result, error_code, error_msg);
+
+	while ((query = pool->queue_head) != NULL)
+	{
+		pool->queue_head = query->next;
+		if (pool->queue_head == NULL)
+		{
+			pool->queue_tail = NULL;
+		}
+		pool->queue_num--;
+		pool->callback_depth++;
+		query->onResult(query, &result);
+		pool->callback_depth--;
+	}
+}
+
+void swMySQL_pool_free(swMySQL_pool *pool)
+{
+	if (pool->callback_depth > 0)
+	{
+		pool->destroy = 1;
+		return;
+	}
+	swMySQL_pool_destroy(pool);
+}
+
+static void swMySQL_pool_destroy(swMySQL_pool *pool)
+{
+	swMySQL_client *cli;
+	swMySQL_query *query;
+
+	pool->destroy = 1;
+	pool->callback_depth++;
+	while ((cli = pool->clients) != NULL)
+	{
+		pool->clients = cli->next;
+		if (cli->state >= SW_MYSQL_STATE_READY)
+		{
+			cli->sequence = 0;
+			cli->out->length = 0;
+			swMySQL_send_command(cli, SW_MYSQL_COM_QUIT, NULL, 0);
+		}
+		query = cli->query;
+		if (query != NULL)
+		{
+			cli->query = NULL;
+			swMySQL_set_error(&cli->result, SW_MYSQL_CR_SERVER_LOST, "mysql pool is closed.");
+			query->onResult(query, &cli->result);
+		}
+		swMySQL_client_free(cli);
+	}
+	pool->callback_depth--;
+	swMySQL_pool_fail(pool, SW_MYSQL_CR_SERVER_LOST, "mysql pool is closed.");
+	sw_free(pool);
+}
+
+static int swMySQL_client_connect(swMySQL_pool *pool)
+{
+	swMySQL_client *cli;
+	int ret;
+
+	cli = sw_malloc(sizeof(swMySQL_client));
+	if (cli == NULL)
+	{
+		swWarn("malloc for swMySQL_client failed.");
+		return SW_ERR;
+	}
+	bzero(cli, sizeof(swMySQL_client));
+	cli->pool = pool;
+	cli->buffer = swString_new(SW_MYSQL_BUFFER_SIZE);
+	cli->out = swString_new(SW_BUFFER_SIZE);
+	cli->row = swString_new(SW_BUFFER_SIZE);
+	if (cli->buffer == NULL || cli->out == NULL || cli->row == NULL)
+	{
+		goto fail;
+	}
+	cli->fd = socket(pool->sock_domain, SOCK_STREAM, 0);
+	if (cli->fd < 0)
+	{
+		swWarn("socket() failed. Error: %s[%d]", strerror(errno), errno);
+		goto fail;
+	}
+	swSetNonBlock(cli->fd);
+	fcntl(cli->fd, F_SETFD, FD_CLOEXEC);
+
+	if (pool->sock_domain == AF_UNIX)
+	{
+		ret = connect(cli->fd, (struct sockaddr *) &pool->unix_addr, sizeof(pool->unix_addr));
+	}
+	else
+	{
+		ret = connect(cli->fd, (struct sockaddr *) &pool->addr, sizeof(pool->addr));
+	}
+	if (ret < 0 && errno != EINPROGRESS && errno != EAGAIN)
+	{
+		swWarn("connect to mysql failed. Error: %s[%d]", strerror(errno), errno);
+		close(cli->fd);
+		goto fail;
+	}
+	cli->state = SW_MYSQL_STATE_CONNECT;
+	if (pool->reactor->add(pool->reactor, cli->fd, SW_FD_MYSQL | SW_EVENT_WRITE) < 0)
+	{
+		close(cli->fd);
+		goto fail;
+	}
+	swHashMap_add_int(&swoole_mysql_clients, cli->fd, cli);
+
+	if (swTimer_init_reactor(pool->reactor, SW_MYSQL_CONNECT_TIMEOUT) == SW_OK)
+	{
+		cli->timer_id = swTimer_set(&SwooleG.timer, SW_MYSQL_CONNECT_TIMEOUT, 0, cli, swMySQL_onTimeout);
+		if (cli->timer_id < 0)
+		{
+			cli->timer_id = 0;
+		}
+	}
+
+	cli->next = pool->clients;
+	pool->clients = cli;
+	pool->num++;
+	pool->connecting++;
+	return SW_OK;
+
+	fail:
+	if (cli->buffer)
+	{
+		swString_free(cli->buffer);
+	}
+	if (cli->out)
+	{
+		swString_free(cli->out);
+	}
+	if (cli->row)
+	{
+		swString_free(cli->row);
+	}
+	sw_free(cli);
+	return SW_ERR;
+}
+
+static void swMySQL_client_free(swMySQL_client *cli)
+{
+	uint16_t i;
+
+	if (cli->timer_id > 0)
+	{
+		swTimer_clear(&SwooleG.timer, cli->timer_id);
+	}
+	swHashMap_del_int(&swoole_mysql_clients, cli->fd);
+	cli->pool->reactor->del(cli->pool->reactor, cli->fd);
+
+	if (cli->result.fields)
+	{
+		for (i = 0; i < cli->result.field_num; i++)
+		{
+			sw_free(cli->result.fields[i].name);
+		}
+		sw_free(cli->result.fields);
+	}
+	if (cli->values)
+	{
+		sw_free(cli->values);
+		sw_free(cli->lengths);
+	}
+	swString_free(cli->buffer);
+	swString_free(cli->out);
+	swString_free(cli->row);
+	sw_free(cli);
+}
+
+/**
+ * 连接出错或被关闭, 正在执行的查询返回错误
+ */
+static void swMySQL_client_close(swMySQL_client *cli, int error_code, char *error_msg)
+{
+	swMySQL_pool *pool = cli->pool;
+	swMySQL_client **find;
+	swMySQL_query *query = cli->query;
+	int connecting = cli->state < SW_MYSQL_STATE_READY;
+
+	for (find = &pool->clients; *find != NULL; find = &(*find)->next)
+	{
+		if (*find == cli)
+		{
+			*find = cli->next;
+			break;
+		}
+	}
+	for (find = &pool->idle; *find != NULL; find = &(*find)->next_idle)
+	{
+		if (*find == cli)
+		{
+			*find = cli->next_idle;
+			break;
+		}
+	}
+	pool->num--;
+	if (connecting)
+	{
+		pool->connecting--;
+	}
+
+	if (query != NULL)
+	{
+		cli->query = NULL;
+		if (cli->result.error_code == 0)
+		{
+			swMySQL_set_error(&cli->result, error_code, error_msg);
+		}
+		pool->callback_depth++;
+		query->onResult(query, &cli->result);
+		pool->callback_depth--;
+	}
+	swMySQL_client_free(cli);
+
+	if (pool->destroy)
+	{
+		return;
+	}
+	//没有可用连接时认证失败或者无法连接, 不重试, 避免不断重连
+	if (connecting && pool->num == pool->connecting)
+	{
+		swMySQL_pool_fail(pool, error_code, error_msg);
+	}
+	else
+	{
+		swMySQL_pool_dispatch(pool);
+	}
+}
+
+static void swMySQL_client_start(swMySQL_client *cli, swMySQL_query *query)
+{
+	bzero(&cli->result, sizeof(cli->result));
+	cli->query = query;
+	cli->result_state = SW_MYSQL_RESULT_HEAD;
+	cli->field_index = 0;
+	cli->skip_packets = 0;
+	cli->stmt_id = 0;
+
+	if (query->binary || query->param_num > 0)
+	{
+		cli->state = SW_MYSQL_STATE_PREPARE;
+		swMySQL_send_command(cli, SW_MYSQL_COM_STMT_PREPARE, query->sql, query->sql_len);
+	}
+	else
+	{
+		cli->state = SW_MYSQL_STATE_QUERY;
+		swMySQL_send_command(cli, SW_MYSQL_COM_QUERY, query->sql, query->sql_len);
+	}
+}
+
+/**
+ * 回调结束后连接才放回空闲队列, 回调中发起的查询排在队列中
+ */
+static void swMySQL_client_finish(swMySQL_client *cli)
+{
+	swMySQL_pool *pool = cli->pool;
+	swMySQL_query *query = cli->query;
+	char stmt_id[4];
+	uint16_t i;
+
+	cli->query = NULL;
+	cli->state = SW_MYSQL_STATE_READY;
+	if (cli->stmt_id > 0)
+	{
+		stmt_id[0] = (char) cli->stmt_id;
+		stmt_id[1] = (char) (cli->stmt_id >> 8);
+		stmt_id[2] = (char) (cli->stmt_id >> 16);
+		stmt_id[3] = (char) (cli->stmt_id >> 24);
+		cli->stmt_id = 0;
+		swMySQL_send_command(cli, SW_MYSQL_COM_STMT_CLOSE, stmt_id, sizeof(stmt_id));
+	}
+
+	cli->releasing = 1;
+	pool->releasing++;
+	pool->callback_depth++;
+	query->onResult(query, &cli->result);
+	pool->callback_depth--;
+	pool->releasing--;
+	cli->releasing = 0;
+
+	if (cli->result.fields)
+	{
+		for (i = 0; i < cli->result.field_num; i++)
+		{
+			sw_free(cli->result.fields[i].name);
+		}
+		sw_free(cli->result.fields);
+		cli->result.fields = NULL;
+	}
+	if (pool->destroy)
+	{
+		return;
+	}
+	cli->next_idle = pool->idle;
+	pool->idle = cli;
+	swMySQL_pool_dispatch(pool);
+}
+
+static void swMySQL_set_error(swMySQL_result *result, int error_code, char *error_msg)
+{
+	result->error_code = error_code;
+	memcpy(result->sqlstate, "HY000", 6);
+	snprintf(result->error_msg, sizeof(result->error_msg), "%s", error_msg);
+}
+
+static void swMySQL_parse_error(swMySQL_client *cli, char *p, uint32_t len)
+{
+	swMySQL_result *result = &cli->result;
+	int msg_len;
+
+	if (len < 3)
+	{
+		swMySQL_set_error(result, SW_MYSQL_CR_MALFORMED_PACKET, "malformed error packet.");
+		return;
+	}
+	result->error_code = sw_mysql_uint2(p + 1);
+	p += 3;
+	len -= 3;
+	memcpy(result->sqlstate, "HY000", 6);
+	if (len >= 6 && p[0] == '#')
+	{
+		memcpy(result->sqlstate, p + 1, 5);
+		p += 6;
+		len -= 6;
+	}
+	msg_len = len < sizeof(result->error_msg) - 1 ? len : sizeof(result->error_msg) - 1;
+	memcpy(result->error_msg, p, msg_len);
+	result->error_msg[msg_len] = 0;
+}
+
+static void swMySQL_parse_ok(swMySQL_client *cli, char *p, uint32_t len)
+{
+	char *end = p + len;
+	int n;
+
+	p++;
+	if ((n = swMySQL_lenenc(p, end, &cli->result.affected_rows, NULL)) < 0)
+	{
+		return;
+	}
+	p += n;
+	if ((n = swMySQL_lenenc(p, end, &cli->result.insert_id, NULL)) < 0)
+	{
+		return;
+	}
+	p += n;
+	if (p + 4 <= end)
+	{
+		cli->result.status = sw_mysql_uint2(p);
+		cli->result.warnings = sw_mysql_uint2(p + 2);
+	}
+}
+
+static int swMySQL_client_handle(swMySQL_client *cli, char *p, uint32_t len)
+{
+	if (len == 0)
+	{
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "empty packet.");
+		return SW_ERR;
+	}
+	switch (cli->state)
+	{
+	case SW_MYSQL_STATE_HANDSHAKE:
+		return swMySQL_client_handshake(cli, p, len);
+	case SW_MYSQL_STATE_AUTH:
+		return swMySQL_client_auth(cli, p, len);
+	case SW_MYSQL_STATE_PREPARE:
+		return swMySQL_client_prepare(cli, p, len);
+	case SW_MYSQL_STATE_QUERY:
+		return swMySQL_client_result(cli, p, len, 0);
+	case SW_MYSQL_STATE_EXECUTE:
+		return swMySQL_client_result(cli, p, len, 1);
+	default:
+		swWarn("unexpected mysql packet[state=%d].", cli->state);
+		return SW_OK;
+	}
+}
+
+/**
+ * SHA1(password) XOR SHA1(scramble + SHA1(SHA1(password)))
+ */
+static void swMySQL_scramble(char *password, char *scramble, unsigned char *token)
+{
+	unsigned char stage1[20], stage2[20];
+	char buf[40];
+	int i;
+
+	swoole_sha1(password, strlen(password), stage1);
+	swoole_sha1((char *) stage1, 20, stage2);
+	memcpy(buf, scramble, 20);
+	memcpy(buf + 20, stage2, 20);
+	swoole_sha1(buf, 40, token);
+	for (i = 0; i < 20; i++)
+	{
+		token[i] ^= stage1[i];
+	}
+}
+
+static int swMySQL_client_handshake(swMySQL_client *cli, char *p, uint32_t len)
+{
+	swMySQL_pool *pool = cli->pool;
+	char *end = p + len;
+	uint32_t server_capability;
+	unsigned char token[20];
+	int begin, user_len, db_len;
+	char *out;
+
+	if ((uint8_t) p[0] == SW_MYSQL_PACKET_ERR)
+	{
+		swMySQL_parse_error(cli, p, len);
+		return SW_ERR;
+	}
+	if (p[0] != 10)
+	{
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "unsupported mysql protocol version.");
+		return SW_ERR;
+	}
+	//server version
+	p++;
+	p += strnlen(p, end - p) + 1;
+	//connection id(4) + scramble part1(8) + filler(1) + capability(2) + charset(1) + status(2) + capability(2) + auth length(1) + reserved(10) + scramble part2(12)
+	if (p + 43 > end)
+	{
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "malformed handshake packet.");
+		return SW_ERR;
+	}
+	memcpy(cli->scramble, p + 4, 8);
+	server_capability = sw_mysql_uint2(p + 13) | ((uint32_t) sw_mysql_uint2(p + 18) << 16);
+	memcpy(cli->scramble + 8, p + 31, 12);
+
+	if (!(server_capability & SW_MYSQL_CLIENT_PROTOCOL_41))
+	{
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "mysql server does not support protocol 4.1.");
+		return SW_ERR;
+	}
+	cli->capability = SW_MYSQL_CLIENT_LONG_PASSWORD | SW_MYSQL_CLIENT_LONG_FLAG | SW_MYSQL_CLIENT_PROTOCOL_41
+			| SW_MYSQL_CLIENT_TRANSACTIONS | SW_MYSQL_CLIENT_SECURE_CONNECTION | SW_MYSQL_CLIENT_PLUGIN_AUTH;
+	db_len = strlen(pool->database);
+	if (db_len > 0)
+	{
+		cli->capability |= SW_MYSQL_CLIENT_CONNECT_WITH_DB;
+	}
+	cli->capability &= server_capability;
+
+	//HandshakeResponse41
+	user_len = strlen(pool->user);
+	begin = swMySQL_packet_begin(cli, 32 + user_len + 1 + 21 + db_len + 1 + sizeof(SW_MYSQL_NATIVE_PASSWORD));
+	if (begin < 0)
+	{
+		return SW_ERR;
+	}
+	out = cli->out->str + cli->out->length;
+	out[0] = (char) cli->capability;
+	out[1] = (char) (cli->capability >> 8);
+	out[2] = (char) (cli->capability >> 16);
+	out[3] = (char) (cli->capability >> 24);
+	//max packet size
+	out[4] = 0;
+	out[5] = 0;
+	out[6] = 0;
+	out[7] = 1;
+	out[8] = (char) pool->charset;
+	bzero(out + 9, 23);
+	out += 32;
+	memcpy(out, pool->user, user_len + 1);
+	out += user_len + 1;
+	if (pool->password[0] == 0)
+	{
+		*out++ = 0;
+	}
+	else
+	{
+		swMySQL_scramble(pool->password, cli->scramble, token);
+		*out++ = 20;
+		memcpy(out, token, 20);
+		out += 20;
+	}
+	if (cli->capability & SW_MYSQL_CLIENT_CONNECT_WITH_DB)
+	{
+		memcpy(out, pool->database, db_len + 1);
+		out += db_len + 1;
+	}
+	if (cli->capability & SW_MYSQL_CLIENT_PLUGIN_AUTH)
+	{
+		memcpy(out, SW_MYSQL_NATIVE_PASSWORD, sizeof(SW_MYSQL_NATIVE_PASSWORD));
+		out += sizeof(SW_MYSQL_NATIVE_PASSWORD);
+	}
+	cli->out->length = out - cli->out->str;
+	swMySQL_packet_end(cli, begin);
+
+	cli->state = SW_MYSQL_STATE_AUTH;
+	swMySQL_client_flush(cli);
+	return SW_OK;
+}
+
+static int swMySQL_client_auth(swMySQL_client *cli, char *p, uint32_t len)
+{
+	swMySQL_pool *pool = cli->pool;
+	unsigned char token[20];
+	char *end = p + len;
+	int begin, n;
+
+	switch ((uint8_t) p[0])
+	{
+	case SW_MYSQL_PACKET_OK:
+		if (cli->timer_id > 0)
+		{
+			swTimer_clear(&SwooleG.timer, cli->timer_id);
+			cli->timer_id = 0;
+		}
+		cli->state = SW_MYSQL_STATE_READY;
+		pool->connecting--;
+		cli->next_idle = pool->idle;
+		pool->idle = cli;
+		swMySQL_pool_dispatch(pool);
+		return SW_OK;
+
+	case SW_MYSQL_PACKET_ERR:
+		swMySQL_parse_error(cli, p, len);
+		return SW_ERR;
+
+	//AuthSwitchRequest, 只支持mysql_native_password
+	case SW_MYSQL_PACKET_EOF:
+		p++;
+		n = strnlen(p, end - p);
+		if (n != sizeof(SW_MYSQL_NATIVE_PASSWORD) - 1 || memcmp(p, SW_MYSQL_NATIVE_PASSWORD, n) != 0 || p + n + 21 > end)
+		{
+			swMySQL_set_error(&cli->result, SW_MYSQL_CR_AUTH_PLUGIN, "only mysql_native_password authentication is supported.");
+			return SW_ERR;
+		}
+		memcpy(cli->scramble, p + n + 1, 20);
+		begin = swMySQL_packet_begin(cli, 20);
+		if (begin < 0)
+		{
+			return SW_ERR;
+		}
+		if (pool->password[0] != 0)
+		{
+			swMySQL_scramble(pool->password, cli->scramble, token);
+			memcpy(cli->out->str + cli->out->length, token, 20);
+			cli->out->length += 20;
+		}
+		swMySQL_packet_end(cli, begin);
+		swMySQL_client_flush(cli);
+		return SW_OK;
+
+	//caching_sha2_password的快速认证成功后还会收到OK包
+	case SW_MYSQL_PACKET_AUTH_MORE:
+		if (len >= 2 && p[1] == 3)
+		{
+			return SW_OK;
+		}
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_AUTH_PLUGIN, "full caching_sha2_password authentication is not supported.");
+		return SW_ERR;
+
+	default:
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "malformed auth packet.");
+		return SW_ERR;
+	}
+}
+
+static int swMySQL_client_prepare(swMySQL_client *cli, char *p, uint32_t len)
+{
+	uint16_t column_num;
+
+	if (cli->skip_packets > 0)
+	{
+		if (--cli->skip_packets == 0)
+		{
+			return swMySQL_client_execute(cli);
+		}
+		return SW_OK;
+	}
+	if ((uint8_t) p[0] == SW_MYSQL_PACKET_ERR)
+	{
+		swMySQL_parse_error(cli, p, len);
+		swMySQL_client_finish(cli);
+		return SW_OK;
+	}
+	if (p[0] != SW_MYSQL_PACKET_OK || len < 12)
+	{
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "malformed prepare packet.");
+		return SW_ERR;
+	}
+	cli->stmt_id = sw_mysql_uint4(p + 1);
+	column_num = sw_mysql_uint2(p + 5);
+	cli->stmt_param_num = sw_mysql_uint2(p + 7);
+	//参数和字段的定义包, 各自以EOF结束
+	cli->skip_packets = cli->stmt_param_num + (cli->stmt_param_num > 0) + column_num + (column_num > 0);
+	if (cli->skip_packets == 0)
+	{
+		return swMySQL_client_execute(cli);
+	}
+	return SW_OK;
+}
+
+/**
+ * COM_STMT_EXECUTE, 参数都以MYSQL_TYPE_VAR_STRING绑定
+ */
+static int swMySQL_client_execute(swMySQL_client *cli)
+{
+	swMySQL_query *query = cli->query;
+	uint32_t i, length, bitmap_len;
+	char *out;
+	int begin;
+
+	if (query->param_num != cli->stmt_param_num)
+	{
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_PARAMS_NOT_BOUND, "the number of parameters does not match the statement.");
+		swMySQL_client_finish(cli);
+		return SW_OK;
+	}
+	bitmap_len = (query->param_num + 7) / 8;
+	length = 10 + bitmap_len + 1 + query->param_num * 2;
+	for (i = 0; i < query->param_num; i++)
+	{
+		if (query->params[i] != NULL)
+		{
+			length += 9 + query->param_lens[i];
+		}
+	}
+	if (length >= SW_MYSQL_PACKET_MAX)
+	{
+		swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "parameters are too large.");
+		swMySQL_client_finish(cli);
+		return SW_OK;
+	}
+
+	cli->sequence = 0;
+	begin = swMySQL_packet_begin(cli, length);
+	if (begin < 0)
+	{
+		return SW_ERR;
+	}
+	out = cli->out->str + cli->out->length;
+	*out++ = SW_MYSQL_COM_STMT_EXECUTE;
+	*out++ = (char) cli->stmt_id;
+	*out++ = (char) (cli->stmt_id >> 8);
+	*out++ = (char) (cli->stmt_id >> 16);
+	*out++ = (char) (cli->stmt_id >> 24);
+	//flags: CURSOR_TYPE_NO_CURSOR, iteration count: 1
+	*out++ = 0;
+	*out++ = 1;
+	*out++ = 0;
+	*out++ = 0;
+	*out++ = 0;
+	if (query->param_num > 0)
+	{
+		bzero(out, bitmap_len);
+		for (i = 0; i < query->param_num; i++)
+		{
+			if (query->params[i] == NULL)
+			{
+				out[i / 8] |= 1 << (i % 8);
+			}
+		}
+		out += bitmap_len;
+		//new params bound
+		*out++ = 1;
+		for (i = 0; i < query->param_num; i++)
+		{
+			*out++ = (char) SW_MYSQL_TYPE_VAR_STRING;
+			*out++ = 0;
+		}
+		for (i = 0; i < query->param_num; i++)
+		{
+			if (query->params[i] != NULL)
+			{
+				out = swMySQL_write_lenenc(out, query->param_lens[i]);
+				memcpy(out, query->params[i], query->param_lens[i]);
+				out += query->param_lens[i];
+			}
+		}
+	}
+	cli->out->length = out - cli->out->str;
+	swMySQL_packet_end(cli, begin);
+
+	cli->state = SW_MYSQL_STATE_EXECUTE;
+	cli->result_state = SW_MYSQL_RESULT_HEAD;
+	swMySQL_client_flush(cli);
+	return SW_OK;
+}
+
+static int swMySQL_client_result(swMySQL_client *cli, char *p, uint32_t len, int binary)
+{
+	swMySQL_result *result = &cli->result;
+	uint64_t field_num;
+	int begin;
+
+	switch (cli->result_state)
+	{
+	case SW_MYSQL_RESULT_HEAD:
+		if ((uint8_t) p[0] == SW_MYSQL_PACKET_OK)
+		{
+			swMySQL_parse_ok(cli, p, len);
+			swMySQL_client_finish(cli);
+			return SW_OK;
+		}
+		else if ((uint8_t) p[0] == SW_MYSQL_PACKET_ERR)
+		{
+			swMySQL_parse_error(cli, p, len);
+			swMySQL_client_finish(cli);
+			return SW_OK;
+		}
+		//不支持LOAD DATA LOCAL INFILE, 发送空包结束
+		else if ((uint8_t) p[0] == SW_MYSQL_PACKET_LOCAL_INFILE)
+		{
+			begin = swMySQL_packet_begin(cli, 0);
+			if (begin < 0)
+			{
+				return SW_ERR;
+			}
+			swMySQL_packet_end(cli, begin);
+			swMySQL_client_flush(cli);
+			return SW_OK;
+		}
+		if (swMySQL_lenenc(p, p + len, &field_num, NULL) < 0 || field_num == 0 || field_num > 0xffff)
+		{
+			swMySQL_set_error(result, SW_MYSQL_CR_MALFORMED_PACKET, "malformed result set header.");
+			return SW_ERR;
+		}
+		result->field_num = field_num;
+		result->fields = sw_calloc(field_num, sizeof(swMySQL_field));
+		if (result->fields == NULL)
+		{
+			return SW_ERR;
+		}
+		if (cli->values != NULL)
+		{
+			sw_free(cli->values);
+			sw_free(cli->lengths);
+		}
+		cli->values = sw_calloc(field_num, sizeof(char *));
+		cli->lengths = sw_calloc(field_num, sizeof(uint32_t));
+		if (cli->values == NULL || cli->lengths == NULL)
+		{
+			return SW_ERR;
+		}
+		cli->field_index = 0;
+		cli->result_state = SW_MYSQL_RESULT_FIELD;
+		return SW_OK;
+
+	case SW_MYSQL_RESULT_FIELD:
+		if (swMySQL_parse_field(cli, p, len) < 0)
+		{
+			swMySQL_set_error(result, SW_MYSQL_CR_MALFORMED_PACKET, "malformed field packet.");
+			return SW_ERR;
+		}
+		if (++cli->field_index == result->field_num)
+		{
+			cli->result_state = SW_MYSQL_RESULT_FIELD_EOF;
+		}
+		return SW_OK;
+
+	case SW_MYSQL_RESULT_FIELD_EOF:
+		cli->result_state = SW_MYSQL_RESULT_ROW;
+		return SW_OK;
+
+	case SW_MYSQL_RESULT_ROW:
+		if ((uint8_t) p[0] == SW_MYSQL_PACKET_EOF && len < 9)
+		{
+			if (len >= 5)
+			{
+				result->warnings = sw_mysql_uint2(p + 1);
+				result->status = sw_mysql_uint2(p + 3);
+			}
+			swMySQL_client_finish(cli);
+			return SW_OK;
+		}
+		else if ((uint8_t) p[0] == SW_MYSQL_PACKET_ERR)
+		{
+			swMySQL_parse_error(cli, p, len);
+			swMySQL_client_finish(cli);
+			return SW_OK;
+		}
+		if ((binary ? swMySQL_parse_binary_row(cli, p, len) : swMySQL_parse_row(cli, p, len)) < 0)
+		{
+			swMySQL_set_error(result, SW_MYSQL_CR_MALFORMED_PACKET, "malformed row packet.");
+			return SW_ERR;
+		}
+		result->row_num++;
+		if (cli->query->onRow)
+		{
+			cli->pool->callback_depth++;
+			cli->query->onRow(cli->query, result, cli->values, cli->lengths);
+			cli->pool->callback_depth--;
+		}
+		return SW_OK;
+	}
+	return SW_OK;
+}
+
+static int swMySQL_parse_field(swMySQL_client *cli, char *p, uint32_t len)
+{
+	swMySQL_field *field = &cli->result.fields[cli->field_index];
+	char *end = p + len;
+	uint64_t length;
+	int i, n;
+
+	//catalog, schema, table, org_table, name, org_name
+	for (i = 0; i < 6; i++)
+	{
+		if ((n = swMySQL_lenenc(p, end, &length, NULL)) < 0 || p + n + length > end)
+		{
+			return SW_ERR;
+		}
+		if (i == 4)
+		{
+			field->name = sw_malloc(length + 1);
+			if (field->name == NULL)
+			{
+				return SW_ERR;
+			}
+			memcpy(field->name, p + n, length);
+			field->name[length] = 0;
+			field->name_len = length;
+		}
+		p += n + length;
+	}
+	//length of fixed fields(0x0c), charset(2), column length(4), type(1), flags(2), decimals(1)
+	if (p + 11 > end)
+	{
+		return SW_ERR;
+	}
+	field->charset = sw_mysql_uint2(p + 1);
+	field->type = (uint8_t) p[7];
+	field->flags = sw_mysql_uint2(p + 8);
+	field->decimals = (uint8_t) p[10];
+	return SW_OK;
+}
+
+static int swMySQL_parse_row(swMySQL_client *cli, char *p, uint32_t len)
+{
+	char *end = p + len;
+	uint64_t length;
+	uint16_t i;
+	int n, is_null;
+
+	for (i = 0; i < cli->result.field_num; i++)
+	{
+		if ((n = swMySQL_lenenc(p, end, &length, &is_null)) < 0 || p + n + length > end)
+		{
+			return SW_ERR;
+		}
+		cli->values[i] = is_null ? NULL : p + n;
+		cli->lengths[i] = length;
+		p += n + length;
+	}
+	return SW_OK;
+}
+
+/**
+ * 二进制协议的值都转换为与文本协议相同的字符串
+ */
+static int swMySQL_parse_binary_row(swMySQL_client *cli, char *p, uint32_t len)
+{
+	swMySQL_result *result = &cli->result;
+	swMySQL_field *field;
+	char *end = p + len;
+	char *bitmap, *out;
+	uint32_t bitmap_len = (result->field_num + 7 + 2) / 8;
+	uint64_t length;
+	uint16_t i;
+	int n, is_unsigned;
+	union
+	{
+		float f;
+		double d;
+		uint32_t u4;
+		uint64_t u8;
+	} num;
+
+	if (p + 1 + bitmap_len > end)
+	{
+		return SW_ERR;
+	}
+	bitmap = p + 1;
+	p += 1 + bitmap_len;
+
+	cli->row->length = 0;
+	if (swMySQL_string_reserve(cli->row, len * 4 + result->field_num * 32) < 0)
+	{
+		return SW_ERR;
+	}
+	out = cli->row->str;
+
+	for (i = 0; i < result->field_num; i++)
+	{
+		field = &result->fields[i];
+		if (bitmap[(i + 2) / 8] & (1 << ((i + 2) % 8)))
+		{
+			cli->values[i] = NULL;
+			cli->lengths[i] = 0;
+			continue;
+		}
+		is_unsigned = field->flags & SW_MYSQL_UNSIGNED_FLAG;
+		cli->values[i] = out;
+		switch (field->type)
+		{
+		case SW_MYSQL_TYPE_TINY:
+			if (p + 1 > end)
+			{
+				return SW_ERR;
+			}
+			n = is_unsigned ? sprintf(out, "%u", (uint8_t) p[0]) : sprintf(out, "%d", (int8_t) p[0]);
+			p += 1;
+			break;
+		case SW_MYSQL_TYPE_SHORT:
+		case SW_MYSQL_TYPE_YEAR:
+			if (p + 2 > end)
+			{
+				return SW_ERR;
+			}
+			n = is_unsigned ? sprintf(out, "%u", sw_mysql_uint2(p)) : sprintf(out, "%d", (int16_t) sw_mysql_uint2(p));
+			p += 2;
+			break;
+		case SW_MYSQL_TYPE_LONG:
+		case SW_MYSQL_TYPE_INT24:
+			if (p + 4 > end)
+			{
+				return SW_ERR;
+			}
+			n = is_unsigned ? sprintf(out, "%u", sw_mysql_uint4(p)) : sprintf(out, "%d", (int32_t) sw_mysql_uint4(p));
+			p += 4;
+			break;
+		case SW_MYSQL_TYPE_LONGLONG:
+			if (p + 8 > end)
+			{
+				return SW_ERR;
+			}
+			n = is_unsigned ? sprintf(out, "%llu", (unsigned long long) sw_mysql_uint8(p)) :
+					sprintf(out, "%lld", (long long) (int64_t) sw_mysql_uint8(p));
+			p += 8;
+			break;
+		case SW_MYSQL_TYPE_FLOAT:
+			if (p + 4 > end)
+			{
+				return SW_ERR;
+			}
+			num.u4 = sw_mysql_uint4(p);
+			n = sprintf(out, "%.7g", num.f);
+			p += 4;
+			break;
+		case SW_MYSQL_TYPE_DOUBLE:
+			if (p + 8 > end)
+			{
+				return SW_ERR;
+			}
+			num.u8 = sw_mysql_uint8(p);
+			n = sprintf(out, "%.17g", num.d);
+			p += 8;
+			break;
+		case SW_MYSQL_TYPE_DATE:
+		case SW_MYSQL_TYPE_DATETIME:
+		case SW_MYSQL_TYPE_TIMESTAMP:
+			if (p + 1 > end || p + 1 + (uint8_t) p[0] > end)
+			{
+				return SW_ERR;
+			}
+			length = (uint8_t) p[0];
+			n = sprintf(out, "%04u-%02u-%02u", length >= 4 ? sw_mysql_uint2(p + 1) : 0, length >= 4 ? (uint8_t) p[3] : 0,
+					length >= 4 ? (uint8_t) p[4] : 0);
+			if (field->type != SW_MYSQL_TYPE_DATE)
+			{
+				n += sprintf(out + n, " %02u:%02u:%02u", length >= 7 ? (uint8_t) p[5] : 0,
+						length >= 7 ? (uint8_t) p[6] : 0, length >= 7 ? (uint8_t) p[7] : 0);
+				if (length >= 11)
+				{
+					n += sprintf(out + n, ".%06u", sw_mysql_uint4(p + 8));
+				}
+			}
+			p += 1 + length;
+			break;
+		case SW_MYSQL_TYPE_TIME:
+			if (p + 1 > end || p + 1 + (uint8_t) p[0] > end)
+			{
+				return SW_ERR;
+			}
+			length = (uint8_t) p[0];
+			if (length >= 8)
+			{
+				n = sprintf(out, "%s%02u:%02u:%02u", p[1] ? "-" : "", sw_mysql_uint4(p + 2) * 24 + (uint8_t) p[6],
+						(uint8_t) p[7], (uint8_t) p[8]);
+				if (length >= 12)
+				{
+					n += sprintf(out + n, ".%06u", sw_mysql_uint4(p + 9));
+				}
+			}
+			else
+			{
+				n = sprintf(out, "00:00:00");
+			}
+			p += 1 + length;
+			break;
+		case SW_MYSQL_TYPE_NULL:
+			cli->values[i] = NULL;
+			n = 0;
+			break;
+		//decimal, string, blob, bit, json等都是length encoded string
+		default:
+			if ((n = swMySQL_lenenc(p, end, &length, NULL)) < 0 || p + n + length > end)
+			{
+				return SW_ERR;
+			}
+			cli->values[i] = p + n;
+			cli->lengths[i] = length;
+			p += n + length;
+			continue;
+		}
+		cli->lengths[i] = n;
+		out += n;
+	}
+	return SW_OK;
+}
+
+static int swMySQL_onRead(swReactor *reactor, swEvent *event)
+{
+	swMySQL_client *cli = swHashMap_find_int(&swoole_mysql_clients, event->fd);
+	swMySQL_pool *pool;
+	swString *buffer;
+	uint32_t length;
+	char *packet;
+	int n, ret = SW_OK;
+
+	if (cli == NULL)
+	{
+		return SW_OK;
+	}
+	pool = cli->pool;
+	buffer = cli->buffer;
+
+	if (buffer->length == buffer->size && swString_extend(buffer, buffer->size * 2) < 0)
+	{
+		swMySQL_client_close(cli, SW_MYSQL_CR_SERVER_LOST, "out of memory.");
+		goto check_destroy;
+	}
+	n = recv(cli->fd, buffer->str + buffer->length, buffer->size - buffer->length, 0);
+	if (n < 0)
+	{
+		if (errno == EAGAIN || errno == EINTR)
+		{
+			return SW_OK;
+		}
+		swMySQL_client_close(cli, SW_MYSQL_CR_SERVER_LOST, strerror(errno));
+		goto check_destroy;
+	}
+	else if (n == 0)
+	{
+		swMySQL_client_close(cli, SW_MYSQL_CR_SERVER_LOST, "mysql server has gone away.");
+		goto check_destroy;
+	}
+	buffer->length += n;
+
+	while (buffer->length - cli->offset >= SW_MYSQL_PACKET_HEADER)
+	{
+		packet = buffer->str + cli->offset;
+		length = sw_mysql_uint3(packet);
+		if (length == SW_MYSQL_PACKET_MAX)
+		{
+			swMySQL_set_error(&cli->result, SW_MYSQL_CR_MALFORMED_PACKET, "packets larger than 16M are not supported.");
+			ret = SW_ERR;
+			break;
+		}
+		if (buffer->length - cli->offset < SW_MYSQL_PACKET_HEADER + length)
+		{
+			//大包: 移到buffer头部, 不够时扩容
+			if (SW_MYSQL_PACKET_HEADER + length > buffer->size - cli->offset)
+			{
+				memmove(buffer->str, packet, buffer->length - cli->offset);
+				buffer->length -= cli->offset;
+				cli->offset = 0;
+				if (SW_MYSQL_PACKET_HEADER + length > buffer->size
+						&& swString_extend(buffer, SW_MYSQL_PACKET_HEADER + length) < 0)
+				{
+					ret = SW_ERR;
+				}
+			}
+			break;
+		}
+		cli->sequence = (uint8_t) packet[3] + 1;
+		cli->offset += SW_MYSQL_PACKET_HEADER + length;
+		ret = swMySQL_client_handle(cli, packet + SW_MYSQL_PACKET_HEADER, length);
+		if (ret < 0 || pool->destroy)
+		{
+			break;
+		}
+	}
+	if (ret < 0)
+	{
+		swMySQL_client_close(cli, cli->result.error_code ? cli->result.error_code : SW_MYSQL_CR_MALFORMED_PACKET,
+				cli->result.error_msg);
+		goto check_destroy;
+	}
+	if (cli->offset == buffer->length)
+	{
+		buffer->length = 0;
+		cli->offset = 0;
+	}
+
+	check_destroy:
+	if (pool->destroy && pool->callback_depth == 0)
+	{
+		swMySQL_pool_destroy(pool);
+	}
+	return SW_OK;
+}
+
+static int swMySQL_onWrite(swReactor *reactor, swEvent *event)
+{
+	swMySQL_client *cli = swHashMap_find_int(&swoole_mysql_clients, event->fd);
+	swMySQL_pool *pool;
+	socklen_t len = sizeof(int);
+	int error = 0;
+
+	if (cli == NULL)
+	{
+		return SW_OK;
+	}
+	pool = cli->pool;
+	if (cli->state == SW_MYSQL_STATE_CONNECT)
+	{
+		if (getsockopt(cli->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+		{
+			swMySQL_client_close(cli, SW_MYSQL_CR_CONN_HOST_ERROR, strerror(error ? error : errno));
+			goto check_destroy;
+		}
+		//等待服务器的握手包
+		cli->state = SW_MYSQL_STATE_HANDSHAKE;
+		reactor->set(reactor, cli->fd, SW_FD_MYSQL | SW_EVENT_READ);
+		return SW_OK;
+	}
+	swMySQL_client_flush(cli);
+
+	check_destroy:
+	if (pool->destroy && pool->callback_depth == 0)
+	{
+		swMySQL_pool_destroy(pool);
+	}
+	return SW_OK;
+}
+
+static void swMySQL_onTimeout(swTimer *timer, swTimer_node *node)
+{
+	swMySQL_client *cli = node->data;
+	swMySQL_pool *pool = cli->pool;
+
+	cli->timer_id = 0;
+	if (cli->state < SW_MYSQL_STATE_READY)
+	{
+		swMySQL_client_close(cli, SW_MYSQL_CR_CONN_HOST_ERROR, "connect to mysql server timeout.");
+		if (pool->destroy && pool->callback_depth == 0)
+		{
+			swMySQL_pool_destroy(pool);
+		}
+	}
+}
@@ -0,0 +1,162 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "Server.h"
+
+#define swPackage_host16(n)   (n)
+#define swPackage_host32(n)   (n)
+
+/**
+ * 为每种长度类型生成一个解析函数, 一次扫描出所有完整的包
+ * 配置在循环外读取, 循环内没有类型判断
+ */
+#define SW_PACKAGE_LENGTH_PARSER(name, type, ntoh) \
+static int swPackage_length_##name(swServer *serv, char *data, uint32_t length, swPackage_range *packages, int max, uint32_t *need) \
+{ \
+	uint32_t offset = 0, package_length; \
+	uint32_t length_offset = serv->package_length_offset; \
+	uint32_t head_length = length_offset + sizeof(type); \
+	uint32_t body_start = serv->package_body_start; \
+	int64_t body_length, body_max = serv->buffer_input_size; \
+	type value; \
+	int n = 0; \
+	*need = 0; \
+	while (n < max && length - offset >= head_length) \
+	{ \
+		memcpy(&value, data + offset + length_offset, sizeof(type)); \
+		body_length = (type) ntoh(value); \
+		if (body_length < 1 || body_length > body_max) \
+		{ \
+			return SW_ERR; \
+		} \
+		package_length = body_start + body_length; \
+		if (package_length > length - offset) \
+		{ \
+			*need = package_length; \
+			break; \
+		} \
+		packages[n].offset = offset; \
+		packages[n].length = package_length; \
+		offset += package_length; \
+		n++; \
+	} \
+	return n; \
+}
+
+SW_PACKAGE_LENGTH_PARSER(short_net, uint16_t, ntohs)
+SW_PACKAGE_LENGTH_PARSER(short_host, uint16_t, swPackage_host16)
+SW_PACKAGE_LENGTH_PARSER(sshort_net, int16_t, ntohs)
+SW_PACKAGE_LENGTH_PARSER(sshort_host, int16_t, swPackage_host16)
+SW_PACKAGE_LENGTH_PARSER(int_net, uint32_t, ntohl)
+SW_PACKAGE_LENGTH_PARSER(int_host, uint32_t, swPackage_host32)
+SW_PACKAGE_LENGTH_PARSER(sint_net, int32_t, ntohl)
+SW_PACKAGE_LENGTH_PARSER(sint_host, int32_t, swPackage_host32)
+
+/**
+ * 根据package_length_type选择解析函数
+ * 长度字段默认为4字节, 设置SW_NUM_SHORT时为2字节
+ */
+swPackage_length_parser swPackage_get_length_parser(uint16_t type)
+{
+	if (type & SW_NUM_SHORT)
+	{
+		if (type & SW_NUM_SIGN)
+		{
+			return (type & SW_NUM_NET) ? swPackage_length_sshort_net : swPackage_length_sshort_host;
+		}
+		return (type & SW_NUM_NET) ? swPackage_length_short_net : swPackage_length_short_host;
+	}
+	if (type & SW_NUM_SIGN)
+	{
+		return (type & SW_NUM_NET) ? swPackage_length_sint_net : swPackage_length_sint_host;
+	}
+	return (type & SW_NUM_NET) ? swPackage_length_int_net : swPackage_length_int_host;
+}
+
+/**
+ * 多个小包合并为一个SW_EVENT_PACKAGE_BATCH消息, 每条记录为swDataHead + 数据
+ * 消息头使用第一条记录的fd, 按fd分配worker时整个消息投递到同一个worker
+ */
+int swPackage_batch_add(swFactory *factory, swPackage_batch *batch, swDataHead *info, char *data)
+{
+	if (swPackage_batch_append(batch, info, data) == SW_OK)
+	{
+		return SW_OK;
+	}
+	if (swPackage_batch_flush(factory, batch) < 0)
+	{
+		return SW_ERR;
+	}
+	return swPackage_batch_append(batch, info, data);
+}
+
+/**
+ * 追加一条记录, 空间不足时返回SW_ERR
+ */
+int swPackage_batch_append(swPackage_batch *batch, swDataHead *info, char *data)
+{
+	uint32_t record_length = sizeof(swDataHead) + info->len;
+
+	if (batch->event.info.len + record_length > SW_BUFFER_SIZE)
+	{
+		return SW_ERR;
+	}
+	if (batch->num == 0)
+	{
+		batch->event.info.fd = info->fd;
+		batch->event.info.from_id = info->from_id;
+	}
+	memcpy(batch->event.data + batch->event.info.len, info, sizeof(swDataHead));
+	memcpy(batch->event.data + batch->event.info.len + sizeof(swDataHead), data, info->len);
+	batch->event.info.len += record_length;
+	batch->num++;
+	return SW_OK;
+}
+
+/**
+ * 整理为待投递的消息, 只有一条记录时按普通数据包投递
+ */
+void swPackage_batch_pack(swPackage_batch *batch)
+{
+	if (batch->num == 1)
+	{
+		memcpy(&batch->event.info, batch->event.data, sizeof(swDataHead));
+		memmove(batch->event.data, batch->event.data + sizeof(swDataHead), batch->event.info.len);
+	}
+	else
+	{
+		batch->event.info.type = SW_EVENT_PACKAGE_BATCH;
+	}
+}
+
+int swPackage_batch_flush(swFactory *factory, swPackage_batch *batch)
+{
+	int ret;
+
+	if (batch->num == 0)
+	{
+		return SW_OK;
+	}
+	swPackage_batch_pack(batch);
+	ret = factory->dispatch(factory, &batch->event);
+	if (ret < 0)
+	{
+		swWarn("factory->dispatch failed.");
+	}
+	swPackage_batch_init(batch, batch->event.info.fd, batch->event.info.from_id);
+	return ret;
+}
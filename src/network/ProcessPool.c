@@ -17,6 +17,7 @@
 #include "swoole.h"
 
 static int swProcessPool_worker_start(swProcessPool *pool, swWorker *worker);
+static int swProcessPool_worker_read(swProcessPool *pool, swWorker *worker, swEventData *buf, int *from_queue);
 static void swProcessPool_free(swProcessPool *pool);
 
 /**
@@ -77,18 +78,103 @@ int swProcessPool_start(swProcessPool *pool)
 	return SW_OK;
 }
 
+/**
+ * 设置worker_id小于0时的分配方式, 需要在swProcessPool_start之前调用
+ */
+int swProcessPool_set_dispatch_mode(swProcessPool *pool, int dispatch_mode)
+{
+	switch (dispatch_mode)
+	{
+	case SW_POOL_DISPATCH_LEAST:
+		pool->inflight = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(atomic_t) * pool->worker_num);
+		if (pool->inflight == NULL)
+		{
+			swWarn("alloc for pool->inflight failed.");
+			return SW_ERR;
+		}
+		bzero((void *) pool->inflight, sizeof(atomic_t) * pool->worker_num);
+		break;
+	case SW_POOL_DISPATCH_QUEUE:
+		if (swPipeUnsock_create(&pool->queue, 1, SOCK_DGRAM) < 0)
+		{
+			swWarn("create pool queue failed.");
+			return SW_ERR;
+		}
+		break;
+	case SW_POOL_DISPATCH_ROUND:
+		break;
+	default:
+		swWarn("unknown dispatch_mode[%d], use round robin.", dispatch_mode);
+		dispatch_mode = SW_POOL_DISPATCH_ROUND;
+		break;
+	}
+	pool->dispatch_mode = dispatch_mode;
+	return SW_OK;
+}
+
+/**
+ * 选择投递的worker, SW_POOL_DISPATCH_QUEUE返回-1表示投递到共用的管道
+ */
+int swProcessPool_schedule(swProcessPool *pool)
+{
+	uint32_t i, start, target;
+
+	if (pool->dispatch_mode == SW_POOL_DISPATCH_QUEUE)
+	{
+		return -1;
+	}
+	start = (pool->round_id++) % pool->worker_num;
+	if (pool->dispatch_mode != SW_POOL_DISPATCH_LEAST)
+	{
+		return start;
+	}
+	//从轮询的位置开始找, 未完成任务数相同时仍然是轮询
+	target = start;
+	if (pool->worker_num <= SW_DISPATCH_LEAST_SCAN)
+	{
+		for (i = 1; i < pool->worker_num && pool->inflight[target] > 0; i++)
+		{
+			if (pool->inflight[(start + i) % pool->worker_num] < pool->inflight[target])
+			{
+				target = (start + i) % pool->worker_num;
+			}
+		}
+		return target;
+	}
+	i = (start + 1 + rand() % (pool->worker_num - 1)) % pool->worker_num;
+	return pool->inflight[i] < pool->inflight[target] ? i : target;
+}
+
 /**
  * dispatch
  */
 int swProcessPool_dispatch(swProcessPool *pool, swEventData *data, int worker_id)
 {
+	int fd, ret;
+
 	//no worker_id, will round
-	if(worker_id < 0)
+	if (worker_id < 0)
+	{
+		worker_id = swProcessPool_schedule(pool);
+	}
+	if (worker_id < 0)
+	{
+		fd = pool->queue.getFd(&pool->queue, 1);
+	}
+	else
+	{
+		fd = swProcessPool_worker(pool, worker_id).pipe_master;
+		if (pool->inflight != NULL)
+		{
+			sw_atomic_fetch_add(&pool->inflight[worker_id], 1);
+		}
+	}
+	ret = swWrite(fd, data, sizeof(data->info) + data->info.len);
+	if (ret < 0 && worker_id >= 0 && pool->inflight != NULL)
 	{
-		worker_id = (pool->round_id++)%pool->worker_num;
+		sw_atomic_fetch_sub(&pool->inflight[worker_id], 1);
 	}
-	swWorker *worker = &swProcessPool_worker(pool, worker_id);
-	return swWrite(worker->pipe_master, data, sizeof(data->info) + data->info.len);
+	return ret;
 }
 
 void swProcessPool_shutdown(swProcessPool *pool)
@@ -110,6 +196,7 @@ void swProcessPool_shutdown(swProcessPool *pool)
 pid_t swProcessPool_spawn(swWorker *worker)
 {
 	pid_t pid = fork();
+	int ret;
 	swProcessPool *pool = worker->pool;
 
 	switch (pid)
@@ -120,7 +207,9 @@ pid_t swProcessPool_spawn(swWorker *worker)
 		{
 			pool->onWorkerStart(pool, worker->id);
 		}
-		exit(pool->main_loop(pool, worker));
+		ret = pool->main_loop(pool, worker);
+		swMemoryGlobal_thread_flush();
+		exit(ret);
 		break;
 	case -1:
 		swWarn("[swProcessPool_run] fork failed. Error: %s [%d]", strerror(errno), errno);
@@ -137,28 +226,81 @@ pid_t swProcessPool_spawn(swWorker *worker)
 static int swProcessPool_worker_start(swProcessPool *pool, swWorker *worker)
 {
 	swEventData buf;
-	int n, ret;
+	int n, ret, from_queue;
 	int task_n = pool->max_request;
 	//使用from_fd保存task_worker的id
 	buf.info.from_fd = worker->id;
 
 	while (SwooleG.running > 0 && task_n > 0)
 	{
-		n = read(worker->pipe_worker, &buf, sizeof(buf));
+		n = swProcessPool_worker_read(pool, worker, &buf, &from_queue);
 		if (n < 0)
 		{
-			swWarn("[Worker#%d]read pipe fail. Error: %s [%d]", worker->id, strerror(errno), errno);
+			//共用管道中的任务被其他worker取走
+			if (errno != EAGAIN)
+			{
+				swWarn("[Worker#%d]read pipe fail. Error: %s [%d]", worker->id, strerror(errno), errno);
+			}
 			continue;
 		}
 		ret = pool->onTask(pool, &buf);
+		if (pool->inflight != NULL && !from_queue)
+		{
+			sw_atomic_fetch_sub(&pool->inflight[worker->id], 1);
+		}
 		if (ret > 0)
 		{
 			task_n--;
 		}
 	}
+	if (pool->onIdle != NULL)
+	{
+		pool->onIdle(pool);
+	}
 	return SW_OK;
 }
 
+/**
+ * SW_POOL_DISPATCH_QUEUE时同时等待自己的管道和共用的管道, 指定了worker的任务优先
+ * 设置了onIdle时, 管道中没有任务才调用onIdle再阻塞等待
+ */
+static int swProcessPool_worker_read(swProcessPool *pool, swWorker *worker, swEventData *buf, int *from_queue)
+{
+	struct pollfd fds[2];
+	int nfds = 1;
+
+	*from_queue = 0;
+	if (pool->dispatch_mode != SW_POOL_DISPATCH_QUEUE && pool->onIdle == NULL)
+	{
+		return read(worker->pipe_worker, buf, sizeof(swEventData));
+	}
+	fds[0].fd = worker->pipe_worker;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	if (pool->dispatch_mode == SW_POOL_DISPATCH_QUEUE)
+	{
+		fds[1].fd = pool->queue.getFd(&pool->queue, 0);
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+		nfds = 2;
+	}
+	if (pool->onIdle != NULL && poll(fds, nfds, 0) == 0)
+	{
+		pool->onIdle(pool);
+	}
+	if (!(fds[0].revents & POLLIN) && (nfds == 1 || !(fds[1].revents & POLLIN)) && poll(fds, nfds, -1) < 0)
+	{
+		return SW_ERR;
+	}
+	if (nfds == 1 || (fds[0].revents & POLLIN))
+	{
+		return read(worker->pipe_worker, buf, sizeof(swEventData));
+	}
+	//多个worker同时被唤醒, 没有取到的返回EAGAIN
+	*from_queue = 1;
+	return recv(fds[1].fd, buf, sizeof(swEventData), MSG_DONTWAIT);
+}
+
 int swProcessPool_add_worker(swProcessPool *pool, swWorker *worker)
 {
 	swHashMap_add_int(&pool->map, worker->pid, worker);
@@ -244,7 +386,11 @@ static void swProcessPool_free(swProcessPool *pool)
 		pipe = &pool->pipes[i];
 		pipe->close(pipe);
 	}
+	if (pool->dispatch_mode == SW_POOL_DISPATCH_QUEUE)
+	{
+		pool->queue.close(&pool->queue);
+	}
 	sw_free(pool->workers);
 	sw_free(pool->pipes);
-	swHashMap_free(&pool->map);
+	swHashMap_free_int(&pool->map);
 }
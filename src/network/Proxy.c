@@ -0,0 +1,431 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "Server.h"
+
+#ifdef HAVE_SPLICE
+
+#define SW_PROXY_EVENT_READ      1
+#define SW_PROXY_EVENT_WRITE     2
+#define SW_PROXY_EVENT_UNKNOWN   0xff  //客户端连接还在使用SW_FD_TCP
+
+static void swProxy_close(swReactor *reactor, swProxy *proxy);
+
+static swProxy* swProxy_get(swReactor *reactor, int fd)
+{
+	swServer *serv = reactor->ptr;
+	return swHashMap_find_int(&serv->reactor_threads[reactor->id].proxies, fd);
+}
+
+/**
+ * 按两个方向的状态计算fds[i]需要监听的事件, 没有任何事件时从reactor中移除, 避免对端关闭后EPOLLHUP一直触发
+ */
+static int swProxy_set_events(swReactor *reactor, swProxy *proxy, int i)
+{
+	swConnection *conn = swServer_get_connection(SwooleG.serv, proxy->fds[0]);
+	uint8_t events = 0;
+	int fdtype = SW_FD_PROXY;
+	int ret;
+
+	//等待out_buffer发送完时客户端仍由swReactorThread_onWrite处理
+	if (i == 0 && conn->proxy != SW_PROXY_ACTIVE)
+	{
+		return SW_OK;
+	}
+	if (!proxy->paused[i] && !proxy->eof[i] && (i == 0 || proxy->connected))
+	{
+		events |= SW_PROXY_EVENT_READ;
+	}
+	if (i == 0 && proxy->pending[1] > 0)
+	{
+		events |= SW_PROXY_EVENT_WRITE;
+	}
+	else if (i == 1 && (proxy->pending[0] > 0 || !proxy->connected))
+	{
+		events |= SW_PROXY_EVENT_WRITE;
+	}
+	if (events == proxy->events[i])
+	{
+		return SW_OK;
+	}
+	if (events & SW_PROXY_EVENT_READ)
+	{
+		fdtype |= SW_EVENT_READ;
+	}
+	if (events & SW_PROXY_EVENT_WRITE)
+	{
+		fdtype |= SW_EVENT_WRITE;
+	}
+	//只移除事件, 不关闭fd
+	if (events == 0)
+	{
+		reactor->flag |= SW_REACTOR_KEEP_FD;
+		ret = reactor->del(reactor, proxy->fds[i]);
+		reactor->flag &= ~SW_REACTOR_KEEP_FD;
+	}
+	else if (proxy->events[i] == 0)
+	{
+		ret = reactor->add(reactor, proxy->fds[i], fdtype);
+	}
+	else
+	{
+		ret = reactor->set(reactor, proxy->fds[i], fdtype);
+	}
+	proxy->events[i] = events;
+	return ret;
+}
+
+/**
+ * 把管道中方向d的数据写到目标socket, 写不完时等待可写事件
+ */
+static int swProxy_flush(swProxy *proxy, int d)
+{
+	swConnection *conn = swServer_get_connection(SwooleG.serv, proxy->fds[0]);
+	ssize_t n;
+
+	if (!proxy->connected || (d == 1 && conn->proxy != SW_PROXY_ACTIVE))
+	{
+		return SW_OK;
+	}
+	while (proxy->pending[d] > 0)
+	{
+		n = splice(proxy->pipes[d][0], NULL, proxy->fds[1 - d], NULL, proxy->pending[d], SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return errno == EAGAIN ? SW_OK : SW_ERR;
+		}
+		proxy->pending[d] -= n;
+	}
+	if (proxy->pending[d] < SW_PROXY_SPLICE_SIZE)
+	{
+		proxy->paused[d] = 0;
+	}
+	//来源已关闭并且数据已写完, 关闭目标的写方向
+	if (proxy->eof[d] && proxy->pending[d] == 0)
+	{
+		shutdown(proxy->fds[1 - d], SHUT_WR);
+	}
+	return SW_OK;
+}
+
+/**
+ * 从fds[d]读到管道, 管道满时暂停读取, 由另一端的可写事件恢复
+ */
+static int swProxy_read(swProxy *proxy, int d)
+{
+	ssize_t n;
+
+	while (!proxy->paused[d] && !proxy->eof[d])
+	{
+		n = splice(proxy->fds[d], NULL, proxy->pipes[d][1], NULL, SW_PROXY_SPLICE_SIZE - proxy->pending[d],
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return errno == EAGAIN ? SW_OK : SW_ERR;
+		}
+		else if (n == 0)
+		{
+			proxy->eof[d] = 1;
+		}
+		proxy->pending[d] += n;
+		if (proxy->pending[d] >= SW_PROXY_SPLICE_SIZE)
+		{
+			proxy->paused[d] = 1;
+		}
+		if (swProxy_flush(proxy, d) < 0)
+		{
+			return SW_ERR;
+		}
+	}
+	return SW_OK;
+}
+
+/**
+ * 两个方向都已关闭并且管道中没有数据
+ */
+static int swProxy_update(swReactor *reactor, swProxy *proxy)
+{
+	if (proxy->eof[0] && proxy->eof[1] && proxy->pending[0] == 0 && proxy->pending[1] == 0)
+	{
+		return SW_ERR;
+	}
+	if (swProxy_set_events(reactor, proxy, 0) < 0 || swProxy_set_events(reactor, proxy, 1) < 0)
+	{
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+int swProxy_onRead(swReactor *reactor, swEvent *event)
+{
+	swProxy *proxy = swProxy_get(reactor, event->fd);
+	int d;
+
+	//同一次epoll事件中已被关闭
+	if (proxy == NULL)
+	{
+		return SW_OK;
+	}
+	d = (event->fd == proxy->fds[0]) ? 0 : 1;
+	if (d == 0)
+	{
+		swConnection_idle_touch(SwooleG.serv, swServer_get_connection(SwooleG.serv, event->fd));
+	}
+	if (swProxy_read(proxy, d) < 0 || swProxy_update(reactor, proxy) < 0)
+	{
+		swProxy_close(reactor, proxy);
+	}
+	return SW_OK;
+}
+
+int swProxy_onWrite(swReactor *reactor, swEvent *event)
+{
+	swProxy *proxy = swProxy_get(reactor, event->fd);
+	int i, err = 0;
+	socklen_t len = sizeof(err);
+
+	if (proxy == NULL)
+	{
+		return SW_OK;
+	}
+	i = (event->fd == proxy->fds[0]) ? 0 : 1;
+	if (i == 1 && !proxy->connected)
+	{
+		if (getsockopt(event->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+		{
+			swWarn("proxy connect to upstream failed. fd=%d. Error: %s[%d]", proxy->fds[0], strerror(err), err);
+			swProxy_close(reactor, proxy);
+			return SW_OK;
+		}
+		proxy->connected = 1;
+		//连接上游之前读到的客户端数据
+		if (swProxy_flush(proxy, 0) < 0)
+		{
+			goto close_fd;
+		}
+	}
+	//写出的是另一个方向的数据
+	if (swProxy_flush(proxy, 1 - i) < 0 || swProxy_read(proxy, 1 - i) < 0 || swProxy_update(reactor, proxy) < 0)
+	{
+		close_fd:
+		swProxy_close(reactor, proxy);
+	}
+	return SW_OK;
+}
+
+/**
+ * worker已交出连接, 在客户端所在的reactor线程中连接上游
+ */
+int swProxy_start(swReactor *reactor, swEventData *resp)
+{
+	swServer *serv = SwooleG.serv;
+	swReactorThread *thread = &serv->reactor_threads[reactor->id];
+	swConnection *conn = swServer_get_connection(serv, resp->info.fd);
+	swProxy_request *req = (swProxy_request *) resp->data;
+	swString *buffer = conn->string_buffer;
+	swProxy *proxy;
+	int sock, i, n;
+
+	if (conn->proxy || !conn->active)
+	{
+		swWarn("connection[%d] is already proxied or closed.", resp->info.fd);
+		return SW_ERR;
+	}
+	proxy = sw_calloc(1, sizeof(swProxy));
+	if (proxy == NULL)
+	{
+		swWarn("malloc for swProxy failed.");
+		return SW_ERR;
+	}
+	proxy->fds[0] = conn->fd;
+	proxy->fds[1] = -1;
+	for (i = 0; i < 2; i++)
+	{
+		proxy->pipes[i][0] = proxy->pipes[i][1] = -1;
+		if (pipe(proxy->pipes[i]) < 0)
+		{
+			swWarn("pipe() failed. Error: %s[%d]", strerror(errno), errno);
+			goto fail;
+		}
+		swSetNonBlock(proxy->pipes[i][0]);
+		swSetNonBlock(proxy->pipes[i][1]);
+	}
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+	{
+		swWarn("socket() failed. Error: %s[%d]", strerror(errno), errno);
+		goto fail;
+	}
+	proxy->fds[1] = sock;
+	swSetNonBlock(sock);
+	if (connect(sock, (struct sockaddr *) &req->addr, sizeof(req->addr)) < 0 && errno != EINPROGRESS)
+	{
+		swWarn("connect to upstream failed. Error: %s[%d]", strerror(errno), errno);
+		goto fail;
+	}
+
+	//按协议切分后剩余的数据先转发给上游
+	if (buffer != NULL && buffer->length > 0)
+	{
+		n = write(proxy->pipes[0][1], buffer->str, buffer->length);
+		if (n != buffer->length)
+		{
+			swWarn("proxy buffered data is too large. length=%d.", (int) buffer->length);
+			goto fail;
+		}
+		proxy->pending[0] = n;
+		buffer->length = 0;
+	}
+
+	if (reactor->add(reactor, sock, SW_FD_PROXY | SW_EVENT_WRITE) < 0)
+	{
+		goto fail;
+	}
+	proxy->events[0] = SW_PROXY_EVENT_UNKNOWN;
+	proxy->events[1] = SW_PROXY_EVENT_WRITE;
+	swHashMap_add_int(&thread->proxies, proxy->fds[0], proxy);
+	swHashMap_add_int(&thread->proxies, proxy->fds[1], proxy);
+
+	//out_buffer中worker的响应发送完之后才能开始转发, 期间不再读取客户端
+	if (conn->out_buffer != NULL && !swBuffer_empty(conn->out_buffer))
+	{
+		conn->proxy = SW_PROXY_WAIT;
+		conn->recv_paused = 0;
+		conn->out_event = 1;
+		return reactor->set(reactor, conn->fd, SW_FD_TCP | SW_EVENT_WRITE);
+	}
+	return swProxy_activate(reactor, conn);
+
+	fail:
+	for (i = 0; i < 2; i++)
+	{
+		if (proxy->pipes[i][0] >= 0)
+		{
+			close(proxy->pipes[i][0]);
+		}
+		if (proxy->pipes[i][1] >= 0)
+		{
+			close(proxy->pipes[i][1]);
+		}
+	}
+	if (proxy->fds[1] >= 0)
+	{
+		close(proxy->fds[1]);
+	}
+	sw_free(proxy);
+	return SW_ERR;
+}
+
+int swProxy_activate(swReactor *reactor, swConnection *conn)
+{
+	swProxy *proxy = swProxy_get(reactor, conn->fd);
+
+	if (proxy == NULL)
+	{
+		return SW_ERR;
+	}
+	conn->proxy = SW_PROXY_ACTIVE;
+	conn->recv_paused = 0;
+	conn->out_event = 0;
+	if (swProxy_flush(proxy, 1) < 0 || swProxy_update(reactor, proxy) < 0)
+	{
+		swProxy_close(reactor, proxy);
+	}
+	return SW_OK;
+}
+
+/**
+ * 由swConnection_close调用, 释放上游socket和管道
+ */
+void swProxy_free(swReactor *reactor, int fd)
+{
+	swServer *serv = SwooleG.serv;
+	swReactorThread *thread = &serv->reactor_threads[reactor->id];
+	swProxy *proxy = swProxy_get(reactor, fd);
+	int i;
+
+	swServer_get_connection(serv, fd)->proxy = 0;
+	if (proxy == NULL)
+	{
+		return;
+	}
+	swHashMap_del_int(&thread->proxies, proxy->fds[0]);
+	swHashMap_del_int(&thread->proxies, proxy->fds[1]);
+	//swConnection_close之后会从reactor中移除客户端
+	if (proxy->events[0] == 0)
+	{
+		reactor->add(reactor, proxy->fds[0], SW_FD_TCP | SW_EVENT_READ);
+	}
+	if (proxy->events[1] != 0)
+	{
+		reactor->del(reactor, proxy->fds[1]);
+	}
+	else
+	{
+		close(proxy->fds[1]);
+	}
+	for (i = 0; i < 2; i++)
+	{
+		close(proxy->pipes[i][0]);
+		close(proxy->pipes[i][1]);
+	}
+	sw_free(proxy);
+}
+
+static void swProxy_close(swReactor *reactor, swProxy *proxy)
+{
+	swConnection_close(SwooleG.serv, proxy->fds[0], 1);
+}
+
+#else
+
+int swProxy_start(swReactor *reactor, swEventData *resp)
+{
+	swWarn("proxy requires splice().");
+	return SW_ERR;
+}
+
+int swProxy_activate(swReactor *reactor, swConnection *conn)
+{
+	return SW_ERR;
+}
+
+void swProxy_free(swReactor *reactor, int fd)
+{
+
+}
+
+int swProxy_onRead(swReactor *reactor, swEvent *event)
+{
+	return SW_OK;
+}
+
+int swProxy_onWrite(swReactor *reactor, swEvent *event)
+{
+	return SW_OK;
+}
+
+#endif
@@ -16,6 +16,9 @@
 
 #include "swoole.h"
 #include "Server.h"
+#include "http.h"
+#include "websocket.h"
+#include "redis.h"
 
 #include <sys/stat.h>
 
@@ -24,46 +27,177 @@ static void swUDPThread_loop(swThreadParam *param);
 static int swReactorThread_loop(swThreadParam *param);
 static int swReactorThread_onClose(swReactor *reactor, swEvent *event);
 static int swReactorThread_onWrite(swReactor *reactor, swDataHead *ev);
+static int swReactorThread_write_out_buffer(swReactor *reactor, swEvent *ev, swConnection *conn);
+static void swReactorThread_pause_recv(swServer *serv, swReactor *reactor, swConnection *conn);
+static void swReactorThread_wait_writable(swServer *serv, swReactor *reactor, swConnection *conn);
+static void swReactorThread_resume_recv(swServer *serv, swReactor *reactor, swConnection *conn);
 static void swReactorThread_onTimeout(swReactor *reactor);
 static void swReactorThread_onFinish(swReactor *reactor);
+static void swReactorThread_latency_done(swServer *serv, int reactor_id, swConnectionInfo *info);
+static uint32_t swReactorThread_websocket_pack(swServer *serv, swConnection *conn, uint8_t flag, char *data,
+		uint32_t length, char *frame);
+static int swReactorThread_websocket_push(swServer *serv, swConnection *conn, uint8_t flag, char *data, uint32_t length,
+		swBuffer_shared *shared);
+static int swReactorThread_onReceive_admit(swReactor *reactor, swEvent *event);
+static int swReactorThread_direct_start(swServer *serv, swReactor *reactor, swConnection *conn, swEventData *resp);
+static int swReactorThread_direct_reply(swServer *serv, swConnection *conn, int sock);
+static int swReactorThread_direct_end(swServer *serv, swReactor *reactor, swConnection *conn, swEventData *resp);
+static int swReactorThread_direct_release(swServer *serv, swReactor *reactor, swConnection *conn);
+static int swReactorThread_direct_reset(swServer *serv, swEventData *resp);
+
+static swReactor_handle swReactorThread_onReceive_admitted;
+
+#define swReactorThread_stats_recv(serv, reactor_id, n)  if (n > 0) swServer_reactor_stats_add(serv, reactor_id, recv_bytes, n)
+
+#ifdef HAVE_RECVMMSG
+/**
+ * recvmmsg一次读取多个UDP包, 每个线程一个
+ */
+typedef struct
+{
+	struct
+	{
+		long queue_type; //For Message Queue, 可以直接插入到队列中
+		swEventData buf;
+	} packets[SW_UDP_RECV_BATCH];
+	struct mmsghdr msgs[SW_UDP_RECV_BATCH];
+	struct iovec iovs[SW_UDP_RECV_BATCH];
+	struct sockaddr_in6 addrs[SW_UDP_RECV_BATCH]; //IPv4和IPv6共用
+} swUdpRecvBuffer;
+
+static __thread swUdpRecvBuffer *swReactorThread_udp_buffer = NULL;
+
+static swUdpRecvBuffer* swReactorThread_udp_buffer_get(void)
+{
+	int i;
+	swUdpRecvBuffer *buffer = swReactorThread_udp_buffer;
+	if (buffer != NULL)
+	{
+		return buffer;
+	}
+	buffer = sw_malloc(sizeof(swUdpRecvBuffer));
+	if (buffer == NULL)
+	{
+		swWarn("malloc for udp recv buffer failed.");
+		return NULL;
+	}
+	bzero(buffer->msgs, sizeof(buffer->msgs));
+	for (i = 0; i < SW_UDP_RECV_BATCH; i++)
+	{
+		buffer->iovs[i].iov_base = buffer->packets[i].buf.data;
+		buffer->iovs[i].iov_len = SW_BUFFER_SIZE;
+		buffer->msgs[i].msg_hdr.msg_iov = &buffer->iovs[i];
+		buffer->msgs[i].msg_hdr.msg_iovlen = 1;
+		buffer->msgs[i].msg_hdr.msg_name = &buffer->addrs[i];
+	}
+	swReactorThread_udp_buffer = buffer;
+	return buffer;
+}
+#endif
 
 /**
- * for udp
+ * 读取UDP包并投递到worker, 返回读到的包数量
+ * 支持recvmmsg时一次最多读取SW_UDP_RECV_BATCH个包, 进程模式下合并为一个消息投递
  */
-int swReactorThread_onPackage(swReactor *reactor, swEvent *event)
+static int swReactorThread_udp_recv(swServer *serv, int sock, int flags)
 {
-	int ret;
-	swServer *serv = reactor->ptr;
 	swFactory *factory = &(serv->factory);
-	swEventData buf;
+	swEventData *buf;
+	struct sockaddr_in *addr;
+	int i, n;
 
-	struct sockaddr_in addr;
-	socklen_t addrlen = sizeof(addr);
-	while (1)
+#ifdef HAVE_RECVMMSG
+	swUdpRecvBuffer *buffer = swReactorThread_udp_buffer_get();
+	swPackage_batch batch;
+	swDataHead *info;
+
+	if (buffer == NULL)
 	{
-		ret = recvfrom(event->fd, buf.data, SW_BUFFER_SIZE, 0, (struct sockaddr *)&addr, &addrlen);
-		if (ret < 0)
+		return SW_ERR;
+	}
+	for (i = 0; i < SW_UDP_RECV_BATCH; i++)
+	{
+		buffer->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+	}
+	n = recvmmsg(sock, buffer->msgs, SW_UDP_RECV_BATCH, flags, NULL);
+	if (n < 0)
+	{
+		return SW_ERR;
+	}
+	swPackage_batch_init(&batch, 0, 0);
+	for (i = 0; i < n; i++)
+	{
+		buf = &(buffer->packets[i].buf);
+		addr = (struct sockaddr_in *) &(buffer->addrs[i]);
+		info = &(buf->info);
+		info->len = buffer->msgs[i].msg_len;
+		swReactorThread_stats_recv(serv, SwooleTG.id, info->len);
+		//UDP的fd是对端地址表的序号, from_id是对端端口
+		info->type = SW_EVENT_UDP;
+		info->from_fd = sock;
+		info->from_id = ntohs(addr->sin_port);
+		info->fd = swUdpPeerTable_intern(serv->udp_peers, (struct sockaddr *) addr, buffer->msgs[i].msg_hdr.msg_namelen);
+		swTrace("recvfrom udp socket.fd=%d|data=%s", sock, buf->data);
+
+		if (serv->factory_mode == SW_MODE_PROCESS && n > 1 && info->len <= SW_BUFFER_SIZE - sizeof(swDataHead))
 		{
-			if (errno == EINTR)
-			{
-				continue;
-			}
-			return SW_ERR;
+			swPackage_batch_add(factory, &batch, info, buf->data);
+			continue;
+		}
+		swPackage_batch_flush(factory, &batch);
+		if (factory->dispatch(factory, buf) < 0)
+		{
+			swWarn("factory->dispatch[udp packet] fail\n");
 		}
-		break;
 	}
-	buf.info.len = ret;
-	//UDP的from_id是PORT，FD是IP
-	buf.info.type = SW_EVENT_UDP;
-	buf.info.from_fd = event->fd; //from fd
-	buf.info.from_id = ntohs(addr.sin_port); //转换字节序
-	buf.info.fd = addr.sin_addr.s_addr;
-	swTrace("recvfrom udp socket.fd=%d|data=%s", event->fd, buf.data);
-	ret = factory->dispatch(factory, &buf);
-	if (ret < 0)
+	swPackage_batch_flush(factory, &batch);
+	return n;
+#else
+	struct
+	{
+		long queue_type; //For Message Queue
+		swEventData buf;
+	} rdata;
+	struct sockaddr_in6 addr_in;
+	socklen_t addrlen = sizeof(addr_in);
+
+	buf = &rdata.buf;
+	addr = (struct sockaddr_in *) &addr_in;
+	n = recvfrom(sock, buf->data, SW_BUFFER_SIZE, flags & MSG_DONTWAIT, (struct sockaddr *) addr, &addrlen);
+	if (n < 0)
+	{
+		return SW_ERR;
+	}
+	buf->info.len = n;
+	swReactorThread_stats_recv(serv, SwooleTG.id, n);
+	//UDP的fd是对端地址表的序号, from_id是对端端口
+	buf->info.type = SW_EVENT_UDP;
+	buf->info.from_fd = sock;
+	buf->info.from_id = ntohs(addr->sin_port); //转换字节序
+	buf->info.fd = swUdpPeerTable_intern(serv->udp_peers, (struct sockaddr *) addr, addrlen);
+	swTrace("recvfrom udp socket.fd=%d|data=%s", sock, buf->data);
+	if (factory->dispatch(factory, buf) < 0)
 	{
 		swWarn("factory->dispatch[udp packet] fail\n");
 	}
+	return 1;
+#endif
+}
+
+/**
+ * for udp
+ */
+int swReactorThread_onPackage(swReactor *reactor, swEvent *event)
+{
+	swServer *serv = reactor->ptr;
+
+	while (swReactorThread_udp_recv(serv, event->fd, MSG_DONTWAIT) < 0)
+	{
+		if (errno != EINTR)
+		{
+			return errno == EAGAIN ? SW_OK : SW_ERR;
+		}
+	}
 	return SW_OK;
 }
 
@@ -81,22 +215,79 @@ static int swReactorThread_onClose(swReactor *reactor, swEvent *event)
 	return SW_OK;
 }
 
+#ifdef SW_USE_OPENSSL
 /**
- * send to client or append to out_buffer
+ * TLS握手的读写事件, 完成后和accept一样设置为SW_FD_TCP, 再通知worker进程onConnect
  */
-int swReactorThread_send(swEventData *resp)
+int swReactorThread_onHandshake(swReactor *reactor, swEvent *event)
 {
-	int fd = resp->info.fd;
+	swServer *serv = reactor->ptr;
+	swConnection *conn = swServer_get_connection(serv, event->fd);
+	swEvent connEv;
+	int ret, fdtype;
 
-	swServer *serv = SwooleG.serv;
+	if (conn == NULL || conn->active == 0 || conn->ssl_state != SW_SSL_STATE_HANDSHAKE)
+	{
+		return SW_OK;
+	}
+	ret = swSSL_accept(serv, event->fd);
+	if (ret < 0)
+	{
+		swConnection_close(serv, event->fd, 0);
+		return SW_OK;
+	}
+	else if (ret > 0)
+	{
+		fdtype = serv->connection_info[event->fd].ssl_want_write ? SW_EVENT_WRITE : SW_EVENT_READ;
+		return reactor->set(reactor, event->fd, SW_FD_SSL | fdtype);
+	}
+
+	fdtype = SW_FD_TCP | SW_EVENT_READ;
+	if (serv->enable_edge_trigger)
+	{
+		fdtype |= SW_EVENT_ET;
+		if (serv->factory_mode != SW_MODE_SINGLE)
+		{
+			fdtype |= SW_EVENT_WRITE;
+			conn->out_event = 1;
+		}
+	}
+	if (reactor->set(reactor, event->fd, fdtype) < 0)
+	{
+		swConnection_close(serv, event->fd, 0);
+		return SW_OK;
+	}
+	if (serv->onConnect != NULL)
+	{
+		connEv.type = SW_EVENT_CONNECT;
+		connEv.from_id = conn->from_id;
+		connEv.fd = event->fd;
+		connEv.from_fd = serv->connection_info[event->fd].from_fd;
+		serv->factory.notify(&serv->factory, &connEv);
+	}
+	return SW_OK;
+}
+#endif
+
+#define swReactorThread_out_events(serv)  (SW_FD_TCP | SW_EVENT_WRITE | SW_EVENT_READ | ((serv)->enable_edge_trigger ? SW_EVENT_ET : 0))
+
+/**
+ * 直接发送或追加到out_buffer, shared不为NULL时out_buffer中只保存引用
+ */
+static int swReactorThread_send_data(swServer *serv, swConnection *conn, char *data, uint32_t length, swBuffer_shared *shared)
+{
+	swReactor *reactor = &(serv->reactor_threads[conn->from_id].reactor);
 	swSendData send_data;
 	swEvent closeFd;
-	swBuffer_trunk *trunk;
-	swTask_sendfile *task;
+	uint32_t offset = 0;
+	int fd = conn->fd;
+	int ret;
 
-	swConnection *conn = swServer_get_connection(serv, fd);
-	swTraceLog(SW_TRACE_EVENT, "send-data. fd=%d|reactor_id=%d", fd, conn->from_id);
-	swReactor *reactor = &(serv->reactor_threads[conn->from_id].reactor);
+	//TLS握手中的连接, 广播时跳过
+	if (conn->ssl_state == SW_SSL_STATE_HANDSHAKE)
+	{
+		return SW_ERR;
+	}
 
 	if (conn->out_buffer == NULL)
 	{
@@ -105,186 +296,839 @@ int swReactorThread_send(swEventData *resp)
 		{
 			return SW_ERR;
 		}
+		conn->out_buffer->pool = swServer_get_buffer_pool(serv, conn->from_id);
 	}
 
-	//recv length=0, will close connection
-	if (resp->info.len == 0)
+	//out_buffer中已有数据,EPOLLOUT已经在监听,直接追加到队尾; worker正在直接写入时等它交还
+	if (!swBuffer_empty(conn->out_buffer) || conn->direct == SW_DIRECT_ACTIVE)
 	{
-#ifdef SW_REACTOR_DIRECT_SEND
-		close_fd:
-#endif
-		{
-			closeFd.fd = fd;
-			closeFd.from_id = conn->from_id;
-			closeFd.type = SW_EVENT_CLOSE;
-			//printf("closeFd.fd=%d|from_id=%d\n", closeFd.fd, closeFd.from_id);
-			swReactorThread_onClose(reactor, &closeFd);
-		}
-		return SW_OK;
+		goto append;
 	}
-	//sendfile to client
-	else if(resp->info.type == SW_EVENT_SENDFILE)
+
+	//try send, 边缘触发时socket可写不会再有通知, 必须直接发送
+	if (serv->direct_send || serv->enable_edge_trigger)
 	{
-		trunk = swBuffer_new_trunk(conn->out_buffer, SW_TRUNK_SENDFILE, 0);
-		if (trunk == NULL)
+		do
 		{
-			swWarn("get out_buffer trunk failed.");
-			return SW_ERR;
-		}
-		task = sw_malloc(sizeof(swTask_sendfile));
-		if (task == NULL)
+			ret = send(fd, data, length, 0);
+		} while (ret < 0 && errno == EINTR);
+
+		if (ret < 0)
 		{
-			swWarn("malloc for swTask_sendfile failed.");
-			//TODO: 回收这里的内存
-			return SW_ERR;
+			//连接已被关闭
+			if (swConnection_error(fd, errno) < 0 || errno == EBADF)
+			{
+				closeFd.fd = fd;
+				closeFd.from_id = conn->from_id;
+				closeFd.type = SW_EVENT_CLOSE;
+				swReactorThread_onClose(reactor, &closeFd);
+				return SW_OK;
+			}
+			else if (errno != EAGAIN)
+			{
+				swWarn("send to client failed. fd=%d|from_id=%d. Error: %s[%d]", fd, conn->from_id, strerror(errno), errno);
+				return SW_ERR;
+			}
+			swServer_reactor_stats_add(serv, conn->from_id, eagain_count, 1);
 		}
-		bzero(task, sizeof(swTask_sendfile));
-		int file_fd = open(resp->data, O_RDONLY);
-		if (file_fd < 0)
+		//send finish
+		else if (ret == length)
 		{
-			swWarn("open file[%s] failed. Error: %s[%d]", task->filename, strerror(errno), errno);
-			return SW_ERR;
+			swServer_reactor_stats_add(serv, conn->from_id, send_bytes, ret);
+			return SW_OK;
 		}
-		struct stat file_stat;
-		if (fstat(file_fd, &file_stat) < 0)
+		//Did not finish, add to writable event callback
+		else
 		{
-			swWarn("swoole_async_readfile: fstat failed. Error: %s[%d]", strerror(errno), errno);
-			return SW_ERR;
+			swServer_reactor_stats_add(serv, conn->from_id, send_bytes, ret);
+			offset = ret;
 		}
-		task->filesize = file_stat.st_size;
-		task->fd = file_fd;
-		trunk->data = (void *)task;
-		reactor->set(reactor, fd, SW_EVENT_TCP | SW_EVENT_WRITE | SW_EVENT_READ);
 	}
-	//send data
+
+	append:
+	length -= offset;
+	if (shared != NULL)
+	{
+		ret = swBuffer_append_shared(conn->out_buffer, shared, offset);
+	}
 	else
 	{
-		//test
-//		char test_data[65530];
-//		memset(test_data, 'A', sizeof(test_data) - 1);
-//		test_data[sizeof(test_data)-1] = 0;
-//		send_data.data = test_data;
-//		send_data.info.len = sizeof(test_data);
-
-		send_data.data = resp->data;
-		send_data.info.len = resp->info.len;
+		send_data.data = data + offset;
+		send_data.info.len = length;
 		send_data.info.from_id = conn->from_id;
 		send_data.info.fd = fd;
+		ret = swBuffer_in(conn->out_buffer, &send_data);
+	}
+	if (ret < 0)
+	{
+		return SW_ERR;
+	}
+	swServer_reactor_stats_add(serv, conn->from_id, out_buffer_bytes, length);
+	if (conn->direct != SW_DIRECT_ACTIVE)
+	{
+		swReactorThread_wait_writable(serv, reactor, conn);
+	}
+	return SW_OK;
+}
 
-#ifdef SW_REACTOR_DIRECT_SEND
-		if (!swBuffer_empty(conn->out_buffer))
-		{
-			append_out_buffer:
-#endif
-			//buffer enQueue
-			swBuffer_in(conn->out_buffer, &send_data);
+/**
+ * out_buffer中有未发送的数据, 等待可写事件
+ */
+static void swReactorThread_wait_writable(swServer *serv, swReactor *reactor, swConnection *conn)
+{
+	//超过高水位, 停止读取此连接的请求
+	if (serv->buffer_high_watermark > 0 && conn->out_buffer->length >= serv->buffer_high_watermark)
+	{
+		swReactorThread_pause_recv(serv, reactor, conn);
+	}
+	//listen EPOLLOUT event
+	else if (conn->out_event == 0)
+	{
+		reactor->set(reactor, conn->fd, swReactorThread_out_events(serv));
+		conn->out_event = 1;
+	}
+}
+
+/**
+ * 只监听可写事件, 客户端不读取响应时不再接收它的请求, 避免out_buffer无限增长
+ */
+static void swReactorThread_pause_recv(swServer *serv, swReactor *reactor, swConnection *conn)
+{
+	swEvent notify_ev;
+
+	if (conn->recv_paused)
+	{
+		return;
+	}
+	reactor->set(reactor, conn->fd, SW_FD_TCP | SW_EVENT_WRITE | (serv->enable_edge_trigger ? SW_EVENT_ET : 0));
+	conn->out_event = 1;
+	conn->recv_paused = 1;
+
+	if (serv->onBufferFull != NULL)
+	{
+		notify_ev.fd = conn->fd;
+		notify_ev.from_id = conn->from_id;
+		notify_ev.type = SW_EVENT_BUFFER_FULL;
+		SwooleG.factory->notify(SwooleG.factory, &notify_ev);
+	}
+}
 
-			//listen EPOLLOUT event
-			reactor->set(reactor, fd, SW_EVENT_TCP | SW_EVENT_WRITE | SW_EVENT_READ);
+/**
+ * out_buffer已降到低水位, 恢复监听可读事件
+ */
+static void swReactorThread_resume_recv(swServer *serv, swReactor *reactor, swConnection *conn)
+{
+	swEvent notify_ev;
+
+	//out_event为0时out_buffer已发送完, 可读事件已经恢复
+	if (conn->out_event)
+	{
+		reactor->set(reactor, conn->fd, swReactorThread_out_events(serv));
+	}
+	conn->recv_paused = 0;
+
+	if (serv->onBufferEmpty != NULL)
+	{
+		notify_ev.fd = conn->fd;
+		notify_ev.from_id = conn->from_id;
+		notify_ev.type = SW_EVENT_BUFFER_EMPTY;
+		SwooleG.factory->notify(SwooleG.factory, &notify_ev);
+	}
+}
+
+/**
+ * 大数据包, 直接从send_arena发送, 不再复制到out_buffer
+ */
+static int swReactorThread_send_shared(swEventData *resp)
+{
+	swServer *serv = SwooleG.serv;
+	swConnection *conn = swServer_get_connection(serv, resp->info.fd);
+	swBuffer_shared *shared;
+	int ret = SW_ERR;
 
-#ifdef SW_REACTOR_DIRECT_SEND
+	memcpy(&shared, resp->data, sizeof(shared));
+	if (conn != NULL && conn->active)
+	{
+		if (resp->info.from_fd & SW_SEND_WEBSOCKET)
+		{
+			ret = swReactorThread_websocket_push(serv, conn, resp->info.from_fd, shared->data, shared->length, shared);
 		}
 		else
 		{
-			//try send
-			int ret = send(send_data.info.fd, send_data.data, send_data.info.len, 0);
-			if (ret < 0)
-			{
-				//连接已被关闭
-				if (errno == ECONNRESET || errno == EBADF)
-				{
-					goto close_fd;
-				}
-				swWarn("factory->onFinish failed.fd=%d|from_id=%d. Error: %s[%d]", , resp->info.from_id, strerror(errno), errno);
-			}
-			//Did not finish, add to writable event callback
-			else if(ret < resp->info.len)
-			{
-				send_data.data += ret;
-				send_data.info.len -= ret;
-				goto append_out_buffer;
-			}
-			//printf("[writer]pop.fd=%d|from_id=%d|data=%s\n", , resp->info.from_id, resp->data);
+			ret = swReactorThread_send_data(serv, conn, shared->data, shared->length, shared);
 		}
-#endif
 	}
-	return SW_OK;
+	//释放此消息持有的引用
+	swBuffer_shared_release(shared);
+	return ret;
 }
 
-static int swReactorThread_onWrite(swReactor *reactor, swEvent *ev)
+/**
+ * 广播到本reactor线程的连接
+ */
+static int swReactorThread_broadcast(swEventData *resp)
 {
-	int ret, sendn;
 	swServer *serv = SwooleG.serv;
-	swConnection *conn = swServer_get_connection(serv, ev->fd);
-	swBuffer *out_buffer = conn->out_buffer;
-	swBuffer_trunk *trunk;
-	swEvent closeFd;
-	swTask_sendfile *task = NULL;
-
-	if (conn->out_buffer == NULL)
+	swBroadcastPackage *pkg = NULL;
+	swBuffer_shared *shared = NULL;
+	swConnection *conn;
+	char *data = resp->data;
+	uint32_t length = resp->info.len;
+	int i, fd_num, *fds;
+
+	if (resp->info.from_fd == SW_SEND_SHARED)
 	{
-		goto remove_out_event;
+		pkg = (swBroadcastPackage *) resp->data;
+		shared = pkg->shared;
+		data = shared->data;
+		length = shared->length;
 	}
 
-	do
+	//指定了fd列表
+	if (pkg != NULL && pkg->fd_num > 0)
 	{
-		trunk = swBuffer_get_trunk(out_buffer);
-		if (trunk->type == SW_TRUNK_SENDFILE)
+		for (i = 0; i < pkg->fd_num; i++)
 		{
-			task = (swTask_sendfile *) trunk->data;
-			sendn = (task->filesize - task->offset > SW_SENDFILE_TRUNK) ? SW_SENDFILE_TRUNK : task->filesize - task->offset;
-			ret = swoole_sendfile(ev->fd, task->fd, &task->offset, sendn);
-			swTrace("ret=%d|task->offset=%ld|sendn=%d|filesize=%ld", ret, task->offset, sendn, task->filesize);
-
-			if (ret <= 0)
-			{
-				swWarn("sendfile failed. Error: %s[%d]", strerror(errno), errno);
-				if (errno == EAGAIN)
-				{
-					return SW_OK;
-				}
-				else if (swConnection_error(conn->fd, errno) < 0)
-				{
-					close_fd:
-					closeFd.fd = ev->fd;
-					closeFd.from_id = ev->from_id;
-					closeFd.type = SW_EVENT_CLOSE;
-					swReactorThread_onClose(reactor, &closeFd);
-				}
-				else
-				{
-					swBuffer_pop_trunk(out_buffer, trunk);
-					return SW_ERR;
-				}
-			}
-			//sendfile finish
-			if (task->offset >= task->filesize)
+			conn = swServer_get_connection(serv, pkg->fds[i]);
+			if (conn == NULL || conn->active == 0)
 			{
-				reactor->set(reactor, ev->fd, SW_EVENT_TCP | SW_EVENT_READ);
-				swBuffer_pop_trunk(out_buffer, trunk);
-				close(task->fd);
-				sw_free(task);
+				continue;
 			}
-			return SW_OK;
+			swReactorThread_send_data(serv, conn, data, length, shared);
 		}
-		else
+	}
+	//发送失败和reactor线程都会关闭连接, 在索引的副本上遍历
+	else if ((fd_num = swServer_connection_snapshot(serv, resp->info.from_id, &fds)) > 0)
+	{
+		for (i = 0; i < fd_num; i++)
 		{
-			sendn = trunk->length - trunk->offset;
-			if (sendn == 0)
+			conn = swServer_get_connection(serv, fds[i]);
+			if (conn == NULL || conn->active == 0)
 			{
-				swBuffer_pop_trunk(out_buffer, trunk);
 				continue;
 			}
-			ret = send(ev->fd, trunk->data + trunk->offset, sendn, 0);
-			//printf("BufferOut: reactor=%d|sendn=%d|ret=%d|trunk->offset=%d|trunk_len=%d\n", reactor->id, sendn, ret, trunk->offset, trunk->length);
-			if (ret < 0)
-			{
-				if (swConnection_error(conn->fd, errno) < 0)
-				{
-					goto close_fd;
-				}
+			swReactorThread_send_data(serv, conn, data, length, shared);
+		}
+		sw_free(fds);
+	}
+	//释放此消息持有的引用
+	if (shared != NULL)
+	{
+		swBuffer_shared_release(shared);
+	}
+	return SW_OK;
+}
+
+/**
+ * send to client or append to out_buffer
+ */
+int swReactorThread_send(swEventData *resp)
+{
+	int fd = resp->info.fd;
+
+	swServer *serv = SwooleG.serv;
+	swEvent closeFd;
+	swBuffer_trunk *trunk;
+	swTask_sendfile *task;
+	swConnectionInfo *info = NULL;
+	int ret;
+
+	if (resp->info.type == SW_EVENT_BROADCAST)
+	{
+		return swReactorThread_broadcast(resp);
+	}
+	else if (resp->info.type == SW_EVENT_SHARED)
+	{
+		return swReactorThread_send_shared(resp);
+	}
+	else if (resp->info.type == SW_EVENT_DIRECT_RESET)
+	{
+		return swReactorThread_direct_reset(serv, resp);
+	}
+
+	swConnection *conn = swServer_get_connection(serv, fd);
+	swTraceLog(SW_TRACE_EVENT, "send-data. fd=%d|reactor_id=%d", fd, conn->from_id);
+	swReactor *reactor = &(serv->reactor_threads[conn->from_id].reactor);
+
+	if (resp->info.type == SW_EVENT_PROXY)
+	{
+		return swProxy_start(reactor, resp);
+	}
+	else if (resp->info.type == SW_EVENT_DIRECT)
+	{
+		return swReactorThread_direct_start(serv, reactor, conn, resp);
+	}
+	else if (resp->info.type == SW_EVENT_DIRECT_END)
+	{
+		return swReactorThread_direct_end(serv, reactor, conn, resp);
+	}
+
+	if (conn->out_buffer == NULL)
+	{
+		conn->out_buffer = swBuffer_new(SW_BUFFER_SIZE);
+		if (conn->out_buffer == NULL)
+		{
+			return SW_ERR;
+		}
+		conn->out_buffer->pool = swServer_get_buffer_pool(serv, conn->from_id);
+	}
+
+	//采样的响应, out_buffer发送完时记录
+	if (resp->info.time != 0 && serv->reactor_latency != NULL)
+	{
+		info = swServer_get_connection_info(serv, fd);
+		info->latency_start = resp->info.time;
+		info->latency_resp = (uint32_t) swClock_usec();
+	}
+
+	//recv length=0, will close connection
+	if (resp->info.len == 0)
+	{
+		closeFd.fd = fd;
+		closeFd.from_id = conn->from_id;
+		closeFd.type = SW_EVENT_CLOSE;
+		//printf("closeFd.fd=%d|from_id=%d\n", closeFd.fd, closeFd.from_id);
+		swReactorThread_onClose(reactor, &closeFd);
+		return SW_OK;
+	}
+	//已交给reactor线程转发, 写入out_buffer会和转发的数据交错
+	else if (conn->proxy == SW_PROXY_ACTIVE)
+	{
+		swWarn("connection[%d] is proxied, cannot send data.", fd);
+		return SW_ERR;
+	}
+	//明文不能写入还在握手的socket
+	else if (conn->ssl_state == SW_SSL_STATE_HANDSHAKE)
+	{
+		swWarn("connection[%d] is in TLS handshake, cannot send data.", fd);
+		return SW_ERR;
+	}
+	//sendfile to client
+	else if(resp->info.type == SW_EVENT_SENDFILE)
+	{
+		swSendFile_request *req = (swSendFile_request *) resp->data;
+		uint16_t name_len = resp->info.len - sizeof(swSendFile_request) - 1;
+		swFileCache_node *file = swFileCache_get(&serv->reactor_threads[conn->from_id].file_cache, req->filename, name_len);
+		if (file == NULL)
+		{
+			return SW_ERR;
+		}
+		if (req->offset < 0 || req->offset >= file->filesize || req->length < 0)
+		{
+			swWarn("sendfile range is invalid. file=%s|offset=%ld|length=%ld|filesize=%ld", req->filename,
+					(long) req->offset, (long) req->length, (long) file->filesize);
+			swFileCache_release(file);
+			return SW_ERR;
+		}
+		task = sw_malloc(sizeof(swTask_sendfile));
+		if (task == NULL)
+		{
+			swWarn("malloc for swTask_sendfile failed.");
+			swFileCache_release(file);
+			return SW_ERR;
+		}
+		task->file = file;
+		task->fd = file->fd;
+		task->offset = req->offset;
+		task->end = (req->length == 0 || req->offset + req->length > file->filesize) ? file->filesize : req->offset + req->length;
+
+		trunk = swBuffer_new_trunk(conn->out_buffer, SW_TRUNK_SENDFILE, 0);
+		if (trunk == NULL)
+		{
+			swWarn("get out_buffer trunk failed.");
+			swTask_sendfile_free(task);
+			return SW_ERR;
+		}
+		trunk->data = (void *)task;
+		if (conn->direct == SW_DIRECT_ACTIVE)
+		{
+			return SW_OK;
+		}
+		else if (conn->out_event == 0)
+		{
+			reactor->set(reactor, fd, swReactorThread_out_events(serv));
+			conn->out_event = 1;
+		}
+		//边缘触发模式下可写事件已经通知过, 直接开始发送
+		else if (serv->enable_edge_trigger && swBuffer_get_trunk(conn->out_buffer) == trunk)
+		{
+			swEvent ev;
+			ev.fd = fd;
+			ev.from_id = conn->from_id;
+			ev.type = SW_FD_TCP;
+			return swReactorThread_onWrite(reactor, &ev);
+		}
+	}
+	//send data
+	else
+	{
+		if (resp->info.from_fd & SW_SEND_WEBSOCKET)
+		{
+			ret = swReactorThread_websocket_push(serv, conn, resp->info.from_fd, resp->data, resp->info.len, NULL);
+		}
+		else
+		{
+			ret = swReactorThread_send_data(serv, conn, resp->data, resp->info.len, NULL);
+		}
+		//直接发送完成
+		if (info != NULL && info->latency_start != 0 && conn->active && swBuffer_empty(conn->out_buffer))
+		{
+			swReactorThread_latency_done(serv, conn->from_id, info);
+		}
+		return ret;
+	}
+	return SW_OK;
+}
+
+/**
+ * 通过worker的管道回复SW_EVENT_DIRECT, sock为-1表示拒绝
+ */
+static int swReactorThread_direct_reply(swServer *serv, swConnection *conn, int sock)
+{
+	union
+	{
+		struct cmsghdr cm;
+		char control[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	swDataHead info;
+	int ret, count;
+	int worker_id = swServer_get_connection_info(serv, conn->fd)->direct_worker;
+
+	bzero(&info, sizeof(info));
+	info.fd = conn->fd;
+	info.type = SW_EVENT_DIRECT;
+	info.from_id = conn->from_id;
+
+	iov.iov_base = &info;
+	iov.iov_len = sizeof(info);
+	bzero(&msg, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (sock >= 0)
+	{
+		msg.msg_control = control.control;
+		msg.msg_controllen = sizeof(control.control);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &sock, sizeof(sock));
+	}
+
+	for (count = 0; count < SW_WORKER_SENDTO_COUNT; count++)
+	{
+		ret = sendmsg(serv->workers[worker_id].pipe_master, &msg, 0);
+		if (ret >= 0)
+		{
+			return SW_OK;
+		}
+		else if (errno == EINTR)
+		{
+			continue;
+		}
+		else if (errno == EAGAIN)
+		{
+			swYield();
+		}
+		else
+		{
+			break;
+		}
+	}
+	swWarn("send direct reply to worker#%d failed. Error: %s[%d]", worker_id, strerror(errno), errno);
+	return SW_ERR;
+}
+
+/**
+ * worker申请直接写socket: 之前的响应还在out_buffer中时等待发送完成
+ */
+static int swReactorThread_direct_start(swServer *serv, swReactor *reactor, swConnection *conn, swEventData *resp)
+{
+	int worker_id;
+
+	memcpy(&worker_id, resp->data, sizeof(worker_id));
+	if (worker_id < 0 || worker_id >= serv->worker_num)
+	{
+		return SW_ERR;
+	}
+	swServer_get_connection_info(serv, conn->fd)->direct_worker = worker_id;
+	//已关闭, 正在转发或者还在TLS握手的连接
+	if (!conn->active || conn->direct != 0 || conn->proxy != 0 || conn->ssl_state == SW_SSL_STATE_HANDSHAKE)
+	{
+		return swReactorThread_direct_reply(serv, conn, -1);
+	}
+	if (conn->out_buffer != NULL && !swBuffer_empty(conn->out_buffer))
+	{
+		conn->direct = SW_DIRECT_WAIT;
+		return SW_OK;
+	}
+	conn->direct = SW_DIRECT_ACTIVE;
+	if (swReactorThread_direct_reply(serv, conn, conn->fd) < 0)
+	{
+		conn->direct = 0;
+		return SW_ERR;
+	}
+	if (conn->out_event == 1 && !serv->enable_edge_trigger)
+	{
+		reactor->set(reactor, conn->fd, SW_FD_TCP | SW_EVENT_READ);
+		conn->out_event = 0;
+	}
+	return SW_OK;
+}
+
+/**
+ * worker交还socket, 发送期间追加到out_buffer的响应
+ */
+static int swReactorThread_direct_end(swServer *serv, swReactor *reactor, swConnection *conn, swEventData *resp)
+{
+	int worker_id;
+
+	memcpy(&worker_id, resp->data, sizeof(worker_id));
+	//连接已关闭或者已被复用
+	if (conn->direct == 0 || swServer_get_connection_info(serv, conn->fd)->direct_worker != worker_id)
+	{
+		return SW_OK;
+	}
+	return swReactorThread_direct_release(serv, reactor, conn);
+}
+
+/**
+ * 收回写权限, 发送期间追加到out_buffer的响应
+ */
+static int swReactorThread_direct_release(swServer *serv, swReactor *reactor, swConnection *conn)
+{
+	swEvent ev;
+
+	conn->direct = 0;
+	if (!conn->active || conn->out_buffer == NULL || swBuffer_empty(conn->out_buffer))
+	{
+		return SW_OK;
+	}
+	//边缘触发模式下可写事件已经通知过
+	if (serv->enable_edge_trigger && conn->out_event == 1)
+	{
+		ev.fd = conn->fd;
+		ev.from_id = conn->from_id;
+		ev.type = SW_FD_TCP;
+		return swReactorThread_onWrite(reactor, &ev);
+	}
+	swReactorThread_wait_writable(serv, reactor, conn);
+	return SW_OK;
+}
+
+/**
+ * worker退出时socket的副本已由内核关闭, 收回它还没有交还的连接
+ */
+static int swReactorThread_direct_reset(swServer *serv, swEventData *resp)
+{
+	int worker_id, i, fd, fd_num, *fds;
+	swReactorThread *thread = &(serv->reactor_threads[resp->info.from_id]);
+	swConnection *conn;
+
+	memcpy(&worker_id, resp->data, sizeof(worker_id));
+	//归还时可能关闭连接, 在索引的副本上遍历
+	if ((fd_num = swServer_connection_snapshot(serv, resp->info.from_id, &fds)) <= 0)
+	{
+		return fd_num < 0 ? SW_ERR : SW_OK;
+	}
+	for (i = 0; i < fd_num; i++)
+	{
+		fd = fds[i];
+		conn = swServer_get_connection(serv, fd);
+		if (conn->active != 0 && conn->direct != 0 && swServer_get_connection_info(serv, fd)->direct_worker == worker_id)
+		{
+			swWarn("worker#%d exited while writing connection[%d] directly.", worker_id, fd);
+			swReactorThread_direct_release(serv, &(thread->reactor), conn);
+		}
+	}
+	sw_free(fds);
+	return SW_OK;
+}
+
+/**
+ * 由swConnection_close调用
+ */
+void swReactorThread_direct_free(swServer *serv, swConnection *conn)
+{
+	if (conn->direct == SW_DIRECT_WAIT)
+	{
+		swReactorThread_direct_reply(serv, conn, -1);
+	}
+	conn->direct = 0;
+}
+
+/**
+ * 是否可以先追加到out_buffer, 等这一批响应处理完再发送
+ * 只合并普通数据, out_buffer已有数据时本来就是追加等待EPOLLOUT
+ */
+static swConnection* swReactorThread_send_deferrable(swServer *serv, swEventData *resp, int *pending, int pending_num)
+{
+	swConnection *conn;
+	int i;
+
+	if (resp->info.type != SW_EVENT_TCP || resp->info.len == 0)
+	{
+		return NULL;
+	}
+	if (!serv->direct_send && !serv->enable_edge_trigger)
+	{
+		return NULL;
+	}
+	//采样延迟的响应走原来的流程
+	if (resp->info.time != 0 && serv->reactor_latency != NULL)
+	{
+		return NULL;
+	}
+	conn = swServer_get_connection(serv, resp->info.fd);
+	if (!conn->active || conn->proxy != 0 || conn->direct == SW_DIRECT_ACTIVE || conn->ssl_state == SW_SSL_STATE_HANDSHAKE)
+	{
+		return NULL;
+	}
+	for (i = 0; i < pending_num; i++)
+	{
+		if (pending[i] == conn->fd)
+		{
+			return conn;
+		}
+	}
+	if (conn->out_buffer != NULL && !swBuffer_empty(conn->out_buffer))
+	{
+		return NULL;
+	}
+	return conn;
+}
+
+/**
+ * 对合并的连接各gather-send一次, 未发送完的等待EPOLLOUT
+ */
+static void swReactorThread_send_flush(swServer *serv, int *pending, int pending_num)
+{
+	swConnection *conn;
+	swReactor *reactor;
+	swEvent ev;
+	int i;
+
+	for (i = 0; i < pending_num; i++)
+	{
+		conn = swServer_get_connection(serv, pending[i]);
+		if (!conn->active)
+		{
+			continue;
+		}
+		reactor = &(serv->reactor_threads[conn->from_id].reactor);
+		ev.fd = conn->fd;
+		ev.from_id = conn->from_id;
+		ev.type = SW_FD_TCP;
+		swReactorThread_onWrite(reactor, &ev);
+		//发送中可能已关闭
+		if (conn->active && conn->out_buffer != NULL && !swBuffer_empty(conn->out_buffer))
+		{
+			swReactorThread_wait_writable(serv, reactor, conn);
+		}
+	}
+}
+
+/**
+ * 处理从worker管道一次读出的多个响应
+ * 连续发往已就绪连接的数据先追加到out_buffer, 全部处理完后每个连接只发送一次
+ * 其他类型的响应(关闭/sendfile/广播等)之前先发送已追加的数据, 保证顺序不变
+ */
+int swReactorThread_send_batch(swEventData *resps, int n)
+{
+	swServer *serv = SwooleG.serv;
+	swConnection *conn;
+	swSendData send_data;
+	char frame[SW_WEBSOCKET_HEADER_MAX + SW_BUFFER_SIZE];
+	int pending[SW_REACTOR_RESP_BATCH];
+	int pending_num = 0;
+	int i;
+
+	if (n == 1)
+	{
+		return swReactorThread_send(&resps[0]);
+	}
+	for (i = 0; i < n; i++)
+	{
+		conn = swReactorThread_send_deferrable(serv, &resps[i], pending, pending_num);
+		if (conn == NULL)
+		{
+			swReactorThread_send_flush(serv, pending, pending_num);
+			pending_num = 0;
+			swReactorThread_send(&resps[i]);
+			continue;
+		}
+		if (conn->out_buffer == NULL)
+		{
+			conn->out_buffer = swBuffer_new(SW_BUFFER_SIZE);
+			if (conn->out_buffer == NULL)
+			{
+				continue;
+			}
+			conn->out_buffer->pool = swServer_get_buffer_pool(serv, conn->from_id);
+		}
+		if (swBuffer_empty(conn->out_buffer) && pending_num < SW_REACTOR_RESP_BATCH)
+		{
+			pending[pending_num++] = conn->fd;
+		}
+		if (resps[i].info.from_fd & SW_SEND_WEBSOCKET)
+		{
+			send_data.data = frame;
+			send_data.info.len = swReactorThread_websocket_pack(serv, conn, resps[i].info.from_fd, resps[i].data,
+					resps[i].info.len, frame);
+		}
+		else
+		{
+			send_data.data = resps[i].data;
+			send_data.info.len = resps[i].info.len;
+		}
+		send_data.info.from_id = conn->from_id;
+		send_data.info.fd = conn->fd;
+		if (swBuffer_in(conn->out_buffer, &send_data) < 0)
+		{
+			swWarn("append to out_buffer failed. fd=%d", conn->fd);
+			continue;
+		}
+		swServer_reactor_stats_add(serv, conn->from_id, out_buffer_bytes, send_data.info.len);
+	}
+	swReactorThread_send_flush(serv, pending, pending_num);
+	return SW_OK;
+}
+
+static void swReactorThread_latency_done(swServer *serv, int reactor_id, swConnectionInfo *info)
+{
+	uint32_t now = (uint32_t) swClock_usec();
+
+	swHistogram_record(&serv->reactor_latency[reactor_id].send, now - info->latency_resp);
+	swHistogram_record(&serv->reactor_latency[reactor_id].total, now - info->latency_start);
+	info->latency_start = 0;
+}
+
+static int swReactorThread_onWrite(swReactor *reactor, swEvent *ev)
+{
+	swServer *serv = SwooleG.serv;
+	swConnection *conn = swServer_get_connection(serv, ev->fd);
+	int ret = swReactorThread_write_out_buffer(reactor, ev, conn);
+
+	//发送过程中连接可能已被关闭
+	if (conn->recv_paused && conn->active
+			&& (conn->out_buffer == NULL || conn->out_buffer->length <= serv->buffer_low_watermark))
+	{
+		swReactorThread_resume_recv(serv, reactor, conn);
+	}
+	return ret;
+}
+
+static int swReactorThread_write_out_buffer(swReactor *reactor, swEvent *ev, swConnection *conn)
+{
+	int ret, sendn;
+	swServer *serv = SwooleG.serv;
+	swBuffer *out_buffer = conn->out_buffer;
+	swBuffer_trunk *trunk;
+	swEvent closeFd;
+	swTask_sendfile *task = NULL;
+
+	//worker正在直接写入, 交还后再发送
+	if (conn->direct == SW_DIRECT_ACTIVE)
+	{
+		if (conn->out_event == 1 && !serv->enable_edge_trigger)
+		{
+			reactor->set(reactor, ev->fd, SW_FD_TCP | SW_EVENT_READ);
+			conn->out_event = 0;
+		}
+		return SW_OK;
+	}
+
+	//边缘触发模式下每次状态变化都会通知,out_buffer可能为空
+	if (conn->out_buffer == NULL || swBuffer_empty(out_buffer))
+	{
+		goto remove_out_event;
+	}
+
+	do
+	{
+		trunk = swBuffer_get_trunk(out_buffer);
+		if (trunk->type == SW_TRUNK_SENDFILE)
+		{
+			task = (swTask_sendfile *) trunk->data;
+			sendn = (task->end - task->offset > serv->sendfile_window) ? serv->sendfile_window : task->end - task->offset;
+			ret = swoole_sendfile(ev->fd, task->fd, &task->offset, sendn);
+			swTrace("ret=%d|task->offset=%ld|sendn=%d|end=%ld", ret, task->offset, sendn, task->end);
+			if (ret > 0)
+			{
+				swServer_reactor_stats_add(serv, reactor->id, send_bytes, ret);
+			}
+
+			//文件被截断
+			if (ret == 0)
+			{
+				swWarn("sendfile failed. file is truncated. offset=%ld|end=%ld", (long) task->offset, (long) task->end);
+				swBuffer_pop_trunk(out_buffer, trunk);
+				return SW_ERR;
+			}
+			else if (ret < 0)
+			{
+				if (errno == EAGAIN)
+				{
+					swServer_reactor_stats_add(serv, reactor->id, eagain_count, 1);
+					return SW_OK;
+				}
+				else if (swConnection_error(conn->fd, errno) < 0)
+				{
+					close_fd:
+					closeFd.fd = ev->fd;
+					closeFd.from_id = ev->from_id;
+					closeFd.type = SW_EVENT_CLOSE;
+					swReactorThread_onClose(reactor, &closeFd);
+					//out_buffer已被释放
+					return SW_OK;
+				}
+				else
+				{
+					swWarn("sendfile failed. Error: %s[%d]", strerror(errno), errno);
+					swBuffer_pop_trunk(out_buffer, trunk);
+					return SW_ERR;
+				}
+			}
+			//sendfile finish, 文件引用在trunk释放时归还
+			if (task->offset >= task->end)
+			{
+				swBuffer_pop_trunk(out_buffer, trunk);
+				continue;
+			}
+			//边缘触发需要一直发送到EAGAIN
+			if (!serv->enable_edge_trigger)
+			{
+				return SW_OK;
+			}
+			continue;
+		}
+		else
+		{
+#ifdef SW_USE_WRITEV
+			//gather-send the data trunks
+			ret = swBuffer_writev(out_buffer, ev->fd);
+#else
+			sendn = trunk->length - trunk->offset;
+			if (sendn == 0)
+			{
+				swBuffer_pop_trunk(out_buffer, trunk);
+				continue;
+			}
+			ret = send(ev->fd, swBuffer_trunk_data(trunk) + trunk->offset, sendn, 0);
+#endif
+			//printf("BufferOut: reactor=%d|sendn=%d|ret=%d|trunk->offset=%d|trunk_len=%d\n", reactor->id, sendn, ret, trunk->offset, trunk->length);
+			if (ret < 0)
+			{
+				if (swConnection_error(conn->fd, errno) < 0)
+				{
+					goto close_fd;
+				}
 				else if(errno == EAGAIN)
 				{
+					swServer_reactor_stats_add(serv, reactor->id, eagain_count, 1);
 					return SW_OK;
 				}
 				else
@@ -293,6 +1137,15 @@ static int swReactorThread_onWrite(swReactor *reactor, swEvent *ev)
 					return SW_OK;
 				}
 			}
+			swServer_reactor_stats_add(serv, reactor->id, send_bytes, ret);
+			swServer_reactor_stats_add(serv, reactor->id, out_buffer_bytes, -ret);
+#ifdef SW_USE_WRITEV
+			//partial send, socket buffer is full. wait next EPOLLOUT
+			else if (!swBuffer_empty(out_buffer) && swBuffer_get_trunk(out_buffer)->offset > 0)
+			{
+				return SW_OK;
+			}
+#else
 			//trunk full send
 			else if(ret == sendn || sendn == 0)
 			{
@@ -302,54 +1155,469 @@ static int swReactorThread_onWrite(swReactor *reactor, swEvent *ev)
 			{
 				trunk->offset += ret;
 			}
+#endif
 		}
 	} while (!swBuffer_empty(out_buffer));
 
-	//remove EPOLLOUT event
-	remove_out_event:
-	reactor->set(reactor, ev->fd, SW_EVENT_TCP | SW_EVENT_READ);
+	//remove EPOLLOUT event, 边缘触发模式下保持监听
+	remove_out_event:
+	if (serv->reactor_latency != NULL)
+	{
+		swConnectionInfo *info = swServer_get_connection_info(serv, ev->fd);
+		if (info->latency_start != 0)
+		{
+			swReactorThread_latency_done(serv, reactor->id, info);
+		}
+	}
+	//worker的响应已发送完, 开始转发
+	if (conn->proxy == SW_PROXY_WAIT)
+	{
+		return swProxy_activate(reactor, conn);
+	}
+	//把socket交给等待的worker
+	else if (conn->direct == SW_DIRECT_WAIT)
+	{
+		conn->direct = SW_DIRECT_ACTIVE;
+		if (swReactorThread_direct_reply(serv, conn, conn->fd) < 0)
+		{
+			conn->direct = 0;
+		}
+	}
+	if (conn->out_event == 1 && !serv->enable_edge_trigger)
+	{
+		reactor->set(reactor, ev->fd, SW_FD_TCP | SW_EVENT_READ);
+		conn->out_event = 0;
+	}
+	return SW_OK;
+}
+
+/**
+ * 过载时不再接收新的请求: 连接上没有未完成的包时回复overload_response并关闭
+ * 已经读了一部分的请求和WebSocket连接继续处理
+ */
+static int swReactorThread_onReceive_admit(swReactor *reactor, swEvent *event)
+{
+	swServer *serv = reactor->ptr;
+	swConnection *conn = swServer_get_connection(serv, event->fd);
+
+	if (swServer_overloaded(serv) && conn->websocket_status == 0
+			&& (conn->string_buffer == NULL || swString_length(conn->string_buffer) == 0)
+			&& serv->connection_info[event->fd].ring_length == 0)
+	{
+		swServer_overload_reject(serv, reactor->id, event->fd, 1);
+		swConnection_close(serv, event->fd, 1);
+		return SW_OK;
+	}
+	return swReactorThread_onReceive_admitted(reactor, event);
+}
+
+int swReactorThread_onReceive_no_buffer(swReactor *reactor, swEvent *event)
+{
+	int ret, n;
+	swReactorThread *thread;
+	swPackage_batch *batch;
+	swServer *serv = reactor->ptr;
+	swFactory *factory = &(serv->factory);
+	swConnection *conn = swServer_get_connection(serv, event->fd);
+
+	struct
+	{
+		/**
+		 * For Message Queue
+		 * 这里多一个long int 就可以直接插入到队列中，不需要内存拷贝
+		 */
+		long queue_type;
+		swEventData buf;
+	} rdata;
+
+	recv_data:
+	//非ET模式会持续通知
+	n = recv(event->fd, rdata.buf.data, SW_BUFFER_SIZE, 0);
+	swReactorThread_stats_recv(serv, reactor->id, n);
+	if (n < 0)
+	{
+		if (swConnection_error(conn->fd, errno) < 0)
+		{
+			goto close_fd;
+		}
+		return SW_OK;
+	}
+	//需要检测errno来区分是EAGAIN还是ECONNRESET
+	else if (n == 0)
+	{
+		close_fd:
+		swTrace("Close Event.FD=%d|From=%d|errno=%d", event->fd, event->from_id, errno);
+		swConnection_close(serv, event->fd, 1);
+		return SW_OK;
+	}
+	else
+	{
+		swTrace("recv: %s|fd=%d|len=%d\n", rdata.buf.data, event->fd, n);
+		//更新最近收包时间
+		swConnection_idle_touch(serv, conn);
+
+		//heartbeat ping package
+		if (serv->heartbeat_ping_length == n)
+		{
+			if(serv->heartbeat_pong_length > 0)
+			{
+				send(event->fd, serv->heartbeat_pong, serv->heartbeat_pong_length, 0);
+			}
+			ret = SW_OK;
+			goto recv_next;
+		}
+
+		rdata.buf.info.fd = event->fd;
+		rdata.buf.info.len = n;
+		rdata.buf.info.type = SW_EVENT_TCP;
+		rdata.buf.info.from_id = event->from_id;
+		rdata.buf.info.from_fd = 0;
+
+		//合并到本线程的缓存,在onFinish中投递
+		if (serv->factory_mode == SW_MODE_PROCESS && serv->dispatch_batch)
+		{
+			thread = &(serv->reactor_threads[event->from_id]);
+			batch = &(thread->batches[event->fd % thread->batch_num]);
+			if (n <= SW_BUFFER_SIZE - sizeof(swDataHead))
+			{
+				ret = swPackage_batch_add(factory, batch, &rdata.buf.info, rdata.buf.data);
+				goto recv_next;
+			}
+			swPackage_batch_flush(factory, batch);
+		}
+		ret = factory->dispatch(factory, &rdata.buf);
+		//处理数据失败，数据将丢失
+		if (ret < 0)
+		{
+			swWarn("factory->dispatch fail.errno=%d|sw_errno=%d", errno, sw_errno);
+		}
+
+		recv_next:
+		//缓存区还有数据没读完，继续读，EPOLL的ET模式
+		if (serv->enable_edge_trigger)
+		{
+			goto recv_data;
+		}
+		return ret;
+	}
+	return SW_OK;
+}
+
+/**
+ * 大于SW_BUFFER_SIZE的包分为多个消息投递
+ */
+static int swReactorThread_dispatch_package(swFactory *factory, swEventData *send_data, char *data, uint32_t length)
+{
+	int ret = SW_OK;
+	if (length <= SW_BUFFER_SIZE)
+	{
+		memcpy(send_data->data, data, length);
+		send_data->info.len = length;
+		send_data->info.type = SW_EVENT_TCP;
+		return factory->dispatch(factory, send_data);
+	}
+	send_data->info.type = SW_EVENT_PACKAGE_START;
+	while (length > 0)
+	{
+		if (length > SW_BUFFER_SIZE)
+		{
+			send_data->info.len = SW_BUFFER_SIZE;
+		}
+		else
+		{
+			send_data->info.type = SW_EVENT_PACKAGE_END;
+			send_data->info.len = length;
+		}
+		memcpy(send_data->data, data, send_data->info.len);
+		//处理数据失败，数据将丢失
+		if (factory->dispatch(factory, send_data) < 0)
+		{
+			ret = SW_ERR;
+		}
+		data += send_data->info.len;
+		length -= send_data->info.len;
+		//转为trunk
+		if (send_data->info.type == SW_EVENT_PACKAGE_START)
+		{
+			send_data->info.type = SW_EVENT_PACKAGE_TRUNK;
+		}
+	}
+	return ret;
+}
+
+/**
+ * 进程模式下小包合并为一个消息投递, 大包先刷新已合并的包以保持顺序
+ */
+static int swReactorThread_dispatch_batch(swServer *serv, swPackage_batch *batch, swEventData *send_data, swDataHead *info,
+		char *data, uint32_t length)
+{
+	swFactory *factory = &(serv->factory);
+	//按key分配时每个包可能投递到不同的worker, 不能合并
+	if (serv->factory_mode == SW_MODE_PROCESS && !serv->disable_package_batch
+			&& length <= SW_BUFFER_SIZE - sizeof(swDataHead))
+	{
+		info->len = length;
+		return swPackage_batch_add(factory, batch, info, data);
+	}
+	swPackage_batch_flush(factory, batch);
+	if (swReactorThread_dispatch_package(factory, send_data, data, length) < 0)
+	{
+		swWarn("factory->dispatch failed.");
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+/**
+ * 开启dispatch_batch时使用reactor线程的合并缓存, 在onFinish中投递, 否则使用调用者的临时缓存
+ */
+static swPackage_batch* swReactorThread_get_batch(swServer *serv, int reactor_id, int fd, swPackage_batch *local)
+{
+	swReactorThread *thread;
+	if (serv->factory_mode == SW_MODE_PROCESS && serv->dispatch_batch)
+	{
+		thread = &(serv->reactor_threads[reactor_id]);
+		return &(thread->batches[fd % thread->batch_num]);
+	}
+	swPackage_batch_init(local, fd, reactor_id);
+	return local;
+}
+
+/**
+ * 连接关闭前投递合并中的数据包, 保证onReceive在onClose之前
+ */
+void swReactorThread_batch_flush(swServer *serv, int reactor_id, int fd)
+{
+	swReactorThread *thread;
+	if (serv->factory_mode == SW_MODE_PROCESS && serv->dispatch_batch)
+	{
+		thread = &(serv->reactor_threads[reactor_id]);
+		swPackage_batch_flush(&(serv->factory), &(thread->batches[fd % thread->batch_num]));
+	}
+}
+
+int swReactorThread_onReceive_buffer_check_eof(swReactor *reactor, swEvent *event)
+{
+	int n, pos, buf_size;
+	swServer *serv = reactor->ptr;
+	swFactory *factory = &(serv->factory);
+	swConnection *conn = swServer_get_connection(serv, event->fd);
+	swString *buffer = swConnection_get_string_buffer(conn);
+	swPackage_batch local_batch, *batch;
+	swEventData send_data;
+	swDataHead info;
+	uint32_t offset, scan_offset, new_size;
+
+	if (buffer == NULL)
+	{
+		return SW_ERR;
+	}
+
+	recv_data:
+	//buffer已满, 需要扩容
+	if (swString_length(buffer) == buffer->size)
+	{
+		if (buffer->size >= serv->buffer_input_size)
+		{
+			swWarn("Package is too big. package_length=%d", (int) buffer->length);
+			goto close_fd;
+		}
+		new_size = MIN(buffer->size * 2, serv->buffer_input_size);
+		if (swString_extend(buffer, new_size) < 0)
+		{
+			goto close_fd;
+		}
+	}
+	buf_size = buffer->size - swString_length(buffer);
+	n = recv(event->fd, swString_ptr(buffer) + swString_length(buffer), buf_size, 0);
+	swReactorThread_stats_recv(serv, reactor->id, n);
+
+	swTrace("ReactorThread: recv[len=%d]", n);
+	if (n < 0)
+	{
+		if (swConnection_error(conn->fd, errno) < 0)
+		{
+			goto close_fd;
+		}
+		goto release_buffer;
+	}
+	else if (n == 0)
+	{
+		close_fd:
+		swTrace("Close Event.FD=%d|From=%d", event->fd, event->from_id);
+		swConnection_close(serv, event->fd, 1);
+		return SW_OK;
+	}
+	else
+	{
+		//update time
+		swConnection_idle_touch(serv, conn);
+
+		//EOF可能跨越两次recv, 从上次数据的末尾回退eof_len-1字节开始查找
+		scan_offset = buffer->length > serv->package_eof_len - 1 ? buffer->length - (serv->package_eof_len - 1) : 0;
+		buffer->length += n;
+
+		send_data.info.fd = event->fd;
+		send_data.info.from_id = event->from_id;
+		info.fd = event->fd;
+		info.from_id = event->from_id;
+		info.type = SW_EVENT_TCP;
+		info.from_fd = 0;
+		batch = swReactorThread_get_batch(serv, event->from_id, event->fd, &local_batch);
+
+		//找出所有EOF, 每个包单独投递, 包含EOF
+		offset = 0;
+		while ((pos = swoole_strnpos(buffer->str + scan_offset, buffer->length - scan_offset, serv->package_eof,
+				serv->package_eof_len)) >= 0)
+		{
+			scan_offset += pos + serv->package_eof_len;
+			swReactorThread_dispatch_batch(serv, batch, &send_data, &info, buffer->str + offset, scan_offset - offset);
+			offset = scan_offset;
+		}
+		if (batch == &local_batch)
+		{
+			swPackage_batch_flush(factory, batch);
+		}
+
+		//保留不完整的包,等待后续数据
+		if (offset > 0)
+		{
+			buffer->length -= offset;
+			if (buffer->length > 0)
+			{
+				memmove(buffer->str, buffer->str + offset, buffer->length);
+			}
+		}
+		//读满buffer了,可能还有数据. 边缘触发必须读到EAGAIN
+		if (n == buf_size || serv->enable_edge_trigger)
+		{
+			goto recv_data;
+		}
+	}
+
+	release_buffer:
+	//没有不完整的包, 归还buffer
+	if (swString_length(buffer) == 0)
+	{
+		swConnection_clear_string_buffer(conn);
+	}
+	return SW_OK;
+}
+
+/**
+ * 大包的剩余部分直接接收到recv_ring中, 已读到的部分只复制一次
+ */
+static int swReactorThread_recv_ring_start(swServer *serv, swConnection *conn, swConnectionInfo *cinfo, char *data, uint32_t length, uint32_t need)
+{
+	swRecvRing *ring = serv->recv_rings[conn->from_id];
+	int offset = swRecvRing_alloc(ring, need);
+	//环已满, 按原来的方式接收到string_buffer
+	if (offset < 0)
+	{
+		return SW_ERR;
+	}
+	memcpy(swRecvRing_data(ring, offset), data, length);
+	cinfo->ring_offset = offset;
+	cinfo->ring_length = need;
+	cinfo->ring_recv = length;
 	return SW_OK;
 }
 
-int swReactorThread_onReceive_buffer_check_eof(swReactor *reactor, swEvent *event)
+/**
+ * 返回SW_ERR关闭连接, 0为还没有接收完, 1为已投递给worker
+ */
+static int swReactorThread_recv_ring(swServer *serv, swReactor *reactor, swConnection *conn, swConnectionInfo *cinfo)
 {
-	int n, recv_again = SW_FALSE;
-	int isEOF = -1;
-	int buf_size;
+	swRecvRing *ring = serv->recv_rings[conn->from_id];
+	swPackage_batch local_batch;
+	swEventData send_data;
+	swPackage_view *view;
+	int n;
 
-	swServer *serv = SwooleG.serv;
-	//swDispatchData send_data;
-	swBuffer *buffer;
-	swBuffer_trunk *trunk;
+	n = recv(conn->fd, swRecvRing_data(ring, cinfo->ring_offset) + cinfo->ring_recv, cinfo->ring_length - cinfo->ring_recv, 0);
+	swReactorThread_stats_recv(serv, reactor->id, n);
+	if (n < 0)
+	{
+		return swConnection_error(conn->fd, errno) < 0 ? SW_ERR : 0;
+	}
+	else if (n == 0)
+	{
+		return SW_ERR;
+	}
+	swConnection_idle_touch(serv, conn);
+	cinfo->ring_recv += n;
+	if (cinfo->ring_recv < cinfo->ring_length)
+	{
+		return 0;
+	}
 
-	swConnection *conn = swServer_get_connection(serv, event->fd);
+	//合并中的小包在前
+	swPackage_batch_flush(&serv->factory, swReactorThread_get_batch(serv, reactor->id, conn->fd, &local_batch));
 
-	trunk = swConnection_get_in_buffer(conn);
-	if (trunk == NULL)
+	send_data.info.fd = conn->fd;
+	send_data.info.from_id = reactor->id;
+	send_data.info.from_fd = 0;
+	send_data.info.type = SW_EVENT_PACKAGE_VIEW;
+	send_data.info.len = sizeof(swPackage_view);
+	view = (swPackage_view *) send_data.data;
+	view->offset = cinfo->ring_offset;
+	view->length = cinfo->ring_length;
+	cinfo->ring_length = 0;
+
+	if (serv->factory.dispatch(&serv->factory, &send_data) < 0)
 	{
-		return swReactorThread_onReceive_no_buffer(reactor, event);
+		swRecvRing_release(ring, view->offset);
+		swWarn("factory->dispatch failed.");
 	}
+	return 1;
+}
+
+int swReactorThread_onReceive_buffer_check_length(swReactor *reactor, swEvent *event)
+{
+	int n, i, num, buf_size;
+	swServer *serv = reactor->ptr;
+	swFactory *factory = &(serv->factory);
+	swConnection *conn = swServer_get_connection(serv, event->fd);
+	swString *buffer = swConnection_get_string_buffer(conn);
+	swPackage_range packages[SW_PACKAGE_PARSE_MAX];
+	swPackage_batch local_batch, *batch;
+	swEventData send_data;
+	swDataHead info;
+	swConnectionInfo *cinfo = swServer_get_connection_info(serv, event->fd);
+	uint32_t need, new_size;
 
-	buffer = conn->in_buffer;
+	if (buffer == NULL)
+	{
+		return SW_ERR;
+	}
 
 	recv_data:
-	buf_size = buffer->trunk_size - trunk->length;
-
-#ifdef SW_USE_EPOLLET
-	n = swRead(event->fd,  trunk->data, SW_BUFFER_SIZE);
-#else
-	//level trigger
-	n = recv(event->fd,  trunk->data + trunk->length, buf_size, 0);
-#endif
+	if (cinfo->ring_length > 0)
+	{
+		n = swReactorThread_recv_ring(serv, reactor, conn, cinfo);
+		if (n < 0)
+		{
+			goto close_fd;
+		}
+		//投递完成后ET模式继续读后面的包
+		if (n > 0 && serv->enable_edge_trigger)
+		{
+			goto recv_data;
+		}
+		goto release_buffer;
+	}
+	buf_size = buffer->size - swString_length(buffer);
+	//非ET模式会持续通知
+	n = recv(event->fd, swString_ptr(buffer) + swString_length(buffer), buf_size, 0);
+	swReactorThread_stats_recv(serv, reactor->id, n);
 
-	swTrace("ReactorThread: recv[len=%d]", n);
 	if (n < 0)
 	{
 		if (swConnection_error(conn->fd, errno) < 0)
 		{
 			goto close_fd;
 		}
-		return SW_OK;
+		goto release_buffer;
 	}
 	else if (n == 0)
 	{
@@ -360,150 +1628,617 @@ int swReactorThread_onReceive_buffer_check_eof(swReactor *reactor, swEvent *even
 	}
 	else
 	{
-		//update time
-		conn->last_time =  SwooleGS->now;
+		swConnection_idle_touch(serv, conn);
+		buffer->length += n;
 
-		//读满buffer了,可能还有数据
-		if ((buffer->trunk_size - trunk->length) == n)
-		{
-			recv_again = SW_TRUE;
-		}
+		send_data.info.fd = event->fd;
+		send_data.info.from_id = event->from_id;
+		info.fd = event->fd;
+		info.from_id = event->from_id;
+		info.type = SW_EVENT_TCP;
+		info.from_fd = 0;
+		batch = swReactorThread_get_batch(serv, event->from_id, event->fd, &local_batch);
 
-		trunk->length += n;
-		buffer->length += n;
+		char *tmp_ptr = buffer->str;
+		uint32_t tmp_len = buffer->length;
 
-		//over max length, will discard
-		if (buffer->length > serv->buffer_input_size)
+		do
 		{
-			swWarn("Package is too big. package_length=%d", buffer->length);
-			goto close_fd;
+			//一次扫描出所有完整的包
+			num = serv->package_length_parser(serv, tmp_ptr, tmp_len, packages, SW_PACKAGE_PARSE_MAX, &need);
+			//协议长度不合法，越界或超过配置长度
+			if (num < 0)
+			{
+				swPackage_batch_flush(factory, batch);
+				goto close_fd;
+			}
+			for (i = 0; i < num; i++)
+			{
+				swReactorThread_dispatch_batch(serv, batch, &send_data, &info, tmp_ptr + packages[i].offset, packages[i].length);
+			}
+			if (num > 0)
+			{
+				n = packages[num - 1].offset + packages[num - 1].length;
+				tmp_ptr += n;
+				tmp_len -= n;
+			}
+		}
+		while (num == SW_PACKAGE_PARSE_MAX);
+		if (batch == &local_batch)
+		{
+			swPackage_batch_flush(factory, batch);
 		}
 
-		//printf("buffer[len=%d][n=%d]-----------------\n", trunk->length, n);
-		//((char *)trunk->data)[trunk->length] = 0; //for printf
-		//printf("buffer-----------------: %s|fd=%d|len=%d\n", (char *) trunk->data, event->fd, trunk->length);
-
-		//EOF_Check
-		isEOF = memcmp(trunk->data + trunk->length - serv->package_eof_len, serv->package_eof, serv->package_eof_len);
-		//printf("buffer ok. EOF=%s|Len=%d|RecvEOF=%s|isEOF=%d\n", serv->package_eof, serv->package_eof_len, (char *)trunk->data + trunk->length - serv->package_eof_len, isEOF);
-
-		//received EOF, will send package to worker
-		if (isEOF == 0)
+		//大包直接接收到recv_ring, 不再扩容buffer
+		if (serv->recv_rings != NULL && need > SW_BUFFER_SIZE && tmp_len < need
+				&& swReactorThread_recv_ring_start(serv, conn, cinfo, tmp_ptr, tmp_len, need) == SW_OK)
 		{
-			//printf("---------------------------EOF---------------------------\n");
-			swConnection_send_in_buffer(conn);
-			return SW_OK;
+			tmp_len = 0;
+		}
+		//保留不完整的包,等待后续数据
+		if (tmp_len > 0 && tmp_ptr != buffer->str)
+		{
+			memmove(buffer->str, tmp_ptr, tmp_len);
 		}
-		else if(recv_again)
+		buffer->length = tmp_len;
+		//包的长度超过buffer区,按2倍扩容, 至少能放下整个包
+		if (cinfo->ring_length == 0 && need > buffer->size)
 		{
-			trunk = swConnection_get_in_buffer(conn);
-			if (trunk)
+			new_size = buffer->size * 2 > serv->buffer_input_size ? serv->buffer_input_size : buffer->size * 2;
+			if (swString_extend(buffer, need > new_size ? need : new_size) < 0)
 			{
-				goto recv_data;
+				goto close_fd;
 			}
 		}
+		//边缘触发必须读到EAGAIN
+		if (serv->enable_edge_trigger)
+		{
+			goto recv_data;
+		}
+	}
+
+	release_buffer:
+	//没有不完整的包, 归还buffer
+	if (swString_length(buffer) == 0)
+	{
+		swConnection_clear_string_buffer(conn);
 	}
 	return SW_OK;
 }
 
-int swReactorThread_onReceive_no_buffer(swReactor *reactor, swEvent *event)
+/**
+ * 客户端的命令是bulk string数组或inline命令, 原样投递给worker, 可以直接转发给redis
+ */
+int swReactorThread_onReceive_redis(swReactor *reactor, swEvent *event)
 {
-	int ret, n;
+	int n, ret, buf_size;
 	swServer *serv = reactor->ptr;
 	swFactory *factory = &(serv->factory);
 	swConnection *conn = swServer_get_connection(serv, event->fd);
+	swString *buffer = swConnection_get_string_buffer(conn);
+	swPackage_batch local_batch, *batch;
+	swEventData send_data;
+	swDataHead info;
+	uint32_t offset, need, new_size;
 
-	struct
+	if (buffer == NULL)
 	{
-		/**
-		 * For Message Queue
-		 * 这里多一个long int 就可以直接插入到队列中，不需要内存拷贝
-		 */
-		long queue_type;
-		swEventData buf;
-	} rdata;
+		return SW_ERR;
+	}
+
+	recv_data:
+	//buffer已满, 需要扩容
+	if (swString_length(buffer) == buffer->size)
+	{
+		if (buffer->size >= serv->buffer_input_size)
+		{
+			swWarn("Package is too big. package_length=%d", (int) buffer->length);
+			goto close_fd;
+		}
+		new_size = buffer->size * 2 > serv->buffer_input_size ? serv->buffer_input_size : buffer->size * 2;
+		if (swString_extend(buffer, new_size) < 0)
+		{
+			goto close_fd;
+		}
+	}
+	buf_size = buffer->size - swString_length(buffer);
+	n = recv(event->fd, swString_ptr(buffer) + swString_length(buffer), buf_size, 0);
+	swReactorThread_stats_recv(serv, reactor->id, n);
 
-#ifdef SW_USE_EPOLLET
-	n = swRead(event->fd, rdata.buf.data, SW_BUFFER_SIZE);
-#else
-	//非ET模式会持续通知
-	n = recv(event->fd, rdata.buf.data, SW_BUFFER_SIZE, 0);
-#endif
 	if (n < 0)
 	{
 		if (swConnection_error(conn->fd, errno) < 0)
 		{
 			goto close_fd;
 		}
-		return SW_OK;
+		goto release_buffer;
 	}
-	//需要检测errno来区分是EAGAIN还是ECONNRESET
 	else if (n == 0)
 	{
 		close_fd:
-		swTrace("Close Event.FD=%d|From=%d|errno=%d", event->fd, event->from_id, errno);
+		swTrace("Close Event.FD=%d|From=%d", event->fd, event->from_id);
 		swConnection_close(serv, event->fd, 1);
 		return SW_OK;
 	}
 	else
 	{
-		swTrace("recv: %s|fd=%d|len=%d\n", rdata.buf.data, event->fd, n);
-		//更新最近收包时间
-		conn->last_time =  SwooleGS->now;
+		swConnection_idle_touch(serv, conn);
+		buffer->length += n;
 
-		//heartbeat ping package
-		if (serv->heartbeat_ping_length == n)
+		send_data.info.fd = event->fd;
+		send_data.info.from_id = event->from_id;
+		info.fd = event->fd;
+		info.from_id = event->from_id;
+		info.type = SW_EVENT_TCP;
+		info.from_fd = 0;
+		batch = swReactorThread_get_batch(serv, event->from_id, event->fd, &local_batch);
+
+		//pipeline的命令逐个投递
+		offset = 0;
+		while ((ret = swRedis_request_length(buffer->str + offset, buffer->length - offset, &need)) > 0)
 		{
-			if(serv->heartbeat_pong_length > 0)
+			swReactorThread_dispatch_batch(serv, batch, &send_data, &info, buffer->str + offset, ret);
+			offset += ret;
+		}
+		if (batch == &local_batch || ret < 0)
+		{
+			swPackage_batch_flush(factory, batch);
+		}
+		if (ret < 0)
+		{
+			swTrace("redis protocol error. fd=%d", event->fd);
+			goto close_fd;
+		}
+
+		//保留不完整的命令,等待后续数据
+		if (offset > 0)
+		{
+			buffer->length -= offset;
+			if (buffer->length > 0)
 			{
-				send(event->fd, serv->heartbeat_pong, serv->heartbeat_pong_length, 0);
+				memmove(buffer->str, buffer->str + offset, buffer->length);
+			}
+		}
+		//大的bulk string, 扩容到能放下整个命令
+		if (need > 0)
+		{
+			if (need > serv->buffer_input_size)
+			{
+				swWarn("Package is too big. package_length=%d", (int) need);
+				goto close_fd;
+			}
+			if (need > buffer->size && swString_extend(buffer, need) < 0)
+			{
+				goto close_fd;
+			}
+		}
+		//读满buffer了,可能还有数据. 边缘触发必须读到EAGAIN
+		if (n == buf_size || serv->enable_edge_trigger)
+		{
+			goto recv_data;
+		}
+	}
+
+	release_buffer:
+	//没有不完整的命令, 归还buffer
+	if (swString_length(buffer) == 0)
+	{
+		swConnection_clear_string_buffer(conn);
+	}
+	return SW_OK;
+}
+
+static void swReactorThread_http_error(int fd, int status)
+{
+	char buf[128];
+	char *reason;
+	int n;
+
+	switch (status)
+	{
+	case 413:
+		reason = "Request Entity Too Large";
+		break;
+	case 431:
+		reason = "Request Header Fields Too Large";
+		break;
+	case 501:
+		reason = "Not Implemented";
+		break;
+	case 505:
+		reason = "HTTP Version Not Supported";
+		break;
+	default:
+		status = 400;
+		reason = "Bad Request";
+		break;
+	}
+	n = snprintf(buf, sizeof(buf), "HTTP/1.1 %d %s\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", status, reason);
+	send(fd, buf, n, MSG_NOSIGNAL);
+}
+
+/**
+ * 请求行和头部只记录位置, 连同解码后的body一次复制到投递给worker的消息中
+ */
+static int swReactorThread_dispatch_http(swServer *serv, swPackage_batch *batch, swEventData *send_data,
+		swDataHead *info, swHttpRequest *req, char *request)
+{
+	char local[SW_BUFFER_SIZE];
+	char *message = local;
+	uint32_t header_size = swHttpRequest_size(req);
+	uint32_t length = header_size + req->header_length + req->content_length;
+	int ret;
+
+	if (length > sizeof(local))
+	{
+		message = sw_malloc(length);
+		if (message == NULL)
+		{
+			swWarn("malloc(%d) failed.", length);
+			return SW_ERR;
+		}
+	}
+	memcpy(message, req, header_size);
+	memcpy(message + header_size, request, req->header_length + req->content_length);
+	ret = swReactorThread_dispatch_batch(serv, batch, send_data, info, message, length);
+	if (message != local)
+	{
+		sw_free(message);
+	}
+	return ret;
+}
+
+/**
+ * 进程模式下与worker的响应共用out_buffer, 帧不会交错
+ */
+static int swReactorThread_websocket_send(swServer *serv, swConnection *conn, char *data, uint32_t length)
+{
+	if (serv->factory_mode == SW_MODE_PROCESS)
+	{
+		return swReactorThread_send_data(serv, conn, data, length, NULL);
+	}
+	return swWrite(conn->fd, data, length);
+}
+
+static int swReactorThread_websocket_reply(swServer *serv, swConnection *conn, uint8_t opcode, char *payload, uint32_t length)
+{
+	char frame[SW_WEBSOCKET_HEADER_MAX + SW_WEBSOCKET_CONTROL_MAX];
+	int n = swWebSocket_encode_header(frame, opcode, 1, length);
+
+	memcpy(frame + n, payload, length);
+	return swReactorThread_websocket_send(serv, conn, frame, n + length);
+}
+
+/**
+ * worker投递的消息负载, 协商了permessage-deflate且不小于websocket_compression_min_length时压缩
+ * 写入帧头并返回负载, 压缩后没有变小时发送原始数据
+ */
+static char* swReactorThread_websocket_frame(swServer *serv, swConnection *conn, uint8_t opcode, char *data,
+		uint32_t *length, char *header, int *header_length)
+{
+#ifdef SW_USE_ZLIB
+	swConnectionInfo *cinfo = swServer_get_connection_info(serv, conn->fd);
+	swString *out;
+
+	if (cinfo->websocket_compression > 0 && *length >= serv->websocket_compression_min_length
+			&& (out = swWebSocket_deflate(data, *length, cinfo->websocket_compression)) != NULL && out->length < *length)
+	{
+		*header_length = swWebSocket_encode_header(header, opcode, 1, out->length);
+		header[0] |= SW_WEBSOCKET_FLAG_RSV1;
+		*length = out->length;
+		return out->str;
+	}
+#endif
+	*header_length = swWebSocket_encode_header(header, opcode, 1, *length);
+	return data;
+}
+
+/**
+ * length不超过SW_BUFFER_SIZE, 完整的帧写入frame, 返回帧的长度
+ */
+static uint32_t swReactorThread_websocket_pack(swServer *serv, swConnection *conn, uint8_t flag, char *data,
+		uint32_t length, char *frame)
+{
+	int n;
+	char *payload = swReactorThread_websocket_frame(serv, conn, flag & 0x0f, data, &length, frame, &n);
+
+	memcpy(frame + n, payload, length);
+	return n + length;
+}
+
+/**
+ * flag为info.from_fd, 大消息不压缩时负载仍然从send_arena中发送
+ */
+static int swReactorThread_websocket_push(swServer *serv, swConnection *conn, uint8_t flag, char *data, uint32_t length,
+		swBuffer_shared *shared)
+{
+	char frame[SW_WEBSOCKET_HEADER_MAX + SW_BUFFER_SIZE];
+	char *payload;
+	int n;
+
+	if (length <= SW_BUFFER_SIZE)
+	{
+		return swReactorThread_send_data(serv, conn, frame, swReactorThread_websocket_pack(serv, conn, flag, data, length, frame), NULL);
+	}
+	payload = swReactorThread_websocket_frame(serv, conn, flag & 0x0f, data, &length, frame, &n);
+	if (payload != data)
+	{
+		shared = NULL;
+	}
+	//帧头和负载相邻追加, out_buffer中不会插入其他数据
+	if (swReactorThread_send_data(serv, conn, frame, n, NULL) < 0)
+	{
+		return SW_ERR;
+	}
+	//发送帧头时连接已关闭
+	if (!conn->active)
+	{
+		return SW_OK;
+	}
+	return swReactorThread_send_data(serv, conn, payload, length, shared);
+}
+
+/**
+ * 发送close帧后由调用者关闭连接, out_buffer中还有未发送完的帧时不能插入
+ */
+static void swReactorThread_websocket_close(swConnection *conn, uint16_t code)
+{
+	char frame[4];
+
+	if (conn->out_buffer != NULL && !swBuffer_empty(conn->out_buffer))
+	{
+		return;
+	}
+	swWebSocket_encode_header(frame, SW_WEBSOCKET_OPCODE_CLOSE, 1, 2);
+	frame[2] = code >> 8;
+	frame[3] = code & 0xff;
+	send(conn->fd, frame, sizeof(frame), MSG_NOSIGNAL);
+}
+
+/**
+ * 完成握手后连接改为按帧解析, 之后收到的数据都是WebSocket帧
+ */
+static int swReactorThread_websocket_handshake(swServer *serv, swConnection *conn, swHttpRequest *req, char *request)
+{
+	swConnectionInfo *cinfo = swServer_get_connection_info(serv, conn->fd);
+	char accept[SW_WEBSOCKET_ACCEPT_LEN + 1];
+	char response[384];
+	int n, deflate = 0;
+
+	if (swWebSocket_handshake(req, request, accept) < 0)
+	{
+		return SW_ERR;
+	}
+#ifdef SW_USE_ZLIB
+	//只有进程模式的响应经过reactor线程发送
+	deflate = cinfo->websocket_compression > 0 && serv->factory_mode == SW_MODE_PROCESS
+			&& swWebSocket_accept_deflate(req, request);
+#endif
+	if (!deflate)
+	{
+		cinfo->websocket_compression = 0;
+	}
+	n = snprintf(response, sizeof(response), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+			"Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n%s\r\n", accept, deflate ? SW_WEBSOCKET_DEFLATE_RESPONSE : "");
+	if (swReactorThread_websocket_send(serv, conn, response, n) < 0)
+	{
+		return SW_ERR;
+	}
+	conn->websocket_status = SW_WEBSOCKET_STATUS_ACTIVE;
+	return SW_OK;
+}
+
+static int swReactorThread_dispatch_websocket(swServer *serv, swPackage_batch *batch, swEventData *send_data,
+		swDataHead *info, uint8_t opcode, char *data, uint32_t length)
+{
+	int ret;
+	//worker按from_fd区分数据消息和HTTP请求
+	info->from_fd = opcode;
+	send_data->info.from_fd = opcode;
+	ret = swReactorThread_dispatch_batch(serv, batch, send_data, info, data, length);
+	info->from_fd = 0;
+	send_data->info.from_fd = 0;
+	return ret;
+}
+
+/**
+ * permessage-deflate压缩的消息解压后投递, 返回0或者需要关闭连接的状态码
+ */
+static int swReactorThread_dispatch_websocket_message(swServer *serv, swPackage_batch *batch, swEventData *send_data,
+		swDataHead *info, uint8_t opcode, uint8_t compressed, char *data, uint32_t length)
+{
+#ifdef SW_USE_ZLIB
+	swString *message;
+
+	if (compressed)
+	{
+		//解压的结果与未压缩的消息一样受buffer_input_size限制
+		message = swWebSocket_inflate(data, length, serv->buffer_input_size);
+		if (message == NULL)
+		{
+			if (errno == E2BIG)
+			{
+				return SW_WEBSOCKET_CLOSE_TOO_BIG;
 			}
-			return SW_OK;
+			return errno == EINVAL ? SW_WEBSOCKET_CLOSE_INVALID_DATA : SW_WEBSOCKET_CLOSE_SERVER_ERROR;
 		}
+		data = message->str;
+		length = message->length;
+	}
+#endif
+	swReactorThread_dispatch_websocket(serv, batch, send_data, info, opcode, data, length);
+	return 0;
+}
 
-		rdata.buf.info.fd = event->fd;
-		rdata.buf.info.len = n;
-		rdata.buf.info.type = SW_EVENT_TCP;
-		rdata.buf.info.from_id = event->from_id;
-
-		ret = factory->dispatch(factory, &rdata.buf);
-		//处理数据失败，数据将丢失
-		if (ret < 0)
+/**
+ * 从offset开始按帧解析, 就地解掩码, ping在这里回复pong, 分片合并后只投递完整的TEXT/BINARY消息
+ * 返回0表示等待更多数据, 大于0为需要回复close帧并关闭连接的状态码
+ */
+static int swReactorThread_onWebSocket(swServer *serv, swConnection *conn, swString *buffer, swPackage_batch *batch,
+		swEventData *send_data, swDataHead *info, uint32_t *offset, uint32_t *need)
+{
+	swConnectionInfo *cinfo = swServer_get_connection_info(serv, conn->fd);
+	swString *message;
+	swWebSocket_frame frame;
+	uint64_t frame_length, new_size;
+	char *payload;
+	int ret, code = 0;
+
+	while (*offset < buffer->length && code == 0)
+	{
+		ret = swWebSocket_decode_frame(&frame, buffer->str + *offset, buffer->length - *offset);
+		if (ret == SW_WEBSOCKET_AGAIN)
 		{
-			swWarn("factory->dispatch fail.errno=%d|sw_errno=%d", errno, sw_errno);
+			break;
 		}
-		if (sw_errno == SW_OK)
+		//客户端发送的帧必须带掩码, 协商了permessage-deflate时只有消息的第一帧可以设置RSV1
+		else if (ret < 0 || !frame.mask
+				|| (frame.compressed && (cinfo->websocket_compression == 0 || frame.opcode == SW_WEBSOCKET_OPCODE_CONTINUATION)))
 		{
-			return ret;
+			return SW_WEBSOCKET_CLOSE_PROTOCOL_ERROR;
+		}
+		frame_length = frame.header_length + frame.payload_length;
+		if (frame_length > serv->buffer_input_size)
+		{
+			return SW_WEBSOCKET_CLOSE_TOO_BIG;
+		}
+		if (buffer->length - *offset < frame_length)
+		{
+			*need = frame_length;
+			break;
+		}
+		payload = buffer->str + *offset + frame.header_length;
+		swWebSocket_unmask(payload, frame.payload_length, frame.mask_key);
+		*offset += frame_length;
+		message = cinfo->websocket_message;
+
+		switch (frame.opcode)
+		{
+		case SW_WEBSOCKET_OPCODE_PING:
+			swReactorThread_websocket_reply(serv, conn, SW_WEBSOCKET_OPCODE_PONG, payload, frame.payload_length);
+			break;
+		case SW_WEBSOCKET_OPCODE_PONG:
+			break;
+		case SW_WEBSOCKET_OPCODE_CLOSE:
+			if (frame.payload_length == 0)
+			{
+				code = SW_WEBSOCKET_CLOSE_NORMAL;
+				break;
+			}
+			code = frame.payload_length == 1 ? 0 : (((uint8_t) payload[0] << 8) | (uint8_t) payload[1]);
+			if (code < 1000 || code >= 5000)
+			{
+				code = SW_WEBSOCKET_CLOSE_PROTOCOL_ERROR;
+			}
+			break;
+		case SW_WEBSOCKET_OPCODE_CONTINUATION:
+			if (message == NULL)
+			{
+				return SW_WEBSOCKET_CLOSE_PROTOCOL_ERROR;
+			}
+			if (message->length + frame.payload_length > serv->buffer_input_size)
+			{
+				return SW_WEBSOCKET_CLOSE_TOO_BIG;
+			}
+			if (message->length + frame.payload_length > message->size)
+			{
+				new_size = message->size * 2;
+				if (new_size < message->length + frame.payload_length)
+				{
+					new_size = message->length + frame.payload_length;
+				}
+				if (swString_extend(message, new_size > serv->buffer_input_size ? serv->buffer_input_size : new_size) < 0)
+				{
+					return SW_WEBSOCKET_CLOSE_SERVER_ERROR;
+				}
+			}
+			memcpy(message->str + message->length, payload, frame.payload_length);
+			message->length += frame.payload_length;
+			if (frame.fin)
+			{
+				code = swReactorThread_dispatch_websocket_message(serv, batch, send_data, info, cinfo->websocket_opcode,
+						cinfo->websocket_compressed, message->str, message->length);
+				swString_free(message);
+				cinfo->websocket_message = NULL;
+			}
+			break;
+		default:
+			//上一个分片消息还未结束
+			if (message != NULL)
+			{
+				return SW_WEBSOCKET_CLOSE_PROTOCOL_ERROR;
+			}
+			if (frame.fin)
+			{
+				code = swReactorThread_dispatch_websocket_message(serv, batch, send_data, info, frame.opcode,
+						frame.compressed, payload, frame.payload_length);
+				break;
+			}
+			message = swString_new(frame.payload_length > SW_WEBSOCKET_FRAGMENT_INIT_SIZE ?
+					frame.payload_length : SW_WEBSOCKET_FRAGMENT_INIT_SIZE);
+			if (message == NULL)
+			{
+				return SW_WEBSOCKET_CLOSE_SERVER_ERROR;
+			}
+			memcpy(message->str, payload, frame.payload_length);
+			message->length = frame.payload_length;
+			cinfo->websocket_message = message;
+			cinfo->websocket_opcode = frame.opcode;
+			cinfo->websocket_compressed = frame.compressed;
+			break;
 		}
-		//缓存区还有数据没读完，继续读，EPOLL的ET模式
-//		else if (sw_errno == EAGAIN)
-//		{
-//			swWarn("sw_errno == EAGAIN");
-//			ret = swReactorThread_onReceive_no_buffer(reactor, event);
-//		}
-		return ret;
 	}
-	return SW_OK;
+	return code;
 }
 
-int swReactorThread_onReceive_buffer_check_length(swReactor *reactor, swEvent *event)
+/**
+ * HTTP/1.1: 按Content-Length或chunked分包, 支持keep-alive和pipeline
+ */
+int swReactorThread_onReceive_http(swReactor *reactor, swEvent *event)
 {
-	int ret, n, buf_size;
+	int n, ret, buf_size, status, close_code;
 	swServer *serv = reactor->ptr;
 	swFactory *factory = &(serv->factory);
 	swConnection *conn = swServer_get_connection(serv, event->fd);
 	swString *buffer = swConnection_get_string_buffer(conn);
+	swPackage_batch local_batch, *batch;
 	swEventData send_data;
+	swDataHead info;
+	char req_buf[sizeof(swHttpRequest) + SW_HTTP_HEADER_NUM * sizeof(swHttp_header)];
+	swHttpRequest *req = (swHttpRequest *) req_buf;
+	uint32_t offset, need, new_size, body_length, consumed;
+	char *request;
 
-	buf_size = buffer->size - swString_length(buffer);
+	if (buffer == NULL)
+	{
+		return SW_ERR;
+	}
 
-#ifdef SW_USE_EPOLLET
-	n = swRead(event->fd, swString_ptr(buffer), buf_size);
-#else
-	//非ET模式会持续通知
-	n = recv(event->fd, swString_ptr(buffer), buf_size, 0);
-#endif
+	recv_data:
+	//buffer已满, 需要扩容
+	if (swString_length(buffer) == buffer->size)
+	{
+		if (buffer->size >= serv->buffer_input_size)
+		{
+			if (conn->websocket_status)
+			{
+				swReactorThread_websocket_close(conn, SW_WEBSOCKET_CLOSE_TOO_BIG);
+			}
+			else
+			{
+				swReactorThread_http_error(event->fd, 413);
+			}
+			goto close_fd;
+		}
+		new_size = buffer->size * 2 > serv->buffer_input_size ? serv->buffer_input_size : buffer->size * 2;
+		if (swString_extend(buffer, new_size) < 0)
+		{
+			goto close_fd;
+		}
+	}
+	buf_size = buffer->size - swString_length(buffer);
+	n = recv(event->fd, swString_ptr(buffer) + swString_length(buffer), buf_size, 0);
+	swReactorThread_stats_recv(serv, reactor->id, n);
 
 	if (n < 0)
 	{
@@ -511,7 +2246,7 @@ int swReactorThread_onReceive_buffer_check_length(swReactor *reactor, swEvent *e
 		{
 			goto close_fd;
 		}
-		return SW_OK;
+		goto release_buffer;
 	}
 	else if (n == 0)
 	{
@@ -520,164 +2255,303 @@ int swReactorThread_onReceive_buffer_check_length(swReactor *reactor, swEvent *e
 		swConnection_close(serv, event->fd, 1);
 		return SW_OK;
 	}
-	else
-	{
-		conn->last_time = SwooleGS->now;
-		int package_length_offset = serv->package_length_offset;
-		uint8_t package_length_size = (serv->package_length_type & SW_NUM_INT) ? 4 : 2;
-		int64_t package_body_length;
-		buffer->length += n;
-
-		send_data.info.fd = event->fd;
-		send_data.info.from_id = event->from_id;
-
-		char *tmp_ptr = buffer->str;
-		int tmp_len = buffer->length;
 
-		do
+	swConnection_idle_touch(serv, conn);
+	buffer->length += n;
+
+	send_data.info.fd = event->fd;
+	send_data.info.from_id = event->from_id;
+	send_data.info.from_fd = 0;
+	info.fd = event->fd;
+	info.from_id = event->from_id;
+	info.type = SW_EVENT_TCP;
+	info.from_fd = 0;
+	batch = swReactorThread_get_batch(serv, event->from_id, event->fd, &local_batch);
+
+	offset = 0;
+	need = 0;
+	status = 0;
+	close_code = 0;
+	while (offset < buffer->length && conn->websocket_status == SW_WEBSOCKET_STATUS_NONE)
+	{
+		request = buffer->str + offset;
+		ret = swHttpRequest_parse(req, request, buffer->length - offset);
+		if (ret == SW_HTTP_AGAIN)
+		{
+			break;
+		}
+		else if (ret < 0)
+		{
+			status = req->status;
+			break;
+		}
+		if (req->chunked)
 		{
-			/*---------------------包头不足---------------------*/
-			if (tmp_len < package_length_offset + package_length_size)
+			ret = swHttpRequest_parse_chunked(request + req->header_length, buffer->length - offset - req->header_length, 0,
+					&body_length, &consumed);
+			if (ret < 0)
 			{
-				//wait more data
-				return SW_OK;
+				status = 400;
+				break;
 			}
-			/*--------------------计算包体长度---------------------*/
-			//sign int
-			if (serv->package_length_type & SW_NUM_SIGN)
+			else if (ret == SW_OK)
 			{
-				int *length_sign = (int *) (tmp_ptr + package_length_offset);
-				package_body_length = *length_sign;
+				swHttpRequest_parse_chunked(request + req->header_length, consumed, 1, &body_length, &consumed);
+				req->content_length = body_length;
+				need = req->header_length + consumed;
 			}
-			//unsigned
 			else
 			{
-				uint32_t *length_unsign = (uint32_t *)(tmp_ptr + package_length_offset);
-				package_body_length = *length_unsign;
+				need = 0;
 			}
-			//network byte order convert to host byte order
-			//字节序转换
-			if (serv->package_length_type & SW_NUM_NET)
+		}
+		else
+		{
+			need = req->header_length + req->content_length;
+			if (need > serv->buffer_input_size)
 			{
-				package_body_length = ntohl((uint32_t) package_body_length);
+				status = 413;
+				break;
 			}
-			//Length error
-			//协议长度不合法，越界或超过配置长度
-			if (package_body_length < 1 || package_body_length > serv->buffer_input_size)
+		}
+		if (need == 0 || buffer->length - offset < need)
+		{
+			//客户端等待100 Continue后才发送body
+			if (req->expect_continue && buffer->length - offset == req->header_length)
 			{
-				goto close_fd;
+				send(event->fd, SW_STRL("HTTP/1.1 100 Continue\r\n\r\n") - 1, MSG_NOSIGNAL);
+			}
+			break;
+		}
+		//握手在reactor线程完成, 升级请求不投递给worker
+		if (serv->open_websocket_protocol && swWebSocket_is_upgrade(req, request))
+		{
+			if (swReactorThread_websocket_handshake(serv, conn, req, request) < 0)
+			{
+				status = 400;
+				break;
 			}
-			/*-------------------isFinish check---------------------*/
-			//A complete package
+			offset += need;
+			need = 0;
+			break;
+		}
+		swReactorThread_dispatch_http(serv, batch, &send_data, &info, req, request);
+		offset += need;
+		need = 0;
+		//Connection: close之后的数据丢弃, 由worker回复后关闭连接
+		if (!req->keepalive)
+		{
+			offset = buffer->length;
+		}
+	}
+	if (status == 0 && conn->websocket_status == SW_WEBSOCKET_STATUS_ACTIVE)
+	{
+		close_code = swReactorThread_onWebSocket(serv, conn, buffer, batch, &send_data, &info, &offset, &need);
+	}
+	if (batch == &local_batch)
+	{
+		swPackage_batch_flush(factory, batch);
+	}
+	if (status > 0)
+	{
+		swReactorThread_batch_flush(serv, event->from_id, event->fd);
+		swReactorThread_http_error(event->fd, status);
+		goto close_fd;
+	}
+	if (close_code > 0)
+	{
+		swReactorThread_batch_flush(serv, event->from_id, event->fd);
+		swReactorThread_websocket_close(conn, close_code);
+		goto close_fd;
+	}
 
-			int package_length = serv->package_body_start + package_body_length;  //total package length
+	//保留不完整的请求,等待后续数据
+	if (offset > 0)
+	{
+		buffer->length -= offset;
+		if (buffer->length > 0)
+		{
+			memmove(buffer->str, buffer->str + offset, buffer->length);
+		}
+	}
+	//请求超过buffer区, 扩容到至少能放下整个请求
+	if (need > buffer->size && swString_extend(buffer, need) < 0)
+	{
+		goto close_fd;
+	}
+	//边缘触发必须读到EAGAIN
+	if (n == buf_size || serv->enable_edge_trigger)
+	{
+		goto recv_data;
+	}
 
-			//printf("package_length=%d|body_len=%ld|tmp_len=%d|tmp_ptr=%p\n", package_length, package_body_length, tmp_len, tmp_ptr);
+	release_buffer:
+	//没有不完整的请求, 归还buffer
+	if (swString_length(buffer) == 0)
+	{
+		swConnection_clear_string_buffer(conn);
+	}
+	return SW_OK;
+}
 
-			if (package_length <= tmp_len)
-			{
-				//超过SW_BUFFER_SIZE
-				if(package_length > SW_BUFFER_SIZE)
-				{
-					int send_n = package_length;
-					send_data.info.type = SW_EVENT_PACKAGE_START;
-					void *send_ptr = tmp_ptr;
-					do
-					{
-						if (send_n > SW_BUFFER_SIZE)
-						{
-							send_data.info.len = SW_BUFFER_SIZE;
-							memcpy(send_data.data, send_ptr, SW_BUFFER_SIZE);
-						}
-						else
-						{
-							send_data.info.type = SW_EVENT_PACKAGE_END;
-							send_data.info.len = send_n;
-							memcpy(send_data.data, send_ptr, send_n);
-						}
-						ret = factory->dispatch(factory, &send_data);
-						//处理数据失败，数据将丢失
-						if (ret < 0)
-						{
-							swWarn("factory->dispatch failed.");
-						}
-						send_n -= SW_BUFFER_SIZE;
-						send_ptr += send_data.info.len;
-						//转为trunk
-						if (send_data.info.type == SW_EVENT_PACKAGE_START)
-						{
-							send_data.info.type = SW_EVENT_PACKAGE_TRUNK;
-						}
-					}
-					while (send_n > 0);
-				}
-				else
-				{
-					memcpy(send_data.data, tmp_ptr, package_length);
-					send_data.info.len = package_length;
-					send_data.info.type = SW_EVENT_TCP;
-					ret = factory->dispatch(factory, &send_data);
-					if (ret < 0)
-					{
-						swWarn("factory->dispatch failed.");
-					}
-				}
-				tmp_len -= package_length;
-				tmp_ptr += package_length;
-			}
-			//wait more data
-			//继续等待数据
-			else
-			{
-				//包的长度超过buffer区,需要扩容
-				if(package_length > buffer->size + package_length_offset)
-				{
-					swString_extend(buffer, package_length + package_length_offset);
-				}
-				return SW_OK;
-			}
+/**
+ * 放入关闭队列, 由当前reactor线程在onFinish中投递, 队列满时扩容
+ */
+int swReactorThread_close_queue_add(swServer *serv, int reactor_id, int fd)
+{
+	swCloseQueue *queue;
+	int *events;
+	int size;
+
+	//在其他reactor线程中关闭时放入当前线程的队列
+	if (SwooleTG.type == SW_THREAD_REACTOR)
+	{
+		reactor_id = SwooleTG.id;
+	}
+	queue = &serv->reactor_threads[reactor_id].close_queue;
+	if (queue->num == queue->size)
+	{
+		size = queue->size == 0 ? SW_CLOSE_QLEN : queue->size * 2;
+		events = sw_realloc(queue->events, sizeof(int) * size);
+		if (events == NULL)
+		{
+			swWarn("realloc for close queue failed. size=%d", size);
+			return SW_ERR;
 		}
-		while (tmp_len > 0);
+		queue->events = events;
+		queue->size = size;
 	}
+	queue->events[queue->num++] = fd;
 	return SW_OK;
 }
 
+/**
+ * 关闭的fd每SW_CLOSE_QLEN个作为一条记录写入无锁队列, 主线程未被唤醒时再写main_pipe唤醒
+ * 无锁队列满时留在close_queue中, 下一轮再投递, 不阻塞reactor线程
+ */
 int swReactorThread_close_queue(swReactor *reactor, swCloseQueue *close_queue)
 {
 	swServer *serv = reactor->ptr;
+	swReactorThread *thread = &serv->reactor_threads[reactor->id];
+	int wakeup = -(reactor->id + 1);
+	int n, offset = 0;
 	int ret;
-	while (1)
+
+	while (offset < close_queue->num)
 	{
-		ret = serv->main_pipe.write(&(serv->main_pipe), close_queue->events, sizeof(int) * close_queue->num);
-		if (ret < 0)
+		n = close_queue->num - offset;
+		if (n > SW_CLOSE_QLEN)
 		{
-			//close事件缓存区满了，必须阻塞写入
-			if (errno == EAGAIN && close_queue->num == SW_CLOSE_QLEN)
-			{
-				//切换一次进程
-				swYield();
-				continue;
-			}
-			else if (errno == EINTR)
-			{
-				continue;
-			}
+			n = SW_CLOSE_QLEN;
 		}
-		break;
+		if (swRingBuffer_push(thread->close_ring, close_queue->events + offset, sizeof(int) * n) < 0)
+		{
+			break;
+		}
+		offset += n;
+	}
+	if (offset == 0)
+	{
+		return SW_OK;
+	}
+	close_queue->num -= offset;
+	if (close_queue->num > 0)
+	{
+		memmove(close_queue->events, close_queue->events + offset, sizeof(int) * close_queue->num);
+	}
+	//每个reactor线程在main_pipe中最多一个唤醒消息, 管道不会满
+	if (!sw_atomic_cmp_set(&thread->close_notified, 0, 1))
+	{
+		return SW_OK;
+	}
+	do
+	{
+		ret = serv->main_pipe.write(&(serv->main_pipe), &wakeup, sizeof(wakeup));
 	}
+	while (ret < 0 && errno == EINTR);
 	if (ret < 0)
 	{
+		thread->close_notified = 0;
 		swWarn("write to main_pipe failed. Error: %s[%d]", strerror(errno), errno);
 		return SW_ERR;
 	}
-	bzero(close_queue, sizeof(swCloseQueue));
 	return SW_OK;
 }
 
+/**
+ * 开启dispatch_batch时关闭通知追加到本线程的合并缓存, 和之前的数据包一起在onFinish中投递
+ */
+int swReactorThread_batch_notify(swServer *serv, int reactor_id, swDataHead *ev)
+{
+	swReactorThread *thread;
+
+	if (serv->factory_mode == SW_MODE_PROCESS && serv->dispatch_batch
+			&& SwooleTG.type == SW_THREAD_REACTOR && SwooleTG.id == reactor_id)
+	{
+		thread = &(serv->reactor_threads[reactor_id]);
+		ev->len = 0;
+		return swPackage_batch_add(&(serv->factory), &(thread->batches[ev->fd % thread->batch_num]), ev, "");
+	}
+	swReactorThread_batch_flush(serv, reactor_id, ev->fd);
+	return SwooleG.factory->notify(SwooleG.factory, ev);
+}
+
+/**
+ * 从空闲链表头部开始关闭超时的连接,只需要遍历已超时的部分
+ */
+void swReactorThread_idle_check(swReactor *reactor)
+{
+	swServer *serv = reactor->ptr;
+	swReactorThread *thread = &serv->reactor_threads[reactor->id];
+	swConnection *conn;
+	time_t checktime;
+	int fd;
+
+	if (!swServer_heartbeat_enable(serv) || swClock_now() - thread->idle_check_time < serv->heartbeat_check_interval)
+	{
+		return;
+	}
+	thread->idle_check_time = swClock_now();
+	checktime = swClock_now() - serv->heartbeat_idle_time;
+
+	while (1)
+	{
+		thread->lock.lock(&thread->lock);
+		fd = thread->idle_head;
+		thread->lock.unlock(&thread->lock);
+		if (fd == 0)
+		{
+			break;
+		}
+		conn = &serv->connection_list[fd];
+		if (conn->last_time >= checktime)
+		{
+			break;
+		}
+		swTrace("idle timeout. fd=%d|last_time=%d", fd, (int) conn->last_time);
+		swConnection_close(serv, fd, 1);
+	}
+}
+
 static void swReactorThread_onFinish(swReactor *reactor)
 {
 	swServer *serv = reactor->ptr;
-	swCloseQueue *queue = &serv->reactor_threads[reactor->id].close_queue;
+	swReactorThread *thread = &serv->reactor_threads[reactor->id];
+	swCloseQueue *queue = &thread->close_queue;
+	int i;
+	//投递本轮事件循环合并的数据包
+	for (i = 0; i < thread->batch_num; i++)
+	{
+		swPackage_batch_flush(&(serv->factory), &(thread->batches[i]));
+	}
+	//检测空闲连接
+	swReactorThread_idle_check(reactor);
+	//由第一个reactor线程归还连接表中空闲块的物理内存
+	if (reactor->id == 0 && swClock_now() - serv->connection_release_time >= SW_CONNECTION_RELEASE_INTERVAL)
+	{
+		serv->connection_release_time = swClock_now();
+		swConnection_chunk_release(serv);
+	}
 	//打开关闭队列
 	if (queue->num > 0)
 	{
@@ -706,8 +2580,8 @@ int swReactorThread_start(swServer *serv, swReactor *main_reactor_ptr)
 			return SW_ERR;
 		}
 	}
-	//listen TCP
-	if (serv->have_tcp_sock == 1)
+	//listen TCP, SO_REUSEPORT模式下UDP也由reactor线程读取
+	if (serv->have_tcp_sock == 1 || serv->enable_reuse_port)
 	{
 		//listen server socket
 		ret = swServer_listen(serv, main_reactor_ptr);
@@ -728,6 +2602,7 @@ int swReactorThread_start(swServer *serv, swReactor *main_reactor_ptr)
 			param->object = serv;
 			param->pti = i;
 
+			swReady_add(serv->ready, 1);
 			if(pthread_create(&pidt, NULL, (void * (*)(void *)) swReactorThread_loop, (void *) param) < 0)
 			{
 				swError("pthread_create[tcp_reactor] failed. Error: %s[%d]", strerror(errno), errno);
@@ -741,8 +2616,6 @@ int swReactorThread_start(swServer *serv, swReactor *main_reactor_ptr)
 	{
 		main_reactor_ptr->add(main_reactor_ptr, SwooleG.timer.fd, SW_FD_TIMER);
 	}
-	//wait poll thread
-	SW_START_SLEEP;
 	return SW_OK;
 }
 
@@ -756,21 +2629,11 @@ static int swReactorThread_loop(swThreadParam *param)
 	int pti = param->pti;
 
 	swReactor *reactor = &(serv->reactor_threads[pti].reactor);
+	swReactor_handle onReceive;
 	struct timeval timeo;
 
 	//cpu affinity setting
-#if HAVE_CPU_AFFINITY
-	if(serv->open_cpu_affinity)
-	{
-		cpu_set_t cpu_set;
-		CPU_ZERO(&cpu_set);
-		CPU_SET(pti % SW_CPU_NUM, &cpu_set);
-		if(0 != pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set))
-		{
-			swWarn("pthread_setaffinity_np set failed");
-		}
-	}
-#endif
+	swServer_set_cpu_affinity(serv, 1, pti);
 
 	ret = swReactor_auto(reactor, SW_REACTOR_MAXEVENTS);
 	if (ret < 0)
@@ -778,12 +2641,51 @@ static int swReactorThread_loop(swThreadParam *param)
 		return SW_ERR;
 	}
 
+	//trunk pool, only used by this thread
+	if (swBufferPool_create(swServer_get_buffer_pool(serv, pti), SW_BUFFER_POOL_MEMORY) < 0)
+	{
+		return SW_ERR;
+	}
+	serv->reactor_threads[pti].input_buffer_num = 0;
+	if (swFileCache_create(&(serv->reactor_threads[pti].file_cache)) < 0)
+	{
+		return SW_ERR;
+	}
+	serv->reactor_threads[pti].close_ring = swRingBuffer_create(SW_CLOSE_RING_SIZE, 0);
+	if (serv->reactor_threads[pti].close_ring == NULL)
+	{
+		return SW_ERR;
+	}
+	//按fd分配时每个worker一个合并缓存
+	if (serv->factory_mode == SW_MODE_PROCESS && serv->dispatch_batch)
+	{
+		swReactorThread *thread = &(serv->reactor_threads[pti]);
+		int i;
+		thread->batch_num = (serv->dispatch_mode == SW_DISPATCH_FDMOD) ? serv->worker_num : 1;
+		thread->batches = sw_malloc(sizeof(swPackage_batch) * thread->batch_num);
+		if (thread->batches == NULL)
+		{
+			swWarn("malloc for dispatch batch failed.");
+			return SW_ERR;
+		}
+		for (i = 0; i < thread->batch_num; i++)
+		{
+			swPackage_batch_init(&(thread->batches[i]), 0, pti);
+		}
+	}
+
 	swSignal_none();
 
+	SwooleTG.type = SW_THREAD_REACTOR;
+	SwooleTG.id = pti;
+
 	timeo.tv_sec = serv->timeout_sec;
 	timeo.tv_usec = serv->timeout_usec; //300ms
 	reactor->ptr = serv;
 	reactor->id = pti;
+	serv->reactor_threads[pti].proxies = NULL;
+	reactor->slow_usec = serv->slow_callback_usec;
+	reactor->slow_count = serv->reactor_stats ? &serv->reactor_stats[pti].slow_count : NULL;
 
 	reactor->onFinish = swReactorThread_onFinish;
 	reactor->onTimeout = swReactorThread_onTimeout;
@@ -791,11 +2693,40 @@ static int swReactorThread_loop(swThreadParam *param)
 	reactor->setHandle(reactor, SW_FD_UDP, swReactorThread_onPackage);
 	reactor->setHandle(reactor, SW_FD_SEND_TO_CLIENT, swFactoryProcess_send2client);
 	reactor->setHandle(reactor, SW_FD_TCP | SW_EVENT_WRITE, swReactorThread_onWrite);
+	reactor->setHandle(reactor, SW_FD_PROXY, swProxy_onRead);
+	reactor->setHandle(reactor, SW_FD_PROXY | SW_EVENT_WRITE, swProxy_onWrite);
+#ifdef SW_USE_OPENSSL
+	reactor->setHandle(reactor, SW_FD_SSL, swReactorThread_onHandshake);
+	reactor->setHandle(reactor, SW_FD_SSL | SW_EVENT_WRITE, swReactorThread_onHandshake);
+#endif
+
+	//SO_REUSEPORT, 由本线程accept
+	if (serv->enable_reuse_port)
+	{
+		swListenList_node *listen_host;
+		reactor->setHandle(reactor, SW_FD_LISTEN, swServer_master_onAccept);
+		LL_FOREACH(serv->listen_list, listen_host)
+		{
+			if (listen_host->reuse_socks == NULL)
+			{
+				continue;
+			}
+			//UDP端口由本线程recvmmsg读取
+			if (listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6)
+			{
+				reactor->add(reactor, listen_host->reuse_socks[pti], SW_FD_UDP);
+			}
+			else
+			{
+				reactor->add(reactor, listen_host->reuse_socks[pti], SW_FD_LISTEN);
+			}
+		}
+	}
 
-#if SW_WORKER_IPC_MODE == 1
+#if SW_WORKER_IPC_MODE != 2
 	int i, worker_id;
-	//worker进程绑定reactor
-	for (i = 0; i < serv->reactor_pipe_num; i++)
+	//worker进程绑定reactor, 线程模式没有worker进程
+	for (i = 0; serv->factory_mode == SW_MODE_PROCESS && i < serv->reactor_pipe_num; i++)
 	{
 		worker_id = (reactor->id * serv->reactor_pipe_num) + i;
 		//swWarn("reactor_id=%d|worker_id=%d", reactor->id, worker_id);
@@ -807,16 +2738,32 @@ static int swReactorThread_loop(swThreadParam *param)
 	//will free after onFinish
 	if (serv->open_eof_check == 1)
 	{
-		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_buffer_check_eof);
+		onReceive = swReactorThread_onReceive_buffer_check_eof;
 	}
 	else if(serv->open_length_check == 1)
 	{
-		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_buffer_check_length);
+		onReceive = swReactorThread_onReceive_buffer_check_length;
+	}
+	else if (serv->open_http_protocol == 1)
+	{
+		onReceive = swReactorThread_onReceive_http;
+	}
+	else if (serv->open_redis_protocol == 1)
+	{
+		onReceive = swReactorThread_onReceive_redis;
 	}
 	else
 	{
-		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_no_buffer);
+		onReceive = swReactorThread_onReceive_no_buffer;
+	}
+	//过载保护在读取前检查, 不影响没有开启时的路径
+	if (serv->overload_target_usec > 0)
+	{
+		swReactorThread_onReceive_admitted = onReceive;
+		onReceive = swReactorThread_onReceive_admit;
 	}
+	reactor->setHandle(reactor, SW_FD_TCP, onReceive);
+	swReady_done(serv->ready);
 	//main loop
 	reactor->wait(reactor, &timeo);
 	//shutdown
@@ -834,10 +2781,10 @@ static int swUDPThread_start(swServer *serv)
 	LL_FOREACH(serv->listen_list, listen_host)
 	{
 		param = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(swThreadParam));
-		//UDP
-		if (listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6)
+		//UDP, SO_REUSEPORT模式下由reactor线程读取
+		if ((listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6) && listen_host->reuse_socks == NULL)
 		{
-			serv->connection_list[listen_host->sock].addr.sin_port = listen_host->port;
+			serv->connection_info[listen_host->sock].addr.sin_port = listen_host->port;
 			param->object = serv;
 			param->pti = listen_host->sock;
 
@@ -858,40 +2805,22 @@ static int swUDPThread_start(swServer *serv)
  */
 static void swUDPThread_loop(swThreadParam *param)
 {
-	int ret;
 	swServer *serv = param->object;
 
-	swEventData buf;
-	struct sockaddr_in addr;
-	socklen_t addrlen = sizeof(addr);
-
 	//使用pti保存fd
 	int sock = param->pti;
 
 	//阻塞读取UDP
 	swSetBlock(sock);
 
-	bzero(&buf.info, sizeof(buf.info));
-	buf.info.from_fd = sock;
-
 	while (SwooleG.running == 1)
 	{
-		ret = recvfrom(sock, buf.data, SW_BUFFER_SIZE, 0, (struct sockaddr *)&addr, &addrlen);
-		if (ret > 0)
-		{
-			buf.info.len = ret;
-			buf.info.type = SW_EVENT_UDP;
-			//UDP的from_id是PORT，FD是IP
-			buf.info.from_id = ntohs(addr.sin_port); //转换字节序
-			buf.info.fd = addr.sin_addr.s_addr;
-
-			swTrace("recvfrom udp socket.fd=%d|data=%s", sock, buf.data);
-			ret = serv->factory.dispatch(&serv->factory, &buf);
-			if (ret < 0)
-			{
-				swWarn("factory->dispatch[udp packet] fail\n");
-			}
-		}
+#ifdef HAVE_RECVMMSG
+		//阻塞到第一个包到达, 然后读取所有已到达的包
+		swReactorThread_udp_recv(serv, sock, MSG_WAITFORONE);
+#else
+		swReactorThread_udp_recv(serv, sock, 0);
+#endif
 	}
 	pthread_exit(0);
 }
@@ -0,0 +1,803 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "redis.h"
+
+#include <netinet/tcp.h>
+
+static swHashMap_int swoole_redis_clients;   //fd -> swRedis_client
+
+static swRedis_client* swRedis_client_connect(swRedis_pool *pool);
+static void swRedis_client_close(swRedis_client *cli, char *error);
+static void swRedis_client_fail(swRedis_client *cli);
+static void swRedis_client_free(swRedis_client *cli);
+static int swRedis_client_append(swRedis_client *cli, swRedis_command *command);
+static int swRedis_client_flush(swRedis_client *cli);
+static swRedis_client* swRedis_pool_select(swRedis_pool *pool);
+static void swRedis_pool_destroy(swRedis_pool *pool);
+static int swRedis_onRead(swReactor *reactor, swEvent *event);
+static int swRedis_onWrite(swReactor *reactor, swEvent *event);
+static void swRedis_onTimeout(swTimer *timer, swTimer_node *node);
+
+/**
+ * 解析[p, end)中的十进制整数, end是\r的位置
+ */
+static int swRedis_parse_int(char *p, char *end, int64_t *value)
+{
+	int negative = 0;
+	int64_t v = 0;
+
+	if (p < end && *p == '-')
+	{
+		negative = 1;
+		p++;
+	}
+	if (p == end)
+	{
+		return SW_ERR;
+	}
+	for (; p < end; p++)
+	{
+		if (*p < '0' || *p > '9' || v > (INT64_MAX - 9) / 10)
+		{
+			return SW_ERR;
+		}
+		v = v * 10 + (*p - '0');
+	}
+	*value = negative ? -v : v;
+	return SW_OK;
+}
+
+int swRedis_reply_length(char *data, uint32_t length, uint32_t *need, uint32_t *node_num)
+{
+	//每一层数组还没有扫描的元素数量
+	uint32_t remain[SW_REDIS_MAX_DEPTH];
+	uint32_t offset = 0, num = 0;
+	int depth = 0;
+	int64_t value;
+	char *line, *eol;
+
+	remain[0] = 1;
+	*need = 0;
+	while (1)
+	{
+		line = data + offset;
+		eol = memchr(line, '\n', length - offset);
+		if (eol == NULL)
+		{
+			return length - offset > SW_REDIS_LINE_MAX ? SW_ERR : 0;
+		}
+		if (eol - line < 2 || eol[-1] != '\r')
+		{
+			return SW_ERR;
+		}
+		offset = eol + 1 - data;
+		num++;
+		remain[depth]--;
+
+		switch (line[0])
+		{
+		case '+':
+		case '-':
+			break;
+		case ':':
+			if (swRedis_parse_int(line + 1, eol - 1, &value) < 0)
+			{
+				return SW_ERR;
+			}
+			break;
+		case '$':
+			if (swRedis_parse_int(line + 1, eol - 1, &value) < 0 || value < -1 || value > SW_REDIS_BULK_MAX)
+			{
+				return SW_ERR;
+			}
+			if (value >= 0)
+			{
+				if (length - offset < value + 2)
+				{
+					*need = offset + value + 2;
+					return 0;
+				}
+				if (data[offset + value] != '\r' || data[offset + value + 1] != '\n')
+				{
+					return SW_ERR;
+				}
+				offset += value + 2;
+			}
+			break;
+		case '*':
+			if (swRedis_parse_int(line + 1, eol - 1, &value) < 0 || value < -1 || value > SW_REDIS_MAX_ELEMENTS)
+			{
+				return SW_ERR;
+			}
+			if (value > 0)
+			{
+				if (++depth == SW_REDIS_MAX_DEPTH)
+				{
+					return SW_ERR;
+				}
+				remain[depth] = value;
+				continue;
+			}
+			break;
+		default:
+			return SW_ERR;
+		}
+		//当前层扫描完, 回到上一层
+		while (remain[depth] == 0)
+		{
+			if (depth == 0)
+			{
+				*node_num = num;
+				return offset;
+			}
+			depth--;
+		}
+	}
+	return SW_ERR;
+}
+
+int swRedis_request_length(char *data, uint32_t length, uint32_t *need)
+{
+	uint32_t node_num;
+	char *eol;
+
+	*need = 0;
+	if (length == 0)
+	{
+		return 0;
+	}
+	if (data[0] == '*')
+	{
+		return swRedis_reply_length(data, length, need, &node_num);
+	}
+	//inline命令, 例如telnet
+	eol = memchr(data, '\n', length);
+	if (eol == NULL)
+	{
+		return length > SW_REDIS_LINE_MAX ? SW_ERR : 0;
+	}
+	return eol - data + 1;
+}
+
+/**
+ * 数组的元素从next中连续分配, 返回下一个值的位置
+ */
+static char* swRedis_reply_build(char *p, swRedis_reply *reply, swRedis_reply **next)
+{
+	char *eol = p;
+	int64_t value = 0;
+	uint32_t i;
+
+	while (*eol != '\n')
+	{
+		eol++;
+	}
+	bzero(reply, sizeof(swRedis_reply));
+	switch (p[0])
+	{
+	case '+':
+	case '-':
+		reply->type = p[0] == '+' ? SW_REDIS_REPLY_STATUS : SW_REDIS_REPLY_ERROR;
+		reply->str = p + 1;
+		reply->len = eol - 1 - reply->str;
+		return eol + 1;
+	case ':':
+		reply->type = SW_REDIS_REPLY_INTEGER;
+		swRedis_parse_int(p + 1, eol - 1, &reply->integer);
+		return eol + 1;
+	case '$':
+		swRedis_parse_int(p + 1, eol - 1, &value);
+		if (value < 0)
+		{
+			reply->type = SW_REDIS_REPLY_NIL;
+			return eol + 1;
+		}
+		reply->type = SW_REDIS_REPLY_STRING;
+		reply->str = eol + 1;
+		reply->len = value;
+		return eol + 1 + value + 2;
+	default:
+		swRedis_parse_int(p + 1, eol - 1, &value);
+		if (value < 0)
+		{
+			reply->type = SW_REDIS_REPLY_NIL;
+			return eol + 1;
+		}
+		reply->type = SW_REDIS_REPLY_ARRAY;
+		reply->element_num = value;
+		reply->elements = *next;
+		*next += value;
+		p = eol + 1;
+		for (i = 0; i < reply->element_num; i++)
+		{
+			p = swRedis_reply_build(p, &reply->elements[i], next);
+		}
+		return p;
+	}
+}
+
+void swRedis_reply_parse(char *data, swRedis_reply *nodes)
+{
+	swRedis_reply *next = nodes + 1;
+	swRedis_reply_build(data, nodes, &next);
+}
+
+static int swRedis_string_reserve(swString *str, uint32_t length)
+{
+	size_t size = str->size;
+	if (str->length + length <= size)
+	{
+		return SW_OK;
+	}
+	while (size < str->length + length)
+	{
+		size *= 2;
+	}
+	return swString_extend(str, size);
+}
+
+swRedis_pool* swRedis_pool_new(swReactor *reactor, char *host, int port, char *password, int database, int size)
+{
+	swRedis_pool *pool;
+	struct hostent *host_entry;
+
+	if (strlen(password) >= SW_REDIS_PASSWORD_MAX)
+	{
+		swWarn("redis password is too long.");
+		return NULL;
+	}
+	pool = sw_malloc(sizeof(swRedis_pool));
+	if (pool == NULL)
+	{
+		swWarn("malloc for swRedis_pool failed.");
+		return NULL;
+	}
+	bzero(pool, sizeof(swRedis_pool));
+
+	if (host[0] == '/')
+	{
+		if (strlen(host) >= sizeof(pool->unix_addr.sun_path))
+		{
+			swWarn("unix socket path[%s] is too long.", host);
+			sw_free(pool);
+			return NULL;
+		}
+		pool->sock_domain = AF_UNIX;
+		pool->unix_addr.sun_family = AF_UNIX;
+		strcpy(pool->unix_addr.sun_path, host);
+	}
+	else
+	{
+		pool->sock_domain = AF_INET;
+		pool->addr.sin_family = AF_INET;
+		pool->addr.sin_port = htons(port > 0 ? port : SW_REDIS_DEFAULT_PORT);
+		//只在创建时解析一次
+		if (!inet_aton(host, &pool->addr.sin_addr))
+		{
+			host_entry = gethostbyname(host);
+			if (host_entry == NULL || host_entry->h_addrtype != AF_INET)
+			{
+				swWarn("gethostbyname(%s) failed.", host);
+				sw_free(pool);
+				return NULL;
+			}
+			memcpy(&pool->addr.sin_addr, host_entry->h_addr_list[0], host_entry->h_length);
+		}
+	}
+	strcpy(pool->password, password);
+	pool->database = database;
+	pool->size = size > 0 ? size : SW_REDIS_POOL_SIZE;
+	pool->reactor = reactor;
+
+	reactor->setHandle(reactor, SW_FD_REDIS | SW_EVENT_READ, swRedis_onRead);
+	reactor->setHandle(reactor, SW_FD_REDIS | SW_EVENT_WRITE, swRedis_onWrite);
+	return pool;
+}
+
+int swRedis_pool_command(swRedis_pool *pool, swRedis_command *command)
+{
+	swRedis_client *cli;
+
+	if (pool->destroy || command->argc <= 0)
+	{
+		return SW_ERR;
+	}
+	cli = swRedis_pool_select(pool);
+	if (cli == NULL)
+	{
+		return SW_ERR;
+	}
+	return swRedis_client_append(cli, command);
+}
+
+/**
+ * 所有连接都在等待回复时, 连接数未满就创建新连接
+ */
+static swRedis_client* swRedis_pool_select(swRedis_pool *pool)
+{
+	swRedis_client *cli, *select = NULL;
+
+	for (cli = pool->clients; cli != NULL; cli = cli->next)
+	{
+		if (select == NULL || cli->pending < select->pending)
+		{
+			select = cli;
+		}
+	}
+	if ((select == NULL || select->pending > 0) && pool->num < pool->size)
+	{
+		cli = swRedis_client_connect(pool);
+		if (cli != NULL)
+		{
+			return cli;
+		}
+	}
+	return select;
+}
+
+void swRedis_pool_free(swRedis_pool *pool)
+{
+	if (pool->callback_depth > 0)
+	{
+		pool->destroy = 1;
+		return;
+	}
+	swRedis_pool_destroy(pool);
+}
+
+static void swRedis_pool_destroy(swRedis_pool *pool)
+{
+	swRedis_client *cli;
+
+	pool->destroy = 1;
+	snprintf(pool->error, sizeof(pool->error), "redis pool is closed.");
+	pool->callback_depth++;
+	while ((cli = pool->clients) != NULL)
+	{
+		pool->clients = cli->next;
+		swRedis_client_fail(cli);
+		swRedis_client_free(cli);
+	}
+	pool->callback_depth--;
+	sw_free(pool);
+}
+
+static swRedis_client* swRedis_client_connect(swRedis_pool *pool)
+{
+	swRedis_client *cli;
+	char database[16];
+	char *argv[2];
+	uint32_t argv_len[2];
+	int nodelay = 1;
+	int ret;
+
+	cli = sw_malloc(sizeof(swRedis_client));
+	if (cli == NULL)
+	{
+		swWarn("malloc for swRedis_client failed.");
+		return NULL;
+	}
+	bzero(cli, sizeof(swRedis_client));
+	cli->pool = pool;
+	cli->buffer = swString_new(SW_REDIS_BUFFER_SIZE);
+	cli->out = swString_new(SW_BUFFER_SIZE);
+	if (cli->buffer == NULL || cli->out == NULL)
+	{
+		goto fail;
+	}
+	cli->fd = socket(pool->sock_domain, SOCK_STREAM, 0);
+	if (cli->fd < 0)
+	{
+		snprintf(pool->error, sizeof(pool->error), "socket() failed. Error: %s", strerror(errno));
+		goto fail;
+	}
+	swSetNonBlock(cli->fd);
+	fcntl(cli->fd, F_SETFD, FD_CLOEXEC);
+
+	if (pool->sock_domain == AF_UNIX)
+	{
+		ret = connect(cli->fd, (struct sockaddr *) &pool->unix_addr, sizeof(pool->unix_addr));
+	}
+	else
+	{
+		//回复到达后立即发送下一批命令, 不等待ACK
+		setsockopt(cli->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+		ret = connect(cli->fd, (struct sockaddr *) &pool->addr, sizeof(pool->addr));
+	}
+	if (ret < 0 && errno != EINPROGRESS && errno != EAGAIN)
+	{
+		snprintf(pool->error, sizeof(pool->error), "connect to redis failed. Error: %s", strerror(errno));
+		close(cli->fd);
+		goto fail;
+	}
+	if (pool->reactor->add(pool->reactor, cli->fd, SW_FD_REDIS | SW_EVENT_WRITE) < 0)
+	{
+		close(cli->fd);
+		goto fail;
+	}
+	swHashMap_add_int(&swoole_redis_clients, cli->fd, cli);
+
+	if (swTimer_init_reactor(pool->reactor, SW_REDIS_CONNECT_TIMEOUT) == SW_OK)
+	{
+		cli->timer_id = swTimer_set(&SwooleG.timer, SW_REDIS_CONNECT_TIMEOUT, 0, cli, swRedis_onTimeout);
+		if (cli->timer_id < 0)
+		{
+			cli->timer_id = 0;
+		}
+	}
+	cli->next = pool->clients;
+	pool->clients = cli;
+	pool->num++;
+
+	//AUTH和SELECT排在所有命令之前, 连接成功后一起发送, 命令已编码到写缓存, 不需要保留参数
+	if (pool->password[0] != '\0')
+	{
+		argv[0] = "AUTH";
+		argv_len[0] = 4;
+		argv[1] = pool->password;
+		argv_len[1] = strlen(pool->password);
+		cli->init[0].argc = 2;
+		cli->init[0].argv = argv;
+		cli->init[0].argv_len = argv_len;
+		swRedis_client_append(cli, &cli->init[0]);
+	}
+	if (pool->database > 0)
+	{
+		argv[0] = "SELECT";
+		argv_len[0] = 6;
+		argv[1] = database;
+		argv_len[1] = snprintf(database, sizeof(database), "%d", pool->database);
+		cli->init[1].argc = 2;
+		cli->init[1].argv = argv;
+		cli->init[1].argv_len = argv_len;
+		swRedis_client_append(cli, &cli->init[1]);
+	}
+	return cli;
+
+	fail:
+	if (cli->buffer)
+	{
+		swString_free(cli->buffer);
+	}
+	if (cli->out)
+	{
+		swString_free(cli->out);
+	}
+	sw_free(cli);
+	return NULL;
+}
+
+static void swRedis_client_free(swRedis_client *cli)
+{
+	if (cli->timer_id > 0)
+	{
+		swTimer_clear(&SwooleG.timer, cli->timer_id);
+	}
+	swHashMap_del_int(&swoole_redis_clients, cli->fd);
+	cli->pool->reactor->del(cli->pool->reactor, cli->fd);
+
+	if (cli->nodes)
+	{
+		sw_free(cli->nodes);
+	}
+	swString_free(cli->buffer);
+	swString_free(cli->out);
+	sw_free(cli);
+}
+
+/**
+ * 没有收到回复的命令全部以NULL回调
+ */
+static void swRedis_client_fail(swRedis_client *cli)
+{
+	swRedis_command *command;
+
+	while ((command = cli->head) != NULL)
+	{
+		cli->head = command->next;
+		cli->pending--;
+		if (command->onReply)
+		{
+			command->onReply(command, NULL);
+		}
+	}
+	cli->tail = NULL;
+}
+
+/**
+ * 连接出错或被关闭, 不重连, 之后的命令会创建新连接
+ */
+static void swRedis_client_close(swRedis_client *cli, char *error)
+{
+	swRedis_pool *pool = cli->pool;
+	swRedis_client **find;
+
+	for (find = &pool->clients; *find != NULL; find = &(*find)->next)
+	{
+		if (*find == cli)
+		{
+			*find = cli->next;
+			break;
+		}
+	}
+	pool->num--;
+	if (error != pool->error)
+	{
+		snprintf(pool->error, sizeof(pool->error), "%s", error);
+	}
+	pool->callback_depth++;
+	swRedis_client_fail(cli);
+	pool->callback_depth--;
+	swRedis_client_free(cli);
+}
+
+/**
+ * 编码为RESP的bulk string数组, 追加到写缓存
+ */
+static int swRedis_client_append(swRedis_client *cli, swRedis_command *command)
+{
+	swString *out = cli->out;
+	uint32_t length = 16;
+	int i, flush = out->length == 0 && cli->connected;
+
+	for (i = 0; i < command->argc; i++)
+	{
+		length += command->argv_len[i] + 16;
+	}
+	if (swRedis_string_reserve(out, length) < 0)
+	{
+		return SW_ERR;
+	}
+	out->length += sprintf(out->str + out->length, "*%d\r\n", command->argc);
+	for (i = 0; i < command->argc; i++)
+	{
+		out->length += sprintf(out->str + out->length, "$%u\r\n", command->argv_len[i]);
+		memcpy(out->str + out->length, command->argv[i], command->argv_len[i]);
+		out->length += command->argv_len[i];
+		out->str[out->length++] = '\r';
+		out->str[out->length++] = '\n';
+	}
+	command->next = NULL;
+	if (cli->tail == NULL)
+	{
+		cli->head = command;
+	}
+	else
+	{
+		cli->tail->next = command;
+	}
+	cli->tail = command;
+	cli->pending++;
+
+	//同一轮事件中发起的命令在可写时一次发送
+	if (flush)
+	{
+		return cli->pool->reactor->set(cli->pool->reactor, cli->fd, SW_FD_REDIS | SW_EVENT_READ | SW_EVENT_WRITE);
+	}
+	return SW_OK;
+}
+
+static int swRedis_client_flush(swRedis_client *cli)
+{
+	swString *out = cli->out;
+	int n, sent = 0;
+
+	while (sent < out->length)
+	{
+		n = send(cli->fd, out->str + sent, out->length - sent, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			else if (errno == EAGAIN)
+			{
+				break;
+			}
+			return SW_ERR;
+		}
+		sent += n;
+	}
+	if (sent == out->length)
+	{
+		out->length = 0;
+		return cli->pool->reactor->set(cli->pool->reactor, cli->fd, SW_FD_REDIS | SW_EVENT_READ);
+	}
+	memmove(out->str, out->str + sent, out->length - sent);
+	out->length -= sent;
+	return cli->pool->reactor->set(cli->pool->reactor, cli->fd, SW_FD_REDIS | SW_EVENT_READ | SW_EVENT_WRITE);
+}
+
+static int swRedis_onRead(swReactor *reactor, swEvent *event)
+{
+	swRedis_client *cli = swHashMap_find_int(&swoole_redis_clients, event->fd);
+	swRedis_pool *pool;
+	swRedis_command *command;
+	swRedis_reply *nodes;
+	swString *buffer;
+	uint32_t need, node_num;
+	char error[SW_REDIS_ERROR_MAX];
+	int n;
+
+	if (cli == NULL)
+	{
+		return SW_OK;
+	}
+	pool = cli->pool;
+	buffer = cli->buffer;
+
+	if (buffer->length == buffer->size && swString_extend(buffer, buffer->size * 2) < 0)
+	{
+		swRedis_client_close(cli, "out of memory.");
+		goto check_destroy;
+	}
+	n = recv(cli->fd, buffer->str + buffer->length, buffer->size - buffer->length, 0);
+	if (n < 0)
+	{
+		if (errno == EAGAIN || errno == EINTR)
+		{
+			return SW_OK;
+		}
+		swRedis_client_close(cli, strerror(errno));
+		goto check_destroy;
+	}
+	else if (n == 0)
+	{
+		swRedis_client_close(cli, "redis server has gone away.");
+		goto check_destroy;
+	}
+	buffer->length += n;
+
+	while (cli->offset < buffer->length)
+	{
+		n = swRedis_reply_length(buffer->str + cli->offset, buffer->length - cli->offset, &need, &node_num);
+		if (n < 0)
+		{
+			swRedis_client_close(cli, "redis protocol error.");
+			goto check_destroy;
+		}
+		else if (n == 0)
+		{
+			//大的回复: 移到buffer头部, 不够时扩容
+			if (cli->offset > 0 && (need == 0 || need > buffer->size - cli->offset))
+			{
+				memmove(buffer->str, buffer->str + cli->offset, buffer->length - cli->offset);
+				buffer->length -= cli->offset;
+				cli->offset = 0;
+			}
+			if (need > buffer->size && swString_extend(buffer, need) < 0)
+			{
+				swRedis_client_close(cli, "out of memory.");
+				goto check_destroy;
+			}
+			break;
+		}
+		command = cli->head;
+		if (command == NULL)
+		{
+			swRedis_client_close(cli, "unexpected reply from redis server.");
+			goto check_destroy;
+		}
+		if (node_num > cli->node_size)
+		{
+			nodes = sw_realloc(cli->nodes, sizeof(swRedis_reply) * node_num);
+			if (nodes == NULL)
+			{
+				swRedis_client_close(cli, "out of memory.");
+				goto check_destroy;
+			}
+			cli->nodes = nodes;
+			cli->node_size = node_num;
+		}
+		swRedis_reply_parse(buffer->str + cli->offset, cli->nodes);
+		cli->offset += n;
+		cli->head = command->next;
+		if (cli->head == NULL)
+		{
+			cli->tail = NULL;
+		}
+		cli->pending--;
+
+		if (command->onReply == NULL)
+		{
+			//AUTH或SELECT失败, 这个连接上的命令都无法执行
+			if (cli->nodes[0].type == SW_REDIS_REPLY_ERROR)
+			{
+				snprintf(error, sizeof(error), "%.*s", cli->nodes[0].len, cli->nodes[0].str);
+				swRedis_client_close(cli, error);
+				goto check_destroy;
+			}
+			continue;
+		}
+		pool->callback_depth++;
+		command->onReply(command, cli->nodes);
+		pool->callback_depth--;
+		if (pool->destroy)
+		{
+			goto check_destroy;
+		}
+	}
+	if (cli->offset == buffer->length)
+	{
+		buffer->length = 0;
+		cli->offset = 0;
+	}
+
+	check_destroy:
+	if (pool->destroy && pool->callback_depth == 0)
+	{
+		swRedis_pool_destroy(pool);
+	}
+	return SW_OK;
+}
+
+static int swRedis_onWrite(swReactor *reactor, swEvent *event)
+{
+	swRedis_client *cli = swHashMap_find_int(&swoole_redis_clients, event->fd);
+	swRedis_pool *pool;
+	socklen_t len = sizeof(int);
+	int error = 0;
+
+	if (cli == NULL)
+	{
+		return SW_OK;
+	}
+	pool = cli->pool;
+	if (!cli->connected)
+	{
+		if (getsockopt(cli->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+		{
+			swRedis_client_close(cli, strerror(error ? error : errno));
+			goto check_destroy;
+		}
+		cli->connected = 1;
+		if (cli->timer_id > 0)
+		{
+			swTimer_clear(&SwooleG.timer, cli->timer_id);
+			cli->timer_id = 0;
+		}
+	}
+	if (swRedis_client_flush(cli) < 0)
+	{
+		swRedis_client_close(cli, strerror(errno));
+	}
+
+	check_destroy:
+	if (pool->destroy && pool->callback_depth == 0)
+	{
+		swRedis_pool_destroy(pool);
+	}
+	return SW_OK;
+}
+
+static void swRedis_onTimeout(swTimer *timer, swTimer_node *node)
+{
+	swRedis_client *cli = node->data;
+	swRedis_pool *pool = cli->pool;
+
+	cli->timer_id = 0;
+	if (!cli->connected)
+	{
+		swRedis_client_close(cli, "connect to redis server timeout.");
+		if (pool->destroy && pool->callback_depth == 0)
+		{
+			swRedis_pool_destroy(pool);
+		}
+	}
+}
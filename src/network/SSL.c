@@ -0,0 +1,169 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "Server.h"
+
+#ifdef SW_USE_OPENSSL
+
+#include <openssl/err.h>
+
+/**
+ * reactor线程中用OpenSSL完成非阻塞握手, 之后由OpenSSL设置TLS_TX/TLS_RX交给内核加解密
+ * 握手完成后连接和普通TCP连接相同, sendfile/writev/out_buffer都不经过用户态加密
+ * 没有用户态加密的回退, 内核不支持kTLS时关闭连接
+ */
+SSL_CTX* swSSL_get_context(char *cert_file, char *key_file, char *ciphers)
+{
+	SSL_CTX *ctx;
+
+	if (cert_file == NULL || key_file == NULL)
+	{
+		swWarn("ssl_cert_file and ssl_key_file are required.");
+		return NULL;
+	}
+#ifndef SSL_OP_ENABLE_KTLS
+	swWarn("OpenSSL is built without kTLS.");
+	return NULL;
+#else
+	SSL_library_init();
+	SSL_load_error_strings();
+
+	ctx = SSL_CTX_new(TLS_server_method());
+	if (ctx == NULL)
+	{
+		swWarn("SSL_CTX_new() failed. Error: %s", ERR_reason_error_string(ERR_get_error()));
+		return NULL;
+	}
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+#if OPENSSL_VERSION_NUMBER < 0x30200000L
+	//3.2之前TLS1.3只有发送方向能交给内核
+	SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+#endif
+	//握手完成后不再由OpenSSL读写, 不能发送会话票据
+	SSL_CTX_set_num_tickets(ctx, 0);
+	SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+	if (SSL_CTX_set_cipher_list(ctx, ciphers ? ciphers : SW_SSL_CIPHERS) == 0)
+	{
+		swWarn("SSL_CTX_set_cipher_list(%s) failed.", ciphers ? ciphers : SW_SSL_CIPHERS);
+		goto fail;
+	}
+	if (SSL_CTX_use_certificate_chain_file(ctx, cert_file) <= 0)
+	{
+		swWarn("SSL_CTX_use_certificate_chain_file(%s) failed. Error: %s", cert_file, ERR_reason_error_string(ERR_get_error()));
+		goto fail;
+	}
+	if (SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) <= 0)
+	{
+		swWarn("SSL_CTX_use_PrivateKey_file(%s) failed. Error: %s", key_file, ERR_reason_error_string(ERR_get_error()));
+		goto fail;
+	}
+	if (!SSL_CTX_check_private_key(ctx))
+	{
+		swWarn("private key does not match the certificate.");
+		goto fail;
+	}
+	return ctx;
+
+	fail:
+	SSL_CTX_free(ctx);
+	return NULL;
+#endif
+}
+
+int swSSL_create(swServer *serv, int fd)
+{
+	swConnectionInfo *info = &serv->connection_info[fd];
+
+	info->ssl = SSL_new(serv->ssl_context);
+	if (info->ssl == NULL)
+	{
+		swWarn("SSL_new() failed.");
+		return SW_ERR;
+	}
+	if (!SSL_set_fd(info->ssl, fd))
+	{
+		SSL_free(info->ssl);
+		info->ssl = NULL;
+		return SW_ERR;
+	}
+	SSL_set_accept_state(info->ssl);
+	serv->connection_list[fd].ssl_state = SW_SSL_STATE_HANDSHAKE;
+	info->ssl_want_write = 0;
+	return SW_OK;
+}
+
+/**
+ * 返回SW_OK握手完成, 返回1需要等待ssl_want_write指定的事件, 返回SW_ERR应关闭连接
+ */
+int swSSL_accept(swServer *serv, int fd)
+{
+	swConnectionInfo *info = &serv->connection_info[fd];
+	static int ktls_warned = 0;
+	int ret, error;
+
+	ERR_clear_error();
+	ret = SSL_do_handshake(info->ssl);
+	if (ret == 1)
+	{
+		if (!BIO_get_ktls_send(SSL_get_wbio(info->ssl)) || !BIO_get_ktls_recv(SSL_get_rbio(info->ssl)))
+		{
+			if (!ktls_warned)
+			{
+				ktls_warned = 1;
+				swWarn("kTLS is not available for %s, load the tls kernel module.", SSL_get_cipher_name(info->ssl));
+			}
+			return SW_ERR;
+		}
+		serv->connection_list[fd].ssl_state = SW_SSL_STATE_READY;
+		return SW_OK;
+	}
+	error = SSL_get_error(info->ssl, ret);
+	switch (error)
+	{
+	case SSL_ERROR_WANT_READ:
+		info->ssl_want_write = 0;
+		return 1;
+	case SSL_ERROR_WANT_WRITE:
+		info->ssl_want_write = 1;
+		return 1;
+	case SSL_ERROR_SYSCALL:
+		//客户端在握手中断开
+		return SW_ERR;
+	default:
+		swTrace("SSL_do_handshake() failed. Error: %s", ERR_reason_error_string(ERR_get_error()));
+		return SW_ERR;
+	}
+}
+
+void swSSL_free(swServer *serv, int fd)
+{
+	swConnectionInfo *info = &serv->connection_info[fd];
+
+	if (info->ssl == NULL)
+	{
+		return;
+	}
+	//数据已经由内核加密发送, 不再写close_notify
+	SSL_set_quiet_shutdown(info->ssl, 1);
+	SSL_free(info->ssl);
+	info->ssl = NULL;
+	serv->connection_list[fd].ssl_state = 0;
+}
+
+#endif
@@ -17,12 +17,21 @@
 #include "swoole.h"
 #include "Server.h"
 #include "memory.h"
+#include "websocket.h"
+#include "coroutine.h"
 
 #include <netinet/tcp.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
 static void swServer_signal_init(void);
+#ifdef HAVE_CPU_AFFINITY
+static int swServer_affinity_cpu(swServer *serv, int reactor_thread, int id);
+#endif
+static int swServer_incoming_cpu_reactor(swServer *serv, int fd);
 
-SWINLINE static void swUpdateTime(void);
 
 #if SW_REACTOR_SCHEDULE == 3
 SWINLINE static void swServer_reactor_schedule(swServer *serv);
@@ -32,6 +41,9 @@ static int swServer_check_callback(swServer *serv);
 
 static void swServer_master_onReactorTimeout(swReactor *reactor);
 static void swServer_master_onReactorFinish(swReactor *reactor);
+static void swServer_single_onReactorFinish(swReactor *reactor);
+static int swServer_connection_index_init(swServer *serv, int shared);
+static int swServer_connection_table_create(swServer *serv);
 
 static void swServer_signal_hanlder(int sig);
 
@@ -40,30 +52,92 @@ static int swServer_single_loop(swProcessPool *pool, swWorker *worker);
 static int swServer_single_onClose(swReactor *reactor, swEvent *event);
 
 static int swServer_master_onClose(swReactor *reactor, swDataHead *event);
-static int swServer_master_onAccept(swReactor *reactor, swDataHead *event);
+static int swServer_listen_reuse_port(swServer *serv, swListenList_node *listen_host);
+static int swServer_listen_udp_reuse_port(swServer *serv);
+static int swServer_reuse_port_num(swServer *serv);
+static int swServer_connection_table_fork(swServer *serv);
+static void swServer_worker_group_init(swServer *serv);
+
+#define swServer_listen_latency_sample(serv, ls)  ((ls)->latency_sample < 0 ? (serv)->latency_sample : (ls)->latency_sample)
+#define swServer_listen_option(serv, ls, opt)      ((ls)->options[opt] < 0 ? (serv)->listen_options[opt] : (ls)->options[opt])
+
+static void swServer_tcp_setopt(swServer *serv, int fd);
+static void swServer_listen_setopt(swServer *serv, swListenList_node *listen_host, int sock);
 
 static int swServer_start_proxy(swServer *serv);
 static int swServer_start_base(swServer *serv);
 static int swServer_create_proxy(swServer *serv);
 static int swServer_create_base(swServer *serv);
 
-static void swServer_heartbeat_start(swServer *serv);
-static void swServer_heartbeat_check(swThreadParam *heartbeat_param);
 
 swServerG SwooleG;
 swServerGS *SwooleGS;
 swWorkerG SwooleWG;
+__thread swThreadG SwooleTG;
 
 int16_t sw_errno;
-char sw_error[SW_ERROR_MSG_SIZE];
+__thread char sw_error[SW_ERROR_MSG_SIZE];
+
+/**
+ * reactor线程关闭的连接, 调用onMasterClose并重新计算max_fd
+ */
+static void swServer_master_close_fd(swServer *serv, int fd)
+{
+	swConnection *conn = swServer_get_connection(serv, fd);
+
+	if (serv->onMasterClose != NULL)
+	{
+		serv->onMasterClose(serv, fd, conn->from_id);
+	}
+	//reactor线程也会修改max_fd
+	if (serv->enable_reuse_port)
+	{
+		SwooleG.lock.lock(&SwooleG.lock);
+	}
+	//重新设置max_fd,此代码为了遍历connection_list服务
+	if(fd == swServer_get_maxfd(serv))
+	{
+		int find_max_fd = fd - 1;
+		//找到第二大的max_fd作为新的max_fd
+		for (; serv->connection_list[find_max_fd].active == 0 && find_max_fd > swServer_get_minfd(serv); find_max_fd--);
+		swServer_set_maxfd(serv, find_max_fd);
+		swTrace("set_maxfd=%d|close_fd=%d", find_max_fd, fd);
+	}
+	if (serv->enable_reuse_port)
+	{
+		SwooleG.lock.unlock(&SwooleG.lock);
+	}
+}
+
+/**
+ * 读完reactor线程投递的所有记录, 先清除唤醒标志, 之后写入的记录会再次唤醒
+ */
+static void swServer_master_close_ring(swServer *serv, int reactor_id)
+{
+	swReactorThread *thread = &serv->reactor_threads[reactor_id];
+	int *fds;
+	int i, length;
+
+	sw_atomic_cmp_set(&thread->close_notified, 1, 0);
+	while ((fds = swRingBuffer_front(thread->close_ring, &length)) != NULL)
+	{
+		for (i = 0; i < length / sizeof(int); i++)
+		{
+			swServer_master_close_fd(serv, fds[i]);
+		}
+		swRingBuffer_pop(thread->close_ring);
+	}
+}
 
+/**
+ * main_pipe中负数为reactor线程的唤醒消息, 其他为swServer_close写入的fd
+ */
 static int swServer_master_onClose(swReactor *reactor, swEvent *event)
 {
 	swServer *serv = reactor->ptr;
-	swConnection *conn;
 	int queue[SW_CLOSE_QLEN];
 
-	int i, n, fd;
+	int i, n;
 	n = serv->main_pipe.read(&serv->main_pipe, queue, sizeof(queue));
 
 	if (n <= 0)
@@ -74,48 +148,32 @@ static int swServer_master_onClose(swReactor *reactor, swEvent *event)
 
 	for (i = 0; i < n / sizeof(int); i++)
 	{
-		fd = queue[i];
-		conn = swServer_get_connection(serv, fd);
-
-		if (serv->onMasterClose != NULL)
+		if (queue[i] < 0)
 		{
-			serv->onMasterClose(serv, fd, conn->from_id);
+			swServer_master_close_ring(serv, -queue[i] - 1);
 		}
-		//重新设置max_fd,此代码为了遍历connection_list服务
-		if(fd == swServer_get_maxfd(serv))
+		else
 		{
-			int find_max_fd = fd - 1;
-			//找到第二大的max_fd作为新的max_fd
-			for (; serv->connection_list[find_max_fd].active == 0 && find_max_fd > swServer_get_minfd(serv); find_max_fd--);
-			swServer_set_maxfd(serv, find_max_fd);
-			swTrace("set_maxfd=%d|close_fd=%d", find_max_fd, fd);
+			swServer_master_close_fd(serv, queue[i]);
 		}
-		serv->connect_count--;
 	}
 	return SW_OK;
 }
 
 static void swServer_master_onReactorTimeout(swReactor *reactor)
 {
-	swUpdateTime();
+	swClock_update();
 }
 
 static void swServer_master_onReactorFinish(swReactor *reactor)
 {
-	swUpdateTime();
+	swClock_update();
 }
 
-SWINLINE static void swUpdateTime(void)
+static void swServer_single_onReactorFinish(swReactor *reactor)
 {
-	time_t now = time(NULL);
-	if (now < 0)
-	{
-		swWarn("get time failed. Error: %s[%d]", strerror(errno), errno);
-	}
-	else
-	{
-		SwooleGS->now = now;
-	}
+	swClock_update();
+	swReactorThread_idle_check(reactor);
 }
 
 #if SW_REACTOR_SCHEDULE == 3
@@ -135,17 +193,122 @@ SWINLINE static void swServer_reactor_schedule(swServer *serv)
 }
 #endif
 
-static int swServer_master_onAccept(swReactor *reactor, swEvent *event)
+/**
+ * TCP Nodelay和keepalive
+ */
+static void swServer_tcp_setopt(swServer *serv, int fd)
+{
+	if (serv->open_tcp_nodelay == 1)
+	{
+		int flag = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+	}
+
+#ifdef SO_KEEPALIVE
+	if (serv->open_tcp_keepalive == 1)
+	{
+		int keepalive = 1;
+		int keep_idle = serv->tcp_keepidle;
+		int keep_interval = serv->tcp_keepinterval;
+		int keep_count = serv->tcp_keepcount;
+#ifdef TCP_KEEPIDLE
+		setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&keepalive , sizeof(keepalive));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, (void*)&keep_idle , sizeof(keep_idle));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, (void *)&keep_interval , sizeof(keep_interval));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, (void *)&keep_count , sizeof(keep_count));
+#endif
+	}
+#endif
+}
+
+/**
+ * SW_ACCEPT_INHERIT_SOCKOPT: accept得到的连接继承监听socket的选项, 在这里设置一次即可
+ */
+static void swServer_listen_setopt(swServer *serv, swListenList_node *listen_host, int sock)
+{
+	int value;
+
+#ifdef TCP_DEFER_ACCEPT
+	value = swServer_listen_option(serv, listen_host, SW_LISTEN_DEFER_ACCEPT);
+	if (value > 0 && setsockopt(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &value, sizeof(value)) < 0)
+	{
+		swWarn("setsockopt(TCP_DEFER_ACCEPT) failed. Error: %s[%d]", strerror(errno), errno);
+	}
+#endif
+#ifdef TCP_FASTOPEN
+	value = swServer_listen_option(serv, listen_host, SW_LISTEN_FASTOPEN);
+	if (value > 0 && setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN, &value, sizeof(value)) < 0)
+	{
+		swWarn("setsockopt(TCP_FASTOPEN) failed. Error: %s[%d]", strerror(errno), errno);
+	}
+#endif
+#ifdef SO_BUSY_POLL
+	value = swServer_listen_option(serv, listen_host, SW_LISTEN_BUSY_POLL);
+	if (value > 0 && setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) < 0)
+	{
+		swWarn("setsockopt(SO_BUSY_POLL) failed. Error: %s[%d]", strerror(errno), errno);
+	}
+#endif
+#ifdef SW_ACCEPT_INHERIT_SOCKOPT
+	swServer_tcp_setopt(serv, sock);
+#endif
+}
+
+/**
+ * 进程模式下一次accept到的多个连接合并为SW_EVENT_PACKAGE_BATCH通知onConnect
+ * 按fd分配的分组中每个worker一条消息, onConnect和这个连接后续的数据仍然在同一个worker
+ */
+static void swServer_notify_connect(swServer *serv, swEvent *events, int num)
+{
+	swPackage_batch batch;
+	swWorkerGroup *group;
+	uint8_t sent[SW_ACCEPT_MAX_COUNT];
+	int i, j, fdmod;
+
+	if (num == 1)
+	{
+		serv->factory.notify(&serv->factory, &events[0]);
+		return;
+	}
+	group = &serv->worker_groups[serv->connection_info[events[0].fd].worker_group];
+	fdmod = (group->dispatch_mode == SW_DISPATCH_FDMOD || group->dispatch_mode == SW_DISPATCH_KEY);
+	bzero(sent, sizeof(sent));
+	bzero(&batch.event.info, sizeof(batch.event.info));
+	swPackage_batch_init(&batch, events[0].fd, events[0].from_id);
+	for (i = 0; i < num; i++)
+	{
+		if (sent[i])
+		{
+			continue;
+		}
+		for (j = i; j < num; j++)
+		{
+			if (sent[j] || (fdmod && events[j].fd % group->worker_num != events[i].fd % group->worker_num))
+			{
+				continue;
+			}
+			swPackage_batch_add(&serv->factory, &batch, &events[j], "");
+			sent[j] = 1;
+		}
+		swPackage_batch_flush(&serv->factory, &batch);
+	}
+}
+
+int swServer_master_onAccept(swReactor *reactor, swEvent *event)
 {
 	swServer *serv = reactor->ptr;
-	swEvent connEv;
+	swEvent connEv[SW_ACCEPT_MAX_COUNT];
+	swEvent notifyEv[SW_ACCEPT_MAX_COUNT];
+	swConnection *conn;
+	int fdtypes[SW_ACCEPT_MAX_COUNT];
 	struct sockaddr_in client_addr;
-	uint32_t client_addrlen = sizeof(client_addr);
-	int new_fd, ret, reactor_id = 0, i;
+	uint32_t client_addrlen;
+	int new_fd, reactor_id = 0, i, n = 0, notify_n = 0, fdtype;
 
-	//SW_ACCEPT_AGAIN
-	for (i = 0; i < SW_ACCEPT_MAX_COUNT; i++)
+	//SW_ACCEPT_AGAIN, 一次最多accept SW_ACCEPT_MAX_COUNT个连接, 再一起加入reactor线程
+	while (n < SW_ACCEPT_MAX_COUNT)
 	{
+		client_addrlen = sizeof(client_addr);
 		//accept得到连接套接字
 #ifdef SW_USE_ACCEPT4
 	    new_fd = accept4(event->fd, (struct sockaddr *)&client_addr, &client_addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
@@ -154,100 +317,171 @@ static int swServer_master_onAccept(swReactor *reactor, swEvent *event)
 #endif
 		if (new_fd < 0 )
 		{
-			switch(errno)
+			if (errno == EINTR)
 			{
-			case EAGAIN:
-				return SW_OK;
-			case EINTR:
 				continue;
-			default:
+			}
+			if (errno != EAGAIN)
+			{
 				swWarn("accept failed. Error: %s[%d]", strerror(errno), errno);
-				return SW_OK;
 			}
+			break;
 		}
 		swTrace("[Master]accept.event->fd=%d|event->from_id=%d|conn=%d", event->fd, event->from_id, new_fd);
-		//连接过多
-		if(serv->connect_count >= serv->max_conn)
+		//连接过多, 本批还没有计入connect_count
+		if(serv->connect_count + n >= serv->max_conn)
 		{
 			swWarn("too many connection");
 			close(new_fd);
-			return SW_OK;
+			break;
 		}
-		//TCP Nodelay
-		if (serv->open_tcp_nodelay == 1)
+#ifndef SW_ACCEPT_INHERIT_SOCKOPT
+		swServer_tcp_setopt(serv, new_fd);
+#endif
+
+		//SO_REUSEPORT模式下由当前reactor线程处理
+		if (serv->enable_reuse_port)
 		{
-			int flag = 1;
-			setsockopt(new_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+			reactor_id = reactor->id;
 		}
-
-#ifdef SO_KEEPALIVE
-		//TCP keepalive
-		if(serv->open_tcp_keepalive == 1)
+		//交给和软中断在同一个CPU上的reactor线程
+		else if (serv->incoming_cpu_map != NULL && (reactor_id = swServer_incoming_cpu_reactor(serv, new_fd)) >= 0)
 		{
-			int keepalive = 1;
-			int keep_idle = serv->tcp_keepidle;
-			int keep_interval = serv->tcp_keepinterval;
-			int keep_count = serv->tcp_keepcount;
-#ifdef TCP_KEEPIDLE
-			setsockopt(new_fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&keepalive , sizeof(keepalive));
-			setsockopt(new_fd, IPPROTO_TCP, TCP_KEEPIDLE, (void*)&keep_idle , sizeof(keep_idle));
-			setsockopt(new_fd, IPPROTO_TCP, TCP_KEEPINTVL, (void *)&keep_interval , sizeof(keep_interval));
-			setsockopt(new_fd, IPPROTO_TCP, TCP_KEEPCNT, (void *)&keep_count , sizeof(keep_count));
-#endif
+			swServer_reactor_stats_add(serv, reactor_id, incoming_cpu_count, 1);
 		}
-#endif
-
+		else
+		{
 #if SW_REACTOR_SCHEDULE == 1
-		//轮询分配
-		reactor_id = (serv->reactor_round_i++) % serv->reactor_num;
+			//轮询分配
+			reactor_id = (serv->reactor_round_i++) % serv->reactor_num;
 #elif SW_REACTOR_SCHEDULE == 2
-		//使用fd取模来散列
-		reactor_id = new_fd % serv->reactor_num;
+			//使用fd取模来散列
+			reactor_id = new_fd % serv->reactor_num;
 #else
-		//平均调度法
-		reactor_id = serv->reactor_next_i;
-		if (serv->reactor_num > 1 && (serv->reactor_schedule_count++) % SW_SCHEDULE_INTERVAL == 0)
+			//平均调度法
+			reactor_id = serv->reactor_next_i;
+			if (serv->reactor_num > 1 && (serv->reactor_schedule_count++) % SW_SCHEDULE_INTERVAL == 0)
+			{
+				swServer_reactor_schedule(serv);
+			}
+#endif
+		}
+		//所有worker都过载, 新连接直接拒绝, 避免在队列中越积越多
+		if (swServer_overloaded(serv))
 		{
-			swServer_reactor_schedule(serv);
+			swServer_overload_reject(serv, reactor_id, new_fd, !serv->connection_info[event->fd].open_ssl);
+			close(new_fd);
+			continue;
 		}
-#endif
-		connEv.type = SW_EVENT_CONNECT;
-		connEv.from_id = reactor_id;
-		connEv.fd = new_fd;
-		connEv.from_fd = event->fd;
+		connEv[n].type = SW_EVENT_CONNECT;
+		connEv[n].from_id = reactor_id;
+		connEv[n].fd = new_fd;
+		connEv[n].from_fd = event->fd;
+		connEv[n].len = 0;
+		connEv[n].time = 0;
 
 		//add to connection_list
-		swServer_new_connection(serv, &connEv);
-		memcpy(&serv->connection_list[new_fd].addr, &client_addr, sizeof(client_addr));
+		swServer_new_connection(serv, &connEv[n]);
+		memcpy(&serv->connection_info[new_fd].addr, &client_addr, sizeof(client_addr));
+
+		//加入reactor线程的空闲链表,由reactor线程检测超时
+		if (swServer_heartbeat_enable(serv))
+		{
+			swConnection_idle_link(serv, &serv->connection_list[new_fd]);
+		}
 
 		/*
 		 * [!!!] new_connection function must before reactor->add
 		 */
-		ret = serv->reactor_threads[reactor_id].reactor.add(&(serv->reactor_threads[reactor_id].reactor), new_fd,
-				SW_FD_TCP | SW_EVENT_READ);
-		if (ret < 0)
+#ifndef SW_USE_ACCEPT4
+		//必须是非阻塞的, 否则一个慢速客户端的直接发送会阻塞整个reactor线程
+		swSetNonBlock(new_fd);
+#endif
+		fdtype = SW_FD_TCP | SW_EVENT_READ;
+#ifdef SW_USE_OPENSSL
+		//TLS端口先由reactor线程握手, 完成后再设置为SW_FD_TCP并通知onConnect
+		if (serv->connection_info[event->fd].open_ssl)
 		{
-			close(new_fd);
-			return SW_OK;
+			if (swSSL_create(serv, new_fd) < 0)
+			{
+				close(new_fd);
+				continue;
+			}
+			fdtype = SW_FD_SSL | SW_EVENT_READ;
 		}
 		else
+#endif
+		//边缘触发, 可写事件在连接的生命周期内只注册一次, 单线程模式不使用out_buffer
+		if (serv->enable_edge_trigger)
 		{
-			serv->connect_count++;
-
-			if(serv->onMasterConnect != NULL)
+			fdtype |= SW_EVENT_ET;
+			if (serv->factory_mode != SW_MODE_SINGLE)
 			{
-				serv->onMasterConnect(serv, new_fd, reactor_id);
+				fdtype |= SW_EVENT_WRITE;
+				serv->connection_list[new_fd].out_event = 1;
 			}
-			if(serv->onConnect != NULL)
+		}
+		fdtypes[n] = fdtype;
+		n++;
+#ifndef SW_ACCEPT_AGAIN
+		break;
+#endif
+	}
+
+	//进程模式先合并通知onConnect再加入reactor, worker从pipe中一定先收到onConnect, 再收到这个连接的数据
+	if (serv->onConnect != NULL && serv->factory_mode == SW_MODE_PROCESS)
+	{
+		for (i = 0; i < n; i++)
+		{
+			//TLS连接在握手完成后通知
+			if (serv->connection_list[connEv[i].fd].ssl_state == 0)
 			{
-				serv->factory.notify(&serv->factory, &connEv);
+				notifyEv[notify_n++] = connEv[i];
 			}
 		}
-#ifdef SW_ACCEPT_AGAIN
-		continue;
-#else
-		break;
+		if (notify_n > 0)
+		{
+			swServer_notify_connect(serv, notifyEv, notify_n);
+		}
+	}
+	//每个连接一次epoll_ctl
+	for (i = 0; i < n; i++)
+	{
+		new_fd = connEv[i].fd;
+		reactor_id = connEv[i].from_id;
+		conn = &serv->connection_list[new_fd];
+		//worker可能已经在onConnect中回复, 没有发完的数据在out_buffer中
+		if (conn->out_event == 0 && conn->out_buffer != NULL && !swBuffer_empty(conn->out_buffer))
+		{
+			fdtypes[i] |= SW_EVENT_WRITE;
+			conn->out_event = 1;
+		}
+		if (serv->reactor_threads[reactor_id].reactor.add(&(serv->reactor_threads[reactor_id].reactor), new_fd, fdtypes[i]) < 0)
+		{
+			if (notify_n > 0 && conn->ssl_state == 0)
+			{
+				connEv[i].type = SW_EVENT_CLOSE;
+				serv->factory.notify(&serv->factory, &connEv[i]);
+			}
+#ifdef SW_USE_OPENSSL
+			swSSL_free(serv, new_fd);
 #endif
+			close(new_fd);
+			continue;
+		}
+		sw_atomic_fetch_add(&serv->connect_count, 1);
+		sw_atomic_fetch_add(&serv->stats->connection_num, 1);
+		swServer_reactor_stats_add(serv, reactor_id, accept_count, 1);
+
+		if(serv->onMasterConnect != NULL)
+		{
+			serv->onMasterConnect(serv, new_fd, reactor_id);
+		}
+		//base模式在当前进程中直接回调onConnect
+		if(serv->onConnect != NULL && serv->factory_mode != SW_MODE_PROCESS && conn->ssl_state == 0)
+		{
+			serv->factory.notify(&serv->factory, &connEv[i]);
+		}
 	}
 	return SW_OK;
 }
@@ -267,12 +501,13 @@ int swServer_addTimer(swServer *serv, int interval)
 		{
 			return SW_ERR;
 		}
-#if SW_WORKER_IPC_MODE == 1
+#if SW_WORKER_IPC_MODE != 2
 		SwooleG.main_reactor->setHandle(SwooleG.main_reactor, SW_FD_TIMER, swTimer_event_handler);
 		SwooleG.main_reactor->add(SwooleG.main_reactor, SwooleG.timer.fd, SW_FD_TIMER);
 #endif
-		SwooleG.timer.onTimer = swServer_onTimer;
 	}
+	//定时器可能已经被其他模块创建
+	SwooleG.timer.onTimer = swServer_onTimer;
 	return swTimer_add(&SwooleG.timer, interval);
 }
 
@@ -387,10 +622,15 @@ static int swServer_start_proxy(swServer *serv)
 {
 	int ret;
 	swReactor *main_reactor = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(swReactor));
-	#ifdef SW_MAINREACTOR_USE_POLL
-		ret = swReactorPoll_create(main_reactor, 10);
+	//监听端口很多或者连接风暴时poll每次都要扫描全部fd
+#ifdef HAVE_EPOLL
+	ret = swReactorEpoll_create(main_reactor, SW_MAINREACTOR_MAXEVENTS);
+#elif defined(HAVE_KQUEUE)
+	ret = swReactorKqueue_create(main_reactor, SW_MAINREACTOR_MAXEVENTS);
+#elif defined(SW_MAINREACTOR_USE_POLL)
+	ret = swReactorPoll_create(main_reactor, 10);
 #else
-		ret = swReactorSelect_create(main_reactor);
+	ret = swReactorSelect_create(main_reactor);
 #endif
 	if (ret < 0)
 	{
@@ -406,6 +646,7 @@ static int swServer_start_proxy(swServer *serv)
 	SwooleG.main_reactor = main_reactor;
 	main_reactor->id = serv->reactor_num; //设为一个特别的ID
 	main_reactor->ptr = serv;
+	main_reactor->slow_usec = serv->slow_callback_usec;
 	main_reactor->setHandle(main_reactor, SW_FD_LISTEN, swServer_master_onAccept);
 	main_reactor->setHandle(main_reactor, (SW_FD_USER+2), swServer_master_onClose);
 
@@ -417,8 +658,11 @@ static int swServer_start_proxy(swServer *serv)
 #endif
 
 	main_reactor->add(main_reactor, serv->main_pipe.getFd(&serv->main_pipe, 0), (SW_FD_USER+2));
-	//no use
-	//SW_START_SLEEP;
+	//等待reactor线程和worker进程注册完reactor
+	if (swReady_wait(serv->ready, SW_READY_TIMEOUT) < 0)
+	{
+		swWarn("wait for reactor threads and workers timeout, %d not ready.", serv->ready->count);
+	}
 	if (serv->onStart != NULL)
 	{
 		serv->onStart(serv);
@@ -428,7 +672,7 @@ static int swServer_start_proxy(swServer *serv)
 	tmo.tv_usec = 0;
 
 	//先更新一次时间
-	swUpdateTime();
+	swClock_update();
 
 	//心跳检测启动
 
@@ -470,11 +714,54 @@ int swServer_start(swServer *serv)
 	{
 		serv->factory.onFinish = swServer_onFinish;
 	}
+	//for large task data
+	if (serv->task_worker_num > 0 && serv->task_arena_size > 0)
+	{
+		SwooleG.task_arena = swMemoryArena_create(serv->task_arena_size);
+		if (SwooleG.task_arena == NULL)
+		{
+			return SW_ERR;
+		}
+	}
+	//for broadcast, worker进程写入, reactor线程发送
+	if (serv->factory_mode == SW_MODE_PROCESS && serv->send_arena_size > 0)
+	{
+		SwooleG.send_arena = swMemoryArena_create(serv->send_arena_size);
+		if (SwooleG.send_arena == NULL)
+		{
+			return SW_ERR;
+		}
+	}
+	//reactor线程接收大包, worker进程读取
+	if (serv->factory_mode == SW_MODE_PROCESS && serv->recv_ring_size > 0 && serv->open_length_check)
+	{
+		int i;
+		serv->recv_rings = sw_calloc(serv->reactor_num, sizeof(swRecvRing *));
+		if (serv->recv_rings == NULL)
+		{
+			return SW_ERR;
+		}
+		for (i = 0; i < serv->reactor_num; i++)
+		{
+			serv->recv_rings[i] = swRecvRing_create(serv->recv_ring_size);
+			if (serv->recv_rings[i] == NULL)
+			{
+				return SW_ERR;
+			}
+		}
+	}
 	//for taskwait
 	if (serv->task_worker_num > 0 && serv->worker_num > 0)
 	{
 		int i;
 		SwooleG.task_result = sw_shm_calloc(serv->worker_num, sizeof(swEventData));
+		//mmap得到的内存已经初始化为0,不需要calloc,避免占用物理内存
+		SwooleG.task_result_multi = sw_shm_malloc(serv->worker_num * SW_TASKWAIT_MULTI_MAX * sizeof(swEventData));
+		if (SwooleG.task_result == NULL || SwooleG.task_result_multi == NULL)
+		{
+			swWarn("malloc for task_result failed.");
+			return SW_ERR;
+		}
 		SwooleG.task_notify = sw_calloc(serv->worker_num, sizeof(swPipe));
 		for(i =0; i< serv->worker_num; i++)
 		{
@@ -484,6 +771,43 @@ int swServer_start(swServer *serv)
 			}
 		}
 	}
+	//UDP对端地址表, worker进程回复时读取
+	if (serv->have_udp_sock)
+	{
+		serv->udp_peers = swUdpPeerTable_new(SW_UDP_PEER_NUM);
+		if (serv->udp_peers == NULL)
+		{
+			return SW_ERR;
+		}
+	}
+	//UDP端口每个reactor线程(base模式每个worker进程)一个socket, worker进程直接sendto, 必须在创建worker之前
+	if (serv->enable_reuse_port && serv->have_udp_sock && (serv->factory_mode != SW_MODE_SINGLE || serv->worker_num > 1)
+			&& swServer_listen_udp_reuse_port(serv) < 0)
+	{
+		return SW_ERR;
+	}
+	//worker进程由manager创建, 必须在fork之前计数
+	if (serv->factory_mode == SW_MODE_PROCESS)
+	{
+		swReady_add(serv->ready, serv->worker_num);
+	}
+	//其他模式在reactor中直接处理请求, 没有worker排队
+	else if (serv->overload_target_usec > 0)
+	{
+		swWarn("overload_target only works in SWOOLE_PROCESS mode.");
+		serv->overload_target_usec = 0;
+	}
+	//协程挂起后worker要继续读取pipe, 其他模式下reactor还要处理连接的数据
+	if (serv->enable_coroutine && serv->factory_mode != SW_MODE_PROCESS)
+	{
+		swWarn("enable_coroutine only works in SWOOLE_PROCESS mode.");
+		serv->enable_coroutine = 0;
+	}
+	//统计数据, 必须在创建worker之前
+	if (swServer_stats_create(serv) < 0)
+	{
+		return SW_ERR;
+	}
 	//factory start
 	if (factory->start(factory) < 0)
 	{
@@ -495,13 +819,6 @@ int swServer_start(swServer *serv)
 	//标识为主进程
 	SwooleG.process_type = SW_PROCESS_MASTER;
 
-	//启动心跳检测
-	if(serv->heartbeat_check_interval >= 1 && serv->heartbeat_check_interval <= serv->heartbeat_idle_time)
-	{
-		swTrace("hb timer start, time: %d live time:%d", serv->heartbeat_check_interval, serv->heartbeat_idle_time);
-		swServer_heartbeat_start(serv);
-	}
-
 	if(serv->factory_mode == SW_MODE_SINGLE)
 	{
 		ret = swServer_start_base(serv);
@@ -516,10 +833,6 @@ int swServer_start(swServer *serv)
 	{
 		serv->onShutdown(serv);
 	}
-	if (SwooleG.heartbeat_pidt)
-	{
-		pthread_cancel(SwooleG.heartbeat_pidt);
-	}
 	swServer_free(serv);
 	return SW_OK;
 }
@@ -544,7 +857,6 @@ int swServer_close(swServer *serv, swEvent *event)
 
 void swoole_init(void)
 {
-	extern FILE *swoole_log_fn;
 	if (SwooleG.running == 0)
 	{
 		bzero(&SwooleG, sizeof(SwooleG));
@@ -561,10 +873,8 @@ void swoole_init(void)
 #ifdef HAVE_SIGNALFD
 		swSignalfd_init();
 #endif
-		//将日志设置为标准输出
-		swoole_log_fn = stdout;
 		//初始化全局内存
-		SwooleG.memory_pool = swMemoryGlobal_create(SW_GLOBAL_MEMORY_PAGESIZE, 1);
+		SwooleG.memory_pool = swMemoryGlobal_create(SW_GLOBAL_MEMORY_SIZE, 1);
 		if(SwooleG.memory_pool == NULL)
 		{
 			swError("[Master] Fatal Error: create global memory fail. Error: %s[%d]", strerror(errno), errno);
@@ -604,6 +914,8 @@ void swServer_init(swServer *serv)
 	serv->factory_mode = SW_MODE_BASE;
 	serv->reactor_num = SW_REACTOR_NUM;
 	serv->dispatch_mode = SW_DISPATCH_FDMOD;
+	serv->task_dispatch_mode = SW_DISPATCH_ROUND;
+	serv->overload_interval_usec = SW_OVERLOAD_INTERVAL * 1000;
 	serv->ringbuffer_size = SW_QUEUE_SIZE;
 
 	serv->timeout_sec = SW_REACTOR_TIMEO_SEC;
@@ -613,8 +925,18 @@ void swServer_init(swServer *serv)
 	serv->worker_num = SW_CPU_NUM;
 	serv->max_conn = SW_MAX_FDS;
 	serv->max_request = SW_MAX_REQUEST;
+	serv->worker_group_num = 1;
 
 	serv->udp_sock_buffer_size = SW_UNSOCK_BUFSIZE;
+	serv->direct_send = SW_REACTOR_DIRECT_SEND;
+	serv->dispatch_batch = SW_REACTOR_DISPATCH_BATCH;
+	serv->work_stealing = SW_FACTORY_WORK_STEALING;
+	serv->worker_spin_usec = SW_WORKER_SPIN_USEC;
+	serv->reload_drain_timeout = SW_RELOAD_DRAIN_TIMEOUT;
+	serv->task_arena_size = SW_TASK_ARENA_SIZE;
+	serv->send_arena_size = SW_SEND_ARENA_SIZE;
+	serv->recv_ring_size = SW_RECV_RING_SIZE;
+	serv->sendfile_window = SW_SENDFILE_TRUNK;
 
 	//tcp keepalive
 	serv->tcp_keepcount = SW_TCP_KEEPCOUNT;
@@ -628,9 +950,63 @@ void swServer_init(swServer *serv)
 	char eof[] = SW_DATA_EOF;
 	serv->package_eof_len = sizeof(SW_DATA_EOF) - 1;
 	serv->buffer_input_size = SW_BUFFER_SIZE;
+	serv->websocket_compression_min_length = SW_WEBSOCKET_COMPRESSION_MIN_LENGTH;
+	serv->buffer_high_watermark = SW_BUFFER_HIGH_WATERMARK;
+	serv->buffer_low_watermark = SW_BUFFER_LOW_WATERMARK;
 	memcpy(serv->package_eof, eof, serv->package_eof_len);
 }
 
+/**
+ * 每个reactor线程维护自己的空闲连接链表和活动连接索引
+ * 进程模式下worker进程也会遍历索引,需要放在共享内存中
+ */
+static int swServer_connection_index_init(swServer *serv, int shared)
+{
+	int i;
+	swReactorThread *thread;
+
+	for (i = 0; i < serv->reactor_num; i++)
+	{
+		thread = &serv->reactor_threads[i];
+		thread->idle_head = 0;
+		thread->idle_tail = 0;
+		thread->idle_check_time = 0;
+		thread->active_num = 0;
+		//进程模式下worker进程也会加锁遍历
+		if (swMutex_create(&thread->lock, shared) < 0)
+		{
+			swError("create reactor lock fail");
+			return SW_ERR;
+		}
+		thread->active_fds = shared ? sw_shm_reserve(serv->max_conn * sizeof(int)) : sw_calloc(serv->max_conn, sizeof(int));
+		if (thread->active_fds == NULL)
+		{
+			swError("calloc[active_fds] fail");
+			return SW_ERR;
+		}
+	}
+	return SW_OK;
+}
+
+/**
+ * 连接表只预留地址空间, 按fd访问到的页面才占用物理内存, max_conn很大时启动不需要清零整个表
+ */
+static int swServer_connection_table_create(swServer *serv)
+{
+	serv->connection_list = sw_shm_reserve(serv->max_conn * sizeof(swConnection));
+	serv->connection_info = sw_shm_reserve(serv->max_conn * sizeof(swConnectionInfo));
+	serv->connection_chunk_num = serv->max_conn / SW_CONNECTION_CHUNK_SIZE + 1;
+	serv->connection_chunks = sw_shm_calloc(serv->connection_chunk_num, sizeof(swConnectionChunk));
+	if (serv->connection_list == NULL || serv->connection_info == NULL || serv->connection_chunks == NULL)
+	{
+		swError("create connection table fail. max_conn=%d", serv->max_conn);
+		return SW_ERR;
+	}
+	//第一块保存了max_fd和min_fd, 不能归还
+	swConnection_chunk_ref(serv, 0);
+	return SW_OK;
+}
+
 static int swServer_create_base(swServer *serv)
 {
 	serv->reactor_num = 1;
@@ -640,11 +1016,12 @@ static int swServer_create_base(swServer *serv)
 		swError("calloc[reactor_threads] fail.alloc_size=%d", (int )(serv->reactor_num * sizeof(swReactorThread)));
 		return SW_ERR;
 	}
-	serv->connection_list = sw_calloc(serv->max_conn, sizeof(swConnection));
-
-	if (serv->connection_list == NULL)
+	if (swServer_connection_index_init(serv, 0) < 0)
+	{
+		return SW_ERR;
+	}
+	if (swServer_connection_table_create(serv) < 0)
 	{
-		swError("calloc[1] fail");
 		return SW_ERR;
 	}
 	//create factry object
@@ -656,10 +1033,56 @@ static int swServer_create_base(swServer *serv)
 	return SW_OK;
 }
 
+/**
+ * base模式有多个worker进程时, fd只在本进程有效, fork之后每个worker使用自己的连接表
+ * 监听socket的信息从master创建的表中复制
+ */
+static int swServer_connection_table_fork(swServer *serv)
+{
+	swConnection *list = serv->connection_list;
+	swConnectionInfo *info = serv->connection_info;
+	swListenList_node *listen_host;
+	int i, n, fd;
+
+	serv->connection_list = sw_shm_reserve(serv->max_conn * sizeof(swConnection));
+	serv->connection_info = sw_shm_reserve(serv->max_conn * sizeof(swConnectionInfo));
+	//不能从全局内存池分配, worker重启时会一直占用
+	serv->connection_chunks = sw_calloc(serv->connection_chunk_num, sizeof(swConnectionChunk));
+	if (serv->connection_list == NULL || serv->connection_info == NULL || serv->connection_chunks == NULL)
+	{
+		swError("create connection table fail. max_conn=%d", serv->max_conn);
+		return SW_ERR;
+	}
+	swConnection_chunk_ref(serv, 0);
+	LL_FOREACH(serv->listen_list, listen_host)
+	{
+		n = listen_host->reuse_socks ? swServer_reuse_port_num(serv) : 1;
+		for (i = 0; i < n; i++)
+		{
+			fd = listen_host->reuse_socks ? listen_host->reuse_socks[i] : listen_host->sock;
+			swConnection_chunk_ref(serv, fd);
+			memcpy(&serv->connection_list[fd], &list[fd], sizeof(swConnection));
+			memcpy(&serv->connection_info[fd], &info[fd], sizeof(swConnectionInfo));
+		}
+	}
+	swServer_set_minfd(serv, list[SW_SERVER_MIN_FD_INDEX].fd);
+	swServer_set_maxfd(serv, list[SW_SERVER_MAX_FD_INDEX].fd);
+	//只解除本进程的映射, master和其他worker不受影响
+	sw_shm_free(list);
+	sw_shm_free(info);
+	return SW_OK;
+}
+
 static int swServer_create_proxy(swServer *serv)
 {
 	int ret = 0;
-	SW_START_SLEEP;
+	serv->ready = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(swReady));
+	if (serv->ready == NULL)
+	{
+		swError("alloc for serv->ready failed.");
+		return SW_ERR;
+	}
+	swReady_init(serv->ready, 1);
 	//初始化master pipe
 #ifdef SW_MAINREACTOR_USE_UNSOCK
 	ret = swPipeUnsock_create(&serv->main_pipe, 0, SOCK_STREAM);
@@ -680,11 +1103,13 @@ static int swServer_create_proxy(swServer *serv)
 		swError("calloc[reactor_threads] fail.alloc_size=%d", (int )(serv->reactor_num * sizeof(swReactorThread)));
 		return SW_ERR;
 	}
+	if (swServer_connection_index_init(serv, 1) < 0)
+	{
+		return SW_ERR;
+	}
 
-	serv->connection_list = sw_shm_calloc(serv->max_conn, sizeof(swConnection));
-	if (serv->connection_list == NULL)
+	if (swServer_connection_table_create(serv) < 0)
 	{
-		swError("calloc[1] fail");
 		return SW_ERR;
 	}
 
@@ -745,6 +1170,36 @@ int swServer_create(swServer *serv)
 	SwooleG.serv = serv;
 	SwooleG.factory = &serv->factory;
 
+	//之后创建的共享内存使用大页, 全局内存在swoole_init中已经创建
+	SwooleG.hugepage = serv->hugepage;
+	if (serv->hugepage && SwooleG.memory_pool != NULL)
+	{
+		swMemoryGlobal *gm = SwooleG.memory_pool->object;
+		sw_shm_hugepage(gm->mem, gm->size);
+	}
+
+	if (serv->open_length_check)
+	{
+		serv->package_length_parser = swPackage_get_length_parser(serv->package_length_type);
+	}
+	//WebSocket握手是HTTP请求
+	if (serv->open_websocket_protocol)
+	{
+		serv->open_http_protocol = 1;
+	}
+	//pipeline的响应必须按请求顺序返回, 同一个连接的请求只能投递给同一个worker
+	if (serv->open_http_protocol && serv->dispatch_mode != SW_DISPATCH_FDMOD)
+	{
+		swWarn("open_http_protocol requires dispatch_mode=2, reset dispatch_mode to 2.");
+		serv->dispatch_mode = SW_DISPATCH_FDMOD;
+	}
+	if (serv->open_redis_protocol && serv->dispatch_mode != SW_DISPATCH_FDMOD)
+	{
+		swWarn("open_redis_protocol requires dispatch_mode=2, reset dispatch_mode to 2.");
+		serv->dispatch_mode = SW_DISPATCH_FDMOD;
+	}
+	swServer_worker_group_init(serv);
+
 	//单进程单线程模式
 	if(serv->factory_mode == SW_MODE_SINGLE)
 	{
@@ -765,6 +1220,7 @@ int swServer_shutdown(swServer *serv)
 
 int swServer_free(swServer *serv)
 {
+	int i;
 	//factory释放
 	if (serv->factory.shutdown != NULL)
 	{
@@ -790,99 +1246,1007 @@ int swServer_free(swServer *serv)
 	}
 
 	//connection_list释放
+	sw_shm_free(serv->connection_list);
+	sw_shm_free(serv->connection_info);
+	sw_shm_free(serv->connection_chunks);
 	if (serv->factory_mode == SW_MODE_SINGLE)
 	{
-		sw_free(serv->connection_list);
+		sw_free(serv->reactor_threads[0].active_fds);
 	}
 	else
 	{
-		sw_shm_free(serv->connection_list);
+		for (i = 0; i < serv->reactor_num; i++)
+		{
+			sw_shm_free(serv->reactor_threads[i].active_fds);
+			sw_free(serv->reactor_threads[i].close_queue.events);
+			if (serv->reactor_threads[i].close_ring != NULL)
+			{
+				swRingBuffer_free(serv->reactor_threads[i].close_ring);
+			}
+		}
+	}
+
+	//close log file
+	if(serv->log_file[0] != 0)
+	{
+		swLog_free();
+	}
+
+	swoole_clean();
+	return SW_OK;
+}
+
+/**
+ * only tcp
+ */
+int swServer_onFinish(swFactory *factory, swSendData *resp)
+{
+	return swWrite(resp->info.fd, resp->data, resp->info.len);
+}
+
+#ifdef HAVE_SENDMMSG
+/**
+ * worker进程的UDP发送队列, 用sendmmsg一次发送多个包
+ */
+typedef struct
+{
+	uint16_t num;
+	int sock;
+	struct mmsghdr msgs[SW_UDP_SEND_BATCH];
+	struct iovec iovs[SW_UDP_SEND_BATCH];
+	swUdpPeer peers[SW_UDP_SEND_BATCH];
+	char data[SW_UDP_SEND_BATCH][SW_BUFFER_SIZE];
+} swUdpSendQueue;
+
+static swUdpSendQueue *swServer_udp_queue = NULL;
+static uint8_t swServer_udp_queue_enable = 0;
+
+static int swServer_udp_queue_push(swServer *serv, swSendData *resp)
+{
+	int i;
+	swUdpSendQueue *queue = swServer_udp_queue;
+
+	if (queue == NULL)
+	{
+		queue = sw_malloc(sizeof(swUdpSendQueue));
+		if (queue == NULL)
+		{
+			swWarn("malloc for udp send queue failed.");
+			return SW_ERR;
+		}
+		bzero(queue->msgs, sizeof(queue->msgs));
+		for (i = 0; i < SW_UDP_SEND_BATCH; i++)
+		{
+			queue->iovs[i].iov_base = queue->data[i];
+			queue->msgs[i].msg_hdr.msg_iov = &queue->iovs[i];
+			queue->msgs[i].msg_hdr.msg_iovlen = 1;
+			queue->msgs[i].msg_hdr.msg_name = &queue->peers[i].addr;
+		}
+		queue->num = 0;
+		swServer_udp_queue = queue;
+	}
+	//sendmmsg只能使用同一个socket
+	if (queue->num == SW_UDP_SEND_BATCH || (queue->num > 0 && queue->sock != resp->info.from_fd))
+	{
+		swServer_udp_queue_flush(serv);
+	}
+	i = queue->num;
+	if (swUdpPeerTable_get(serv->udp_peers, resp->info.fd, &queue->peers[i]) < 0)
+	{
+		swWarn("udp peer[%d] is expired.", resp->info.fd);
+		return SW_ERR;
+	}
+	queue->num++;
+	queue->sock = resp->info.from_fd;
+	queue->msgs[i].msg_hdr.msg_namelen = queue->peers[i].addrlen;
+	queue->iovs[i].iov_len = resp->info.len;
+	memcpy(queue->data[i], resp->data, resp->info.len);
+	return resp->info.len;
+}
+#endif
+
+/**
+ * 开始合并发送, 之后的UDP包在swServer_udp_queue_end时发出
+ */
+void swServer_udp_queue_start(swServer *serv)
+{
+#ifdef HAVE_SENDMMSG
+	swServer_udp_queue_enable = 1;
+#endif
+}
+
+void swServer_udp_queue_end(swServer *serv)
+{
+#ifdef HAVE_SENDMMSG
+	swServer_udp_queue_flush(serv);
+	swServer_udp_queue_enable = 0;
+#endif
+}
+
+int swServer_udp_queue_flush(swServer *serv)
+{
+#ifdef HAVE_SENDMMSG
+	int ret, sent = 0, count = 0;
+	swUdpSendQueue *queue = swServer_udp_queue;
+
+	if (queue == NULL || queue->num == 0)
+	{
+		return SW_OK;
+	}
+	while (sent < queue->num)
+	{
+		ret = sendmmsg(queue->sock, queue->msgs + sent, queue->num - sent, MSG_DONTWAIT);
+		if (ret > 0)
+		{
+			sent += ret;
+			continue;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		//缓存区已满, 重试SW_WORKER_SENDTO_COUNT次后丢弃
+		if (errno == EAGAIN && ++count < SW_WORKER_SENDTO_COUNT)
+		{
+			swYield();
+			continue;
+		}
+		swWarn("sendmmsg failed, %d packets dropped. Error: %s[%d]", queue->num - sent, strerror(errno), errno);
+		break;
+	}
+	queue->num = 0;
+#endif
+	return SW_OK;
+}
+
+int swServer_send_udp_packet(swServer *serv, swSendData *resp)
+{
+	int count, ret;
+	swUdpPeer peer;
+
+#ifdef HAVE_SENDMMSG
+	if (swServer_udp_queue_enable && resp->info.len <= SW_BUFFER_SIZE)
+	{
+		return swServer_udp_queue_push(serv, resp);
+	}
+#endif
+	//fd是对端地址表的序号
+	if (swUdpPeerTable_get(serv->udp_peers, resp->info.fd, &peer) < 0)
+	{
+		swWarn("udp peer[%d] is expired.", resp->info.fd);
+		return SW_ERR;
+	}
+	int sock = resp->info.from_fd;
+
+	for (count = 0; count < SW_WORKER_SENDTO_COUNT; count++)
+	{
+		ret = sendto(sock, resp->data, resp->info.len, MSG_DONTWAIT, (struct sockaddr *) &peer.addr, peer.addrlen);
+		if (ret >= 0)
+		{
+			break;
+		}
+		else if (errno == EINTR)
+		{
+			continue;
+		}
+		else if (errno == EAGAIN)
+		{
+			swYield();
+		}
+		else
+		{
+			break;
+		}
+	}
+	return ret;
+}
+
+/**
+ * 发送TCP数据, 超过SW_BUFFER_SIZE时分页投递
+ * 进程模式下大数据包复制到send_arena, 只投递一个描述符, reactor线程直接从共享内存发送
+ */
+int swServer_tcp_send(swServer *serv, int fd, char *data, int length)
+{
+	swFactory *factory = &(serv->factory);
+	swBuffer_shared *shared;
+	swSendData _send;
+	int i, n, ret = SW_ERR;
+
+	_send.info.fd = fd;
+	_send.info.from_fd = 0;
+	_send.info.from_id = 0;
+
+	if (serv->factory_mode == SW_MODE_PROCESS && length > SW_BUFFER_SIZE
+			&& (shared = swBuffer_shared_new(data, length)) != NULL)
+	{
+		_send.info.type = SW_EVENT_SHARED;
+		_send.info.len = sizeof(shared);
+		_send.data = (char *) &shared;
+		ret = factory->finish(factory, &_send);
+		if (ret < 0)
+		{
+			swBuffer_shared_release(shared);
+		}
+		return ret;
+	}
+
+	_send.info.type = SW_EVENT_TCP;
+	for (i = 0; length > 0; i++, data += n, length -= n)
+	{
+		n = length > SW_BUFFER_SIZE ? SW_BUFFER_SIZE : length;
+		_send.data = data;
+		_send.info.len = n;
+		ret = factory->finish(factory, &_send);
+#ifdef SW_WORKER_SENDTO_YIELD
+		if ((i % SW_WORKER_SENDTO_YIELD) == (SW_WORKER_SENDTO_YIELD - 1))
+		{
+			swYield();
+		}
+#endif
+	}
+	return ret;
+}
+
+/**
+ * 一次发送多段数据, 合并为尽量少的IPC消息
+ * 进程模式下总长度超过SW_BUFFER_SIZE时每段只复制一次到send_arena, 只投递一个描述符
+ */
+int swServer_tcp_sendv(swServer *serv, int fd, struct iovec *iov, int iovcnt)
+{
+	swFactory *factory = &(serv->factory);
+	swBuffer_shared *shared;
+	swSendData _send;
+	char buffer[SW_BUFFER_SIZE];
+	uint32_t total = 0, offset = 0, n;
+	char *data;
+	int i, ret = SW_OK;
+
+	for (i = 0; i < iovcnt; i++)
+	{
+		total += iov[i].iov_len;
+	}
+	if (total == 0)
+	{
+		return SW_OK;
+	}
+	if (iovcnt == 1)
+	{
+		return swServer_tcp_send(serv, fd, iov[0].iov_base, iov[0].iov_len);
+	}
+
+	_send.info.fd = fd;
+	_send.info.from_fd = 0;
+	_send.info.from_id = 0;
+
+	if (serv->factory_mode == SW_MODE_PROCESS && total > SW_BUFFER_SIZE
+			&& (shared = swBuffer_shared_alloc(total)) != NULL)
+	{
+		for (i = 0; i < iovcnt; i++)
+		{
+			memcpy(shared->data + offset, iov[i].iov_base, iov[i].iov_len);
+			offset += iov[i].iov_len;
+		}
+		_send.info.type = SW_EVENT_SHARED;
+		_send.info.len = sizeof(shared);
+		_send.data = (char *) &shared;
+		ret = factory->finish(factory, &_send);
+		if (ret < 0)
+		{
+			swBuffer_shared_release(shared);
+		}
+		return ret;
+	}
+
+	//小数据段拼接到整页再投递, 大数据段直接分页投递
+	for (i = 0; i < iovcnt; i++)
+	{
+		data = iov[i].iov_base;
+		n = iov[i].iov_len;
+		if (offset == 0 && n >= SW_BUFFER_SIZE)
+		{
+			ret = swServer_tcp_send(serv, fd, data, n - n % SW_BUFFER_SIZE);
+			data += n - n % SW_BUFFER_SIZE;
+			n = n % SW_BUFFER_SIZE;
+		}
+		while (n > 0)
+		{
+			uint32_t len = n > SW_BUFFER_SIZE - offset ? SW_BUFFER_SIZE - offset : n;
+			memcpy(buffer + offset, data, len);
+			offset += len;
+			data += len;
+			n -= len;
+			if (offset == SW_BUFFER_SIZE)
+			{
+				ret = swServer_tcp_send(serv, fd, buffer, offset);
+				offset = 0;
+			}
+		}
+	}
+	if (offset > 0)
+	{
+		ret = swServer_tcp_send(serv, fd, buffer, offset);
+	}
+	return ret;
+}
+
+/**
+ * open_websocket_protocol: 封装为一个不分片的服务端帧, 负载较大时帧头和负载分两次投递, 避免复制
+ * 进程模式下只投递负载, 由reactor线程封装帧, 协商了permessage-deflate的连接在reactor线程中压缩
+ */
+int swServer_websocket_push(swServer *serv, int fd, char *data, int length, int opcode)
+{
+	swFactory *factory = &(serv->factory);
+	swBuffer_shared *shared;
+	swSendData _send;
+	char buffer[SW_BUFFER_SIZE];
+	int n, ret;
+
+	if (serv->factory_mode == SW_MODE_PROCESS && length > 0)
+	{
+		_send.info.fd = fd;
+		_send.info.from_id = 0;
+		_send.info.from_fd = SW_SEND_WEBSOCKET | (opcode & 0x0f);
+		if (length <= SW_BUFFER_SIZE)
+		{
+			_send.info.type = SW_EVENT_TCP;
+			_send.info.len = length;
+			_send.data = data;
+			return factory->finish(factory, &_send);
+		}
+		//帧头和负载必须在同一个消息中, send_arena已满时按原来的方式封装, 不压缩
+		if ((shared = swBuffer_shared_new(data, length)) != NULL)
+		{
+			_send.info.type = SW_EVENT_SHARED;
+			_send.info.len = sizeof(shared);
+			_send.data = (char *) &shared;
+			ret = factory->finish(factory, &_send);
+			if (ret < 0)
+			{
+				swBuffer_shared_release(shared);
+			}
+			return ret;
+		}
+	}
+
+	n = swWebSocket_encode_header(buffer, opcode, 1, length);
+	if (n + length <= sizeof(buffer))
+	{
+		memcpy(buffer + n, data, length);
+		return swServer_tcp_send(serv, fd, buffer, n + length);
+	}
+	if (swServer_tcp_send(serv, fd, buffer, n) < 0)
+	{
+		return SW_ERR;
+	}
+	return swServer_tcp_send(serv, fd, data, length);
+}
+
+/**
+ * 把连接交给所在的reactor线程, 用splice在客户端和上游之间转发, 之后worker只会收到onClose
+ * host必须是IPv4地址, reactor线程中不做DNS解析
+ */
+int swServer_proxy(swServer *serv, int fd, char *host, int port)
+{
+	swFactory *factory = &(serv->factory);
+	swProxy_request req;
+	swSendData send_data;
+
+	if (serv->factory_mode != SW_MODE_PROCESS)
+	{
+		swWarn("proxy only supports SWOOLE_PROCESS mode.");
+		return SW_ERR;
+	}
+	bzero(&req, sizeof(req));
+	req.addr.sin_family = AF_INET;
+	req.addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, host, &req.addr.sin_addr) != 1)
+	{
+		swWarn("proxy host[%s] must be an IPv4 address.", host);
+		return SW_ERR;
+	}
+	send_data.info.fd = fd;
+	send_data.info.type = SW_EVENT_PROXY;
+	send_data.info.from_fd = 0;
+	send_data.info.from_id = 0;
+	send_data.info.len = sizeof(req);
+	send_data.data = (char *) &req;
+	return factory->finish(factory, &send_data);
+}
+
+static int swServer_direct_notify(swServer *serv, int fd, int type)
+{
+	swFactory *factory = &(serv->factory);
+	swSendData send_data;
+	int worker_id = SwooleWG.id;
+
+	send_data.info.fd = fd;
+	send_data.info.type = type;
+	send_data.info.from_fd = 0;
+	send_data.info.from_id = 0;
+	send_data.info.len = sizeof(worker_id);
+	send_data.data = (char *) &worker_id;
+	return factory->finish(factory, &send_data);
+}
+
+/**
+ * 向reactor线程申请连接的写权限, 之前的响应全部发送完成后reactor线程通过SCM_RIGHTS传回socket的副本
+ * 阻塞等待, 返回的socket必须用swServer_direct_end交还, 等待期间收到的其他请求在之后处理
+ */
+int swServer_direct_begin(swServer *serv, int fd, int timeout_ms)
+{
+#if SW_WORKER_IPC_MODE != 2
+	int sock;
+
+	if (serv->factory_mode != SW_MODE_PROCESS)
+	{
+		swWarn("direct write only supports SWOOLE_PROCESS mode.");
+		return SW_ERR;
+	}
+	if (swServer_direct_notify(serv, fd, SW_EVENT_DIRECT) < 0)
+	{
+		return SW_ERR;
+	}
+	sock = swFactoryProcess_direct_wait(&serv->factory, fd, timeout_ms);
+	if (sock < 0 && errno == ETIMEDOUT)
+	{
+		//reactor线程可能已经交出了socket, 之后到达的回复会被丢弃
+		swServer_direct_notify(serv, fd, SW_EVENT_DIRECT_END);
+	}
+	return sock;
+#else
+	swWarn("direct write requires unix socket IPC (SW_WORKER_IPC_MODE != 2).");
+	return SW_ERR;
+#endif
+}
+
+static int swServer_direct_wait(int sock, int timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	pfd.fd = sock;
+	pfd.events = POLLOUT;
+	do
+	{
+		ret = poll(&pfd, 1, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+	if (ret == 0)
+	{
+		errno = ETIMEDOUT;
+		return SW_ERR;
+	}
+	return ret < 0 ? SW_ERR : SW_OK;
+}
+
+/**
+ * socket是非阻塞的, 缓存区满时poll等待, 每次等待最长timeout_ms
+ */
+int swServer_direct_send(int sock, char *data, size_t length, int timeout_ms)
+{
+	size_t written = 0;
+	ssize_t n;
+
+	while (written < length)
+	{
+		n = send(sock, data + written, length - written, MSG_NOSIGNAL);
+		if (n > 0)
+		{
+			written += n;
+		}
+		else if (errno == EINTR)
+		{
+			continue;
+		}
+		else if (errno != EAGAIN || swServer_direct_wait(sock, timeout_ms) < 0)
+		{
+			return SW_ERR;
+		}
+	}
+	return SW_OK;
+}
+
+/**
+ * 发送文件的[offset, offset + length)部分, length为0表示发送到文件末尾
+ */
+int swServer_direct_sendfile(int sock, char *filename, off_t offset, size_t length, int timeout_ms)
+{
+	struct stat file_stat;
+	off_t end;
+	int file_fd, n;
+
+	file_fd = open(filename, O_RDONLY);
+	if (file_fd < 0)
+	{
+		swWarn("open(%s) failed. Error: %s[%d]", filename, strerror(errno), errno);
+		return SW_ERR;
+	}
+	if (length == 0)
+	{
+		if (fstat(file_fd, &file_stat) < 0 || file_stat.st_size <= offset)
+		{
+			close(file_fd);
+			return SW_ERR;
+		}
+		length = file_stat.st_size - offset;
+	}
+	end = offset + length;
+	while (offset < end)
+	{
+		n = swoole_sendfile(sock, file_fd, &offset, end - offset);
+		if (n > 0)
+		{
+			continue;
+		}
+		else if (n == 0)
+		{
+			//文件在发送过程中被截断
+			break;
+		}
+		else if (errno == EINTR)
+		{
+			continue;
+		}
+		else if (errno != EAGAIN || swServer_direct_wait(sock, timeout_ms) < 0)
+		{
+			break;
+		}
+	}
+	close(file_fd);
+	return offset < end ? SW_ERR : SW_OK;
+}
+
+/**
+ * 关闭socket副本并交还写权限, reactor线程继续发送在此期间产生的响应
+ */
+int swServer_direct_end(swServer *serv, int fd, int sock)
+{
+	if (sock >= 0)
+	{
+		close(sock);
+	}
+	return swServer_direct_notify(serv, fd, SW_EVENT_DIRECT_END);
+}
+
+/**
+ * 发送文件的[offset, offset + length)部分, length为0表示发送到文件末尾
+ */
+int swServer_sendfile(swServer *serv, int fd, char *filename, off_t offset, off_t length)
+{
+	char buffer[SW_BUFFER_SIZE];
+	swSendFile_request *req = (swSendFile_request *) buffer;
+	swSendData send_data;
+	int name_len = strlen(filename);
+
+	if (name_len > SW_BUFFER_SIZE - sizeof(swSendFile_request) - 1)
+	{
+		swWarn("sendfile name too long. [MAX_LENGTH=%ld]", SW_BUFFER_SIZE - sizeof(swSendFile_request) - 1);
+		return SW_ERR;
+	}
+	req->offset = offset;
+	req->length = length;
+	memcpy(req->filename, filename, name_len + 1);
+
+	send_data.info.fd = fd;
+	send_data.info.type = SW_EVENT_SENDFILE;
+	send_data.info.len = sizeof(swSendFile_request) + name_len + 1;
+	send_data.info.from_fd = 0;
+	send_data.info.from_id = 0;
+	send_data.data = buffer;
+	return serv->factory.finish(&serv->factory, &send_data);
+}
+
+/**
+ * 向所有连接广播
+ * 进程模式下每个reactor线程只投递一次, 由reactor线程遍历自己的连接发送
+ * SINGLE模式下每个进程有独立的连接列表, 只发送到当前进程的连接
+ */
+int swServer_broadcast(swServer *serv, char *data, int length)
+{
+	return swServer_multicast(serv, NULL, 0, data, length);
+}
+
+/**
+ * 投递一个共享数据的引用描述符, 每条消息持有一个引用
+ */
+static int swServer_multicast_package(swServer *serv, swBroadcastPackage *pkg, int reactor_id)
+{
+	swFactory *factory = &(serv->factory);
+	swSendData _send;
+
+	_send.data = (char *) pkg;
+	_send.info.len = sizeof(swBroadcastPackage) + pkg->fd_num * sizeof(int);
+	_send.info.type = SW_EVENT_BROADCAST;
+	_send.info.fd = 0;
+	_send.info.from_id = reactor_id;
+	_send.info.from_fd = SW_SEND_SHARED;
+
+	sw_atomic_fetch_add(&pkg->shared->refcount, 1);
+	if (factory->finish(factory, &_send) < 0)
+	{
+		swBuffer_shared_release(pkg->shared);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+/**
+ * 数据只复制一次到send_arena, 按reactor线程分组投递fd列表
+ */
+static int swServer_multicast_shared(swServer *serv, swBuffer_shared *shared, int *fds, int fd_num)
+{
+	char buf[SW_BUFFER_SIZE];
+	swBroadcastPackage *pkg = (swBroadcastPackage *) buf;
+	swConnection *conn;
+	int i, j, ret = SW_OK;
+
+	pkg->shared = shared;
+	for (i = 0; i < serv->reactor_num; i++)
+	{
+		pkg->fd_num = 0;
+		if (fds == NULL)
+		{
+			if (swServer_multicast_package(serv, pkg, i) < 0)
+			{
+				ret = SW_ERR;
+			}
+			continue;
+		}
+		for (j = 0; j < fd_num; j++)
+		{
+			conn = swServer_get_connection(serv, fds[j]);
+			if (conn == NULL || conn->active == 0 || conn->from_id != i)
+			{
+				continue;
+			}
+			pkg->fds[pkg->fd_num++] = fds[j];
+			if (pkg->fd_num == SW_BROADCAST_FD_MAX)
+			{
+				if (swServer_multicast_package(serv, pkg, i) < 0)
+				{
+					ret = SW_ERR;
+				}
+				pkg->fd_num = 0;
+			}
+		}
+		if (pkg->fd_num > 0 && swServer_multicast_package(serv, pkg, i) < 0)
+		{
+			ret = SW_ERR;
+		}
+	}
+	return ret;
+}
+
+/**
+ * 发送到多个连接, fds为NULL时发送到所有连接
+ * 进程模式下数据引用send_arena中的同一份拷贝, send_arena不足时退回到逐个复制
+ */
+int swServer_multicast(swServer *serv, int *fds, int fd_num, char *data, int length)
+{
+	swFactory *factory = &(serv->factory);
+	swBuffer_shared *shared;
+	swSendData _send;
+	int *active_fds = NULL;
+	int i, j, n, active_num, ret = SW_OK;
+
+	if (length <= 0)
+	{
+		return SW_ERR;
+	}
+	if (serv->factory_mode == SW_MODE_PROCESS && (shared = swBuffer_shared_new(data, length)) != NULL)
+	{
+		ret = swServer_multicast_shared(serv, shared, fds, fd_num);
+		//释放调用者持有的引用
+		swBuffer_shared_release(shared);
+		return ret;
+	}
+	for (; length > 0; data += n, length -= n)
+	{
+		n = length > SW_BUFFER_SIZE ? SW_BUFFER_SIZE : length;
+		_send.data = data;
+		_send.info.len = n;
+		_send.info.from_fd = 0;
+
+		if (fds != NULL)
+		{
+			_send.info.type = SW_EVENT_TCP;
+			for (j = 0; j < fd_num; j++)
+			{
+				_send.info.fd = fds[j];
+				_send.info.from_id = 0;
+				if (factory->finish(factory, &_send) < 0)
+				{
+					ret = SW_ERR;
+				}
+			}
+			continue;
+		}
+		for (i = 0; i < serv->reactor_num; i++)
+		{
+			_send.info.from_id = i;
+			if (serv->factory_mode == SW_MODE_PROCESS)
+			{
+				_send.info.type = SW_EVENT_BROADCAST;
+				_send.info.fd = 0;
+				if (factory->finish(factory, &_send) < 0)
+				{
+					ret = SW_ERR;
+				}
+				continue;
+			}
+			//同一进程内直接发送, 发送失败会关闭连接, 先复制索引
+			_send.info.type = SW_EVENT_TCP;
+			if ((active_num = swServer_connection_snapshot(serv, i, &active_fds)) < 0)
+			{
+				ret = SW_ERR;
+			}
+			for (j = 0; j < active_num; j++)
+			{
+				_send.info.fd = active_fds[j];
+				if (factory->finish(factory, &_send) < 0)
+				{
+					ret = SW_ERR;
+				}
+			}
+			if (active_fds != NULL)
+			{
+				sw_free(active_fds);
+			}
+		}
+	}
+	return ret;
+}
+
+/**
+ * for udp + tcp
+ */
+int swServer_onFinish2(swFactory *factory, swSendData *resp)
+{
+	swServer *serv = factory->ptr;
+	int ret;
+
+	//UDP
+	if (resp->info.type == SW_EVENT_UDP)
+	{
+		ret = swServer_send_udp_packet(serv, resp);
+	}
+	else
+	{
+		ret = swWrite(resp->info.fd, resp->data, resp->info.len);
+	}
+	if (ret < 0)
+	{
+		swWarn("[Writer]sendto client fail. errno=%d", errno);
+	}
+	return ret;
+}
+
+int swTaskWorker_onTask(swProcessPool *pool, swEventData *task)
+{
+	swServer *serv = pool->ptr;
+	struct timespec start, end;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = serv->onTask(serv, task);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	swServer_worker_stats_add(serv, SwooleWG.id, request_count, 1);
+	swServer_worker_stats_add(serv, SwooleWG.id, busy_usec,
+			(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+	return ret;
+}
+
+/**
+ * 投递到task进程, worker_id小于0时按task_dispatch_mode选择
+ */
+int swTaskWorker_dispatch(swServer *serv, swEventData *task, int worker_id)
+{
+	swProcessPool *pool = &SwooleG.task_workers;
+
+	if (worker_id < 0)
+	{
+		worker_id = swProcessPool_schedule(pool);
+	}
+	//投递到共用队列时不知道由哪个task进程处理
+	if (worker_id >= 0)
+	{
+		swServer_worker_stats_add(serv, serv->worker_num + worker_id, dispatch_count, 1);
+	}
+	return swProcessPool_dispatch(pool, task, worker_id);
+}
+
+/**
+ * 小于SW_BUFFER_SIZE的数据直接复制到task->data,否则保存到task_arena中,只传递句柄
+ */
+int swTaskWorker_pack(swEventData *task, void *data, int data_len)
+{
+	swTaskPackage pkg;
+
+	task->info.from_fd = 0;
+	if (data_len <= sizeof(task->data))
+	{
+		memcpy(task->data, data, data_len);
+		task->info.len = data_len;
+		return SW_OK;
+	}
+	if (SwooleG.task_arena == NULL)
+	{
+		swWarn("task data max_size=%d, please set task_arena_size.", (int) sizeof(task->data));
+		return SW_ERR;
+	}
+	pkg.data = SwooleG.task_arena->alloc(SwooleG.task_arena, data_len);
+	if (pkg.data == NULL)
+	{
+		swWarn("task_arena is full or data is too big. length=%d", data_len);
+		return SW_ERR;
+	}
+	memcpy(pkg.data, data, data_len);
+	pkg.length = data_len;
+
+	memcpy(task->data, &pkg, sizeof(pkg));
+	task->info.len = sizeof(pkg);
+	task->info.from_fd = SW_TASK_SHM;
+	return SW_OK;
+}
+
+void* swTaskWorker_unpack(swEventData *task, int *data_len)
+{
+	swTaskPackage *pkg;
+	if (task->info.from_fd != SW_TASK_SHM)
+	{
+		*data_len = task->info.len;
+		return task->data;
+	}
+	pkg = (swTaskPackage *) task->data;
+	*data_len = pkg->length;
+	return pkg->data;
+}
+
+/**
+ * 数据使用完后释放task_arena中的内存
+ */
+void swTaskWorker_release(swEventData *task)
+{
+	swTaskPackage *pkg;
+	if (task->info.from_fd != SW_TASK_SHM)
+	{
+		return;
+	}
+	pkg = (swTaskPackage *) task->data;
+	SwooleG.task_arena->free(SwooleG.task_arena, pkg->data);
+	task->info.from_fd = 0;
+}
+
+/**
+ * task进程中发往每个worker的结果合并缓存
+ */
+static swPackage_batch *swTaskWorker_batches = NULL;
+
+static int swTaskWorker_send_result(swServer *serv, swEventData *result, int worker_id)
+{
+	if (serv->factory_mode == SW_MODE_PROCESS)
+	{
+		return swFactoryProcess_send2worker(&serv->factory, result, worker_id);
+	}
+	return swWrite(SwooleG.event_workers->workers[worker_id].pipe_worker, result, sizeof(result->info) + result->info.len);
+}
+
+static int swTaskWorker_batch_send(swServer *serv, int worker_id)
+{
+	swPackage_batch *batch = &swTaskWorker_batches[worker_id];
+	int ret;
+
+	if (batch->num == 0)
+	{
+		return SW_OK;
 	}
-
-	//close log file
-	if(serv->log_file[0] != 0)
+	swPackage_batch_pack(batch);
+	if (batch->num > 1)
 	{
-		swLog_free();
+		batch->event.info.type = SW_EVENT_FINISH_BATCH;
 	}
-
-	swoole_clean();
-	return SW_OK;
+	ret = swTaskWorker_send_result(serv, &batch->event, worker_id);
+	swPackage_batch_init(batch, 0, worker_id);
+	return ret;
 }
 
 /**
- * only tcp
+ * 管道中没有待处理的任务, 发送所有合并的结果
  */
-int swServer_onFinish(swFactory *factory, swSendData *resp)
-{
-	return swWrite(resp->info.fd, resp->data, resp->info.len);
-}
-
-int swServer_send_udp_packet(swServer *serv, swSendData *resp)
+static void swTaskWorker_onIdle(swProcessPool *pool)
 {
-	int count, ret;
-	struct sockaddr_in to_addr;
-	to_addr.sin_family = AF_INET;
-	to_addr.sin_port = htons((unsigned short) resp->info.from_id); //from_id is port
-	to_addr.sin_addr.s_addr = resp->info.fd; //from_id is port
-	int sock = resp->info.from_fd;
+	swServer *serv = pool->ptr;
+	int i;
 
-	for (count = 0; count < SW_WORKER_SENDTO_COUNT; count++)
+	for (i = 0; i < serv->worker_num; i++)
 	{
-		ret = sendto(sock, resp->data, resp->info.len, MSG_DONTWAIT, (struct sockaddr *) &to_addr, sizeof(to_addr));
-		if (ret == 0)
-		{
-			break;
-		}
-		else if (errno == EINTR)
-		{
-			continue;
-		}
-		else if (errno == EAGAIN)
-		{
-			swYield();
-		}
-		else
-		{
-			break;
-		}
+		swTaskWorker_batch_send(serv, i);
 	}
-	return ret;
 }
 
 /**
- * for udp + tcp
+ * 非阻塞task的结果发回worker进程, 开启task_finish_batch时先合并
  */
-int swServer_onFinish2(swFactory *factory, swSendData *resp)
+int swTaskWorker_finish(swServer *serv, swEventData *result, int worker_id)
 {
-	swServer *serv = factory->ptr;
-	int ret;
+	swPackage_batch *batch;
 
-	//UDP
-	if (resp->info.from_id >= serv->reactor_num)
+	if (swTaskWorker_batches == NULL)
 	{
-		ret = swServer_send_udp_packet(serv, resp);
+		return swTaskWorker_send_result(serv, result, worker_id);
 	}
-	else
+	batch = &swTaskWorker_batches[worker_id];
+	if (swPackage_batch_append(batch, &result->info, result->data) == SW_OK)
 	{
-		ret = swWrite(resp->info.fd, resp->data, resp->info.len);
+		return SW_OK;
 	}
-	if (ret < 0)
+	if (swTaskWorker_batch_send(serv, worker_id) < 0)
 	{
-		swWarn("[Writer]sendto client fail. errno=%d", errno);
+		return SW_ERR;
 	}
-	return ret;
+	//太大的结果不合并
+	if (swPackage_batch_append(batch, &result->info, result->data) == SW_OK)
+	{
+		return SW_OK;
+	}
+	return swTaskWorker_send_result(serv, result, worker_id);
 }
 
-int swTaskWorker_onTask(swProcessPool *pool, swEventData *task)
+/**
+ * worker进程收到合并的结果, 没有设置onFinishBatch时逐个调用onFinish
+ */
+int swTaskWorker_onFinish_batch(swServer *serv, swEventData *batch)
 {
-	swServer *serv = pool->ptr;
-	return serv->onTask(serv, task);
+	swEventData result;
+	uint32_t offset = 0;
+
+	//有协程在等待task结果时逐个分发
+	if (serv->onFinishBatch != NULL && !serv->enable_coroutine)
+	{
+		return serv->onFinishBatch(serv, batch);
+	}
+	while (offset + sizeof(swDataHead) <= batch->info.len)
+	{
+		memcpy(&result.info, batch->data + offset, sizeof(swDataHead));
+		offset += sizeof(swDataHead);
+		if (offset + result.info.len > batch->info.len)
+		{
+			swWarn("[Worker] finish batch is broken.");
+			return SW_ERR;
+		}
+		memcpy(result.data, batch->data + offset, result.info.len);
+		offset += result.info.len;
+		swTaskWorker_onResult(serv, &result);
+	}
+	return SW_OK;
 }
 
 void swTaskWorker_onWorkerStart(swProcessPool *pool, int worker_id)
 {
 	swServer *serv = pool->ptr;
-	serv->onWorkerStart(serv, worker_id + serv->worker_num);
+	int i;
+
+	SwooleWG.id = worker_id + serv->worker_num;
+	if (serv->task_finish_batch && serv->worker_num > 0)
+	{
+		swTaskWorker_batches = sw_malloc(sizeof(swPackage_batch) * serv->worker_num);
+		if (swTaskWorker_batches == NULL)
+		{
+			swWarn("malloc for finish batch failed.");
+		}
+		else
+		{
+			for (i = 0; i < serv->worker_num; i++)
+			{
+				swPackage_batch_init(&swTaskWorker_batches[i], 0, i);
+			}
+			pool->onIdle = swTaskWorker_onIdle;
+		}
+	}
+	swSlowlog_init(serv->slow_callback_usec, serv->onSlowlog, serv->worker_stats ? &serv->worker_stats[SwooleWG.id].slow_count : NULL);
+	if (serv->onWorkerStart != NULL)
+	{
+		serv->onWorkerStart(serv, worker_id + serv->worker_num);
+	}
 }
 
 int swTaskWorker_onFinish(swReactor *reactor, swEvent *event)
@@ -895,7 +2259,21 @@ int swTaskWorker_onFinish(swReactor *reactor, swEvent *event)
 		n = read(event->fd, &task, sizeof(task));
 	}
 	while(n < 0 && errno == EINTR);
-	return serv->onFinish(serv, &task);
+	if (task.info.type == SW_EVENT_FINISH_BATCH)
+	{
+		return swTaskWorker_onFinish_batch(serv, &task);
+	}
+	return swTaskWorker_onResult(serv, &task);
+}
+
+int swTaskWorker_onResult(swServer *serv, swEventData *result)
+{
+	//swCoroutine_task等待的结果直接恢复协程
+	if (serv->enable_coroutine && swCoroutine_task_finish(result))
+	{
+		return SW_OK;
+	}
+	return serv->onFinish(serv, result);
 }
 
 static int swServer_single_start(swServer *serv)
@@ -916,7 +2294,7 @@ static int swServer_single_start(swServer *serv)
 			//UDP
 			if (listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6)
 			{
-				serv->connection_list[listen_host->sock].addr.sin_port = listen_host->port;
+				serv->connection_info[listen_host->sock].addr.sin_port = listen_host->port;
 			}
 		}
 	}
@@ -939,147 +2317,461 @@ static int swServer_single_start(swServer *serv)
 			swWarn("[Master] create task_workers fail");
 			return SW_ERR;
 		}
-		//设置指针和回调函数
-		SwooleG.task_workers.ptr = serv;
-		SwooleG.task_workers.onTask = swTaskWorker_onTask;
-		if (serv->onWorkerStart != NULL)
+		//设置指针和回调函数
+		SwooleG.task_workers.ptr = serv;
+		SwooleG.task_workers.onTask = swTaskWorker_onTask;
+		SwooleG.task_workers.onWorkerStart = swTaskWorker_onWorkerStart;
+		if (swProcessPool_set_dispatch_mode(&SwooleG.task_workers, serv->task_dispatch_mode) < 0)
+		{
+			return SW_ERR;
+		}
+		swProcessPool_start(&SwooleG.task_workers);
+
+		//将taskworker也加入到wait中来
+		for (i = 0; i < SwooleG.task_workers.worker_num; i++)
+		{
+			swProcessPool_add_worker(&pool, &SwooleG.task_workers.workers[i]);
+		}
+	}
+	swProcessPool_start(&pool);
+	return swProcessPool_wait(&pool);
+}
+
+static int swServer_single_loop(swProcessPool *pool, swWorker *worker)
+{
+	swServer *serv = pool->ptr;
+	swReactor *reactor = &(serv->reactor_threads[0].reactor);
+
+	//create reactor
+	if (swReactor_auto(reactor, SW_REACTOR_MAXEVENTS) < 0)
+	{
+		swWarn("Swoole reactor create fail");
+		return SW_ERR;
+	}
+
+	swListenList_node *listen_host;
+	int type;
+
+	if (serv->worker_num > 1 && swServer_connection_table_fork(serv) < 0)
+	{
+		return SW_ERR;
+	}
+	//listen the all tcp port, SO_REUSEPORT时只监听本进程的socket, 由内核分配连接, 不再争抢accept
+	LL_FOREACH(serv->listen_list, listen_host)
+	{
+		type = (listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6) ? SW_FD_UDP : SW_FD_LISTEN;
+		reactor->add(reactor, listen_host->reuse_socks ? listen_host->reuse_socks[worker->id] : listen_host->sock, type);
+	}
+	SwooleG.main_reactor = reactor;
+
+	reactor->id = 0;
+	reactor->ptr = serv;
+	reactor->slow_usec = serv->slow_callback_usec;
+	reactor->slow_count = serv->reactor_stats ? &serv->reactor_stats[0].slow_count : NULL;
+	swSlowlog_init(serv->slow_callback_usec, serv->onSlowlog, NULL);
+
+	//set event handler
+	//connect
+	reactor->setHandle(reactor, SW_FD_LISTEN, swServer_master_onAccept);
+	//close
+	reactor->setHandle(reactor, SW_FD_CLOSE, swServer_single_onClose);
+	//task finish
+	reactor->setHandle(reactor, SW_FD_PIPE, swTaskWorker_onFinish);
+	//udp receive
+	reactor->setHandle(reactor, SW_FD_UDP, swReactorThread_onPackage);
+#ifdef SW_USE_OPENSSL
+	//tls handshake
+	reactor->setHandle(reactor, SW_FD_SSL, swReactorThread_onHandshake);
+	reactor->setHandle(reactor, SW_FD_SSL | SW_EVENT_WRITE, swReactorThread_onHandshake);
+#endif
+	//tcp receive
+	if (serv->open_eof_check == 1)
+	{
+		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_buffer_check_eof);
+	}
+	else if(serv->open_length_check == 1)
+	{
+		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_buffer_check_length);
+	}
+	else if (serv->open_http_protocol == 1)
+	{
+		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_http);
+	}
+	else if (serv->open_redis_protocol == 1)
+	{
+		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_redis);
+	}
+	else
+	{
+		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_no_buffer);
+	}
+	//pipe
+	reactor->add(reactor, worker->pipe_master, SW_FD_PIPE);
+
+#ifdef HAVE_SIGNALFD
+	swSignalfd_setup(reactor);
+#endif
+
+	reactor->onFinish = swServer_single_onReactorFinish;
+	reactor->onTimeout = swServer_single_onReactorFinish;
+
+	//更新系统时间
+	swClock_update();
+
+	struct timeval timeo;
+	if (serv->onWorkerStart != NULL)
+	{
+		serv->onWorkerStart(serv, worker->id);
+	}
+	timeo.tv_sec = SW_MAINREACTOR_TIMEO;
+	timeo.tv_usec = 0;
+	reactor->wait(reactor, &timeo);
+
+	return SW_OK;
+}
+
+static int swServer_single_onClose(swReactor *reactor, swEvent *event)
+{
+	swServer *serv = reactor->ptr;
+	swConnection_close(serv, event->fd, 0);
+
+	if (serv->onClose != NULL)
+	{
+		serv->onClose(serv, event->fd, event->from_id);
+	}
+
+	return SW_OK;
+}
+
+void swServer_signal_init(void)
+{
+#ifdef HAVE_SIGNALFD
+	swSignalfd_add(SIGHUP, NULL);
+	swSignalfd_add(SIGPIPE, NULL);
+	if (SwooleG.serv->daemonize)
+	{
+		swSignalfd_add(SIGINT, NULL);
+	}
+	swSignalfd_add(SIGUSR1, swServer_signal_hanlder);
+	swSignalfd_add(SIGUSR2, swServer_signal_hanlder);
+	swSignalfd_add(SIGTERM, swServer_signal_hanlder);
+	swSignalfd_add(SIGALRM, swTimer_signal_handler);
+	//for test
+	swSignalfd_add(SIGVTALRM, swServer_signal_hanlder);
+#else
+	swSignal_set(SIGHUP, SIG_IGN, 1, 0);
+	swSignal_set(SIGPIPE, SIG_IGN, 1, 0);
+	if (SwooleG.serv->daemonize)
+	{
+		swSignal_set(SIGINT, SIG_IGN, 1, 0);
+	}
+	swSignal_set(SIGUSR1, swServer_signal_hanlder, 1, 0);
+	swSignal_set(SIGUSR2, swServer_signal_hanlder, 1, 0);
+	swSignal_set(SIGTERM, swServer_signal_hanlder, 1, 0);
+	swSignal_set(SIGVTALRM, swServer_signal_hanlder, 1, 0);
+#endif
+}
+
+/**
+ * 计算每个分组的起始worker, serv->worker_num变为所有分组的worker总数
+ */
+static void swServer_worker_group_init(swServer *serv)
+{
+	swWorkerGroup *group = &serv->worker_groups[0];
+	int i;
+
+	if (serv->worker_group_num > 1 && serv->factory_mode != SW_MODE_PROCESS)
+	{
+		swWarn("worker group only supports process mode.");
+		serv->worker_group_num = 1;
+	}
+	strcpy(group->name, "default");
+	group->offset = 0;
+	group->worker_num = serv->worker_num;
+	group->dispatch_mode = serv->dispatch_mode;
+	group->max_request = serv->max_request;
+
+	for (i = 1; i < serv->worker_group_num; i++)
+	{
+		serv->worker_groups[i].offset = serv->worker_groups[i - 1].offset + serv->worker_groups[i - 1].worker_num;
+	}
+	group = &serv->worker_groups[serv->worker_group_num - 1];
+	serv->worker_num = group->offset + group->worker_num;
+
+	for (i = 0; i < serv->worker_group_num; i++)
+	{
+		//按key分配时每个包可能投递到不同的worker
+		if (serv->worker_groups[i].dispatch_mode == SW_DISPATCH_KEY)
+		{
+			serv->disable_package_batch = 1;
+		}
+	}
+	//合并投递的消息只能发给一个worker
+	if (serv->disable_package_batch || serv->worker_group_num > 1)
+	{
+		serv->dispatch_batch = 0;
+	}
+}
+
+/**
+ * 增加一个worker分组, 必须在swServer_create之前调用, 返回分组的id
+ */
+int swServer_add_worker_group(swServer *serv, char *name, int worker_num, int dispatch_mode, int max_request)
+{
+	swWorkerGroup *group;
+
+	if (serv->worker_group_num >= SW_MAX_WORKER_GROUP)
+	{
+		swWarn("too many worker groups, max is %d.", SW_MAX_WORKER_GROUP);
+		return SW_ERR;
+	}
+	if (worker_num < 1)
+	{
+		swWarn("worker group[%s] worker_num must be greater than 0.", name);
+		return SW_ERR;
+	}
+	group = &serv->worker_groups[serv->worker_group_num];
+	bzero(group, sizeof(swWorkerGroup));
+	strncpy(group->name, name, SW_WORKER_GROUP_NAMELEN - 1);
+	group->worker_num = worker_num;
+	group->dispatch_mode = dispatch_mode;
+	group->max_request = max_request;
+	return serv->worker_group_num++;
+}
+
+/**
+ * 监听端口port上的请求投递到name分组
+ */
+int swServer_bind_worker_group(swServer *serv, int port, char *name)
+{
+	swListenList_node *listen_host;
+	int i, found = 0;
+
+	for (i = 0; i < serv->worker_group_num; i++)
+	{
+		if (i > 0 && strncmp(serv->worker_groups[i].name, name, SW_WORKER_GROUP_NAMELEN) == 0)
+		{
+			break;
+		}
+	}
+	if (i == serv->worker_group_num)
+	{
+		swWarn("worker group[%s] not found.", name);
+		return SW_ERR;
+	}
+	LL_FOREACH(serv->listen_list, listen_host)
+	{
+		if (listen_host->port == port)
 		{
-			SwooleG.task_workers.onWorkerStart = swTaskWorker_onWorkerStart;
+			listen_host->worker_group = i;
+			found = 1;
 		}
-		swProcessPool_start(&SwooleG.task_workers);
+	}
+	if (!found)
+	{
+		swWarn("listen port[%d] not found.", port);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
 
-		//将taskworker也加入到wait中来
-		for (i = 0; i < SwooleG.task_workers.worker_num; i++)
+swWorkerGroup* swServer_get_worker_group(swServer *serv, int worker_id)
+{
+	int i;
+	for (i = serv->worker_group_num - 1; i > 0; i--)
+	{
+		if (worker_id >= serv->worker_groups[i].offset)
 		{
-			swProcessPool_add_worker(&pool, &SwooleG.task_workers.workers[i]);
+			break;
 		}
 	}
-	swProcessPool_start(&pool);
-	return swProcessPool_wait(&pool);
+	return &serv->worker_groups[i];
 }
 
-static int swServer_single_loop(swProcessPool *pool, swWorker *worker)
+/**
+ * open_cpu_affinity: 把当前线程绑定到一个CPU, reactor_thread为0时id是worker_id
+ * numa_affinity: reactor线程轮流分布到各个NUMA节点, worker和reactor线程(worker_id % reactor_num)在同一个节点,
+ * 之后首次访问的内存也优先在本节点分配
+ */
+int swServer_set_cpu_affinity(swServer *serv, int reactor_thread, int id)
 {
-	swServer *serv = pool->ptr;
-	swReactor *reactor = &(serv->reactor_threads[0].reactor);
+#ifdef HAVE_CPU_AFFINITY
+	cpu_set_t cpu_set;
+	int cpu;
 
-	//create reactor
-	if (swReactor_auto(reactor, SW_REACTOR_MAXEVENTS) < 0)
+	if (!serv->open_cpu_affinity)
 	{
-		swWarn("Swoole reactor create fail");
+		return SW_OK;
+	}
+	cpu = swServer_affinity_cpu(serv, reactor_thread, id);
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu, &cpu_set);
+	if (0 != pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set))
+	{
+		swWarn("pthread_setaffinity_np set failed. cpu=%d", cpu);
 		return SW_ERR;
 	}
+	if (serv->numa_affinity)
+	{
+		return swoole_numa_prefer((reactor_thread ? id : id % serv->reactor_num) % swoole_numa_node_num());
+	}
+#endif
+	return SW_OK;
+}
 
-	swListenList_node *listen_host;
-	int type;
+#ifdef HAVE_CPU_AFFINITY
+/**
+ * swServer_set_cpu_affinity绑定的CPU
+ */
+static int swServer_affinity_cpu(swServer *serv, int reactor_thread, int id)
+{
+	int node, node_num, reactor_id;
 
-	//listen the all tcp port
-	LL_FOREACH(serv->listen_list, listen_host)
+	if (!serv->numa_affinity)
 	{
-		type = (listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6) ? SW_FD_UDP : SW_FD_LISTEN;
-		reactor->add(reactor, listen_host->sock, type);
+		return id % SW_CPU_NUM;
 	}
-	SwooleG.main_reactor = reactor;
+	node_num = swoole_numa_node_num();
+	reactor_id = reactor_thread ? id : id % serv->reactor_num;
+	node = reactor_id % node_num;
+	//节点上前面的CPU留给reactor线程
+	return reactor_thread ? swoole_numa_node_cpu(node, id / node_num)
+			: swoole_numa_node_cpu(node, (serv->reactor_num + node_num - 1) / node_num + id / node_num);
+}
+#endif
 
-	reactor->id = 0;
-	reactor->ptr = serv;
+/**
+ * incoming_cpu_affinity: 建立CPU到reactor线程的映射, BASE模式由worker进程自己accept, 映射到worker
+ * 一个CPU上绑定了多个线程时使用第一个
+ */
+static int swServer_incoming_cpu_init(swServer *serv)
+{
+#if defined(HAVE_CPU_AFFINITY) && defined(SO_INCOMING_CPU)
+	int i, cpu, cpu_num = SW_CPU_NUM;
+	int reactor_thread = (serv->factory_mode != SW_MODE_SINGLE);
+	int num = reactor_thread ? serv->reactor_num : serv->worker_num;
 
-	//set event handler
-	//connect
-	reactor->setHandle(reactor, SW_FD_LISTEN, swServer_master_onAccept);
-	//close
-	reactor->setHandle(reactor, SW_FD_CLOSE, swServer_single_onClose);
-	//task finish
-	reactor->setHandle(reactor, SW_FD_PIPE, swTaskWorker_onFinish);
-	//udp receive
-	reactor->setHandle(reactor, SW_FD_UDP, swReactorThread_onPackage);
-	//tcp receive
-	if (serv->open_eof_check == 1)
+	if (!serv->incoming_cpu_affinity)
 	{
-		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_buffer_check_eof);
+		return SW_OK;
 	}
-	else if(serv->open_length_check == 1)
+	if (!serv->open_cpu_affinity)
 	{
-		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_buffer_check_length);
+		swWarn("incoming_cpu_affinity requires open_cpu_affinity.");
+		serv->incoming_cpu_affinity = 0;
+		return SW_OK;
 	}
-	else
+	//BASE模式的worker进程共用一个监听socket时, 连接由accept的进程处理
+	if (!reactor_thread && !serv->enable_reuse_port)
 	{
-		reactor->setHandle(reactor, SW_FD_TCP, swReactorThread_onReceive_no_buffer);
+		swWarn("incoming_cpu_affinity requires enable_reuse_port in SWOOLE_BASE mode.");
+		serv->incoming_cpu_affinity = 0;
+		return SW_OK;
 	}
-	//pipe
-	reactor->add(reactor, worker->pipe_master, SW_FD_PIPE);
-
-#ifdef HAVE_SIGNALFD
-	swSignalfd_setup(reactor);
-#endif
-
-	reactor->onFinish = swServer_master_onReactorFinish;
-	reactor->onTimeout = swServer_master_onReactorTimeout;
-
-	//更新系统时间
-	swUpdateTime();
-
-	struct timeval timeo;
-	if (serv->onWorkerStart != NULL)
+	serv->incoming_cpu_map = SwooleG.memory_pool->alloc(SwooleG.memory_pool, cpu_num * sizeof(int16_t));
+	if (serv->incoming_cpu_map == NULL)
 	{
-		serv->onWorkerStart(serv, 0);
+		swWarn("malloc[incoming_cpu_map] failed.");
+		return SW_ERR;
 	}
-	timeo.tv_sec = SW_MAINREACTOR_TIMEO;
-	timeo.tv_usec = 0;
-	reactor->wait(reactor, &timeo);
-
+	for (i = 0; i < cpu_num; i++)
+	{
+		serv->incoming_cpu_map[i] = -1;
+	}
+	for (i = 0; i < num; i++)
+	{
+		cpu = swServer_affinity_cpu(serv, reactor_thread, i);
+		if (cpu >= 0 && cpu < cpu_num && serv->incoming_cpu_map[cpu] < 0)
+		{
+			serv->incoming_cpu_map[cpu] = i;
+		}
+	}
+#else
+	if (serv->incoming_cpu_affinity)
+	{
+		swWarn("SO_INCOMING_CPU is not supported.");
+		serv->incoming_cpu_affinity = 0;
+	}
+#endif
 	return SW_OK;
 }
 
-static int swServer_single_onClose(swReactor *reactor, swEvent *event)
+/**
+ * 收到这个连接的数据包的CPU上绑定的reactor线程, 没有时返回-1
+ */
+static int swServer_incoming_cpu_reactor(swServer *serv, int fd)
 {
-	swServer *serv = reactor->ptr;
-	swConnection_close(serv, event->fd, 0);
+#ifdef SO_INCOMING_CPU
+	int cpu = -1;
+	socklen_t len = sizeof(cpu);
 
-	if (serv->onClose != NULL)
+	if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0 || cpu < 0 || cpu >= SW_CPU_NUM)
 	{
-		serv->onClose(serv, event->fd, event->from_id);
+		return -1;
 	}
-
-	serv->connect_count--;
-	return SW_OK;
+	return serv->incoming_cpu_map[cpu];
+#else
+	return -1;
+#endif
 }
 
-void swServer_signal_init(void)
+/**
+ * SO_REUSEPORT: 用cBPF按软中断所在CPU选择组内的socket, reuse_socks[i]是组内第i个socket
+ * 返回值超出socket数量时内核退回到按四元组hash选择
+ */
+static void swServer_incoming_cpu_attach(swServer *serv, swListenList_node *listen_host)
 {
-#ifdef HAVE_SIGNALFD
-	swSignalfd_add(SIGHUP, NULL);
-	swSignalfd_add(SIGPIPE, NULL);
-	if (SwooleG.serv->daemonize)
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	struct sock_filter *code;
+	struct sock_fprog prog;
+	int i, n = 0, cpu_num = SW_CPU_NUM;
+
+	if (serv->incoming_cpu_map == NULL)
 	{
-		swSignalfd_add(SIGINT, NULL);
+		return;
 	}
-	swSignalfd_add(SIGUSR1, swServer_signal_hanlder);
-	swSignalfd_add(SIGUSR2, swServer_signal_hanlder);
-	swSignalfd_add(SIGTERM, swServer_signal_hanlder);
-	swSignalfd_add(SIGALRM, swTimer_signal_handler);
-	//for test
-	swSignalfd_add(SIGVTALRM, swServer_signal_hanlder);
-#else
-	swSignal_set(SIGHUP, SIG_IGN, 1, 0);
-	swSignal_set(SIGPIPE, SIG_IGN, 1, 0);
-	if (SwooleG.serv->daemonize)
+	if (cpu_num * 2 + 2 > BPF_MAXINSNS)
 	{
-		swSignal_set(SIGINT, SIG_IGN, 1, 0);
+		swWarn("too many cpus for reuseport cBPF program.");
+		return;
 	}
-	swSignal_set(SIGUSR1, swServer_signal_hanlder, 1, 0);
-	swSignal_set(SIGUSR2, swServer_signal_hanlder, 1, 0);
-	swSignal_set(SIGTERM, swServer_signal_hanlder, 1, 0);
-	swSignal_set(SIGVTALRM, swServer_signal_hanlder, 1, 0);
+	code = sw_malloc((cpu_num * 2 + 2) * sizeof(struct sock_filter));
+	if (code == NULL)
+	{
+		return;
+	}
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+	for (i = 0; i < cpu_num; i++)
+	{
+		if (serv->incoming_cpu_map[i] >= 0)
+		{
+			code[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, i, 0, 1);
+			code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, serv->incoming_cpu_map[i]);
+		}
+	}
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	prog.len = n;
+	prog.filter = code;
+	if (setsockopt(listen_host->reuse_socks[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+	{
+		swWarn("setsockopt(SO_ATTACH_REUSEPORT_CBPF) failed. Error: %s[%d]", strerror(errno), errno);
+	}
+	sw_free(code);
 #endif
 }
 
 int swServer_addListen(swServer *serv, int type, char *host, int port)
 {
 	swListenList_node *listen_host = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(swListenList_node));
+	listen_host->ssl = (type & SW_SOCK_SSL) ? 1 : 0;
+	type &= ~SW_SOCK_SSL;
 	listen_host->type = type;
 	listen_host->port = port;
 	listen_host->sock = 0;
+	listen_host->reuse_socks = NULL;
+	listen_host->worker_group = 0;
+	listen_host->latency_sample = -1;
+	memset(listen_host->options, -1, sizeof(listen_host->options));
 	bzero(listen_host->host, SW_HOST_MAXSIZE);
 	strncpy(listen_host->host, host, SW_HOST_MAXSIZE);
 	LL_APPEND(serv->listen_list, listen_host);
@@ -1087,7 +2779,7 @@ int swServer_addListen(swServer *serv, int type, char *host, int port)
 	//UDP需要提前创建好
 	if (type == SW_SOCK_UDP || type == SW_SOCK_UDP6)
 	{
-		int sock = swSocket_listen(type, listen_host->host, port, serv->backlog);
+		int sock = swSocket_listen(type, listen_host->host, port, serv->backlog, 0);
 		if(sock < 0)
 		{
 			return SW_ERR;
@@ -1107,35 +2799,212 @@ int swServer_addListen(swServer *serv, int type, char *host, int port)
 	return SW_OK;
 }
 
+/**
+ * port为0时设置所有端口的默认值, 需要在swServer_listen之前调用
+ */
+int swServer_set_listen_option(swServer *serv, int port, int option, int value)
+{
+	swListenList_node *listen_host;
+	int found = 0;
+
+	if (option < 0 || option >= SW_LISTEN_OPTION_NUM || value < 0
+			|| (option == SW_LISTEN_WEBSOCKET_COMPRESSION && value > 9))
+	{
+		swWarn("listen option[%d]=%d is invalid.", option, value);
+		return SW_ERR;
+	}
+	if (port == 0)
+	{
+		serv->listen_options[option] = value;
+		return SW_OK;
+	}
+	LL_FOREACH(serv->listen_list, listen_host)
+	{
+		if (listen_host->port == port && listen_host->type != SW_SOCK_UDP && listen_host->type != SW_SOCK_UDP6)
+		{
+			listen_host->options[option] = value;
+			found = 1;
+		}
+	}
+	if (!found)
+	{
+		swWarn("listen port[%d] not found.", port);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+/**
+ * 每个端口的SO_REUSEPORT socket数量, process模式每个reactor线程一个, base模式每个worker进程一个
+ */
+static int swServer_reuse_port_num(swServer *serv)
+{
+	return serv->factory_mode == SW_MODE_SINGLE ? serv->worker_num : serv->reactor_num;
+}
+
+/**
+ * 返回最后一个socket
+ */
+static int swServer_listen_reuse_port(swServer *serv, swListenList_node *listen_host)
+{
+	int i, sock = -1;
+
+	listen_host->reuse_socks = SwooleG.memory_pool->alloc(SwooleG.memory_pool, swServer_reuse_port_num(serv) * sizeof(int));
+	if (listen_host->reuse_socks == NULL)
+	{
+		swError("malloc[reuse_socks] failed");
+		return SW_ERR;
+	}
+	for (i = 0; i < swServer_reuse_port_num(serv); i++)
+	{
+		sock = swSocket_listen(listen_host->type, listen_host->host, listen_host->port, serv->backlog, 1);
+		if (sock < 0)
+		{
+			return SW_ERR;
+		}
+		listen_host->reuse_socks[i] = sock;
+		swServer_listen_setopt(serv, listen_host, sock);
+		swConnection_chunk_ref(serv, sock);
+		serv->connection_info[sock].addr.sin_port = listen_host->port;
+		serv->connection_info[sock].worker_group = listen_host->worker_group;
+		serv->connection_info[sock].latency_sample = swServer_listen_latency_sample(serv, listen_host);
+		serv->connection_info[sock].open_ssl = listen_host->ssl;
+		serv->connection_info[sock].websocket_compression = swServer_listen_option(serv, listen_host, SW_LISTEN_WEBSOCKET_COMPRESSION);
+	}
+	listen_host->sock = listen_host->reuse_socks[0];
+	swServer_incoming_cpu_attach(serv, listen_host);
+	return sock;
+}
+
+/**
+ * addListen时创建的UDP socket没有设置SO_REUSEPORT, 关闭后重新创建
+ */
+static int swServer_listen_udp_reuse_port(swServer *serv)
+{
+	swListenList_node *listen_host;
+	int i, bufsize = serv->udp_sock_buffer_size;
+
+#ifndef SO_REUSEPORT
+	return SW_OK;
+#endif
+	LL_FOREACH(serv->listen_list, listen_host)
+	{
+		if (listen_host->type != SW_SOCK_UDP && listen_host->type != SW_SOCK_UDP6)
+		{
+			continue;
+		}
+		close(listen_host->sock);
+		if (swServer_listen_reuse_port(serv, listen_host) < 0)
+		{
+			return SW_ERR;
+		}
+		for (i = 0; i < swServer_reuse_port_num(serv); i++)
+		{
+			setsockopt(listen_host->reuse_socks[i], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+			setsockopt(listen_host->reuse_socks[i], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+		}
+	}
+	return SW_OK;
+}
+
 int swServer_listen(swServer *serv, swReactor *reactor)
 {
 	int sock=-1;
 
 	swListenList_node *listen_host;
 
+#ifndef SO_REUSEPORT
+	if (serv->enable_reuse_port)
+	{
+		swWarn("SO_REUSEPORT is not supported.");
+		serv->enable_reuse_port = 0;
+	}
+#endif
+	//base模式只有一个worker进程时不需要多个socket
+	if (serv->factory_mode == SW_MODE_SINGLE && serv->worker_num <= 1)
+	{
+		serv->enable_reuse_port = 0;
+	}
+	if (swServer_incoming_cpu_init(serv) < 0)
+	{
+		return SW_ERR;
+	}
+
 	LL_FOREACH(serv->listen_list, listen_host)
 	{
+		if (listen_host->ssl)
+		{
+#ifdef SW_USE_OPENSSL
+			if (listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6)
+			{
+				swWarn("SW_SOCK_SSL is not supported for UDP port %d.", listen_host->port);
+				return SW_ERR;
+			}
+			if (serv->ssl_context == NULL)
+			{
+				serv->ssl_context = swSSL_get_context(serv->ssl_cert_file, serv->ssl_key_file, serv->ssl_ciphers);
+				if (serv->ssl_context == NULL)
+				{
+					return SW_ERR;
+				}
+			}
+#else
+			swWarn("SW_SOCK_SSL requires openssl, port %d.", listen_host->port);
+			return SW_ERR;
+#endif
+		}
 		//UDP
 		if (listen_host->type == SW_SOCK_UDP || listen_host->type == SW_SOCK_UDP6)
 		{
 			//设置到fdList中，发送UDP包时需要
+			swConnection_chunk_ref(serv, listen_host->sock);
 			serv->connection_list[listen_host->sock].fd = listen_host->sock;
+			serv->connection_info[listen_host->sock].worker_group = listen_host->worker_group;
+			serv->connection_info[listen_host->sock].latency_sample = swServer_listen_latency_sample(serv, listen_host);
+			if (listen_host->reuse_socks != NULL)
+			{
+				int i;
+				for (i = 0; i < swServer_reuse_port_num(serv); i++)
+				{
+					swConnection_chunk_ref(serv, listen_host->reuse_socks[i]);
+					serv->connection_list[listen_host->reuse_socks[i]].fd = listen_host->reuse_socks[i];
+					serv->connection_info[listen_host->reuse_socks[i]].worker_group = listen_host->worker_group;
+					serv->connection_info[listen_host->reuse_socks[i]].latency_sample = swServer_listen_latency_sample(serv, listen_host);
+				}
+			}
+			continue;
+		}
+		//SO_REUSEPORT, 每个reactor线程一个监听socket, 由reactor线程自己accept
+		if (serv->enable_reuse_port)
+		{
+			sock = swServer_listen_reuse_port(serv, listen_host);
+			if (sock < 0)
+			{
+				LL_DELETE(serv->listen_list, listen_host);
+				return SW_ERR;
+			}
 			continue;
 		}
 		//TCP
-		sock = swSocket_listen(listen_host->type, listen_host->host, listen_host->port, serv->backlog);
+		sock = swSocket_listen(listen_host->type, listen_host->host, listen_host->port, serv->backlog, 0);
 		if (sock < 0)
 		{
 			LL_DELETE(serv->listen_list, listen_host);
 			return SW_ERR;
 		}
+		swServer_listen_setopt(serv, listen_host, sock);
 		if(reactor!=NULL)
 		{
 			reactor->add(reactor, sock, SW_FD_LISTEN);
 		}
 		listen_host->sock = sock;
 		//将server socket也放置到connection_list中
-		serv->connection_list[sock].addr.sin_port = listen_host->port;
+		swConnection_chunk_ref(serv, sock);
+		serv->connection_info[sock].addr.sin_port = listen_host->port;
+		serv->connection_info[sock].worker_group = listen_host->worker_group;
+		serv->connection_info[sock].latency_sample = swServer_listen_latency_sample(serv, listen_host);
+		serv->connection_info[sock].open_ssl = listen_host->ssl;
+		serv->connection_info[sock].websocket_compression = swServer_listen_option(serv, listen_host, SW_LISTEN_WEBSOCKET_COMPRESSION);
 	}
 	//将最后一个fd作为minfd和maxfd
 	if (sock>=0)
@@ -1192,65 +3061,3 @@ static void swServer_signal_hanlder(int sig)
 		break;
 	}
 }
-
-static void swServer_heartbeat_start(swServer *serv)
-{
-	swThreadParam *heartbeat_param;
-	pthread_t heartbeat_pidt;
-	heartbeat_param = SwooleG.memory_pool->alloc(SwooleG.memory_pool, sizeof(swThreadParam));
-	if (heartbeat_param == NULL)
-	{
-		swError("heartbeat_param malloc fail\n");
-		return;
-	}
-	heartbeat_param->object = serv;
-	heartbeat_param->pti = 0;
-	if(pthread_create(&heartbeat_pidt, NULL, (void * (*)(void *)) swServer_heartbeat_check, (void *) heartbeat_param) < 0)
-	{
-		swWarn("pthread_create[hbcheck] fail");
-	}
-	SwooleG.heartbeat_pidt = heartbeat_pidt;
-	pthread_detach(SwooleG.heartbeat_pidt);
-}
-
-static void swServer_heartbeat_check(swThreadParam *heartbeat_param)
-{
-	swEvent notify_ev;
-	swServer *serv;
-	swFactory *factory;
-	swConnection *conn;
-
-	int fd;
-	int serv_max_fd;
-	int serv_min_fd;
-	int checktime;
-
-	notify_ev.len = 0;
-	notify_ev.type = SW_EVENT_TCP;
-
-	while (SwooleG.running)
-	{
-		serv = heartbeat_param->object;
-		factory = &serv->factory;
-
-		serv_max_fd = swServer_get_maxfd(serv);
-		serv_min_fd = swServer_get_minfd(serv);
-
-		checktime = (int) time(NULL) - serv->heartbeat_idle_time;
-
-		//遍历到最大fd
-		for (fd = serv_min_fd; fd <= serv_max_fd; fd++)
-		{
-			swTrace("check fd=%d", fd);
-			conn = swServer_get_connection(serv, fd);
-			if (conn != NULL && 1 == conn->active && conn->last_time < checktime)
-			{
-				notify_ev.from_id = conn->from_id;
-				notify_ev.fd = fd;
-				factory->finish(factory, (swSendData *) &notify_ev);
-			}
-		}
-		sleep(serv->heartbeat_check_interval);
-	}
-	pthread_exit(0);
-}
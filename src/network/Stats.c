@@ -0,0 +1,396 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "Server.h"
+#include <stdarg.h>
+
+static int swServer_stats_printf(swString *buf, const char *format, ...);
+static int swServer_latency_enable(swServer *serv);
+
+static __thread uint32_t swServer_latency_counter = 0;
+
+int swServer_stats_create(swServer *serv)
+{
+	int worker_num = serv->worker_num + serv->task_worker_num;
+	size_t size = sizeof(swServerStats) + sizeof(swReactorStats) * serv->reactor_num
+			+ sizeof(swWorkerStats) * worker_num + SW_CACHELINE_SIZE;
+	void *mem = sw_shm_calloc(1, size);
+
+	if (mem == NULL)
+	{
+		swWarn("alloc for server stats failed.");
+		return SW_ERR;
+	}
+	//按cache line对齐
+	mem = (void *) (((uintptr_t) mem + SW_CACHELINE_SIZE - 1) & ~((uintptr_t) SW_CACHELINE_SIZE - 1));
+	serv->stats = mem;
+	serv->reactor_stats = (swReactorStats *) (serv->stats + 1);
+	serv->worker_stats = (swWorkerStats *) (serv->reactor_stats + serv->reactor_num);
+	serv->stats->start_time = time(NULL);
+
+	if (!swServer_latency_enable(serv))
+	{
+		return SW_OK;
+	}
+	//histogram较大, 只在有端口开启采样时分配
+	size = sizeof(swWorkerLatency) * worker_num + sizeof(swReactorLatency) * serv->reactor_num + SW_CACHELINE_SIZE;
+	mem = sw_shm_calloc(1, size);
+	if (mem == NULL)
+	{
+		swWarn("alloc for latency histogram failed.");
+		return SW_ERR;
+	}
+	mem = (void *) (((uintptr_t) mem + SW_CACHELINE_SIZE - 1) & ~((uintptr_t) SW_CACHELINE_SIZE - 1));
+	serv->worker_latency = mem;
+	serv->reactor_latency = (swReactorLatency *) (serv->worker_latency + worker_num);
+	return SW_OK;
+}
+
+static int swServer_latency_enable(swServer *serv)
+{
+	swListenList_node *listen_host;
+
+	LL_FOREACH(serv->listen_list, listen_host)
+	{
+		if (listen_host->latency_sample > 0 || (listen_host->latency_sample < 0 && serv->latency_sample > 0))
+		{
+			return SW_TRUE;
+		}
+	}
+	return SW_FALSE;
+}
+
+int swServer_set_latency_sample(swServer *serv, int port, int sample)
+{
+	swListenList_node *listen_host;
+	int found = 0;
+
+	if (sample < 0 || sample > UINT16_MAX)
+	{
+		swWarn("latency_sample[%d] is invalid.", sample);
+		return SW_ERR;
+	}
+	if (port == 0)
+	{
+		serv->latency_sample = sample;
+		return SW_OK;
+	}
+	LL_FOREACH(serv->listen_list, listen_host)
+	{
+		if (listen_host->port == port)
+		{
+			listen_host->latency_sample = sample;
+			found = 1;
+		}
+	}
+	if (!found)
+	{
+		swWarn("listen port[%d] not found.", port);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+uint32_t swServer_latency_stamp(swServer *serv, swDataHead *info)
+{
+	uint16_t sample;
+
+	if (serv->worker_latency == NULL && serv->overload_target_usec == 0)
+	{
+		return 0;
+	}
+	switch (info->type)
+	{
+	case SW_EVENT_TCP:
+	case SW_EVENT_PACKAGE_START:
+	case SW_EVENT_PACKAGE_TRUNK:
+	case SW_EVENT_PACKAGE_END:
+	case SW_EVENT_PACKAGE_VIEW:
+	case SW_EVENT_PACKAGE_BATCH:
+		sample = serv->connection_info[info->fd].latency_sample;
+		break;
+	//UDP的fd不是连接, 使用监听socket的设置
+	case SW_EVENT_UDP:
+		sample = serv->connection_info[info->from_fd].latency_sample;
+		break;
+	default:
+		return 0;
+	}
+	if (serv->worker_latency != NULL && sample > 0 && ++swServer_latency_counter % sample == 0)
+	{
+		//奇数为采样的请求, 0表示不采样
+		return (uint32_t) swClock_usec() | 1;
+	}
+	//过载保护需要每个请求的排队延迟, 不采样的为非0偶数
+	if (serv->overload_target_usec > 0)
+	{
+		return ((uint32_t) swClock_usec() | 2) & ~1;
+	}
+	return 0;
+}
+
+void swServer_overload_record(swServer *serv, uint32_t now, uint32_t sojourn)
+{
+	swWorkerStats *ws = &serv->worker_stats[SwooleWG.id];
+
+	//有一个请求低于目标就不是过载, 短暂的突发不会触发
+	if (sojourn < serv->overload_target_usec)
+	{
+		SwooleWG.overload_deadline = 0;
+		if (ws->overload)
+		{
+			ws->overload = 0;
+		}
+	}
+	else if (SwooleWG.overload_deadline == 0)
+	{
+		SwooleWG.overload_deadline = (now + serv->overload_interval_usec) | 1;
+	}
+	else if (!ws->overload && (int32_t) (now - SwooleWG.overload_deadline) >= 0)
+	{
+		ws->overload = 1;
+	}
+}
+
+int swServer_overloaded(swServer *serv)
+{
+	static __thread uint64_t check_msec = 0;
+	static __thread int overloaded = 0;
+	swWorkerStats *ws;
+	int i;
+
+	if (serv->overload_target_usec == 0 || serv->worker_stats == NULL)
+	{
+		return 0;
+	}
+	//每个线程每毫秒最多扫描一次
+	if (SwooleTG.clock_msec == check_msec)
+	{
+		return overloaded;
+	}
+	check_msec = SwooleTG.clock_msec;
+	overloaded = 1;
+	for (i = 0, ws = serv->worker_stats; i < serv->worker_num; i++, ws++)
+	{
+		//被拒绝后worker收不到新请求, 队列排空就不再算过载
+		if (!ws->overload || ws->dispatch_count == ws->request_count)
+		{
+			overloaded = 0;
+			break;
+		}
+	}
+	return overloaded;
+}
+
+void swServer_overload_reject(swServer *serv, int reactor_id, int fd, int reply)
+{
+	char buf[SW_BUFFER_SIZE];
+	int i;
+
+	for (i = 0; i < SW_OVERLOAD_DRAIN_COUNT; i++)
+	{
+		if (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) <= 0)
+		{
+			break;
+		}
+	}
+	if (reply && serv->overload_response_length > 0)
+	{
+		//写不下的部分丢弃, 不进入out_buffer
+		send(fd, serv->overload_response, serv->overload_response_length, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+	swServer_reactor_stats_add(serv, reactor_id, overload_count, 1);
+}
+
+int swServer_latency_merge(swServer *serv, int type, swHistogram *out)
+{
+	int i, worker_num = serv->worker_num + serv->task_worker_num;
+
+	bzero(out, sizeof(swHistogram));
+	if (serv->worker_latency == NULL)
+	{
+		return SW_ERR;
+	}
+	switch (type)
+	{
+	case SW_LATENCY_QUEUE:
+		for (i = 0; i < worker_num; i++)
+		{
+			swHistogram_merge(out, &serv->worker_latency[i].queue);
+		}
+		break;
+	case SW_LATENCY_HANDLER:
+		for (i = 0; i < worker_num; i++)
+		{
+			swHistogram_merge(out, &serv->worker_latency[i].handler);
+		}
+		break;
+	case SW_LATENCY_SEND:
+		for (i = 0; i < serv->reactor_num; i++)
+		{
+			swHistogram_merge(out, &serv->reactor_latency[i].send);
+		}
+		break;
+	case SW_LATENCY_TOTAL:
+		for (i = 0; i < serv->reactor_num; i++)
+		{
+			swHistogram_merge(out, &serv->reactor_latency[i].total);
+		}
+		break;
+	default:
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+int swServer_stats_dump(swServer *serv, swString *buf)
+{
+	swReactorStats *rs;
+	swWorkerStats *ws;
+	int i, worker_num = serv->worker_num + serv->task_worker_num;
+
+	if (serv->stats == NULL)
+	{
+		return SW_ERR;
+	}
+
+#define SW_STATS_REACTOR(name, type, field) \
+	swServer_stats_printf(buf, "# TYPE swoole_reactor_" name " " type "\n"); \
+	for (i = 0, rs = serv->reactor_stats; i < serv->reactor_num; i++, rs++) \
+	{ \
+		swServer_stats_printf(buf, "swoole_reactor_" name "{reactor=\"%d\"} %lu\n", i, (unsigned long) rs->field); \
+	}
+
+#define SW_STATS_WORKER(name, type, value) \
+	swServer_stats_printf(buf, "# TYPE swoole_worker_" name " " type "\n"); \
+	for (i = 0, ws = serv->worker_stats; i < worker_num; i++, ws++) \
+	{ \
+		swServer_stats_printf(buf, "swoole_worker_" name "{worker=\"%d\",type=\"%s\"} %lu\n", i, \
+				i < serv->worker_num ? "event" : "task", (unsigned long) (value)); \
+	}
+
+	swServer_stats_printf(buf, "# TYPE swoole_start_time_seconds gauge\nswoole_start_time_seconds %ld\n", (long) serv->stats->start_time);
+	swServer_stats_printf(buf, "# TYPE swoole_connections gauge\nswoole_connections %lu\n", (unsigned long) serv->stats->connection_num);
+
+	SW_STATS_REACTOR("accept_total", "counter", accept_count);
+	SW_STATS_REACTOR("close_total", "counter", close_count);
+	SW_STATS_REACTOR("recv_bytes_total", "counter", recv_bytes);
+	SW_STATS_REACTOR("send_bytes_total", "counter", send_bytes);
+	SW_STATS_REACTOR("dispatch_total", "counter", dispatch_count);
+	SW_STATS_REACTOR("eagain_total", "counter", eagain_count);
+	SW_STATS_REACTOR("out_buffer_bytes", "gauge", out_buffer_bytes);
+	SW_STATS_REACTOR("slow_total", "counter", slow_count);
+	SW_STATS_REACTOR("overload_total", "counter", overload_count);
+	SW_STATS_REACTOR("incoming_cpu_total", "counter", incoming_cpu_count);
+
+	SW_STATS_WORKER("dispatch_total", "counter", ws->dispatch_count);
+	SW_STATS_WORKER("request_total", "counter", ws->request_count);
+	//两个计数不是同时读取的, 可能短暂地小于0
+	SW_STATS_WORKER("inflight", "gauge", ws->dispatch_count > ws->request_count ? ws->dispatch_count - ws->request_count : 0);
+	SW_STATS_WORKER("busy_usec_total", "counter", ws->busy_usec);
+	SW_STATS_WORKER("slow_total", "counter", ws->slow_count);
+	SW_STATS_WORKER("overload", "gauge", ws->overload);
+
+#undef SW_STATS_REACTOR
+#undef SW_STATS_WORKER
+
+	if (serv->worker_latency != NULL)
+	{
+		static const char *names[] = {"queue", "handler", "send", "total"};
+		static const double quantiles[] = {50, 90, 99, 99.9};
+		swHistogram h;
+		int j;
+
+		for (i = SW_LATENCY_QUEUE; i <= SW_LATENCY_TOTAL; i++)
+		{
+			swServer_latency_merge(serv, i, &h);
+			swServer_stats_printf(buf, "# TYPE swoole_latency_%s_usec summary\n", names[i]);
+			for (j = 0; j < sizeof(quantiles) / sizeof(quantiles[0]); j++)
+			{
+				swServer_stats_printf(buf, "swoole_latency_%s_usec{quantile=\"%g\"} %lu\n", names[i], quantiles[j] / 100,
+						(unsigned long) swHistogram_percentile(&h, quantiles[j]));
+			}
+			swServer_stats_printf(buf, "swoole_latency_%s_usec_sum %lu\nswoole_latency_%s_usec_count %lu\n", names[i],
+					(unsigned long) h.sum, names[i], (unsigned long) h.count);
+		}
+	}
+	return SW_OK;
+}
+
+/**
+ * 先写临时文件再rename, 抓取时不会读到一半的内容
+ */
+int swServer_stats_write(swServer *serv, char *file)
+{
+	char tmpfile[SW_LOG_FILENAME + 8];
+	swString *buf;
+	int fd, ret;
+
+	buf = swString_new(SW_BUFFER_SIZE);
+	if (buf == NULL)
+	{
+		return SW_ERR;
+	}
+	if (swServer_stats_dump(serv, buf) < 0)
+	{
+		swString_free(buf);
+		return SW_ERR;
+	}
+	snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+	fd = open(tmpfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		swWarn("open(%s) failed. Error: %s[%d]", tmpfile, strerror(errno), errno);
+		swString_free(buf);
+		return SW_ERR;
+	}
+	ret = swWrite(fd, buf->str, buf->length);
+	close(fd);
+	swString_free(buf);
+	if (ret < 0 || rename(tmpfile, file) < 0)
+	{
+		swWarn("write stats to %s failed. Error: %s[%d]", file, strerror(errno), errno);
+		unlink(tmpfile);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+static int swServer_stats_printf(swString *buf, const char *format, ...)
+{
+	va_list args;
+	int n;
+
+	while (1)
+	{
+		va_start(args, format);
+		n = vsnprintf(buf->str + buf->length, buf->size - buf->length, format, args);
+		va_end(args);
+		if (n < 0)
+		{
+			return SW_ERR;
+		}
+		if (buf->length + n < buf->size)
+		{
+			buf->length += n;
+			return SW_OK;
+		}
+		if (swString_extend(buf, buf->size * 2) < 0)
+		{
+			return SW_ERR;
+		}
+	}
+}
@@ -34,14 +34,14 @@ int swThreadPool_create(swThreadPool *pool, int thread_num)
 	swTrace("threads=%p|params=%p", pool->threads, pool->params);
 
 #ifdef SW_THREADPOOL_USE_CHANNEL
-	pool->chan = swChannel_create(1024 * 256, 512, 0);
+	pool->chan = swMPSCChannel_create(SW_MPSC_CHANNEL_SIZE, 0);
 	if (pool->chan == NULL)
 	{
 		swWarn("swThreadPool_create create channel failed");
 		return SW_ERR;
 	}
 #else
-	if (swRingQueue_init(&pool->queue, SW_THREADPOOL_QUEUE_LEN) < 0)
+	if (swMPMCQueue_create(&pool->queue, SW_THREAD_QUEUE_SIZE) < 0)
 	{
 		return SW_ERR;
 	}
@@ -56,25 +56,36 @@ int swThreadPool_create(swThreadPool *pool, int thread_num)
 
 int swThreadPool_dispatch(swThreadPool *pool, void *task, int task_len)
 {
-	int ret;
-	pthread_mutex_lock(&(pool->mutex));
-#ifdef SW_THREADPOOL_USE_CHANNEL
-	ret = swChannel_in(pool->chan, task, task_len);
+#ifndef SW_THREADPOOL_USE_CHANNEL
+	//无锁队列, 只有存在睡眠的线程时才需要唤醒, 队列已满时等待线程消费
+	while (swMPMCQueue_push(&pool->queue, task) < 0)
+	{
+		if (pool->shutdown)
+		{
+			swWarn("swThreadPool push task failed");
+			return SW_ERR;
+		}
+		swYield();
+	}
+	sw_atomic_fetch_add(&pool->task_num, 1);
+	return SW_OK;
 #else
-	ret = swRingQueue_push(&pool->queue, task);
-#endif
-	if ( ret < 0)
+	//channel中保存task指针, 入队不需要加锁, 只有存在等待的线程时才需要signal
+	if (swMPSCChannel_push(pool->chan, &task, sizeof(task)) < 0)
 	{
 		swWarn("swThreadPool push task failed");
-		pthread_mutex_unlock(&(pool->mutex));
 		return SW_ERR;
 	}
-	else
+	sw_atomic_fetch_add(&pool->task_num, 1);
+	sw_atomic_memory_barrier();
+	if (pool->idle_num > 0)
 	{
-		pool->task_num ++;
+		pthread_mutex_lock(&(pool->mutex));
+		pthread_cond_signal(&(pool->cond));
 		pthread_mutex_unlock(&(pool->mutex));
 	}
-	return pthread_cond_signal(&(pool->cond));
+	return SW_OK;
+#endif
 }
 
 int swThreadPool_run(swThreadPool *pool)
@@ -101,7 +112,13 @@ int swThreadPool_free(swThreadPool *pool)
 		return -1;
 	}
 	pool->shutdown = 1;
+#ifdef SW_THREADPOOL_USE_CHANNEL
+	pthread_mutex_lock(&(pool->mutex));
 	pthread_cond_broadcast(&(pool->cond));
+	pthread_mutex_unlock(&(pool->mutex));
+#else
+	swMPMCQueue_wake_all(&pool->queue);
+#endif
 
 	for (i = 0; i < pool->thread_num; i++)
 	{
@@ -109,9 +126,9 @@ int swThreadPool_free(swThreadPool *pool)
 	}
 
 #ifdef SW_THREADPOOL_USE_CHANNEL
-	swChannel_free(pool->chan);
+	swMPSCChannel_free(pool->chan);
 #else
-	swRingQueue_free(&pool->queue);
+	swMPMCQueue_free(&pool->queue);
 #endif
 
 	pthread_mutex_destroy(&(pool->mutex));
@@ -130,44 +147,47 @@ static void *swThreadPool_loop(void *arg)
 #ifdef SW_DEBUG
 	int id = param->pti;
 #endif
-	int ret;
 
-#ifdef SW_THREADPOOL_USE_CHANNEL
-	char task[SW_BUFFER_SIZE];
-#else
 	void *task;
-#endif
 
 	swTrace("starting thread 0x%lx=%d", pthread_self(), id);
-	while (SwooleG.running)
+#ifndef SW_THREADPOOL_USE_CHANNEL
+	while (SwooleG.running && !pool->shutdown)
 	{
-		pthread_mutex_lock(&(pool->mutex));
-		while (pool->task_num == 0 && !pool->shutdown)
+		if (swMPMCQueue_wait(&pool->queue, &task, SW_THREAD_QUEUE_WAIT) == SW_OK)
 		{
-			swTrace("thread 0x%lx is waiting\n", pthread_self());
-			pthread_cond_wait(&(pool->cond), &(pool->mutex));
+			pool->onTask(pool, task, 0);
+			sw_atomic_fetch_sub(&pool->task_num, 1);
 		}
-
-		if (pool->shutdown)
+	}
+	swTrace("thread [%d] will exit\n", id);
+#else
+	while (SwooleG.running)
+	{
+		//多个线程消费, 出队需要在锁内进行
+		pthread_mutex_lock(&(pool->mutex));
+		while (swMPSCChannel_pop(pool->chan, &task, sizeof(task)) < 0)
 		{
-			pthread_mutex_unlock(&(pool->mutex));
-			swTrace("thread [%d] will exit\n", id);
-			pthread_exit(NULL);
+			if (pool->shutdown)
+			{
+				pthread_mutex_unlock(&(pool->mutex));
+				swTrace("thread [%d] will exit\n", id);
+				pthread_exit(NULL);
+			}
+			sw_atomic_fetch_add(&pool->idle_num, 1);
+			//增加idle_num后重新检查, 避免错过signal
+			if (swMPSCChannel_empty(pool->chan) && !pool->shutdown)
+			{
+				pthread_cond_wait(&(pool->cond), &(pool->mutex));
+			}
+			sw_atomic_fetch_sub(&pool->idle_num, 1);
 		}
+		pthread_mutex_unlock(&(pool->mutex));
 
 		swTrace("thread [%d] is starting to work\n", id);
-
-#ifdef SW_THREADPOOL_USE_CHANNEL
-		ret = swChannel_out(pool->chan, task, SW_BUFFER_SIZE);
-#else
-		ret = swRingQueue_pop(&pool->queue, &task);
-#endif
-		pthread_mutex_unlock(&(pool->mutex));
-		if (ret >= 0)
-		{
-			pool->onTask(pool, (void *)task, ret);
-			pool->task_num --;
-		}
+		pool->onTask(pool, task, 0);
+		sw_atomic_fetch_sub(&pool->task_num, 1);
 	}
+#endif
 	pthread_exit(NULL);
 }
@@ -0,0 +1,177 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "Server.h"
+
+static uint32_t swUdpPeer_hash(struct sockaddr *addr, socklen_t addrlen);
+static int swUdpPeer_equal(swUdpPeer *peer, struct sockaddr *addr, socklen_t addrlen);
+
+swUdpPeerTable* swUdpPeerTable_new(uint32_t size)
+{
+	swUdpPeerTable *table;
+
+	if (size == 0 || (size & (size - 1)) != 0 || size > (1u << SW_UDP_PEER_SLOT_BITS))
+	{
+		swWarn("udp peer table size[%d] must be a power of 2 and not greater than %d.", size, 1u << SW_UDP_PEER_SLOT_BITS);
+		return NULL;
+	}
+	//mmap得到的内存已经初始化为0
+	table = sw_shm_malloc(sizeof(swUdpPeerTable) + sizeof(swUdpPeer) * size);
+	if (table == NULL)
+	{
+		swWarn("malloc for udp peer table failed.");
+		return NULL;
+	}
+	table->size = size;
+	table->mask = size - 1;
+	//base模式多个worker进程共用, 必须是跨进程的锁
+	if (swFutexLock_create(&table->lock, 1) < 0)
+	{
+		swWarn("create udp peer table lock failed.");
+		sw_shm_free(table);
+		return NULL;
+	}
+	return table;
+}
+
+static uint32_t swUdpPeer_hash(struct sockaddr *addr, socklen_t addrlen)
+{
+	uint32_t hash, *words;
+	int i;
+
+	if (addr->sa_family == AF_INET6)
+	{
+		struct sockaddr_in6 *v6 = (struct sockaddr_in6 *) addr;
+		words = (uint32_t *) &v6->sin6_addr;
+		hash = v6->sin6_port;
+		for (i = 0; i < 4; i++)
+		{
+			hash = hash * 31 + words[i];
+		}
+	}
+	else
+	{
+		struct sockaddr_in *v4 = (struct sockaddr_in *) addr;
+		hash = v4->sin_addr.s_addr * 31 + v4->sin_port;
+	}
+	//取模只用低位, 乘法后把高位混入低位, 否则端口的高字节不影响槽位
+	hash *= 2654435761u;
+	return hash ^ (hash >> 16);
+}
+
+static int swUdpPeer_equal(swUdpPeer *peer, struct sockaddr *addr, socklen_t addrlen)
+{
+	if (peer->addrlen != addrlen || peer->addr.inet_v4.sin_family != addr->sa_family)
+	{
+		return SW_FALSE;
+	}
+	if (addr->sa_family == AF_INET6)
+	{
+		struct sockaddr_in6 *v6 = (struct sockaddr_in6 *) addr;
+		return peer->addr.inet_v6.sin6_port == v6->sin6_port
+				&& memcmp(&peer->addr.inet_v6.sin6_addr, &v6->sin6_addr, sizeof(v6->sin6_addr)) == 0;
+	}
+	struct sockaddr_in *v4 = (struct sockaddr_in *) addr;
+	return peer->addr.inet_v4.sin_port == v4->sin_port && peer->addr.inet_v4.sin_addr.s_addr == v4->sin_addr.s_addr;
+}
+
+#define swUdpPeer_fd(slot, version)  (SW_UDP_PEER_FLAG | ((((version) >> 1) & SW_UDP_PEER_VERSION_MASK) << SW_UDP_PEER_SLOT_BITS) | (slot))
+
+/**
+ * 查找对端地址, 不存在时插入, 返回作为fd使用的序号
+ * 已存在的地址不加锁, 只有插入时加锁. 冲突的槽位都被占用时复用第一个槽位, 旧的fd随之失效
+ */
+int swUdpPeerTable_intern(swUdpPeerTable *table, struct sockaddr *addr, socklen_t addrlen)
+{
+	uint32_t hash = swUdpPeer_hash(addr, addrlen);
+	uint32_t i, slot, version;
+	swUdpPeer *peer;
+
+	for (i = 0; i < SW_UDP_PEER_PROBE; i++)
+	{
+		slot = (hash + i) & table->mask;
+		peer = &table->peers[slot];
+		version = peer->version;
+		if (version == 0)
+		{
+			break;
+		}
+		if (!(version & 1) && swUdpPeer_equal(peer, addr, addrlen) && peer->version == version)
+		{
+			return swUdpPeer_fd(slot, version);
+		}
+	}
+
+	table->lock.lock(&table->lock);
+	//加锁后重新查找空闲槽位, 其他线程可能已经插入
+	for (i = 0; i < SW_UDP_PEER_PROBE; i++)
+	{
+		slot = (hash + i) & table->mask;
+		peer = &table->peers[slot];
+		if (peer->version == 0 || swUdpPeer_equal(peer, addr, addrlen))
+		{
+			break;
+		}
+	}
+	if (i == SW_UDP_PEER_PROBE)
+	{
+		slot = hash & table->mask;
+		peer = &table->peers[slot];
+	}
+	if (peer->version == 0 || !swUdpPeer_equal(peer, addr, addrlen))
+	{
+		//版本号为奇数时读取者会丢弃
+		peer->version++;
+		sw_atomic_memory_barrier();
+		memcpy(&peer->addr, addr, addrlen);
+		peer->addrlen = addrlen;
+		sw_atomic_memory_barrier();
+		peer->version++;
+	}
+	version = peer->version;
+	table->lock.unlock(&table->lock);
+	return swUdpPeer_fd(slot, version);
+}
+
+/**
+ * 复制fd对应的对端地址, 槽位已被复用时返回SW_ERR
+ */
+int swUdpPeerTable_get(swUdpPeerTable *table, int fd, swUdpPeer *peer)
+{
+	uint32_t slot = fd & ((1u << SW_UDP_PEER_SLOT_BITS) - 1);
+	uint32_t version;
+	swUdpPeer *node;
+
+	if (!swUdpPeer_is_peer(fd) || slot >= table->size)
+	{
+		return SW_ERR;
+	}
+	node = &table->peers[slot];
+	version = node->version;
+	if ((version & 1) || ((fd >> SW_UDP_PEER_SLOT_BITS) & SW_UDP_PEER_VERSION_MASK) != ((version >> 1) & SW_UDP_PEER_VERSION_MASK))
+	{
+		return SW_ERR;
+	}
+	sw_atomic_memory_barrier();
+	memcpy(peer, node, sizeof(swUdpPeer));
+	sw_atomic_memory_barrier();
+	if (node->version != version)
+	{
+		return SW_ERR;
+	}
+	return SW_OK;
+}
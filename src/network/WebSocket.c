@@ -0,0 +1,475 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "websocket.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef SW_USE_ZLIB
+#include <zlib.h>
+
+/**
+ * 双向no_context_takeover, 每个消息压缩或解压后reset, 同一线程的连接共用
+ */
+typedef struct
+{
+	z_stream deflate;
+	z_stream inflate;
+	uint8_t deflate_init;
+	uint8_t inflate_init;
+	int level;           //deflate当前的压缩级别
+	swString *buffer;    //压缩或解压的结果
+} swWebSocket_zstream;
+
+static __thread swWebSocket_zstream *swWebSocket_zs = NULL;
+#endif
+
+int swWebSocket_decode_frame(swWebSocket_frame *frame, char *buf, uint32_t length)
+{
+	uint8_t *p = (uint8_t *) buf;
+	uint32_t header_length = 2;
+	uint64_t payload_length;
+	int i;
+
+	if (length < 2)
+	{
+		return SW_WEBSOCKET_AGAIN;
+	}
+	//RSV2和RSV3必须为0, 只支持permessage-deflate
+	if (p[0] & 0x30)
+	{
+		return SW_ERR;
+	}
+	frame->fin = p[0] >> 7;
+	frame->compressed = (p[0] & SW_WEBSOCKET_FLAG_RSV1) ? 1 : 0;
+	frame->opcode = p[0] & 0x0f;
+	frame->mask = p[1] >> 7;
+	payload_length = p[1] & 0x7f;
+	if (payload_length == 126)
+	{
+		header_length += 2;
+	}
+	else if (payload_length == 127)
+	{
+		header_length += 8;
+	}
+	if (frame->mask)
+	{
+		header_length += 4;
+	}
+	if (length < header_length)
+	{
+		return SW_WEBSOCKET_AGAIN;
+	}
+	if (payload_length == 126)
+	{
+		payload_length = ((uint64_t) p[2] << 8) | p[3];
+	}
+	else if (payload_length == 127)
+	{
+		payload_length = 0;
+		for (i = 2; i < 10; i++)
+		{
+			payload_length = (payload_length << 8) | p[i];
+		}
+		//最高位必须为0
+		if (payload_length >> 63)
+		{
+			return SW_ERR;
+		}
+	}
+	if (frame->mask)
+	{
+		memcpy(frame->mask_key, buf + header_length - 4, 4);
+	}
+	frame->header_length = header_length;
+	frame->payload_length = payload_length;
+
+	//控制帧不能分片, 不能压缩, 负载不超过125字节
+	if (frame->opcode & 0x8)
+	{
+		if (frame->opcode > SW_WEBSOCKET_OPCODE_PONG || !frame->fin || frame->compressed
+				|| payload_length > SW_WEBSOCKET_CONTROL_MAX)
+		{
+			return SW_ERR;
+		}
+	}
+	else if (frame->opcode > SW_WEBSOCKET_OPCODE_BINARY)
+	{
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+int swWebSocket_encode_header(char *buf, uint8_t opcode, uint8_t fin, uint64_t length)
+{
+	uint8_t *p = (uint8_t *) buf;
+	int i;
+
+	p[0] = (fin ? 0x80 : 0) | (opcode & 0x0f);
+	if (length < 126)
+	{
+		p[1] = length;
+		return 2;
+	}
+	else if (length <= 0xffff)
+	{
+		p[1] = 126;
+		p[2] = length >> 8;
+		p[3] = length & 0xff;
+		return 4;
+	}
+	p[1] = 127;
+	for (i = 0; i < 8; i++)
+	{
+		p[2 + i] = (length >> (56 - i * 8)) & 0xff;
+	}
+	return 10;
+}
+
+void swWebSocket_unmask(char *data, uint64_t length, char *mask_key)
+{
+	uint64_t i = 0, key64, value;
+	uint32_t key32;
+
+	memcpy(&key32, mask_key, 4);
+#ifdef __SSE2__
+	if (length >= 16)
+	{
+		__m128i key = _mm_set1_epi32(key32);
+		__m128i block;
+		for (; i + 16 <= length; i += 16)
+		{
+			block = _mm_loadu_si128((__m128i *) (data + i));
+			_mm_storeu_si128((__m128i *) (data + i), _mm_xor_si128(block, key));
+		}
+	}
+#endif
+	//i始终是4的倍数, 掩码的字节顺序与内存一致
+	key64 = ((uint64_t) key32 << 32) | key32;
+	for (; i + 8 <= length; i += 8)
+	{
+		memcpy(&value, data + i, 8);
+		value ^= key64;
+		memcpy(data + i, &value, 8);
+	}
+	for (; i < length; i++)
+	{
+		data[i] ^= mask_key[i & 3];
+	}
+}
+
+static swHttp_header* swWebSocket_find_header(swHttpRequest *req, char *data, char *name, int name_len)
+{
+	int i;
+	for (i = 0; i < req->header_num; i++)
+	{
+		if (req->headers[i].name.length == name_len && strncasecmp(data + req->headers[i].name.offset, name, name_len) == 0)
+		{
+			return &req->headers[i];
+		}
+	}
+	return NULL;
+}
+
+int swWebSocket_is_upgrade(swHttpRequest *req, char *data)
+{
+	swHttp_header *header = swWebSocket_find_header(req, data, SW_STRL("Upgrade") - 1);
+	if (header == NULL)
+	{
+		return SW_FALSE;
+	}
+	return swHttp_has_token(data + header->value.offset, header->value.length, SW_STRL("websocket") - 1);
+}
+
+int swWebSocket_handshake(swHttpRequest *req, char *data, char *accept)
+{
+	char buf[SW_WEBSOCKET_KEY_MAX + sizeof(SW_WEBSOCKET_GUID)];
+	unsigned char digest[20];
+	swHttp_header *header;
+
+	if (req->method != SW_HTTP_GET || req->version != 11 || req->content_length > 0 || req->chunked)
+	{
+		return SW_ERR;
+	}
+	header = swWebSocket_find_header(req, data, SW_STRL("Connection") - 1);
+	if (header == NULL || !swHttp_has_token(data + header->value.offset, header->value.length, SW_STRL("upgrade") - 1))
+	{
+		return SW_ERR;
+	}
+	header = swWebSocket_find_header(req, data, SW_STRL("Sec-WebSocket-Version") - 1);
+	if (header == NULL || header->value.length != 2 || memcmp(data + header->value.offset, "13", 2) != 0)
+	{
+		return SW_ERR;
+	}
+	header = swWebSocket_find_header(req, data, SW_STRL("Sec-WebSocket-Key") - 1);
+	if (header == NULL || header->value.length == 0 || header->value.length > SW_WEBSOCKET_KEY_MAX)
+	{
+		return SW_ERR;
+	}
+	memcpy(buf, data + header->value.offset, header->value.length);
+	memcpy(buf + header->value.length, SW_WEBSOCKET_GUID, sizeof(SW_WEBSOCKET_GUID) - 1);
+	swoole_sha1(buf, header->value.length + sizeof(SW_WEBSOCKET_GUID) - 1, digest);
+	swoole_base64_encode(digest, sizeof(digest), accept);
+	return SW_OK;
+}
+
+static int swWebSocket_is_token(char *start, char *end, char *token, int token_len)
+{
+	while (start < end && (*start == ' ' || *start == '\t'))
+	{
+		start++;
+	}
+	while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+	{
+		end--;
+	}
+	return end - start == token_len && strncasecmp(start, token, token_len) == 0;
+}
+
+/**
+ * 一个offer: 扩展名和以;分隔的参数
+ * server_max_window_bits需要在回复中确认窗口大小, 带有这个参数或未知参数的offer不接受
+ */
+static int swWebSocket_deflate_offer(char *p, char *end)
+{
+	char *param, *eq;
+	int i;
+
+	for (i = 0; p < end; i++, p++)
+	{
+		param = p;
+		while (p < end && *p != ';')
+		{
+			p++;
+		}
+		if (i == 0)
+		{
+			if (!swWebSocket_is_token(param, p, SW_STRL("permessage-deflate") - 1))
+			{
+				return SW_FALSE;
+			}
+			continue;
+		}
+		//client_max_window_bits只表示客户端支持这个参数, 不回复时客户端使用15
+		eq = memchr(param, '=', p - param);
+		if (eq != NULL)
+		{
+			if (!swWebSocket_is_token(param, eq, SW_STRL("client_max_window_bits") - 1))
+			{
+				return SW_FALSE;
+			}
+		}
+		else if (!swWebSocket_is_token(param, p, SW_STRL("client_max_window_bits") - 1)
+				&& !swWebSocket_is_token(param, p, SW_STRL("server_no_context_takeover") - 1)
+				&& !swWebSocket_is_token(param, p, SW_STRL("client_no_context_takeover") - 1))
+		{
+			return SW_FALSE;
+		}
+	}
+	return i > 0;
+}
+
+int swWebSocket_accept_deflate(swHttpRequest *req, char *data)
+{
+	swHttp_header *header = swWebSocket_find_header(req, data, SW_STRL("Sec-WebSocket-Extensions") - 1);
+	char *p, *end, *offer;
+
+	if (header == NULL)
+	{
+		return SW_FALSE;
+	}
+	p = data + header->value.offset;
+	end = p + header->value.length;
+	//按客户端的优先顺序
+	while (p < end)
+	{
+		offer = p;
+		while (p < end && *p != ',')
+		{
+			p++;
+		}
+		if (swWebSocket_deflate_offer(offer, p))
+		{
+			return SW_TRUE;
+		}
+		p++;
+	}
+	return SW_FALSE;
+}
+
+#ifdef SW_USE_ZLIB
+/**
+ * 上一次的结果超过SW_WEBSOCKET_DEFLATE_BUFFER_MAX时先释放, 大消息不会一直占用线程的内存
+ */
+static swWebSocket_zstream* swWebSocket_get_zstream(void)
+{
+	swWebSocket_zstream *zs = swWebSocket_zs;
+
+	if (zs == NULL)
+	{
+		zs = sw_malloc(sizeof(swWebSocket_zstream));
+		if (zs == NULL)
+		{
+			swWarn("malloc for websocket zstream failed.");
+			return NULL;
+		}
+		bzero(zs, sizeof(swWebSocket_zstream));
+		swWebSocket_zs = zs;
+	}
+	if (zs->buffer != NULL && zs->buffer->size > SW_WEBSOCKET_DEFLATE_BUFFER_MAX)
+	{
+		swString_free(zs->buffer);
+		zs->buffer = NULL;
+	}
+	if (zs->buffer == NULL)
+	{
+		zs->buffer = swString_new(SW_WEBSOCKET_DEFLATE_BUFFER_SIZE);
+		if (zs->buffer == NULL)
+		{
+			return NULL;
+		}
+	}
+	zs->buffer->length = 0;
+	return zs;
+}
+
+swString* swWebSocket_deflate(char *data, uint32_t length, int level)
+{
+	swWebSocket_zstream *zs = swWebSocket_get_zstream();
+	swString *buffer;
+	z_stream *strm;
+	size_t bound;
+	int ret;
+
+	if (zs == NULL)
+	{
+		return NULL;
+	}
+	strm = &zs->deflate;
+	buffer = zs->buffer;
+	if (!zs->deflate_init)
+	{
+		if (deflateInit2(strm, level, Z_DEFLATED, -SW_WEBSOCKET_DEFLATE_WINDOW_BITS, SW_WEBSOCKET_DEFLATE_MEM_LEVEL,
+				Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			swWarn("deflateInit2() failed.");
+			return NULL;
+		}
+		zs->deflate_init = 1;
+		zs->level = level;
+	}
+	//reset之后没有待输出的数据, 修改级别不会产生输出
+	else if (zs->level != level)
+	{
+		deflateParams(strm, level, Z_DEFAULT_STRATEGY);
+		zs->level = level;
+	}
+	//Z_SYNC_FLUSH在deflateBound之外还有一个空的stored块
+	bound = deflateBound(strm, length) + 16;
+	if (bound > buffer->size && swString_extend(buffer, bound) < 0)
+	{
+		return NULL;
+	}
+	strm->next_in = (Bytef *) data;
+	strm->avail_in = length;
+	strm->next_out = (Bytef *) buffer->str;
+	strm->avail_out = buffer->size;
+	ret = deflate(strm, Z_SYNC_FLUSH);
+	buffer->length = buffer->size - strm->avail_out;
+	deflateReset(strm);
+
+	if (ret != Z_OK || strm->avail_in != 0 || strm->avail_out == 0 || buffer->length < 4)
+	{
+		swWarn("deflate() failed. ret=%d", ret);
+		return NULL;
+	}
+	buffer->length -= 4;
+	return buffer;
+}
+
+swString* swWebSocket_inflate(char *data, uint32_t length, uint32_t max_length)
+{
+	static char tail[4] = {0x00, 0x00, (char) 0xff, (char) 0xff};
+	swWebSocket_zstream *zs = swWebSocket_get_zstream();
+	swString *buffer;
+	z_stream *strm;
+	size_t new_size;
+	int i, ret = Z_OK;
+
+	if (zs == NULL)
+	{
+		return NULL;
+	}
+	strm = &zs->inflate;
+	buffer = zs->buffer;
+	//客户端可能使用最大的窗口
+	if (!zs->inflate_init)
+	{
+		if (inflateInit2(strm, -15) != Z_OK)
+		{
+			swWarn("inflateInit2() failed.");
+			return NULL;
+		}
+		zs->inflate_init = 1;
+	}
+	//补上发送端去掉的00 00 ff ff
+	for (i = 0; i < 2 && ret != Z_STREAM_END; i++)
+	{
+		strm->next_in = (Bytef *) (i == 0 ? data : tail);
+		strm->avail_in = i == 0 ? length : sizeof(tail);
+		do
+		{
+			if (buffer->length == buffer->size)
+			{
+				if (buffer->size >= max_length)
+				{
+					inflateReset(strm);
+					errno = E2BIG;
+					return NULL;
+				}
+				new_size = buffer->size * 2 > max_length ? max_length : buffer->size * 2;
+				if (swString_extend(buffer, new_size) < 0)
+				{
+					inflateReset(strm);
+					errno = ENOMEM;
+					return NULL;
+				}
+			}
+			strm->next_out = (Bytef *) (buffer->str + buffer->length);
+			strm->avail_out = buffer->size - buffer->length;
+			ret = inflate(strm, Z_SYNC_FLUSH);
+			buffer->length = buffer->size - strm->avail_out;
+			if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+			{
+				inflateReset(strm);
+				errno = EINVAL;
+				return NULL;
+			}
+		} while (ret != Z_STREAM_END && (strm->avail_in > 0 || strm->avail_out == 0));
+	}
+	inflateReset(strm);
+	if (buffer->length > max_length)
+	{
+		errno = E2BIG;
+		return NULL;
+	}
+	return buffer;
+}
+#endif
@@ -42,6 +42,10 @@ static swThreadPool swoole_aio_thread_pool;
 static int swoole_aio_pipe_read;
 static int swoole_aio_pipe_write;
 
+#if defined(SW_AIO_USE_IO_URING) && defined(HAVE_IO_URING)
+static int swoole_aio_use_uring = 0;
+#endif
+
 static int swoole_aio_onFinish(swReactor *reactor, swEvent *event)
 {
 	int i;
@@ -64,11 +68,21 @@ int swoole_aio_init(swReactor *_reactor, int max_aio_events)
 {
 	if (swoole_aio_have_init == 0)
 	{
+		int thread_num = SW_AIO_THREAD_QUEUE_DEPTH;
+
 		if (swPipeBase_create(&swoole_aio_pipe, 0) < 0)
 		{
 			return SW_ERR;
 		}
-		if (swThreadPool_create(&swoole_aio_thread_pool, SW_AIO_THREAD_NUM) < 0)
+#if defined(SW_AIO_USE_IO_URING) && defined(HAVE_IO_URING)
+		//运行时检测内核是否支持
+		if (swoole_aio_uring_init(_reactor, max_aio_events) == SW_OK)
+		{
+			swoole_aio_use_uring = 1;
+			thread_num = SW_AIO_THREAD_NUM;
+		}
+#endif
+		if (swThreadPool_create(&swoole_aio_thread_pool, thread_num) < 0)
 		{
 			return SW_ERR;
 		}
@@ -166,6 +180,12 @@ static int swoole_aio_thread_onTask(swThreadPool *pool, void *task, int task_len
 
 int swoole_aio_write(int fd, void *inbuf, size_t size, off_t offset)
 {
+#if defined(SW_AIO_USE_IO_URING) && defined(HAVE_IO_URING)
+	if (swoole_aio_use_uring)
+	{
+		return swoole_aio_uring_write(fd, inbuf, size, offset);
+	}
+#endif
 	swAio_event *aio_ev = (swAio_event *) sw_malloc(sizeof(swAio_event));
 	if (aio_ev == NULL)
 	{
@@ -199,6 +219,12 @@ int swoole_aio_dns_lookup(void *hostname, void *ip_addr, size_t size)
 
 int swoole_aio_read(int fd, void *inbuf, size_t size, off_t offset)
 {
+#if defined(SW_AIO_USE_IO_URING) && defined(HAVE_IO_URING)
+	if (swoole_aio_use_uring)
+	{
+		return swoole_aio_uring_read(fd, inbuf, size, offset);
+	}
+#endif
 	swAio_event *aio_ev = (swAio_event *) sw_malloc(sizeof(swAio_event));
 	if (aio_ev == NULL)
 	{
@@ -217,6 +243,13 @@ int swoole_aio_read(int fd, void *inbuf, size_t size, off_t offset)
 void swoole_aio_destroy()
 {
 	swThreadPool_free(&swoole_aio_thread_pool);
+#if defined(SW_AIO_USE_IO_URING) && defined(HAVE_IO_URING)
+	if (swoole_aio_use_uring)
+	{
+		swoole_aio_uring_destroy();
+		swoole_aio_use_uring = 0;
+	}
+#endif
 }
 
 #endif
@@ -0,0 +1,53 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+
+/**
+ * 每个线程缓存的时间, reactor每次从epoll_wait等返回时刷新一次
+ * clock_msec是单调时间(毫秒), 用于定时器和超时, clock_now是秒级的墙上时间
+ * 墙上时间变化时同时更新共享内存中的SwooleGS->now
+ */
+void swClock_update(void)
+{
+	struct timespec ts;
+	time_t now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+	{
+		SwooleTG.clock_msec = (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	}
+	now = time(NULL);
+	if (now < 0)
+	{
+		swWarn("get time failed. Error: %s[%d]", strerror(errno), errno);
+		return;
+	}
+	SwooleTG.clock_now = now;
+	//每秒只写一次共享内存
+	if (SwooleGS != NULL && SwooleGS->now != now)
+	{
+		SwooleGS->now = now;
+	}
+}
+
+uint64_t swClock_usec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
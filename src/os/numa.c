@@ -0,0 +1,188 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+#include <sys/syscall.h>
+
+#define SW_MPOL_PREFERRED  1
+
+#ifndef CPU_SETSIZE
+#define CPU_SETSIZE        1024
+#endif
+
+/**
+ * 从/sys/devices/system/node读取每个CPU所属的NUMA节点, 只读取一次
+ * 读不到时视为只有一个节点
+ */
+static struct
+{
+	int init;
+	int node_num;
+	int cpu_num;
+	int16_t cpu_node[CPU_SETSIZE];
+	uint16_t node_start[SW_NUMA_NODE_MAX];
+	uint16_t node_cpu_num[SW_NUMA_NODE_MAX];
+	uint16_t cpus[CPU_SETSIZE];   //按节点顺序排列的CPU
+	int total;
+} swoole_numa;
+
+static void swoole_numa_parse(int node, char *cpulist)
+{
+	char *p = cpulist, *end;
+	long start, stop, cpu;
+
+	swoole_numa.node_start[node] = swoole_numa.total;
+	while (*p != '\0' && *p != '\n')
+	{
+		start = strtol(p, &end, 10);
+		if (end == p)
+		{
+			break;
+		}
+		stop = start;
+		if (*end == '-')
+		{
+			p = end + 1;
+			stop = strtol(p, &end, 10);
+		}
+		for (cpu = start; cpu <= stop && cpu < CPU_SETSIZE && swoole_numa.total < CPU_SETSIZE; cpu++)
+		{
+			swoole_numa.cpu_node[cpu] = node;
+			swoole_numa.cpus[swoole_numa.total++] = cpu;
+			swoole_numa.node_cpu_num[node]++;
+		}
+		p = (*end == ',') ? end + 1 : end;
+	}
+}
+
+static void swoole_numa_init(void)
+{
+	char path[128], buf[4096];
+	int node, fd, n, i;
+
+	if (swoole_numa.init)
+	{
+		return;
+	}
+	swoole_numa.init = 1;
+	swoole_numa.cpu_num = SW_CPU_NUM;
+	for (node = 0; node < SW_NUMA_NODE_MAX; node++)
+	{
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			break;
+		}
+		n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (n <= 0)
+		{
+			break;
+		}
+		buf[n] = 0;
+		swoole_numa_parse(node, buf);
+		//没有CPU的节点(只有内存)
+		if (swoole_numa.node_cpu_num[node] == 0)
+		{
+			break;
+		}
+	}
+	swoole_numa.node_num = node;
+	if (swoole_numa.node_num == 0)
+	{
+		swoole_numa.node_num = 1;
+		for (i = 0; i < swoole_numa.cpu_num && i < CPU_SETSIZE; i++)
+		{
+			swoole_numa.cpu_node[i] = 0;
+			swoole_numa.cpus[i] = i;
+		}
+		swoole_numa.node_start[0] = 0;
+		swoole_numa.node_cpu_num[0] = i;
+	}
+}
+
+int swoole_numa_node_num(void)
+{
+	swoole_numa_init();
+	return swoole_numa.node_num;
+}
+
+int swoole_numa_cpu_node(int cpu)
+{
+	swoole_numa_init();
+	return (cpu >= 0 && cpu < CPU_SETSIZE) ? swoole_numa.cpu_node[cpu] : 0;
+}
+
+/**
+ * 节点上的第index个CPU, 超过节点的CPU数量时循环
+ */
+int swoole_numa_node_cpu(int node, int index)
+{
+	swoole_numa_init();
+	node = node % swoole_numa.node_num;
+	return swoole_numa.cpus[swoole_numa.node_start[node] + index % swoole_numa.node_cpu_num[node]];
+}
+
+/**
+ * 当前线程之后第一次访问的页面优先在node上分配(first-touch), 内存不足时回退到其他节点
+ */
+int swoole_numa_prefer(int node)
+{
+#ifdef SYS_set_mempolicy
+	unsigned long mask[SW_NUMA_NODE_MAX / (8 * sizeof(unsigned long)) + 1];
+
+	if (swoole_numa_node_num() < 2)
+	{
+		return SW_OK;
+	}
+	bzero(mask, sizeof(mask));
+	mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	if (syscall(SYS_set_mempolicy, SW_MPOL_PREFERRED, mask, sizeof(mask) * 8) < 0)
+	{
+		swWarn("set_mempolicy(node=%d) fail. Error: %s[%d]", node, strerror(errno), errno);
+		return SW_ERR;
+	}
+#endif
+	return SW_OK;
+}
+
+/**
+ * 把已经映射但还未访问的内存绑定到node
+ */
+int swoole_numa_bind(void *addr, size_t length, int node)
+{
+#ifdef SYS_mbind
+	unsigned long mask[SW_NUMA_NODE_MAX / (8 * sizeof(unsigned long)) + 1];
+	uintptr_t pagesize = (uintptr_t) getpagesize();
+	uintptr_t start = (uintptr_t) addr & ~(pagesize - 1);
+
+	if (swoole_numa_node_num() < 2)
+	{
+		return SW_OK;
+	}
+	bzero(mask, sizeof(mask));
+	mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+	length += (uintptr_t) addr - start;
+	if (syscall(SYS_mbind, start, length, SW_MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) < 0)
+	{
+		swWarn("mbind(node=%d) fail. Error: %s[%d]", node, strerror(errno), errno);
+		return SW_ERR;
+	}
+#endif
+	return SW_OK;
+}
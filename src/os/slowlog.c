@@ -0,0 +1,150 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "swoole.h"
+
+/**
+ * 每个进程一个监视线程, 回调开始和结束时只写两个变量
+ * 超过阈值后向主线程发送SW_SLOWLOG_SIGNAL, 信号处理函数在回调的调用栈上执行, 可以取到正在执行的位置
+ */
+static struct
+{
+	volatile uint64_t start;   //当前回调的开始时间, 0表示空闲
+	volatile uint32_t seq;     //每次进入回调加1, 同一次回调只记录一次
+	const char * volatile name;
+	uint32_t depth;
+	uint32_t threshold;
+	pthread_t main_thread;
+	pthread_t tid;
+	swSlowlog_dump dump;
+	atomic_t *count;
+} swSlowlog_state;
+
+static void* swSlowlog_loop(void *arg);
+static void swSlowlog_signal_handler(int signo);
+
+int swSlowlog_init(uint32_t threshold_usec, swSlowlog_dump dump, atomic_t *count)
+{
+	struct sigaction act;
+
+	if (threshold_usec == 0)
+	{
+		return SW_OK;
+	}
+	bzero(&swSlowlog_state, sizeof(swSlowlog_state));
+	swSlowlog_state.threshold = threshold_usec;
+	swSlowlog_state.dump = dump;
+	swSlowlog_state.count = count;
+	swSlowlog_state.main_thread = pthread_self();
+	//SA_RESTART, 不能打断回调里阻塞的系统调用
+	bzero(&act, sizeof(act));
+	act.sa_handler = swSlowlog_signal_handler;
+	act.sa_flags = SA_RESTART;
+	sigemptyset(&act.sa_mask);
+	if (sigaction(SW_SLOWLOG_SIGNAL, &act, NULL) < 0)
+	{
+		swWarn("sigaction[slowlog] failed. Error: %s[%d]", strerror(errno), errno);
+		swSlowlog_state.threshold = 0;
+		return SW_ERR;
+	}
+	if (pthread_create(&swSlowlog_state.tid, NULL, swSlowlog_loop, NULL) != 0)
+	{
+		swWarn("pthread_create[slowlog] failed. Error: %s[%d]", strerror(errno), errno);
+		swSlowlog_state.threshold = 0;
+		return SW_ERR;
+	}
+	pthread_detach(swSlowlog_state.tid);
+	return SW_OK;
+}
+
+void swSlowlog_enter(const char *name)
+{
+	//嵌套的回调算在最外层
+	if (swSlowlog_state.threshold == 0 || swSlowlog_state.depth++ > 0)
+	{
+		return;
+	}
+	swSlowlog_state.name = name;
+	swSlowlog_state.seq++;
+	sw_atomic_write_barrier();
+	swSlowlog_state.start = swClock_usec();
+}
+
+void swSlowlog_leave(void)
+{
+	if (swSlowlog_state.threshold == 0 || --swSlowlog_state.depth > 0)
+	{
+		return;
+	}
+	swSlowlog_state.start = 0;
+}
+
+static void* swSlowlog_loop(void *arg)
+{
+	uint32_t reported = 0, seq;
+	uint64_t start;
+	useconds_t interval = swSlowlog_state.threshold / 4;
+
+	if (interval < 1000)
+	{
+		interval = 1000;
+	}
+	else if (interval > 100000)
+	{
+		interval = 100000;
+	}
+	while (SwooleG.running)
+	{
+		usleep(interval);
+		seq = swSlowlog_state.seq;
+		sw_atomic_read_barrier();
+		start = swSlowlog_state.start;
+		if (start == 0 || seq == reported || swClock_usec() - start < swSlowlog_state.threshold)
+		{
+			continue;
+		}
+		reported = seq;
+		pthread_kill(swSlowlog_state.main_thread, SW_SLOWLOG_SIGNAL);
+	}
+	return NULL;
+}
+
+static void swSlowlog_signal_handler(int signo)
+{
+	char buf[256];
+	uint64_t start = swSlowlog_state.start;
+	uint64_t usec;
+	int n;
+
+	//信号到达前回调已经返回
+	if (start == 0)
+	{
+		return;
+	}
+	usec = swClock_usec() - start;
+	if (swSlowlog_state.count != NULL)
+	{
+		sw_atomic_fetch_add(swSlowlog_state.count, 1);
+	}
+	n = snprintf(buf, sizeof(buf), "[slowlog] pid=%d|callback=%s|usec=%lu\n", getpid(),
+			swSlowlog_state.name ? swSlowlog_state.name : "unknown", (unsigned long) usec);
+	swLog_write_direct(buf, n < sizeof(buf) ? n : sizeof(buf) - 1);
+	if (swSlowlog_state.dump != NULL)
+	{
+		swSlowlog_state.dump(swSlowlog_state.name, usec);
+	}
+}
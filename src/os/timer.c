@@ -21,6 +21,14 @@ int swTimer_signal_set(swTimer *timer, int interval);
 #ifdef HAVE_TIMERFD
 int swTimer_timerfd_set(swTimer *timer, int interval);
 #endif
+
+static int swTimer_heap_push(swTimer *timer, swTimer_node *node);
+static void swTimer_heap_remove(swTimer *timer, swTimer_node *node);
+static void swTimer_heap_up(swTimer *timer, uint32_t i);
+static void swTimer_heap_down(swTimer *timer, uint32_t i);
+static void swTimer_node_free(swTimer *timer, swTimer_node *node);
+static int swTimer_arm(swTimer *timer, uint64_t now_ms);
+
 /**
  * 创建定时器
  */
@@ -29,8 +37,8 @@ int swTimer_create(swTimer *timer, int interval)
 	timer->interval = interval;
 	timer->lasttime = interval;
 
-#if defined(HAVE_TIMERFD) && SW_WORKER_IPC_MODE == 1
-	if(swTimer_timerfd_set(timer, interval) < 0)
+#if defined(HAVE_TIMERFD) && SW_WORKER_IPC_MODE != 2
+	if(swTimer_timerfd_set(timer, 0) < 0)
 	{
 		return SW_ERR;
 	}
@@ -47,10 +55,6 @@ int swTimer_create(swTimer *timer, int interval)
 	timer->fd = timer->pipe.getFd(&timer->pipe, 0);
 	timer->use_pipe = 1;
 #endif
-	if (swTimer_signal_set(timer, interval) < 0)
-	{
-		return SW_ERR;
-	}
 //end
 #endif
 	return SW_OK;
@@ -58,26 +62,16 @@ int swTimer_create(swTimer *timer, int interval)
 
 #ifdef HAVE_TIMERFD
 /**
- * timerfd
+ * timerfd, 只触发一次, interval为0时停止
  */
 int swTimer_timerfd_set(swTimer *timer, int interval)
 {
-	struct timeval now;
-	int sec = interval / 1000;
-	int msec = (((float) interval / 1000) - sec) * 1000;
-
-	if (gettimeofday(&now, NULL) < 0)
-	{
-		swWarn("gettimeofday failed");
-		return SW_ERR;
-	}
-
 	struct itimerspec timer_set;
 	bzero(&timer_set, sizeof(timer_set));
 
 	if(timer->fd == 0)
 	{
-		timer->fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+		timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
 		if (timer->fd < 0)
 		{
 			swWarn("create timerfd failed. Error: %s[%d]", strerror(errno), errno);
@@ -85,12 +79,10 @@ int swTimer_timerfd_set(swTimer *timer, int interval)
 		}
 	}
 
-	timer_set.it_value.tv_sec = now.tv_sec + sec;
-	timer_set.it_value.tv_nsec = now.tv_usec + msec * 1000;
-	timer_set.it_interval.tv_sec = sec;
-	timer_set.it_interval.tv_nsec = msec * 1000 * 1000;
+	timer_set.it_value.tv_sec = interval / 1000;
+	timer_set.it_value.tv_nsec = (interval % 1000) * 1000 * 1000;
 
-	if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &timer_set, NULL) == -1)
+	if (timerfd_settime(timer->fd, 0, &timer_set, NULL) == -1)
 	{
 		swWarn("set timer failed. Error: %s[%d]", strerror(errno), errno);
 		return SW_ERR;
@@ -100,19 +92,15 @@ int swTimer_timerfd_set(swTimer *timer, int interval)
 #endif
 
 /**
- * setitimer
+ * setitimer, 只触发一次, interval为0时停止
  */
 int swTimer_signal_set(swTimer *timer, int interval)
 {
 	struct itimerval timer_set;
-	int sec = interval / 1000;
-	int msec = (((float) interval / 1000) - sec) * 1000;
 
 	memset(&timer_set, 0, sizeof(timer_set));
-	timer_set.it_value.tv_sec = sec;
-	timer_set.it_value.tv_usec = msec * 1000;
-	timer_set.it_interval.tv_sec = sec;
-	timer_set.it_interval.tv_usec = msec * 1000;
+	timer_set.it_value.tv_sec = interval / 1000;
+	timer_set.it_value.tv_usec = (interval % 1000) * 1000;
 
 	if (setitimer(ITIMER_REAL, &timer_set, NULL) < 0)
 	{
@@ -122,90 +110,220 @@ int swTimer_signal_set(swTimer *timer, int interval)
 	return SW_OK;
 }
 
-void swTimer_del(swTimer *timer, int ms)
+/**
+ * 按最近一个定时器的到期时间设置timerfd/itimer
+ */
+static int swTimer_arm(swTimer *timer, uint64_t now_ms)
 {
-	swHashMap_del_int(&timer->list, ms);
+	int interval = 0;
+	if (timer->heap_num > 0)
+	{
+		uint64_t exec_msec = timer->heap[1]->exec_msec;
+		//0表示停止,已经到期的定时器需要尽快触发
+		interval = exec_msec > now_ms ? (int) (exec_msec - now_ms) : 1;
+	}
+#if defined(HAVE_TIMERFD) && SW_WORKER_IPC_MODE != 2
+	return swTimer_timerfd_set(timer, interval);
+#else
+	return swTimer_signal_set(timer, interval);
+#endif
 }
 
-int swTimer_free(swTimer *timer)
+/**
+ * 异步模块在reactor上使用SwooleG.timer, 还没有创建时创建并加入reactor
+ */
+int swTimer_init_reactor(swReactor *reactor, int interval)
 {
-	swHashMap_destory(&timer->list);
-	if (timer->use_pipe)
+	if (SwooleG.timer.fd != 0)
 	{
-		return timer->pipe.close(&timer->pipe);
+		return SW_OK;
 	}
-	else
+	if (swTimer_create(&SwooleG.timer, interval) < 0)
 	{
-		return close(timer->fd);
+		return SW_ERR;
 	}
+#if SW_WORKER_IPC_MODE != 2
+	reactor->setHandle(reactor, SW_FD_TIMER, swTimer_event_handler);
+	reactor->add(reactor, SwooleG.timer.fd, SW_FD_TIMER);
+#endif
+	return SW_OK;
 }
 
-int swTimer_add(swTimer *timer, int ms)
+/**
+ * 添加一个定时器, 返回timer id
+ * @param repeat 1表示每隔ms毫秒执行一次, 0表示只执行一次
+ */
+int swTimer_set(swTimer *timer, int ms, int repeat, void *data, swTimerCallback callback)
 {
-	swTimer_node *node = sw_malloc(sizeof(swTimer_node));
+	uint64_t now_ms;
+	swTimer_node *node;
+
+	//可能在reactor之外添加定时器, 缓存的时间不一定是新的
+	swClock_update();
+	now_ms = swTimer_get_ms();
+
+	if (ms <= 0)
+	{
+		swWarn("timer interval must be greater than 0");
+		return SW_ERR;
+	}
+	node = sw_malloc(sizeof(swTimer_node));
 	if (node == NULL)
 	{
-		swWarn("swTimer_add malloc fail");
+		swWarn("swTimer_set malloc fail");
 		return SW_ERR;
 	}
 	bzero(node, sizeof(swTimer_node));
-	node->lasttime = swTimer_get_ms();
+	node->exec_msec = now_ms + ms;
 	node->interval = ms;
+	node->repeat = repeat;
+	node->data = data;
+	node->callback = callback;
+	//id不能为0
+	node->id = ++timer->id_seq;
+	if (node->id == 0)
+	{
+		node->id = ++timer->id_seq;
+	}
 
-	if(ms < timer->interval)
+	if (swTimer_heap_push(timer, node) < 0)
 	{
-		int new_interval = swoole_common_divisor(ms, timer->interval);
-		timer->interval = new_interval;
-#if defined(HAVE_TIMERFD) && SW_WORKER_IPC_MODE == 1
-		swTimer_timerfd_set(timer, new_interval);
-#else
-		swTimer_signal_set(timer, new_interval);
-#endif
+		sw_free(node);
+		return SW_ERR;
 	}
-	swHashMap_add_int(&timer->list, ms, node);
+	swHashMap_add_int(&timer->map, node->id, node);
 	timer->num++;
-	return SW_OK;
+
+	//新的定时器最先到期, 重新设置timerfd
+	if (timer->heap[1] == node)
+	{
+		swTimer_arm(timer, now_ms);
+	}
+	return node->id;
 }
 
-int swTimer_select(swTimer *timer)
+/**
+ * 删除定时器
+ */
+int swTimer_clear(swTimer *timer, int id)
 {
-	void *tmp = NULL;
-	uint64_t key;
-	swTimer_node *timer_node;
-
-	uint64_t now_ms = swTimer_get_ms();
-	if (now_ms < 0)
+	swTimer_node *node = swHashMap_find_int(&timer->map, id);
+	if (node == NULL)
 	{
 		return SW_ERR;
 	}
+	//正在执行回调, 回调结束后再释放
+	if (node->heap_index == 0)
+	{
+		node->remove = 1;
+		return SW_OK;
+	}
+	swTimer_heap_remove(timer, node);
+	swTimer_node_free(timer, node);
+	return SW_OK;
+}
 
-	if (timer->onTimer == NULL)
+/**
+ * 兼容旧接口: 每个interval只有一个重复定时器, 回调timer->onTimer
+ */
+int swTimer_add(swTimer *timer, int ms)
+{
+	int id;
+	if (swHashMap_find_int(&timer->list, ms) != NULL)
+	{
+		return SW_OK;
+	}
+	id = swTimer_set(timer, ms, 1, NULL, NULL);
+	if (id < 0)
 	{
-		swWarn("timer->onTimer is NULL");
 		return SW_ERR;
 	}
+	swHashMap_add_int(&timer->list, ms, swHashMap_find_int(&timer->map, id));
+	return SW_OK;
+}
+
+void swTimer_del(swTimer *timer, int ms)
+{
+	swTimer_node *node = swHashMap_find_int(&timer->list, ms);
+	if (node == NULL)
+	{
+		return;
+	}
+	swTimer_clear(timer, node->id);
+}
+
+int swTimer_free(swTimer *timer)
+{
+	uint32_t i;
+	for (i = 1; i <= timer->heap_num; i++)
+	{
+		sw_free(timer->heap[i]);
+	}
+	if (timer->heap)
+	{
+		sw_free(timer->heap);
+		timer->heap = NULL;
+	}
+	timer->heap_num = 0;
+	timer->num = 0;
+	swHashMap_free_int(&timer->list);
+	swHashMap_free_int(&timer->map);
+	if (timer->use_pipe)
+	{
+		return timer->pipe.close(&timer->pipe);
+	}
+	else
+	{
+		return close(timer->fd);
+	}
+}
+
+/**
+ * 执行所有到期的定时器
+ */
+int swTimer_select(swTimer *timer)
+{
+	swTimer_node *node;
+	uint64_t now_ms;
 
-	while (1)
+	//定时器到期时刷新一次缓存的时间, 回调中读到的都是这个时间
+	swClock_update();
+	now_ms = swTimer_get_ms();
+
+	while (timer->heap_num > 0 && timer->heap[1]->exec_msec <= now_ms)
 	{
-		tmp = swHashMap_foreach_int(&timer->list, &key, (void **)&timer_node, tmp);
-		//值为空
-		if (timer_node == NULL)
+		node = timer->heap[1];
+		swTimer_heap_remove(timer, node);
+
+		if (node->callback)
 		{
-			break;
+			node->callback(timer, node);
 		}
-		//swWarn("Timer=%ld|lasttime=%ld|now=%ld", key, timer_node->lasttime, now_ms);
-		if (timer_node->lasttime < now_ms - timer_node->interval)
+		else if (timer->onTimer)
 		{
-			timer->onTimer(timer, timer_node->interval);
-			timer_node->lasttime += timer_node->interval;
+			timer->onTimer(timer, node->interval);
 		}
-		//遍历结束
-		if (tmp == NULL)
+		else
 		{
-			break;
+			swWarn("timer->onTimer is NULL");
 		}
+
+		if (node->repeat && !node->remove)
+		{
+			node->exec_msec += node->interval;
+			//处理不过来时跳过错过的周期, 避免连续触发
+			if (node->exec_msec <= now_ms)
+			{
+				node->exec_msec = now_ms + node->interval;
+			}
+			if (swTimer_heap_push(timer, node) == SW_OK)
+			{
+				continue;
+			}
+		}
+		swTimer_node_free(timer, node);
 	}
-	return SW_OK;
+	return swTimer_arm(timer, now_ms);
 }
 
 int swTimer_event_handler(swReactor *reactor, swEvent *event)
@@ -233,13 +351,107 @@ void swTimer_signal_handler(int sig)
 #endif
 }
 
+/**
+ * 定时器使用reactor每轮缓存的单调时间
+ */
 SWINLINE uint64_t swTimer_get_ms()
 {
-	struct timeval now;
-	if (gettimeofday(&now, NULL) < 0)
+	return swClock_msec();
+}
+
+static void swTimer_node_free(swTimer *timer, swTimer_node *node)
+{
+	if (node->callback == NULL && swHashMap_find_int(&timer->list, node->interval) == node)
 	{
-		swWarn("gettimeofday fail.Error: %s[%d]", strerror(errno), errno);
-		return SW_ERR;
+		swHashMap_del_int(&timer->list, node->interval);
+	}
+	swHashMap_del_int(&timer->map, node->id);
+	timer->num--;
+	sw_free(node);
+}
+
+/**
+ * 最小堆, heap[0]不使用, 节点中保存自己的位置, 删除时不需要查找
+ */
+static int swTimer_heap_push(swTimer *timer, swTimer_node *node)
+{
+	if (timer->heap_num + 1 >= timer->heap_size)
+	{
+		uint32_t new_size = timer->heap_size == 0 ? SW_TIMER_HEAP_SIZE : timer->heap_size * 2;
+		swTimer_node **new_heap = sw_realloc(timer->heap, sizeof(swTimer_node *) * new_size);
+		if (new_heap == NULL)
+		{
+			swWarn("realloc for timer heap failed.");
+			return SW_ERR;
+		}
+		timer->heap = new_heap;
+		timer->heap_size = new_size;
+	}
+	timer->heap_num++;
+	timer->heap[timer->heap_num] = node;
+	node->heap_index = timer->heap_num;
+	swTimer_heap_up(timer, timer->heap_num);
+	return SW_OK;
+}
+
+static void swTimer_heap_remove(swTimer *timer, swTimer_node *node)
+{
+	uint32_t i = node->heap_index;
+	swTimer_node *last = timer->heap[timer->heap_num];
+
+	timer->heap_num--;
+	node->heap_index = 0;
+	if (last == node)
+	{
+		return;
+	}
+	timer->heap[i] = last;
+	last->heap_index = i;
+	if (i > 1 && timer->heap[i / 2]->exec_msec > last->exec_msec)
+	{
+		swTimer_heap_up(timer, i);
+	}
+	else
+	{
+		swTimer_heap_down(timer, i);
+	}
+}
+
+static void swTimer_heap_up(swTimer *timer, uint32_t i)
+{
+	swTimer_node **heap = timer->heap;
+	swTimer_node *node = heap[i];
+
+	while (i > 1 && heap[i / 2]->exec_msec > node->exec_msec)
+	{
+		heap[i] = heap[i / 2];
+		heap[i]->heap_index = i;
+		i = i / 2;
+	}
+	heap[i] = node;
+	node->heap_index = i;
+}
+
+static void swTimer_heap_down(swTimer *timer, uint32_t i)
+{
+	swTimer_node **heap = timer->heap;
+	swTimer_node *node = heap[i];
+	uint32_t child;
+
+	while ((child = i * 2) <= timer->heap_num)
+	{
+		if (child < timer->heap_num && heap[child + 1]->exec_msec < heap[child]->exec_msec)
+		{
+			child++;
+		}
+		if (heap[child]->exec_msec >= node->exec_msec)
+		{
+			break;
+		}
+		heap[i] = heap[child];
+		heap[i]->heap_index = i;
+		i = child;
 	}
-	return (now.tv_sec * 1000) + (now.tv_usec / 1000);
+	heap[i] = node;
+	node->heap_index = i;
 }
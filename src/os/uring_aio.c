@@ -0,0 +1,384 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+#include "async.h"
+
+#if defined(SW_AIO_THREAD_POOL) && defined(SW_AIO_USE_IO_URING) && defined(HAVE_IO_URING)
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+/**
+ * 文件读写使用io_uring, 不需要O_DIRECT
+ * 请求在一轮事件循环结束时一次提交, 完成后通过eventfd通知reactor
+ * 只能在aio_reactor所在的线程中调用
+ */
+typedef struct
+{
+	int ring_fd;
+	int event_fd;
+	uint32_t sq_entries;
+	uint32_t pending;
+
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	struct io_uring_sqe *sqes;
+
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ptr;
+	size_t sq_size;
+	void *cq_ptr;
+	size_t cq_size;
+	size_t sqes_size;
+
+	swReactor *reactor;
+	void (*onFinish)(swReactor *reactor);
+	void (*onTimeout)(swReactor *reactor);
+} swAioUring;
+
+static swAioUring swoole_aio_uring;
+
+static int swoole_aio_uring_setup(swAioUring *object, uint32_t entries);
+static void swoole_aio_uring_release(swAioUring *object);
+static int swoole_aio_uring_submit(swAioUring *object);
+static int swoole_aio_uring_onFinish(swReactor *reactor, swEvent *event);
+static int swoole_aio_uring_request(int type, int fd, void *buf, size_t size, off_t offset);
+static void swoole_aio_uring_onLoopFinish(swReactor *reactor);
+static void swoole_aio_uring_onLoopTimeout(swReactor *reactor);
+
+int swoole_aio_uring_init(swReactor *reactor, int max_aio_events)
+{
+	swAioUring *object = &swoole_aio_uring;
+
+	bzero(object, sizeof(swAioUring));
+	object->ring_fd = -1;
+	object->event_fd = -1;
+
+	if (swoole_aio_uring_setup(object, max_aio_events > 0 ? max_aio_events : SW_AIO_MAX_EVENTS) < 0)
+	{
+		swoole_aio_uring_release(object);
+		return SW_ERR;
+	}
+	object->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (object->event_fd < 0)
+	{
+		swWarn("eventfd create fail. Error: %s[%d]", strerror(errno), errno);
+		swoole_aio_uring_release(object);
+		return SW_ERR;
+	}
+	if (syscall(__NR_io_uring_register, object->ring_fd, IORING_REGISTER_EVENTFD, &object->event_fd, 1) < 0)
+	{
+		swTrace("io_uring_register fail. Error: %s[%d]", strerror(errno), errno);
+		swoole_aio_uring_release(object);
+		return SW_ERR;
+	}
+
+	object->reactor = reactor;
+	reactor->setHandle(reactor, SW_FD_AIO_URING, swoole_aio_uring_onFinish);
+	if (reactor->add(reactor, object->event_fd, SW_FD_AIO_URING) < 0)
+	{
+		swoole_aio_uring_release(object);
+		return SW_ERR;
+	}
+	//在一轮事件循环结束时提交请求
+	object->onFinish = reactor->onFinish;
+	object->onTimeout = reactor->onTimeout;
+	reactor->onFinish = swoole_aio_uring_onLoopFinish;
+	reactor->onTimeout = swoole_aio_uring_onLoopTimeout;
+	return SW_OK;
+}
+
+static int swoole_aio_uring_setup(swAioUring *object, uint32_t entries)
+{
+	struct io_uring_params params;
+
+	bzero(&params, sizeof(params));
+	object->ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (object->ring_fd < 0)
+	{
+		swTrace("io_uring_setup fail. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	//完成队列满时不能丢事件
+	if (!(params.features & IORING_FEAT_NODROP))
+	{
+		swTrace("io_uring features not supported. features=%x", params.features);
+		return SW_ERR;
+	}
+	object->sq_entries = params.sq_entries;
+	object->sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	object->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (object->cq_size > object->sq_size)
+		{
+			object->sq_size = object->cq_size;
+		}
+		object->cq_size = object->sq_size;
+	}
+	object->sq_ptr = mmap(NULL, object->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, object->ring_fd,
+			IORING_OFF_SQ_RING);
+	if (object->sq_ptr == MAP_FAILED)
+	{
+		object->sq_ptr = NULL;
+		swWarn("mmap[sq_ring] fail. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		object->cq_ptr = object->sq_ptr;
+	}
+	else
+	{
+		object->cq_ptr = mmap(NULL, object->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				object->ring_fd, IORING_OFF_CQ_RING);
+		if (object->cq_ptr == MAP_FAILED)
+		{
+			object->cq_ptr = NULL;
+			swWarn("mmap[cq_ring] fail. Error: %s[%d]", strerror(errno), errno);
+			return SW_ERR;
+		}
+	}
+	object->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	object->sqes = mmap(NULL, object->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, object->ring_fd,
+			IORING_OFF_SQES);
+	if (object->sqes == MAP_FAILED)
+	{
+		swWarn("mmap[sqes] fail. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+
+	object->sq_head = object->sq_ptr + params.sq_off.head;
+	object->sq_tail = object->sq_ptr + params.sq_off.tail;
+	object->sq_mask = object->sq_ptr + params.sq_off.ring_mask;
+	object->sq_array = object->sq_ptr + params.sq_off.array;
+
+	object->cq_head = object->cq_ptr + params.cq_off.head;
+	object->cq_tail = object->cq_ptr + params.cq_off.tail;
+	object->cq_mask = object->cq_ptr + params.cq_off.ring_mask;
+	object->cqes = object->cq_ptr + params.cq_off.cqes;
+	return SW_OK;
+}
+
+static void swoole_aio_uring_release(swAioUring *object)
+{
+	if (object->sqes != NULL && object->sqes != MAP_FAILED)
+	{
+		munmap(object->sqes, object->sqes_size);
+	}
+	if (object->cq_ptr != NULL && object->cq_ptr != object->sq_ptr)
+	{
+		munmap(object->cq_ptr, object->cq_size);
+	}
+	if (object->sq_ptr != NULL)
+	{
+		munmap(object->sq_ptr, object->sq_size);
+	}
+	if (object->ring_fd >= 0)
+	{
+		close(object->ring_fd);
+	}
+	if (object->event_fd >= 0)
+	{
+		close(object->event_fd);
+	}
+	bzero(object, sizeof(swAioUring));
+	object->ring_fd = -1;
+	object->event_fd = -1;
+}
+
+void swoole_aio_uring_destroy()
+{
+	swAioUring *object = &swoole_aio_uring;
+	swReactor *reactor = object->reactor;
+
+	if (reactor != NULL)
+	{
+		reactor->del(reactor, object->event_fd);
+		reactor->onFinish = object->onFinish;
+		reactor->onTimeout = object->onTimeout;
+	}
+	swoole_aio_uring_release(object);
+}
+
+static int swoole_aio_uring_submit(swAioUring *object)
+{
+	int ret;
+
+	while (object->pending > 0)
+	{
+		ret = syscall(__NR_io_uring_enter, object->ring_fd, object->pending, 0, 0, NULL, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			//EAGAIN/EBUSY: 内核暂时无法接收, 下一轮事件循环再提交
+			if (errno != EAGAIN && errno != EBUSY)
+			{
+				swWarn("io_uring_enter fail. Error: %s[%d]", strerror(errno), errno);
+			}
+			return SW_ERR;
+		}
+		object->pending -= ret;
+	}
+	return SW_OK;
+}
+
+static void swoole_aio_uring_onLoopFinish(swReactor *reactor)
+{
+	swoole_aio_uring_submit(&swoole_aio_uring);
+	if (swoole_aio_uring.onFinish != NULL)
+	{
+		swoole_aio_uring.onFinish(reactor);
+	}
+}
+
+static void swoole_aio_uring_onLoopTimeout(swReactor *reactor)
+{
+	swoole_aio_uring_submit(&swoole_aio_uring);
+	if (swoole_aio_uring.onTimeout != NULL)
+	{
+		swoole_aio_uring.onTimeout(reactor);
+	}
+}
+
+static int swoole_aio_uring_request(int type, int fd, void *buf, size_t size, off_t offset)
+{
+	swAioUring *object = &swoole_aio_uring;
+	struct io_uring_sqe *sqe;
+	uint32_t tail, index;
+
+	//提交队列满了, 先提交
+	sw_atomic_memory_barrier();
+	tail = *object->sq_tail;
+	if (tail - *object->sq_head >= object->sq_entries && swoole_aio_uring_submit(object) < 0)
+	{
+		return SW_ERR;
+	}
+	sw_atomic_memory_barrier();
+	if (tail - *object->sq_head >= object->sq_entries)
+	{
+		swWarn("io_uring submission queue is full.");
+		return SW_ERR;
+	}
+
+	swAio_event *aio_ev = (swAio_event *) sw_malloc(sizeof(swAio_event));
+	if (aio_ev == NULL)
+	{
+		swWarn("malloc failed.");
+		return SW_ERR;
+	}
+	bzero(aio_ev, sizeof(swAio_event));
+	aio_ev->fd = fd;
+	aio_ev->buf = buf;
+	aio_ev->type = type;
+	aio_ev->nbytes = size;
+	aio_ev->offset = offset;
+
+	index = tail & *object->sq_mask;
+	sqe = &object->sqes[index];
+	bzero(sqe, sizeof(struct io_uring_sqe));
+	sqe->opcode = (type == SW_AIO_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t) (uintptr_t) buf;
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->user_data = (uint64_t) (uintptr_t) aio_ev;
+	object->sq_array[index] = index;
+	sw_atomic_memory_barrier();
+	(*object->sq_tail)++;
+	object->pending++;
+
+	//onFinish被替换了, 不能延迟提交
+	if (object->reactor->onFinish != swoole_aio_uring_onLoopFinish)
+	{
+		swoole_aio_uring_submit(object);
+	}
+	//在事件循环之外(例如wait之前)发起的请求要唤醒reactor, 否则没有事件时不会执行onFinish
+	else if (object->pending == 1)
+	{
+		uint64_t wakeup = 1;
+		if (write(object->event_fd, &wakeup, sizeof(wakeup)) < 0)
+		{
+			swoole_aio_uring_submit(object);
+		}
+	}
+	return SW_OK;
+}
+
+int swoole_aio_uring_read(int fd, void *outbuf, size_t size, off_t offset)
+{
+	return swoole_aio_uring_request(SW_AIO_READ, fd, outbuf, size, offset);
+}
+
+int swoole_aio_uring_write(int fd, void *inbuf, size_t size, off_t offset)
+{
+	return swoole_aio_uring_request(SW_AIO_WRITE, fd, inbuf, size, offset);
+}
+
+static int swoole_aio_uring_onFinish(swReactor *reactor, swEvent *event)
+{
+	swAioUring *object = &swoole_aio_uring;
+	struct io_uring_cqe *cqe;
+	swAio_event *aio_ev;
+	uint64_t finished_aio;
+	uint32_t head;
+
+	if (read(event->fd, &finished_aio, sizeof(finished_aio)) < 0 && errno != EAGAIN)
+	{
+		swWarn("read failed. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+
+	sw_atomic_memory_barrier();
+	head = *object->cq_head;
+	while (head != *object->cq_tail)
+	{
+		cqe = &object->cqes[head & *object->cq_mask];
+		aio_ev = (swAio_event *) (uintptr_t) cqe->user_data;
+		if (cqe->res < 0)
+		{
+			aio_ev->ret = -1;
+			aio_ev->error = -cqe->res;
+		}
+		else
+		{
+			aio_ev->ret = cqe->res;
+		}
+		head++;
+		//回调中可能提交新的请求, 先归还cqe
+		sw_atomic_memory_barrier();
+		*object->cq_head = head;
+
+		swoole_aio_complete_callback(aio_ev);
+		sw_free(aio_ev);
+		sw_atomic_memory_barrier();
+	}
+	return SW_OK;
+}
+
+#endif
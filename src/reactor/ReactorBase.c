@@ -47,7 +47,7 @@ SWINLINE int swReactor_error(swReactor *reactor)
 
 SWINLINE int swReactor_fdtype(int fdtype)
 {
-	return fdtype & (~SW_EVENT_READ) & (~SW_EVENT_WRITE) & (~SW_EVENT_ERROR);
+	return fdtype & (~SW_EVENT_READ) & (~SW_EVENT_WRITE) & (~SW_EVENT_ERROR) & (~SW_EVENT_ET);
 }
 
 SWINLINE int swReactor_event_read(int fdtype)
@@ -80,12 +80,64 @@ swReactor_handle swReactor_getHandle(swReactor *reactor, int event_type, int fdt
 	return reactor->handle[fdtype];
 }
 
+static const char* swReactor_fdtype_name(int fdtype)
+{
+	static const char *names[] = {
+		"TCP", "LISTEN", "CLOSE", "ERROR", "UDP", "PIPE", "6", "WRITE", "TIMER", "AIO",
+		"SEND_TO_CLIENT", "SIGNAL", "RING", "AIO_URING", "DNS", "MYSQL", "PROXY", "SSL", "CORO", "REDIS",
+	};
+	return fdtype < SW_FD_USER ? names[fdtype] : "USER";
+}
+
+int swReactor_call_timed(swReactor *reactor, int event_type, swReactor_handle handle, swEvent *ev)
+{
+	uint64_t start = swClock_usec(), usec;
+	int ret = handle(reactor, ev);
+
+	usec = swClock_usec() - start;
+	if (usec >= reactor->slow_usec)
+	{
+		reactor->slow_flag = 1;
+		if (reactor->slow_count != NULL)
+		{
+			sw_atomic_fetch_add(reactor->slow_count, 1);
+		}
+		//handler可以用addr2line查找
+		swWarn("[Reactor#%d] slow callback. fd=%d|fdtype=%s|event=%s|handler=%p|usec=%lu", reactor->id, ev->fd,
+				swReactor_fdtype_name(ev->type), event_type == SW_EVENT_WRITE ? "write" : (event_type == SW_EVENT_ERROR ? "error" : "read"),
+				handle, (unsigned long) usec);
+	}
+	return ret;
+}
+
+void swReactor_loop_check(swReactor *reactor)
+{
+	uint64_t usec = swClock_usec() - reactor->loop_start;
+
+	//已经记录了慢回调的不重复记录
+	if (usec >= reactor->slow_usec && !reactor->slow_flag)
+	{
+		if (reactor->slow_count != NULL)
+		{
+			sw_atomic_fetch_add(reactor->slow_count, 1);
+		}
+		swWarn("[Reactor#%d] event loop blocked. usec=%lu", reactor->id, (unsigned long) usec);
+	}
+}
+
 /**
  * 自动适配reactor
  */
 int swReactor_auto(swReactor *reactor, int max_event)
 {
 	int ret;
+#if defined(HAVE_IO_URING) && SW_USE_IO_URING
+	//内核不支持或者被禁用时使用epoll
+	if (swReactorUring_create(reactor, max_event) == SW_OK)
+	{
+		return SW_OK;
+	}
+#endif
 #ifdef HAVE_EPOLL
 	ret = swReactorEpoll_create(reactor, max_event);
 #elif defined(HAVE_KQUEUE)
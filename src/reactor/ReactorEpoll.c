@@ -62,6 +62,7 @@ int swReactorEpoll_create(swReactor *reactor, int max_event_num)
 	bzero(reactor_object, sizeof(swReactorEpoll));
 	reactor->object = reactor_object;
 	reactor->max_event_num = max_event_num;
+	reactor->flag = 0;
 
 	reactor_object->events = sw_calloc(max_event_num, sizeof(struct epoll_event));
 
@@ -86,6 +87,8 @@ int swReactorEpoll_create(swReactor *reactor, int max_event_num)
 	reactor->setHandle = swReactor_setHandle;
 	reactor->onFinish = NULL;
 	reactor->onTimeout = NULL;
+	reactor->slow_usec = 0;
+	reactor->slow_count = NULL;
 	return SW_OK;
 }
 
@@ -140,7 +143,14 @@ int swReactorEpoll_del(swReactor *reactor, int fd)
 	}
 	//close时会自动从epoll事件中移除
 	//swoole中未使用dup
-	ret = close(fd);
+	if (reactor->flag & SW_REACTOR_KEEP_FD)
+	{
+		ret = 0;
+	}
+	else
+	{
+		ret = close(fd);
+	}
 	if (ret >= 0)
 	{
 		(reactor->event_num <= 0) ? reactor->event_num = 0 : reactor->event_num--;
@@ -152,9 +162,10 @@ int swReactorEpoll_del(swReactor *reactor, int fd)
 SWINLINE static int swReactorEpoll_event_set(int fdtype)
 {
 	uint32_t flag = 0;
-#ifdef SW_USE_EPOLLET
-	flag = EPOLLET;
-#endif
+	if (fdtype & SW_EVENT_ET)
+	{
+		flag = EPOLLET;
+	}
 
 	if (swReactor_event_read(fdtype))
 	{
@@ -214,6 +225,8 @@ int swReactorEpoll_wait(swReactor *reactor, struct timeval *timeo)
 	while (SwooleG.running > 0)
 	{
 		n = epoll_wait(object->epfd, object->events, reactor->max_event_num, usec);
+		swClock_update();
+		swReactor_loop_begin(reactor);
 		if (n < 0)
 		{
 			if (swReactor_error(reactor) < 0)
@@ -221,6 +234,10 @@ int swReactorEpoll_wait(swReactor *reactor, struct timeval *timeo)
 				swWarn("Epoll[#%d] Error: %s[%d]", reactor->id, strerror(errno), errno);
 				return SW_ERR;
 			}
+			else if (reactor->flag & SW_REACTOR_ONCE)
+			{
+				return 0;
+			}
 			else
 			{
 				continue;
@@ -232,6 +249,10 @@ int swReactorEpoll_wait(swReactor *reactor, struct timeval *timeo)
 			{
 				reactor->onTimeout(reactor);
 			}
+			if (reactor->flag & SW_REACTOR_ONCE)
+			{
+				return 0;
+			}
 			continue;
 		}
 		for (i = 0; i < n; i++)
@@ -247,7 +268,7 @@ int swReactorEpoll_wait(swReactor *reactor, struct timeval *timeo)
 			{
 				//read
 				handle = swReactor_getHandle(reactor, SW_EVENT_READ, ev.type);
-				ret = handle(reactor, &ev);
+				ret = swReactor_call(reactor, SW_EVENT_READ, handle, &ev);
 				if (ret < 0)
 				{
 					swWarn("[Reactor#%d] epoll [EPOLLIN] handle failed. fd=%d. Error: %s[%d]", reactor->id, ev.fd,
@@ -258,7 +279,7 @@ int swReactorEpoll_wait(swReactor *reactor, struct timeval *timeo)
 			if ((object->events[i].events & EPOLLOUT))
 			{
 				handle = swReactor_getHandle(reactor, SW_EVENT_WRITE, ev.type);
-				ret = handle(reactor, &ev);
+				ret = swReactor_call(reactor, SW_EVENT_WRITE, handle, &ev);
 				if (ret < 0)
 				{
 					swWarn("[Reactor#%d] epoll [EPOLLOUT] handle failed. fd=%d. Error: %s[%d]", reactor->id, ev.fd,
@@ -271,7 +292,7 @@ int swReactorEpoll_wait(swReactor *reactor, struct timeval *timeo)
 			if ((object->events[i].events & (EPOLLRDHUP)))
 			{
 				handle = swReactor_getHandle(reactor, SW_EVENT_ERROR, ev.type);
-				ret = handle(reactor, &ev);
+				ret = swReactor_call(reactor, SW_EVENT_ERROR, handle, &ev);
 				if (ret < 0)
 				{
 					swWarn("[Reactor#%d] epoll [EPOLLRDHUP] handle failed. fd=%d. Error: %s[%d]", reactor->id, ev.fd,
@@ -284,6 +305,11 @@ int swReactorEpoll_wait(swReactor *reactor, struct timeval *timeo)
 		{
 			reactor->onFinish(reactor);
 		}
+		swReactor_loop_end(reactor);
+		if (reactor->flag & SW_REACTOR_ONCE)
+		{
+			return n;
+		}
 	}
 	return 0;
 }
@@ -33,6 +33,9 @@ static int swReactorKqueue_del(swReactor *reactor, int fd);
 static int swReactorKqueue_wait(swReactor *reactor, struct timeval *timeo);
 static void swReactorKqueue_free(swReactor *reactor);
 
+//EV_CLEAR: 边缘触发
+#define swReactorKqueue_flags(fdtype)  (((fdtype) & SW_EVENT_ET) ? (EV_ADD | EV_CLEAR) : EV_ADD)
+
 struct swReactorKqueue_s
 {
 	int epfd;
@@ -78,6 +81,8 @@ int swReactorKqueue_create(swReactor *reactor, int max_event_num)
 	reactor->setHandle = swReactor_setHandle;
 	reactor->onFinish = NULL;
 	reactor->onTimeout = NULL;
+	reactor->slow_usec = 0;
+	reactor->slow_count = NULL;
 	return SW_OK;
 }
 
@@ -106,7 +111,7 @@ static int swReactorKqueue_add(swReactor *reactor, int fd, int fdtype)
 #ifdef NOTE_EOF
 		fflags = NOTE_EOF;
 #endif
-		EV_SET(&e, fd, EVFILT_READ, EV_ADD, fflags, 0, NULL);
+		EV_SET(&e, fd, EVFILT_READ, swReactorKqueue_flags(fdtype), fflags, 0, NULL);
 		memcpy(&e.udata, &fd_, sizeof(swFd));
 		ret = kevent(this->epfd, &e, 1, NULL, 0, NULL);
 		if (ret < 0)
@@ -117,7 +122,7 @@ static int swReactorKqueue_add(swReactor *reactor, int fd, int fdtype)
 	}
 	if(swReactor_event_write(fdtype))
 	{
-		EV_SET(&e, fd, EVFILT_WRITE, EV_ADD, 0, 0, NULL);
+		EV_SET(&e, fd, EVFILT_WRITE, swReactorKqueue_flags(fdtype), 0, 0, NULL);
 		memcpy(&e.udata, &fd_, sizeof(swFd));
 		ret = kevent(this->epfd, &e, 1, NULL, 0, NULL);
 		if (ret < 0)
@@ -149,7 +154,7 @@ static int swReactorKqueue_set(swReactor *reactor, int fd, int fdtype)
 #ifdef NOTE_EOF
 		fflags = NOTE_EOF;
 #endif
-		EV_SET(&e, fd, EVFILT_READ, EV_ADD, fflags, 0, NULL);
+		EV_SET(&e, fd, EVFILT_READ, swReactorKqueue_flags(fdtype), fflags, 0, NULL);
 		memcpy(&e.udata, &fd_, sizeof(swFd));
 		ret = kevent(this->epfd, &e, 1, NULL, 0, NULL);
 		if (ret < 0)
@@ -171,7 +176,7 @@ static int swReactorKqueue_set(swReactor *reactor, int fd, int fdtype)
 	}
 	if(swReactor_event_write(fdtype))
 	{
-		EV_SET(&e, fd, EVFILT_WRITE, EV_ADD, 0, 0, NULL);
+		EV_SET(&e, fd, EVFILT_WRITE, swReactorKqueue_flags(fdtype), 0, 0, NULL);
 		memcpy(&e.udata, &fd_, sizeof(swFd));
 		ret = kevent(this->epfd, &e, 1, NULL, 0, NULL);
 		if (ret < 0)
@@ -210,7 +215,7 @@ static int swReactorKqueue_del(swReactor *reactor, int fd)
 	{
 		swWarn("kqueue remove fd[=%d] failed. Error: %s[%d]", fd, strerror(errno), errno);
 	}
-	ret = close(fd);
+	ret = (reactor->flag & SW_REACTOR_KEEP_FD) ? 0 : close(fd);
 	if (ret >= 0)
 	{
 		(reactor->event_num <= 0) ? reactor->event_num = 0 : reactor->event_num--;
@@ -234,6 +239,8 @@ static int swReactorKqueue_wait(swReactor *reactor, struct timeval *timeo)
 	while (SwooleG.running > 0)
 	{
 		n = kevent(this->epfd, NULL, 0, this->events, this->event_max, &t);
+		swClock_update();
+		swReactor_loop_begin(reactor);
 
 		if (n < 0)
 		{
@@ -268,7 +275,7 @@ static int swReactorKqueue_wait(swReactor *reactor, struct timeval *timeo)
 				if (this->events[i].filter == EVFILT_READ)
 				{
 					handle = swReactor_getHandle(reactor, SW_EVENT_READ, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_READ, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("kqueue event handler fail. fd=%d|errno=%d.Error: %s[%d]", event.fd, errno, strerror(errno), errno);
@@ -278,7 +285,7 @@ static int swReactorKqueue_wait(swReactor *reactor, struct timeval *timeo)
 				else if (this->events[i].filter == EVFILT_WRITE)
 				{
 					handle = swReactor_getHandle(reactor, SW_EVENT_WRITE, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_WRITE, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("kqueue event handler fail. fd=%d|errno=%d.Error: %s[%d]", event.fd, errno, strerror(errno), errno);
@@ -295,6 +302,7 @@ static int swReactorKqueue_wait(swReactor *reactor, struct timeval *timeo)
 		{
 			reactor->onFinish(reactor);
 		}
+		swReactor_loop_end(reactor);
 	}
 	return 0;
 }
@@ -71,6 +71,8 @@ int swReactorPoll_create(swReactor *reactor, int max_fd_num)
 	reactor->setHandle = swReactor_setHandle;
 	reactor->onFinish = NULL;
 	reactor->onTimeout = NULL;
+	reactor->slow_usec = 0;
+	reactor->slow_count = NULL;
 	return SW_OK;
 }
 
@@ -164,7 +166,10 @@ static int swReactorPoll_del(swReactor *reactor, int fd)
 					object->events[i] = object->events[i + 1];
 				}
 			}
-			close(fd);
+			if (!(reactor->flag & SW_REACTOR_KEEP_FD))
+			{
+				close(fd);
+			}
 			return SW_OK;
 		}
 	}
@@ -184,6 +189,8 @@ static int swReactorPoll_wait(swReactor *reactor, struct timeval *_timeo)
 	while (SwooleG.running > 0)
 	{
 		ret = poll(object->events, reactor->event_num, timeo.tv_sec * 1000 + timeo.tv_usec / 1000);
+		swClock_update();
+		swReactor_loop_begin(reactor);
 		if (ret < 0)
 		{
 			if (swReactor_error(reactor) < 0)
@@ -212,7 +219,7 @@ static int swReactorPoll_wait(swReactor *reactor, struct timeval *_timeo)
 				if (object->events[i].revents & POLLIN)
 				{
 					handle = swReactor_getHandle(reactor, SW_EVENT_READ, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_READ, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("poll[POLLIN] handler failed. fd=%d|errno=%d.Error: %s[%d]", event.fd, errno, strerror(errno), errno);
@@ -222,7 +229,7 @@ static int swReactorPoll_wait(swReactor *reactor, struct timeval *_timeo)
 				if (object->events[i].revents & (POLLHUP | POLLERR))
 				{
 					handle = swReactor_getHandle(reactor, SW_EVENT_READ, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_READ, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("poll[POLLERR] handler failed. fd=%d|errno=%d.Error: %s[%d]", event.fd, errno, strerror(errno), errno);
@@ -232,7 +239,7 @@ static int swReactorPoll_wait(swReactor *reactor, struct timeval *_timeo)
 				if (object->events[i].revents & POLLOUT)
 				{
 					handle = swReactor_getHandle(reactor, SW_EVENT_WRITE, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_WRITE, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("poll[POLLOUT] handler failed. fd=%d|errno=%d.Error: %s[%d]", event.fd, errno, strerror(errno), errno);
@@ -243,6 +250,7 @@ static int swReactorPoll_wait(swReactor *reactor, struct timeval *_timeo)
 			{
 				reactor->onFinish(reactor);
 			}
+			swReactor_loop_end(reactor);
 		}
 	}
 	return SW_OK;
@@ -69,14 +69,16 @@ int swReactorSelect_create(swReactor *reactor)
 	reactor->setHandle = swReactor_setHandle;
 	reactor->onFinish = NULL;
 	reactor->onTimeout = NULL;
+	reactor->slow_usec = 0;
+	reactor->slow_count = NULL;
 	return SW_OK;
 }
 
 void swReactorSelect_free(swReactor *reactor)
 {
-	swFdList_node *ev;
+	swFdList_node *ev, *tmp;
 	swReactorSelect *object = reactor->object;
-	LL_FOREACH(object->fds, ev)
+	LL_FOREACH_SAFE(object->fds, ev, tmp)
 	{
 		LL_DELETE(object->fds, ev);
 		sw_free(ev);
@@ -180,6 +182,8 @@ int swReactorSelect_wait(swReactor *reactor, struct timeval *timeo)
 			}
 		}
 		ret = select(object->maxfd + 1, &(object->rfds), &(object->wfds), &(object->efds), &timeout);
+		swClock_update();
+		swReactor_loop_begin(reactor);
 		if (ret < 0)
 		{
 			if (swReactor_error(reactor) < 0)
@@ -207,7 +211,7 @@ int swReactorSelect_wait(swReactor *reactor, struct timeval *timeo)
 					event.from_id = reactor->id;
 					event.type = swReactor_fdtype(ev->fdtype);
 					handle = swReactor_getHandle(reactor, SW_EVENT_READ, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_READ, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("[Reactor#%d] select event[type=%d] handler fail. fd=%d|errno=%d", reactor->id,
@@ -221,7 +225,7 @@ int swReactorSelect_wait(swReactor *reactor, struct timeval *timeo)
 					event.from_id = reactor->id;
 					event.type = SW_FD_WRITE;
 					handle = swReactor_getHandle(reactor, SW_EVENT_WRITE, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_WRITE, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("[Reactor#%d] select event[type=SW_FD_WRITE] handler fail. fd=%d|errno=%d", reactor->id,
@@ -236,7 +240,7 @@ int swReactorSelect_wait(swReactor *reactor, struct timeval *timeo)
 					event.from_id = reactor->id;
 					event.type = SW_FD_ERROR;
 					handle = swReactor_getHandle(reactor, SW_EVENT_ERROR, event.type);
-					ret = handle(reactor, &event);
+					ret = swReactor_call(reactor, SW_EVENT_ERROR, handle, &event);
 					if (ret < 0)
 					{
 						swWarn("[Reactor#%d] select event[type=SW_FD_ERROR] handler fail. fd=%d|errno=%d", reactor->id,
@@ -248,6 +252,7 @@ int swReactorSelect_wait(swReactor *reactor, struct timeval *timeo)
 			{
 				reactor->onFinish(reactor);
 			}
+			swReactor_loop_end(reactor);
 		}
 	}
 	return SW_OK;
@@ -0,0 +1,743 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "swoole.h"
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+
+#ifndef POLLRDHUP
+#define POLLRDHUP   0x2000
+#endif
+
+#define SW_URING_WAKEUP    ((uint64_t) -1)  //跨线程唤醒的eventfd
+#define SW_URING_IGNORE    ((uint64_t) -2)  //POLL_REMOVE的完成事件,直接忽略
+
+enum swReactorUring_op_type
+{
+	SW_URING_ADD = 1, SW_URING_SET, SW_URING_DEL,
+};
+
+typedef struct _swReactorUring_fd
+{
+	uint32_t gen;      //每次add/set/del递增,用来丢弃过期的完成事件
+	int fdtype;
+	uint8_t active;
+	uint8_t armed;     //poll请求已提交,还未返回
+} swReactorUring_fd;
+
+typedef struct _swReactorUring_op
+{
+	int fd;
+	int fdtype;
+	int type;
+} swReactorUring_op;
+
+typedef struct swReactorUring_s
+{
+	int ring_fd;
+	uint32_t sq_entries;
+
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	struct io_uring_sqe *sqes;
+
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ptr;
+	size_t sq_size;
+	void *cq_ptr;
+	size_t cq_size;
+	size_t sqes_size;
+
+	swReactorUring_fd *fds;
+	int fd_capacity;
+
+	/**
+	 * 其他线程调用add/set/del时放入队列,由reactor所在线程执行
+	 */
+	pthread_t owner;
+	int wakeup_fd;
+	swLock lock;
+	swReactorUring_op *ops;
+	int ops_num;
+	int ops_size;
+} swReactorUring;
+
+static int swReactorUring_add(swReactor *reactor, int fd, int fdtype);
+static int swReactorUring_set(swReactor *reactor, int fd, int fdtype);
+static int swReactorUring_del(swReactor *reactor, int fd);
+static int swReactorUring_wait(swReactor *reactor, struct timeval *timeo);
+static void swReactorUring_free(swReactor *reactor);
+static void swReactorUring_release(swReactorUring *object);
+
+static int swReactorUring_setup(swReactorUring *object, uint32_t entries);
+static int swReactorUring_enter(swReactorUring *object, uint32_t min_complete, struct timeval *timeo);
+static struct io_uring_sqe* swReactorUring_get_sqe(swReactorUring *object);
+static int swReactorUring_arm(swReactorUring *object, int fd);
+static void swReactorUring_cancel(swReactorUring *object, int fd);
+static swReactorUring_fd* swReactorUring_get_fd(swReactorUring *object, int fd);
+static int swReactorUring_push_op(swReactorUring *object, int type, int fd, int fdtype);
+static void swReactorUring_run_ops(swReactor *reactor);
+static int swReactorUring_arm_wakeup(swReactorUring *object);
+SWINLINE static uint32_t swReactorUring_event_set(int fdtype);
+
+#define swReactorUring_user_data(object, fd)  (((uint64_t) (object)->fds[fd].gen << 32) | (uint32_t) (fd))
+#define swReactorUring_in_owner(object)       pthread_equal(pthread_self(), (object)->owner)
+
+int swReactorUring_create(swReactor *reactor, int max_event_num)
+{
+	//create reactor object
+	swReactorUring *reactor_object = sw_malloc(sizeof(swReactorUring));
+	if (reactor_object == NULL)
+	{
+		swWarn("malloc[0] fail\n");
+		return SW_ERR;
+	}
+	bzero(reactor_object, sizeof(swReactorUring));
+	reactor_object->ring_fd = -1;
+	reactor_object->wakeup_fd = -1;
+
+	if (swReactorUring_setup(reactor_object, max_event_num) < 0)
+	{
+		swReactorUring_release(reactor_object);
+		return SW_ERR;
+	}
+	reactor_object->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (reactor_object->wakeup_fd < 0)
+	{
+		swWarn("eventfd create fail. Error: %s[%d]", strerror(errno), errno);
+		swReactorUring_release(reactor_object);
+		return SW_ERR;
+	}
+	if (swMutex_create(&reactor_object->lock, 0) < 0)
+	{
+		swWarn("create lock fail.");
+		swReactorUring_release(reactor_object);
+		return SW_ERR;
+	}
+	reactor_object->owner = pthread_self();
+	swReactorUring_arm_wakeup(reactor_object);
+
+	reactor->object = reactor_object;
+	reactor->max_event_num = max_event_num;
+	//binding method
+	reactor->add = swReactorUring_add;
+	reactor->set = swReactorUring_set;
+	reactor->del = swReactorUring_del;
+	reactor->wait = swReactorUring_wait;
+	reactor->free = swReactorUring_free;
+	reactor->setHandle = swReactor_setHandle;
+	reactor->onFinish = NULL;
+	reactor->onTimeout = NULL;
+	reactor->slow_usec = 0;
+	reactor->slow_count = NULL;
+	return SW_OK;
+}
+
+static int swReactorUring_setup(swReactorUring *object, uint32_t entries)
+{
+	struct io_uring_params params;
+
+	bzero(&params, sizeof(params));
+	object->ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (object->ring_fd < 0)
+	{
+		swTrace("io_uring_setup fail. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	//需要带超时的io_uring_enter, 并且完成队列满时不能丢事件
+	if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+	{
+		swTrace("io_uring features not supported. features=%x", params.features);
+		return SW_ERR;
+	}
+	object->sq_entries = params.sq_entries;
+	object->sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	object->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (object->cq_size > object->sq_size)
+		{
+			object->sq_size = object->cq_size;
+		}
+		object->cq_size = object->sq_size;
+	}
+	object->sq_ptr = mmap(NULL, object->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, object->ring_fd,
+			IORING_OFF_SQ_RING);
+	if (object->sq_ptr == MAP_FAILED)
+	{
+		object->sq_ptr = NULL;
+		swWarn("mmap[sq_ring] fail. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		object->cq_ptr = object->sq_ptr;
+	}
+	else
+	{
+		object->cq_ptr = mmap(NULL, object->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				object->ring_fd, IORING_OFF_CQ_RING);
+		if (object->cq_ptr == MAP_FAILED)
+		{
+			object->cq_ptr = NULL;
+			swWarn("mmap[cq_ring] fail. Error: %s[%d]", strerror(errno), errno);
+			return SW_ERR;
+		}
+	}
+	object->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	object->sqes = mmap(NULL, object->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, object->ring_fd,
+			IORING_OFF_SQES);
+	if (object->sqes == MAP_FAILED)
+	{
+		swWarn("mmap[sqes] fail. Error: %s[%d]", strerror(errno), errno);
+		return SW_ERR;
+	}
+
+	object->sq_head = object->sq_ptr + params.sq_off.head;
+	object->sq_tail = object->sq_ptr + params.sq_off.tail;
+	object->sq_mask = object->sq_ptr + params.sq_off.ring_mask;
+	object->sq_array = object->sq_ptr + params.sq_off.array;
+
+	object->cq_head = object->cq_ptr + params.cq_off.head;
+	object->cq_tail = object->cq_ptr + params.cq_off.tail;
+	object->cq_mask = object->cq_ptr + params.cq_off.ring_mask;
+	object->cqes = object->cq_ptr + params.cq_off.cqes;
+	return SW_OK;
+}
+
+static void swReactorUring_free(swReactor *reactor)
+{
+	swReactorUring *object = reactor->object;
+	object->lock.free(&object->lock);
+	swReactorUring_release(object);
+}
+
+/**
+ * 释放ring和内存, 创建失败时也会调用
+ */
+static void swReactorUring_release(swReactorUring *object)
+{
+	if (object->sqes != NULL && object->sqes != MAP_FAILED)
+	{
+		munmap(object->sqes, object->sqes_size);
+	}
+	if (object->cq_ptr != NULL && object->cq_ptr != object->sq_ptr)
+	{
+		munmap(object->cq_ptr, object->cq_size);
+	}
+	if (object->sq_ptr != NULL)
+	{
+		munmap(object->sq_ptr, object->sq_size);
+	}
+	if (object->ring_fd >= 0)
+	{
+		close(object->ring_fd);
+	}
+	if (object->wakeup_fd >= 0)
+	{
+		close(object->wakeup_fd);
+	}
+	if (object->fds != NULL)
+	{
+		sw_free(object->fds);
+	}
+	if (object->ops != NULL)
+	{
+		sw_free(object->ops);
+	}
+	sw_free(object);
+}
+
+/**
+ * 提交所有未提交的请求,min_complete > 0 时等待完成事件
+ */
+static int swReactorUring_enter(swReactorUring *object, uint32_t min_complete, struct timeval *timeo)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	uint32_t to_submit;
+	uint32_t flags = 0;
+
+	sw_atomic_memory_barrier();
+	to_submit = *object->sq_tail - *object->sq_head;
+	if (to_submit == 0 && min_complete == 0)
+	{
+		return SW_OK;
+	}
+	bzero(&arg, sizeof(arg));
+	if (min_complete > 0)
+	{
+		flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+		arg.sigmask_sz = _NSIG / 8;
+		if (timeo != NULL)
+		{
+			ts.tv_sec = timeo->tv_sec;
+			ts.tv_nsec = timeo->tv_usec * 1000;
+			arg.ts = (uint64_t) (uintptr_t) &ts;
+		}
+	}
+	return syscall(__NR_io_uring_enter, object->ring_fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+}
+
+static struct io_uring_sqe* swReactorUring_get_sqe(swReactorUring *object)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t tail = *object->sq_tail;
+	uint32_t index;
+
+	//提交队列满了,先提交
+	while (tail - *object->sq_head >= object->sq_entries)
+	{
+		if (swReactorUring_enter(object, 0, NULL) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			swWarn("io_uring_enter fail. Error: %s[%d]", strerror(errno), errno);
+			return NULL;
+		}
+		sw_atomic_memory_barrier();
+	}
+	index = tail & *object->sq_mask;
+	sqe = &object->sqes[index];
+	bzero(sqe, sizeof(struct io_uring_sqe));
+	object->sq_array[index] = index;
+	return sqe;
+}
+
+#define swReactorUring_commit_sqe(object) do { \
+	sw_atomic_memory_barrier(); \
+	(*(object)->sq_tail)++; \
+} while (0)
+
+static int swReactorUring_arm(swReactorUring *object, int fd)
+{
+	struct io_uring_sqe *sqe = swReactorUring_get_sqe(object);
+	if (sqe == NULL)
+	{
+		return SW_ERR;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = swReactorUring_event_set(object->fds[fd].fdtype);
+	//边缘触发使用multishot poll, 只在有新事件时通知, 不需要重新提交
+	if (object->fds[fd].fdtype & SW_EVENT_ET)
+	{
+		sqe->len = IORING_POLL_ADD_MULTI;
+	}
+	sqe->user_data = swReactorUring_user_data(object, fd);
+	swReactorUring_commit_sqe(object);
+	object->fds[fd].armed = 1;
+	return SW_OK;
+}
+
+static void swReactorUring_cancel(swReactorUring *object, int fd)
+{
+	struct io_uring_sqe *sqe;
+
+	if (object->fds[fd].armed == 0)
+	{
+		return;
+	}
+	sqe = swReactorUring_get_sqe(object);
+	if (sqe == NULL)
+	{
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = swReactorUring_user_data(object, fd);
+	sqe->user_data = SW_URING_IGNORE;
+	swReactorUring_commit_sqe(object);
+	object->fds[fd].armed = 0;
+}
+
+static int swReactorUring_arm_wakeup(swReactorUring *object)
+{
+	struct io_uring_sqe *sqe = swReactorUring_get_sqe(object);
+	if (sqe == NULL)
+	{
+		return SW_ERR;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = object->wakeup_fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = SW_URING_WAKEUP;
+	swReactorUring_commit_sqe(object);
+	return SW_OK;
+}
+
+static swReactorUring_fd* swReactorUring_get_fd(swReactorUring *object, int fd)
+{
+	int capacity;
+	void *new_ptr;
+
+	if (fd < object->fd_capacity)
+	{
+		return &object->fds[fd];
+	}
+	capacity = object->fd_capacity == 0 ? SW_REACTOR_MAXEVENTS : object->fd_capacity;
+	while (capacity <= fd)
+	{
+		capacity *= 2;
+	}
+	new_ptr = sw_realloc(object->fds, capacity * sizeof(swReactorUring_fd));
+	if (new_ptr == NULL)
+	{
+		swWarn("realloc[fds] fail. capacity=%d", capacity);
+		return NULL;
+	}
+	object->fds = new_ptr;
+	bzero(object->fds + object->fd_capacity, (capacity - object->fd_capacity) * sizeof(swReactorUring_fd));
+	object->fd_capacity = capacity;
+	return &object->fds[fd];
+}
+
+SWINLINE static uint32_t swReactorUring_event_set(int fdtype)
+{
+	uint32_t flag = 0;
+	if (swReactor_event_read(fdtype))
+	{
+		flag |= POLLIN;
+	}
+	if (swReactor_event_write(fdtype))
+	{
+		flag |= POLLOUT;
+	}
+	if (swReactor_event_error(fdtype))
+	{
+		flag |= POLLRDHUP;
+	}
+	return flag;
+}
+
+static int swReactorUring_push_op(swReactorUring *object, int type, int fd, int fdtype)
+{
+	uint64_t flag = 1;
+	void *new_ptr;
+
+	object->lock.lock(&object->lock);
+	if (object->ops_num == object->ops_size)
+	{
+		int size = object->ops_size == 0 ? 64 : object->ops_size * 2;
+		new_ptr = sw_realloc(object->ops, size * sizeof(swReactorUring_op));
+		if (new_ptr == NULL)
+		{
+			object->lock.unlock(&object->lock);
+			swWarn("realloc[ops] fail. size=%d", size);
+			return SW_ERR;
+		}
+		object->ops = new_ptr;
+		object->ops_size = size;
+	}
+	object->ops[object->ops_num].type = type;
+	object->ops[object->ops_num].fd = fd;
+	object->ops[object->ops_num].fdtype = fdtype;
+	object->ops_num++;
+	object->lock.unlock(&object->lock);
+
+	if (write(object->wakeup_fd, &flag, sizeof(flag)) < 0 && errno != EAGAIN)
+	{
+		swWarn("write to wakeup_fd fail. Error: %s[%d]", strerror(errno), errno);
+	}
+	return SW_OK;
+}
+
+/**
+ * 执行其他线程提交的操作
+ */
+static void swReactorUring_run_ops(swReactor *reactor)
+{
+	swReactorUring *object = reactor->object;
+	swReactorUring_op op;
+	int i;
+
+	object->lock.lock(&object->lock);
+	for (i = 0; i < object->ops_num; i++)
+	{
+		op = object->ops[i];
+		switch (op.type)
+		{
+		case SW_URING_ADD:
+			swReactorUring_add(reactor, op.fd, op.fdtype);
+			break;
+		case SW_URING_SET:
+			swReactorUring_set(reactor, op.fd, op.fdtype);
+			break;
+		default:
+			swReactorUring_del(reactor, op.fd);
+			break;
+		}
+	}
+	object->ops_num = 0;
+	object->lock.unlock(&object->lock);
+}
+
+static int swReactorUring_add(swReactor *reactor, int fd, int fdtype)
+{
+	swReactorUring *object = reactor->object;
+	swReactorUring_fd *fd_;
+
+	if (!swReactorUring_in_owner(object))
+	{
+		return swReactorUring_push_op(object, SW_URING_ADD, fd, fdtype);
+	}
+	fd_ = swReactorUring_get_fd(object, fd);
+	if (fd_ == NULL)
+	{
+		return SW_ERR;
+	}
+	if (fd_->active)
+	{
+		swWarn("add event fail. fd=%d is exists.", fd);
+		return SW_ERR;
+	}
+	fd_->gen++;
+	fd_->fdtype = fdtype;
+	fd_->active = 1;
+	if (swReactorUring_arm(object, fd) < 0)
+	{
+		fd_->active = 0;
+		return SW_ERR;
+	}
+	swTraceLog(SW_TRACE_EVENT, "add event[reactor_id=%d|fd=%d]", reactor->id, fd);
+	reactor->event_num++;
+	return SW_OK;
+}
+
+static int swReactorUring_set(swReactor *reactor, int fd, int fdtype)
+{
+	swReactorUring *object = reactor->object;
+
+	if (!swReactorUring_in_owner(object))
+	{
+		return swReactorUring_push_op(object, SW_URING_SET, fd, fdtype);
+	}
+	if (fd >= object->fd_capacity || object->fds[fd].active == 0)
+	{
+		swWarn("set event[reactor_id=%d|fd=%d] failed. fd is not exists.", reactor->id, fd);
+		return SW_ERR;
+	}
+	object->fds[fd].fdtype = fdtype;
+	//正在处理此fd的事件时,处理完成后会按新的事件重新提交
+	if (object->fds[fd].armed)
+	{
+		swReactorUring_cancel(object, fd);
+		object->fds[fd].gen++;
+		return swReactorUring_arm(object, fd);
+	}
+	return SW_OK;
+}
+
+static int swReactorUring_del(swReactor *reactor, int fd)
+{
+	swReactorUring *object = reactor->object;
+	int ret, armed = 0;
+
+	if (fd <= 0)
+	{
+		return SW_ERR;
+	}
+	if (!swReactorUring_in_owner(object))
+	{
+		return swReactorUring_push_op(object, SW_URING_DEL, fd, 0);
+	}
+	if (fd < object->fd_capacity && object->fds[fd].active)
+	{
+		armed = object->fds[fd].armed;
+		swReactorUring_cancel(object, fd);
+		object->fds[fd].gen++;
+		object->fds[fd].active = 0;
+	}
+	else
+	{
+		swWarn("uring remove fd[=%d] failed. fd is not exists.", fd);
+	}
+	//poll请求会持有文件的引用, close之前先提交POLL_REMOVE, 否则fd被复用时旧的poll还在
+	if (armed && !(reactor->flag & SW_REACTOR_KEEP_FD) && swReactorUring_enter(object, 0, NULL) < 0)
+	{
+		swWarn("io_uring_enter fail. Error: %s[%d]", strerror(errno), errno);
+	}
+	ret = (reactor->flag & SW_REACTOR_KEEP_FD) ? 0 : close(fd);
+	if (ret >= 0)
+	{
+		(reactor->event_num <= 0) ? reactor->event_num = 0 : reactor->event_num--;
+	}
+	swTraceLog(SW_TRACE_EVENT, "remove event[reactor_id=%d|fd=%d]", reactor->id, fd);
+	return SW_OK;
+}
+
+static int swReactorUring_wait(swReactor *reactor, struct timeval *timeo)
+{
+	swEvent ev;
+	swReactorUring *object = reactor->object;
+	swReactorUring_fd *fd_;
+	swReactor_handle handle;
+	struct io_uring_cqe *cqe;
+	uint64_t user_data, flag;
+	uint32_t head, gen, events, cqe_flags;
+	int fd, res, n, ret;
+
+	object->owner = pthread_self();
+
+	while (SwooleG.running > 0)
+	{
+		if (object->ops_num > 0)
+		{
+			swReactorUring_run_ops(reactor);
+		}
+		//提交本轮所有的poll请求并等待事件,一次系统调用
+		ret = swReactorUring_enter(object, 1, timeo);
+		swClock_update();
+		swReactor_loop_begin(reactor);
+		if (ret < 0 && errno != ETIME && errno != EBUSY)
+		{
+			if (swReactor_error(reactor) < 0)
+			{
+				swWarn("Uring[#%d] Error: %s[%d]", reactor->id, strerror(errno), errno);
+				return SW_ERR;
+			}
+			else
+			{
+				continue;
+			}
+		}
+
+		n = 0;
+		head = *object->cq_head;
+		while (1)
+		{
+			sw_atomic_memory_barrier();
+			if (head == *object->cq_tail)
+			{
+				break;
+			}
+			cqe = &object->cqes[head & *object->cq_mask];
+			user_data = cqe->user_data;
+			res = cqe->res;
+			cqe_flags = cqe->flags;
+			head++;
+			//取出后立即释放完成队列的空间
+			sw_atomic_memory_barrier();
+			*object->cq_head = head;
+
+			if (user_data == SW_URING_IGNORE)
+			{
+				continue;
+			}
+			else if (user_data == SW_URING_WAKEUP)
+			{
+				while (read(object->wakeup_fd, &flag, sizeof(flag)) > 0);
+				swReactorUring_arm_wakeup(object);
+				swReactorUring_run_ops(reactor);
+				continue;
+			}
+
+			fd = (int) (uint32_t) user_data;
+			gen = (uint32_t) (user_data >> 32);
+			if (fd >= object->fd_capacity)
+			{
+				continue;
+			}
+			fd_ = &object->fds[fd];
+			//已经被删除或者修改过的fd
+			if (fd_->gen != gen || fd_->active == 0)
+			{
+				continue;
+			}
+			//multishot poll仍然有效
+			fd_->armed = (cqe_flags & IORING_CQE_F_MORE) ? 1 : 0;
+			if (res < 0)
+			{
+				swWarn("[Reactor#%d] uring poll failed. fd=%d. Error: %s[%d]", reactor->id, fd, strerror(-res), -res);
+				continue;
+			}
+			n++;
+			events = res;
+			ev.fd = fd;
+			ev.from_id = reactor->id;
+			ev.type = swReactor_fdtype(fd_->fdtype);
+
+			//read
+			if ((events & POLLIN) || ((events & (POLLERR | POLLHUP)) && swReactor_event_read(fd_->fdtype)))
+			{
+				handle = swReactor_getHandle(reactor, SW_EVENT_READ, ev.type);
+				ret = swReactor_call(reactor, SW_EVENT_READ, handle, &ev);
+				if (ret < 0)
+				{
+					swWarn("[Reactor#%d] uring [POLLIN] handle failed. fd=%d. Error: %s[%d]", reactor->id, ev.fd,
+							strerror(errno), errno);
+				}
+			}
+			//回调中可能add新的fd导致fds被realloc
+			fd_ = &object->fds[fd];
+			//write
+			if ((events & POLLOUT) && fd_->gen == gen && fd_->active)
+			{
+				handle = swReactor_getHandle(reactor, SW_EVENT_WRITE, ev.type);
+				ret = swReactor_call(reactor, SW_EVENT_WRITE, handle, &ev);
+				if (ret < 0)
+				{
+					swWarn("[Reactor#%d] uring [POLLOUT] handle failed. fd=%d. Error: %s[%d]", reactor->id, ev.fd,
+							strerror(errno), errno);
+				}
+			}
+			fd_ = &object->fds[fd];
+			//error
+			if ((events & POLLRDHUP) && fd_->gen == gen && fd_->active)
+			{
+				handle = swReactor_getHandle(reactor, SW_EVENT_ERROR, ev.type);
+				ret = swReactor_call(reactor, SW_EVENT_ERROR, handle, &ev);
+				if (ret < 0)
+				{
+					swWarn("[Reactor#%d] uring [POLLRDHUP] handle failed. fd=%d. Error: %s[%d]", reactor->id, ev.fd,
+							strerror(errno), errno);
+				}
+			}
+			fd_ = &object->fds[fd];
+			//one-shot poll重新提交, 保持和epoll水平触发相同的语义
+			if (fd_->gen == gen && fd_->active && fd_->armed == 0)
+			{
+				swReactorUring_arm(object, fd);
+			}
+		}
+
+		if (n == 0)
+		{
+			if (reactor->onTimeout != NULL)
+			{
+				reactor->onTimeout(reactor);
+			}
+			continue;
+		}
+		if (reactor->onFinish != NULL)
+		{
+			reactor->onFinish(reactor);
+		}
+		swReactor_loop_end(reactor);
+	}
+	return 0;
+}
+
+#endif
@@ -17,6 +17,9 @@
 /* $Id: swoole.c 2013-12-24 10:31:55Z tianfeng $ */
 
 #include "php_swoole.h"
+#include "http.h"
+#include "websocket.h"
+#include "table.h"
 #include <ext/standard/info.h>
 
 #include <netinet/in.h>
@@ -26,6 +29,12 @@
 
 zval *php_sw_callback[PHP_SERVER_CALLBACK_NUM];
 
+static zend_fcall_info php_sw_callback_fci[PHP_SERVER_CALLBACK_NUM];
+static zend_fcall_info_cache php_sw_callback_fcc[PHP_SERVER_CALLBACK_NUM];
+
+#define PHP_SERVER_CALLBACK_ARGS_NUM         4
+static __thread zval *php_sw_callback_args[PHP_SERVER_CALLBACK_ARGS_NUM];
+
 HashTable php_sw_reactor_callback;
 HashTable php_sw_timer_callback;
 HashTable php_sw_client_callback;
@@ -86,12 +95,44 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_sendfile, 0, 0, 3)
 	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
 	ZEND_ARG_INFO(0, conn_fd)
 	ZEND_ARG_INFO(0, filename)
+	ZEND_ARG_INFO(0, offset)
+	ZEND_ARG_INFO(0, length)
 ZEND_END_ARG_INFO()
 
 //for object style
 ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_sendfile_oo, 0, 0, 2)
 	ZEND_ARG_INFO(0, conn_fd)
 	ZEND_ARG_INFO(0, filename)
+	ZEND_ARG_INFO(0, offset)
+	ZEND_ARG_INFO(0, length)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_proxy, 0, 0, 4)
+	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
+	ZEND_ARG_INFO(0, conn_fd)
+	ZEND_ARG_INFO(0, host)
+	ZEND_ARG_INFO(0, port)
+ZEND_END_ARG_INFO()
+
+//for object style
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_proxy_oo, 0, 0, 3)
+	ZEND_ARG_INFO(0, conn_fd)
+	ZEND_ARG_INFO(0, host)
+	ZEND_ARG_INFO(0, port)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_push, 0, 0, 3)
+	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
+	ZEND_ARG_INFO(0, conn_fd)
+	ZEND_ARG_INFO(0, data)
+	ZEND_ARG_INFO(0, opcode)
+ZEND_END_ARG_INFO()
+
+//for object style
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_push_oo, 0, 0, 2)
+	ZEND_ARG_INFO(0, conn_fd)
+	ZEND_ARG_INFO(0, data)
+	ZEND_ARG_INFO(0, opcode)
 ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_close, 0, 0, 2)
@@ -183,6 +224,17 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_taskwait_oo, 0, 0, 1)
 	ZEND_ARG_INFO(0, worker_id)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_taskWaitMulti, 0, 0, 2)
+	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
+	ZEND_ARG_INFO(0, tasks)
+	ZEND_ARG_INFO(0, timeout)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_taskWaitMulti_oo, 0, 0, 1)
+	ZEND_ARG_INFO(0, tasks)
+	ZEND_ARG_INFO(0, timeout)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_finish, 0, 0, 2)
 	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
 	ZEND_ARG_INFO(0, data)
@@ -206,6 +258,13 @@ ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_shutdown_oo, 0, 0, 0)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_stats, 0, 0, 1)
+	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_stats_oo, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_heartbeat, 0, 0, 2)
 	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
 	ZEND_ARG_INFO(0, from_id)
@@ -237,6 +296,28 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_connection_list_oo, 0, 0, 2)
 	ZEND_ARG_INFO(0, find_count)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_sendv, 0, 0, 3)
+	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
+	ZEND_ARG_INFO(0, conn_fd)
+	ZEND_ARG_ARRAY_INFO(0, send_data, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_sendv_oo, 0, 0, 2)
+	ZEND_ARG_INFO(0, conn_fd)
+	ZEND_ARG_ARRAY_INFO(0, send_data, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_broadcast, 0, 0, 2)
+	ZEND_ARG_OBJ_INFO(0, zobject, swoole_server, 0)
+	ZEND_ARG_INFO(0, send_data)
+	ZEND_ARG_ARRAY_INFO(0, fds, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_server_broadcast_oo, 0, 0, 1)
+	ZEND_ARG_INFO(0, send_data)
+	ZEND_ARG_ARRAY_INFO(0, fds, 1)
+ZEND_END_ARG_INFO()
+
 //arginfo event
 ZEND_BEGIN_ARG_INFO_EX(arginfo_swoole_event_add, 0, 0, 2)
 	ZEND_ARG_INFO(0, fd)
@@ -266,18 +347,25 @@ ZEND_END_ARG_INFO()
 //arginfo end
 
 static int php_swoole_onReceive(swFactory *, swEventData *);
+static int php_swoole_onRequest(swFactory *, swEventData *);
+static int php_swoole_onMessage(swFactory *, swEventData *);
 static void php_swoole_onStart(swServer *);
 static void php_swoole_onShutdown(swServer *);
 static void php_swoole_onConnect(swServer *, int fd, int from_id);
 static void php_swoole_onClose(swServer *, int fd, int from_id);
+static void php_swoole_onBufferFull(swServer *, int fd, int from_id);
+static void php_swoole_onBufferEmpty(swServer *, int fd, int from_id);
 static void php_swoole_onTimer(swServer *serv, int interval);
 static void php_swoole_onWorkerStart(swServer *, int worker_id);
 static void php_swoole_onWorkerStop(swServer *, int worker_id);
+static void php_swoole_onWorkerWarmup(swServer *, int worker_id);
 static void php_swoole_onMasterConnect(swServer *, int fd, int from_id);
 static void php_swoole_onMasterClose(swServer *, int fd, int from_id);
 static int php_swoole_onTask(swServer *, swEventData *task);
 static int php_swoole_onFinish(swServer *, swEventData *task);
+static int php_swoole_onFinishBatch(swServer *, swEventData *batch);
 static void php_swoole_onWorkerError(swServer *serv, int worker_id, pid_t worker_pid, int exit_code);
+static void php_swoole_onSlowlog(const char *name, uint64_t usec);
 
 static void swoole_destory_server(zend_rsrc_list_entry *rsrc TSRMLS_DC);
 static void swoole_destory_client(zend_rsrc_list_entry *rsrc TSRMLS_DC);
@@ -306,7 +394,10 @@ const zend_function_entry swoole_functions[] =
 	PHP_FE(swoole_server_set, arginfo_swoole_server_set)
 	PHP_FE(swoole_server_start, arginfo_swoole_server_start)
 	PHP_FE(swoole_server_send, arginfo_swoole_server_send)
+	PHP_FE(swoole_server_sendv, arginfo_swoole_server_sendv)
 	PHP_FE(swoole_server_sendfile, arginfo_swoole_server_sendfile)
+	PHP_FE(swoole_server_push, arginfo_swoole_server_push)
+	PHP_FE(swoole_server_proxy, arginfo_swoole_server_proxy)
 	PHP_FE(swoole_server_close, arginfo_swoole_server_close)
 	PHP_FE(swoole_server_handler, arginfo_swoole_server_handler)
 	PHP_FE(swoole_server_on, arginfo_swoole_server_on)
@@ -315,12 +406,15 @@ const zend_function_entry swoole_functions[] =
 	PHP_FE(swoole_server_deltimer, arginfo_swoole_server_deltimer)
 	PHP_FE(swoole_server_task, arginfo_swoole_server_task)
 	PHP_FE(swoole_server_taskwait, arginfo_swoole_server_taskwait)
+	PHP_FE(swoole_server_taskWaitMulti, arginfo_swoole_server_taskWaitMulti)
 	PHP_FE(swoole_server_finish, arginfo_swoole_server_finish)
 	PHP_FE(swoole_server_reload, arginfo_swoole_server_reload)
 	PHP_FE(swoole_server_shutdown, arginfo_swoole_server_shutdown)
 	PHP_FE(swoole_server_heartbeat, arginfo_swoole_server_heartbeat)
+	PHP_FE(swoole_server_stats, arginfo_swoole_server_stats)
 	PHP_FE(swoole_connection_info, arginfo_swoole_connection_info)
 	PHP_FE(swoole_connection_list, arginfo_swoole_connection_list)
+	PHP_FE(swoole_server_broadcast, arginfo_swoole_server_broadcast)
 	/*------swoole_event-----*/
 	PHP_FE(swoole_event_add, arginfo_swoole_event_add)
 	PHP_FE(swoole_event_del, arginfo_swoole_event_del)
@@ -337,6 +431,7 @@ const zend_function_entry swoole_functions[] =
 	PHP_FE(swoole_async_dns_lookup, NULL)
 	/*------other-----*/
 	PHP_FE(swoole_client_select, NULL)
+	PHP_FE(swoole_client_pool_set, NULL)
 	PHP_FE(swoole_set_process_name, NULL)
 	PHP_FE(swoole_get_local_ip, NULL)
 	PHP_FE(swoole_strerror, NULL)
@@ -352,10 +447,14 @@ static zend_function_entry swoole_server_methods[] = {
 	PHP_FALIAS(set, swoole_server_set, arginfo_swoole_server_set_oo)
 	PHP_FALIAS(start, swoole_server_start, arginfo_swoole_server_start_oo)
 	PHP_FALIAS(send, swoole_server_send, arginfo_swoole_server_send_oo)
+	PHP_FALIAS(sendv, swoole_server_sendv, arginfo_swoole_server_sendv_oo)
 	PHP_FALIAS(sendfile, swoole_server_sendfile, arginfo_swoole_server_sendfile_oo)
+	PHP_FALIAS(push, swoole_server_push, arginfo_swoole_server_push_oo)
+	PHP_FALIAS(proxy, swoole_server_proxy, arginfo_swoole_server_proxy_oo)
 	PHP_FALIAS(close, swoole_server_close, arginfo_swoole_server_close_oo)
 	PHP_FALIAS(task, swoole_server_task, arginfo_swoole_server_task_oo)
 	PHP_FALIAS(taskwait, swoole_server_taskwait, arginfo_swoole_server_taskwait_oo)
+	PHP_FALIAS(taskWaitMulti, swoole_server_taskWaitMulti, arginfo_swoole_server_taskWaitMulti_oo)
 	PHP_FALIAS(finish, swoole_server_finish, arginfo_swoole_server_finish_oo)
 	PHP_FALIAS(addlistener, swoole_server_addlisten, arginfo_swoole_server_addlisten_oo)
 	PHP_FALIAS(addtimer, swoole_server_addtimer, arginfo_swoole_server_addtimer_oo)
@@ -363,10 +462,12 @@ static zend_function_entry swoole_server_methods[] = {
 	PHP_FALIAS(reload, swoole_server_reload, arginfo_swoole_server_reload_oo)
 	PHP_FALIAS(shutdown, swoole_server_shutdown, arginfo_swoole_server_shutdown_oo)
 	PHP_FALIAS(hbcheck, swoole_server_heartbeat, arginfo_swoole_server_heartbeat_oo)
+	PHP_FALIAS(stats, swoole_server_stats, arginfo_swoole_server_stats_oo)
 	PHP_FALIAS(handler, swoole_server_handler, arginfo_swoole_server_handler_oo)
 	PHP_FALIAS(on, swoole_server_on, arginfo_swoole_server_on_oo)
 	PHP_FALIAS(connection_info, swoole_connection_info, arginfo_swoole_connection_info_oo)
 	PHP_FALIAS(connection_list, swoole_connection_list, arginfo_swoole_connection_list_oo)
+	PHP_FALIAS(broadcast, swoole_server_broadcast, arginfo_swoole_server_broadcast_oo)
 	{NULL, NULL, NULL}
 };
 
@@ -381,6 +482,50 @@ const zend_function_entry swoole_client_methods[] =
 	PHP_FE_END
 };
 
+#ifdef HAVE_EPOLL
+const zend_function_entry swoole_client_waitset_methods[] =
+{
+	PHP_ME(swoole_client_waitset, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(swoole_client_waitset, add, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_client_waitset, del, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_client_waitset, wait, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_client_waitset, count, NULL, ZEND_ACC_PUBLIC)
+	PHP_FE_END
+};
+#endif
+
+const zend_function_entry swoole_mysql_methods[] =
+{
+	PHP_ME(swoole_mysql, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(swoole_mysql, query, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_mysql, execute, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_mysql, close, NULL, ZEND_ACC_PUBLIC)
+	PHP_FE_END
+};
+
+const zend_function_entry swoole_redis_methods[] =
+{
+	PHP_ME(swoole_redis, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(swoole_redis, command, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_redis, close, NULL, ZEND_ACC_PUBLIC)
+	PHP_FE_END
+};
+
+const zend_function_entry swoole_table_methods[] =
+{
+	PHP_ME(swoole_table, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(swoole_table, column, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, create, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, set, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, get, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, exist, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, del, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, incr, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, decr, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(swoole_table, count, NULL, ZEND_ACC_PUBLIC)
+	PHP_FE_END
+};
+
 const zend_function_entry swoole_lock_methods[] =
 {
 	PHP_ME(swoole_lock, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
@@ -395,6 +540,10 @@ const zend_function_entry swoole_lock_methods[] =
 int le_swoole_server;
 int le_swoole_client;
 int le_swoole_lock;
+int le_swoole_client_waitset;
+int le_swoole_mysql;
+int le_swoole_redis;
+int le_swoole_table;
 
 zend_class_entry swoole_lock_ce;
 zend_class_entry *swoole_lock_class_entry_ptr;
@@ -402,6 +551,18 @@ zend_class_entry *swoole_lock_class_entry_ptr;
 zend_class_entry swoole_client_ce;
 zend_class_entry *swoole_client_class_entry_ptr;
 
+zend_class_entry swoole_client_waitset_ce;
+zend_class_entry *swoole_client_waitset_class_entry_ptr;
+
+zend_class_entry swoole_mysql_ce;
+zend_class_entry *swoole_mysql_class_entry_ptr;
+
+zend_class_entry swoole_redis_ce;
+zend_class_entry *swoole_redis_class_entry_ptr;
+
+zend_class_entry swoole_table_ce;
+zend_class_entry *swoole_table_class_entry_ptr;
+
 zend_class_entry swoole_server_ce;
 zend_class_entry *swoole_server_class_entry_ptr;
 
@@ -457,6 +618,12 @@ PHP_MINIT_FUNCTION(swoole)
 	le_swoole_server = zend_register_list_destructors_ex(swoole_destory_server, NULL, SW_RES_SERVER_NAME, module_number);
 	le_swoole_client = zend_register_list_destructors_ex(swoole_destory_client, NULL, SW_RES_CLIENT_NAME, module_number);
 	le_swoole_lock = zend_register_list_destructors_ex(swoole_destory_lock, NULL, SW_RES_LOCK_NAME, module_number);
+#ifdef HAVE_EPOLL
+	le_swoole_client_waitset = zend_register_list_destructors_ex(swoole_destory_client_waitset, NULL, SW_RES_CLIENT_WAITSET_NAME, module_number);
+#endif
+	le_swoole_mysql = zend_register_list_destructors_ex(swoole_destory_mysql, NULL, SW_RES_MYSQL_NAME, module_number);
+	le_swoole_redis = zend_register_list_destructors_ex(swoole_destory_redis, NULL, SW_RES_REDIS_NAME, module_number);
+	le_swoole_table = zend_register_list_destructors_ex(swoole_destory_table, NULL, SW_RES_TABLE_NAME, module_number);
 	/**
 	 * mode type
 	 */
@@ -470,6 +637,7 @@ PHP_MINIT_FUNCTION(swoole)
 	REGISTER_LONG_CONSTANT("SWOOLE_SOCK_TCP6", SW_SOCK_TCP6, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SWOOLE_SOCK_UDP", SW_SOCK_UDP, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SWOOLE_SOCK_UDP6", SW_SOCK_UDP6, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_SSL", SW_SOCK_SSL, CONST_CS | CONST_PERSISTENT);
 	/**
 	 * simple api
 	 */
@@ -484,10 +652,19 @@ PHP_MINIT_FUNCTION(swoole)
 	REGISTER_LONG_CONSTANT("SWOOLE_FILELOCK", SW_FILELOCK, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SWOOLE_MUTEX", SW_MUTEX, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SWOOLE_SEM", SW_SEM, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_FUTEXLOCK", SW_FUTEXLOCK, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_SEQLOCK", SW_SEQLOCK, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_BRLOCK", SW_BRLOCK, CONST_CS | CONST_PERSISTENT);
 
 #ifdef HAVE_SPINLOCK
 	REGISTER_LONG_CONSTANT("SWOOLE_SPINLOCK", SW_SPINLOCK, CONST_CS | CONST_PERSISTENT);
 #endif
+	/**
+	 * swoole_table column type
+	 */
+	REGISTER_LONG_CONSTANT("SWOOLE_TABLE_INT", SW_TABLE_INT, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_TABLE_FLOAT", SW_TABLE_FLOAT, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_TABLE_STRING", SW_TABLE_STRING, CONST_CS | CONST_PERSISTENT);
 	/**
 	 * simple api
 	 */
@@ -497,6 +674,9 @@ PHP_MINIT_FUNCTION(swoole)
 	REGISTER_LONG_CONSTANT("SWOOLE_SYNC", SW_FLAG_SYNC, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SWOOLE_ASYNC", SW_FLAG_ASYNC, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SWOOLE_KEEP", SW_FLAG_KEEP, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_FASTOPEN", SW_FLAG_FASTOPEN, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_EVENT_READ", SW_EVENT_READ, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SWOOLE_EVENT_WRITE", SW_EVENT_WRITE, CONST_CS | CONST_PERSISTENT);
 
 	REGISTER_LONG_CONSTANT("SWOOLE_SIGN", SW_NUM_SIGN, CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SWOOLE_UNSIGN", SW_NUM_UNSIGN, CONST_CS | CONST_PERSISTENT);
@@ -513,12 +693,33 @@ PHP_MINIT_FUNCTION(swoole)
 	zend_declare_property_long(swoole_client_class_entry_ptr, SW_STRL("errCode")-1, 0, ZEND_ACC_PUBLIC TSRMLS_CC);
 	zend_declare_property_long(swoole_client_class_entry_ptr, SW_STRL("sock")-1, 0, ZEND_ACC_PUBLIC TSRMLS_CC);
 
+#ifdef HAVE_EPOLL
+	INIT_CLASS_ENTRY(swoole_client_waitset_ce, "swoole_client_waitset", swoole_client_waitset_methods);
+	swoole_client_waitset_class_entry_ptr = zend_register_internal_class(&swoole_client_waitset_ce TSRMLS_CC);
+#endif
+
+	INIT_CLASS_ENTRY(swoole_mysql_ce, "swoole_mysql", swoole_mysql_methods);
+	swoole_mysql_class_entry_ptr = zend_register_internal_class(&swoole_mysql_ce TSRMLS_CC);
+
+	zend_declare_property_long(swoole_mysql_class_entry_ptr, SW_STRL("errno")-1, 0, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_string(swoole_mysql_class_entry_ptr, SW_STRL("error")-1, "", ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_long(swoole_mysql_class_entry_ptr, SW_STRL("affected_rows")-1, 0, ZEND_ACC_PUBLIC TSRMLS_CC);
+	zend_declare_property_long(swoole_mysql_class_entry_ptr, SW_STRL("insert_id")-1, 0, ZEND_ACC_PUBLIC TSRMLS_CC);
+
+	INIT_CLASS_ENTRY(swoole_redis_ce, "swoole_redis", swoole_redis_methods);
+	swoole_redis_class_entry_ptr = zend_register_internal_class(&swoole_redis_ce TSRMLS_CC);
+
+	zend_declare_property_string(swoole_redis_class_entry_ptr, SW_STRL("error")-1, "", ZEND_ACC_PUBLIC TSRMLS_CC);
+
 	INIT_CLASS_ENTRY(swoole_server_ce, "swoole_server", swoole_server_methods);
 	swoole_server_class_entry_ptr = zend_register_internal_class(&swoole_server_ce TSRMLS_CC);
 
 	INIT_CLASS_ENTRY(swoole_lock_ce, "swoole_lock", swoole_lock_methods);
 	swoole_lock_class_entry_ptr = zend_register_internal_class(&swoole_lock_ce TSRMLS_CC);
 
+	INIT_CLASS_ENTRY(swoole_table_ce, "swoole_table", swoole_table_methods);
+	swoole_table_class_entry_ptr = zend_register_internal_class(&swoole_table_ce TSRMLS_CC);
+
 	zend_hash_init(&php_sw_long_connections, 16, NULL, ZVAL_PTR_DTOR, 1);
 
 	//swoole init
@@ -620,7 +821,11 @@ static void swoole_destory_server(zend_rsrc_list_entry *rsrc TSRMLS_DC)
 static void swoole_destory_client(zend_rsrc_list_entry *rsrc TSRMLS_DC)
 {
 	swClient *cli = (swClient *) rsrc->ptr;
-	if (cli->keep == 0)
+	if (cli->pool != NULL)
+	{
+		swClientPool_release(cli->pool, cli);
+	}
+	else if (cli->keep == 0)
 	{
 		if (cli->sock != 0)
 		{
@@ -733,6 +938,32 @@ PHP_FUNCTION(swoole_server_create)
 	zval_ptr_dtor(&zres);
 }
 
+static void php_swoole_set_listen_option(swServer *serv, zval **v, int option)
+{
+	zval **element;
+	char *key;
+	uint key_len;
+	ulong num_key;
+
+	if (Z_TYPE_PP(v) != IS_ARRAY)
+	{
+		convert_to_long(*v);
+		swServer_set_listen_option(serv, 0, option, (int) Z_LVAL_PP(v));
+		return;
+	}
+	for (zend_hash_internal_pointer_reset(Z_ARRVAL_PP(v));
+			zend_hash_get_current_data(Z_ARRVAL_PP(v), (void **) &element) == SUCCESS;
+			zend_hash_move_forward(Z_ARRVAL_PP(v)))
+	{
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_PP(v), &key, &key_len, &num_key, 0, NULL) != HASH_KEY_IS_LONG)
+		{
+			continue;
+		}
+		convert_to_long(*element);
+		swServer_set_listen_option(serv, (int) num_key, option, (int) Z_LVAL_PP(element));
+	}
+}
+
 PHP_FUNCTION(swoole_server_set)
 {
 	zval *zset = NULL;
@@ -810,6 +1041,33 @@ PHP_FUNCTION(swoole_server_set)
 		convert_to_long(*v);
 		serv->task_worker_num = (int)Z_LVAL_PP(v);
 	}
+	//task_arena_size
+	if (zend_hash_find(vht, ZEND_STRS("task_arena_size"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->task_arena_size = (uint32_t)Z_LVAL_PP(v);
+	}
+	//send_arena_size
+	if (zend_hash_find(vht, ZEND_STRS("send_arena_size"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->send_arena_size = (uint32_t)Z_LVAL_PP(v);
+	}
+	//recv_ring_size
+	if (zend_hash_find(vht, ZEND_STRS("recv_ring_size"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->recv_ring_size = (uint32_t)Z_LVAL_PP(v);
+	}
+	//sendfile_window
+	if (zend_hash_find(vht, ZEND_STRS("sendfile_window"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		if (Z_LVAL_PP(v) > 0)
+		{
+			serv->sendfile_window = (uint32_t)Z_LVAL_PP(v);
+		}
+	}
 	//max_conn
 	if (zend_hash_find(vht, ZEND_STRS("max_conn"), (void **)&v) == SUCCESS)
 	{
@@ -828,12 +1086,91 @@ PHP_FUNCTION(swoole_server_set)
 		convert_to_long(*v);
 		serv->open_cpu_affinity = (uint8_t)Z_LVAL_PP(v);
 	}
+	//按NUMA拓扑设置亲和性, 需要开启open_cpu_affinity
+	if (zend_hash_find(vht, ZEND_STRS("numa_affinity"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->numa_affinity = (uint8_t)Z_LVAL_PP(v);
+	}
+	//按网卡软中断所在的CPU分配连接, 需要开启open_cpu_affinity
+	if (zend_hash_find(vht, ZEND_STRS("incoming_cpu_affinity"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->incoming_cpu_affinity = (uint8_t)Z_LVAL_PP(v);
+	}
+	//共享内存使用大页, 1: 透明大页, 2: MAP_HUGETLB
+	if (zend_hash_find(vht, ZEND_STRS("hugepage"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->hugepage = (uint8_t)Z_LVAL_PP(v);
+	}
 	//tcp_nodelay
 	if (zend_hash_find(vht, ZEND_STRS("open_tcp_nodelay"), (void **)&v) == SUCCESS)
 	{
 		convert_to_long(*v);
 		serv->open_tcp_nodelay = (uint8_t)Z_LVAL_PP(v);
 	}
+	//监听选项: 整数为所有端口的默认值, 数组为 port => value
+	if (zend_hash_find(vht, ZEND_STRS("tcp_defer_accept"), (void **)&v) == SUCCESS)
+	{
+		php_swoole_set_listen_option(serv, v, SW_LISTEN_DEFER_ACCEPT);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("tcp_fastopen"), (void **)&v) == SUCCESS)
+	{
+		php_swoole_set_listen_option(serv, v, SW_LISTEN_FASTOPEN);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("tcp_busy_poll"), (void **)&v) == SUCCESS)
+	{
+		php_swoole_set_listen_option(serv, v, SW_LISTEN_BUSY_POLL);
+	}
+	//direct send
+	if (zend_hash_find(vht, ZEND_STRS("direct_send"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->direct_send = (uint8_t)Z_LVAL_PP(v);
+	}
+	//dispatch_batch
+	if (zend_hash_find(vht, ZEND_STRS("dispatch_batch"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->dispatch_batch = (uint8_t)Z_LVAL_PP(v);
+	}
+	//work_stealing
+	if (zend_hash_find(vht, ZEND_STRS("work_stealing"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->work_stealing = (uint8_t)Z_LVAL_PP(v);
+	}
+	//worker_spin_usec
+	if (zend_hash_find(vht, ZEND_STRS("worker_spin_usec"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->worker_spin_usec = (uint32_t)Z_LVAL_PP(v);
+	}
+	//reload_batch
+	if (zend_hash_find(vht, ZEND_STRS("reload_batch"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->reload_batch = (uint16_t)Z_LVAL_PP(v);
+	}
+	//reload_drain_timeout, 单位为秒
+	if (zend_hash_find(vht, ZEND_STRS("reload_drain_timeout"), (void **)&v) == SUCCESS)
+	{
+		convert_to_double(*v);
+		serv->reload_drain_timeout = (uint32_t)(Z_DVAL_PP(v) * 1000);
+	}
+	//enable_reuse_port
+	if (zend_hash_find(vht, ZEND_STRS("enable_reuse_port"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->enable_reuse_port = (uint8_t)Z_LVAL_PP(v);
+	}
+	//enable_edge_trigger
+	if (zend_hash_find(vht, ZEND_STRS("enable_edge_trigger"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->enable_edge_trigger = (uint8_t)Z_LVAL_PP(v);
+	}
 	//tcp_keepalive
 	if (zend_hash_find(vht, ZEND_STRS("open_tcp_keepalive"), (void **)&v) == SUCCESS)
 	{
@@ -883,6 +1220,23 @@ PHP_FUNCTION(swoole_server_set)
 		convert_to_long(*v);
 		serv->dispatch_mode = (int)Z_LVAL_PP(v);
 	}
+	//task_dispatch_mode
+	if (zend_hash_find(vht, ZEND_STRS("task_dispatch_mode"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->task_dispatch_mode = (uint8_t)Z_LVAL_PP(v);
+	}
+	//task_finish_batch
+	if (zend_hash_find(vht, ZEND_STRS("task_finish_batch"), (void **)&v) == SUCCESS)
+	{
+		convert_to_boolean(*v);
+		serv->task_finish_batch = (uint8_t)Z_BVAL_PP(v);
+	}
+	//enable_coroutine, PHP5的执行器和VM栈是全局的, PHP回调在协程中挂起会破坏它们, 只开放给C编写的服务器
+	if (zend_hash_find(vht, ZEND_STRS("enable_coroutine"), (void **)&v) == SUCCESS)
+	{
+		zend_error(E_WARNING, "swoole_server: enable_coroutine is only available to servers written in C, ignored.");
+	}
 	//log_file
 	if (zend_hash_find(vht, ZEND_STRS("log_file"), (void **)&v) == SUCCESS)
 	{
@@ -894,6 +1248,86 @@ PHP_FUNCTION(swoole_server_set)
 		}
 		memcpy(serv->log_file, Z_STRVAL_PP(v), Z_STRLEN_PP(v));
 	}
+	//latency_sample: 整数为所有端口的默认值, 数组为 port => sample
+	if (zend_hash_find(vht, ZEND_STRS("latency_sample"), (void **)&v) == SUCCESS)
+	{
+		if (Z_TYPE_PP(v) == IS_ARRAY)
+		{
+			zval **element;
+			char *key;
+			uint key_len;
+			ulong num_key;
+
+			for (zend_hash_internal_pointer_reset(Z_ARRVAL_PP(v));
+					zend_hash_get_current_data(Z_ARRVAL_PP(v), (void **) &element) == SUCCESS;
+					zend_hash_move_forward(Z_ARRVAL_PP(v)))
+			{
+				if (zend_hash_get_current_key_ex(Z_ARRVAL_PP(v), &key, &key_len, &num_key, 0, NULL) != HASH_KEY_IS_LONG)
+				{
+					continue;
+				}
+				convert_to_long(*element);
+				swServer_set_latency_sample(serv, (int) num_key, (int) Z_LVAL_PP(element));
+			}
+		}
+		else
+		{
+			convert_to_long(*v);
+			swServer_set_latency_sample(serv, 0, (int) Z_LVAL_PP(v));
+		}
+	}
+	//stats_file
+	if (zend_hash_find(vht, ZEND_STRS("stats_file"), (void **)&v) == SUCCESS)
+	{
+		convert_to_string(*v);
+		if (Z_STRLEN_PP(v) >= SW_LOG_FILENAME)
+		{
+			zend_error(E_ERROR, "stats_file name to long");
+			RETURN_FALSE;
+		}
+		memcpy(serv->stats_file, Z_STRVAL_PP(v), Z_STRLEN_PP(v));
+	}
+#ifdef SW_USE_OPENSSL
+	//tls, 用于SWOOLE_SSL端口, 证书在启动时加载
+	if (zend_hash_find(vht, ZEND_STRS("ssl_cert_file"), (void **)&v) == SUCCESS)
+	{
+		convert_to_string(*v);
+		serv->ssl_cert_file = strndup(Z_STRVAL_PP(v), Z_STRLEN_PP(v));
+	}
+	if (zend_hash_find(vht, ZEND_STRS("ssl_key_file"), (void **)&v) == SUCCESS)
+	{
+		convert_to_string(*v);
+		serv->ssl_key_file = strndup(Z_STRVAL_PP(v), Z_STRLEN_PP(v));
+	}
+	if (zend_hash_find(vht, ZEND_STRS("ssl_ciphers"), (void **)&v) == SUCCESS)
+	{
+		convert_to_string(*v);
+		serv->ssl_ciphers = strndup(Z_STRVAL_PP(v), Z_STRLEN_PP(v));
+	}
+#endif
+	//slow callback threshold, 单位毫秒
+	if (zend_hash_find(vht, ZEND_STRS("slow_callback_threshold"), (void **)&v) == SUCCESS)
+	{
+		convert_to_double(*v);
+		serv->slow_callback_usec = Z_DVAL_PP(v) > 0 ? (uint32_t) (Z_DVAL_PP(v) * 1000) : 0;
+	}
+	//overload protection, 单位毫秒
+	if (zend_hash_find(vht, ZEND_STRS("overload_target"), (void **)&v) == SUCCESS)
+	{
+		convert_to_double(*v);
+		serv->overload_target_usec = Z_DVAL_PP(v) > 0 ? (uint32_t) (Z_DVAL_PP(v) * 1000) : 0;
+	}
+	if (zend_hash_find(vht, ZEND_STRS("overload_interval"), (void **)&v) == SUCCESS)
+	{
+		convert_to_double(*v);
+		serv->overload_interval_usec = Z_DVAL_PP(v) > 0 ? (uint32_t) (Z_DVAL_PP(v) * 1000) : SW_OVERLOAD_INTERVAL * 1000;
+	}
+	if (zend_hash_find(vht, ZEND_STRS("overload_response"), (void **)&v) == SUCCESS)
+	{
+		convert_to_string(*v);
+		serv->overload_response = strndup(Z_STRVAL_PP(v), Z_STRLEN_PP(v));
+		serv->overload_response_length = Z_STRLEN_PP(v);
+	}
 	//heartbeat idle time
 	if (zend_hash_find(vht, ZEND_STRS("heartbeat_idle_time"), (void **) &v) == SUCCESS)
 	{
@@ -936,6 +1370,37 @@ PHP_FUNCTION(swoole_server_set)
 		convert_to_long(*v);
 		serv->open_length_check = (uint8_t)Z_LVAL_PP(v);
 	}
+	//open http protocol
+	if (zend_hash_find(vht, ZEND_STRS("open_http_protocol"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->open_http_protocol = (uint8_t)Z_LVAL_PP(v);
+	}
+	//open websocket protocol
+	if (zend_hash_find(vht, ZEND_STRS("open_websocket_protocol"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->open_websocket_protocol = (uint8_t)Z_LVAL_PP(v);
+	}
+	//permessage-deflate: 整数为所有端口的压缩级别, 数组为 port => level
+	if (zend_hash_find(vht, ZEND_STRS("websocket_compression"), (void **)&v) == SUCCESS)
+	{
+#ifndef SW_USE_ZLIB
+		zend_error(E_WARNING, "swoole_server: websocket_compression requires --enable-swoole-zlib.");
+#endif
+		php_swoole_set_listen_option(serv, v, SW_LISTEN_WEBSOCKET_COMPRESSION);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("websocket_compression_min_length"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->websocket_compression_min_length = (uint32_t)Z_LVAL_PP(v);
+	}
+	//open redis protocol
+	if (zend_hash_find(vht, ZEND_STRS("open_redis_protocol"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->open_redis_protocol = (uint8_t)Z_LVAL_PP(v);
+	}
 	//package length size
 	if (zend_hash_find(vht, ZEND_STRS("package_length_type"), (void **)&v) == SUCCESS)
 	{
@@ -954,12 +1419,36 @@ PHP_FUNCTION(swoole_server_set)
 		convert_to_long(*v);
 		serv->package_body_start  = (int)Z_LVAL_PP(v);
 	}
+	//dispatch key offset
+	if (zend_hash_find(vht, ZEND_STRS("dispatch_key_offset"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->dispatch_key_offset = (uint32_t)Z_LVAL_PP(v);
+	}
+	//dispatch key length
+	if (zend_hash_find(vht, ZEND_STRS("dispatch_key_length"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->dispatch_key_length = (uint16_t)Z_LVAL_PP(v);
+	}
 	//package max length
 	if (zend_hash_find(vht, ZEND_STRS("package_max_length"), (void **)&v) == SUCCESS)
 	{
 		convert_to_long(*v);
 		serv->buffer_input_size = (int)Z_LVAL_PP(v);
 	}
+	//out_buffer high watermark, 0 is unlimited
+	if (zend_hash_find(vht, ZEND_STRS("buffer_high_watermark"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->buffer_high_watermark = (uint32_t)Z_LVAL_PP(v);
+	}
+	//out_buffer low watermark
+	if (zend_hash_find(vht, ZEND_STRS("buffer_low_watermark"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		serv->buffer_low_watermark = (uint32_t)Z_LVAL_PP(v);
+	}
 	zend_update_property(swoole_server_class_entry_ptr, zobject, ZEND_STRL("setting"), zset TSRMLS_CC);
 	RETURN_TRUE;
 }
@@ -982,6 +1471,21 @@ static int php_swoole_set_callback(int key, zval *cb TSRMLS_DC)
 	*(php_sw_callback[key]) = *cb;
 	zval_copy_ctor(php_sw_callback[key]);
 	efree(func_name);
+
+	php_sw_callback_fcc[key].initialized = 0;
+#ifndef ZTS
+	/**
+	 * 线程模式下每个线程有自己的函数表, 不能共用fcall cache
+	 * __call转发的方法在调用结束后会被zend_call_function释放, 也不能缓存
+	 */
+	if (zend_fcall_info_init(php_sw_callback[key], 0, &php_sw_callback_fci[key], &php_sw_callback_fcc[key], NULL, NULL TSRMLS_CC) == SUCCESS
+			&& (php_sw_callback_fcc[key].function_handler->common.fn_flags & ZEND_ACC_CALL_VIA_HANDLER))
+	{
+		efree((char *) php_sw_callback_fcc[key].function_handler->common.function_name);
+		efree(php_sw_callback_fcc[key].function_handler);
+		php_sw_callback_fcc[key].initialized = 0;
+	}
+#endif
 	return SW_OK;
 }
 
@@ -1033,6 +1537,12 @@ PHP_FUNCTION(swoole_server_handler)
 			"onWorkerError",
 			"onManagerStart",
 			"onManagerStop",
+			"onBufferFull",
+			"onBufferEmpty",
+			"onRequest",
+			"onMessage",
+			"onWorkerWarmup",
+			"onFinishBatch",
 	};
 	for(i=0; i<PHP_SERVER_CALLBACK_NUM; i++)
 	{
@@ -1097,6 +1607,12 @@ PHP_FUNCTION(swoole_server_on)
 			"workerError",
 			"managerStart",
 			"managerStop",
+			"bufferFull",
+			"bufferEmpty",
+			"request",
+			"message",
+			"workerWarmup",
+			"finishBatch",
 	};
 	for(i=0; i<PHP_SERVER_CALLBACK_NUM; i++)
 	{
@@ -1181,24 +1697,27 @@ PHP_FUNCTION(swoole_server_heartbeat)
 		return;
 	}
 
-	int serv_max_fd = swServer_get_maxfd(serv);
-	int serv_min_fd = swServer_get_minfd(serv);
-
 	array_init(return_value);
 
-	int fd;
+	int i, n, fd;
 	int checktime = (int) SwooleGS->now - serv->heartbeat_idle_time;
+	swConnectionIterator iter = {0, 0};
+	int fds[SW_MAX_FIND_COUNT];
 
-	//遍历到最大fd
-	for(fd = serv_min_fd; fd<= serv_max_fd; fd++)
+	//只遍历各reactor线程的活动连接, 关闭连接时要加锁, 按页复制出来再处理
+	while ((n = swServer_connection_next(serv, &iter, fds, SW_MAX_FIND_COUNT)) > 0)
 	{
-		 swTrace("check fd=%d", fd);
-		 if(1 == serv->connection_list[fd].active && (serv->connection_list[fd].last_time  < checktime))
-		 {
-		 	ev.fd = fd;
-		 	serv->factory.end(&serv->factory, &ev);
-			add_next_index_long(return_value, fd);
-		 }
+		for (i = 0; i < n; i++)
+		{
+			fd = fds[i];
+			swTrace("check fd=%d", fd);
+			if (1 == serv->connection_list[fd].active && (serv->connection_list[fd].last_time < checktime))
+			{
+				ev.fd = fd;
+				serv->factory.end(&serv->factory, &ev);
+				add_next_index_long(return_value, fd);
+			}
+		}
 	}
 }
 
@@ -1226,36 +1745,132 @@ PHP_FUNCTION(swoole_server_shutdown)
 	}
 }
 
-PHP_FUNCTION(swoole_connection_info)
+PHP_FUNCTION(swoole_server_stats)
 {
 	zval *zobject = getThis();
+	zval *zreactor, *zworker, *zitem;
 	swServer *serv;
-	long fd = 0;
-	long from_id = -1;
+	swReactorStats *rs;
+	swWorkerStats *ws;
+	int i;
 
 	if (zobject == NULL)
 	{
-		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Ol|l", &zobject, swoole_server_class_entry_ptr, &fd, &from_id) == FAILURE)
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &zobject, swoole_server_class_entry_ptr) == FAILURE)
 		{
 			return;
 		}
 	}
-	else
+	SWOOLE_GET_SERVER(zobject, serv);
+	if (serv->stats == NULL)
 	{
-		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l|l", &fd, &from_id) == FAILURE)
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+	add_assoc_long(return_value, "start_time", serv->stats->start_time);
+	add_assoc_long(return_value, "connection_num", serv->stats->connection_num);
+
+	MAKE_STD_ZVAL(zreactor);
+	array_init(zreactor);
+	for (i = 0, rs = serv->reactor_stats; i < serv->reactor_num; i++, rs++)
+	{
+		MAKE_STD_ZVAL(zitem);
+		array_init(zitem);
+		add_assoc_long(zitem, "accept_count", rs->accept_count);
+		add_assoc_long(zitem, "close_count", rs->close_count);
+		add_assoc_long(zitem, "recv_bytes", rs->recv_bytes);
+		add_assoc_long(zitem, "send_bytes", rs->send_bytes);
+		add_assoc_long(zitem, "dispatch_count", rs->dispatch_count);
+		add_assoc_long(zitem, "eagain_count", rs->eagain_count);
+		add_assoc_long(zitem, "out_buffer_bytes", rs->out_buffer_bytes);
+		add_assoc_long(zitem, "slow_count", rs->slow_count);
+		add_assoc_long(zitem, "incoming_cpu_count", rs->incoming_cpu_count);
+		add_next_index_zval(zreactor, zitem);
+	}
+	add_assoc_zval(return_value, "reactor", zreactor);
+
+	//前worker_num个是worker进程, 后面是task进程
+	MAKE_STD_ZVAL(zworker);
+	array_init(zworker);
+	for (i = 0, ws = serv->worker_stats; i < serv->worker_num + serv->task_worker_num; i++, ws++)
+	{
+		MAKE_STD_ZVAL(zitem);
+		array_init(zitem);
+		add_assoc_long(zitem, "dispatch_count", ws->dispatch_count);
+		add_assoc_long(zitem, "request_count", ws->request_count);
+		add_assoc_long(zitem, "inflight", ws->dispatch_count > ws->request_count ? ws->dispatch_count - ws->request_count : 0);
+		add_assoc_long(zitem, "busy_usec", ws->busy_usec);
+		add_assoc_long(zitem, "slow_count", ws->slow_count);
+		add_next_index_zval(zworker, zitem);
+	}
+	add_assoc_zval(return_value, "worker", zworker);
+
+	//采样的延迟, 所有worker/reactor线程合并, 单位微秒
+	if (serv->worker_latency != NULL)
+	{
+		static const char *names[] = {"queue", "handler", "send", "total"};
+		zval *zlatency;
+		swHistogram h;
+
+		MAKE_STD_ZVAL(zlatency);
+		array_init(zlatency);
+		for (i = SW_LATENCY_QUEUE; i <= SW_LATENCY_TOTAL; i++)
 		{
-			return;
+			swServer_latency_merge(serv, i, &h);
+			MAKE_STD_ZVAL(zitem);
+			array_init(zitem);
+			add_assoc_long(zitem, "count", h.count);
+			add_assoc_long(zitem, "avg", h.count > 0 ? h.sum / h.count : 0);
+			add_assoc_long(zitem, "p50", swHistogram_percentile(&h, 50));
+			add_assoc_long(zitem, "p90", swHistogram_percentile(&h, 90));
+			add_assoc_long(zitem, "p99", swHistogram_percentile(&h, 99));
+			add_assoc_long(zitem, "p999", swHistogram_percentile(&h, 99.9));
+			add_assoc_long(zitem, "max", h.max);
+			add_assoc_zval(zlatency, names[i], zitem);
 		}
+		add_assoc_zval(return_value, "latency", zlatency);
 	}
-	SWOOLE_GET_SERVER(zobject, serv);
-
-	swConnection *conn = swServer_get_connection(serv, fd);
+}
 
-	//It's udp
-	if(conn == NULL)
-	{
-		array_init(return_value);
+PHP_FUNCTION(swoole_connection_info)
+{
+	zval *zobject = getThis();
+	swServer *serv;
+	long fd = 0;
+	long from_id = -1;
+
+	if (zobject == NULL)
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Ol|l", &zobject, swoole_server_class_entry_ptr, &fd, &from_id) == FAILURE)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l|l", &fd, &from_id) == FAILURE)
+		{
+			return;
+		}
+	}
+	SWOOLE_GET_SERVER(zobject, serv);
+
+	swConnection *conn = swServer_get_connection(serv, fd);
+
+	//It's udp
+	if(conn == NULL)
+	{
 		php_swoole_udp_t udp_info;
+		swUdpPeer peer;
+		char remote_ip[INET6_ADDRSTRLEN];
+
+		//fd是对端地址表的序号
+		if (serv->udp_peers == NULL || swUdpPeerTable_get(serv->udp_peers, fd, &peer) < 0)
+		{
+			RETURN_FALSE;
+		}
+		array_init(return_value);
 		if (from_id < 0)
 		{
 			from_id = php_swoole_udp_from_id;
@@ -1263,18 +1878,22 @@ PHP_FUNCTION(swoole_connection_info)
 		memcpy(&udp_info, &from_id, sizeof(udp_info));
 
 		swConnection *from_sock = swServer_get_connection(serv, udp_info.from_fd);
-		struct in_addr sin_addr;
-		sin_addr.s_addr = fd;
 		if (from_sock != NULL)
 		{
 			add_assoc_long(return_value, "from_fd", udp_info.from_fd);
-			add_assoc_long(return_value, "from_port",  from_sock->addr.sin_port);
+			add_assoc_long(return_value, "from_port",  serv->connection_info[udp_info.from_fd].addr.sin_port);
 		}
-		if (from_id !=0 )
+		if (peer.addr.inet_v4.sin_family == AF_INET6)
 		{
-			add_assoc_long(return_value, "remote_port", ntohs(from_id));
+			inet_ntop(AF_INET6, &peer.addr.inet_v6.sin6_addr, remote_ip, sizeof(remote_ip));
+			add_assoc_long(return_value, "remote_port", ntohs(peer.addr.inet_v6.sin6_port));
 		}
-		add_assoc_string(return_value, "remote_ip", inet_ntoa(sin_addr), 1);
+		else
+		{
+			inet_ntop(AF_INET, &peer.addr.inet_v4.sin_addr, remote_ip, sizeof(remote_ip));
+			add_assoc_long(return_value, "remote_port", ntohs(peer.addr.inet_v4.sin_port));
+		}
+		add_assoc_string(return_value, "remote_ip", remote_ip, 1);
 		return;
 	}
 
@@ -1285,14 +1904,15 @@ PHP_FUNCTION(swoole_connection_info)
 	}
 	else
 	{
+		swConnectionInfo *info = swServer_get_connection_info(serv, fd);
 		array_init(return_value);
 		add_assoc_long(return_value, "from_id", conn->from_id);
-		add_assoc_long(return_value, "from_fd", conn->from_fd);
-		add_assoc_long(return_value, "connect_time", conn->connect_time);
+		add_assoc_long(return_value, "from_fd", info->from_fd);
+		add_assoc_long(return_value, "connect_time", info->connect_time);
 		add_assoc_long(return_value, "last_time", conn->last_time);
-		add_assoc_long(return_value, "from_port",  serv->connection_list[conn->from_fd].addr.sin_port);
-		add_assoc_long(return_value, "remote_port", ntohs(conn->addr.sin_port));
-		add_assoc_string(return_value, "remote_ip", inet_ntoa(conn->addr.sin_addr), 1);
+		add_assoc_long(return_value, "from_port",  serv->connection_info[info->from_fd].addr.sin_port);
+		add_assoc_long(return_value, "remote_port", ntohs(info->addr.sin_port));
+		add_assoc_string(return_value, "remote_ip", inet_ntoa(info->addr.sin_addr), 1);
 	}
 }
 
@@ -1325,39 +1945,218 @@ PHP_FUNCTION(swoole_connection_list)
 		zend_error(E_WARNING, "swoole_connection_list max_find_count=%d", SW_MAX_FIND_COUNT);
 		RETURN_FALSE;
 	}
+	if (find_count < 1)
+	{
+		find_count = 1;
+	}
 
-	//复制出来避免被其他进程改写
-	int serv_max_fd = swServer_get_maxfd(serv);
+	//遍历活动连接索引, 取出大于start_fd的最小的find_count个fd, 保持按fd分页的语义
+	swConnectionIterator iter = {0, 0};
+	int fds[SW_MAX_FIND_COUNT];
+	int page[SW_MAX_FIND_COUNT];
+	int i, j, n, found = 0;
 
-	if(start_fd == 0)
+	while ((n = swServer_connection_next(serv, &iter, page, SW_MAX_FIND_COUNT)) > 0)
 	{
-		start_fd = swServer_get_minfd(serv);
+		for (i = 0; i < n; i++)
+		{
+			if (page[i] <= start_fd || (found == find_count && page[i] >= fds[found - 1]))
+			{
+				continue;
+			}
+			//插入排序
+			j = (found < find_count) ? found++ : found - 1;
+			for (; j > 0 && fds[j - 1] > page[i]; j--)
+			{
+				fds[j] = fds[j - 1];
+			}
+			fds[j] = page[i];
+		}
 	}
 
-	//达到最大，表示已经取完了
-	if ((int)start_fd >= serv_max_fd)
+	//已经取完了
+	if (found == 0)
 	{
 		RETURN_FALSE;
 	}
 	array_init(return_value);
-	int fd = start_fd+1;
+	for (i = 0; i < found; i++)
+	{
+		add_next_index_long(return_value, fds[i]);
+	}
+}
+
+PHP_FUNCTION(swoole_server_broadcast)
+{
+	zval *zobject = getThis();
+	zval *zfds = NULL;
+	zval **element;
+	swServer *serv;
+	char *send_data;
+	int send_len;
+	int *fds, fd_num = 0, ret;
+
+	if (zobject == NULL)
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Os|a!", &zobject, swoole_server_class_entry_ptr, &send_data, &send_len, &zfds) == FAILURE)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|a!", &send_data, &send_len, &zfds) == FAILURE)
+		{
+			return;
+		}
+	}
+	SWOOLE_GET_SERVER(zobject, serv);
+	if (zfds == NULL)
+	{
+		SW_CHECK_RETURN(swServer_broadcast(serv, send_data, send_len));
+	}
+	if (zend_hash_num_elements(Z_ARRVAL_P(zfds)) == 0)
+	{
+		RETURN_TRUE;
+	}
+	//发送到指定的连接列表
+	fds = emalloc(zend_hash_num_elements(Z_ARRVAL_P(zfds)) * sizeof(int));
+	for (zend_hash_internal_pointer_reset(Z_ARRVAL_P(zfds));
+			zend_hash_get_current_data(Z_ARRVAL_P(zfds), (void **) &element) == SUCCESS;
+			zend_hash_move_forward(Z_ARRVAL_P(zfds)))
+	{
+		convert_to_long(*element);
+		fds[fd_num++] = (int) Z_LVAL_PP(element);
+	}
+	ret = swServer_multicast(serv, fds, fd_num, send_data, send_len);
+	efree(fds);
+	SW_CHECK_RETURN(ret);
+}
+
+/**
+ * 所有PHP回调都从这里进入, 慢回调监视线程据此计时
+ */
+int php_swoole_call_user_function(const char *name, zval *callback, zval **retval, zend_uint argc, zval ***args TSRMLS_DC)
+{
+	int ret;
+
+	swSlowlog_enter(name);
+	ret = call_user_function_ex(EG(function_table), NULL, callback, retval, argc, args, 0, NULL TSRMLS_CC);
+	swSlowlog_leave();
+	return ret;
+}
+
+/**
+ * 服务器回调使用swoole_server_on时解析好的fcall info, 不需要每次查找函数表
+ */
+static int php_swoole_call_server_callback(int key, const char *name, zval **retval, zend_uint argc, zval ***args TSRMLS_DC)
+{
+	zend_fcall_info fci;
+	int ret;
+
+	if (!php_sw_callback_fcc[key].initialized)
+	{
+		return php_swoole_call_user_function(name, php_sw_callback[key], retval, argc, args TSRMLS_CC);
+	}
+	fci = php_sw_callback_fci[key];
+	fci.retval_ptr_ptr = retval;
+	fci.param_count = argc;
+	fci.params = args;
+	fci.no_separation = 0;
+
+	swSlowlog_enter(name);
+	ret = zend_call_function(&fci, &php_sw_callback_fcc[key] TSRMLS_CC);
+	swSlowlog_leave();
+	return ret;
+}
+
+/**
+ * 回调参数的zval每个worker只分配一次. 调用期间多持有一个引用, PHP代码写入或引用传参时会先分离
+ * 回调结束后引用计数仍大于1说明被用户保存了, 交给用户并重新分配
+ */
+static zval* php_swoole_arg_get(zval **slot)
+{
+	if (*slot == NULL || Z_REFCOUNT_P(*slot) > 1)
+	{
+		if (*slot != NULL)
+		{
+			zval_ptr_dtor(slot);
+		}
+		MAKE_STD_ZVAL(*slot);
+	}
+	Z_ADDREF_P(*slot);
+	return *slot;
+}
 
-	//循环到最大fd
-	for(; fd<= serv_max_fd; fd++)
+/**
+ * PHP字符串必须以'\0'结尾, 缓存区有空余时直接引用, 否则复制
+ */
+static int php_swoole_arg_set_string(zval *zdata, char *str, int length, int size)
+{
+	if (length < size)
 	{
-		 swTrace("maxfd=%d|fd=%d|find_count=%ld|start_fd=%ld", serv_max_fd, fd, find_count, start_fd);
-		 if(serv->connection_list[fd].active == 1)
-		 {
-			 add_next_index_long(return_value, fd);
-			 find_count--;
-		 }
-		 //finish fetch
-		 if(find_count <= 0)
-		 {
-			 break;
-		 }
+		str[length] = 0;
+		ZVAL_STRINGL(zdata, str, length, 0);
+		return 1;
+	}
+	ZVAL_STRINGL(zdata, str, length, 1);
+	return 0;
+}
+
+static void php_swoole_arg_free_string(zval **slot, zval *zdata, int borrowed)
+{
+	int retained = Z_REFCOUNT_P(zdata) > (zdata == *slot ? 2 : 1);
+
+	if (!retained)
+	{
+		if (!borrowed)
+		{
+			zval_dtor(zdata);
+		}
+		ZVAL_NULL(zdata);
+	}
+	//被用户保存的数据在缓存区复用之前复制出来
+	else if (borrowed)
+	{
+		Z_STRVAL_P(zdata) = estrndup(Z_STRVAL_P(zdata), Z_STRLEN_P(zdata));
+	}
+	zval_ptr_dtor(&zdata);
+}
+
+/**
+ * 在信号处理函数中执行, 和php-fpm的slowlog一样只读取执行栈, 不分配内存
+ */
+static void php_swoole_onSlowlog(const char *name, uint64_t usec)
+{
+	TSRMLS_FETCH();
+	zend_execute_data *ex = EG(current_execute_data);
+	zend_function *func;
+	char buf[512];
+	int i, n;
+
+	for (i = 0; ex != NULL && i < SW_SLOWLOG_BACKTRACE_MAX; ex = ex->prev_execute_data)
+	{
+		func = ex->function_state.function;
+		if (func == NULL)
+		{
+			continue;
+		}
+		n = snprintf(buf, sizeof(buf), "[slowlog] #%d %s%s%s()", i,
+				func->common.scope ? func->common.scope->name : "",
+				func->common.scope ? "::" : "",
+				func->common.function_name ? func->common.function_name : "main");
+		if (ex->op_array != NULL && ex->opline != NULL && n < sizeof(buf))
+		{
+			n += snprintf(buf + n, sizeof(buf) - n, " %s:%d", ex->op_array->filename, ex->opline->lineno);
+		}
+		if (n >= sizeof(buf) - 1)
+		{
+			n = sizeof(buf) - 2;
+		}
+		buf[n++] = '\n';
+		swLog_write_direct(buf, n);
+		i++;
 	}
-	//sw_log(SW_END_LINE);
 }
 
 int php_swoole_onReceive(swFactory *factory, swEventData *req)
@@ -1370,14 +2169,15 @@ int php_swoole_onReceive(swFactory *factory, swEventData *req)
 	zval *zfrom_id;
 	zval *zdata;
 	zval *retval;
+	int borrowed;
 
 	//UDP使用from_id作为port,fd做为ip
 	php_swoole_udp_t udp_info;
 
-	MAKE_STD_ZVAL(zfd);
+	zfd = php_swoole_arg_get(&php_sw_callback_args[1]);
 	ZVAL_LONG(zfd, (long)req->info.fd);
 
-	MAKE_STD_ZVAL(zfrom_id);
+	zfrom_id = php_swoole_arg_get(&php_sw_callback_args[2]);
 
 	if(req->info.type == SW_EVENT_UDP)
 	{
@@ -1393,7 +2193,7 @@ int php_swoole_onReceive(swFactory *factory, swEventData *req)
 		ZVAL_LONG(zfrom_id, (long)req->info.from_id);
 	}
 
-	MAKE_STD_ZVAL(zdata);
+	zdata = php_swoole_arg_get(&php_sw_callback_args[3]);
 
 	char *data_ptr;
 	int data_len;
@@ -1402,13 +2202,21 @@ int php_swoole_onReceive(swFactory *factory, swEventData *req)
 	{
 		data_ptr = SwooleWG.buffer_input[req->info.from_id]->str;
 		data_len = SwooleWG.buffer_input[req->info.from_id]->length;
+		borrowed = php_swoole_arg_set_string(zdata, data_ptr, data_len, SwooleWG.buffer_input[req->info.from_id]->size);
+	}
+	//recv_ring的内存块在包后面留有一个字节
+	else if (req->info.type == SW_EVENT_PACKAGE_VIEW)
+	{
+		data_ptr = swPackage_view_data(req);
+		data_len = ((swPackage_view *) req->data)->length;
+		borrowed = php_swoole_arg_set_string(zdata, data_ptr, data_len, data_len + 1);
 	}
 	else
 	{
 		data_ptr = req->data;
 		data_len = req->info.len;
+		borrowed = php_swoole_arg_set_string(zdata, data_ptr, data_len, sizeof(req->data));
 	}
-	ZVAL_STRINGL(zdata, data_ptr, data_len, 0);
 	swTrace("data_len=%d|data_ptr=%p", data_len, data_ptr);
 
 	args[0] = &zserv;
@@ -1419,7 +2227,7 @@ int php_swoole_onReceive(swFactory *factory, swEventData *req)
 	//printf("req: fd=%d|len=%d|from_id=%d|data=%s\n", req->fd, req->len, req->from_id, req->data);
 
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
-	if (call_user_function_ex(EG(function_table), NULL, php_sw_callback[SW_SERVER_CB_onReceive], &retval, 4, args, 0, NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onReceive, "onReceive", &retval, 4, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_server: onReceive handler error");
 	}
@@ -1429,7 +2237,164 @@ int php_swoole_onReceive(swFactory *factory, swEventData *req)
 	}
 	zval_ptr_dtor(&zfd);
 	zval_ptr_dtor(&zfrom_id);
+	php_swoole_arg_free_string(&php_sw_callback_args[3], zdata, borrowed);
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+	return SW_OK;
+}
+
+/**
+ * open_http_protocol: 请求已在reactor线程中解析, 这里只按位置构造数组
+ */
+static int php_swoole_onRequest(swFactory *factory, swEventData *req)
+{
+	swServer *serv = factory->ptr;
+	zval *zserv = (zval *) serv->ptr2;
+	zval **args[4];
+	zval *zfd, *zfrom_id, *zrequest, *zheader, *retval = NULL;
+	swHttpRequest *request;
+	swHttp_header *header;
+	char *data, *name;
+	int i, length;
+
+	//open_websocket_protocol: 握手之后只会收到完整的数据消息
+	if (swWebSocket_is_message(&req->info))
+	{
+		return php_swoole_onMessage(factory, req);
+	}
+	if (php_sw_callback[SW_SERVER_CB_onRequest] == NULL)
+	{
+		swWarn("onRequest callback is not set, fd=%d.", req->info.fd);
+		return SW_ERR;
+	}
+	if (req->info.type == SW_EVENT_PACKAGE_END)
+	{
+		request = (swHttpRequest *) SwooleWG.buffer_input[req->info.from_id]->str;
+		length = SwooleWG.buffer_input[req->info.from_id]->length;
+	}
+	else
+	{
+		request = (swHttpRequest *) req->data;
+		length = req->info.len;
+	}
+	if (length < sizeof(swHttpRequest) || length < swHttpRequest_size(request) + request->header_length + request->content_length)
+	{
+		swWarn("invalid http request[length=%d].", length);
+		return SW_ERR;
+	}
+	data = swHttpRequest_data(request);
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	MAKE_STD_ZVAL(zfd);
+	ZVAL_LONG(zfd, (long) req->info.fd);
+	MAKE_STD_ZVAL(zfrom_id);
+	ZVAL_LONG(zfrom_id, (long) req->info.from_id);
+
+	MAKE_STD_ZVAL(zrequest);
+	array_init(zrequest);
+	add_assoc_stringl(zrequest, "method", data + request->method_name.offset, request->method_name.length, 1);
+	add_assoc_stringl(zrequest, "uri", data + request->uri.offset, request->uri.length, 1);
+	add_assoc_stringl(zrequest, "path", data + request->path.offset, request->path.length, 1);
+	add_assoc_stringl(zrequest, "query_string", data + request->query_string.offset, request->query_string.length, 1);
+	add_assoc_string(zrequest, "protocol", request->version == 11 ? "HTTP/1.1" : "HTTP/1.0", 1);
+	add_assoc_bool(zrequest, "keepalive", request->keepalive);
+
+	//头部名称转为小写
+	MAKE_STD_ZVAL(zheader);
+	array_init(zheader);
+	for (i = 0; i < request->header_num; i++)
+	{
+		header = &request->headers[i];
+		name = zend_str_tolower_dup(data + header->name.offset, header->name.length);
+		add_assoc_stringl_ex(zheader, name, header->name.length + 1, data + header->value.offset, header->value.length, 1);
+		efree(name);
+	}
+	add_assoc_zval(zrequest, "header", zheader);
+	add_assoc_stringl(zrequest, "body", swHttpRequest_body(request), request->content_length, 1);
+
+	args[0] = &zserv;
+	args[1] = &zfd;
+	args[2] = &zfrom_id;
+	args[3] = &zrequest;
+
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onRequest, "onRequest", &retval, 4, args TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_server: onRequest handler error");
+	}
+	if (EG(exception))
+	{
+		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
+	}
+	zval_ptr_dtor(&zfd);
+	zval_ptr_dtor(&zfrom_id);
+	zval_ptr_dtor(&zrequest);
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+	return SW_OK;
+}
+
+/**
+ * open_websocket_protocol: 负载已在reactor线程解掩码并合并分片
+ */
+static int php_swoole_onMessage(swFactory *factory, swEventData *req)
+{
+	swServer *serv = factory->ptr;
+	zval *zserv = (zval *) serv->ptr2;
+	zval **args[5];
+	zval *zfd, *zfrom_id, *zdata, *zopcode, *retval = NULL;
+	char *data;
+	int length;
+
+	if (php_sw_callback[SW_SERVER_CB_onMessage] == NULL)
+	{
+		swWarn("onMessage callback is not set, fd=%d.", req->info.fd);
+		return SW_ERR;
+	}
+	if (req->info.type == SW_EVENT_PACKAGE_END)
+	{
+		data = SwooleWG.buffer_input[req->info.from_id]->str;
+		length = SwooleWG.buffer_input[req->info.from_id]->length;
+	}
+	else
+	{
+		data = req->data;
+		length = req->info.len;
+	}
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	MAKE_STD_ZVAL(zfd);
+	ZVAL_LONG(zfd, (long) req->info.fd);
+	MAKE_STD_ZVAL(zfrom_id);
+	ZVAL_LONG(zfrom_id, (long) req->info.from_id);
+	MAKE_STD_ZVAL(zdata);
+	ZVAL_STRINGL(zdata, data, length, 0);
+	MAKE_STD_ZVAL(zopcode);
+	ZVAL_LONG(zopcode, (long) req->info.from_fd);
+
+	args[0] = &zserv;
+	args[1] = &zfd;
+	args[2] = &zfrom_id;
+	args[3] = &zdata;
+	args[4] = &zopcode;
+
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onMessage, "onMessage", &retval, 5, args TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_server: onMessage handler error");
+	}
+	if (EG(exception))
+	{
+		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
+	}
+	zval_ptr_dtor(&zfd);
+	zval_ptr_dtor(&zfrom_id);
 	efree(zdata);
+	zval_ptr_dtor(&zopcode);
 	if (retval != NULL)
 	{
 		zval_ptr_dtor(&retval);
@@ -1446,18 +2411,30 @@ static int php_swoole_onTask(swServer *serv, swEventData *req)
 	zval *zfrom_id;
 	zval *zdata;
 	zval *retval;
+	char *data;
+	int data_len, borrowed;
 
 	//for swoole_server_finish
 	sw_current_task = req;
 
-	MAKE_STD_ZVAL(zfd);
+	zfd = php_swoole_arg_get(&php_sw_callback_args[1]);
 	ZVAL_LONG(zfd, (long)req->info.fd);
 
-	MAKE_STD_ZVAL(zfrom_id);
+	zfrom_id = php_swoole_arg_get(&php_sw_callback_args[2]);
 	ZVAL_LONG(zfrom_id, (long)req->info.from_id);
 
-	MAKE_STD_ZVAL(zdata);
-	ZVAL_STRINGL(zdata, req->data, req->info.len, 1);
+	zdata = php_swoole_arg_get(&php_sw_callback_args[3]);
+	data = swTaskWorker_unpack(req, &data_len);
+	//task_arena中的数据没有预留'\0'的位置, 只能复制
+	if (req->info.from_fd == SW_TASK_SHM)
+	{
+		borrowed = php_swoole_arg_set_string(zdata, data, data_len, data_len);
+		swTaskWorker_release(req);
+	}
+	else
+	{
+		borrowed = php_swoole_arg_set_string(zdata, data, data_len, sizeof(req->data));
+	}
 
 	args[0] = &zserv;
 	args[1] = &zfd;
@@ -1467,7 +2444,7 @@ static int php_swoole_onTask(swServer *serv, swEventData *req)
 //	printf("task: fd=%d|len=%d|from_id=%d|data=%s\n", req->info.fd, req->info.len, req->info.from_id, req->data);
 
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
-	if (call_user_function_ex(EG(function_table), NULL, php_sw_callback[SW_SERVER_CB_onTask], &retval, 4, args, 0, NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onTask, "onTask", &retval, 4, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_server: onTask handler error");
 	}
@@ -1478,7 +2455,7 @@ static int php_swoole_onTask(swServer *serv, swEventData *req)
 
 	zval_ptr_dtor(&zfd);
 	zval_ptr_dtor(&zfrom_id);
-	zval_ptr_dtor(&zdata);
+	php_swoole_arg_free_string(&php_sw_callback_args[3], zdata, borrowed);
 	if (retval != NULL)
 	{
 		zval_ptr_dtor(&retval);
@@ -1494,12 +2471,23 @@ static int php_swoole_onFinish(swServer *serv, swEventData *req)
 	zval *ztask_id;
 	zval *zdata;
 	zval *retval;
+	char *data;
+	int data_len, borrowed;
 
-	MAKE_STD_ZVAL(ztask_id);
+	ztask_id = php_swoole_arg_get(&php_sw_callback_args[1]);
 	ZVAL_LONG(ztask_id, (long)req->info.fd);
 
-	MAKE_STD_ZVAL(zdata);
-	ZVAL_STRINGL(zdata, req->data, req->info.len, 1);
+	zdata = php_swoole_arg_get(&php_sw_callback_args[2]);
+	data = swTaskWorker_unpack(req, &data_len);
+	if (req->info.from_fd == SW_TASK_SHM)
+	{
+		borrowed = php_swoole_arg_set_string(zdata, data, data_len, data_len);
+		swTaskWorker_release(req);
+	}
+	else
+	{
+		borrowed = php_swoole_arg_set_string(zdata, data, data_len, sizeof(req->data));
+	}
 
 	args[0] = &zserv;
 	args[1] = &ztask_id;
@@ -1508,7 +2496,7 @@ static int php_swoole_onFinish(swServer *serv, swEventData *req)
 //	printf("req: fd=%d|len=%d|from_id=%d|data=%s\n", req->info.fd, req->info.len, req->info.from_id, req->data);
 
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
-	if (call_user_function_ex(EG(function_table), NULL, php_sw_callback[SW_SERVER_CB_onFinish], &retval, 3, args, 0, NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onFinish, "onFinish", &retval, 3, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_server: onFinish handler error");
 	}
@@ -1517,7 +2505,62 @@ static int php_swoole_onFinish(swServer *serv, swEventData *req)
 		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
 	}
 	zval_ptr_dtor(&ztask_id);
-	zval_ptr_dtor(&zdata);
+	php_swoole_arg_free_string(&php_sw_callback_args[2], zdata, borrowed);
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+	return SW_OK;
+}
+
+/**
+ * 合并的task结果, 一次回调传入array(task_id => data)
+ */
+static int php_swoole_onFinishBatch(swServer *serv, swEventData *batch)
+{
+	zval *zserv = (zval *)serv->ptr2;
+	zval **args[2];
+
+	zval *zresults;
+	zval *retval;
+	swEventData result;
+	uint32_t offset = 0;
+	char *data;
+	int data_len;
+
+	MAKE_STD_ZVAL(zresults);
+	array_init(zresults);
+	while (offset + sizeof(swDataHead) <= batch->info.len)
+	{
+		memcpy(&result.info, batch->data + offset, sizeof(swDataHead));
+		offset += sizeof(swDataHead);
+		if (offset + result.info.len > batch->info.len)
+		{
+			break;
+		}
+		memcpy(result.data, batch->data + offset, result.info.len);
+		offset += result.info.len;
+		data = swTaskWorker_unpack(&result, &data_len);
+		add_index_stringl(zresults, (ulong) result.info.fd, data, data_len, 1);
+		if (result.info.from_fd == SW_TASK_SHM)
+		{
+			swTaskWorker_release(&result);
+		}
+	}
+
+	args[0] = &zserv;
+	args[1] = &zresults;
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onFinishBatch, "onFinishBatch", &retval, 2, args TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_server: onFinishBatch handler error");
+	}
+	if (EG(exception))
+	{
+		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
+	}
+	zval_ptr_dtor(&zresults);
 	if (retval != NULL)
 	{
 		zval_ptr_dtor(&retval);
@@ -1621,7 +2664,7 @@ static void php_swoole_onTimer(swServer *serv, int interval)
 	zval *retval;
 	zval *zinterval;
 
-	MAKE_STD_ZVAL(zinterval);
+	zinterval = php_swoole_arg_get(&php_sw_callback_args[1]);
 	ZVAL_LONG(zinterval, interval);
 
 	args[0] = &zserv;
@@ -1629,7 +2672,7 @@ static void php_swoole_onTimer(swServer *serv, int interval)
 	zval_add_ref(&zserv);
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
 
-	if (call_user_function_ex(EG(function_table), NULL, php_sw_callback[SW_SERVER_CB_onTimer], &retval, 2, args, 0, NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onTimer, "onTimer", &retval, 2, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_server: onTimer handler error");
 	}
@@ -1749,7 +2792,37 @@ static void php_swoole_onWorkerStop(swServer *serv, int worker_id)
 	{
 		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
 	}
-
+
+	zval_ptr_dtor(&zworker_id);
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+}
+
+static void php_swoole_onWorkerWarmup(swServer *serv, int worker_id)
+{
+	zval *zserv = (zval *)serv->ptr2;
+	zval *zworker_id;
+	zval **args[2]; //这里必须与下面的数字对应
+	zval *retval;
+
+	MAKE_STD_ZVAL(zworker_id);
+	ZVAL_LONG(zworker_id, worker_id);
+
+	zval_add_ref(&zserv);
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	args[0] = &zserv;
+	args[1] = &zworker_id;
+	if (call_user_function_ex(EG(function_table), NULL, php_sw_callback[SW_SERVER_CB_onWorkerWarmup], &retval, 2, args, 0, NULL TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_server: onWorkerWarmup handler error");
+	}
+	if (EG(exception))
+	{
+		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
+	}
 	zval_ptr_dtor(&zworker_id);
 	if (retval != NULL)
 	{
@@ -1809,10 +2882,10 @@ static void php_swoole_onConnect(swServer *serv, int fd, int from_id)
 	zval **args[3];
 	zval *retval;
 
-	MAKE_STD_ZVAL(zfd);
+	zfd = php_swoole_arg_get(&php_sw_callback_args[1]);
 	ZVAL_LONG(zfd, fd);
 
-	MAKE_STD_ZVAL(zfrom_id);
+	zfrom_id = php_swoole_arg_get(&php_sw_callback_args[2]);
 	ZVAL_LONG(zfrom_id, from_id);
 
 	args[0] = &zserv;
@@ -1821,8 +2894,7 @@ static void php_swoole_onConnect(swServer *serv, int fd, int from_id)
 	args[2] = &zfrom_id;
 
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
-	if (call_user_function_ex(EG(function_table), NULL, php_sw_callback[SW_SERVER_CB_onConnect], &retval, 3, args, 0,
-			NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onConnect, "onConnect", &retval, 3, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_server: onConnect handler error");
 	}
@@ -1847,10 +2919,10 @@ static void php_swoole_onClose(swServer *serv, int fd, int from_id)
 	zval **args[3];
 	zval *retval;
 
-	MAKE_STD_ZVAL(zfd);
+	zfd = php_swoole_arg_get(&php_sw_callback_args[1]);
 	ZVAL_LONG(zfd, fd);
 
-	MAKE_STD_ZVAL(zfrom_id);
+	zfrom_id = php_swoole_arg_get(&php_sw_callback_args[2]);
 	ZVAL_LONG(zfrom_id, from_id);
 
 	args[0] = &zserv;
@@ -1862,8 +2934,7 @@ static void php_swoole_onClose(swServer *serv, int fd, int from_id)
 
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
 
-	if (call_user_function_ex(EG(function_table), NULL, php_sw_callback[SW_SERVER_CB_onClose], &retval, 3, args, 0,
-			NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_server_callback(SW_SERVER_CB_onClose, "onClose", &retval, 3, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_server: onClose handler error");
 	}
@@ -1955,6 +3026,54 @@ static void php_swoole_onMasterClose(swServer *serv, int fd, int from_id)
 	}
 }
 
+static void php_swoole_onBufferEvent(swServer *serv, int fd, int from_id, int callback)
+{
+	zval *zserv = (zval *) serv->ptr2;
+	zval *zfd;
+	zval *zfrom_id;
+	zval **args[3];
+	zval *retval;
+
+	MAKE_STD_ZVAL(zfd);
+	ZVAL_LONG(zfd, fd);
+
+	MAKE_STD_ZVAL(zfrom_id);
+	ZVAL_LONG(zfrom_id, from_id);
+
+	args[0] = &zserv;
+	zval_add_ref(&zserv);
+	args[1] = &zfd;
+	args[2] = &zfrom_id;
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+	if (php_swoole_call_user_function(callback == SW_SERVER_CB_onBufferFull ? "onBufferFull" : "onBufferEmpty",
+			php_sw_callback[callback], &retval, 3, args TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_server: onBufferFull/onBufferEmpty handler error");
+	}
+	if (EG(exception))
+	{
+		zend_exception_error(EG(exception), E_WARNING TSRMLS_CC);
+	}
+
+	zval_ptr_dtor(&zfd);
+	zval_ptr_dtor(&zfrom_id);
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+}
+
+static void php_swoole_onBufferFull(swServer *serv, int fd, int from_id)
+{
+	php_swoole_onBufferEvent(serv, fd, from_id, SW_SERVER_CB_onBufferFull);
+}
+
+static void php_swoole_onBufferEmpty(swServer *serv, int fd, int from_id)
+{
+	php_swoole_onBufferEvent(serv, fd, from_id, SW_SERVER_CB_onBufferEmpty);
+}
+
 PHP_FUNCTION(swoole_strerror)
 {
 	int swoole_errno = 0;
@@ -2017,6 +3136,11 @@ PHP_FUNCTION(swoole_server_start)
 	{
 		serv->onWorkerStop = php_swoole_onWorkerStop;
 	}
+	if (php_sw_callback[SW_SERVER_CB_onWorkerWarmup] != NULL)
+	{
+		serv->onWorkerWarmup = php_swoole_onWorkerWarmup;
+	}
+	serv->onSlowlog = php_swoole_onSlowlog;
 	if (php_sw_callback[SW_SERVER_CB_onTask] != NULL)
 	{
 		serv->onTask = php_swoole_onTask;
@@ -2025,6 +3149,10 @@ PHP_FUNCTION(swoole_server_start)
 	{
 		serv->onFinish = php_swoole_onFinish;
 	}
+	if (php_sw_callback[SW_SERVER_CB_onFinishBatch] != NULL)
+	{
+		serv->onFinishBatch = php_swoole_onFinishBatch;
+	}
 	if (php_sw_callback[SW_SERVER_CB_onWorkerError] != NULL)
 	{
 		serv->onWorkerError = php_swoole_onWorkerError;
@@ -2050,13 +3178,30 @@ PHP_FUNCTION(swoole_server_start)
  	{
  		serv->onConnect = php_swoole_onConnect;
  	}
-	if (php_sw_callback[SW_SERVER_CB_onReceive] == NULL)
+	if (php_sw_callback[SW_SERVER_CB_onBufferFull] != NULL)
+	{
+		serv->onBufferFull = php_swoole_onBufferFull;
+	}
+	if (php_sw_callback[SW_SERVER_CB_onBufferEmpty] != NULL)
+	{
+		serv->onBufferEmpty = php_swoole_onBufferEmpty;
+	}
+	//open_http_protocol时可以只设置onRequest, open_websocket_protocol时可以只设置onMessage
+	if ((serv->open_http_protocol || serv->open_websocket_protocol)
+			&& (php_sw_callback[SW_SERVER_CB_onRequest] != NULL || php_sw_callback[SW_SERVER_CB_onMessage] != NULL))
+	{
+		serv->onReceive = php_swoole_onRequest;
+	}
+	else if (php_sw_callback[SW_SERVER_CB_onReceive] == NULL)
 	{
 		zend_error(E_ERROR, "swoole_server: onReceive must set.");
 		RETURN_FALSE;
 	}
+	else
+	{
+		serv->onReceive = php_swoole_onReceive;
+	}
 	//-------------------------------------------------------------
-	serv->onReceive = php_swoole_onReceive;
 
 	zval_add_ref(&zobject);
 	serv->ptr2 = zobject;
@@ -2112,9 +3257,8 @@ PHP_FUNCTION(swoole_server_send)
 	factory = &(serv->factory);
 	_send.info.fd = (int)conn_fd;
 
-	//UDP, UDP必然超过0x1000000
-	//原因：IPv4的第4字节最小为1,而这里的conn_fd是网络字节序
-	if(conn_fd > 0x1000000)
+	//UDP, fd为对端地址表的序号, 设置了SW_UDP_PEER_FLAG
+	if (swUdpPeer_is_peer(conn_fd))
 	{
 		if (from_id == -1)
 		{
@@ -2130,7 +3274,7 @@ PHP_FUNCTION(swoole_server_send)
 	//TCP
 	else
 	{
-		_send.info.type = SW_EVENT_TCP;
+		SW_CHECK_RETURN(swServer_tcp_send(serv, (int) conn_fd, send_data, send_len));
 	}
 	_send.data = buffer;
 
@@ -2164,33 +3308,92 @@ PHP_FUNCTION(swoole_server_send)
 	SW_CHECK_RETURN(ret);
 }
 
+/**
+ * 一次发送多个字符串, 只支持TCP连接. 合并后投递, 总长度超过SW_BUFFER_SIZE时只需要一个IPC消息
+ */
+PHP_FUNCTION(swoole_server_sendv)
+{
+	zval *zobject = getThis();
+	zval *zdata;
+	zval **element;
+	swServer *serv = NULL;
+	struct iovec *iov;
+	long conn_fd;
+	int iovcnt = 0, ret;
+
+	if (zobject == NULL)
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Ola", &zobject, swoole_server_class_entry_ptr, &conn_fd, &zdata) == FAILURE)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "la", &conn_fd, &zdata) == FAILURE)
+		{
+			return;
+		}
+	}
+	SWOOLE_GET_SERVER(zobject, serv);
+
+	if (swUdpPeer_is_peer(conn_fd))
+	{
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "sendv only support tcp connection.");
+		RETURN_FALSE;
+	}
+	if (zend_hash_num_elements(Z_ARRVAL_P(zdata)) == 0)
+	{
+		RETURN_TRUE;
+	}
+	iov = emalloc(zend_hash_num_elements(Z_ARRVAL_P(zdata)) * sizeof(struct iovec));
+	for (zend_hash_internal_pointer_reset(Z_ARRVAL_P(zdata));
+			zend_hash_get_current_data(Z_ARRVAL_P(zdata), (void **) &element) == SUCCESS;
+			zend_hash_move_forward(Z_ARRVAL_P(zdata)))
+	{
+		convert_to_string(*element);
+		iov[iovcnt].iov_base = Z_STRVAL_PP(element);
+		iov[iovcnt].iov_len = Z_STRLEN_PP(element);
+		iovcnt++;
+	}
+	ret = swServer_tcp_sendv(serv, (int) conn_fd, iov, iovcnt);
+	efree(iov);
+	SW_CHECK_RETURN(ret);
+}
+
 PHP_FUNCTION(swoole_server_sendfile)
 {
 	zval *zobject = getThis();
 	swServer *serv;
-	swSendData send_data;
-	char buffer[SW_BUFFER_SIZE];
 	char *filename;
+	int name_len;
 	long conn_fd;
+	long offset = 0;
+	long length = 0;
 
 	if (zobject == NULL)
 	{
-		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Ols", &zobject, swoole_server_class_entry_ptr, &conn_fd, &filename, &send_data.info.len) == FAILURE)
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Ols|ll", &zobject, swoole_server_class_entry_ptr, &conn_fd, &filename, &name_len, &offset, &length) == FAILURE)
 		{
 			return;
 		}
 	}
 	else
 	{
-		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ls", &conn_fd, &filename, &send_data.info.len) == FAILURE)
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ls|ll", &conn_fd, &filename, &name_len, &offset, &length) == FAILURE)
 		{
 			return;
 		}
 	}
 	//file name size
-	if (send_data.info.len > SW_BUFFER_SIZE - 1)
+	if (name_len > SW_BUFFER_SIZE - sizeof(swSendFile_request) - 1)
+	{
+		zend_error(E_WARNING, "swoole_server: sendfile name too long. [MAX_LENGTH=%ld]", SW_BUFFER_SIZE - sizeof(swSendFile_request) - 1);
+		RETURN_FALSE;
+	}
+	if (offset < 0 || length < 0)
 	{
-		zend_error(E_WARNING, "swoole_server: sendfile name too long. [MAX_LENGTH=%ld]", SW_BUFFER_SIZE - 1);
+		zend_error(E_WARNING, "swoole_server: sendfile offset and length must be positive.");
 		RETURN_FALSE;
 	}
 	//check file exists
@@ -2201,15 +3404,76 @@ PHP_FUNCTION(swoole_server_sendfile)
 	}
 
 	SWOOLE_GET_SERVER(zobject, serv);
+	SW_CHECK_RETURN(swServer_sendfile(serv, (int) conn_fd, filename, offset, length));
+}
+
+PHP_FUNCTION(swoole_server_proxy)
+{
+	zval *zobject = getThis();
+	swServer *serv;
+	char *host;
+	int host_len;
+	long conn_fd;
+	long port;
+
+	if (zobject == NULL)
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Olsl", &zobject, swoole_server_class_entry_ptr, &conn_fd, &host, &host_len, &port) == FAILURE)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "lsl", &conn_fd, &host, &host_len, &port) == FAILURE)
+		{
+			return;
+		}
+	}
+	if (port <= 0 || port > 65535)
+	{
+		zend_error(E_WARNING, "swoole_server: proxy port[%ld] is invalid.", port);
+		RETURN_FALSE;
+	}
+	SWOOLE_GET_SERVER(zobject, serv);
+	SW_CHECK_RETURN(swServer_proxy(serv, (int) conn_fd, host, (int) port));
+}
 
-	send_data.info.fd = (int)conn_fd;
-	send_data.info.type = SW_EVENT_SENDFILE;
-	memcpy(buffer, filename, send_data.info.len);
-	buffer[send_data.info.len] = 0;
-	send_data.info.len++;
+PHP_FUNCTION(swoole_server_push)
+{
+	zval *zobject = getThis();
+	swServer *serv;
+	char *data;
+	int data_len;
+	long conn_fd;
+	long opcode = SW_WEBSOCKET_OPCODE_TEXT;
 
-	send_data.data = buffer;
-	SW_CHECK_RETURN(serv->factory.finish(&serv->factory, &send_data));
+	if (zobject == NULL)
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Ols|l", &zobject, swoole_server_class_entry_ptr, &conn_fd, &data, &data_len, &opcode) == FAILURE)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ls|l", &conn_fd, &data, &data_len, &opcode) == FAILURE)
+		{
+			return;
+		}
+	}
+	if (opcode != SW_WEBSOCKET_OPCODE_TEXT && opcode != SW_WEBSOCKET_OPCODE_BINARY && opcode != SW_WEBSOCKET_OPCODE_CLOSE)
+	{
+		zend_error(E_WARNING, "swoole_server: push opcode[%ld] is invalid.", opcode);
+		RETURN_FALSE;
+	}
+	SWOOLE_GET_SERVER(zobject, serv);
+	if (!serv->open_websocket_protocol)
+	{
+		zend_error(E_WARNING, "swoole_server: push requires open_websocket_protocol.");
+		RETURN_FALSE;
+	}
+	SW_CHECK_RETURN(swServer_websocket_push(serv, (int) conn_fd, data, data_len, (int) opcode));
 }
 
 PHP_FUNCTION(swoole_server_addlisten)
@@ -2287,7 +3551,7 @@ PHP_FUNCTION(swoole_server_addtimer)
 		RETURN_FALSE;
 	}
 
-#if SW_WORKER_IPC_MODE == 1
+#if SW_WORKER_IPC_MODE != 2
 	if (SwooleG.main_reactor == NULL)
 	{
 		zend_error(E_WARNING, "swoole_server: can not use addtimer here.");
@@ -2408,29 +3672,26 @@ PHP_FUNCTION(swoole_server_taskwait)
 		RETURN_FALSE;
 	}
 
-	if(data_len > sizeof(buf.data))
+	if (worker_id >= serv->task_worker_num)
 	{
-		zend_error(E_WARNING, "swoole_server: task data max_size=%d.", (int)sizeof(buf.data));
+		zend_error(E_WARNING, "swoole_server: worker_id must be less than serv->task_worker_num");
 		RETURN_FALSE;
 	}
 
-	if (worker_id >= serv->task_worker_num)
+	if (swTaskWorker_pack(&buf, data, data_len) < 0)
 	{
-		zend_error(E_WARNING, "swoole_server: worker_id must be less than serv->task_worker_num");
 		RETURN_FALSE;
 	}
-
-	memcpy(buf.data, data, data_len);
-	buf.info.len = data_len;
 	buf.info.type = SW_TASK_BLOCKING;
 	//field fd save task_id
 	buf.info.fd = php_swoole_task_id++;
 	//field from_id save the worker_id
 	buf.info.from_id = SwooleWG.id;
-	//clear result buffer
+	//clear result buffer, 上一次超时的结果可能还占用着task_arena
+	swTaskWorker_release(&SwooleG.task_result[SwooleWG.id]);
 	bzero(&(SwooleG.task_result[SwooleWG.id]), sizeof(SwooleG.task_result[SwooleWG.id]));
 
-	if (swProcessPool_dispatch(&SwooleG.task_workers, &buf, (int) worker_id) > 0)
+	if (swTaskWorker_dispatch(serv, &buf, (int) worker_id) > 0)
 	{
 		int ret = 0;
 		uint64_t notify;
@@ -2442,16 +3703,170 @@ PHP_FUNCTION(swoole_server_taskwait)
 
 		if (ret > 0)
 		{
-			RETURN_STRINGL(SwooleG.task_result[SwooleWG.id].data, SwooleG.task_result[SwooleWG.id].info.len, 1);
+			swEventData *result = &SwooleG.task_result[SwooleWG.id];
+			data = swTaskWorker_unpack(result, &data_len);
+			RETVAL_STRINGL(data, data_len, 1);
+			swTaskWorker_release(result);
+			return;
 		}
 		else
 		{
 			zend_error(E_WARNING, "taskwait fail. Error: %s[%d]", strerror(errno), errno);
 		}
 	}
+	else
+	{
+		swTaskWorker_release(&buf);
+	}
 	RETURN_FALSE;
 }
 
+/**
+ * 并行投递多个task,全部完成或超时后返回,结果数组的key与tasks相同,超时或失败的task没有结果
+ */
+PHP_FUNCTION(swoole_server_taskWaitMulti)
+{
+	zval *zobject = getThis();
+	zval *tasks;
+	zval **element;
+	swEventData buf;
+	swServer *serv;
+	double timeout = SW_TASKWAIT_TIMEOUT;
+	char *data;
+	int data_len;
+	int i, n, ret;
+	int task_num = 0, finish_num = 0;
+	int task_ids[SW_TASKWAIT_MULTI_MAX];
+	zval *task_keys[SW_TASKWAIT_MULTI_MAX];
+	swEventData *result;
+	uint64_t notify;
+	struct pollfd event;
+	struct timeval now;
+	long deadline, remain;
+	char *key;
+	uint key_len;
+	ulong num_key;
+
+	if (zobject == NULL)
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Oa|d", &zobject, swoole_server_class_entry_ptr, &tasks, &timeout) == FAILURE)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|d", &tasks, &timeout) == FAILURE)
+		{
+			return;
+		}
+	}
+
+	SWOOLE_GET_SERVER(zobject, serv);
+	if (serv->task_worker_num < 1)
+	{
+		zend_error(E_WARNING, "swoole_server: task can not use. Please set task_worker_num.");
+		RETURN_FALSE;
+	}
+	if (zend_hash_num_elements(Z_ARRVAL_P(tasks)) > SW_TASKWAIT_MULTI_MAX)
+	{
+		zend_error(E_WARNING, "swoole_server: taskWaitMulti max task num is %d.", SW_TASKWAIT_MULTI_MAX);
+		RETURN_FALSE;
+	}
+
+	//scatter: 轮询投递到所有task进程
+	for (zend_hash_internal_pointer_reset(Z_ARRVAL_P(tasks));
+			zend_hash_get_current_data(Z_ARRVAL_P(tasks), (void **) &element) == SUCCESS;
+			zend_hash_move_forward(Z_ARRVAL_P(tasks)))
+	{
+		convert_to_string(*element);
+		if (swTaskWorker_pack(&buf, Z_STRVAL_PP(element), Z_STRLEN_PP(element)) < 0)
+		{
+			continue;
+		}
+		buf.info.type = SW_TASK_WAITMULTI;
+		buf.info.fd = php_swoole_task_id++;
+		buf.info.from_id = SwooleWG.id;
+
+		//清除槽位中上一次超时遗留的结果
+		result = swTaskWorker_result_multi(SwooleWG.id, buf.info.fd);
+		swTaskWorker_release(result);
+		result->info.type = 0;
+
+		if (swTaskWorker_dispatch(serv, &buf, -1) < 0)
+		{
+			swTaskWorker_release(&buf);
+			continue;
+		}
+		MAKE_STD_ZVAL(task_keys[task_num]);
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_P(tasks), &key, &key_len, &num_key, 0, NULL) == HASH_KEY_IS_STRING)
+		{
+			ZVAL_STRINGL(task_keys[task_num], key, key_len - 1, 1);
+		}
+		else
+		{
+			ZVAL_LONG(task_keys[task_num], num_key);
+		}
+		task_ids[task_num] = buf.info.fd;
+		task_num++;
+	}
+
+	//gather: 最多等待timeout秒
+	gettimeofday(&now, NULL);
+	deadline = now.tv_sec * 1000 + now.tv_usec / 1000 + (long) (timeout * 1000);
+	event.fd = SwooleG.task_notify[SwooleWG.id].getFd(&SwooleG.task_notify[SwooleWG.id], 0);
+	event.events = POLLIN;
+
+	while (finish_num < task_num)
+	{
+		gettimeofday(&now, NULL);
+		remain = deadline - (now.tv_sec * 1000 + now.tv_usec / 1000);
+		if (remain <= 0)
+		{
+			break;
+		}
+		ret = poll(&event, 1, (int) remain);
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (ret <= 0)
+		{
+			break;
+		}
+		SwooleG.task_notify[SwooleWG.id].read(&SwooleG.task_notify[SwooleWG.id], &notify, sizeof(notify));
+		for (finish_num = 0, i = 0; i < task_num; i++)
+		{
+			result = swTaskWorker_result_multi(SwooleWG.id, task_ids[i]);
+			if (result->info.type == SW_EVENT_FINISH && result->info.fd == task_ids[i])
+			{
+				finish_num++;
+			}
+		}
+	}
+
+	array_init(return_value);
+	for (i = 0; i < task_num; i++)
+	{
+		result = swTaskWorker_result_multi(SwooleWG.id, task_ids[i]);
+		if (result->info.type == SW_EVENT_FINISH && result->info.fd == task_ids[i])
+		{
+			data = swTaskWorker_unpack(result, &n);
+			if (Z_TYPE_P(task_keys[i]) == IS_STRING)
+			{
+				add_assoc_stringl_ex(return_value, Z_STRVAL_P(task_keys[i]), Z_STRLEN_P(task_keys[i]) + 1, data, n, 1);
+			}
+			else
+			{
+				add_index_stringl(return_value, Z_LVAL_P(task_keys[i]), data, n, 1);
+			}
+			swTaskWorker_release(result);
+			result->info.type = 0;
+		}
+		zval_ptr_dtor(&task_keys[i]);
+	}
+}
+
 PHP_FUNCTION(swoole_server_task)
 {
 	zval *zobject = getThis();
@@ -2489,26 +3904,23 @@ PHP_FUNCTION(swoole_server_task)
 		RETURN_FALSE;
 	}
 
-	if(data_len > sizeof(buf.data))
+	if (swTaskWorker_pack(&buf, data, data_len) < 0)
 	{
-		zend_error(E_WARNING, "swoole_server: task data max_size=%d.", (int) sizeof(buf.data));
 		RETURN_FALSE;
 	}
-
-	memcpy(buf.data, data, data_len);
-	buf.info.len = data_len;
 	buf.info.type = SW_TASK_NONBLOCK;
 	//使用fd保存task_id
 	buf.info.fd = php_swoole_task_id++;
 	//from_id保存worker_id
 	buf.info.from_id = SwooleWG.id;
 
-	if (swProcessPool_dispatch(&SwooleG.task_workers, &buf, (int) worker_id) > 0)
+	if (swTaskWorker_dispatch(serv, &buf, (int) worker_id) > 0)
 	{
 		RETURN_LONG(buf.info.fd);
 	}
 	else
 	{
+		swTaskWorker_release(&buf);
 		RETURN_FALSE;
 	}
 }
@@ -2535,11 +3947,6 @@ PHP_FUNCTION(swoole_server_finish)
 			return;
 		}
 	}
-	if(data_len > sizeof(buf.data))
-	{
-		zend_error(E_WARNING, "swoole_server: finish data max_size=%d.", (int) sizeof(buf.data));
-		RETURN_FALSE;
-	}
 	SWOOLE_GET_SERVER(zobject, serv);
 	if(serv->task_worker_num < 1)
 	{
@@ -2551,29 +3958,35 @@ PHP_FUNCTION(swoole_server_finish)
 	//for swoole_server_task
 	if (sw_current_task->info.type == SW_TASK_NONBLOCK)
 	{
-		memcpy(buf.data, data, data_len);
-		buf.info.len = data_len;
-		buf.info.type = SW_EVENT_FINISH;
-		buf.info.fd = sw_current_task->info.fd;
-
-		if(serv->factory_mode == SW_MODE_PROCESS)
+		if (swTaskWorker_pack(&buf, data, data_len) < 0)
 		{
-			SW_CHECK_RETURN(swFactoryProcess_send2worker(factory, &buf, sw_current_task->info.from_id));
-		}
-		else
-		{
-			SW_CHECK_RETURN(swWrite(SwooleG.event_workers->workers[sw_current_task->info.from_id].pipe_worker, &buf, sizeof(buf.info)+data_len));
+			RETURN_FALSE;
 		}
+		buf.info.type = SW_EVENT_FINISH;
+		buf.info.fd = sw_current_task->info.fd;
+		SW_CHECK_RETURN(swTaskWorker_finish(serv, &buf, sw_current_task->info.from_id));
 	}
 	else
 	{
 		uint64_t flag = 1;
 		int ret;
-		swEventData *result = &SwooleG.task_result[sw_current_task->info.from_id];
-		memcpy(result->data, data, data_len);
-		result->info.len = data_len;
-		result->info.type = SW_EVENT_FINISH;
+		swEventData *result;
+		if (sw_current_task->info.type == SW_TASK_WAITMULTI)
+		{
+			result = swTaskWorker_result_multi(sw_current_task->info.from_id, sw_current_task->info.fd);
+		}
+		else
+		{
+			result = &SwooleG.task_result[sw_current_task->info.from_id];
+		}
+		if (swTaskWorker_pack(result, data, data_len) < 0)
+		{
+			RETURN_FALSE;
+		}
 		result->info.fd = sw_current_task->info.fd;
+		//type最后写入,taskWaitMulti依靠它判断结果是否完整
+		sw_atomic_memory_barrier();
+		result->info.type = SW_EVENT_FINISH;
 		do
 		{
 			ret = SwooleG.task_notify[sw_current_task->info.from_id].write(&SwooleG.task_notify[sw_current_task->info.from_id], &flag, sizeof(flag));
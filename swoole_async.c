@@ -19,9 +19,18 @@
 #include "php_network.h"
 
 #include "async.h"
+#include "dns.h"
 
 #define PHP_SWOOLE_AIO_MAXEVENTS       128
 
+typedef struct {
+	void *buf;
+	off_t offset;
+	uint32_t length;
+	int ret;
+	uint8_t done;
+} swoole_async_file_chunk;
+
 typedef struct {
 	zval *callback;
 	zval *filename;
@@ -31,6 +40,14 @@ typedef struct {
 	uint8_t once;
 	char *file_content;
 	uint32_t content_length;
+	/**
+	 * swoole_async_read预读, 同时有chunk_num个读请求, 按offset顺序回调
+	 */
+	swoole_async_file_chunk *chunks;
+	off_t read_offset;
+	uint8_t chunk_num;
+	uint8_t inflight;
+	uint8_t closed;
 } swoole_async_file_request;
 
 typedef struct {
@@ -40,6 +57,10 @@ typedef struct {
 
 static void php_swoole_check_aio();
 static void php_swoole_aio_onComplete(swAio_event *event);
+static void php_swoole_aio_stream_onComplete(swAio_event *event, swoole_async_file_request *file_req);
+static int php_swoole_aio_stream_read(swoole_async_file_request *file_req, swoole_async_file_chunk *chunk);
+static void php_swoole_aio_stream_free(swoole_async_file_request *file_req);
+static void php_swoole_dns_onResolve(char *domain, swDNSResolver_result *result, void *data);
 static char php_swoole_aio_init = 0;
 static swHashMap php_swoole_open_files = NULL;
 
@@ -57,7 +78,6 @@ static void php_swoole_check_aio()
 
 static void php_swoole_aio_onComplete(swAio_event *event)
 {
-	int isEOF = SW_FALSE;
 	int64_t ret;
 
 	zval *retval = NULL, *zcallback = NULL, *zwriten = NULL;
@@ -91,6 +111,11 @@ static void php_swoole_aio_onComplete(swAio_event *event)
 			return;
 		}
 		zcallback = file_req->callback;
+		if (file_req->type == SW_AIO_READ && file_req->once == 0)
+		{
+			php_swoole_aio_stream_onComplete(event, file_req);
+			return;
+		}
 	}
 
 	ret = event->ret;
@@ -103,7 +128,6 @@ static void php_swoole_aio_onComplete(swAio_event *event)
 		if (ret == 0)
 		{
 			bzero(event->buf, event->nbytes);
-			isEOF = SW_TRUE;
 		}
 		else if (file_req->once == 1 && ret < file_req->content_length)
 		{
@@ -173,18 +197,6 @@ static void php_swoole_aio_onComplete(swAio_event *event)
 				swHashMap_del(&php_swoole_open_files, Z_STRVAL_P(file_req->filename), Z_STRLEN_P(file_req->filename));
 			}
 		}
-		else
-		{
-			if (!Z_BVAL_P(retval) || isEOF)
-			{
-				goto close_file;
-			}
-			else if (swoole_aio_read(event->fd, event->buf, event->nbytes, file_req->offset) < 0)
-			{
-				zend_error(E_WARNING, "swoole_async: continue to read failed. Error: %s[%d]", strerror(event->error),
-						event->error);
-			}
-		}
 	}
 	else if(dns_req != NULL)
 	{
@@ -208,18 +220,170 @@ static void php_swoole_aio_onComplete(swAio_event *event)
 	}
 }
 
+static int php_swoole_aio_stream_read(swoole_async_file_request *file_req, swoole_async_file_chunk *chunk)
+{
+	chunk->done = 0;
+	if (swoole_aio_read(file_req->fd, chunk->buf, chunk->length, chunk->offset) < 0)
+	{
+		return SW_ERR;
+	}
+	file_req->inflight++;
+	return SW_OK;
+}
+
+static void php_swoole_aio_stream_free(swoole_async_file_request *file_req)
+{
+	int i;
+	int fd = file_req->fd;
+
+	for (i = 0; i < file_req->chunk_num; i++)
+	{
+#ifdef HAVE_LINUX_NATIVE_AIO
+		free(file_req->chunks[i].buf);
+#else
+		efree(file_req->chunks[i].buf);
+#endif
+	}
+	efree(file_req->chunks);
+	zval_ptr_dtor(&file_req->callback);
+	zval_ptr_dtor(&file_req->filename);
+	close(fd);
+	zend_hash_del(&php_sw_aio_callback, (char *) &fd, sizeof(fd));
+}
+
+/**
+ * 读请求可能乱序完成, 已完成的chunk等待前面的chunk, 按offset顺序回调
+ * 回调返回true后用同一个buffer提交下一个读请求, 内存占用为chunk_num * trunk_len
+ */
+static void php_swoole_aio_stream_onComplete(swAio_event *event, swoole_async_file_request *file_req)
+{
+	swoole_async_file_chunk *chunk = NULL;
+	zval *retval = NULL, *zcontent = NULL;
+	zval **args[2];
+	int i, ret, next;
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	for (i = 0; i < file_req->chunk_num; i++)
+	{
+		if (file_req->chunks[i].buf == event->buf)
+		{
+			chunk = &file_req->chunks[i];
+			break;
+		}
+	}
+	if (chunk == NULL)
+	{
+		zend_error(E_WARNING, "swoole_async: onAsyncComplete chunk not found");
+		return;
+	}
+	file_req->inflight--;
+	chunk->done = 1;
+	chunk->ret = event->ret;
+	if (event->ret < 0)
+	{
+		zend_error(E_WARNING, "swoole_async: Aio Error: %s[%d]", strerror(event->error), event->error);
+		file_req->closed = 1;
+	}
+
+	while (file_req->closed == 0)
+	{
+		chunk = NULL;
+		for (i = 0; i < file_req->chunk_num; i++)
+		{
+			if (file_req->chunks[i].done && file_req->chunks[i].offset == file_req->offset)
+			{
+				chunk = &file_req->chunks[i];
+				break;
+			}
+		}
+		if (chunk == NULL)
+		{
+			break;
+		}
+		ret = chunk->ret;
+		if (ret == 0)
+		{
+			bzero(chunk->buf, chunk->length);
+		}
+
+		MAKE_STD_ZVAL(zcontent);
+		ZVAL_STRINGL(zcontent, chunk->buf, ret, 0);
+		args[0] = &file_req->filename;
+		args[1] = &zcontent;
+		if (call_user_function_ex(EG(function_table), NULL, file_req->callback, &retval, 2, args, 0, NULL TSRMLS_CC) == FAILURE)
+		{
+			zend_error(E_WARNING, "swoole_async: onAsyncComplete handler error");
+			retval = NULL;
+		}
+		next = (retval != NULL && Z_BVAL_P(retval) && ret > 0);
+		efree(zcontent);
+		if (retval != NULL)
+		{
+			zval_ptr_dtor(&retval);
+			retval = NULL;
+		}
+		//回调返回false或者读到文件末尾
+		if (!next)
+		{
+			file_req->closed = 1;
+			break;
+		}
+		file_req->offset += ret;
+		//读取的长度不足, 用同一个chunk继续读剩余部分, 读到末尾时返回0
+		if (ret < chunk->length)
+		{
+			chunk->offset += ret;
+			chunk->length -= ret;
+		}
+		else
+		{
+			chunk->offset = file_req->read_offset;
+			chunk->length = file_req->content_length;
+			file_req->read_offset += file_req->content_length;
+		}
+		if (php_swoole_aio_stream_read(file_req, chunk) < 0)
+		{
+			zend_error(E_WARNING, "swoole_async: continue to read failed.");
+			file_req->closed = 1;
+		}
+	}
+
+	//等待所有已提交的读请求完成后再释放buffer
+	if (file_req->closed && file_req->inflight == 0)
+	{
+		php_swoole_aio_stream_free(file_req);
+	}
+}
+
 PHP_FUNCTION(swoole_async_read)
 {
 	zval *cb;
 	zval *filename;
-	long trunk_len = 8192;
+	long trunk_len = SW_AIO_STREAM_TRUNK_SIZE;
+	long chunk_num = SW_AIO_STREAM_INFLIGHT;
+	int i;
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zz|l", &filename, &cb, &trunk_len) == FAILURE)
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zz|ll", &filename, &cb, &trunk_len, &chunk_num) == FAILURE)
 	{
 		return;
 	}
 	convert_to_string(filename);
 
+	if (trunk_len <= 0)
+	{
+		zend_error(E_WARNING, "swoole_async_read: trunk_len must be greater than 0.");
+		RETURN_FALSE;
+	}
+	if (chunk_num <= 0)
+	{
+		chunk_num = 1;
+	}
+	else if (chunk_num > SW_AIO_STREAM_INFLIGHT_MAX)
+	{
+		chunk_num = SW_AIO_STREAM_INFLIGHT_MAX;
+	}
+
 #ifdef HAVE_LINUX_NATIVE_AIO
 	int open_flag =  O_RDONLY | O_DIRECT;
 #else
@@ -232,49 +396,76 @@ PHP_FUNCTION(swoole_async_read)
 		RETURN_FALSE;
 	}
 
-	void *fcnt;
-#ifdef HAVE_LINUX_NATIVE_AIO
-	int buf_len = trunk_len + (sysconf(_SC_PAGESIZE) - (trunk_len % sysconf(_SC_PAGESIZE)));
-	if (posix_memalign((void **)&fcnt, sysconf(_SC_PAGESIZE), buf_len))
+	swoole_async_file_chunk *chunks = ecalloc(chunk_num, sizeof(swoole_async_file_chunk));
+	for (i = 0; i < chunk_num; i++)
 	{
-		zend_error(E_WARNING, "posix_memalign failed. Error: %s[%d]", strerror(errno), errno);
-		RETURN_FALSE;
-	}
+#ifdef HAVE_LINUX_NATIVE_AIO
+		int buf_len = trunk_len + (sysconf(_SC_PAGESIZE) - (trunk_len % sysconf(_SC_PAGESIZE)));
+		if (posix_memalign((void **) &chunks[i].buf, sysconf(_SC_PAGESIZE), buf_len))
+		{
+			zend_error(E_WARNING, "posix_memalign failed. Error: %s[%d]", strerror(errno), errno);
+			goto free_chunks;
+		}
 #else
-	fcnt = emalloc(trunk_len);
-	if (fcnt == NULL)
-	{
-		zend_error(E_WARNING, "malloc failed. Error: %s[%d]", strerror(errno), errno);
-		RETURN_FALSE;
-	}
+		chunks[i].buf = emalloc(trunk_len);
 #endif
+		chunks[i].offset = i * trunk_len;
+		chunks[i].length = trunk_len;
+	}
 
-	//printf("buf_len=%d|addr=%p\n", buf_len, fcnt);
-	//printf("pagesize=%d|st_size=%d\n", sysconf(_SC_PAGESIZE), buf_len);
-
-	swoole_async_file_request req;
+	swoole_async_file_request req, *file_req;
+	bzero(&req, sizeof(req));
 	req.fd = fd;
 	req.filename = filename;
 	req.callback = cb;
-	req.file_content = fcnt;
 	req.once = 0;
 	req.type = SW_AIO_READ;
 	req.content_length = trunk_len;
 	req.offset = 0;
-
-	Z_ADDREF_PP(&cb);
-	Z_ADDREF_PP(&filename);
+	req.chunks = chunks;
+	req.chunk_num = chunk_num;
+	req.read_offset = chunk_num * trunk_len;
 
 	if (zend_hash_update(&php_sw_aio_callback, (char * )&fd, sizeof(fd), &req, sizeof(swoole_async_file_request),
-			NULL) == FAILURE)
+			(void **) &file_req) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_async_readfile add to hashtable[1] failed");
-		RETURN_FALSE;
+		goto free_chunks;
 	}
 
+	Z_ADDREF_PP(&cb);
+	Z_ADDREF_PP(&filename);
+
 	php_swoole_check_aio();
-	SW_CHECK_RETURN(swoole_aio_read(fd, fcnt, trunk_len, 0));
+	for (i = 0; i < chunk_num; i++)
+	{
+		if (php_swoole_aio_stream_read(file_req, &chunks[i]) < 0)
+		{
+			file_req->closed = 1;
+			if (file_req->inflight == 0)
+			{
+				php_swoole_aio_stream_free(file_req);
+			}
+			RETURN_FALSE;
+		}
+	}
 	RETURN_TRUE;
+
+	free_chunks:
+	for (i = 0; i < chunk_num; i++)
+	{
+		if (chunks[i].buf != NULL)
+		{
+#ifdef HAVE_LINUX_NATIVE_AIO
+			free(chunks[i].buf);
+#else
+			efree(chunks[i].buf);
+#endif
+		}
+	}
+	efree(chunks);
+	close(fd);
+	RETURN_FALSE;
 }
 
 PHP_FUNCTION(swoole_async_write)
@@ -396,7 +587,7 @@ PHP_FUNCTION(swoole_async_readfile)
 	if (file_stat.st_size > SW_AIO_MAX_FILESIZE)
 	{
 		zend_error(E_WARNING,
-				"swoole_async_readfile: file_size[size=%ld|max_size=%d] is too big. Please use swoole_async_read.",
+				"swoole_async_readfile: file_size[size=%ld|max_size=%d] is too big. Please use swoole_async_read to read it in chunks.",
 				(long int) file_stat.st_size, SW_AIO_MAX_FILESIZE);
 		RETURN_FALSE;
 	}
@@ -470,7 +661,7 @@ PHP_FUNCTION(swoole_async_writefile)
 	if (fcnt_len > SW_AIO_MAX_FILESIZE)
 	{
 		zend_error(E_WARNING,
-				"swoole_async_writefile: file_size[size=%d|max_size=%d] is too big. Please use swoole_async_read.",
+				"swoole_async_writefile: file_size[size=%d|max_size=%d] is too big. Please use swoole_async_read to read it in chunks.",
 				fcnt_len, SW_AIO_MAX_FILESIZE);
 		RETURN_FALSE;
 	}
@@ -532,6 +723,7 @@ PHP_FUNCTION(swoole_async_dns_lookup)
 		return;
 	}
 
+	convert_to_string(domain);
 	if (Z_STRLEN_P(domain) == 0)
 	{
 		zend_error(E_WARNING, "swoole_async_dns_lookup: domain name empty.");
@@ -545,8 +737,54 @@ PHP_FUNCTION(swoole_async_dns_lookup)
 	Z_ADDREF_PP(&req->callback);
 	Z_ADDREF_PP(&req->domain);
 
-	void *buf = emalloc(SW_IP_MAX_LENGTH);
-	memcpy(buf, Z_STRVAL_P(domain), Z_STRLEN_P(domain));
-	php_swoole_check_aio();
-	SW_CHECK_RETURN(swoole_aio_dns_lookup(req, buf, SW_IP_MAX_LENGTH));
+	php_swoole_check_reactor();
+	if (swDNSResolver_lookup(SwooleG.main_reactor, Z_STRVAL_P(domain), php_swoole_dns_onResolve, req) < 0)
+	{
+		zval_ptr_dtor(&req->callback);
+		zval_ptr_dtor(&req->domain);
+		efree(req);
+		RETURN_FALSE;
+	}
+	php_swoole_try_run_reactor();
+	RETURN_TRUE;
+}
+
+/**
+ * 回调参数为域名和第一个IP地址, 优先使用IPv4, 查询失败时为空字符串
+ */
+static void php_swoole_dns_onResolve(char *domain, swDNSResolver_result *result, void *data)
+{
+	swoole_async_dns_request *req = data;
+	char ip_addr[INET6_ADDRSTRLEN] = {0};
+	zval *zcontent, *retval = NULL;
+	zval **args[2];
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	if (result != NULL && result->ipv4_num > 0)
+	{
+		inet_ntop(AF_INET, &result->ipv4[0], ip_addr, sizeof(ip_addr));
+	}
+	else if (result != NULL && result->ipv6_num > 0)
+	{
+		inet_ntop(AF_INET6, &result->ipv6[0], ip_addr, sizeof(ip_addr));
+	}
+
+	MAKE_STD_ZVAL(zcontent);
+	ZVAL_STRING(zcontent, ip_addr, 1);
+	args[0] = &req->domain;
+	args[1] = &zcontent;
+
+	if (call_user_function_ex(EG(function_table), NULL, req->callback, &retval, 2, args, 0, NULL TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_async: onAsyncComplete handler error");
+	}
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+	zval_ptr_dtor(&zcontent);
+	zval_ptr_dtor(&req->callback);
+	zval_ptr_dtor(&req->domain);
+	efree(req);
 }
@@ -19,6 +19,7 @@
 #include "php_network.h"
 
 #include "ext/standard/basic_functions.h"
+#include "dns.h"
 
 #ifdef SW_SOCKETS
 #if PHP_VERSION_ID >= 50301 && (HAVE_SOCKETS || defined(COMPILE_DL_SOCKETS))
@@ -44,6 +45,12 @@ typedef struct {
 	int interval;
 } swoole_timer_item;
 
+typedef struct {
+	zval *object;
+	long port;
+	double timeout;
+} swoole_client_dns_request;
+
 char php_sw_reactor_wait_onexit = 0;
 static char php_sw_reactor_ok = 0;
 static char php_sw_in_client = 0;
@@ -58,6 +65,7 @@ static char *php_sw_callbacks[PHP_CLIENT_CALLBACK_NUM] =
 };
 
 HashTable php_sw_long_connections;
+swClientPool php_sw_client_pool;
 
 static int php_swoole_client_event_add(zval *sock_array, fd_set *fds, int *max_fd TSRMLS_DC);
 static int php_swoole_client_event_loop(zval *sock_array, fd_set *fds TSRMLS_DC);
@@ -67,6 +75,8 @@ static void php_swoole_onTimerCallback(swTimer *timer, int interval);
 
 static int php_swoole_client_onReceive(swReactor *reactor, swEvent *event);
 static int php_swoole_client_onConnect(swReactor *reactor, swEvent *event);
+static int php_swoole_client_async_connect(zval *zobject, swClient *cli, char *host, long port, double timeout, long sock_flag TSRMLS_DC);
+static void php_swoole_client_onResolve(char *domain, swDNSResolver_result *result, void *data);
 
 static int swoole_convert_to_fd(zval **fd);
 static swClient* swoole_client_create_socket(zval *object, char *host, int host_len, int port);
@@ -197,12 +207,8 @@ static int php_swoole_client_onReceive(swReactor *reactor, swEvent *event)
 	char buf[SW_CLIENT_BUFFER_SIZE];
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
 
-#ifdef SW_USE_EPOLLET
-	n = swRead(event->fd, buf, SW_CLIENT_BUFFER_SIZE);
-#else
 	//非ET模式会持续通知
 	n = recv(event->fd, buf, SW_CLIENT_BUFFER_SIZE, 0);
-#endif
 
 	if (n < 0)
 	{
@@ -397,7 +403,7 @@ static void php_swoole_onTimerCallback(swTimer *timer, int interval)
 
 	args[0] = &zinterval;
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
-	if (call_user_function_ex(EG(function_table), NULL, timer_item->callback, &retval, 1, args, 0, NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_user_function("swoole_timer", timer_item->callback, &retval, 1, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_timer: onReactorCallback handler error");
 		return;
@@ -423,7 +429,7 @@ static int php_swoole_onReactorCallback(swReactor *reactor, swEvent *event)
 
 	args[0] = &fd->socket;
 	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
-	if (call_user_function_ex(EG(function_table), NULL, fd->callback, &retval, 1, args, 0, NULL TSRMLS_CC) == FAILURE)
+	if (php_swoole_call_user_function("swoole_event", fd->callback, &retval, 1, args TSRMLS_CC) == FAILURE)
 	{
 		zend_error(E_WARNING, "swoole_server: onReactorCallback handler error");
 		return SW_ERR;
@@ -499,8 +505,29 @@ static swClient* swoole_client_create_socket(zval *object, char *host, int host_
 		async = 1;
 	}
 
+	//同步长连接从连接池中获取
+	if ((type & SW_FLAG_KEEP) && !async)
+	{
+		if (!php_sw_client_pool.init || php_sw_client_pool.pid != getpid())
+		{
+			if (php_sw_client_pool.init)
+			{
+				swClientPool_free(&php_sw_client_pool);
+			}
+			swClientPool_create(&php_sw_client_pool);
+		}
+		cli = swClientPool_get(&php_sw_client_pool, php_swoole_socktype(type), host, port);
+		if (cli == NULL)
+		{
+			MAKE_STD_ZVAL(zerrorCode);
+			ZVAL_LONG(zerrorCode, errno);
+			zend_update_property(swoole_client_class_entry_ptr, object, ZEND_STRL("errCode"), zerrorCode TSRMLS_CC);
+			zval_ptr_dtor(&zerrorCode);
+			return NULL;
+		}
+	}
 	//keep the tcp connection
-	if (type & SW_FLAG_KEEP)
+	else if (type & SW_FLAG_KEEP)
 	{
 		swClient **find;
 		if (zend_hash_find(&php_sw_long_connections, conn_key, conn_key_len, (void **) &find) == FAILURE)
@@ -538,6 +565,7 @@ static swClient* swoole_client_create_socket(zval *object, char *host, int host_
 			zend_update_property(swoole_client_class_entry_ptr, object, ZEND_STRL("errCode"), zerrorCode TSRMLS_CC);
 			return NULL;
 		}
+		cli->open_tcp_fastopen = (type & SW_FLAG_FASTOPEN) ? 1 : 0;
 		//don't forget free it
 		cli->server_str = strdup(conn_key);
 		cli->server_strlen = conn_key_len;
@@ -656,10 +684,10 @@ PHP_FUNCTION(swoole_timer_add)
 		{
 			RETURN_FALSE;
 		}
-		SwooleG.timer.onTimer = php_swoole_onTimerCallback;
 		SwooleG.main_reactor->setHandle(SwooleG.main_reactor, SW_FD_TIMER, swTimer_event_handler);
 		SwooleG.main_reactor->add(SwooleG.main_reactor, SwooleG.timer.fd, SW_FD_TIMER);
 	}
+	SwooleG.timer.onTimer = php_swoole_onTimerCallback;
 
 	if (swTimer_add(&SwooleG.timer, timer_item.interval) < 0)
 	{
@@ -804,6 +832,120 @@ PHP_METHOD(swoole_client, __construct)
 	RETURN_TRUE;
 }
 
+static int php_swoole_client_async_connect(zval *zobject, swClient *cli, char *host, long port, double timeout, long sock_flag TSRMLS_DC)
+{
+	char *hash_key;
+	int hash_key_len;
+	int ret, flag = 0;
+
+	cli->connect(cli, host, port, (float) timeout, sock_flag);
+
+	hash_key_len = spprintf(&hash_key, sizeof(int)+1, "%d", cli->sock);
+	zval_add_ref(&zobject);
+
+	if (zend_hash_update(&php_sw_client_callback, hash_key, hash_key_len+1, &zobject, sizeof(zval*), NULL) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_client: add to hashtable fail");
+		efree(hash_key);
+		return SW_ERR;
+	}
+
+	php_swoole_check_reactor();
+	if (cli->type == SW_SOCK_TCP || cli->type == SW_SOCK_TCP6)
+	{
+		flag = (SW_FD_USER+1) | SW_EVENT_WRITE;
+	}
+	else
+	{
+		flag = (SW_FD_USER+1);
+
+		zval *zcallback = NULL;
+		zval **args[1];
+		zval *retval;
+
+		args[0] = &zobject;
+		zcallback = zend_read_property(swoole_client_class_entry_ptr, zobject, SW_STRL("connect")-1, 0 TSRMLS_CC);
+		if (ZVAL_IS_NULL(zcallback))
+		{
+			zend_error(E_WARNING, "swoole_client: swoole_client object have not connect callback.");
+			efree(hash_key);
+			return SW_ERR;
+		}
+		if (call_user_function_ex(EG(function_table), NULL, zcallback, &retval, 1, args, 0, NULL TSRMLS_CC) == FAILURE)
+		{
+			zend_error(E_WARNING, "swoole_client: onConnect[udp] handler error");
+			efree(hash_key);
+			return SW_ERR;
+		}
+		if (retval)
+		{
+			zval_ptr_dtor(&retval);
+		}
+	}
+	ret = SwooleG.main_reactor->add(SwooleG.main_reactor, cli->sock, flag);
+	efree(hash_key);
+	return ret;
+}
+
+/**
+ * DNS查询完成后再发起连接, 查询失败时回调onError
+ */
+static void php_swoole_client_onResolve(char *domain, swDNSResolver_result *result, void *data)
+{
+	swoole_client_dns_request *req = data;
+	zval *zobject = req->object;
+	zval *zcallback, *retval = NULL, *errCode;
+	zval **args[1];
+	zval **zres;
+	swClient *cli = NULL;
+	char ip_addr[INET_ADDRSTRLEN];
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	if (zend_hash_find(Z_OBJPROP_P(zobject), SW_STRL("_client"), (void **) &zres) == SUCCESS)
+	{
+		ZEND_FETCH_RESOURCE_NO_RETURN(cli, swClient*, zres, -1, SW_RES_CLIENT_NAME, le_swoole_client);
+	}
+	if (cli == NULL)
+	{
+		zend_error(E_WARNING, "swoole_client: no _client property.");
+		goto free_request;
+	}
+
+	if (result != NULL && result->ipv4_num > 0)
+	{
+		inet_ntop(AF_INET, &result->ipv4[0], ip_addr, sizeof(ip_addr));
+		php_swoole_client_async_connect(zobject, cli, ip_addr, req->port, req->timeout, 1 TSRMLS_CC);
+		goto free_request;
+	}
+
+	zend_error(E_WARNING, "swoole_client: DNS lookup for [%s] failed.", domain);
+	MAKE_STD_ZVAL(errCode);
+	ZVAL_LONG(errCode, EHOSTUNREACH);
+	zend_update_property(swoole_client_class_entry_ptr, zobject, ZEND_STRL("errCode"), errCode TSRMLS_CC);
+	zval_ptr_dtor(&errCode);
+
+	zcallback = zend_read_property(swoole_client_class_entry_ptr, zobject, SW_STRL(php_sw_client_onError)-1, 0 TSRMLS_CC);
+	if (ZVAL_IS_NULL(zcallback))
+	{
+		zend_error(E_WARNING, "swoole_client: swoole_client object have not error callback.");
+		goto free_request;
+	}
+	args[0] = &zobject;
+	if (call_user_function_ex(EG(function_table), NULL, zcallback, &retval, 1, args, 0, NULL TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_client: onError handler error");
+	}
+	if (retval)
+	{
+		zval_ptr_dtor(&retval);
+	}
+
+	free_request:
+	zval_ptr_dtor(&req->object);
+	efree(req);
+}
+
 PHP_METHOD(swoole_client, connect)
 {
 	int ret, i;
@@ -822,6 +964,15 @@ PHP_METHOD(swoole_client, connect)
 		return;
 	}
 	cli = swoole_client_create_socket(getThis(), host, host_len, port);
+	if (cli == NULL)
+	{
+		RETURN_FALSE;
+	}
+	//连接池中已连接的连接直接复用
+	if (cli->pool != NULL && cli->connected == 1)
+	{
+		RETURN_TRUE;
+	}
 
 	if (cli->async == 1 && (cli->type == SW_SOCK_TCP || cli->type == SW_SOCK_TCP6))
 	{
@@ -836,8 +987,6 @@ PHP_METHOD(swoole_client, connect)
 		RETURN_FALSE;
 	}
 
-	ret = cli->connect(cli, host, port, (float) timeout, sock_flag);
-
 	//nonblock async
 	if (cli->async == 1)
 	{
@@ -852,58 +1001,34 @@ PHP_METHOD(swoole_client, connect)
 			}
 		}
 
-		char *hash_key;
-		int hash_key_len;
-		int flag = 0;
-
-		hash_key_len = spprintf(&hash_key, sizeof(int)+1, "%d", cli->sock);
-		zval_add_ref(&getThis());
-
-		if (zend_hash_update(&php_sw_client_callback, hash_key, hash_key_len+1, &getThis(), sizeof(zval*), NULL) == FAILURE)
+		//域名不在缓存中, 先异步查询再连接
+		struct in_addr tmp;
+		if (cli->type == SW_SOCK_TCP && !inet_aton(host, &tmp) && swDNSResolver_find(host) == NULL)
 		{
-			zend_error(E_WARNING, "swoole_client: add to hashtable fail");
-			efree(hash_key);
-			RETURN_FALSE;
-		}
-
-		php_swoole_check_reactor();
-		if (cli->type == SW_SOCK_TCP || cli->type == SW_SOCK_TCP6)
-		{
-			flag = (SW_FD_USER+1) | SW_EVENT_WRITE;
-		}
-		else
-		{
-			flag = (SW_FD_USER+1);
-
-			zval *zcallback = NULL;
-			zval **args[1];
-			zval *retval;
-
-			args[0] = &getThis();
-			zcallback = zend_read_property(swoole_client_class_entry_ptr, getThis(), SW_STRL("connect")-1, 0 TSRMLS_CC);
-			if (ZVAL_IS_NULL(callback))
+			swoole_client_dns_request *req = emalloc(sizeof(swoole_client_dns_request));
+			req->object = getThis();
+			req->port = port;
+			req->timeout = timeout;
+			zval_add_ref(&req->object);
+
+			php_swoole_check_reactor();
+			if (swDNSResolver_lookup(SwooleG.main_reactor, host, php_swoole_client_onResolve, req) < 0)
 			{
-				zend_error(E_WARNING, "swoole_client: swoole_client object have not connect callback.");
-				efree(hash_key);
+				zval_ptr_dtor(&req->object);
+				efree(req);
 				RETURN_FALSE;
 			}
-			if (call_user_function_ex(EG(function_table), NULL, zcallback, &retval, 1, args, 0, NULL TSRMLS_CC) == FAILURE)
-			{
-				zend_error(E_WARNING, "swoole_client: onConnect[udp] handler error");
-				efree(hash_key);
-				RETURN_FALSE;
-			}
-			if (retval)
-			{
-				zval_ptr_dtor(&retval);
-			}
+			php_swoole_try_run_reactor();
+			RETURN_TRUE;
 		}
-		ret = SwooleG.main_reactor->add(SwooleG.main_reactor, cli->sock, flag);
-		efree(hash_key);
+
+		ret = php_swoole_client_async_connect(getThis(), cli, host, port, timeout, sock_flag TSRMLS_CC);
 		php_swoole_try_run_reactor();
 		SW_CHECK_RETURN(ret);
 	}
-	else if (ret < 0)
+
+	ret = cli->connect(cli, host, port, (float) timeout, sock_flag);
+	if (ret < 0)
 	{
 		zend_error(E_WARNING, "swoole_client: connect to server[%s:%d] fail. Error: %s [%d]", host, (int)port, strerror(errno), errno);
 		MAKE_STD_ZVAL(errCode);
@@ -1065,6 +1190,12 @@ PHP_METHOD(swoole_client, close)
 		RETURN_FALSE;
 	}
 
+	//归还到连接池, 由资源的析构函数释放
+	if (cli->pool != NULL)
+	{
+		zend_hash_del(Z_OBJPROP_P(getThis()), SW_STRL("_client"));
+		RETURN_TRUE;
+	}
 	//Connection error, or short tcp connection.
 	//No keep connection
 	if (!(Z_LVAL_P(ztype) & SW_FLAG_KEEP) && swConnection_error(cli->sock, SwooleG.error) == SW_OK)
@@ -1166,6 +1297,52 @@ PHP_FUNCTION(swoole_client_select)
 	RETURN_LONG(retval);
 }
 
+PHP_FUNCTION(swoole_client_pool_set)
+{
+	zval *zset;
+	HashTable *vht;
+	zval **v;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zset) == FAILURE)
+	{
+		return;
+	}
+	if (!php_sw_client_pool.init || php_sw_client_pool.pid != getpid())
+	{
+		if (php_sw_client_pool.init)
+		{
+			swClientPool_free(&php_sw_client_pool);
+		}
+		swClientPool_create(&php_sw_client_pool);
+	}
+	vht = Z_ARRVAL_P(zset);
+	//回收空闲连接时至少保留的数量
+	if (zend_hash_find(vht, ZEND_STRS("min_idle"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		php_sw_client_pool.min_idle = (uint32_t) Z_LVAL_PP(v);
+	}
+	//每个host:port最多保留的空闲连接
+	if (zend_hash_find(vht, ZEND_STRS("max_idle"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		php_sw_client_pool.max_idle = (uint32_t) Z_LVAL_PP(v);
+	}
+	//一个连接最多同时借给几个客户端
+	if (zend_hash_find(vht, ZEND_STRS("max_pipeline"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		php_sw_client_pool.max_pipeline = Z_LVAL_PP(v) > 0 ? (uint16_t) Z_LVAL_PP(v) : 1;
+	}
+	//空闲超时, 单位为秒
+	if (zend_hash_find(vht, ZEND_STRS("idle_timeout"), (void **)&v) == SUCCESS)
+	{
+		convert_to_long(*v);
+		php_sw_client_pool.idle_timeout = (uint32_t) Z_LVAL_PP(v);
+	}
+	RETURN_TRUE;
+}
+
 static int php_swoole_client_event_loop(zval *sock_array, fd_set *fds TSRMLS_DC)
 {
 	zval **element;
@@ -0,0 +1,232 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_swoole.h"
+
+#ifdef HAVE_EPOLL
+
+/**
+ * 持久的epoll等待集合, 注册一次可以多次wait, 每次只返回就绪的客户端
+ */
+typedef struct
+{
+	swReactor reactor;
+	HashTable clients;   //fd => swoole_client
+	zval *ready;         //本次wait就绪的客户端
+} swoole_client_waitset;
+
+static int php_swoole_waitset_onEvent(swReactor *reactor, swEvent *event);
+
+static int php_swoole_waitset_get_fd(zval *zclient TSRMLS_DC)
+{
+	zval *zsock;
+
+	if (Z_TYPE_P(zclient) != IS_OBJECT)
+	{
+		zend_error(E_WARNING, "object is not swoole_client object.");
+		return SW_ERR;
+	}
+	zsock = zend_read_property(Z_OBJCE_P(zclient), zclient, SW_STRL("sock")-1, 1 TSRMLS_CC);
+	if (ZVAL_IS_NULL(zsock) || Z_TYPE_P(zsock) != IS_LONG || Z_LVAL_P(zsock) <= 0)
+	{
+		zend_error(E_WARNING, "object is not swoole_client object.");
+		return SW_ERR;
+	}
+	return (int) Z_LVAL_P(zsock);
+}
+
+#define SWOOLE_GET_WAITSET(zobject, set) zval **zset;\
+	if (zend_hash_find(Z_OBJPROP_P(zobject), SW_STRL("_waitset"), (void **) &zset) == FAILURE){ \
+	RETURN_FALSE;}\
+	ZEND_FETCH_RESOURCE(set, swoole_client_waitset*, zset, -1, SW_RES_CLIENT_WAITSET_NAME, le_swoole_client_waitset);
+
+void swoole_destory_client_waitset(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	swoole_client_waitset *set = (swoole_client_waitset *) rsrc->ptr;
+	set->reactor.free(&set->reactor);
+	zend_hash_destroy(&set->clients);
+	efree(set);
+}
+
+static int php_swoole_waitset_onEvent(swReactor *reactor, swEvent *event)
+{
+	swoole_client_waitset *set = reactor->ptr;
+	zval **zclient;
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+	if (zend_hash_index_find(&set->clients, event->fd, (void **) &zclient) == SUCCESS)
+	{
+		//同时可读可写时只返回一次
+		zval_add_ref(zclient);
+		add_index_zval(set->ready, event->fd, *zclient);
+	}
+	return SW_OK;
+}
+
+PHP_METHOD(swoole_client_waitset, __construct)
+{
+	long max_events = SW_CLIENT_WAITSET_EVENTS;
+	swoole_client_waitset *set;
+	zval *zres;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|l", &max_events) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	if (max_events <= 0)
+	{
+		max_events = SW_CLIENT_WAITSET_EVENTS;
+	}
+	set = emalloc(sizeof(swoole_client_waitset));
+	bzero(set, sizeof(swoole_client_waitset));
+	if (swReactorEpoll_create(&set->reactor, max_events) < 0)
+	{
+		zend_error(E_WARNING, "swoole_client_waitset: create epoll failed.");
+		efree(set);
+		RETURN_FALSE;
+	}
+	//fd由swoole_client管理, wait只轮询一次
+	set->reactor.flag = SW_REACTOR_ONCE | SW_REACTOR_KEEP_FD;
+	set->reactor.ptr = set;
+	set->reactor.setHandle(&set->reactor, SW_FD_USER | SW_EVENT_READ, php_swoole_waitset_onEvent);
+	set->reactor.setHandle(&set->reactor, SW_FD_USER | SW_EVENT_WRITE, php_swoole_waitset_onEvent);
+	zend_hash_init(&set->clients, 16, NULL, ZVAL_PTR_DTOR, 0);
+
+	MAKE_STD_ZVAL(zres);
+	ZEND_REGISTER_RESOURCE(zres, set, le_swoole_client_waitset);
+	zend_update_property(swoole_client_waitset_class_entry_ptr, getThis(), ZEND_STRL("_waitset"), zres TSRMLS_CC);
+	zval_ptr_dtor(&zres);
+	RETURN_TRUE;
+}
+
+/**
+ * 添加客户端, 已经在集合中时修改监听的事件
+ */
+PHP_METHOD(swoole_client_waitset, add)
+{
+	zval *zclient;
+	zval **zfind;
+	long events = SW_EVENT_READ;
+	swoole_client_waitset *set;
+	int fd, fdtype = SW_FD_USER, ret;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z|l", &zclient, &events) == FAILURE)
+	{
+		return;
+	}
+	SWOOLE_GET_WAITSET(getThis(), set);
+
+	fd = php_swoole_waitset_get_fd(zclient TSRMLS_CC);
+	if (fd < 0)
+	{
+		RETURN_FALSE;
+	}
+	fdtype |= (events & (SW_EVENT_READ | SW_EVENT_WRITE));
+	if (fdtype == SW_FD_USER)
+	{
+		zend_error(E_WARNING, "swoole_client_waitset: events must be SWOOLE_EVENT_READ or SWOOLE_EVENT_WRITE.");
+		RETURN_FALSE;
+	}
+	//同一个对象修改事件, fd被关闭后重新连接时已从epoll中移除, 需要重新添加
+	if (zend_hash_index_find(&set->clients, fd, (void **) &zfind) == SUCCESS
+			&& Z_OBJ_HANDLE_PP(zfind) == Z_OBJ_HANDLE_P(zclient))
+	{
+		ret = set->reactor.set(&set->reactor, fd, fdtype);
+		if (ret < 0 && errno == ENOENT)
+		{
+			ret = set->reactor.add(&set->reactor, fd, fdtype);
+		}
+	}
+	else
+	{
+		ret = set->reactor.add(&set->reactor, fd, fdtype);
+	}
+	if (ret < 0)
+	{
+		RETURN_FALSE;
+	}
+	zval_add_ref(&zclient);
+	zend_hash_index_update(&set->clients, fd, &zclient, sizeof(zval *), NULL);
+	RETURN_TRUE;
+}
+
+PHP_METHOD(swoole_client_waitset, del)
+{
+	zval *zclient;
+	swoole_client_waitset *set;
+	int fd;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zclient) == FAILURE)
+	{
+		return;
+	}
+	SWOOLE_GET_WAITSET(getThis(), set);
+
+	fd = php_swoole_waitset_get_fd(zclient TSRMLS_CC);
+	if (fd < 0 || !zend_hash_index_exists(&set->clients, fd))
+	{
+		RETURN_FALSE;
+	}
+	set->reactor.del(&set->reactor, fd);
+	zend_hash_index_del(&set->clients, fd);
+	RETURN_TRUE;
+}
+
+/**
+ * 返回就绪的客户端数组, 以fd为key. timeout小于0时一直等待
+ */
+PHP_METHOD(swoole_client_waitset, wait)
+{
+	double timeout = 0.5;
+	struct timeval timeo;
+	swoole_client_waitset *set;
+	int ret;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|d", &timeout) == FAILURE)
+	{
+		return;
+	}
+	SWOOLE_GET_WAITSET(getThis(), set);
+
+	array_init(return_value);
+	set->ready = return_value;
+	if (timeout < 0)
+	{
+		ret = set->reactor.wait(&set->reactor, NULL);
+	}
+	else
+	{
+		timeo.tv_sec = (int) timeout;
+		timeo.tv_usec = (int) ((timeout - timeo.tv_sec) * 1000 * 1000);
+		ret = set->reactor.wait(&set->reactor, &timeo);
+	}
+	set->ready = NULL;
+	if (ret < 0)
+	{
+		zend_error(E_WARNING, "swoole_client_waitset: wait failed. Error: %s [%d]", strerror(errno), errno);
+		zval_dtor(return_value);
+		RETURN_FALSE;
+	}
+}
+
+PHP_METHOD(swoole_client_waitset, count)
+{
+	swoole_client_waitset *set;
+	SWOOLE_GET_WAITSET(getThis(), set);
+	RETURN_LONG(zend_hash_num_elements(&set->clients));
+}
+
+#endif
@@ -18,13 +18,25 @@
 
 #define SW_MAX_FDTYPE              32   //32 kinds of event
 #define SW_ERROR_MSG_SIZE          512
-#define SW_MAX_WORKER_GROUP        2
+#define SW_MAX_WORKER_GROUP        4    //worker分组的最大数量,包括默认分组
+#define SW_WORKER_GROUP_NAMELEN    32
 
-#define SW_GLOBAL_MEMORY_PAGESIZE  (1024*1024*2) //全局内存的分页
+#if defined(__x86_64__) || defined(__aarch64__)
+#define SW_GLOBAL_MEMORY_SIZE      (1024L*1024*1024) //全局内存预留的地址空间, 使用时才分配物理内存
+#else
+#define SW_GLOBAL_MEMORY_SIZE      (1024*1024*256)
+#endif
+#define SW_HUGEPAGE_SIZE           (1024*1024*2) //大于此长度的共享内存才使用大页
+#define SW_NUMA_NODE_MAX           64
+#define SW_MEMORY_CACHE_NUM        32    //每个线程每个尺寸级别缓存的空闲块数量
+#define SW_MEMORY_CACHE_BATCH      8     //线程缓存为空时一次从全局链表取回的数量
+#define SW_MEMORY_LARGE_SPLIT      4096  //大块剩余不足此值时不拆分
 
 #define SW_MAX_THREAD_NCPU         4 // n * cpu_num
 #define SW_MAX_WORKER_NCPU         100 // n * cpu_num
 #define SW_MAX_FDS                 (1024*10)      //最大tcp连接数
+#define SW_CONNECTION_CHUNK_SIZE   4096           //连接表按块统计连接数, 没有连接的块定期归还物理内存
+#define SW_CONNECTION_RELEASE_INTERVAL 60         //检查空闲块的间隔(秒)
 #define SW_MAX_REQUEST             10000          //最大请求包数
 #define SW_UNSOCK_BUFSIZE          (4*1024*1024)  //UDP socket的buffer区大小
 
@@ -33,14 +45,61 @@
 //#define SW_DEBUG                  //debug
 #define SW_LOG_NO_SRCINFO          //no source info
 #define SW_LOG_TRACE_OPEN          0 //1: open all trace log, 0: close all trace log, >1: open some[traceId=n] trace log
+#define SW_LOG_ASYNC                   //写入日志文件时先放入每个线程的环形队列, 由日志线程批量writev
+#define SW_LOG_RING_SIZE           (64*1024)  //每个线程的日志队列大小, 满了之后丢弃
+#define SW_LOG_RING_NUM            256        //最多多少个线程使用日志队列, 超过后同步写入
+#define SW_LOG_FLUSH_INTERVAL      10         //日志线程的刷新间隔(ms)
+#define SW_LOG_RATE_LIMIT          1000       //每个级别每秒最多记录的日志条数, 0表示不限制
 //#define SW_BUFFER_SIZE            65495 //65535 - 28 - 12(UDP最大包 - 包头 - 3个INT)
 #define SW_CLIENT_BUFFER_SIZE      65535
+#define SW_CLIENT_POOL_MIN_IDLE    1      //空闲连接超时后至少保留的数量(默认值,可通过swoole_client_pool_set设置)
+#define SW_CLIENT_POOL_MAX_IDLE    16     //每个host:port最多保留的空闲连接
+#define SW_CLIENT_POOL_MAX_PIPELINE 1     //一个连接同时借给多少个客户端, 大于1时启用pipeline
+#define SW_CLIENT_POOL_IDLE_TIMEOUT 60    //空闲连接超时时间(秒)
+#define SW_CLIENT_POOL_CHECK_INTERVAL 5000 //worker中检查空闲连接的间隔(ms)
+#define SW_CLIENT_POOL_KEY_LEN     64
+#define SW_CLIENT_WAITSET_EVENTS   1024        //swoole_client_waitset每次wait最多返回的数量
+#define SW_CORO_STACK_SIZE         (256 * 1024) //每个协程的栈, 只占用虚拟内存
+#define SW_CORO_MAX_NUM            3000   //每个进程最多同时存在的协程, 超过后onReceive不在协程中执行
+#define SW_CORO_POOL_SIZE          128    //保留的空闲协程栈
+#define SW_CORO_FD_INIT_SIZE       1024
 #define SW_BUFFER_SIZE             (8192-sizeof(struct _swDataHead)) //65535 - 28 - 12(UDP最大包 - 包头 - 3个INT)
-#define SW_SENDFILE_TRUNK          65535
+#define SW_SENDFILE_TRUNK          65535  //每次可写事件最多sendfile的字节数(默认值,可通过sendfile_window设置)
+#define SW_PACKAGE_PARSE_MAX       64     //长度检测时一次扫描最多解析的包数量
+#define SW_UDP_RECV_BATCH          64     //recvmmsg一次最多读取的UDP包数量
+#define SW_UDP_SEND_BATCH          64     //worker进程sendmmsg一次最多发送的UDP包数量
+#define SW_UDP_PEER_NUM            65536  //UDP对端地址表的大小,必须是2的N次方,最大为1M
+#define SW_UDP_PEER_PROBE          4      //UDP对端地址表冲突时向后查找的槽位数
+#define SW_FILECACHE_MAX           4096   //每个reactor线程缓存的文件fd数量
+#define SW_FILECACHE_CHECK_INTERVAL 1     //缓存的文件每隔多少秒检查一次是否被修改
 #define SW_SENDFILE_MAXLEN         4194304
+#define SW_USE_WRITEV                     //使用writev合并发送out_buffer中的多个trunk
+#define SW_BUFFER_IOV_MAX          1024   //一次writev的最大trunk数量,不超过IOV_MAX
+#define SW_BUFFER_POOL_CLASS_NUM   2      //trunk内存池的尺寸级别数量
+#define SW_BUFFER_POOL_SMALL_SIZE  512    //小尺寸trunk,用于短小的响应
+#define SW_BUFFER_POOL_MEMORY      (1024*1024*64) //每个reactor线程的trunk内存池每级最大占用,超过后使用malloc
+#define SW_BUFFER_HIGH_WATERMARK   (1024*1024*8)  //out_buffer超过此长度时停止读取此连接,0表示不限制
+#define SW_BUFFER_LOW_WATERMARK    (1024*1024)    //out_buffer降到此长度以下时恢复读取
+#define SW_BUFFER_INPUT_INIT_SIZE  2048   //EOF/长度检测的接收buffer初始大小,按2倍扩容到buffer_input_size
+#define SW_BUFFER_INPUT_POOL_NUM   256    //每个reactor线程缓存的空闲接收buffer数量
+#define SW_BUFFER_INPUT_SHRINK_SIZE (256*1024) //worker进程合并大包的buffer超过此大小时,处理完后释放
 
 #define SW_HASHMAP_KEY_MAXLEN      256
 #define SW_HASHMAP_INIT_BUCKET_N   32  //hashmap初始化时创建32大小的桶
+#define SW_HASHMAP_INT_INIT_BITS   4   //整数key的hashmap初始容量为2^4
+
+#define SW_HTTP_HEADER_MAX_SIZE    8192   //open_http_protocol: 请求行和头部的最大长度
+#define SW_HTTP_HEADER_NUM         64     //最多解析的头部数量
+#define SW_HTTP_CHUNK_LINE_MAX     1024   //chunk-size行的最大长度
+#define SW_WEBSOCKET_FRAGMENT_INIT_SIZE 8192 //分片消息合并buffer的初始大小,最大为buffer_input_size
+#define SW_WEBSOCKET_COMPRESSION_MIN_LENGTH 256 //permessage-deflate: 小于此长度的消息不压缩
+#define SW_WEBSOCKET_DEFLATE_WINDOW_BITS  15      //服务端压缩的窗口, 解压客户端的消息固定为15
+#define SW_WEBSOCKET_DEFLATE_MEM_LEVEL    8
+#define SW_WEBSOCKET_DEFLATE_BUFFER_SIZE  65536   //每个线程的压缩/解压buffer的初始大小
+#define SW_WEBSOCKET_DEFLATE_BUFFER_MAX   (1024*1024) //超过此大小时下一次使用前释放
+
+#define SW_PROXY_SPLICE_SIZE       65536  //splice代理每次移动的最大字节数, 与默认管道容量一致
+#define SW_SSL_CIPHERS             "ECDHE+AESGCM:ECDHE+CHACHA20" //内核kTLS支持的AEAD套件
 
 #define SW_DATA_EOF                "\r\n\r\n"
 #define SW_DATA_EOF_MAXLEN         8
@@ -51,29 +110,88 @@
 #define SW_MAINREACTOR_TIMEO       1    //main reactor
 #define SW_MAINREACTOR_USE_UNSOCK  1    //主线程使用unsock
 #define SW_REACTOR_WRITER_TIMEO    3    //writer线程的reactor
-//#define SW_REACTOR_DIRECT_SEND          //首先尝试直接发送,如果发生EAGAIN错误,再添加EPOLLOUT事件监听
+#define SW_REACTOR_DIRECT_SEND     0    //首先尝试直接发送,如果发生EAGAIN错误,再添加EPOLLOUT事件监听(默认关闭,可通过direct_send开启)
+#define SW_REACTOR_DISPATCH_BATCH  0    //一轮事件循环中发往同一个worker的小包合并投递,在onFinish中发送(默认值,可通过dispatch_batch设置)
+#define SW_REACTOR_RESP_BATCH      16   //reactor线程一次从worker管道读取的最大响应数量,合并后每个连接只发送一次
+#define SW_TIMER_HEAP_SIZE         64   //定时器最小堆的初始容量
 #define SW_TASKWAIT_TIMEOUT        0.5
+#define SW_TASKWAIT_MULTI_MAX      32   //taskWaitMulti一次最多并行的task数量
+#define SW_TASK_ARENA_SIZE         (32*1024*1024) //超过SW_BUFFER_SIZE的task数据保存在此共享内存中(可通过task_arena_size设置)
+#define SW_RECV_RING_SIZE          0    //PROCESS模式每个reactor线程的共享内存接收环, 超过SW_BUFFER_SIZE的length_check包直接接收到环中, 0为关闭(可通过recv_ring_size设置)
+#define SW_SEND_ARENA_SIZE         (16*1024*1024) //广播和大数据包保存在此共享内存中,reactor线程直接从中发送(可通过send_arena_size设置)
 
 //#define SW_AIO_LINUX_NATIVE
 //#define SW_AIO_GCC
 #define SW_AIO_THREAD_POOL
+#define SW_AIO_USE_IO_URING             //内核支持时文件读写使用io_uring, 线程池只处理DNS查询
 #define SW_AIO_THREAD_NUM          2
+#define SW_AIO_THREAD_QUEUE_DEPTH  32   //不能使用io_uring时线程池的线程数量, 按磁盘队列深度设置
 //#define SW_AIO_THREAD_USE_CHANNEL
-//#define SW_THREADPOOL_USE_CHANNEL
+//#define SW_THREADPOOL_USE_CHANNEL        //线程池使用无锁MPSC channel, 否则使用MPMCQueue
+#if defined(SW_AIO_THREAD_USE_CHANNEL) && !defined(SW_THREADPOOL_USE_CHANNEL)
+#define SW_THREADPOOL_USE_CHANNEL
+#endif
 #define SW_THREADPOOL_QUEUE_LEN    100
+#define SW_MPSC_CHANNEL_MIN_SIZE   (64*1024)
+#define SW_MPSC_CHANNEL_SIZE       (256*1024) //线程池使用channel时的内存大小
 #define SW_IP_MAX_LENGTH           32
+
+#define SW_DNS_RESOLV_CONF         "/etc/resolv.conf"
+#define SW_DNS_HOSTS_CONF          "/etc/hosts"
+#define SW_DNS_DEFAULT_SERVER      "127.0.0.1"  //resolv.conf中没有nameserver时使用
+#define SW_DNS_SERVER_PORT         53
+#define SW_DNS_TIMEOUT             1000   //查询超时时间(ms), 超时后重发
+#define SW_DNS_RETRY               2
+#define SW_DNS_CACHE_MAX           4096   //缓存的域名数量
+#define SW_DNS_MIN_TTL             1
+#define SW_DNS_MAX_TTL             3600
+#define SW_DNS_DOMAIN_MAX          256
+#define SW_DNS_HOST_ADDR_MAX       8      //每个域名保存的IPv4/IPv6地址数量
+#define SW_DNS_PACKET_SIZE         512
+#define SW_DNS_LINE_MAX            1024
+
+#define SW_MYSQL_POOL_SIZE         4      //每个worker到同一个MySQL的默认连接数
+#define SW_MYSQL_BUFFER_SIZE       16384  //连接的初始读缓存, 按需增长
+#define SW_MYSQL_CONNECT_TIMEOUT   3000   //连接和认证的超时时间(ms)
+#define SW_MYSQL_DEFAULT_PORT      3306
+#define SW_MYSQL_DEFAULT_CHARSET   33     //utf8_general_ci
+#define SW_MYSQL_USER_MAX          64
+#define SW_MYSQL_PASSWORD_MAX      128
+#define SW_MYSQL_DATABASE_MAX      64
+#define SW_MYSQL_ERROR_MAX         256
+
+#define SW_REDIS_POOL_SIZE         4      //每个worker到同一个Redis的默认连接数
+#define SW_REDIS_BUFFER_SIZE       16384  //连接的初始读缓存, 按需增长
+#define SW_REDIS_CONNECT_TIMEOUT   3000   //连接的超时时间(ms)
+#define SW_REDIS_DEFAULT_PORT      6379
+#define SW_REDIS_PASSWORD_MAX      128
+#define SW_REDIS_ERROR_MAX         256
+#define SW_REDIS_MAX_DEPTH         8      //回复中数组嵌套的最大层数
+#define SW_REDIS_MAX_ELEMENTS      1048576
+#define SW_REDIS_BULK_MAX          536870912  //与redis的proto-max-bulk-len一致
+#define SW_REDIS_LINE_MAX          65536  //inline命令和状态行的最大长度
+
 #define SW_AIO_MAX_FILESIZE        4194304
 #define SW_AIO_EVENT_NUM           128
+#define SW_AIO_STREAM_TRUNK_SIZE   262144 //swoole_async_read每次读取的长度(默认值)
+#define SW_AIO_STREAM_INFLIGHT     4      //swoole_async_read同时提交的读请求数量(默认值)
+#define SW_AIO_STREAM_INFLIGHT_MAX 16
 
 #ifndef SW_WORKER_IPC_MODE
-#define SW_WORKER_IPC_MODE         1    //1:unix socket,2:IPC Message Queue
+#define SW_WORKER_IPC_MODE         1    //1:unix socket,2:IPC Message Queue,3:shared memory ring
 #endif
+#define SW_WORKER_RING_SIZE        (1024*256) //IPC_MODE=3时每个(reactor线程,worker)环形队列的大小,必须是2的N次方
+#define SW_WORKER_SPIN_USEC        0    //worker取完所有请求后自旋等待新请求的时间(微秒),0表示不自旋(可通过worker_spin_usec设置)
 #define SW_USE_WRITER_THREAD       0    //使用单独的发送线程
 
 #define SW_WORKER_SENDTO_COUNT     2    //写回客户端失败尝试次数
 #define SW_WORKER_SENDTO_YIELD     10   //yield after sendto
 
-#define SW_MAINREACTOR_USE_POLL         //main thread to use select or poll
+#define SW_MAINREACTOR_USE_POLL         //没有epoll/kqueue时main reactor使用poll, 否则使用select
+#define SW_MAINREACTOR_MAXEVENTS   64   //main reactor每次wait最多返回的事件数
+#ifndef SW_USE_IO_URING
+#define SW_USE_IO_URING            0    //1: 内核支持时swReactor_auto优先使用io_uring, 还不支持multishot/provided buffer, 默认关闭
+#endif
 
 #define SW_REACTOR_TIMEO_SEC       3
 #define SW_REACTOR_TIMEO_USEC      0
@@ -82,6 +200,14 @@
 #define SW_SCHEDULE_INTERVAL       32   //平均调度的间隔次数,减少运算量
 
 #define SW_QUEUE_SIZE              100   //缩减版的RingQueue,用在线程模式下
+#define SW_THREAD_QUEUE_SIZE       16384 //线程模式和线程池使用的无锁MPMC队列长度,必须是2的N次方
+#define SW_THREAD_QUEUE_WAIT       1000  //队列为空时消费者线程每次最多睡眠的时间(毫秒)
+#define SW_DISPATCH_LEAST_SCAN     8     //dispatch_mode=4时worker数量不超过此值则扫描全部worker,否则随机取两个比较
+#define SW_FACTORY_WORK_STEALING   0     //线程模式下空闲的写线程从其他线程的队列窃取请求(默认值,可通过work_stealing设置)
+#define SW_FACTORY_STEAL_WAIT      1     //窃取失败后空闲线程睡眠的时间(毫秒)
+#define SW_RELOAD_DRAIN_TIMEOUT    5000  //reload_batch>0时等待worker排空请求的默认时间(毫秒)
+#define SW_RELOAD_WARMUP_TIMEOUT   30000 //等待新worker预热完成的最长时间(毫秒), 超时后直接加入分配
+#define SW_CACHE_LINE_SIZE         64
 
 #define SW_RINGQUEUE_USE           0             //使用RingQueue代替系统消息队列，此特性正在测试中，启用此特性会用内存队列来替代IPC通信，会减少系统调用、内存申请和复制，提高性能
 #define SW_RINGQUEUE_LEN           100           //RingQueue队列长度
@@ -94,19 +220,41 @@
 
 #define SW_ACCEPT_AGAIN            1     //是否循环accept，可以一次性处理完全部的listen队列，用于大量并发连接的场景
 #define SW_ACCEPT_MAX_COUNT        64    //一次循环的最大accept次数
+#ifdef __linux__
+#define SW_ACCEPT_INHERIT_SOCKOPT        //accept得到的连接继承监听socket的TCP_NODELAY/keepalive/SO_BUSY_POLL, 不再每个连接设置
+#endif
+
+#define SW_OVERLOAD_INTERVAL       100    //毫秒, worker排队延迟持续超过overload_target多久算过载
+#define SW_OVERLOAD_DRAIN_COUNT    4      //拒绝前读掉客户端已发送的数据的次数, 否则close会发RST丢弃回复
 
 #define SW_CLOSE_AGAIN             1
-#define SW_CLOSE_QLEN              1024
-//#define SW_USE_EPOLLET
+#define SW_CLOSE_QLEN              1024   //关闭队列的初始长度, 也是投递给主线程的每条记录最多包含的fd数量
+#define SW_CLOSE_RING_SIZE         65536  //每个reactor线程投递关闭fd的无锁队列尺寸,必须是2的N次方
 #define SW_USE_EVENTFD                   //是否使用eventfd来做消息通知，需要Linux 2.6.22以上版本才会支持
 
 #define SW_AIO_MAX_EVENTS          128
 
-#if defined(HAVE_SIGNALFD) && SW_WORKER_IPC_MODE != 1
+#define SW_TABLE_COLUMN_NUM        32    //swoole_table最多的列数
+#define SW_TABLE_COLUMN_NAME_SIZE  32
+#define SW_TABLE_KEY_SIZE          64    //key的最大长度
+#define SW_TABLE_CONFLICT_PROPORTION 0.2 //冲突链表的行数占桶数量的比例
+#define SW_TABLE_LOCK_SPIN         1024
+
+#define SW_FUTEXLOCK_SPIN          1024  //futex锁睡眠前自旋的最大次数(指数退避)
+#define SW_CACHELINE_SIZE          64
+#define SW_SEQLOCK_SPIN            1024
+#define SW_BRLOCK_SPIN             1024
+#define SW_BRLOCK_SLOT_NUM         64    //BRLock读者计数的slot数量, 每个占一个cache line
+#define SW_READY_TIMEOUT           3000  //启动时等待reactor线程/worker就绪的最长时间(毫秒)
+#define SW_STATS_DUMP_INTERVAL     10    //设置了stats_file时manager写入统计数据的间隔(秒)
+#define SW_SLOWLOG_SIGNAL          (SIGRTMIN + 1)  //慢回调监视线程通知主线程记录调用栈
+#define SW_SLOWLOG_BACKTRACE_MAX   32    //慢日志最多记录多少层调用栈
+
+#if defined(HAVE_SIGNALFD) && SW_WORKER_IPC_MODE == 2
 #undef HAVE_SIGNALFD
 #endif
 
-#if defined(HAVE_TIMERFD) && SW_WORKER_IPC_MODE != 1
+#if defined(HAVE_TIMERFD) && SW_WORKER_IPC_MODE == 2
 #undef HAVE_TIMERFD
 #endif
 
@@ -68,6 +68,15 @@ PHP_METHOD(swoole_lock, __construct)
 		ret = swSpinLock_create(lock, 1);
 		break;
 #endif
+	case SW_FUTEXLOCK:
+		ret = swFutexLock_create(lock, 1);
+		break;
+	case SW_SEQLOCK:
+		ret = swSeqLock_create(lock, 1);
+		break;
+	case SW_BRLOCK:
+		ret = swBRLock_create(lock, 1);
+		break;
 	case SW_MUTEX:
 	default:
 		ret = swMutex_create(lock, 1);
@@ -160,7 +169,7 @@ PHP_METHOD(swoole_lock, trylock_read)
 		zend_error(E_WARNING, "SwooleLock: lock[type=%d] can not trylock_read", lock->type);
 		RETURN_FALSE;
 	}
-	SW_LOCK_CHECK_RETURN(lock->trylock(lock));
+	SW_LOCK_CHECK_RETURN(lock->trylock_rd(lock));
 }
 
 PHP_METHOD(swoole_lock, lock_read)
@@ -180,5 +189,5 @@ PHP_METHOD(swoole_lock, lock_read)
 		zend_error(E_WARNING, "SwooleLock: lock[type=%d] can not lock_read", lock->type);
 		RETURN_FALSE;
 	}
-	SW_LOCK_CHECK_RETURN(lock->trylock(lock));
+	SW_LOCK_CHECK_RETURN(lock->lock_rd(lock));
 }
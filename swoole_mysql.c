@@ -0,0 +1,361 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_swoole.h"
+#include "mysql_client.h"
+
+typedef struct
+{
+	swMySQL_query query;
+	swMySQL_pool *pool;
+	zval *object;
+	zval *callback;
+	zval *rows;
+} php_swoole_mysql_query;
+
+static void php_swoole_mysql_onRow(swMySQL_query *query, swMySQL_result *result, char **values, uint32_t *lengths);
+static void php_swoole_mysql_onResult(swMySQL_query *query, swMySQL_result *result);
+
+#define SWOOLE_GET_MYSQL(zobject, pool) zval **zpool;\
+	if (zend_hash_find(Z_OBJPROP_P(zobject), SW_STRL("_mysql"), (void **) &zpool) == FAILURE){ \
+	zend_error(E_WARNING, "swoole_mysql: mysql connection is closed.");\
+	RETURN_FALSE;}\
+	ZEND_FETCH_RESOURCE(pool, swMySQL_pool*, zpool, -1, SW_RES_MYSQL_NAME, le_swoole_mysql);
+
+void swoole_destory_mysql(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	swMySQL_pool *pool = (swMySQL_pool *) rsrc->ptr;
+	swMySQL_pool_free(pool);
+}
+
+static void php_swoole_mysql_query_free(php_swoole_mysql_query *req)
+{
+	uint16_t i;
+
+	for (i = 0; i < req->query.param_num; i++)
+	{
+		if (req->query.params[i])
+		{
+			efree(req->query.params[i]);
+		}
+	}
+	if (req->query.params)
+	{
+		efree(req->query.params);
+		efree(req->query.param_lens);
+	}
+	if (req->rows)
+	{
+		zval_ptr_dtor(&req->rows);
+	}
+	zval_ptr_dtor(&req->callback);
+	zval_ptr_dtor(&req->object);
+	efree(req->query.sql);
+	efree(req);
+}
+
+static void php_swoole_mysql_onRow(swMySQL_query *query, swMySQL_result *result, char **values, uint32_t *lengths)
+{
+	php_swoole_mysql_query *req = query->object;
+	zval *row;
+	uint16_t i;
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	if (req->pool->destroy)
+	{
+		return;
+	}
+	if (req->rows == NULL)
+	{
+		MAKE_STD_ZVAL(req->rows);
+		array_init(req->rows);
+	}
+	MAKE_STD_ZVAL(row);
+	array_init(row);
+	for (i = 0; i < result->field_num; i++)
+	{
+		if (values[i] == NULL)
+		{
+			add_assoc_null_ex(row, result->fields[i].name, result->fields[i].name_len + 1);
+		}
+		else
+		{
+			add_assoc_stringl_ex(row, result->fields[i].name, result->fields[i].name_len + 1, values[i], lengths[i], 1);
+		}
+	}
+	add_next_index_zval(req->rows, row);
+}
+
+/**
+ * 回调参数为swoole_mysql对象和结果: 结果集为数组, 其他语句成功为true, 失败为false
+ */
+static void php_swoole_mysql_onResult(swMySQL_query *query, swMySQL_result *result)
+{
+	php_swoole_mysql_query *req = query->object;
+	zval *zobject = req->object;
+	zval *zresult, *retval = NULL;
+	zval **args[2];
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	//close()或者请求结束时释放连接池, 不再回调
+	if (req->pool->destroy)
+	{
+		php_swoole_mysql_query_free(req);
+		return;
+	}
+
+	zend_update_property_long(swoole_mysql_class_entry_ptr, zobject, ZEND_STRL("errno"), result->error_code TSRMLS_CC);
+	zend_update_property_string(swoole_mysql_class_entry_ptr, zobject, ZEND_STRL("error"), result->error_code ? result->error_msg : "" TSRMLS_CC);
+	zend_update_property_long(swoole_mysql_class_entry_ptr, zobject, ZEND_STRL("affected_rows"), result->affected_rows TSRMLS_CC);
+	zend_update_property_long(swoole_mysql_class_entry_ptr, zobject, ZEND_STRL("insert_id"), result->insert_id TSRMLS_CC);
+
+	if (result->error_code != 0)
+	{
+		MAKE_STD_ZVAL(zresult);
+		ZVAL_FALSE(zresult);
+	}
+	else if (result->field_num > 0)
+	{
+		if (req->rows == NULL)
+		{
+			MAKE_STD_ZVAL(req->rows);
+			array_init(req->rows);
+		}
+		zresult = req->rows;
+		req->rows = NULL;
+	}
+	else
+	{
+		MAKE_STD_ZVAL(zresult);
+		ZVAL_TRUE(zresult);
+	}
+
+	args[0] = &zobject;
+	args[1] = &zresult;
+	if (call_user_function_ex(EG(function_table), NULL, req->callback, &retval, 2, args, 0, NULL TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_mysql: onResult handler error");
+	}
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+	zval_ptr_dtor(&zresult);
+	php_swoole_mysql_query_free(req);
+}
+
+static int php_swoole_mysql_query(zval *zobject, swMySQL_pool *pool, char *sql, int sql_len, zval *params, zval *callback TSRMLS_DC)
+{
+	php_swoole_mysql_query *req;
+	zval **zparam, *zvalue;
+	char *func_name = NULL;
+	int i = 0;
+
+	if (!zend_is_callable(callback, 0, &func_name TSRMLS_CC))
+	{
+		zend_error(E_WARNING, "swoole_mysql: function '%s' is not callable", func_name);
+		efree(func_name);
+		return SW_ERR;
+	}
+	efree(func_name);
+
+	req = emalloc(sizeof(php_swoole_mysql_query));
+	bzero(req, sizeof(php_swoole_mysql_query));
+	req->query.sql = estrndup(sql, sql_len);
+	req->query.sql_len = sql_len;
+	req->query.onRow = php_swoole_mysql_onRow;
+	req->query.onResult = php_swoole_mysql_onResult;
+	req->query.object = req;
+	req->pool = pool;
+
+	if (params != NULL)
+	{
+		//参数都以字符串绑定
+		req->query.binary = 1;
+		req->query.param_num = zend_hash_num_elements(Z_ARRVAL_P(params));
+		if (req->query.param_num > 0)
+		{
+			req->query.params = ecalloc(req->query.param_num, sizeof(char *));
+			req->query.param_lens = ecalloc(req->query.param_num, sizeof(uint32_t));
+		}
+		for (zend_hash_internal_pointer_reset(Z_ARRVAL_P(params));
+				zend_hash_get_current_data(Z_ARRVAL_P(params), (void **) &zparam) == SUCCESS && i < req->query.param_num;
+				zend_hash_move_forward(Z_ARRVAL_P(params)), i++)
+		{
+			if (Z_TYPE_PP(zparam) == IS_NULL)
+			{
+				continue;
+			}
+			ALLOC_ZVAL(zvalue);
+			MAKE_COPY_ZVAL(zparam, zvalue);
+			convert_to_string(zvalue);
+			req->query.params[i] = estrndup(Z_STRVAL_P(zvalue), Z_STRLEN_P(zvalue));
+			req->query.param_lens[i] = Z_STRLEN_P(zvalue);
+			zval_ptr_dtor(&zvalue);
+		}
+	}
+
+	req->object = zobject;
+	req->callback = callback;
+	zval_add_ref(&req->object);
+	zval_add_ref(&req->callback);
+
+	if (swMySQL_pool_query(pool, &req->query) < 0)
+	{
+		php_swoole_mysql_query_free(req);
+		return SW_ERR;
+	}
+	return SW_OK;
+}
+
+PHP_METHOD(swoole_mysql, __construct)
+{
+	zval *zconfig, **ztmp, *zres;
+	char *host = "127.0.0.1", *user = "root", *password = "", *database = "";
+	long port = SW_MYSQL_DEFAULT_PORT;
+	long pool_size = SW_MYSQL_POOL_SIZE;
+	int charset = SW_MYSQL_DEFAULT_CHARSET;
+	swMySQL_pool *pool;
+	HashTable *vht;
+
+#ifdef ZTS
+	if (sw_thread_ctx == NULL)
+	{
+		TSRMLS_SET_CTX(sw_thread_ctx);
+	}
+#endif
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zconfig) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	vht = Z_ARRVAL_P(zconfig);
+	if (zend_hash_find(vht, ZEND_STRS("host"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_string(*ztmp);
+		host = Z_STRVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("port"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_long(*ztmp);
+		port = Z_LVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("user"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_string(*ztmp);
+		user = Z_STRVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("password"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_string(*ztmp);
+		password = Z_STRVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("database"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_string(*ztmp);
+		database = Z_STRVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("charset"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_string(*ztmp);
+		charset = swMySQL_charset(Z_STRVAL_PP(ztmp));
+		if (charset < 0)
+		{
+			zend_error(E_WARNING, "swoole_mysql: unknown charset[%s].", Z_STRVAL_PP(ztmp));
+			RETURN_FALSE;
+		}
+	}
+	//每个worker进程中的连接数量
+	if (zend_hash_find(vht, ZEND_STRS("pool_size"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_long(*ztmp);
+		pool_size = Z_LVAL_PP(ztmp);
+	}
+
+	php_swoole_check_reactor();
+	pool = swMySQL_pool_new(SwooleG.main_reactor, host, port, user, password, database, pool_size);
+	if (pool == NULL)
+	{
+		zend_error(E_WARNING, "swoole_mysql: create connection pool failed.");
+		RETURN_FALSE;
+	}
+	pool->charset = charset;
+
+	MAKE_STD_ZVAL(zres);
+	ZEND_REGISTER_RESOURCE(zres, pool, le_swoole_mysql);
+	zend_update_property(swoole_mysql_class_entry_ptr, getThis(), ZEND_STRL("_mysql"), zres TSRMLS_CC);
+	zval_ptr_dtor(&zres);
+	RETURN_TRUE;
+}
+
+PHP_METHOD(swoole_mysql, query)
+{
+	zval *callback;
+	char *sql;
+	int sql_len;
+	swMySQL_pool *pool;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sz", &sql, &sql_len, &callback) == FAILURE)
+	{
+		return;
+	}
+	SWOOLE_GET_MYSQL(getThis(), pool);
+
+	if (php_swoole_mysql_query(getThis(), pool, sql, sql_len, NULL, callback TSRMLS_CC) < 0)
+	{
+		RETURN_FALSE;
+	}
+	php_swoole_try_run_reactor();
+	RETURN_TRUE;
+}
+
+/**
+ * 预处理语句, $params按顺序绑定到?占位符
+ */
+PHP_METHOD(swoole_mysql, execute)
+{
+	zval *callback, *params;
+	char *sql;
+	int sql_len;
+	swMySQL_pool *pool;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "saz", &sql, &sql_len, &params, &callback) == FAILURE)
+	{
+		return;
+	}
+	SWOOLE_GET_MYSQL(getThis(), pool);
+
+	if (php_swoole_mysql_query(getThis(), pool, sql, sql_len, params, callback TSRMLS_CC) < 0)
+	{
+		RETURN_FALSE;
+	}
+	php_swoole_try_run_reactor();
+	RETURN_TRUE;
+}
+
+/**
+ * 关闭所有连接, 未完成的查询不再回调
+ */
+PHP_METHOD(swoole_mysql, close)
+{
+	swMySQL_pool *pool;
+	SWOOLE_GET_MYSQL(getThis(), pool);
+
+	zend_hash_del(Z_OBJPROP_P(getThis()), SW_STRL("_mysql"));
+	RETURN_TRUE;
+}
@@ -0,0 +1,287 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_swoole.h"
+#include "redis.h"
+
+typedef struct
+{
+	swRedis_command command;
+	swRedis_pool *pool;
+	zval *object;
+	zval *callback;
+} php_swoole_redis_command;
+
+static void php_swoole_redis_onReply(swRedis_command *command, swRedis_reply *reply);
+
+#define SWOOLE_GET_REDIS(zobject, pool) zval **zpool;\
+	if (zend_hash_find(Z_OBJPROP_P(zobject), SW_STRL("_redis"), (void **) &zpool) == FAILURE){ \
+	zend_error(E_WARNING, "swoole_redis: redis connection is closed.");\
+	RETURN_FALSE;}\
+	ZEND_FETCH_RESOURCE(pool, swRedis_pool*, zpool, -1, SW_RES_REDIS_NAME, le_swoole_redis);
+
+void swoole_destory_redis(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	swRedis_pool *pool = (swRedis_pool *) rsrc->ptr;
+	swRedis_pool_free(pool);
+}
+
+static void php_swoole_redis_command_free(php_swoole_redis_command *req)
+{
+	int i;
+
+	for (i = 0; i < req->command.argc; i++)
+	{
+		efree(req->command.argv[i]);
+	}
+	if (req->command.argv)
+	{
+		efree(req->command.argv);
+		efree(req->command.argv_len);
+	}
+	zval_ptr_dtor(&req->callback);
+	zval_ptr_dtor(&req->object);
+	efree(req);
+}
+
+/**
+ * 状态和字符串为string, 整数为int, nil为null, 数组中的错误为false
+ */
+static zval* php_swoole_redis_reply_zval(swRedis_reply *reply TSRMLS_DC)
+{
+	zval *zreply;
+	uint32_t i;
+
+	MAKE_STD_ZVAL(zreply);
+	switch (reply->type)
+	{
+	case SW_REDIS_REPLY_STATUS:
+	case SW_REDIS_REPLY_STRING:
+		ZVAL_STRINGL(zreply, reply->str, reply->len, 1);
+		break;
+	case SW_REDIS_REPLY_INTEGER:
+		ZVAL_LONG(zreply, (long) reply->integer);
+		break;
+	case SW_REDIS_REPLY_ARRAY:
+		array_init(zreply);
+		for (i = 0; i < reply->element_num; i++)
+		{
+			add_next_index_zval(zreply, php_swoole_redis_reply_zval(&reply->elements[i] TSRMLS_CC));
+		}
+		break;
+	case SW_REDIS_REPLY_ERROR:
+		ZVAL_FALSE(zreply);
+		break;
+	default:
+		ZVAL_NULL(zreply);
+		break;
+	}
+	return zreply;
+}
+
+/**
+ * 回调参数为swoole_redis对象和结果, 错误回复或连接出错时为false, 错误信息在$redis->error
+ */
+static void php_swoole_redis_onReply(swRedis_command *command, swRedis_reply *reply)
+{
+	php_swoole_redis_command *req = command->object;
+	zval *zobject = req->object;
+	zval *zresult, *retval = NULL;
+	zval **args[2];
+
+	TSRMLS_FETCH_FROM_CTX(sw_thread_ctx ? sw_thread_ctx : NULL);
+
+	//close()或者请求结束时释放连接池, 不再回调
+	if (req->pool->destroy)
+	{
+		php_swoole_redis_command_free(req);
+		return;
+	}
+
+	if (reply == NULL)
+	{
+		zend_update_property_string(swoole_redis_class_entry_ptr, zobject, ZEND_STRL("error"), req->pool->error TSRMLS_CC);
+		MAKE_STD_ZVAL(zresult);
+		ZVAL_FALSE(zresult);
+	}
+	else if (reply->type == SW_REDIS_REPLY_ERROR)
+	{
+		zend_update_property_stringl(swoole_redis_class_entry_ptr, zobject, ZEND_STRL("error"), reply->str, reply->len TSRMLS_CC);
+		MAKE_STD_ZVAL(zresult);
+		ZVAL_FALSE(zresult);
+	}
+	else
+	{
+		zend_update_property_string(swoole_redis_class_entry_ptr, zobject, ZEND_STRL("error"), "" TSRMLS_CC);
+		zresult = php_swoole_redis_reply_zval(reply TSRMLS_CC);
+	}
+
+	args[0] = &zobject;
+	args[1] = &zresult;
+	if (call_user_function_ex(EG(function_table), NULL, req->callback, &retval, 2, args, 0, NULL TSRMLS_CC) == FAILURE)
+	{
+		zend_error(E_WARNING, "swoole_redis: onReply handler error");
+	}
+	if (retval != NULL)
+	{
+		zval_ptr_dtor(&retval);
+	}
+	zval_ptr_dtor(&zresult);
+	php_swoole_redis_command_free(req);
+}
+
+PHP_METHOD(swoole_redis, __construct)
+{
+	zval *zconfig, **ztmp, *zres;
+	char *host = "127.0.0.1", *password = "";
+	long port = SW_REDIS_DEFAULT_PORT;
+	long database = 0;
+	long pool_size = SW_REDIS_POOL_SIZE;
+	swRedis_pool *pool;
+	HashTable *vht;
+
+#ifdef ZTS
+	if (sw_thread_ctx == NULL)
+	{
+		TSRMLS_SET_CTX(sw_thread_ctx);
+	}
+#endif
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zconfig) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	vht = Z_ARRVAL_P(zconfig);
+	if (zend_hash_find(vht, ZEND_STRS("host"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_string(*ztmp);
+		host = Z_STRVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("port"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_long(*ztmp);
+		port = Z_LVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("password"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_string(*ztmp);
+		password = Z_STRVAL_PP(ztmp);
+	}
+	if (zend_hash_find(vht, ZEND_STRS("database"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_long(*ztmp);
+		database = Z_LVAL_PP(ztmp);
+	}
+	//每个worker进程中的连接数量
+	if (zend_hash_find(vht, ZEND_STRS("pool_size"), (void **) &ztmp) == SUCCESS)
+	{
+		convert_to_long(*ztmp);
+		pool_size = Z_LVAL_PP(ztmp);
+	}
+
+	php_swoole_check_reactor();
+	pool = swRedis_pool_new(SwooleG.main_reactor, host, port, password, database, pool_size);
+	if (pool == NULL)
+	{
+		zend_error(E_WARNING, "swoole_redis: create connection pool failed.");
+		RETURN_FALSE;
+	}
+
+	MAKE_STD_ZVAL(zres);
+	ZEND_REGISTER_RESOURCE(zres, pool, le_swoole_redis);
+	zend_update_property(swoole_redis_class_entry_ptr, getThis(), ZEND_STRL("_redis"), zres TSRMLS_CC);
+	zval_ptr_dtor(&zres);
+	RETURN_TRUE;
+}
+
+/**
+ * $redis->command(array('SET', 'key', 'value'), function($redis, $result) {})
+ * 同一轮事件中发起的命令合并发送, 不等待前一个命令的回复
+ */
+PHP_METHOD(swoole_redis, command)
+{
+	zval *zargv, *callback, **zarg, *zvalue;
+	php_swoole_redis_command *req;
+	swRedis_pool *pool;
+	char *func_name = NULL;
+	int argc, i = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "az", &zargv, &callback) == FAILURE)
+	{
+		return;
+	}
+	SWOOLE_GET_REDIS(getThis(), pool);
+
+	argc = zend_hash_num_elements(Z_ARRVAL_P(zargv));
+	if (argc == 0)
+	{
+		zend_error(E_WARNING, "swoole_redis: command is empty.");
+		RETURN_FALSE;
+	}
+	if (!zend_is_callable(callback, 0, &func_name TSRMLS_CC))
+	{
+		zend_error(E_WARNING, "swoole_redis: function '%s' is not callable", func_name);
+		efree(func_name);
+		RETURN_FALSE;
+	}
+	efree(func_name);
+
+	req = emalloc(sizeof(php_swoole_redis_command));
+	bzero(req, sizeof(php_swoole_redis_command));
+	req->command.argv = ecalloc(argc, sizeof(char *));
+	req->command.argv_len = ecalloc(argc, sizeof(uint32_t));
+	for (zend_hash_internal_pointer_reset(Z_ARRVAL_P(zargv));
+			zend_hash_get_current_data(Z_ARRVAL_P(zargv), (void **) &zarg) == SUCCESS && i < argc;
+			zend_hash_move_forward(Z_ARRVAL_P(zargv)), i++)
+	{
+		ALLOC_ZVAL(zvalue);
+		MAKE_COPY_ZVAL(zarg, zvalue);
+		convert_to_string(zvalue);
+		req->command.argv[i] = estrndup(Z_STRVAL_P(zvalue), Z_STRLEN_P(zvalue));
+		req->command.argv_len[i] = Z_STRLEN_P(zvalue);
+		zval_ptr_dtor(&zvalue);
+	}
+	req->command.argc = i;
+	req->command.onReply = php_swoole_redis_onReply;
+	req->command.object = req;
+	req->pool = pool;
+
+	req->object = getThis();
+	req->callback = callback;
+	zval_add_ref(&req->object);
+	zval_add_ref(&req->callback);
+
+	if (swRedis_pool_command(pool, &req->command) < 0)
+	{
+		zend_update_property_string(swoole_redis_class_entry_ptr, getThis(), ZEND_STRL("error"), pool->error TSRMLS_CC);
+		php_swoole_redis_command_free(req);
+		RETURN_FALSE;
+	}
+	php_swoole_try_run_reactor();
+	RETURN_TRUE;
+}
+
+/**
+ * 关闭所有连接, 未完成的命令不再回调
+ */
+PHP_METHOD(swoole_redis, close)
+{
+	swRedis_pool *pool;
+	SWOOLE_GET_REDIS(getThis(), pool);
+
+	zend_hash_del(Z_OBJPROP_P(getThis()), SW_STRL("_redis"));
+	RETURN_TRUE;
+}
@@ -0,0 +1,326 @@
+/*
+  +----------------------------------------------------------------------+
+  | Swoole                                                               |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.0 of the Apache license,    |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.apache.org/licenses/LICENSE-2.0.html                      |
+  | If you did not receive a copy of the Apache2.0 license and are unable|
+  | to obtain it through the world-wide-web, please send a note to       |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Tianfeng Han  <mikan.tenny@gmail.com>                        |
+  +----------------------------------------------------------------------+
+*/
+
+
+#include "php_swoole.h"
+#include "table.h"
+
+static swTable* php_swoole_table_get(zval *object TSRMLS_DC)
+{
+	zval **zres;
+	swTable *table = NULL;
+
+	if (zend_hash_find(Z_OBJPROP_P(object), SW_STRL("_table"), (void **) &zres) == SUCCESS)
+	{
+		table = (swTable *) zend_fetch_resource(zres TSRMLS_CC, -1, SW_RES_TABLE_NAME, NULL, 1, le_swoole_table);
+	}
+	return table;
+}
+
+static void php_swoole_table_row2array(swTable *table, swTableRow *row, zval *return_value)
+{
+	swTableColumn *col;
+	char *data;
+	uint16_t len;
+	double dval;
+	int i;
+
+	array_init(return_value);
+	for (i = 0; i < table->column_num; i++)
+	{
+		col = &table->columns[i];
+		data = swTableColumn_data(row, col);
+		switch (col->type)
+		{
+		case SW_TABLE_INT:
+			add_assoc_long_ex(return_value, col->name, col->name_len + 1, (long) swTableRow_get_int(row, col));
+			break;
+		case SW_TABLE_FLOAT:
+			memcpy(&dval, data, sizeof(dval));
+			add_assoc_double_ex(return_value, col->name, col->name_len + 1, dval);
+			break;
+		default:
+			memcpy(&len, data, sizeof(len));
+			add_assoc_stringl_ex(return_value, col->name, col->name_len + 1, data + sizeof(len), len, 1);
+			break;
+		}
+	}
+}
+
+void swoole_destory_table(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	//共享内存由所有进程共用, 只解除当前进程的映射
+	swTable *table = (swTable *) rsrc->ptr;
+	swTable_free(table);
+}
+
+PHP_METHOD(swoole_table, __construct)
+{
+	long table_size;
+	swTable *table;
+	zval *zres;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &table_size) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	if (table_size <= 0)
+	{
+		zend_error(E_WARNING, "swoole_table: table size[%ld] is invalid.", table_size);
+		RETURN_FALSE;
+	}
+	table = swTable_new(table_size);
+	if (table == NULL)
+	{
+		zend_error(E_WARNING, "swoole_table: alloc fail.");
+		RETURN_FALSE;
+	}
+	MAKE_STD_ZVAL(zres);
+	ZEND_REGISTER_RESOURCE(zres, table, le_swoole_table);
+	zend_update_property(swoole_table_class_entry_ptr, getThis(), ZEND_STRL("_table"), zres TSRMLS_CC);
+	zval_ptr_dtor(&zres);
+	RETURN_TRUE;
+}
+
+PHP_METHOD(swoole_table, column)
+{
+	char *name;
+	int name_len;
+	long type;
+	long size = 0;
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL)
+	{
+		RETURN_FALSE;
+	}
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sl|l", &name, &name_len, &type, &size) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	SW_CHECK_RETURN(swTable_column_add(table, name, name_len, type, size));
+}
+
+/**
+ * 必须在swoole_server->start之前调用, 子进程继承同一块共享内存
+ */
+PHP_METHOD(swoole_table, create)
+{
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL)
+	{
+		RETURN_FALSE;
+	}
+	SW_CHECK_RETURN(swTable_create(table));
+}
+
+PHP_METHOD(swoole_table, set)
+{
+	zval *array, **element, tmp;
+	char *key, *name;
+	int key_len;
+	uint name_len;
+	ulong num_key;
+	swTableRow *row, *lock_row;
+	swTableColumn *col;
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL || table->rows == NULL)
+	{
+		zend_error(E_WARNING, "swoole_table: table is not created.");
+		RETURN_FALSE;
+	}
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sa", &key, &key_len, &array) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	row = swTableRow_set(table, key, key_len, &lock_row);
+	if (row == NULL)
+	{
+		RETURN_FALSE;
+	}
+	for (zend_hash_internal_pointer_reset(Z_ARRVAL_P(array));
+			zend_hash_get_current_data(Z_ARRVAL_P(array), (void **) &element) == SUCCESS;
+			zend_hash_move_forward(Z_ARRVAL_P(array)))
+	{
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_P(array), &name, &name_len, &num_key, 0, NULL) != HASH_KEY_IS_STRING)
+		{
+			continue;
+		}
+		col = swTable_column_find(table, name, name_len - 1);
+		if (col == NULL)
+		{
+			continue;
+		}
+		//不修改调用者的数组
+		tmp = **element;
+		zval_copy_ctor(&tmp);
+		if (col->type == SW_TABLE_INT)
+		{
+			convert_to_long(&tmp);
+			swTableRow_set_int(row, col, Z_LVAL(tmp));
+		}
+		else if (col->type == SW_TABLE_FLOAT)
+		{
+			convert_to_double(&tmp);
+			swTableRow_set_value(row, col, &Z_DVAL(tmp), sizeof(double));
+		}
+		else
+		{
+			convert_to_string(&tmp);
+			swTableRow_set_value(row, col, Z_STRVAL(tmp), Z_STRLEN(tmp));
+		}
+		zval_dtor(&tmp);
+	}
+	swTableRow_unlock(lock_row);
+	RETURN_TRUE;
+}
+
+PHP_METHOD(swoole_table, get)
+{
+	char *key;
+	int key_len;
+	swTableRow *row, *lock_row;
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL || table->rows == NULL)
+	{
+		RETURN_FALSE;
+	}
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &key, &key_len) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	row = swTableRow_get(table, key, key_len, &lock_row);
+	if (row == NULL)
+	{
+		RETURN_FALSE;
+	}
+	php_swoole_table_row2array(table, row, return_value);
+	swTableRow_unlock(lock_row);
+}
+
+PHP_METHOD(swoole_table, exist)
+{
+	char *key;
+	int key_len;
+	swTableRow *row, *lock_row;
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL || table->rows == NULL)
+	{
+		RETURN_FALSE;
+	}
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &key, &key_len) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	row = swTableRow_get(table, key, key_len, &lock_row);
+	if (row == NULL)
+	{
+		RETURN_FALSE;
+	}
+	swTableRow_unlock(lock_row);
+	RETURN_TRUE;
+}
+
+PHP_METHOD(swoole_table, del)
+{
+	char *key;
+	int key_len;
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL || table->rows == NULL)
+	{
+		RETURN_FALSE;
+	}
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &key, &key_len) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	SW_CHECK_RETURN(swTableRow_del(table, key, key_len));
+}
+
+/**
+ * 在行锁内完成加法, 不存在的key会先创建, 返回新的值
+ */
+static void php_swoole_table_incr(INTERNAL_FUNCTION_PARAMETERS, int sign)
+{
+	char *key, *name;
+	int key_len, name_len;
+	long incrby = 1;
+	int64_t value;
+	double dval;
+	swTableRow *row, *lock_row;
+	swTableColumn *col;
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL || table->rows == NULL)
+	{
+		RETURN_FALSE;
+	}
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ss|l", &key, &key_len, &name, &name_len, &incrby) == FAILURE)
+	{
+		RETURN_FALSE;
+	}
+	col = swTable_column_find(table, name, name_len);
+	if (col == NULL || col->type == SW_TABLE_STRING)
+	{
+		zend_error(E_WARNING, "swoole_table: column[%s] is not exists or not a number.", name);
+		RETURN_FALSE;
+	}
+	row = swTableRow_set(table, key, key_len, &lock_row);
+	if (row == NULL)
+	{
+		RETURN_FALSE;
+	}
+	if (col->type == SW_TABLE_INT)
+	{
+		value = swTableRow_get_int(row, col) + sign * incrby;
+		swTableRow_set_int(row, col, value);
+		//按列的宽度截断后的值
+		value = swTableRow_get_int(row, col);
+		swTableRow_unlock(lock_row);
+		RETURN_LONG((long) value);
+	}
+	memcpy(&dval, swTableColumn_data(row, col), sizeof(dval));
+	dval += sign * incrby;
+	swTableRow_set_value(row, col, &dval, sizeof(dval));
+	swTableRow_unlock(lock_row);
+	RETURN_DOUBLE(dval);
+}
+
+PHP_METHOD(swoole_table, incr)
+{
+	php_swoole_table_incr(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
+}
+
+PHP_METHOD(swoole_table, decr)
+{
+	php_swoole_table_incr(INTERNAL_FUNCTION_PARAM_PASSTHRU, -1);
+}
+
+PHP_METHOD(swoole_table, count)
+{
+	swTable *table = php_swoole_table_get(getThis() TSRMLS_CC);
+
+	if (table == NULL)
+	{
+		RETURN_FALSE;
+	}
+	RETURN_LONG((long) table->row_num);
+}
@@ -4,6 +4,10 @@
 #include "uthash.h"
 #include "rbtree.h"
 #include <netinet/tcp.h>
+#include "table.h"
+#include "coroutine.h"
+#include "redis.h"
+#include "websocket.h"
 #include "tests.h"
 
 
@@ -60,6 +64,55 @@ swUnitTest(hashmap_test1)
 	return 0;
 }
 
+swUnitTest(hashmap_test2)
+{
+	swHashMap_int hm = NULL;
+	static void *expect[4096];
+	uint64_t key;
+	void *data, *tmp = NULL;
+	int i, n = 0, ok = 1;
+
+	//随机插入删除, 和数组对比
+	srand(1234);
+	for (i = 0; i < 200000; i++)
+	{
+		key = rand() % 4096;
+		if (rand() % 3 == 0)
+		{
+			swHashMap_del_int(&hm, key);
+			expect[key] = NULL;
+		}
+		else
+		{
+			swHashMap_add_int(&hm, key, (void *) (long) (i + 1));
+			expect[key] = (void *) (long) (i + 1);
+		}
+	}
+	for (i = 0; i < 4096; i++)
+	{
+		if (swHashMap_find_int(&hm, i) != expect[i])
+		{
+			ok = 0;
+		}
+		n += (expect[i] != NULL);
+	}
+	ok = ok && hm->num == n;
+	n = 0;
+	do
+	{
+		tmp = swHashMap_foreach_int(&hm, &key, &data, tmp);
+		if (data != NULL)
+		{
+			n++;
+			ok = ok && expect[key] == data;
+		}
+	} while (tmp != NULL);
+	printf("HashMap_int: num=%d|size=%d|foreach=%d|ok=%d\n", hm->num, hm->size, n, ok);
+	ok = ok && hm->num == n;
+	swHashMap_free_int(&hm);
+	return ok ? SW_OK : SW_ERR;
+}
+
 #define BUFSIZE 128
 char data[BUFSIZE];
 
@@ -182,3 +235,892 @@ swUnitTest(rbtree_test)
 	printf("find_n %d\n", (int) swRbtree_find(tree, 17532));
 	return 0;
 }
+
+swUnitTest(ringbuffer_test)
+{
+	int i, n, len, ret;
+	int num = (object->argc > 2) ? atoi(object->argv[2]) : 100000;
+	char item[BUFSIZE];
+	char *ptr;
+
+	swRingBuffer *rb = swRingBuffer_create(1024 * 64, 1);
+	if (rb == NULL)
+	{
+		err_exit("swRingBuffer_create");
+	}
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		err_exit("fork");
+	}
+	//consumer
+	else if (pid == 0)
+	{
+		for (i = 0; i < num;)
+		{
+			ptr = swRingBuffer_front(rb, &len);
+			if (ptr == NULL)
+			{
+				swYield();
+				continue;
+			}
+			n = sprintf(item, "item-%d", i);
+			if (len != n || memcmp(ptr, item, n) != 0)
+			{
+				printf("RingBuffer error: expect=%s|len=%d\n", item, len);
+				exit(1);
+			}
+			swRingBuffer_pop(rb);
+			i++;
+		}
+		exit(0);
+	}
+	//producer
+	for (i = 0; i < num;)
+	{
+		//变长记录,测试尾部回绕
+		n = sprintf(item, "item-%d", i);
+		if (swRingBuffer_push(rb, item, n) < 0)
+		{
+			swYield();
+			continue;
+		}
+		i++;
+	}
+	waitpid(pid, &ret, 0);
+	printf("RingBuffer: push/pop %d items, consumer exit=%d\n", num, WEXITSTATUS(ret));
+	swRingBuffer_free(rb);
+	return 0;
+}
+
+swUnitTest(recv_ring_test)
+{
+	int i, offsets[5], ret;
+	pid_t pid;
+
+	swRecvRing *ring = swRecvRing_create(4096);
+	if (ring == NULL)
+	{
+		err_exit("swRecvRing_create");
+	}
+	//每块1000字节加头部对齐后为1016字节, 正好放下4块
+	for (i = 0; i < 4; i++)
+	{
+		offsets[i] = swRecvRing_alloc(ring, 1000);
+		if (offsets[i] < 0)
+		{
+			printf("RecvRing: alloc[%d] failed\n", i);
+			return 1;
+		}
+		memset(swRecvRing_data(ring, offsets[i]), 'a' + i, 1000);
+	}
+	if (swRecvRing_alloc(ring, 1000) >= 0)
+	{
+		printf("RecvRing: ring should be full\n");
+		return 1;
+	}
+	//乱序释放, 最早的块没有释放时不能回收
+	swRecvRing_release(ring, offsets[1]);
+	if (swRecvRing_alloc(ring, 1000) >= 0)
+	{
+		printf("RecvRing: block[1] reused before block[0]\n");
+		return 1;
+	}
+	//在其他进程中释放
+	pid = fork();
+	if (pid < 0)
+	{
+		err_exit("fork");
+	}
+	else if (pid == 0)
+	{
+		exit(swRecvRing_data(ring, offsets[0])[999] == 'a' ? 0 : 1);
+	}
+	waitpid(pid, &ret, 0);
+	pid = fork();
+	if (pid == 0)
+	{
+		swRecvRing_release(ring, offsets[0]);
+		exit(0);
+	}
+	waitpid(pid, &ret, 0);
+	//尾部剩余32字节, 填充后从头分配
+	offsets[4] = swRecvRing_alloc(ring, 1000);
+	if (offsets[4] != offsets[0] || swRecvRing_data(ring, offsets[2])[0] != 'c')
+	{
+		printf("RecvRing: wrap failed, offset=%d\n", offsets[4]);
+		return 1;
+	}
+	swRecvRing_release(ring, offsets[2]);
+	swRecvRing_release(ring, offsets[3]);
+	swRecvRing_release(ring, offsets[4]);
+	//全部释放后可以分配整个环
+	if (swRecvRing_alloc(ring, 4000) != offsets[0])
+	{
+		printf("RecvRing: reset failed\n");
+		return 1;
+	}
+	printf("RecvRing: ok\n");
+	swRecvRing_free(ring);
+	return 0;
+}
+
+static int timer_test_count[3];
+static int timer_test_cancel_id;
+
+static void timer_test_callback(swTimer *timer, swTimer_node *node)
+{
+	int index = (int) (long) node->data;
+	timer_test_count[index]++;
+	//重复定时器执行5次后在回调中删除自己,同时删除还没到期的定时器
+	if (index == 1 && timer_test_count[index] == 5)
+	{
+		swTimer_clear(timer, node->id);
+		swTimer_clear(timer, timer_test_cancel_id);
+	}
+}
+
+swUnitTest(timer_test)
+{
+	swTimer timer;
+	uint64_t exp;
+	bzero(&timer, sizeof(timer));
+	if (swTimer_create(&timer, 10) < 0)
+	{
+		err_exit("swTimer_create");
+	}
+	swTimer_set(&timer, 10, 0, (void *) 0, timer_test_callback);
+	swTimer_set(&timer, 20, 1, (void *) 1, timer_test_callback);
+	timer_test_cancel_id = swTimer_set(&timer, 500, 0, (void *) 2, timer_test_callback);
+
+	while (timer.num > 0)
+	{
+		struct pollfd event = { timer.fd, POLLIN, 0 };
+		if (poll(&event, 1, 1000) <= 0)
+		{
+			printf("Timer: timeout, num=%d\n", timer.num);
+			break;
+		}
+		read(timer.fd, &exp, sizeof(exp));
+		swTimer_select(&timer);
+	}
+	printf("Timer: once=%d|repeat=%d|canceled=%d\n", timer_test_count[0], timer_test_count[1], timer_test_count[2]);
+	swTimer_free(&timer);
+	return 0;
+}
+
+#define MPMC_TEST_THREADS  4
+#define MPMC_TEST_N        200000
+
+static swMPMCQueue mpmc_test_queue;
+static uint64_t mpmc_test_sum[MPMC_TEST_THREADS];
+static uint32_t mpmc_test_done;
+
+static void* mpmc_test_producer(void *arg)
+{
+	long i;
+	for (i = 1; i <= MPMC_TEST_N; i++)
+	{
+		while (swMPMCQueue_push(&mpmc_test_queue, (void *) i) < 0)
+		{
+			swYield();
+		}
+	}
+	return NULL;
+}
+
+static void* mpmc_test_consumer(void *arg)
+{
+	long id = (long) arg;
+	void *data;
+	while (1)
+	{
+		if (swMPMCQueue_wait(&mpmc_test_queue, &data, 100) == SW_OK)
+		{
+			mpmc_test_sum[id] += (long) data;
+		}
+		else if (mpmc_test_done)
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+swUnitTest(mpmc_test)
+{
+	pthread_t producers[MPMC_TEST_THREADS], consumers[MPMC_TEST_THREADS];
+	uint64_t sum = 0, expect = (uint64_t) MPMC_TEST_N * (MPMC_TEST_N + 1) / 2 * MPMC_TEST_THREADS;
+	long i;
+
+	if (swMPMCQueue_create(&mpmc_test_queue, 1024) < 0)
+	{
+		return SW_ERR;
+	}
+	for (i = 0; i < MPMC_TEST_THREADS; i++)
+	{
+		pthread_create(&consumers[i], NULL, mpmc_test_consumer, (void *) i);
+		pthread_create(&producers[i], NULL, mpmc_test_producer, NULL);
+	}
+	for (i = 0; i < MPMC_TEST_THREADS; i++)
+	{
+		pthread_join(producers[i], NULL);
+	}
+	mpmc_test_done = 1;
+	swMPMCQueue_wake_all(&mpmc_test_queue);
+	for (i = 0; i < MPMC_TEST_THREADS; i++)
+	{
+		pthread_join(consumers[i], NULL);
+		sum += mpmc_test_sum[i];
+	}
+	swMPMCQueue_free(&mpmc_test_queue);
+	printf("MPMCQueue: sum=%lu|expect=%lu\n", sum, expect);
+	return sum == expect ? SW_OK : SW_ERR;
+}
+
+swUnitTest(table_test)
+{
+	swTable *table = swTable_new(256);
+	swTableRow *row, *lock_row;
+	swTableColumn *col_id, *col_name;
+	char key[16];
+	int i, n, ok = 1;
+	int64_t value;
+	pid_t pid;
+
+	if (table == NULL)
+	{
+		return SW_ERR;
+	}
+	swTable_column_add(table, "id", 2, SW_TABLE_INT, 4);
+	swTable_column_add(table, "name", 4, SW_TABLE_STRING, 16);
+	if (swTable_create(table) < 0)
+	{
+		return SW_ERR;
+	}
+	col_id = swTable_column_find(table, "id", 2);
+	col_name = swTable_column_find(table, "name", 4);
+
+	//子进程写入, 哈希冲突的key进入冲突链表
+	pid = fork();
+	if (pid == 0)
+	{
+		for (i = 0; i < 150; i++)
+		{
+			n = sprintf(key, "key_%d", i);
+			row = swTableRow_set(table, key, n, &lock_row);
+			if (row != NULL)
+			{
+				value = i;
+				swTableRow_set_value(row, col_id, &value, 0);
+				swTableRow_set_value(row, col_name, key, n);
+				swTableRow_unlock(lock_row);
+			}
+		}
+		_exit(0);
+	}
+	waitpid(pid, NULL, 0);
+
+	for (i = 0; i < 150; i += 2)
+	{
+		n = sprintf(key, "key_%d", i);
+		swTableRow_del(table, key, n);
+	}
+	for (i = 0; i < 150; i++)
+	{
+		n = sprintf(key, "key_%d", i);
+		row = swTableRow_get(table, key, n, &lock_row);
+		if ((i % 2 == 0) != (row == NULL))
+		{
+			ok = 0;
+		}
+		if (row != NULL)
+		{
+			if (swTableRow_get_int(row, col_id) != i || memcmp(swTableColumn_data(row, col_name) + sizeof(uint16_t), key, n) != 0)
+			{
+				ok = 0;
+			}
+			swTableRow_unlock(lock_row);
+		}
+	}
+	printf("Table: row_num=%d|ok=%d\n", (int) table->row_num, ok);
+	ok = ok && table->row_num == 75;
+	swTable_free(table);
+	return ok ? SW_OK : SW_ERR;
+}
+
+swUnitTest(futexlock_test)
+{
+	struct
+	{
+		swLock lock;
+		long count;
+	} *shared;
+	int i, j, ok;
+	pid_t pid[4];
+
+	shared = sw_shm_calloc(1, sizeof(*shared));
+	if (shared == NULL || swFutexLock_create(&shared->lock, 1) < 0)
+	{
+		return SW_ERR;
+	}
+	//多个进程竞争同一个锁
+	for (i = 0; i < 4; i++)
+	{
+		pid[i] = fork();
+		if (pid[i] == 0)
+		{
+			for (j = 0; j < 100000; j++)
+			{
+				shared->lock.lock(&shared->lock);
+				shared->count++;
+				shared->lock.unlock(&shared->lock);
+			}
+			_exit(0);
+		}
+	}
+	for (i = 0; i < 4; i++)
+	{
+		waitpid(pid[i], NULL, 0);
+	}
+	ok = shared->count == 400000 && shared->lock.trylock(&shared->lock) == 0 && shared->lock.trylock(&shared->lock) != 0;
+	shared->lock.unlock(&shared->lock);
+	printf("FutexLock: count=%ld|ok=%d\n", shared->count, ok);
+	shared->lock.free(&shared->lock);
+	sw_shm_free(shared);
+	return ok ? SW_OK : SW_ERR;
+}
+
+swUnitTest(brlock_test)
+{
+	struct
+	{
+		swLock rwlock;
+		swSeqLock seqlock;
+		long a, b;
+		long record[4];
+		int bad;
+	} *shared;
+	int i, j;
+	long record[4];
+	pid_t pid[4];
+
+	shared = sw_shm_calloc(1, sizeof(*shared));
+	if (shared == NULL || swBRLock_create(&shared->rwlock, 1) < 0)
+	{
+		return SW_ERR;
+	}
+	//一个进程写, 其他进程读, 读到的a和b必须相等
+	for (i = 0; i < 4; i++)
+	{
+		pid[i] = fork();
+		if (pid[i] == 0)
+		{
+			for (j = 0; j < 20000; j++)
+			{
+				if (i == 0)
+				{
+					shared->rwlock.lock(&shared->rwlock);
+					shared->a++;
+					shared->b++;
+					shared->rwlock.unlock(&shared->rwlock);
+
+					record[0] = record[1] = record[2] = record[3] = j;
+					swSeqLock_write(&shared->seqlock, shared->record, record, sizeof(record));
+				}
+				else
+				{
+					shared->rwlock.lock_rd(&shared->rwlock);
+					if (shared->a != shared->b)
+					{
+						sw_atomic_fetch_add(&shared->bad, 1);
+					}
+					shared->rwlock.unlock(&shared->rwlock);
+
+					swSeqLock_read(&shared->seqlock, record, shared->record, sizeof(record));
+					if (record[0] != record[3])
+					{
+						sw_atomic_fetch_add(&shared->bad, 1);
+					}
+				}
+			}
+			_exit(0);
+		}
+	}
+	for (i = 0; i < 4; i++)
+	{
+		waitpid(pid[i], NULL, 0);
+	}
+	j = shared->rwlock.trylock(&shared->rwlock) == 0 && shared->rwlock.trylock_rd(&shared->rwlock) != 0;
+	shared->rwlock.unlock(&shared->rwlock);
+	j = j && shared->a == 20000 && shared->bad == 0 && shared->record[0] == 19999 && shared->seqlock.seq == 40000;
+	printf("BRLock: a=%ld|bad=%d|seq=%ld|ok=%d\n", shared->a, shared->bad, (long) shared->seqlock.seq, j);
+	shared->rwlock.free(&shared->rwlock);
+	sw_shm_free(shared);
+	return j ? SW_OK : SW_ERR;
+}
+
+swUnitTest(ready_test)
+{
+	swReady *ready;
+	int i, ok;
+	pid_t pid[4];
+
+	ready = sw_shm_calloc(1, sizeof(swReady));
+	if (ready == NULL)
+	{
+		return SW_ERR;
+	}
+	swReady_init(ready, 1);
+	//没有人done, 必须超时
+	swReady_add(ready, 4);
+	ok = swReady_wait(ready, 10) < 0;
+	for (i = 0; i < 4; i++)
+	{
+		pid[i] = fork();
+		if (pid[i] == 0)
+		{
+			usleep(10000 * i);
+			swReady_done(ready);
+			_exit(0);
+		}
+	}
+	ok = ok && swReady_wait(ready, 3000) == 0 && ready->count == 0;
+	for (i = 0; i < 4; i++)
+	{
+		waitpid(pid[i], NULL, 0);
+	}
+	printf("Ready: count=%d|ok=%d\n", ready->count, ok);
+	sw_shm_free(ready);
+	return ok ? SW_OK : SW_ERR;
+}
+
+#define MPSC_TEST_THREADS   4
+#define MPSC_TEST_NUM       100000
+
+static swMPSCChannel *mpsc_test_chan;
+static uint32_t mpsc_test_next[MPSC_TEST_THREADS];
+static int mpsc_test_error;
+
+static void* mpsc_test_producer(void *arg)
+{
+	uint32_t record[32];
+	long id = (long) arg;
+	uint32_t i, n;
+
+	for (i = 0; i < MPSC_TEST_NUM; i++)
+	{
+		//变长记录: id, 序号, 填充
+		n = 2 + i % 30;
+		record[0] = id;
+		record[1] = i;
+		record[n - 1] = i;
+		while (swMPSCChannel_push(mpsc_test_chan, record, n * sizeof(uint32_t)) < 0)
+		{
+			swYield();
+		}
+	}
+	return NULL;
+}
+
+static void mpsc_test_handler(swMPSCChannel *object, void *data, uint32_t length, void *arg)
+{
+	uint32_t *record = data;
+	uint32_t n = length / sizeof(uint32_t);
+
+	//同一个生产者的记录必须按顺序到达
+	if (record[1] != mpsc_test_next[record[0]] || n != 2 + record[1] % 30 || record[n - 1] != record[1])
+	{
+		mpsc_test_error++;
+	}
+	mpsc_test_next[record[0]]++;
+}
+
+swUnitTest(mpsc_test)
+{
+	pthread_t producers[MPSC_TEST_THREADS];
+	long i, total = 0, wakeup = 0;
+
+	mpsc_test_chan = swMPSCChannel_create(64 * 1024, SW_CHAN_NOTIFY);
+	if (mpsc_test_chan == NULL)
+	{
+		return SW_ERR;
+	}
+	for (i = 0; i < MPSC_TEST_THREADS; i++)
+	{
+		pthread_create(&producers[i], NULL, mpsc_test_producer, (void *) i);
+	}
+	while (total < MPSC_TEST_THREADS * MPSC_TEST_NUM)
+	{
+		total += swMPSCChannel_pop_batch(mpsc_test_chan, mpsc_test_handler, NULL, 64);
+		if (swMPSCChannel_empty(mpsc_test_chan) && total < MPSC_TEST_THREADS * MPSC_TEST_NUM)
+		{
+			swMPSCChannel_wait(mpsc_test_chan);
+			wakeup++;
+		}
+	}
+	for (i = 0; i < MPSC_TEST_THREADS; i++)
+	{
+		pthread_join(producers[i], NULL);
+	}
+	printf("MPSCChannel: total=%ld|wakeup=%ld|error=%d|empty=%d\n", total, wakeup, mpsc_test_error,
+			swMPSCChannel_empty(mpsc_test_chan));
+	swMPSCChannel_free(mpsc_test_chan);
+	return mpsc_test_error == 0 ? SW_OK : SW_ERR;
+}
+
+swUnitTest(histogram_test)
+{
+	swHistogram *h, merged;
+	uint32_t i;
+	uint64_t p50, p99;
+	int ok;
+
+	h = sw_shm_calloc(2, sizeof(swHistogram));
+	if (h == NULL)
+	{
+		return SW_ERR;
+	}
+	for (i = 1; i <= 1000; i++)
+	{
+		swHistogram_record(&h[i % 2], i);
+	}
+	bzero(&merged, sizeof(merged));
+	swHistogram_merge(&merged, &h[0]);
+	swHistogram_merge(&merged, &h[1]);
+	p50 = swHistogram_percentile(&merged, 50);
+	p99 = swHistogram_percentile(&merged, 99);
+	//每个桶的相对误差不超过1/SW_HISTOGRAM_SUB_BUCKETS
+	ok = merged.count == 1000 && merged.max == 1000 && merged.sum == 500500
+			&& p50 >= 500 && p50 <= 500 + 500 / SW_HISTOGRAM_SUB_BUCKETS
+			&& p99 >= 990 && p99 <= 1000 && swHistogram_percentile(&merged, 0) == 1;
+	swHistogram_record(&merged, UINT32_MAX);
+	ok = ok && swHistogram_percentile(&merged, 100) == UINT32_MAX;
+	printf("Histogram: p50=%lu|p99=%lu|ok=%d\n", (unsigned long) p50, (unsigned long) p99, ok);
+	sw_shm_free(h);
+	return ok ? SW_OK : SW_ERR;
+}
+
+static int slowlog_test_dumps;
+
+static void slowlog_test_busy(uint64_t usec)
+{
+	//信号会打断usleep, 用忙等
+	uint64_t start = swClock_usec();
+	while (swClock_usec() - start < usec);
+}
+
+static int slowlog_test_handle(swReactor *reactor, swEvent *event)
+{
+	slowlog_test_busy(event->fd);
+	return SW_OK;
+}
+
+static void slowlog_test_dump(const char *name, uint64_t usec)
+{
+	slowlog_test_dumps++;
+}
+
+swUnitTest(slowlog_test)
+{
+	swReactor reactor;
+	swEvent ev;
+	atomic_t reactor_count = 0, count = 0;
+	int ok;
+
+	bzero(&reactor, sizeof(reactor));
+	bzero(&ev, sizeof(ev));
+	reactor.slow_usec = 10000;
+	reactor.slow_count = &reactor_count;
+	ev.type = SW_FD_PIPE;
+
+	//快的回调不记录, 只有一轮事件的总时间超过阈值
+	swReactor_loop_begin(&reactor);
+	ev.fd = 6000;
+	swReactor_call(&reactor, SW_EVENT_READ, slowlog_test_handle, &ev);
+	swReactor_call(&reactor, SW_EVENT_READ, slowlog_test_handle, &ev);
+	ok = reactor_count == 0;
+	swReactor_loop_end(&reactor);
+	ok = ok && reactor_count == 1;
+	//慢回调记录一次, 同一轮不再记录loop
+	swReactor_loop_begin(&reactor);
+	ev.fd = 15000;
+	swReactor_call(&reactor, SW_EVENT_READ, slowlog_test_handle, &ev);
+	swReactor_loop_end(&reactor);
+	ok = ok && reactor_count == 2;
+
+	SwooleG.running = 1;
+	if (swSlowlog_init(20000, slowlog_test_dump, &count) < 0)
+	{
+		return SW_ERR;
+	}
+	swSlowlog_enter("fast");
+	slowlog_test_busy(1000);
+	swSlowlog_leave();
+	//嵌套的回调算在最外层, 只记录一次
+	swSlowlog_enter("slow");
+	swSlowlog_enter("inner");
+	slowlog_test_busy(100000);
+	swSlowlog_leave();
+	swSlowlog_leave();
+	ok = ok && count == 1 && slowlog_test_dumps == 1;
+	printf("Slowlog: reactor=%ld|count=%ld|dumps=%d|ok=%d\n", (long) reactor_count, (long) count, slowlog_test_dumps, ok);
+	return ok ? SW_OK : SW_ERR;
+}
+
+static int coroutine_test_pipe[2];
+static int coroutine_test_order[8];
+static int coroutine_test_n;
+
+static void coroutine_test_sleeper(void *arg)
+{
+	swCoroutine_sleep((int) (long) arg);
+	coroutine_test_order[coroutine_test_n++] = (int) (long) arg;
+}
+
+static void coroutine_test_reader(void *arg)
+{
+	char buf[8];
+	//写端30ms后写入
+	if (swCoroutine_wait_fd(coroutine_test_pipe[0], SW_EVENT_READ, 1000) == SW_OK && read(coroutine_test_pipe[0], buf, sizeof(buf)) == 5)
+	{
+		coroutine_test_order[coroutine_test_n++] = 100;
+	}
+	//没有数据, 20ms后超时
+	if (swCoroutine_wait_fd(coroutine_test_pipe[0], SW_EVENT_READ, 20) < 0 && errno == ETIMEDOUT)
+	{
+		coroutine_test_order[coroutine_test_n++] = 200;
+	}
+}
+
+static void coroutine_test_writer(void *arg)
+{
+	swCoroutine_sleep(30);
+	write(coroutine_test_pipe[1], "hello", 5);
+}
+
+static void coroutine_test_onFinish(swReactor *reactor)
+{
+	if (swCoroutine_num() == 0)
+	{
+		SwooleG.running = 0;
+	}
+}
+
+swUnitTest(coroutine_test)
+{
+	swReactor reactor;
+	struct timeval timeo;
+	int ok;
+
+	bzero(&reactor, sizeof(reactor));
+	if (swReactor_auto(&reactor, 16) < 0 || pipe(coroutine_test_pipe) < 0)
+	{
+		return SW_ERR;
+	}
+	swSetNonBlock(coroutine_test_pipe[0]);
+	reactor.onFinish = coroutine_test_onFinish;
+	SwooleG.main_reactor = &reactor;
+	SwooleG.running = 1;
+
+	//每个协程执行到第一次等待就返回, 之后由reactor按事件顺序恢复
+	swCoroutine_create(coroutine_test_sleeper, (void *) 40);
+	swCoroutine_create(coroutine_test_sleeper, (void *) 10);
+	swCoroutine_create(coroutine_test_reader, NULL);
+	swCoroutine_create(coroutine_test_writer, NULL);
+	ok = swCoroutine_num() == 4 && coroutine_test_n == 0;
+
+	timeo.tv_sec = 1;
+	timeo.tv_usec = 0;
+	reactor.wait(&reactor, &timeo);
+	SwooleG.running = 1;
+
+	ok = ok && coroutine_test_n == 4 && coroutine_test_order[0] == 10 && coroutine_test_order[1] == 100
+			&& coroutine_test_order[2] == 40 && coroutine_test_order[3] == 200 && swCoroutine_num() == 0;
+	printf("Coroutine: order=%d,%d,%d,%d|ok=%d\n", coroutine_test_order[0], coroutine_test_order[1],
+			coroutine_test_order[2], coroutine_test_order[3], ok);
+
+	reactor.free(&reactor);
+	swTimer_free(&SwooleG.timer);
+	bzero(&SwooleG.timer, sizeof(SwooleG.timer));
+	SwooleG.main_reactor = NULL;
+	swCoroutine_free();
+	close(coroutine_test_pipe[0]);
+	close(coroutine_test_pipe[1]);
+	return ok ? SW_OK : SW_ERR;
+}
+
+swUnitTest(redis_test)
+{
+	char reply[] = "*3\r\n$3\r\nfoo\r\n$-1\r\n*2\r\n:-42\r\n+OK\r\n";
+	char pipeline[] = "*2\r\n$3\r\nGET\r\n$1\r\na\r\nPING\r\n";
+	swRedis_reply nodes[8];
+	uint32_t need, node_num, i;
+	int ok = 1, n, len = sizeof(reply) - 1;
+
+	//每个不完整的前缀都需要等待更多数据
+	for (i = 0; i < len; i++)
+	{
+		if (swRedis_reply_length(reply, i, &need, &node_num) != 0)
+		{
+			ok = 0;
+		}
+	}
+	n = swRedis_reply_length(reply, len, &need, &node_num);
+	ok = ok && n == len && node_num == 6;
+	swRedis_reply_parse(reply, nodes);
+	ok = ok && nodes[0].type == SW_REDIS_REPLY_ARRAY && nodes[0].element_num == 3
+			&& nodes[0].elements[0].type == SW_REDIS_REPLY_STRING && memcmp(nodes[0].elements[0].str, "foo", 3) == 0
+			&& nodes[0].elements[1].type == SW_REDIS_REPLY_NIL
+			&& nodes[0].elements[2].element_num == 2 && nodes[0].elements[2].elements[0].integer == -42
+			&& nodes[0].elements[2].elements[1].type == SW_REDIS_REPLY_STATUS && nodes[0].elements[2].elements[1].len == 2;
+
+	//大的bulk string返回需要的长度
+	ok = ok && swRedis_reply_length("$10\r\nab", 7, &need, &node_num) == 0 && need == 17;
+	ok = ok && swRedis_reply_length("$3\r\nfoo\n\n", 9, &need, &node_num) == SW_ERR;
+	ok = ok && swRedis_reply_length("?\r\n", 3, &need, &node_num) == SW_ERR;
+
+	n = swRedis_request_length(pipeline, sizeof(pipeline) - 1, &need);
+	ok = ok && n == 20 && swRedis_request_length(pipeline + n, sizeof(pipeline) - 1 - n, &need) == 6;
+	ok = ok && swRedis_request_length("PIN", 3, &need) == 0;
+
+	printf("Redis: reply=%d|nodes=%d|ok=%d\n", swRedis_reply_length(reply, len, &need, &node_num), node_num, ok);
+	return ok ? SW_OK : SW_ERR;
+}
+
+static int websocket_offer(char *extensions)
+{
+	char req_buf[sizeof(swHttpRequest) + SW_HTTP_HEADER_NUM * sizeof(swHttp_header)];
+	swHttpRequest *req = (swHttpRequest *) req_buf;
+	char request[512];
+	int n = snprintf(request, sizeof(request), "GET / HTTP/1.1\r\nHost: x\r\nSec-WebSocket-Extensions: %s\r\n\r\n", extensions);
+
+	if (swHttpRequest_parse(req, request, n) != SW_OK)
+	{
+		return -1;
+	}
+	return swWebSocket_accept_deflate(req, request);
+}
+
+swUnitTest(websocket_deflate_test)
+{
+	int ok = 1;
+
+	ok = ok && websocket_offer("permessage-deflate") == SW_TRUE;
+	ok = ok && websocket_offer("x-webkit-deflate-frame, permessage-deflate; client_max_window_bits") == SW_TRUE;
+	ok = ok && websocket_offer("permessage-deflate; client_max_window_bits=10; server_no_context_takeover") == SW_TRUE;
+	//需要确认服务端窗口大小的offer不接受, 继续检查下一个
+	ok = ok && websocket_offer("permessage-deflate; server_max_window_bits=10") == SW_FALSE;
+	ok = ok && websocket_offer("permessage-deflate; server_max_window_bits=10, permessage-deflate") == SW_TRUE;
+	ok = ok && websocket_offer("permessage-deflate-x; foo") == SW_FALSE;
+
+#ifdef SW_USE_ZLIB
+	{
+		char data[4096];
+		char compressed[4096];
+		uint32_t length;
+		swString *out;
+		int i;
+
+		for (i = 0; i < sizeof(data); i++)
+		{
+			data[i] = "swoole websocket "[i % 17];
+		}
+		out = swWebSocket_deflate(data, sizeof(data), 6);
+		ok = ok && out != NULL && out->length < sizeof(data) / 10;
+		length = out ? out->length : 0;
+		memcpy(compressed, out ? out->str : "", length);
+		//每个消息独立压缩, 第二次的结果相同
+		out = swWebSocket_deflate(data, sizeof(data), 6);
+		ok = ok && out != NULL && out->length == length && memcmp(out->str, compressed, length) == 0;
+		out = swWebSocket_inflate(compressed, length, sizeof(data));
+		ok = ok && out != NULL && out->length == sizeof(data) && memcmp(out->str, data, sizeof(data)) == 0;
+		//超过max_length
+		ok = ok && swWebSocket_inflate(compressed, length, 1024) == NULL && errno == E2BIG;
+		printf("WebSocket: deflate %d -> %d\n", (int) sizeof(data), length);
+	}
+#endif
+	printf("WebSocket: ok=%d\n", ok);
+	return ok ? SW_OK : SW_ERR;
+}
+
+static int uring_test_pair[3][2];
+static int uring_test_reads;
+static int uring_test_eof;
+static time_t uring_test_deadline;
+
+static int uring_test_onRead(swReactor *reactor, swEvent *ev)
+{
+	char buf[8];
+
+	if (read(ev->fd, buf, sizeof(buf)) <= 0)
+	{
+		return SW_OK;
+	}
+	uring_test_reads++;
+	if (ev->fd == uring_test_pair[0][0] && uring_test_reads == 1)
+	{
+		//还在等待事件的fd, 关闭后对端马上能看到EOF, poll请求不能再持有文件的引用
+		reactor->del(reactor, uring_test_pair[2][0]);
+		uring_test_eof = recv(uring_test_pair[2][1], buf, sizeof(buf), MSG_DONTWAIT) == 0;
+		//新的socket复用同一个fd
+		socketpair(AF_UNIX, SOCK_STREAM, 0, uring_test_pair[1]);
+		reactor->add(reactor, uring_test_pair[1][0], SW_FD_USER | SW_EVENT_READ);
+		write(uring_test_pair[1][1], "y", 1);
+	}
+	else
+	{
+		SwooleG.running = 0;
+	}
+	return SW_OK;
+}
+
+static void uring_test_onTimeout(swReactor *reactor)
+{
+	if (time(NULL) > uring_test_deadline)
+	{
+		SwooleG.running = 0;
+	}
+}
+
+swUnitTest(uring_test)
+{
+#if defined(HAVE_IO_URING)
+	swReactor reactor;
+	struct timeval timeo = {1, 0};
+	int ok;
+
+	bzero(&reactor, sizeof(reactor));
+	if (swReactorUring_create(&reactor, 16) < 0)
+	{
+		printf("Uring: not supported by kernel, skip\n");
+		return SW_OK;
+	}
+	socketpair(AF_UNIX, SOCK_STREAM, 0, uring_test_pair[0]);
+	socketpair(AF_UNIX, SOCK_STREAM, 0, uring_test_pair[2]);
+	reactor.setHandle(&reactor, SW_FD_USER, uring_test_onRead);
+	reactor.onTimeout = uring_test_onTimeout;
+	reactor.add(&reactor, uring_test_pair[0][0], SW_FD_USER | SW_EVENT_READ);
+	reactor.add(&reactor, uring_test_pair[2][0], SW_FD_USER | SW_EVENT_READ);
+	write(uring_test_pair[0][1], "x", 1);
+
+	uring_test_deadline = time(NULL) + 3;
+	SwooleG.running = 1;
+	reactor.wait(&reactor, &timeo);
+	reactor.free(&reactor);
+
+	ok = uring_test_reads == 2 && uring_test_eof && uring_test_pair[1][0] == uring_test_pair[2][0];
+	printf("Uring: reads=%d|eof=%d|reuse=%d|ok=%d\n", uring_test_reads, uring_test_eof,
+			uring_test_pair[1][0] == uring_test_pair[2][0], ok);
+	close(uring_test_pair[0][0]);
+	close(uring_test_pair[0][1]);
+	close(uring_test_pair[1][0]);
+	close(uring_test_pair[1][1]);
+	close(uring_test_pair[2][1]);
+	return ok ? SW_OK : SW_ERR;
+#else
+	printf("Uring: not compiled, skip\n");
+	return SW_OK;
+#endif
+}
@@ -14,17 +14,40 @@ int main(int argc, char **argv)
 	swUnitTest_steup(mem_test1, 1);
 	swUnitTest_steup(mem_test2, 1);
 	swUnitTest_steup(mem_test3, 1);
+	swUnitTest_steup(mem_test4, 1);
+	swUnitTest_steup(mem_test5, 1);
+	swUnitTest_steup(mem_test6, 1);
 
 	swUnitTest_steup(server_test, 1);
 	swUnitTest_steup(client_test, 1);
+	swUnitTest_steup(stats_test, 1);
+	swUnitTest_steup(direct_send_test, 1);
+	swUnitTest_steup(udp_peer_test, 1);
 
 	swUnitTest_steup(chan_test, 1);
+	swUnitTest_steup(ringbuffer_test, 1);
+	swUnitTest_steup(recv_ring_test, 1);
+	swUnitTest_steup(timer_test, 1);
+	swUnitTest_steup(mpmc_test, 1);
+	swUnitTest_steup(mpsc_test, 1);
+	swUnitTest_steup(table_test, 1);
+	swUnitTest_steup(futexlock_test, 1);
+	swUnitTest_steup(brlock_test, 1);
+	swUnitTest_steup(ready_test, 1);
+	swUnitTest_steup(histogram_test, 1);
+	swUnitTest_steup(slowlog_test, 1);
+	swUnitTest_steup(coroutine_test, 1);
+	swUnitTest_steup(uring_test, 1);
+	swUnitTest_steup(redis_test, 1);
+	swUnitTest_steup(websocket_deflate_test, 1);
 
 	swUnitTest_steup(ds_test2, 1);
 	swUnitTest_steup(hashmap_test1, 1);
+	swUnitTest_steup(hashmap_test2, 1);
 
 	swUnitTest_steup(u1_test1, 1);
 	swUnitTest_steup(u1_test2, 1);
+	swUnitTest_steup(log_test, 1);
 
 	swUnitTest_steup(aio_test, 1);
 	swUnitTest_steup(aio_test2, 1);
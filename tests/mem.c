@@ -132,3 +132,188 @@ swUnitTest(mem_test3)
 	alloc->destroy(alloc);
 	return 0;
 }
+
+swUnitTest(mem_test4)
+{
+	int size = 1024 * 1024;
+	swAllocator *arena = swMemoryArena_create(size);
+	if (arena == NULL)
+	{
+		swWarn("swMemoryArena_create fail");
+		return SW_ERR;
+	}
+	int i, j, n, ok = 1;
+	int loop = 100000;
+	char *m[16];
+	int len[16];
+	bzero(m, sizeof(m));
+
+	//随机长度分配和释放,释放前检查内容没有被其他块覆盖,最后必须能重新分配出整块内存
+	for (i = 0; i < loop; i++)
+	{
+		n = rand() % 16;
+		if (m[n] != NULL)
+		{
+			for (j = 0; j < len[n]; j++)
+			{
+				if (m[n][j] != (char) n)
+				{
+					ok = 0;
+					break;
+				}
+			}
+			arena->free(arena, m[n]);
+			m[n] = NULL;
+		}
+		else
+		{
+			len[n] = 1 + rand() % (size / 32);
+			m[n] = arena->alloc(arena, len[n]);
+			if (m[n] != NULL)
+			{
+				memset(m[n], n, len[n]);
+			}
+		}
+	}
+	for (n = 0; n < 16; n++)
+	{
+		if (m[n] != NULL)
+		{
+			arena->free(arena, m[n]);
+		}
+	}
+	m[0] = arena->alloc(arena, size - 8);
+	printf("MemoryArena: alloc %d times, content %s, merge %s\n", loop, ok ? "ok" : "fail", m[0] != NULL ? "ok" : "fail");
+	arena->destroy(arena);
+	return ok && m[0] != NULL ? SW_OK : SW_ERR;
+}
+
+/**
+ * 随机分配释放, 结束时全部释放并归还线程缓存
+ */
+static int mem_test5_round(swAllocator *gm, int seed, int tag)
+{
+	char *m[64];
+	int len[64];
+	int i, n, j, ok = 1;
+
+	bzero(m, sizeof(m));
+	srand(seed);
+	for (i = 0; i < 50000; i++)
+	{
+		n = rand() % 64;
+		if (m[n] != NULL)
+		{
+			for (j = 0; j < len[n]; j++)
+			{
+				if (m[n][j] != (char) (n + tag))
+				{
+					ok = 0;
+				}
+			}
+			gm->free(gm, m[n]);
+			m[n] = NULL;
+		}
+		else
+		{
+			len[n] = (rand() % 8 == 0) ? 1 + rand() % (256 * 1024) : 1 + rand() % 2048;
+			m[n] = gm->alloc(gm, len[n]);
+			if (m[n] == NULL)
+			{
+				ok = 0;
+				continue;
+			}
+			memset(m[n], n + tag, len[n]);
+		}
+	}
+	for (n = 0; n < 64; n++)
+	{
+		if (m[n] != NULL)
+		{
+			gm->free(gm, m[n]);
+		}
+	}
+	swMemoryGlobal_thread_flush();
+	return ok;
+}
+
+swUnitTest(mem_test5)
+{
+	swAllocator *gm = swMemoryGlobal_create(1024 * 1024 * 64, 1);
+	swMemoryGlobal *global = gm->object;
+	int i, ok, status;
+	size_t offset = 0;
+	pid_t pid;
+
+	//子进程和父进程同时分配释放, 内容不能被对方覆盖
+	pid = fork();
+	ok = mem_test5_round(gm, pid == 0 ? 1 : 2, pid == 0 ? 1 : 2);
+	if (pid == 0)
+	{
+		_exit(ok ? 0 : 1);
+	}
+	waitpid(pid, &status, 0);
+	//全部释放后重复同样的分配序列, 空闲块必须被复用, 占用的内存不增长
+	for (i = 0; i < 4; i++)
+	{
+		ok = mem_test5_round(gm, 3, 3) && ok;
+		if (i == 0)
+		{
+			offset = global->offset;
+		}
+	}
+	printf("MemoryGlobal: offset=%ld|after=%ld|ok=%d|child=%d\n", (long) offset, (long) global->offset, ok, WEXITSTATUS(status));
+	ok = ok && WEXITSTATUS(status) == 0 && global->offset == offset;
+	gm->destroy(gm);
+	return ok ? SW_OK : SW_ERR;
+}
+
+static void* mem_test6_thread(void *arg)
+{
+	swAllocator *gm = arg;
+	void *m[SW_MEMORY_CACHE_NUM];
+	int i;
+
+	for (i = 0; i < SW_MEMORY_CACHE_NUM; i++)
+	{
+		m[i] = gm->alloc(gm, 100);
+	}
+	for (i = 0; i < SW_MEMORY_CACHE_NUM; i++)
+	{
+		gm->free(gm, m[i]);
+	}
+	return NULL;
+}
+
+swUnitTest(mem_test6)
+{
+	swAllocator *gm = swMemoryGlobal_create(1024 * 1024 * 8, 1);
+	swMemoryGlobal *global = gm->object;
+	size_t offset = 0;
+	pthread_t tid;
+	pid_t pid;
+	int i, status;
+
+	//线程和worker进程退出时归还缓存的块, 反复重启后占用的内存不增长
+	for (i = 0; i < 20; i++)
+	{
+		pthread_create(&tid, NULL, mem_test6_thread, gm);
+		pthread_join(tid, NULL);
+		pid = fork();
+		if (pid == 0)
+		{
+			mem_test6_thread(gm);
+			swMemoryGlobal_thread_flush();
+			_exit(0);
+		}
+		waitpid(pid, &status, 0);
+		if (i == 0)
+		{
+			offset = global->offset;
+		}
+	}
+	printf("MemoryGlobal: offset=%ld|after=%ld\n", (long) offset, (long) global->offset);
+	i = global->offset == offset ? SW_OK : SW_ERR;
+	gm->destroy(gm);
+	return i;
+}
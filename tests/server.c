@@ -130,3 +130,197 @@ void my_onClose(swServer *serv, int fd, int from_id)
 {
 	printf("Close fd=%d|from_id=%d\n", fd, from_id);
 }
+
+swUnitTest(stats_test)
+{
+	swServer serv;
+	swString *buf;
+	int ok;
+
+	bzero(&serv, sizeof(serv));
+	serv.reactor_num = 2;
+	serv.worker_num = 2;
+	serv.task_worker_num = 1;
+	if (swServer_stats_create(&serv) < 0)
+	{
+		return SW_ERR;
+	}
+	ok = ((uintptr_t) serv.reactor_stats % SW_CACHELINE_SIZE) == 0 && sizeof(swWorkerStats) == SW_CACHELINE_SIZE;
+	swServer_reactor_stats_add(&serv, 1, recv_bytes, 100);
+	swServer_worker_stats_add(&serv, 2, dispatch_count, 3);
+	swServer_worker_stats_add(&serv, 2, request_count, 1);
+
+	buf = swString_new(64);
+	swServer_stats_dump(&serv, buf);
+	ok = ok && swoole_strnpos(buf->str, buf->length, "swoole_reactor_recv_bytes_total{reactor=\"1\"} 100\n", 49) >= 0;
+	ok = ok && swoole_strnpos(buf->str, buf->length, "swoole_worker_inflight{worker=\"2\",type=\"task\"} 2\n", 49) >= 0;
+	printf("Stats: length=%d|ok=%d\n", (int) buf->length, ok);
+	swString_free(buf);
+	return ok ? SW_OK : SW_ERR;
+}
+
+static int direct_send_onReceive(swFactory *factory, swEventData *req)
+{
+	swServer *serv = factory->ptr;
+	char *big;
+
+	//大响应一次发不完, 剩余部分进入out_buffer等待可写
+	if (req->info.len >= 3 && memcmp(req->data, "big", 3) == 0)
+	{
+		big = sw_malloc(1024 * 1024);
+		memset(big, 'x', 1024 * 1024);
+		swServer_tcp_send(serv, req->info.fd, big, 1024 * 1024);
+		sw_free(big);
+		return SW_OK;
+	}
+	swServer_tcp_send(serv, req->info.fd, req->data, req->info.len);
+	return SW_OK;
+}
+
+static int direct_send_recv(int fd, char *buf, int length)
+{
+	int n, total = 0;
+	while (total < length && (n = recv(fd, buf + total, length - total, 0)) > 0)
+	{
+		total += n;
+	}
+	return total;
+}
+
+/**
+ * direct_send开启时响应由reactor线程直接发送, reactor_pipe_num > 1时响应要回到连接所在的reactor线程
+ */
+swUnitTest(direct_send_test)
+{
+	struct sockaddr_in addr;
+	struct timeval timeo = {5, 0};
+	char buf[1024 * 1024], msg[32];
+	int fds[8], i, j, n, ok = 1, status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0)
+	{
+		swServer serv;
+		setpgid(0, 0);
+		swServer_init(&serv);
+		serv.reactor_num = 2;
+		serv.worker_num = 4;
+		serv.factory_mode = SW_MODE_PROCESS;
+		serv.direct_send = 1;
+		serv.onReceive = direct_send_onReceive;
+		if (swServer_create(&serv) < 0 || swServer_addListen(&serv, SW_SOCK_TCP, "127.0.0.1", 9507) < 0)
+		{
+			_exit(1);
+		}
+		swServer_start(&serv);
+		_exit(0);
+	}
+
+	bzero(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(9507);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	for (i = 0; i < 8; i++)
+	{
+		fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		setsockopt(fds[i], SOL_SOCKET, SO_RCVTIMEO, &timeo, sizeof(timeo));
+		//等待服务器启动
+		for (j = 0; j < 100 && connect(fds[i], (struct sockaddr *) &addr, sizeof(addr)) < 0; j++)
+		{
+			close(fds[i]);
+			fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+			setsockopt(fds[i], SOL_SOCKET, SO_RCVTIMEO, &timeo, sizeof(timeo));
+			usleep(20000);
+		}
+	}
+	for (j = 0; j < 10; j++)
+	{
+		for (i = 0; i < 8; i++)
+		{
+			n = snprintf(msg, sizeof(msg), "hello-%d-%d", i, j);
+			send(fds[i], msg, n, 0);
+			if (direct_send_recv(fds[i], buf, n) != n || memcmp(buf, msg, n) != 0)
+			{
+				ok = 0;
+			}
+		}
+	}
+	send(fds[0], "big", 3, 0);
+	usleep(100000);
+	if (direct_send_recv(fds[0], buf, sizeof(buf)) != sizeof(buf) || buf[sizeof(buf) - 1] != 'x')
+	{
+		ok = 0;
+	}
+	for (i = 0; i < 8; i++)
+	{
+		close(fds[i]);
+	}
+	kill(-pid, SIGKILL);
+	waitpid(pid, &status, 0);
+	printf("DirectSend: ok=%d\n", ok);
+	return ok ? SW_OK : SW_ERR;
+}
+
+#define UDP_PEER_TEST_PROCS  4
+#define UDP_PEER_TEST_N      500
+
+/**
+ * base模式下多个worker进程同时插入同一批地址, 每个地址只能占一个槽位
+ */
+swUnitTest(udp_peer_test)
+{
+	swUdpPeerTable *table = swUdpPeerTable_new(4096);
+	struct sockaddr_in addr;
+	swUdpPeer peer;
+	int *fds, i, j, k, fd, status, ok = 1;
+	pid_t pids[UDP_PEER_TEST_PROCS];
+
+	fds = sw_shm_calloc(UDP_PEER_TEST_PROCS * UDP_PEER_TEST_N, sizeof(int));
+	if (table == NULL || fds == NULL)
+	{
+		return SW_ERR;
+	}
+	bzero(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("10.0.0.1");
+	for (i = 0; i < UDP_PEER_TEST_PROCS; i++)
+	{
+		pids[i] = fork();
+		if (pids[i] == 0)
+		{
+			for (j = 0; j < UDP_PEER_TEST_N; j++)
+			{
+				//每个进程的插入顺序不同
+				k = (j * 7 + i * 131) % UDP_PEER_TEST_N;
+				addr.sin_port = htons(10000 + k);
+				fds[i * UDP_PEER_TEST_N + k] = swUdpPeerTable_intern(table, (struct sockaddr *) &addr, sizeof(addr));
+			}
+			_exit(0);
+		}
+	}
+	for (i = 0; i < UDP_PEER_TEST_PROCS; i++)
+	{
+		waitpid(pids[i], &status, 0);
+	}
+	for (k = 0; k < UDP_PEER_TEST_N; k++)
+	{
+		addr.sin_port = htons(10000 + k);
+		fd = swUdpPeerTable_intern(table, (struct sockaddr *) &addr, sizeof(addr));
+		if (swUdpPeerTable_get(table, fd, &peer) < 0 || peer.addr.inet_v4.sin_port != addr.sin_port)
+		{
+			ok = 0;
+		}
+		for (i = 0; i < UDP_PEER_TEST_PROCS; i++)
+		{
+			if (fds[i * UDP_PEER_TEST_N + k] != fd)
+			{
+				ok = 0;
+			}
+		}
+	}
+	printf("UdpPeer: procs=%d|n=%d|ok=%d\n", UDP_PEER_TEST_PROCS, UDP_PEER_TEST_N, ok);
+	sw_shm_free(fds);
+	sw_shm_free(table);
+	return ok ? SW_OK : SW_ERR;
+}
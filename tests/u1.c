@@ -106,3 +106,54 @@ swUnitTest(u1_test1)
 	}
 	return 0;
 }
+
+static void* log_test_thread(void *arg)
+{
+	int i;
+	for (i = 0; i < 2000; i++)
+	{
+		swWarn("log test %ld-%d", (long) arg, i);
+	}
+	return NULL;
+}
+
+swUnitTest(log_test)
+{
+	char *file = "/tmp/swoole_log_test.log";
+	char line[1024];
+	pthread_t threads[4];
+	long i;
+	int lines = 0, suppressed = 0;
+	FILE *fp;
+
+	unlink(file);
+	if (swLog_init(file) < 0)
+	{
+		return SW_ERR;
+	}
+	//每秒超过SW_LOG_RATE_LIMIT条的日志会被丢弃
+	for (i = 0; i < 4; i++)
+	{
+		pthread_create(&threads[i], NULL, log_test_thread, (void *) i);
+	}
+	for (i = 0; i < 4; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	sleep(1);
+	swWarn("log test end");
+	swLog_free();
+
+	fp = fopen(file, "r");
+	while (fp && fgets(line, sizeof(line), fp))
+	{
+		lines++;
+		suppressed += (strstr(line, "messages suppressed") != NULL);
+	}
+	if (fp)
+	{
+		fclose(fp);
+	}
+	printf("Log: lines=%d|suppressed=%d\n", lines, suppressed);
+	return (lines > 0 && lines <= SW_LOG_RATE_LIMIT * 2 + 2 && (SW_LOG_RATE_LIMIT == 0 || suppressed > 0)) ? SW_OK : SW_ERR;
+}